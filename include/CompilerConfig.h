@@ -30,6 +30,88 @@ struct CompilerConfig {
         unsigned matrixDimLimit = 1024;        // Maximum supported matrix dimension
     };
     
+    // Tiled code generation parameters
+    // A dimension of 0 means "derive from the architecture parameters"
+    struct TilingParams {
+        // Nesting of the loops over tiles (i, j) and slices (k)
+        enum LoopOrder {
+            ORDER_IJK = 0,                     // Each tile accumulates in a register over all its slices
+            ORDER_IKJ,                         // A slices stay resident across a row of tiles
+            ORDER_JKI                          // B slices stay resident across a column of tiles
+        };
+        
+        bool enabled = true;                   // Tile matrices that exceed the PE array
+        unsigned tileRows = 0;                 // Rows of C per tile
+        unsigned tileCols = 0;                 // Columns of C per tile
+        unsigned tileDepth = 0;                // Common-dimension slice per tile
+        bool doubleBuffering = true;           // Load the next slice while the current one computes
+        LoopOrder order = ORDER_IJK;           // ikj and jki keep partial sums of C in PE-local memory
+    };
+    
+    // Memory layout parameters
+    struct LayoutParams {
+        // How the hardware maps a PIM word address to a memory bank
+        enum BankHashing {
+            BANK_HASH_LINEAR = 0,              // Contiguous: bank = address / words per bank
+            BANK_HASH_INTERLEAVED,             // Low-order interleave: bank = address % numMemoryBanks
+            BANK_HASH_XOR                      // XOR swizzle of the interleaved bank with the next address bits
+        };
+        
+        bool enabled = true;                   // Plan bank-aware layouts (off: A, B, C row-major back to back)
+        BankHashing bankHashing = BANK_HASH_INTERLEAVED;
+    };
+    
+    // Distribution of untiled kernels over per-PE instruction streams
+    struct SchedulingParams {
+        // How the output matrix C is partitioned across the PEs
+        enum Strategy {
+            SCHEDULE_AUTO = 0,                 // Cheapest partition under the cost model
+            SCHEDULE_ROW_BLOCK,                // Each PE owns a band of rows
+            SCHEDULE_COLUMN_BLOCK,             // Each PE owns a band of columns
+            SCHEDULE_BLOCK_2D                  // Each PE owns a rectangular block
+        };
+        
+        bool enabled = false;                  // Schedule untiled kernels across PEs (off: a single PE)
+        Strategy strategy = SCHEDULE_AUTO;
+    };
+    
+    // Distribution of kernels over several PIM devices or channels
+    struct ShardingParams {
+        // How A, B and C are partitioned across the devices
+        enum Strategy {
+            SHARD_AUTO = 0,                    // Cheapest partition under the traffic model
+            SHARD_ROWS,                        // Each device owns a band of rows of A and C; B is replicated
+            SHARD_COLUMNS,                     // Each device owns a band of columns of B and C; A is replicated
+            SHARD_COMMON,                      // Each device multiplies a slice of the common dimension; the host reduces C
+            SHARD_2D,                          // Each device owns a block of C; the host replicates A and B blocks
+            SHARD_SUMMA                        // 2D blocks of C; A and B panels are loaded once and broadcast between devices
+        };
+        
+        unsigned devices = 1;                  // PIM devices (1: every kernel runs on one device)
+        Strategy strategy = SHARD_AUTO;
+    };
+    
+    // Search of tile shape, loop order and PE schedule per kernel shape
+    struct TuningParams {
+        bool enabled = false;                  // Choose the code generation parameters of every kernel by search
+        std::string database;                  // File of tuning results; empty keeps them for the process only
+    };
+    
+    // On-disk compilation cache parameters
+    struct CacheParams {
+        std::string directory;                 // Cache location; empty disables the cache
+        unsigned long long maxBytes = 256ull << 20;  // Size bound enforced by evicting least recently used entries
+    };
+    
+    // Matrix dimensions to assume when they cannot be inferred from the IR
+    // A dimension of 0 means "unknown"
+    struct MatrixDimensions {
+        unsigned rows = 0;                     // Rows of A and C
+        unsigned cols = 0;                     // Columns of B and C
+        unsigned common = 0;                   // Columns of A, rows of B
+        unsigned batch = 0;                    // Products of a batched kernel
+    };
+    
     // Default configuration
     static CompilerConfig getDefaultConfig() {
         CompilerConfig config;
@@ -37,6 +119,12 @@ struct CompilerConfig {
         config.outputFormat = "text";
         config.verboseOutput = false;
         config.enableMemoryMapping = true;
+        config.enableRegisterAllocation = true;
+        config.symbolicDimensions = false;
+        config.compileJobs = 1;
+        config.precision = 32;
+        config.isaVersion = 2;
+        config.coalesceTransfers = true;
         return config;
     }
     
@@ -45,7 +133,22 @@ struct CompilerConfig {
     std::string outputFormat = "text";         // "text" or "binary"
     bool verboseOutput = false;
     bool enableMemoryMapping = true;
+    bool enableRegisterAllocation = true;      // Keep accumulators register-resident
+    bool foldConstantWeights = true;           // Carry a constant B in the program, folding its 0, +-1 and +-2^n
+    bool symbolicDimensions = false;           // Emit one looped program for all matrix sizes
+    unsigned compileJobs = 1;                  // Threads lowering functions in parallel (1 = serial)
+    unsigned precision = 32;                   // Bits per A/B element: 8 or 16 pack several elements per word
+    unsigned isaVersion = 2;                   // Instruction encoding: 2 (64-bit, MAC and block transfers) or 1 (32-bit)
+    bool coalesceTransfers = true;             // Merge runs of LOADs/STOREs into block transfers (ISA version 2)
+    bool linkKernels = true;                   // Keep operands shared by the kernels of one module resident in PIM memory
     PIMArchParams archParams;
+    TilingParams tiling;
+    LayoutParams layout;
+    SchedulingParams scheduling;
+    ShardingParams sharding;
+    TuningParams tuning;
+    CacheParams cache;
+    MatrixDimensions assumedDimensions;
 };
 
 #endif // COMPILER_CONFIG_H
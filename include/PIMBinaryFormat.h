@@ -0,0 +1,74 @@
+/**
+ * PIMBinaryFormat.h
+ * Defines the binary container format for compiled PIM programs
+ */
+
+#ifndef PIM_BINARY_FORMAT_H
+#define PIM_BINARY_FORMAT_H
+
+#include <cstdint>
+
+/**
+ * PIM Binary Container
+ * 
+ * All multi-byte fields are little-endian.
+ * 
+ * [0, HEADER_SIZE)                 PIMBinaryHeader
+ * [textOffset, textOffset+text)    Instruction words (instructionWordSize bytes each)
+ * [dataOffset, dataOffset+data)    Data section (optional, dataSize may be 0)
+ * 
+ * Sections start on SECTION_ALIGNMENT byte boundaries so a runtime can mmap
+ * the file and use the instruction words in place.
+ * 
+ * The container version is the ISA version of its instructions: VERSION
+ * containers hold 32-bit PIMInstructionFormat words, VERSION_EXTENDED
+ * containers 64-bit PIMExtendedFormat words.
+ * 
+ * The data section holds the constant matrices selected by
+ * PIM_CONFIG_CONSTANT_B as 32-bit words, cut into blocks of
+ * DATA_BLOCK_ROWS x DATA_BLOCK_COLS words of which identical ones are
+ * stored once:
+ * 
+ * uint32 matrixCount, uint32 blockCount
+ * matrixCount x {uint32 rows, uint32 cols}
+ * Block table: per matrix, the pool index of each of its blocks (row-major)
+ * blockCount pool blocks of row-major words, zero past the matrix edge
+ */
+struct PIMBinaryFormat {
+    static const uint32_t MAGIC = 0x424D4950;        // "PIMB" in file byte order
+    static const uint32_t VERSION = 1;
+    static const uint32_t VERSION_EXTENDED = 2;
+    static const uint32_t HEADER_SIZE = 64;
+    static const uint32_t SECTION_ALIGNMENT = 16;
+    static const uint32_t DATA_BLOCK_ROWS = 8;
+    static const uint32_t DATA_BLOCK_COLS = 8;
+};
+
+/**
+ * PIM Binary Header
+ * Fixed-size header at the start of every PIM binary
+ */
+struct PIMBinaryHeader {
+    uint32_t magic;                  // PIMBinaryFormat::MAGIC
+    uint32_t version;                // PIMBinaryFormat::VERSION or VERSION_EXTENDED
+    uint32_t headerSize;             // Size of this header in bytes
+    uint32_t instructionWordSize;    // Size of one instruction word in bytes
+    
+    // Architecture the program was compiled for
+    uint32_t numProcessingElements;
+    uint32_t memoryBankSize;
+    uint32_t numMemoryBanks;
+    uint32_t registerFileSize;
+    uint32_t wordSize;
+    
+    uint32_t instructionCount;       // Number of instruction words
+    uint32_t textOffset;             // Byte offset of the instruction section
+    uint32_t textSize;               // Size of the instruction section in bytes
+    uint32_t dataOffset;             // Byte offset of the data section
+    uint32_t dataSize;               // Size of the data section in bytes
+    uint32_t reserved[2];            // Must be zero
+};
+
+static_assert(sizeof(PIMBinaryHeader) == PIMBinaryFormat::HEADER_SIZE, "PIMBinaryHeader layout mismatch");
+
+#endif // PIM_BINARY_FORMAT_H
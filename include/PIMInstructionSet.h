@@ -31,7 +31,11 @@ enum PIMOpcode {
     PIM_JUMP,        // Unconditional jump
     PIM_JUMPZ,       // Jump if zero
     PIM_JUMPNZ,      // Jump if not zero
-    PIM_CONFIG       // Configure PIM parameters
+    PIM_CONFIG,      // Configure PIM parameters
+    PIM_SYNC,        // Barrier: wait until every PE has completed its outstanding work
+    PIM_MAC,         // Multiply-accumulate: dest = dest + src1 * src2
+    PIM_LOAD_BLOCK,  // Burst load of consecutive host words (see PIM Block Transfers)
+    PIM_STORE_BLOCK  // Burst store of consecutive PIM words to host memory
 };
 
 /**
@@ -59,7 +63,197 @@ enum PIMConfigParam {
     PIM_CONFIG_ARRAY_SIZE = 0,    // Size of the PIM processing array
     PIM_CONFIG_OP_MODE,           // Operation mode
     PIM_CONFIG_PRECISION,         // Precision (e.g., 8-bit, 16-bit, 32-bit)
-    PIM_CONFIG_INTERCONNECT       // Interconnect configuration
+    PIM_CONFIG_INTERCONNECT,      // Interconnect configuration
+    PIM_CONFIG_PE_STREAM,         // Start the instruction stream of one PE (see PIM PE Streams)
+    PIM_CONFIG_HOST_LAYOUT,       // How the host stores A and B (see PIM Host Operands)
+    PIM_CONFIG_BATCH,             // Select the product of a batched kernel (see PIM Host Operands)
+    PIM_CONFIG_CONSTANT_B,        // Read B from the program's data section (see PIM Host Operands)
+    PIM_CONFIG_KERNEL,            // Start one kernel of a linked program (see PIM Linked Programs)
+    PIM_CONFIG_DEVICE             // Start the program of one device (see PIM Sharded Programs)
+};
+
+/**
+ * PIM Operation Modes
+ * Values of the PIM_CONFIG_OP_MODE parameter
+ */
+enum PIMOpMode {
+    PIM_OP_MODE_STATIC = 0,       // Matrix sizes are fixed at compile time
+    PIM_OP_MODE_SYMBOLIC          // Matrix sizes are read from the launch block (see PIMLaunchLayout)
+};
+
+/**
+ * PIM Precision
+ * 
+ * CONFIG PIM_CONFIG_PRECISION, bits, lanes selects packed operands: every
+ * word of A and B holds lanes elements of bits bits (lane l in bits
+ * [l*bits, (l+1)*bits)), packed along the common dimension. A host LOAD of
+ * A [row, col] then reads A[row][col*lanes .. col*lanes+lanes) and a LOAD
+ * of B [row, col] reads B[row*lanes .. row*lanes+lanes)[col], zero-padding
+ * past the matrix edge. MUL sign-extends the lanes of both operands and
+ * writes the sum of their products as a full 32-bit word, so a MUL/ADD pair
+ * performs lanes multiply-accumulates with widening accumulation; all other
+ * operations and C stay 32-bit. A lanes value of 0 (src2) leaves the
+ * precision unchanged, which keeps the matrix size header of untiled
+ * programs (CONFIG 0, 1, 2) informational. Programs without a PRECISION
+ * configuration run at 32 bits.
+ */
+
+/**
+ * PIM PE Streams
+ * 
+ * CONFIG PIM_CONFIG_PE_STREAM, pe, batch starts the instruction stream of
+ * PE pe: the instructions up to the next stream marker or SYNC execute on
+ * that PE only. Consecutive streams run concurrently until the SYNC that
+ * closes them, which completes once every stream has finished. Inside a
+ * stream addresses are PE-local and LOAD/STORE [row, col] access host
+ * element [row][col] of product batch (packed as configured by
+ * PIM_CONFIG_PRECISION); streams contain no jumps or other CONFIG
+ * instructions.
+ */
+
+/**
+ * PIM Host Operands
+ * 
+ * CONFIG PIM_CONFIG_HOST_LAYOUT, flags declares that the host stores A
+ * (PIM_HOST_TRANSPOSE_A) or B (PIM_HOST_TRANSPOSE_B) transposed. Host
+ * transfers of such an operand give [row, col] in stored coordinates, so
+ * LOAD [k, i] reads A[i][k], and burst axes refer to the stored matrix;
+ * broadcast grid offsets and packing still follow the logical A and B.
+ * Leading dimensions are applied by the runtime when it maps [row, col] to
+ * a host address and do not appear in the program.
+ * 
+ * Batched kernels compute independent products C[b] = A[b] * B[b].
+ * CONFIG PIM_CONFIG_BATCH, b makes the host transfers of the broadcast
+ * stream address product b until the next batch selection; PE streams take
+ * their product from the stream marker. Programs without either
+ * configuration address product 0 of untransposed operands.
+ * 
+ * CONFIG PIM_CONFIG_CONSTANT_B, m makes the host transfers of B read
+ * constant matrix m - 1 of the program's data section instead of the B
+ * supplied by the host, until the next such configuration; m = 0 selects
+ * the host's B again. A constant matrix holds the logical B pre-packed:
+ * its word [row, col] is the word an untransposed LOAD B [row, col]
+ * delivers. LOADs of a transposed B swap their coordinates first, and
+ * broadcast grid offsets apply as for the host's B.
+ */
+enum PIMHostLayoutFlag {
+    PIM_HOST_TRANSPOSE_A = 1,     // A stored as its transpose (common x rows)
+    PIM_HOST_TRANSPOSE_B = 2      // B stored as its transpose (cols x common)
+};
+
+/**
+ * PIM Linked Programs
+ * 
+ * A program lowered from a module with several kernels runs them in module
+ * order, and CONFIG PIM_CONFIG_KERNEL, n starts kernel n: the host
+ * transfers up to the next kernel marker address the A, B, C and bias
+ * vectors the runtime binds to kernel n. A marker also resets the host
+ * layout, the batch and constant B selections and returns the array to a
+ * single PE. PIM memory is kept between kernels, so a kernel may read an
+ * operand an earlier kernel left in PIM memory, such as its C or a B they
+ * share, instead of loading it, and a C that only later kernels read need
+ * not be stored to the host. Programs without markers bind every transfer
+ * to the single set of host operands.
+ */
+
+/**
+ * PIM Sharded Programs
+ * 
+ * A program sharded over several PIM devices holds one program per device,
+ * each opened by CONFIG PIM_CONFIG_DEVICE, d: the instructions up to the
+ * next device marker run on device d alone, in its own PIM memory. Inside
+ * a device program CONFIG PIM_CONFIG_KERNEL, n opens the shard of kernel n
+ * the device computes, a block of rows x cols of C over a slice of the
+ * common dimension. Its host transfers address that block: LOAD A [r, k]
+ * reads A[row + r][k0 + k], LOAD B [k, c] reads B[k0 + k][col + c] and
+ * STORE [r, c] writes C[row + r][col + c] (or a partial sum of it, which
+ * the host reduces), for the origin the host schedule gives the shard;
+ * row and column vectors are offset by row and col alike. The host
+ * schedule, written next to the program, stages every block a shard reads
+ * (from the host, or from the device that received it first) before the
+ * devices reach the kernel marker, and gathers or reduces C after them.
+ */
+
+/**
+ * PIM Block Transfers
+ * 
+ * LOAD_BLOCK dest, src1 [row, col] moves count host words into PIM words
+ * dest .. dest+count-1 in one link transfer, where src1 packs the host
+ * buffer, the burst axis and count (PIMBlockOperand). Word w is the word a
+ * LOAD [row, col + w] would read, or LOAD [row + w, col] for a burst down a
+ * column. STORE_BLOCK dest, src1 [row, col] writes PIM words
+ * src1 .. src1+count-1 the same way, with dest packing the buffer, axis and
+ * count. MAC dest, src1, src2 adds src1 * src2 to dest (the widening dot
+ * product of the lanes with packed precision). These opcodes are generated
+ * for ISA version 2 only.
+ */
+enum PIMBlockAxis {
+    PIM_BLOCK_ALONG_ROW = 0,      // Word w at column col + w
+    PIM_BLOCK_DOWN_COLUMN = 1     // Word w at row row + w
+};
+
+struct PIMBlockOperand {
+    static const uint32_t BUFFER_MASK = 0x3;   // PIMHostBuffer in the low 2 bits
+    static const uint32_t AXIS_SHIFT = 2;      // PIMBlockAxis above it
+    static const uint32_t COUNT_SHIFT = 3;     // Word count in the remaining bits
+    
+    static uint32_t encode(uint32_t buffer, uint32_t count, uint32_t axis = PIM_BLOCK_ALONG_ROW) {
+        return (buffer & BUFFER_MASK) | ((axis & 1) << AXIS_SHIFT) | (count << COUNT_SHIFT);
+    }
+    
+    static uint32_t buffer(uint32_t operand) {
+        return operand & BUFFER_MASK;
+    }
+    
+    static uint32_t axis(uint32_t operand) {
+        return (operand >> AXIS_SHIFT) & 1;
+    }
+    
+    static uint32_t count(uint32_t operand) {
+        return operand >> COUNT_SHIFT;
+    }
+    
+    // Longest burst whose operand fits a field of the given width limit
+    static uint32_t maxCount(uint32_t operandLimit) {
+        return (operandLimit - 1) >> COUNT_SHIFT;
+    }
+};
+
+/**
+ * PIM Move Modes
+ * Selects the direction of a MOVE through its immediate field
+ */
+enum PIMMoveMode {
+    PIM_MOVE_TO_REG = 0,          // dest = register, src1 = PIM memory address
+    PIM_MOVE_TO_MEM = 1,          // dest = PIM memory address, src1 = register
+    PIM_MOVE_TO_REG_INDIRECT = 2, // dest = register, src1 = register holding the address
+    PIM_MOVE_TO_MEM_INDIRECT = 3  // dest = register holding the address, src1 = register
+};
+
+/**
+ * PIM Control Flow
+ * 
+ * JUMP dest transfers control to absolute instruction index dest.
+ * JUMPZ/JUMPNZ dest, src1 jump to dest if register src1 is zero/non-zero.
+ */
+
+/**
+ * PIM Host Buffers
+ * Identifies the host-side operand a LOAD reads from or a STORE writes to
+ * (src1 of LOAD, dest of STORE)
+ * 
+ * The vector buffers hold the bias vectors of a fused epilogue, one per
+ * row: LOAD [v, e] reads element e of vector v, and a broadcast LOAD adds
+ * the grid row (row vectors) or column (column vectors) of the PE to e.
+ * Block transfers only address buffers up to PIM_HOST_C.
+ */
+enum PIMHostBuffer {
+    PIM_HOST_ZERO = 0,    // Zero source, used to initialize PIM memory
+    PIM_HOST_A,           // Matrix A
+    PIM_HOST_B,           // Matrix B
+    PIM_HOST_C,           // Matrix C (result)
+    PIM_HOST_ROW_VECTOR,  // Epilogue vectors indexed by the row of C
+    PIM_HOST_COL_VECTOR   // Epilogue vectors indexed by the column of C
 };
 
 /**
@@ -75,7 +269,35 @@ struct PIMMemoryLayout {
 };
 
 /**
- * PIM Instruction Format
+ * PIM Launch Block
+ * 
+ * Symbolic-dimension programs (PIM_OP_MODE_SYMBOLIC) read the matrix sizes
+ * and base addresses from fixed PIM memory words written by the runtime
+ * before launch. The runtime also stages A (row-major, rows x common) and
+ * B (row-major, common x cols) at their base addresses and reads C
+ * (row-major, rows x cols) back after the program finishes.
+ */
+struct PIMLaunchLayout {
+    // Launch arguments, written by the runtime
+    static const uint32_t ROWS = 0;               // Rows of A and C
+    static const uint32_t COLS = 1;               // Columns of B and C
+    static const uint32_t COMMON = 2;             // Columns of A, rows of B
+    static const uint32_t A_BASE = 3;             // PIM address of A[0][0]
+    static const uint32_t B_BASE = 4;             // PIM address of B[0][0]
+    static const uint32_t C_BASE = 5;             // PIM address of C[0][0]
+    
+    // Loop state spilled by the program
+    static const uint32_t ROW_COUNT = 6;          // Remaining rows of C
+    static const uint32_t COL_COUNT = 7;          // Remaining columns in the current row
+    static const uint32_t A_ROW = 8;              // Address of A[i][0]
+    static const uint32_t B_COL = 9;              // Address of B[0][j]
+    static const uint32_t C_NEXT = 10;            // Address of C[i][j]
+    
+    static const uint32_t DATA_OFFSET = 16;       // First address available for matrix data
+};
+
+/**
+ * PIM Instruction Format (ISA version 1)
  * 
  * 32-bit instruction format:
  * [31:26] - Opcode (6 bits)
@@ -129,4 +351,84 @@ struct PIMInstructionFormat {
     }
 };
 
+/**
+ * PIM Extended Instruction Format (ISA version 2)
+ * 
+ * 64-bit instruction format with operands wide enough for every PIM word
+ * address, jump target and host coordinate:
+ * [63:56] - Opcode (8 bits)
+ * [55:42] - Destination (14 bits)
+ * [41:28] - Source 1 (14 bits)
+ * [27:14] - Source 2 (14 bits)
+ * [13:0]  - Immediate (14 bits)
+ */
+struct PIMExtendedFormat {
+    static const uint32_t OPCODE_SHIFT = 56;
+    static const uint64_t OPCODE_MASK = 0xFF;    // 8 bits
+    
+    static const uint32_t DEST_SHIFT = 42;
+    static const uint64_t DEST_MASK = 0x3FFF;    // 14 bits
+    
+    static const uint32_t SRC1_SHIFT = 28;
+    static const uint64_t SRC1_MASK = 0x3FFF;    // 14 bits
+    
+    static const uint32_t SRC2_SHIFT = 14;
+    static const uint64_t SRC2_MASK = 0x3FFF;    // 14 bits
+    
+    static const uint32_t IMM_SHIFT = 0;
+    static const uint64_t IMM_MASK = 0x3FFF;     // 14 bits
+    
+    static uint64_t encode(PIMOpcode opcode, uint64_t dest, uint64_t src1, uint64_t src2, uint64_t imm) {
+        return ((opcode & OPCODE_MASK) << OPCODE_SHIFT) |
+               ((dest & DEST_MASK) << DEST_SHIFT) |
+               ((src1 & SRC1_MASK) << SRC1_SHIFT) |
+               ((src2 & SRC2_MASK) << SRC2_SHIFT) |
+               ((imm & IMM_MASK) << IMM_SHIFT);
+    }
+    
+    static PIMOpcode decodeOpcode(uint64_t instruction) {
+        return static_cast<PIMOpcode>((instruction >> OPCODE_SHIFT) & OPCODE_MASK);
+    }
+    
+    static uint32_t decodeDest(uint64_t instruction) {
+        return static_cast<uint32_t>((instruction >> DEST_SHIFT) & DEST_MASK);
+    }
+    
+    static uint32_t decodeSrc1(uint64_t instruction) {
+        return static_cast<uint32_t>((instruction >> SRC1_SHIFT) & SRC1_MASK);
+    }
+    
+    static uint32_t decodeSrc2(uint64_t instruction) {
+        return static_cast<uint32_t>((instruction >> SRC2_SHIFT) & SRC2_MASK);
+    }
+    
+    static uint32_t decodeImm(uint64_t instruction) {
+        return static_cast<uint32_t>((instruction >> IMM_SHIFT) & IMM_MASK);
+    }
+};
+
+/**
+ * PIM ISA Versions
+ * Selects the instruction encoding and the opcodes a program may use
+ */
+struct PIMEncoding {
+    static const unsigned V1 = 1;    // 32-bit PIMInstructionFormat
+    static const unsigned V2 = 2;    // 64-bit PIMExtendedFormat, MAC and block transfers
+    
+    /**
+     * Number of values the address and jump target fields can hold
+     */
+    static uint32_t operandLimit(unsigned version) {
+        return static_cast<uint32_t>(version == V2 ? PIMExtendedFormat::DEST_MASK + 1
+                                                   : PIMInstructionFormat::DEST_MASK + 1);
+    }
+    
+    /**
+     * Size of one instruction word in bytes
+     */
+    static uint32_t wordBytes(unsigned version) {
+        return version == V2 ? sizeof(uint64_t) : sizeof(uint32_t);
+    }
+};
+
 #endif // PIM_INSTRUCTION_SET_H
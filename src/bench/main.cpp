@@ -0,0 +1,362 @@
+/**
+ * Main entry point for the PIM compiler benchmark
+ * Measures compile time, per-stage time, heap usage and emitted instructions
+ * over a matrix of kernel shapes, precisions and optimization levels
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include "compiler/CompilerDriver.h"
+#include "utils/TimeProfiler.h"
+#include "../include/CompilerConfig.h"
+
+namespace {
+
+// Square kernels from 8 to 256, and skinny kernels with a 1024 extent
+const char* const DEFAULT_SHAPES = "8x8x8,32x32x32,128x128x128,256x256x256,"
+                                   "1024x16x16,16x1024x16,16x16x1024,1024x8x1024";
+
+struct Shape {
+    unsigned rows = 0;
+    unsigned cols = 0;
+    unsigned common = 0;
+};
+
+void printUsage(const std::string& programName) {
+    std::cout << "Usage: " << programName << " [options] [benchmark options]\n"
+              << "Compiles every example over a matrix of shapes, precisions and optimization levels\n"
+              << "Options:\n"
+              << "  --examples <d>   Directory of the seed programs (default: the source tree's examples)\n"
+              << "  --shapes <list>  Comma separated RxCxK shapes (default " << DEFAULT_SHAPES << ")\n"
+              << "  --baseline <f>   Compare against a JSON baseline written with --benchmark_out and\n"
+              << "                   exit with 1 on regressions\n"
+              << "  --threshold <p>  Compile time increase in percent counted as a regression (default 10)\n"
+              << "  -h, --help       Display this help message\n"
+              << "Google Benchmark options such as --benchmark_filter=<regex>, --benchmark_min_time=<s>\n"
+              << "and --benchmark_out=<file> --benchmark_out_format=json are passed through\n";
+}
+
+// Parse a dimension triple of the form "RxCxK"
+bool parseShape(const std::string& text, Shape& shape) {
+    std::stringstream ss(text);
+    char sep1 = 0, sep2 = 0;
+    if (!(ss >> shape.rows >> sep1 >> shape.cols >> sep2 >> shape.common) || sep1 != 'x' || sep2 != 'x') {
+        return false;
+    }
+    return ss.eof() && shape.rows > 0 && shape.cols > 0 && shape.common > 0;
+}
+
+// Counter name of a stage, e.g. "Shape analysis" -> "shape_analysis_ms"
+std::string counterName(const std::string& stage) {
+    std::string name;
+    for (char c : stage) {
+        name += c == ' ' ? '_' : static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return name + "_ms";
+}
+
+// Process high-water mark of the resident set
+double maxResidentBytes() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_maxrss) * 1024.0;
+}
+
+/**
+ * Compile one seed with one configuration per iteration
+ *
+ * Reports the stages directly under "Compile file" and the backend phases
+ * as per-iteration counters, with the instruction count and the peak heap
+ * usage of a compilation.
+ */
+void compileBenchmark(benchmark::State& state, const std::string& source, const CompilerConfig& config,
+                      const std::string& outputFile) {
+    TimeProfiler& profiler = TimeProfiler::getInstance();
+    CompilerDriver driver(config);
+    std::map<std::string, double> stageMilliseconds;
+    size_t instructions = 0;
+    int64_t peakHeap = 0;
+    
+    for (auto _ : state) {
+        profiler.clear();
+        try {
+            instructions = driver.compileFile(source, outputFile).instructions;
+        } catch (const std::exception& e) {
+            state.SkipWithError(e.what());
+            break;
+        }
+        
+        for (const auto& stage : profiler.getStageTotals()) {
+            const std::string& path = stage.path;
+            if (path == "Compile file") {
+                peakHeap = std::max(peakHeap, stage.peakBytes);
+            }
+            bool pipelineStage = stage.depth == 1 && path.compare(0, 13, "Compile file/") == 0;
+            bool backendPhase = path.compare(0, 45, "Compile file/Code generation/Kernel lowering/") == 0 &&
+                                stage.depth == 3;
+            if (pipelineStage || backendPhase) {
+                stageMilliseconds[path.substr(path.rfind('/') + 1)] += stage.microseconds / 1000.0;
+            }
+        }
+    }
+    
+    for (const auto& [stage, milliseconds] : stageMilliseconds) {
+        state.counters[counterName(stage)] = benchmark::Counter(milliseconds, benchmark::Counter::kAvgIterations);
+    }
+    state.counters["instructions"] = static_cast<double>(instructions);
+    state.counters["peak_heap_bytes"] = benchmark::Counter(static_cast<double>(peakHeap),
+                                                           benchmark::Counter::kDefaults,
+                                                           benchmark::Counter::kIs1024);
+    state.counters["max_rss_bytes"] = benchmark::Counter(maxResidentBytes(), benchmark::Counter::kDefaults,
+                                                         benchmark::Counter::kIs1024);
+}
+
+/**
+ * Console reporter that keeps the runs for the baseline comparison
+ */
+class CollectingReporter : public benchmark::ConsoleReporter {
+public:
+    void ReportRuns(const std::vector<Run>& reports) override {
+        for (const auto& run : reports) {
+            if (run.run_type == Run::RT_Iteration && !run.error_occurred) {
+                runs.push_back(run);
+            }
+        }
+        ConsoleReporter::ReportRuns(reports);
+    }
+    
+    std::vector<Run> runs;
+};
+
+double toMilliseconds(double time, const std::string& unit) {
+    if (unit == "ns") {
+        return time / 1e6;
+    }
+    if (unit == "us") {
+        return time / 1e3;
+    }
+    if (unit == "s") {
+        return time * 1e3;
+    }
+    return time;
+}
+
+// Time and instruction count of one benchmark in a baseline
+struct Baseline {
+    double milliseconds = 0;
+    double instructions = -1;
+};
+
+/**
+ * Read a baseline in Google Benchmark's JSON format
+ *
+ * @param baselineFile File written with --benchmark_out_format=json
+ * @param baseline Receives the iteration runs by benchmark name
+ * @return False if the file cannot be read or is not a benchmark report
+ */
+bool readBaseline(const std::string& baselineFile, std::map<std::string, Baseline>& baseline) {
+    auto buffer = llvm::MemoryBuffer::getFile(baselineFile);
+    if (!buffer) {
+        std::cerr << "Error: Could not read baseline: " << baselineFile << std::endl;
+        return false;
+    }
+    llvm::Expected<llvm::json::Value> parsed = llvm::json::parse((*buffer)->getBuffer());
+    const llvm::json::Array* benchmarks = nullptr;
+    if (!parsed) {
+        llvm::consumeError(parsed.takeError());
+    } else if (parsed->getAsObject()) {
+        benchmarks = parsed->getAsObject()->getArray("benchmarks");
+    }
+    if (!benchmarks) {
+        std::cerr << "Error: " << baselineFile << " is not a benchmark JSON file" << std::endl;
+        return false;
+    }
+    
+    for (const auto& entry : *benchmarks) {
+        const llvm::json::Object* object = entry.getAsObject();
+        if (!object || object->getString("run_type").getValueOr("iteration") != "iteration") {
+            continue;
+        }
+        auto name = object->getString("name");
+        auto time = object->getNumber("real_time");
+        if (!name || !time) {
+            continue;
+        }
+        Baseline& values = baseline[name->str()];
+        values.milliseconds = toMilliseconds(*time, object->getString("time_unit").getValueOr("ns").str());
+        values.instructions = object->getNumber("instructions").getValueOr(-1);
+    }
+    return true;
+}
+
+/**
+ * Compare the runs with a baseline
+ *
+ * A benchmark regresses when its compile time grows by more than the
+ * threshold or when it emits more instructions than the baseline.
+ *
+ * @return Number of regressions
+ */
+int compareWithBaseline(const std::vector<benchmark::BenchmarkReporter::Run>& runs,
+                        const std::map<std::string, Baseline>& baseline, double threshold) {
+    int regressions = 0;
+    size_t compared = 0;
+    std::cout << "\nComparison with the baseline (threshold " << threshold << "%):\n";
+    for (const auto& run : runs) {
+        auto found = baseline.find(run.benchmark_name());
+        if (found == baseline.end()) {
+            continue;
+        }
+        compared++;
+        const double milliseconds = toMilliseconds(run.GetAdjustedRealTime(),
+                                                   benchmark::GetTimeUnitString(run.time_unit));
+        const double change = found->second.milliseconds > 0
+            ? 100.0 * (milliseconds - found->second.milliseconds) / found->second.milliseconds : 0.0;
+        auto counter = run.counters.find("instructions");
+        const double instructions = counter == run.counters.end() ? -1 : counter->second.value;
+        
+        std::vector<std::string> problems;
+        if (change > threshold) {
+            std::ostringstream text;
+            text << std::fixed << std::setprecision(1) << "time +" << change << "%";
+            problems.push_back(text.str());
+        }
+        if (found->second.instructions >= 0 && instructions > found->second.instructions) {
+            problems.push_back("instructions " + std::to_string(static_cast<long long>(found->second.instructions)) +
+                               " -> " + std::to_string(static_cast<long long>(instructions)));
+        }
+        if (!problems.empty()) {
+            regressions++;
+            std::cout << "  REGRESSION " << run.benchmark_name() << ":";
+            for (const auto& problem : problems) {
+                std::cout << " " << problem;
+            }
+            std::cout << "\n";
+        }
+    }
+    std::cout << "  " << compared << " benchmarks compared, " << regressions << " regressed\n";
+    return regressions;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    benchmark::Initialize(&argc, argv);
+    
+    std::string examplesDir = PIM_EXAMPLES_DIR;
+    std::string shapeList = DEFAULT_SHAPES;
+    std::string baselineFile;
+    double threshold = 10.0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "--examples" && i + 1 < argc) {
+            examplesDir = argv[++i];
+        } else if (arg == "--shapes" && i + 1 < argc) {
+            shapeList = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baselineFile = argv[++i];
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            std::string value = argv[++i];
+            char* end = nullptr;
+            threshold = std::strtod(value.c_str(), &end);
+            if (value.empty() || *end != '\0' || threshold < 0) {
+                std::cerr << "Invalid threshold: " << value << std::endl;
+                return 1;
+            }
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+    std::vector<Shape> shapes;
+    std::stringstream shapeStream(shapeList);
+    std::string item;
+    while (std::getline(shapeStream, item, ',')) {
+        Shape shape;
+        if (!parseShape(item, shape)) {
+            std::cerr << "Invalid shape: " << item << " (expected RxCxK)" << std::endl;
+            return 1;
+        }
+        shapes.push_back(shape);
+    }
+    
+    std::map<std::string, Baseline> baseline;
+    if (!baselineFile.empty() && !readBaseline(baselineFile, baseline)) {
+        return 1;
+    }
+    
+    // The seeds are the example programs, in name order
+    std::vector<std::string> seeds;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(examplesDir, error)) {
+        if (entry.path().extension() == ".cpp") {
+            seeds.push_back(entry.path().string());
+        }
+    }
+    std::sort(seeds.begin(), seeds.end());
+    if (seeds.empty()) {
+        std::cerr << "Error: No example programs in " << examplesDir << std::endl;
+        return 1;
+    }
+    
+    const std::filesystem::path outputDir = std::filesystem::temp_directory_path() /
+                                            ("pim_bench." + std::to_string(getpid()));
+    std::filesystem::create_directories(outputDir);
+    const std::string outputFile = (outputDir / "kernel.pim").string();
+    
+    TimeProfiler::getInstance().enable();
+    for (const auto& seed : seeds) {
+        const std::string seedName = std::filesystem::path(seed).filename().string();
+        for (const auto& shape : shapes) {
+            for (unsigned precision : {32u, 8u}) {
+                for (auto level : {CompilerConfig::O0, CompilerConfig::O2}) {
+                    CompilerConfig config = CompilerConfig::getDefaultConfig();
+                    config.cache.directory.clear();
+                    config.assumedDimensions.rows = shape.rows;
+                    config.assumedDimensions.cols = shape.cols;
+                    config.assumedDimensions.common = shape.common;
+                    config.precision = precision;
+                    config.optimizationLevel = level;
+                    
+                    const std::string shapeName = std::to_string(shape.rows) + "x" + std::to_string(shape.cols) +
+                                                  "x" + std::to_string(shape.common);
+                    const std::string name = "compile/" + seedName + "/" + shapeName + "/int" +
+                                             std::to_string(precision) + "/O" + std::to_string(level);
+                    benchmark::RegisterBenchmark(name.c_str(), compileBenchmark, seed, config, outputFile)
+                        ->Unit(benchmark::kMillisecond)
+                        ->UseRealTime();
+                }
+            }
+        }
+    }
+    
+    CollectingReporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+    std::filesystem::remove_all(outputDir, error);
+    
+    if (!baselineFile.empty()) {
+        return compareWithBaseline(reporter.runs, baseline, threshold) == 0 ? 0 : 1;
+    }
+    return 0;
+}
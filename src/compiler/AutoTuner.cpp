@@ -0,0 +1,187 @@
+/**
+ * AutoTuner.cpp
+ * Implements the search of tile shapes, tile orders and PE schedules
+ */
+
+#include "AutoTuner.h"
+#include "PIMBackend.h"
+#include "InstructionSink.h"
+#include "LayoutPlanner.h"
+#include "../optimizer/CodeQualityAnalyzer.h"
+#include "../utils/Logger.h"
+#include "../utils/TimeProfiler.h"
+#include "../include/PIMInstructionSet.h"
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace {
+
+using Strategy = CompilerConfig::SchedulingParams::Strategy;
+
+} // namespace
+
+AutoTuner::AutoTuner(const CompilerConfig& config) : config(config) {
+    this->config.tuning.enabled = false;
+}
+
+AutoTuner::~AutoTuner() {}
+
+std::vector<KernelTuning> AutoTuner::candidates(const KernelShape& shape) const {
+    std::vector<KernelTuning> result;
+    const unsigned numPEs = std::max(config.archParams.numProcessingElements, 1u);
+    const unsigned lanes = LayoutPlanner(config).lanesPerWord();
+    const unsigned commonWords = (shape.common + lanes - 1) / lanes;
+    bool hasBias = false;
+    unsigned biasWords = 0;
+    for (const auto& op : shape.epilogue) {
+        if (op.isBias()) {
+            hasBias = true;
+            biasWords += op.kind == EpilogueOp::BIAS_ROW ? shape.rows : shape.cols;
+        }
+    }
+    
+    // Untiled programs address A, B, C and the bias vectors directly
+    unsigned footprint = shape.rows * commonWords + commonWords * shape.cols + shape.rows * shape.cols + biasWords;
+    if (footprint <= PIMEncoding::operandLimit(config.isaVersion)) {
+        result.push_back(KernelTuning());
+        for (Strategy strategy : {CompilerConfig::SchedulingParams::SCHEDULE_ROW_BLOCK,
+                                  CompilerConfig::SchedulingParams::SCHEDULE_COLUMN_BLOCK,
+                                  CompilerConfig::SchedulingParams::SCHEDULE_BLOCK_2D}) {
+            KernelTuning candidate;
+            candidate.scheduled = true;
+            candidate.strategy = strategy;
+            result.push_back(candidate);
+        }
+    }
+    
+    // Tiles of every power-of-two width, filling the PE array
+    unsigned previousRows = 0;
+    for (unsigned cols = 1; cols <= std::min(shape.cols, numPEs); cols *= 2) {
+        unsigned rows = std::max(1u, std::min(shape.rows, numPEs / cols));
+        if (rows == previousRows) {
+            continue;  // Narrower tiles took every row already
+        }
+        previousRows = rows;
+        
+        KernelTuning tile;
+        tile.tiled = true;
+        tile.tileRows = rows;
+        tile.tileCols = cols;
+        
+        // The derived depth fills the PE-local memory; shallower slices
+        // trade host transfers for earlier compute. Bias words are reserved
+        // by the backend only for a derived depth
+        CompilerConfig tileConfig = config;
+        tile.apply(tileConfig);
+        unsigned derived = PIMBackend(tileConfig).computeTileShape(shape.rows, shape.cols, commonWords).depth;
+        std::vector<unsigned> depths = {0};
+        for (unsigned divisor : {2u, 4u}) {
+            if (!hasBias && derived / divisor >= 1 && derived / divisor < derived) {
+                depths.push_back(derived / divisor);
+            }
+        }
+        
+        unsigned tileRowCount = (shape.rows + rows - 1) / rows;
+        unsigned tileColCount = (shape.cols + cols - 1) / cols;
+        for (unsigned depth : depths) {
+            bool sliced = commonWords > (depth == 0 ? derived : depth);
+            tile.tileDepth = depth;
+            tile.order = CompilerConfig::TilingParams::ORDER_IJK;
+            result.push_back(tile);
+            
+            // The other orders only reuse slices across a grid of several tiles
+            if (sliced && tileColCount > 1) {
+                tile.order = CompilerConfig::TilingParams::ORDER_IKJ;
+                result.push_back(tile);
+            }
+            if (sliced && tileRowCount > 1) {
+                tile.order = CompilerConfig::TilingParams::ORDER_JKI;
+                result.push_back(tile);
+            }
+        }
+    }
+    return result;
+}
+
+uint64_t AutoTuner::evaluate(const KernelShape& shape, const KernelTuning& candidate, size_t& instructions) const {
+    CompilerConfig candidateConfig = config;
+    candidate.apply(candidateConfig);
+    
+    std::vector<PIMInstruction> program;
+    VectorInstructionSink sink(program);
+    PIMBackend(candidateConfig).generateKernelInstructions(shape, sink);
+    sink.finish();
+    
+    instructions = program.size();
+    return CodeQualityAnalyzer(candidateConfig).analyze(program).estimatedCycles;
+}
+
+KernelTuning AutoTuner::tune(const KernelShape& shape) const {
+    TuningDatabase& database = TuningDatabase::shared(config.tuning.database);
+    const std::string key = TuningDatabase::makeKey(shape, config);
+    
+    KernelTuning best;
+    if (database.lookup(key, best)) {
+        PIM_LOG_INFO("Using stored tuning for " + key + ": " + best.describe());
+        return best;
+    }
+    
+    ScopedTimer timer("Autotuning", key);
+    std::vector<KernelTuning> candidates = this->candidates(shape);
+    
+    // Candidates are independent, so they are lowered on all cores; the
+    // choice only depends on the results, not on the order they finish in
+    std::vector<size_t> instructions(candidates.size(), 0);
+    std::vector<std::string> errors(candidates.size());
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < candidates.size(); i = next++) {
+            try {
+                candidates[i].estimatedCycles = evaluate(shape, candidates[i], instructions[i]);
+            } catch (const std::exception& e) {
+                errors[i] = e.what();
+            }
+        }
+    };
+    unsigned threadCount = std::max(1u, std::min<unsigned>(std::thread::hardware_concurrency(),
+                                                           static_cast<unsigned>(candidates.size())));
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threadCount; i++) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    
+    size_t bestInstructions = 0;
+    bool found = false;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        const KernelTuning& candidate = candidates[i];
+        if (!errors[i].empty()) {
+            PIM_LOG_DEBUG("Tuning candidate " + candidate.describe() + " rejected: " + errors[i]);
+            continue;
+        }
+        PIM_LOG_DEBUG("Tuning candidate " + candidate.describe() + ": " +
+                      std::to_string(candidate.estimatedCycles) + " cycles, " +
+                      std::to_string(instructions[i]) + " instructions");
+        if (!found || candidate.estimatedCycles < best.estimatedCycles ||
+            (candidate.estimatedCycles == best.estimatedCycles && instructions[i] < bestInstructions)) {
+            best = candidate;
+            bestInstructions = instructions[i];
+            found = true;
+        }
+    }
+    if (!found) {
+        throw std::runtime_error("No code generation candidate can lower the kernel " + key);
+    }
+    
+    best.candidates = static_cast<unsigned>(candidates.size());
+    PIM_LOG_INFO("Tuned " + key + " over " + std::to_string(candidates.size()) + " candidates: " +
+                best.describe() + " (estimated " + std::to_string(best.estimatedCycles) + " cycles)");
+    database.record(key, best);
+    return best;
+}
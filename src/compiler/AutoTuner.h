@@ -0,0 +1,72 @@
+/**
+ * AutoTuner.h
+ * Searches the code generation parameters of matrix multiplication kernels
+ */
+
+#ifndef AUTO_TUNER_H
+#define AUTO_TUNER_H
+
+#include <vector>
+#include "MatrixShapeAnalysis.h"
+#include "TuningDatabase.h"
+#include "../include/CompilerConfig.h"
+
+/**
+ * Chooses tile shape, tile order and PE schedule per kernel shape
+ * 
+ * Every candidate is lowered with its configuration and the program is
+ * measured with the static cycle estimate of CodeQualityAnalyzer for the
+ * configured PIMArchParams; the fewest estimated cycles win, ties going to
+ * the shorter program. Candidates are lowered on all cores. Results are
+ * kept in the TuningDatabase of CompilerConfig::TuningParams, so a shape
+ * is searched once per architecture and later compilations reuse the
+ * choice.
+ */
+class AutoTuner {
+public:
+    /**
+     * @param config Configuration the candidates start from; its tiling and
+     *        scheduling parameters are replaced by those of each candidate
+     */
+    explicit AutoTuner(const CompilerConfig& config);
+    ~AutoTuner();
+    
+    /**
+     * Get the tuning of a kernel, from the database or by search
+     * 
+     * @param shape Kernel shape inferred from the IR
+     * @return Best candidate
+     * @throws std::runtime_error if no candidate can be lowered
+     */
+    KernelTuning tune(const KernelShape& shape) const;
+    
+    /**
+     * List the candidates of a kernel
+     * 
+     * Untiled candidates run on a single PE or on per-PE streams of each
+     * PEScheduler strategy, as long as the operands fit the address space.
+     * Tiled candidates take power-of-two tile widths up to the PE count
+     * with the height filling the remaining PEs, the derived slice depth
+     * and its half and quarter, and each tile order that differs from ijk
+     * for the tile grid.
+     * 
+     * @param shape Kernel shape inferred from the IR
+     */
+    std::vector<KernelTuning> candidates(const KernelShape& shape) const;
+    
+    /**
+     * Estimate the cycles of a kernel lowered with a candidate
+     * 
+     * @param shape Kernel shape inferred from the IR
+     * @param candidate Parameters to lower the kernel with
+     * @param instructions Receives the program length
+     * @return Static cycle estimate
+     * @throws std::runtime_error if the candidate cannot be lowered
+     */
+    uint64_t evaluate(const KernelShape& shape, const KernelTuning& candidate, size_t& instructions) const;
+
+private:
+    CompilerConfig config;
+};
+
+#endif // AUTO_TUNER_H
@@ -0,0 +1,109 @@
+/**
+ * BatchCompiler.cpp
+ * Implements concurrent compilation of many input files
+ */
+
+#include "BatchCompiler.h"
+#include "CompilerDriver.h"
+#include "../utils/Logger.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+BatchCompiler::BatchCompiler(const CompilerConfig& config) : config(config) {}
+
+BatchCompiler::~BatchCompiler() = default;
+
+std::vector<BatchEntry> BatchCompiler::readManifest(const std::string& manifestFile,
+                                                    const std::string& outputDir) const {
+    std::ifstream manifest(manifestFile);
+    if (!manifest) {
+        throw std::runtime_error("Could not open batch manifest: " + manifestFile);
+    }
+    
+    std::vector<BatchEntry> entries;
+    std::string line;
+    unsigned lineNumber = 0;
+    while (std::getline(manifest, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        
+        std::stringstream fields(line);
+        std::string inputFile, outputFile, extra;
+        if (!(fields >> inputFile)) {
+            continue;
+        }
+        fields >> outputFile;
+        if (fields >> extra) {
+            throw std::runtime_error(manifestFile + ":" + std::to_string(lineNumber) +
+                                     ": expected an input file and an optional output file");
+        }
+        
+        entries.push_back({inputFile, outputFile.empty() ? defaultOutput(inputFile, outputDir) : outputFile});
+    }
+    
+    return entries;
+}
+
+std::string BatchCompiler::defaultOutput(const std::string& inputFile, const std::string& outputDir) const {
+    std::filesystem::path output(inputFile);
+    output.replace_extension(config.outputFormat == "binary" ? ".pimb" : ".pim");
+    if (!outputDir.empty()) {
+        output = std::filesystem::path(outputDir) / output.filename();
+    }
+    return output.string();
+}
+
+std::vector<BatchEntryResult> BatchCompiler::compile(const std::vector<BatchEntry>& entries) const {
+    // Concurrent writers to one file would corrupt it
+    std::set<std::string> outputs;
+    for (const auto& entry : entries) {
+        std::string normalized = std::filesystem::path(entry.outputFile).lexically_normal().string();
+        if (!outputs.insert(normalized).second) {
+            throw std::runtime_error("Batch writes " + entry.outputFile + " more than once");
+        }
+    }
+    
+    unsigned threadCount = config.compileJobs;
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threadCount = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threadCount, entries.size())));
+    PIM_LOG_INFO("Compiling " + std::to_string(entries.size()) + " files on " +
+                std::to_string(threadCount) + " threads");
+    
+    // The batch is the unit of parallelism; each file is compiled serially
+    CompilerConfig fileConfig = config;
+    fileConfig.compileJobs = 1;
+    
+    std::vector<BatchEntryResult> results(entries.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        CompilerDriver driver(fileConfig);
+        for (size_t index = next++; index < entries.size(); index = next++) {
+            try {
+                CompileResult result = driver.compileFile(entries[index].inputFile, entries[index].outputFile);
+                results[index].instructions = result.instructions;
+                results[index].cached = result.cached;
+                results[index].success = true;
+            } catch (const std::exception& e) {
+                results[index].error = e.what();
+            }
+        }
+    };
+    
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threadCount; i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    
+    return results;
+}
@@ -0,0 +1,84 @@
+/**
+ * BatchCompiler.h
+ * Compiles many input files in one process
+ */
+
+#ifndef BATCH_COMPILER_H
+#define BATCH_COMPILER_H
+
+#include <string>
+#include <vector>
+#include "../include/CompilerConfig.h"
+
+/**
+ * One input of a batch and where its output goes
+ */
+struct BatchEntry {
+    std::string inputFile;
+    std::string outputFile;
+};
+
+/**
+ * Outcome of compiling one batch entry
+ */
+struct BatchEntryResult {
+    bool success = false;
+    size_t instructions = 0;  // Instructions written on success
+    bool cached = false;      // Output came from the compilation cache
+    std::string error;        // Failure reason otherwise
+};
+
+class BatchCompiler {
+public:
+    /**
+     * @param config Compiler configuration; compileJobs sets the number of
+     *        files compiled concurrently (0 uses every hardware thread)
+     */
+    explicit BatchCompiler(const CompilerConfig& config);
+    ~BatchCompiler();
+    
+    /**
+     * Read a batch manifest
+     *
+     * Each non-empty line names an input file, optionally followed by its
+     * output file; text after '#' is a comment. Entries without an output
+     * get defaultOutput() of their input.
+     *
+     * @param manifestFile Manifest path
+     * @param outputDir Directory for default outputs (empty: next to the input)
+     * @return Entries in manifest order
+     * @throws std::runtime_error if the manifest cannot be read or a line has
+     *         more than two fields
+     */
+    std::vector<BatchEntry> readManifest(const std::string& manifestFile, const std::string& outputDir) const;
+    
+    /**
+     * Get the default output path of an input
+     *
+     * @param inputFile Input path
+     * @param outputDir Directory for the output (empty: next to the input)
+     * @return Input path with its extension replaced by .pim, or .pimb for
+     *         binary output
+     */
+    std::string defaultOutput(const std::string& inputFile, const std::string& outputDir) const;
+    
+    /**
+     * Compile every entry
+     *
+     * Files are distributed over worker threads, each owning one
+     * CompilerDriver that is reused for all the files it compiles, so
+     * component setup happens once per thread rather than once per file.
+     * Functions within a file are compiled serially. A failing entry does
+     * not stop the others.
+     *
+     * @param entries Files to compile
+     * @return One result per entry, in entry order
+     * @throws std::runtime_error if two entries write the same output file
+     */
+    std::vector<BatchEntryResult> compile(const std::vector<BatchEntry>& entries) const;
+
+private:
+    CompilerConfig config;
+};
+
+#endif // BATCH_COMPILER_H
@@ -0,0 +1,204 @@
+/**
+ * CompilationCache.cpp
+ * Implements the content-addressed compilation cache
+ */
+
+#include "CompilationCache.h"
+#include "../utils/Logger.h"
+#include "../include/PIMBinaryFormat.h"
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/SHA256.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <sstream>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifndef PIM_COMPILER_VERSION
+#define PIM_COMPILER_VERSION "unknown"
+#endif
+
+namespace {
+
+// Suffix of cache entries; other files in the directory are left alone
+const char* const ENTRY_SUFFIX = ".pimcache";
+
+// Distinguishes temporary files of concurrent writers
+std::atomic<unsigned> temporaryCounter(0);
+
+bool isBitcode(const std::string& filename) {
+    return filename.size() >= 3 && filename.compare(filename.size() - 3, 3, ".bc") == 0;
+}
+
+} // namespace
+
+CompilationCache::CompilationCache(const CompilerConfig& config) : config(config) {}
+
+CompilationCache::~CompilationCache() = default;
+
+bool CompilationCache::isEnabled() const {
+    return !config.cache.directory.empty();
+}
+
+std::string CompilationCache::normalizeSource(const std::string& source) {
+    std::string normalized;
+    normalized.reserve(source.size());
+    
+    std::stringstream lines(source);
+    std::string line;
+    size_t pendingBlankLines = 0;
+    while (std::getline(lines, line)) {
+        size_t end = line.find_last_not_of(" \t\r\f\v");
+        if (end == std::string::npos) {
+            pendingBlankLines++;
+            continue;
+        }
+        
+        // Blank lines only count when more text follows
+        normalized.append(pendingBlankLines, '\n');
+        pendingBlankLines = 0;
+        normalized.append(line, 0, end + 1);
+        normalized.push_back('\n');
+    }
+    
+    return normalized;
+}
+
+std::string CompilationCache::configFingerprint(const CompilerConfig& config) {
+    const auto& arch = config.archParams;
+    const auto& tiling = config.tiling;
+    std::stringstream ss;
+    ss << "opt=" << config.optimizationLevel
+       << " format=" << config.outputFormat
+       << " mapping=" << config.enableMemoryMapping
+       << " regalloc=" << config.enableRegisterAllocation
+       << " folding=" << config.foldConstantWeights
+       << " symbolic=" << config.symbolicDimensions
+       << " linking=" << config.linkKernels
+       << " precision=" << config.precision
+       << " isa=" << config.isaVersion << "," << config.coalesceTransfers
+       << " arch=" << arch.numProcessingElements << "," << arch.memoryBankSize << "," << arch.numMemoryBanks
+       << "," << arch.registerFileSize << "," << arch.wordSize << "," << arch.matrixDimLimit
+       << " tiling=" << tiling.enabled << "," << tiling.tileRows << "," << tiling.tileCols << "," << tiling.tileDepth
+       << "," << tiling.doubleBuffering << "," << tiling.order
+       << " layout=" << config.layout.enabled << "," << config.layout.bankHashing
+       << " scheduling=" << config.scheduling.enabled << "," << config.scheduling.strategy
+       << " sharding=" << config.sharding.devices << "," << config.sharding.strategy
+       << " tuning=" << config.tuning.enabled
+       << " dims=" << config.assumedDimensions.rows << "," << config.assumedDimensions.cols
+       << "," << config.assumedDimensions.common << "," << config.assumedDimensions.batch;
+    return ss.str();
+}
+
+std::string CompilationCache::computeKey(const std::string& inputFile, const std::string& content) const {
+    llvm::SHA256 hasher;
+    hasher.update("pim_compiler " PIM_COMPILER_VERSION "\n");
+    hasher.update("container " + std::to_string(PIMBinaryFormat::VERSION) + "\n");
+    hasher.update(configFingerprint(config) + "\n");
+    
+    // Bitcode is binary; textual inputs are normalized first
+    bool binary = isBitcode(inputFile);
+    hasher.update(binary ? "bitcode\n" : "text\n");
+    hasher.update(binary ? content : normalizeSource(content));
+    
+    llvm::StringRef digest = hasher.final();
+    return llvm::toHex(llvm::ArrayRef<uint8_t>(reinterpret_cast<const uint8_t*>(digest.data()), digest.size()), true);
+}
+
+std::string CompilationCache::entryPath(const std::string& key) const {
+    return (std::filesystem::path(config.cache.directory) / (key + ENTRY_SUFFIX)).string();
+}
+
+bool CompilationCache::lookup(const std::string& key, const std::string& outputFile) const {
+    std::error_code error;
+    std::string entry = entryPath(key);
+    if (!std::filesystem::is_regular_file(entry, error)) {
+        return false;
+    }
+    
+    // Another process may evict the entry at any time; a failed copy is a miss
+    std::filesystem::copy_file(entry, outputFile, std::filesystem::copy_options::overwrite_existing, error);
+    if (error) {
+        PIM_LOG_WARNING("Could not read cache entry " + entry + ": " + error.message());
+        return false;
+    }
+    
+    std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), error);
+    return true;
+}
+
+void CompilationCache::store(const std::string& key, const std::string& outputFile) const {
+    std::error_code error;
+    std::filesystem::create_directories(config.cache.directory, error);
+    
+    // Write under a unique name and rename, so readers never see a partial entry
+    std::stringstream temporaryName;
+    temporaryName << key << ".tmp." << std::hash<std::thread::id>()(std::this_thread::get_id())
+                  << "." << temporaryCounter++;
+    std::filesystem::path temporary = std::filesystem::path(config.cache.directory) / temporaryName.str();
+    
+    if (!error) {
+        std::filesystem::copy_file(outputFile, temporary, std::filesystem::copy_options::overwrite_existing, error);
+    }
+    if (!error) {
+        std::filesystem::rename(temporary, entryPath(key), error);
+    }
+    if (error) {
+        PIM_LOG_WARNING("Could not write cache entry for " + outputFile + ": " + error.message());
+        std::filesystem::remove(temporary, error);
+        return;
+    }
+    
+    evict();
+}
+
+size_t CompilationCache::evict() const {
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type lastUsed;
+        uintmax_t size;
+    };
+    
+    std::error_code error;
+    std::vector<Entry> entries;
+    uintmax_t totalSize = 0;
+    for (std::filesystem::directory_iterator it(config.cache.directory, error), end; !error && it != end;
+         it.increment(error)) {
+        const auto& path = it->path();
+        if (path.extension() != ENTRY_SUFFIX) {
+            continue;
+        }
+        
+        std::error_code entryError;
+        Entry entry = {path, std::filesystem::last_write_time(path, entryError),
+                       std::filesystem::file_size(path, entryError)};
+        if (!entryError) {
+            entries.push_back(entry);
+            totalSize += entry.size;
+        }
+    }
+    
+    // Least recently used first
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.lastUsed < b.lastUsed;
+    });
+    
+    size_t removed = 0;
+    for (const auto& entry : entries) {
+        if (totalSize <= config.cache.maxBytes) {
+            break;
+        }
+        std::error_code removeError;
+        if (std::filesystem::remove(entry.path, removeError)) {
+            removed++;
+        }
+        totalSize -= entry.size;
+    }
+    
+    if (removed > 0) {
+        PIM_LOG_INFO("Evicted " + std::to_string(removed) + " compilation cache entries");
+    }
+    return removed;
+}
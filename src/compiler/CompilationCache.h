@@ -0,0 +1,95 @@
+/**
+ * CompilationCache.h
+ * Content-addressed on-disk cache of compiled PIM programs
+ */
+
+#ifndef COMPILATION_CACHE_H
+#define COMPILATION_CACHE_H
+
+#include <string>
+#include "../include/CompilerConfig.h"
+
+/**
+ * Stores compiled outputs under a hash of everything that determines them
+ *
+ * The key covers the normalized input, every CompilerConfig field that
+ * affects the generated code and the compiler and container versions, so a
+ * hit can be copied to the output without running any pipeline stage.
+ * Entries are written atomically (temporary file and rename), so several
+ * processes or batch workers may share one cache directory.
+ */
+class CompilationCache {
+public:
+    /**
+     * @param config Compiler configuration; CacheParams select the directory
+     *        and size bound
+     */
+    explicit CompilationCache(const CompilerConfig& config);
+    ~CompilationCache();
+    
+    /**
+     * Check whether a cache directory is configured
+     */
+    bool isEnabled() const;
+    
+    /**
+     * Compute the cache key of an input
+     *
+     * @param inputFile Input path (only its kind matters, not its name)
+     * @param content Contents of the input file
+     * @return Hex SHA-256 digest
+     */
+    std::string computeKey(const std::string& inputFile, const std::string& content) const;
+    
+    /**
+     * Copy a cached output to its destination
+     *
+     * A hit marks the entry as recently used.
+     *
+     * @param key Key from computeKey()
+     * @param outputFile Destination path
+     * @return True on a hit, false if the entry is missing or unreadable
+     */
+    bool lookup(const std::string& key, const std::string& outputFile) const;
+    
+    /**
+     * Add a freshly compiled output to the cache and enforce the size bound
+     *
+     * Failures to write the cache are logged and otherwise ignored.
+     *
+     * @param key Key from computeKey()
+     * @param outputFile Compiled output to store
+     */
+    void store(const std::string& key, const std::string& outputFile) const;
+    
+    /**
+     * Remove least recently used entries until the cache fits
+     * CacheParams::maxBytes
+     *
+     * @return Number of entries removed
+     */
+    size_t evict() const;
+    
+    /**
+     * Normalize source text so formatting-only edits share a key
+     *
+     * Converts CRLF line endings, strips trailing whitespace from every line
+     * and drops trailing blank lines.
+     */
+    static std::string normalizeSource(const std::string& source);
+    
+    /**
+     * Describe the configuration fields that affect generated code
+     */
+    static std::string configFingerprint(const CompilerConfig& config);
+
+private:
+    CompilerConfig config;
+    
+    /**
+     * Get the path of the entry for a key
+     */
+    std::string entryPath(const std::string& key) const;
+};
+
+#endif // COMPILATION_CACHE_H
@@ -0,0 +1,268 @@
+/**
+ * CompilerDriver.cpp
+ * Implements the file-level compilation pipeline
+ */
+
+#include "CompilerDriver.h"
+#include "MatrixShapeAnalysis.h"
+#include "ParallelCompiler.h"
+#include "PIMBinary.h"
+#include "ResidencyPlanner.h"
+#include "../utils/Logger.h"
+#include "../utils/TimeProfiler.h"
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Suffix of the cache key under which the host schedule of a sharded program is stored
+const char* const SCHEDULE_KEY = "-schedule";
+
+} // namespace
+
+CompilerDriver::CompilerDriver(const CompilerConfig& config)
+    : config(config), optimizer(config), memoryMapper(config), backend(config), cache(config) {}
+
+CompilerDriver::~CompilerDriver() = default;
+
+bool CompilerDriver::isIRFile(const std::string& filename) {
+    auto endsWith = [&](const std::string& suffix) {
+        return filename.size() >= suffix.size() &&
+               filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return endsWith(".ll") || endsWith(".bc");
+}
+
+std::string CompilerDriver::readFile(const std::string& filename) {
+    std::ifstream inFile(filename, std::ios::binary);
+    if (!inFile) {
+        throw std::runtime_error("Could not open input file: " + filename);
+    }
+    
+    return std::string((std::istreambuf_iterator<char>(inFile)),
+                       std::istreambuf_iterator<char>());
+}
+
+CompileResult CompilerDriver::compileFile(const std::string& inputFile, const std::string& outputFile) {
+    PIM_LOG_INFO("Compiling " + inputFile + " to " + outputFile);
+    ScopedTimer timer("Compile file", inputFile);
+    CompileResult result;
+    
+    // IR inputs are only read here when their contents are hashed
+    bool needsContent = cache.isEnabled() || !isIRFile(inputFile);
+    std::string source = needsContent ? readFile(inputFile) : std::string();
+    
+    std::string key;
+    if (cache.isEnabled()) {
+        ScopedTimer lookupTimer("Cache lookup");
+        key = cache.computeKey(inputFile, source);
+        bool sharded = config.sharding.devices > 1;
+        if (cache.lookup(key, outputFile) && (!sharded || cache.lookup(key + SCHEDULE_KEY, schedulePath(outputFile)))) {
+            PIM_LOG_INFO("Compilation cache hit for " + inputFile + " (" + key + ")");
+            result.instructions = countInstructions(outputFile);
+            result.cached = true;
+            return result;
+        }
+        PIM_LOG_INFO("Compilation cache miss for " + inputFile + " (" + key + ")");
+    }
+    
+    std::unique_ptr<llvm::Module> module = buildModule(inputFile, source);
+    
+    std::ofstream outFile;
+    std::unique_ptr<InstructionSink> sink = openOutput(outputFile, outFile);
+    result.instructions = generate(module, *sink);
+    
+    {
+        ScopedTimer writeTimer("Output writing");
+        sink->finish();
+        if (outFile.is_open()) {
+            outFile.close();
+            if (!outFile) {
+                throw std::runtime_error("Could not write output file: " + outputFile);
+            }
+        }
+        writeSchedule(outputFile);
+    }
+    
+    if (cache.isEnabled()) {
+        ScopedTimer storeTimer("Cache store");
+        cache.store(key, outputFile);
+        if (!shardPlan.kernels.empty()) {
+            cache.store(key + SCHEDULE_KEY, schedulePath(outputFile));
+        }
+    }
+    
+    return result;
+}
+
+size_t CompilerDriver::countInstructions(const std::string& outputFile) const {
+    if (config.outputFormat == "binary") {
+        PIMBinaryReader reader(outputFile);
+        return reader.getInstructionCount();
+    }
+    
+    // One instruction per line; DATA lines hold the constant matrices
+    std::istringstream text(readFile(outputFile));
+    size_t count = 0;
+    for (std::string line; std::getline(text, line);) {
+        if (!PIMConstantMatrix::isDataLine(line)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+std::unique_ptr<llvm::Module> CompilerDriver::buildModule(const std::string& inputFile, const std::string& source,
+                                                         bool dumpInput) {
+    std::unique_ptr<llvm::Module> module;
+    if (isIRFile(inputFile)) {
+        ScopedTimer timer("IR loading");
+        module = irGenerator.loadIR(inputFile);
+    } else {
+        module = generateModule(source);
+    }
+    if (dumpInput) {
+        dumpIR(module);
+    }
+    
+    PIM_LOG_INFO("Optimizing LLVM IR...");
+    optimizer.optimize(*module);
+    return module;
+}
+
+std::unique_ptr<llvm::Module> CompilerDriver::buildIRModule(const std::string& ir, const std::string& name) {
+    std::unique_ptr<llvm::Module> module;
+    {
+        ScopedTimer timer("IR loading");
+        module = irGenerator.parseIR(ir, name);
+    }
+    
+    PIM_LOG_INFO("Optimizing LLVM IR...");
+    optimizer.optimize(*module);
+    return module;
+}
+
+std::unique_ptr<llvm::Module> CompilerDriver::generateModule(const std::string& source) {
+    PIM_LOG_INFO("Parsing input file...");
+#ifdef HAVE_CLANG
+    std::unique_ptr<clang::ASTContext> ast;
+    {
+        ScopedTimer timer("Parsing");
+        ast = parser.parse(source);
+    }
+    PIM_LOG_INFO("Generating LLVM IR...");
+    ScopedTimer timer("IR generation");
+    return irGenerator.generateIR(ast);
+#else
+    try {
+        void* dummyAst;
+        {
+            ScopedTimer timer("Parsing");
+            dummyAst = parser.parse(source);
+        }
+        PIM_LOG_INFO("Generating LLVM IR...");
+        ScopedTimer timer("IR generation");
+        return irGenerator.generateIR(dummyAst);
+    } catch (const std::runtime_error& e) {
+        PIM_LOG_INFO("Using fallback path: Clang not available");
+        // Pass nullptr as a void* directly to the IR generator
+        ScopedTimer timer("IR generation");
+        return irGenerator.generateIR(nullptr);
+    }
+#endif
+}
+
+size_t CompilerDriver::generate(std::unique_ptr<llvm::Module>& module, InstructionSink& sink) {
+    shardPlan = ShardPlan();
+    
+    // Sharded kernels are lowered once per device from their shard shapes
+    if (config.sharding.devices > 1) {
+        ShapeAnalysisResult shapes;
+        {
+            ScopedTimer timer("Shape analysis");
+            shapes = MatrixShapeAnalysis(config).analyze(*module);
+        }
+        {
+            ScopedTimer timer("Shard planning");
+            shardPlan = ShardPlanner(config).plan(*module, shapes);
+        }
+        
+        PIM_LOG_INFO("Generating PIM instructions...");
+        ScopedTimer timer("Code generation");
+        return backend.generateShardedInstructions(shapes, shardPlan, sink);
+    }
+    
+    // Parallel builds analyze and map every function in its worker instead
+    if (config.compileJobs != 1) {
+        ScopedTimer timer("Code generation");
+        ParallelCompiler parallelCompiler(config);
+        return parallelCompiler.compile(module, sink);
+    }
+    
+    // Infer matrix dimensions once, before memory mapping rewrites the accesses
+    ShapeAnalysisResult shapes;
+    {
+        ScopedTimer timer("Shape analysis");
+        MatrixShapeAnalysis shapeAnalysis(config);
+        shapes = shapeAnalysis.analyze(*module);
+    }
+    
+    // The kernels of one program share the PIM memory, planned on the unmapped IR
+    ResidencyPlan residency;
+    {
+        ScopedTimer timer("Residency planning");
+        residency = ResidencyPlanner(config).plan(*module, shapes);
+    }
+    
+    PIM_LOG_INFO("Applying memory mapping for PIM architecture...");
+    std::unique_ptr<llvm::Module> mappedModule;
+    {
+        ScopedTimer timer("Memory mapping");
+        mappedModule = memoryMapper.applyMemoryMapping(module, shapes);
+    }
+    
+    PIM_LOG_INFO("Generating PIM instructions...");
+    ScopedTimer timer("Code generation");
+    return backend.generatePIMInstructions(mappedModule, shapes, sink, &residency);
+}
+
+const ShardPlan& CompilerDriver::getShardPlan() const {
+    return shardPlan;
+}
+
+void CompilerDriver::writeSchedule(const std::string& outputFile) const {
+    if (shardPlan.kernels.empty()) {
+        return;
+    }
+    std::string path = schedulePath(outputFile);
+    std::ofstream out(path);
+    shardPlan.write(out);
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Could not write host schedule: " + path);
+    }
+    PIM_LOG_INFO("Wrote the host schedule of " + std::to_string(shardPlan.devices) + " devices to " + path);
+}
+
+std::string CompilerDriver::schedulePath(const std::string& outputFile) {
+    return outputFile + ".schedule";
+}
+
+void CompilerDriver::dumpIR(std::unique_ptr<llvm::Module>& module) {
+    irGenerator.dumpIR(module);
+}
+
+std::unique_ptr<InstructionSink> CompilerDriver::openOutput(const std::string& outputFile,
+                                                            std::ofstream& textStream) const {
+    if (config.outputFormat == "binary") {
+        PIM_LOG_INFO("Writing PIM binary container");
+        return std::make_unique<BinaryInstructionSink>(outputFile, config.archParams, config.isaVersion);
+    }
+    
+    textStream.open(outputFile);
+    if (!textStream) {
+        throw std::runtime_error("Could not open output file: " + outputFile);
+    }
+    return std::make_unique<TextInstructionSink>(textStream, config.isaVersion);
+}
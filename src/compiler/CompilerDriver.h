@@ -0,0 +1,163 @@
+/**
+ * CompilerDriver.h
+ * Runs the compilation pipeline on input files with reusable components
+ */
+
+#ifndef COMPILER_DRIVER_H
+#define COMPILER_DRIVER_H
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <llvm/IR/Module.h>
+#include "Parser.h"
+#include "IRGenerator.h"
+#include "IROptimizer.h"
+#include "MemoryMapper.h"
+#include "PIMBackend.h"
+#include "InstructionSink.h"
+#include "CompilationCache.h"
+#include "ShardPlanner.h"
+#include "../include/CompilerConfig.h"
+
+/**
+ * Outcome of compiling one file
+ */
+struct CompileResult {
+    size_t instructions = 0;  // Instructions in the output
+    bool cached = false;      // Output was copied from the compilation cache
+};
+
+/**
+ * Owns one instance of every pipeline stage
+ *
+ * A driver may compile any number of files one after another; the parser,
+ * the IR generator and its LLVM context are created once and reused. A
+ * driver must only be used by one thread at a time. Modules it returns
+ * belong to its LLVM context and must be destroyed before the driver.
+ */
+class CompilerDriver {
+public:
+    explicit CompilerDriver(const CompilerConfig& config);
+    ~CompilerDriver();
+    
+    CompilerDriver(const CompilerDriver&) = delete;
+    CompilerDriver& operator=(const CompilerDriver&) = delete;
+    
+    /**
+     * Compile one input file
+     *
+     * With a cache directory configured, a cache hit copies the stored
+     * output and skips every pipeline stage; a miss stores the new output.
+     *
+     * @param inputFile C++ source, or LLVM IR (.ll/.bc)
+     * @param outputFile Destination in CompilerConfig::outputFormat
+     * @return Instruction count and whether the cache was used
+     * @throws std::runtime_error if any stage fails or a file cannot be accessed
+     */
+    CompileResult compileFile(const std::string& inputFile, const std::string& outputFile);
+    
+    /**
+     * Build the LLVM module of an input and run the IR pipeline of the
+     * configured optimization level (IROptimizer)
+     *
+     * @param inputFile Input path; .ll and .bc files are loaded as IR
+     * @param source Contents of a C++ input (unused for IR inputs)
+     * @param dumpInput Dump the IR to stderr before the pipeline changes it
+     * @return Optimized, unmapped LLVM module
+     */
+    std::unique_ptr<llvm::Module> buildModule(const std::string& inputFile, const std::string& source,
+                                              bool dumpInput = false);
+    
+    /**
+     * Parse LLVM IR held in memory and run the IR pipeline on it
+     *
+     * @param ir Textual IR or bitcode
+     * @param name Name of the module in diagnostics
+     * @return Optimized, unmapped LLVM module
+     * @throws std::runtime_error if the IR cannot be parsed or is invalid
+     */
+    std::unique_ptr<llvm::Module> buildIRModule(const std::string& ir, const std::string& name);
+    
+    /**
+     * Analyze, memory-map and lower a module into a sink
+     *
+     * Uses ParallelCompiler when CompilerConfig::compileJobs is not 1. With
+     * CompilerConfig::ShardingParams::devices above 1 the kernels are
+     * sharded instead, serially, and getShardPlan() holds their host schedule.
+     *
+     * @param module Module from buildModule(); it is consumed
+     * @param sink Sink receiving the instructions; finish() is left to the caller
+     * @return Number of instructions emitted
+     */
+    size_t generate(std::unique_ptr<llvm::Module>& module, InstructionSink& sink);
+    
+    /**
+     * Get the sharding planned by the last generate(); empty unless the
+     * program was sharded over several devices
+     */
+    const ShardPlan& getShardPlan() const;
+    
+    /**
+     * Write the host schedule of the last generate() next to its program
+     * (see schedulePath); does nothing for a program that was not sharded
+     *
+     * @param outputFile Path of the program
+     * @throws std::runtime_error if the schedule cannot be written
+     */
+    void writeSchedule(const std::string& outputFile) const;
+    
+    /**
+     * Get the path of the host schedule of a sharded program
+     */
+    static std::string schedulePath(const std::string& outputFile);
+    
+    /**
+     * Dump a module to stderr
+     */
+    void dumpIR(std::unique_ptr<llvm::Module>& module);
+    
+    /**
+     * Open the sink for an output file in the configured format
+     *
+     * @param outputFile Destination path
+     * @param textStream Stream kept open by the caller for text output
+     * @return Sink writing to outputFile
+     * @throws std::runtime_error if the file cannot be opened
+     */
+    std::unique_ptr<InstructionSink> openOutput(const std::string& outputFile, std::ofstream& textStream) const;
+    
+    /**
+     * Check whether a file holds LLVM IR rather than C++ source
+     */
+    static bool isIRFile(const std::string& filename);
+    
+    /**
+     * Read a whole file
+     *
+     * @throws std::runtime_error if the file cannot be opened
+     */
+    static std::string readFile(const std::string& filename);
+
+private:
+    CompilerConfig config;
+    Parser parser;
+    IRGenerator irGenerator;
+    IROptimizer optimizer;
+    MemoryMapper memoryMapper;
+    PIMBackend backend;
+    CompilationCache cache;
+    ShardPlan shardPlan;
+    
+    /**
+     * Parse a C++ input and generate its LLVM IR
+     */
+    std::unique_ptr<llvm::Module> generateModule(const std::string& source);
+    
+    /**
+     * Count the instructions of an output file in the configured format
+     */
+    size_t countInstructions(const std::string& outputFile) const;
+};
+
+#endif // COMPILER_DRIVER_H
@@ -0,0 +1,86 @@
+/**
+ * HostExecutor.cpp
+ * Implements host execution of kernels through ORC LLJIT
+ */
+
+#include "HostExecutor.h"
+#include "../utils/Logger.h"
+#include <mutex>
+#include <stdexcept>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+
+namespace {
+
+/**
+ * Turn an LLVM error into an exception
+ */
+void check(llvm::Error error, const std::string& context) {
+    if (error) {
+        throw std::runtime_error(context + ": " + llvm::toString(std::move(error)));
+    }
+}
+
+/**
+ * Register the native target with the JIT once per process
+ */
+void initializeNativeTarget() {
+    static std::once_flag initialized;
+    std::call_once(initialized, [] {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+    });
+}
+
+} // namespace
+
+HostExecutor::HostExecutor(const llvm::Module& module) {
+    initializeNativeTarget();
+    
+    auto created = llvm::orc::LLJITBuilder().create();
+    check(created.takeError(), "Could not create the host JIT");
+    jit = std::move(*created);
+    
+    auto process = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        jit->getDataLayout().getGlobalPrefix());
+    check(process.takeError(), "Could not resolve host symbols");
+    jit->getMainJITDylib().addGenerator(std::move(*process));
+    
+    // Modules belong to one context; the JIT gets a copy in its own
+    std::string bitcode;
+    {
+        llvm::raw_string_ostream out(bitcode);
+        llvm::WriteBitcodeToFile(module, out);
+    }
+    auto context = std::make_unique<llvm::LLVMContext>();
+    auto buffer = llvm::MemoryBuffer::getMemBuffer(bitcode, module.getModuleIdentifier(), false);
+    auto copy = llvm::parseBitcodeFile(buffer->getMemBufferRef(), *context);
+    check(copy.takeError(), "Could not copy " + module.getModuleIdentifier() + " into the host JIT");
+    (*copy)->setTargetTriple(jit->getTargetTriple().str());
+    (*copy)->setDataLayout(jit->getDataLayout());
+    
+    check(jit->addIRModule(llvm::orc::ThreadSafeModule(std::move(*copy), std::move(context))),
+          "Could not add " + module.getModuleIdentifier() + " to the host JIT");
+    PIM_LOG_INFO("Emulating " + module.getModuleIdentifier() + " on the host (" +
+                 jit->getTargetTriple().str() + ")");
+}
+
+HostExecutor::~HostExecutor() = default;
+
+void* HostExecutor::lookup(const std::string& symbol) {
+    auto address = jit->lookup(symbol);
+    check(address.takeError(), "Host JIT lookup of " + symbol + " failed");
+    return reinterpret_cast<void*>(static_cast<uintptr_t>(address->getAddress()));
+}
+
+void HostExecutor::run(const std::string& function) {
+    auto entry = reinterpret_cast<void (*)()>(lookup(function));
+    PIM_LOG_DEBUG("Running " + function + " on the host");
+    entry();
+}
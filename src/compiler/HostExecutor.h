@@ -0,0 +1,66 @@
+/**
+ * HostExecutor.h
+ * Runs kernels on the host through the LLVM JIT
+ */
+
+#ifndef HOST_EXECUTOR_H
+#define HOST_EXECUTOR_H
+
+#include <memory>
+#include <string>
+#include <llvm/IR/Module.h>
+
+namespace llvm {
+namespace orc {
+class LLJIT;
+}
+}
+
+/**
+ * Emulates a device by executing the original, unmapped IR of a module
+ * on the host (ORC LLJIT)
+ *
+ * This is the fallback when no PIM device is attached, and for functions
+ * the backend does not lower. The module's globals live in JIT memory,
+ * where the host fills the inputs and reads the results through lookup();
+ * external symbols resolve against the current process.
+ */
+class HostExecutor {
+public:
+    /**
+     * JIT-compile a module
+     *
+     * @param module Module to execute; it is copied into the executor's own
+     *        context and not modified
+     * @throws std::runtime_error if the JIT cannot be created or the module
+     *         cannot be added
+     */
+    explicit HostExecutor(const llvm::Module& module);
+    ~HostExecutor();
+    
+    HostExecutor(const HostExecutor&) = delete;
+    HostExecutor& operator=(const HostExecutor&) = delete;
+    
+    /**
+     * Get the address of a function or global variable
+     *
+     * @param symbol IR name without the platform prefix
+     * @return Address in JIT memory
+     * @throws std::runtime_error if the symbol is not defined
+     */
+    void* lookup(const std::string& symbol);
+    
+    /**
+     * Call a function taking no arguments and returning void, such as a
+     * kernel working on global matrices
+     *
+     * @param function IR name of the function
+     * @throws std::runtime_error if the function is not defined
+     */
+    void run(const std::string& function);
+
+private:
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+};
+
+#endif // HOST_EXECUTOR_H
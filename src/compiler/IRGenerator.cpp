@@ -12,6 +12,10 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
 
 #ifdef HAVE_CLANG
 #include <clang/AST/RecursiveASTVisitor.h>
@@ -30,7 +34,7 @@ public:
 
     bool VisitFunctionDecl(clang::FunctionDecl* decl) {
         if (decl->isThisDeclarationADefinition()) {
-            Logger::getInstance().log("Processing function: " + decl->getNameAsString());
+            PIM_LOG_INFO("Processing function: " + decl->getNameAsString());
             generator->processMatrixMultiplication(decl, module, *builder);
         }
         return true;
@@ -50,7 +54,7 @@ std::unique_ptr<llvm::Module> IRGenerator::generateIR(std::unique_ptr<clang::AST
         throw std::runtime_error("AST Context is null");
     }
     
-    Logger::getInstance().log("Starting LLVM IR generation");
+    PIM_LOG_INFO("Starting LLVM IR generation");
     
     // Create new LLVM module
     std::unique_ptr<llvm::Module> module = std::make_unique<llvm::Module>("MatrixMultiplicationModule", *llvmContext);
@@ -60,13 +64,13 @@ std::unique_ptr<llvm::Module> IRGenerator::generateIR(std::unique_ptr<clang::AST
     MatrixMultVisitor visitor(this, module.get(), &builder);
     visitor.TraverseDecl(astContext->getTranslationUnitDecl());
     
-    Logger::getInstance().log("LLVM IR generation completed");
+    PIM_LOG_INFO("LLVM IR generation completed");
     
     return module;
 }
 #else
 std::unique_ptr<llvm::Module> IRGenerator::generateIR(void* /*astContext*/) {
-    Logger::getInstance().log("Starting LLVM IR generation (no Clang available)");
+    PIM_LOG_INFO("Starting LLVM IR generation (no Clang available)");
     
     // Create new LLVM module
     std::unique_ptr<llvm::Module> module = std::make_unique<llvm::Module>("MatrixMultiplicationModule", *llvmContext);
@@ -75,14 +79,48 @@ std::unique_ptr<llvm::Module> IRGenerator::generateIR(void* /*astContext*/) {
     // When Clang is not available, create a hardcoded matrix multiplication function
     createHardcodedMatrixMultiplyFunction(module.get(), builder);
     
-    Logger::getInstance().log("LLVM IR generation completed (fallback path)");
+    PIM_LOG_INFO("LLVM IR generation completed (fallback path)");
     
     return module;
 }
 #endif
 
+std::unique_ptr<llvm::Module> IRGenerator::loadIR(const std::string& filename) {
+    PIM_LOG_INFO("Loading LLVM IR from " + filename);
+    
+    llvm::SMDiagnostic error;
+    std::unique_ptr<llvm::Module> module = llvm::parseIRFile(filename, error, *llvmContext);
+    return verifyParsedIR(std::move(module), error, filename);
+}
+
+std::unique_ptr<llvm::Module> IRGenerator::parseIR(const std::string& ir, const std::string& name) {
+    llvm::SMDiagnostic error;
+    auto buffer = llvm::MemoryBuffer::getMemBuffer(ir, name, false);
+    std::unique_ptr<llvm::Module> module = llvm::parseIR(buffer->getMemBufferRef(), error, *llvmContext);
+    return verifyParsedIR(std::move(module), error, name);
+}
+
+std::unique_ptr<llvm::Module> IRGenerator::verifyParsedIR(std::unique_ptr<llvm::Module> module,
+                                                          const llvm::SMDiagnostic& error,
+                                                          const std::string& name) {
+    if (!module) {
+        std::string message;
+        llvm::raw_string_ostream messageStream(message);
+        error.print("pim_compiler", messageStream);
+        throw std::runtime_error("Failed to load LLVM IR: " + messageStream.str());
+    }
+    
+    std::string verifierMessage;
+    llvm::raw_string_ostream verifierStream(verifierMessage);
+    if (llvm::verifyModule(*module, &verifierStream)) {
+        throw std::runtime_error("Invalid LLVM IR in " + name + ": " + verifierStream.str());
+    }
+    
+    return module;
+}
+
 void IRGenerator::dumpIR(std::unique_ptr<llvm::Module>& module) {
-    Logger::getInstance().log("Dumping LLVM IR");
+    PIM_LOG_INFO("Dumping LLVM IR");
     std::string irStr;
     llvm::raw_string_ostream irStream(irStr);
     module->print(irStream, nullptr);
@@ -124,7 +162,7 @@ void IRGenerator::processMatrixMultiplication(clang::FunctionDecl* func, llvm::M
     // Process function body for matrix multiplication patterns
     for (auto it = body->child_begin(); it != body->child_end(); ++it) {
         if (isMatrixMultiplyPattern(*it)) {
-            Logger::getInstance().log("Found matrix multiplication pattern");
+            PIM_LOG_INFO("Found matrix multiplication pattern");
             // Here we would extract the matrices and their dimensions
             // and generate the appropriate LLVM IR for matrix multiplication
             
@@ -140,8 +178,12 @@ void IRGenerator::processMatrixMultiplication(clang::FunctionDecl* func, llvm::M
             llvm::Value* common = llvm::ConstantInt::get(llvm::Type::getInt32Ty(*llvmContext), 2);
             
             // Create nested loops for matrix multiplication
-            // Outer loop (i)
+            // Loop counters live in the entry block so mem2reg can promote them
             llvm::Value* i = builder.CreateAlloca(llvm::Type::getInt32Ty(*llvmContext), nullptr, "i");
+            llvm::Value* j = builder.CreateAlloca(llvm::Type::getInt32Ty(*llvmContext), nullptr, "j");
+            llvm::Value* k = builder.CreateAlloca(llvm::Type::getInt32Ty(*llvmContext), nullptr, "k");
+            
+            // Outer loop (i)
             builder.CreateStore(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*llvmContext), 0), i);
             
             llvm::BasicBlock* outerLoopCond = llvm::BasicBlock::Create(*llvmContext, "outer_loop_cond", llvmFunc);
@@ -161,7 +203,6 @@ void IRGenerator::processMatrixMultiplication(clang::FunctionDecl* func, llvm::M
             builder.SetInsertPoint(outerLoopBody);
             
             // Middle loop (j)
-            llvm::Value* j = builder.CreateAlloca(llvm::Type::getInt32Ty(*llvmContext), nullptr, "j");
             builder.CreateStore(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*llvmContext), 0), j);
             
             llvm::BasicBlock* middleLoopCond = llvm::BasicBlock::Create(*llvmContext, "middle_loop_cond", llvmFunc);
@@ -192,7 +233,6 @@ void IRGenerator::processMatrixMultiplication(clang::FunctionDecl* func, llvm::M
             builder.CreateStore(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*llvmContext), 0), cij_ptr);
             
             // Inner loop (k)
-            llvm::Value* k = builder.CreateAlloca(llvm::Type::getInt32Ty(*llvmContext), nullptr, "k");
             builder.CreateStore(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*llvmContext), 0), k);
             
             llvm::BasicBlock* innerLoopCond = llvm::BasicBlock::Create(*llvmContext, "inner_loop_cond", llvmFunc);
@@ -293,7 +333,7 @@ bool IRGenerator::isMatrixMultiplyPattern(clang::Stmt* stmt) {
 
 // Helper function for when Clang is not available
 void IRGenerator::createHardcodedMatrixMultiplyFunction(llvm::Module* module, llvm::IRBuilder<>& builder) {
-    Logger::getInstance().log("Creating hardcoded matrix multiplication function (Clang not available)");
+    PIM_LOG_INFO("Creating hardcoded matrix multiplication function (Clang not available)");
     
     // Create function prototype for matrix multiplication
     std::vector<llvm::Type*> paramTypes = {
@@ -325,8 +365,12 @@ void IRGenerator::createHardcodedMatrixMultiplyFunction(llvm::Module* module, ll
     builder.SetInsertPoint(entryBB);
     
     // Create nested loops for matrix multiplication - similar to the Clang-dependent version
-    // Outer loop (i)
+    // Loop counters live in the entry block so mem2reg can promote them
     llvm::Value* i = builder.CreateAlloca(llvm::Type::getInt32Ty(*llvmContext), nullptr, "i");
+    llvm::Value* j = builder.CreateAlloca(llvm::Type::getInt32Ty(*llvmContext), nullptr, "j");
+    llvm::Value* k = builder.CreateAlloca(llvm::Type::getInt32Ty(*llvmContext), nullptr, "k");
+    
+    // Outer loop (i)
     builder.CreateStore(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*llvmContext), 0), i);
     
     llvm::BasicBlock* outerLoopCond = llvm::BasicBlock::Create(*llvmContext, "outer_loop_cond", matrixMultFunc);
@@ -346,7 +390,6 @@ void IRGenerator::createHardcodedMatrixMultiplyFunction(llvm::Module* module, ll
     builder.SetInsertPoint(outerLoopBody);
     
     // Middle loop (j)
-    llvm::Value* j = builder.CreateAlloca(llvm::Type::getInt32Ty(*llvmContext), nullptr, "j");
     builder.CreateStore(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*llvmContext), 0), j);
     
     llvm::BasicBlock* middleLoopCond = llvm::BasicBlock::Create(*llvmContext, "middle_loop_cond", matrixMultFunc);
@@ -377,7 +420,6 @@ void IRGenerator::createHardcodedMatrixMultiplyFunction(llvm::Module* module, ll
     builder.CreateStore(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*llvmContext), 0), cij_ptr);
     
     // Inner loop (k)
-    llvm::Value* k = builder.CreateAlloca(llvm::Type::getInt32Ty(*llvmContext), nullptr, "k");
     builder.CreateStore(llvm::ConstantInt::get(llvm::Type::getInt32Ty(*llvmContext), 0), k);
     
     llvm::BasicBlock* innerLoopCond = llvm::BasicBlock::Create(*llvmContext, "inner_loop_cond", matrixMultFunc);
@@ -11,6 +11,7 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/Support/SourceMgr.h>
 
 // Include Clang headers conditionally
 #ifdef HAVE_CLANG
@@ -50,6 +51,25 @@ public:
     std::unique_ptr<llvm::Module> generateIR(void* astContext);
 #endif
     
+    /**
+     * Load an existing LLVM IR module (textual .ll or bitcode .bc)
+     * 
+     * @param filename Path of the IR file
+     * @return Loaded LLVM module
+     * @throws std::runtime_error if the file cannot be read or parsed
+     */
+    std::unique_ptr<llvm::Module> loadIR(const std::string& filename);
+    
+    /**
+     * Parse an LLVM IR module held in memory (textual IR or bitcode)
+     * 
+     * @param ir Contents of a .ll or .bc file
+     * @param name Name of the module in diagnostics
+     * @return Parsed LLVM module
+     * @throws std::runtime_error if the IR cannot be parsed or is invalid
+     */
+    std::unique_ptr<llvm::Module> parseIR(const std::string& ir, const std::string& name);
+    
     /**
      * Dump LLVM IR to stdout for debugging
      */
@@ -58,6 +78,15 @@ public:
 private:
     std::unique_ptr<llvm::LLVMContext> llvmContext;
     
+    /**
+     * Check the result of parsing IR and verify the module
+     * 
+     * @throws std::runtime_error with the parser diagnostic or verifier message
+     */
+    static std::unique_ptr<llvm::Module> verifyParsedIR(std::unique_ptr<llvm::Module> module,
+                                                        const llvm::SMDiagnostic& error,
+                                                        const std::string& name);
+    
     /**
      * Create a hardcoded matrix multiplication function
      * Used when Clang is not available
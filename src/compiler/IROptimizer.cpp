@@ -0,0 +1,162 @@
+/**
+ * IROptimizer.cpp
+ * Implements the optimization pipelines per optimization level
+ */
+
+#include "IROptimizer.h"
+#include "../utils/Logger.h"
+#include "../utils/TimeProfiler.h"
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/IR/PassTimingInfo.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/InstCombine/InstCombine.h>
+#include <llvm/Transforms/Scalar/DeadStoreElimination.h>
+#include <llvm/Transforms/Scalar/EarlyCSE.h>
+#include <llvm/Transforms/Scalar/GVN.h>
+#include <llvm/Transforms/Scalar/LICM.h>
+#include <llvm/Transforms/Scalar/LoopPassManager.h>
+#include <llvm/Transforms/Scalar/LoopRotation.h>
+#include <llvm/Transforms/Scalar/SROA.h>
+#include <llvm/Transforms/Scalar/SimplifyCFG.h>
+#include <llvm/Transforms/Utils/Mem2Reg.h>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+size_t countInstructions(const llvm::Module& module) {
+    size_t count = 0;
+    for (const auto& function : module) {
+        count += function.getInstructionCount();
+    }
+    return count;
+}
+
+// Function pipeline of one optimization level
+llvm::FunctionPassManager buildPipeline(CompilerConfig::OptimizationLevel level) {
+    llvm::FunctionPassManager functionPasses;
+    if (level == CompilerConfig::O0) {
+        return functionPasses;
+    }
+    
+    // Stack slots to SSA values, then local cleanup
+    functionPasses.addPass(llvm::SROAPass());
+    functionPasses.addPass(llvm::PromotePass());
+    functionPasses.addPass(llvm::EarlyCSEPass());
+    functionPasses.addPass(llvm::InstCombinePass());
+    functionPasses.addPass(llvm::SimplifyCFGPass());
+    if (level == CompilerConfig::O1) {
+        return functionPasses;
+    }
+    
+    // Canonical loops (the adaptor adds loop-simplify and LCSSA), rotated
+    // and with invariant code hoisted. IndVarSimplify is not run: it folds
+    // the exit of a loop that runs once, which dissolves the loop nest of
+    // kernels with a dimension of 1
+    llvm::LoopPassManager loopPasses;
+    loopPasses.addPass(llvm::LoopRotatePass());
+    loopPasses.addPass(llvm::LICMPass());
+    functionPasses.addPass(llvm::createFunctionToLoopPassAdaptor(std::move(loopPasses), /*UseMemorySSA=*/true));
+    
+    if (level == CompilerConfig::O3) {
+        functionPasses.addPass(llvm::GVNPass());
+        functionPasses.addPass(llvm::DSEPass());
+    }
+    functionPasses.addPass(llvm::InstCombinePass());
+    functionPasses.addPass(llvm::SimplifyCFGPass());
+    return functionPasses;
+}
+
+} // namespace
+
+IROptimizer::IROptimizer(const CompilerConfig& config) : config(config) {}
+
+IROptimizer::~IROptimizer() = default;
+
+std::string IROptimizer::describePipeline(CompilerConfig::OptimizationLevel level) {
+    switch (level) {
+        case CompilerConfig::O0:
+            return "none";
+        case CompilerConfig::O1:
+            return "sroa,mem2reg,early-cse,instcombine,simplifycfg";
+        case CompilerConfig::O2:
+            return "sroa,mem2reg,early-cse,instcombine,simplifycfg,loop-mssa(loop-rotate,licm),"
+                   "instcombine,simplifycfg";
+        case CompilerConfig::O3:
+            return "sroa,mem2reg,early-cse,instcombine,simplifycfg,loop-mssa(loop-rotate,licm),"
+                   "gvn,dse,instcombine,simplifycfg";
+    }
+    return "none";
+}
+
+void IROptimizer::optimize(llvm::Module& module) {
+    const auto level = config.optimizationLevel;
+    PIM_LOG_INFO("Running O" + std::to_string(level) + " IR pipeline: " + describePipeline(level));
+    if (level == CompilerConfig::O0) {
+        return;
+    }
+    ScopedTimer timer("IR optimization");
+    
+    // With profiling, every pass run is a stage nested in the pass managers
+    // that run it, and LLVM's pass timing table joins the time report
+    TimeProfiler& profiler = TimeProfiler::getInstance();
+    llvm::PassInstrumentationCallbacks callbacks;
+    std::string passTiming;
+    llvm::raw_string_ostream passTimingStream(passTiming);
+    std::unique_ptr<llvm::TimePassesHandler> timePasses;
+    std::vector<std::unique_ptr<ScopedTimer>> passTimers;
+    if (profiler.isEnabled()) {
+        timePasses = std::make_unique<llvm::TimePassesHandler>(true);
+        timePasses->setOutStream(passTimingStream);
+        timePasses->registerCallbacks(callbacks);
+        
+        // Pass IDs are the pass class names; pass managers and adaptors only
+        // group other passes and are not stages of their own
+        callbacks.registerBeforeNonSkippedPassCallback([&](llvm::StringRef pass, llvm::Any) {
+            bool grouping = pass.startswith("PassManager<") || pass.endswith("PassAdaptor");
+            passTimers.push_back(grouping ? nullptr : std::make_unique<ScopedTimer>(pass.str().c_str()));
+        });
+        callbacks.registerAfterPassCallback([&](llvm::StringRef, llvm::Any, const llvm::PreservedAnalyses&) {
+            passTimers.pop_back();
+        });
+        callbacks.registerAfterPassInvalidatedCallback([&](llvm::StringRef, const llvm::PreservedAnalyses&) {
+            passTimers.pop_back();
+        });
+    }
+    
+    // Analyses are registered through a PassBuilder so every pass finds
+    // the ones it requires
+    llvm::LoopAnalysisManager loopAnalyses;
+    llvm::FunctionAnalysisManager functionAnalyses;
+    llvm::CGSCCAnalysisManager sccAnalyses;
+    llvm::ModuleAnalysisManager moduleAnalyses;
+    llvm::PassBuilder passBuilder(nullptr, llvm::PipelineTuningOptions(), llvm::None, &callbacks);
+    passBuilder.registerModuleAnalyses(moduleAnalyses);
+    passBuilder.registerCGSCCAnalyses(sccAnalyses);
+    passBuilder.registerFunctionAnalyses(functionAnalyses);
+    passBuilder.registerLoopAnalyses(loopAnalyses);
+    passBuilder.crossRegisterProxies(loopAnalyses, functionAnalyses, sccAnalyses, moduleAnalyses);
+    
+    size_t before = countInstructions(module);
+    llvm::ModulePassManager modulePasses;
+    modulePasses.addPass(llvm::createModuleToFunctionPassAdaptor(buildPipeline(level)));
+    modulePasses.run(module, moduleAnalyses);
+    
+    if (timePasses) {
+        timePasses->print();
+        profiler.addSection("IR passes of " + module.getModuleIdentifier() + ":\n" + passTimingStream.str());
+    }
+    
+    std::string errors;
+    llvm::raw_string_ostream errorStream(errors);
+    if (llvm::verifyModule(module, &errorStream)) {
+        throw std::runtime_error("IR pipeline produced an invalid module: " + errorStream.str());
+    }
+    
+    PIM_LOG_INFO("IR instructions: " + std::to_string(before) + " before, " +
+                std::to_string(countInstructions(module)) + " after optimization");
+}
@@ -0,0 +1,45 @@
+/**
+ * IROptimizer.h
+ * LLVM pass pipeline run on the IR before shape analysis and memory mapping
+ */
+
+#ifndef IR_OPTIMIZER_H
+#define IR_OPTIMIZER_H
+
+#include <string>
+#include <llvm/IR/Module.h>
+#include "../include/CompilerConfig.h"
+
+class IROptimizer {
+public:
+    explicit IROptimizer(const CompilerConfig& config);
+    ~IROptimizer();
+    
+    /**
+     * Run the new pass manager pipeline of CompilerConfig::optimizationLevel
+     *
+     * O0 runs nothing. O1 promotes stack slots to SSA (SROA, mem2reg) and
+     * cleans up with early CSE, instcombine and simplifycfg, which lets
+     * ScalarEvolution compute the trip counts of loops whose counters and
+     * bounds lived in memory. O2 adds loop canonicalization (loop-simplify,
+     * LCSSA, rotation) and LICM; O3 adds GVN and dead store elimination.
+     * Passes that restructure or remove loops (unrolling, interchange, idiom
+     * recognition, loop deletion) are not run: the backend lowers the i/j/k
+     * nest that MatrixShapeAnalysis recognizes and generates its own
+     * blocking, ordering and transfers.
+     *
+     * @param module Module to optimize in place
+     * @throws std::runtime_error if the optimized module fails verification
+     */
+    void optimize(llvm::Module& module);
+    
+    /**
+     * Get the textual pass pipeline of an optimization level (for logging)
+     */
+    static std::string describePipeline(CompilerConfig::OptimizationLevel level);
+
+private:
+    CompilerConfig config;
+};
+
+#endif // IR_OPTIMIZER_H
@@ -0,0 +1,260 @@
+/**
+ * InstructionSink.cpp
+ * Implementation of the instruction sinks
+ */
+
+#include "InstructionSink.h"
+#include "PIMBinary.h"
+#include "../utils/Logger.h"
+#include <iostream>
+#include <stdexcept>
+
+// Implementation of InstructionSink
+
+InstructionSink::InstructionSink() : count(0), dataCount(0) {}
+
+InstructionSink::~InstructionSink() = default;
+
+void InstructionSink::emit(const PIMInstruction& instruction) {
+    write(instruction);
+    count++;
+}
+
+size_t InstructionSink::emitData(const PIMConstantMatrix& matrix) {
+    size_t index = writeData(matrix);
+    dataCount++;
+    return index;
+}
+
+void InstructionSink::finish() {}
+
+size_t InstructionSink::getCount() const {
+    return count;
+}
+
+size_t InstructionSink::getDataCount() const {
+    return dataCount;
+}
+
+size_t InstructionSink::writeData(const PIMConstantMatrix&) {
+    return dataCount;
+}
+
+// Implementation of TextInstructionSink
+
+TextInstructionSink::TextInstructionSink(std::ostream& out, unsigned isaVersion)
+    : out(out), isaVersion(isaVersion) {}
+
+void TextInstructionSink::write(const PIMInstruction& instruction) {
+    out << instruction.toString(isaVersion) << '\n';
+}
+
+size_t TextInstructionSink::writeData(const PIMConstantMatrix& matrix) {
+    out << matrix.toString(getDataCount());
+    return getDataCount();
+}
+
+// Implementation of BinaryInstructionSink
+
+BinaryInstructionSink::BinaryInstructionSink(const std::string& filename,
+                                             const CompilerConfig::PIMArchParams& archParams,
+                                             unsigned isaVersion)
+    : filename(filename), archParams(archParams), isaVersion(isaVersion),
+      file(std::fopen(filename.c_str(), "wb")) {
+    if (!file) {
+        throw std::runtime_error("Could not open output file: " + filename);
+    }
+    
+    buffer.reserve(BUFFER_SIZE);
+    
+    // Reserve space for the header and padding up to the instruction section
+    PIMBinaryHeader header = PIMBinaryWriter::makeHeader(archParams, 0, 0, isaVersion);
+    buffer.resize(header.textOffset, 0);
+}
+
+BinaryInstructionSink::~BinaryInstructionSink() {
+    // A container that was never finished is incomplete; do not leave it behind
+    if (file) {
+        std::fclose(file);
+        std::remove(filename.c_str());
+    }
+}
+
+void BinaryInstructionSink::write(const PIMInstruction& instruction) {
+    const size_t wordBytes = PIMEncoding::wordBytes(isaVersion);
+    if (buffer.size() + wordBytes > BUFFER_SIZE) {
+        flushBuffer();
+    }
+    
+    // Throws for an instruction the encoding cannot hold
+    size_t offset = buffer.size();
+    buffer.resize(offset + wordBytes);
+    PIMBinaryWriter::encodeInstruction(instruction, isaVersion, buffer.data() + offset);
+}
+
+size_t BinaryInstructionSink::writeData(const PIMConstantMatrix& matrix) {
+    data.push_back(matrix);
+    return data.size() - 1;
+}
+
+void BinaryInstructionSink::flushBuffer() {
+    if (!buffer.empty() && std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+        throw std::runtime_error("Failed to write output file: " + filename);
+    }
+    buffer.clear();
+}
+
+void BinaryInstructionSink::finish() {
+    if (!file) {
+        return;
+    }
+    
+    size_t blocks = 0;
+    std::vector<uint8_t> section = PIMBinaryWriter::encodeData(data, &blocks);
+    PIMBinaryHeader header = PIMBinaryWriter::makeHeader(archParams, static_cast<uint32_t>(getCount()),
+                                                         static_cast<uint32_t>(section.size()), isaVersion);
+    if (!data.empty()) {
+        PIM_LOG_INFO("Data section of " + std::to_string(data.size()) + " constant matrices: " +
+                    std::to_string(section.size()) + " bytes, " + std::to_string(blocks) + " blocks");
+    }
+    
+    // Pad the instruction section out to the data section
+    size_t end = header.textOffset + header.textSize;
+    buffer.resize(buffer.size() + (header.dataOffset - end), 0);
+    flushBuffer();
+    buffer = std::move(section);
+    flushBuffer();
+    
+    uint8_t encoded[PIMBinaryFormat::HEADER_SIZE];
+    PIMBinaryWriter::encodeHeader(header, encoded);
+    
+    bool ok = std::fseek(file, 0, SEEK_SET) == 0 &&
+              std::fwrite(encoded, 1, sizeof(encoded), file) == sizeof(encoded);
+    ok = (std::fclose(file) == 0) && ok;
+    file = nullptr;
+    
+    if (!ok) {
+        throw std::runtime_error("Failed to write output file: " + filename);
+    }
+}
+
+// Implementation of CountingInstructionSink
+
+CountingInstructionSink::CountingInstructionSink()
+    : opcodeCounts(PIMInstructionFormat::OPCODE_MASK + 1, 0) {}
+
+void CountingInstructionSink::write(const PIMInstruction& instruction) {
+    opcodeCounts[instruction.getOpcode() & PIMInstructionFormat::OPCODE_MASK]++;
+}
+
+size_t CountingInstructionSink::getOpcodeCount(PIMOpcode opcode) const {
+    return opcodeCounts[opcode & PIMInstructionFormat::OPCODE_MASK];
+}
+
+// Implementation of CoalescingInstructionSink
+
+namespace {
+
+// PIM word and host buffer of a LOAD or STORE
+unsigned transferAddress(const PIMInstruction& instruction) {
+    return instruction.getOpcode() == PIM_LOAD ? instruction.getDest() : instruction.getSrc1();
+}
+
+unsigned transferBuffer(const PIMInstruction& instruction) {
+    return instruction.getOpcode() == PIM_LOAD ? instruction.getSrc1() : instruction.getDest();
+}
+
+} // namespace
+
+CoalescingInstructionSink::CoalescingInstructionSink(InstructionSink& next, unsigned maxBurst)
+    : next(next), maxBurst(maxBurst), axis(PIM_BLOCK_ALONG_ROW), merged(0), blocks(0) {}
+
+void CoalescingInstructionSink::finish() {
+    flush();
+}
+
+size_t CoalescingInstructionSink::getMergedCount() const {
+    return merged;
+}
+
+size_t CoalescingInstructionSink::getBlockCount() const {
+    return blocks;
+}
+
+bool CoalescingInstructionSink::continuesRun(const PIMInstruction& instruction) const {
+    const PIMInstruction& first = run.front();
+    const unsigned length = static_cast<unsigned>(run.size());
+    if (instruction.getOpcode() != first.getOpcode() || length >= maxBurst ||
+        transferBuffer(instruction) != transferBuffer(first) ||
+        transferAddress(instruction) != transferAddress(first) + length) {
+        return false;
+    }
+    
+    // The second transfer fixes the axis of the run
+    bool alongRow = instruction.getSrc2() == first.getSrc2() && instruction.getImm() == first.getImm() + length;
+    bool downColumn = instruction.getImm() == first.getImm() && instruction.getSrc2() == first.getSrc2() + length;
+    if (length == 1) {
+        return alongRow || downColumn;
+    }
+    return axis == PIM_BLOCK_ALONG_ROW ? alongRow : downColumn;
+}
+
+void CoalescingInstructionSink::write(const PIMInstruction& instruction) {
+    PIMOpcode opcode = instruction.getOpcode();
+    bool transfer = (opcode == PIM_LOAD || opcode == PIM_STORE) &&
+                    transferBuffer(instruction) <= PIMBlockOperand::BUFFER_MASK;
+    if (!run.empty() && transfer && continuesRun(instruction)) {
+        if (run.size() == 1) {
+            axis = instruction.getSrc2() == run.front().getSrc2() ? PIM_BLOCK_ALONG_ROW : PIM_BLOCK_DOWN_COLUMN;
+        }
+        run.push_back(instruction);
+        return;
+    }
+    
+    flush();
+    if (transfer && maxBurst > 1) {
+        run.push_back(instruction);
+    } else {
+        next.emit(instruction);
+    }
+}
+
+size_t CoalescingInstructionSink::writeData(const PIMConstantMatrix& matrix) {
+    flush();
+    return next.emitData(matrix);
+}
+
+void CoalescingInstructionSink::flush() {
+    if (run.size() == 1) {
+        next.emit(run.front());
+    } else if (!run.empty()) {
+        const PIMInstruction& first = run.front();
+        unsigned length = static_cast<unsigned>(run.size());
+        unsigned packed = PIMBlockOperand::encode(transferBuffer(first), length, axis);
+        if (first.getOpcode() == PIM_LOAD) {
+            next.emit(PIMInstruction(PIM_LOAD_BLOCK, first.getDest(), packed, first.getSrc2(), first.getImm()));
+        } else {
+            next.emit(PIMInstruction(PIM_STORE_BLOCK, packed, first.getSrc1(), first.getSrc2(), first.getImm()));
+        }
+        merged += length;
+        blocks++;
+    }
+    run.clear();
+}
+
+// Implementation of VectorInstructionSink
+
+VectorInstructionSink::VectorInstructionSink(std::vector<PIMInstruction>& instructions,
+                                             std::vector<PIMConstantMatrix>* data)
+    : instructions(instructions), data(data) {}
+
+void VectorInstructionSink::write(const PIMInstruction& instruction) {
+    instructions.push_back(instruction);
+}
+
+size_t VectorInstructionSink::writeData(const PIMConstantMatrix& matrix) {
+    if (data) {
+        data->push_back(matrix);
+    }
+    return getDataCount();
+}
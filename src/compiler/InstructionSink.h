@@ -0,0 +1,240 @@
+/**
+ * InstructionSink.h
+ * Destinations for PIM instructions streamed out of the backend
+ */
+
+#ifndef INSTRUCTION_SINK_H
+#define INSTRUCTION_SINK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "PIMInstruction.h"
+#include "../include/CompilerConfig.h"
+
+/**
+ * Base class for instruction sinks
+ * 
+ * The backend emits each instruction as soon as it is generated, so a sink
+ * that writes through keeps memory use independent of program size.
+ */
+class InstructionSink {
+public:
+    InstructionSink();
+    virtual ~InstructionSink();
+    
+    InstructionSink(const InstructionSink&) = delete;
+    InstructionSink& operator=(const InstructionSink&) = delete;
+    
+    /**
+     * Emit one instruction
+     */
+    void emit(const PIMInstruction& instruction);
+    
+    /**
+     * Add a constant matrix to the data section of the program
+     * 
+     * @return Index of the matrix in the program (PIM_CONFIG_CONSTANT_B
+     *         selects it as index + 1)
+     */
+    size_t emitData(const PIMConstantMatrix& matrix);
+    
+    /**
+     * Flush any buffered output; no instructions may be emitted afterwards
+     */
+    virtual void finish();
+    
+    /**
+     * Get the number of instructions emitted so far
+     */
+    size_t getCount() const;
+
+    /**
+     * Get the number of constant matrices emitted so far
+     */
+    size_t getDataCount() const;
+
+protected:
+    /**
+     * Consume one instruction
+     */
+    virtual void write(const PIMInstruction& instruction) = 0;
+
+    /**
+     * Consume one constant matrix; sinks that do not keep the program's
+     * data drop it
+     * 
+     * @return Index of the matrix in the program
+     */
+    virtual size_t writeData(const PIMConstantMatrix& matrix);
+
+private:
+    size_t count;
+    size_t dataCount;
+};
+
+/**
+ * Writes the human-readable form, one instruction per line
+ * 
+ * Constant matrices are written as DATA lines where they are emitted (see
+ * PIMConstantMatrix).
+ */
+class TextInstructionSink : public InstructionSink {
+public:
+    /**
+     * @param out Output stream
+     * @param isaVersion Encoding shown in the comment of every line (PIMEncoding)
+     */
+    explicit TextInstructionSink(std::ostream& out, unsigned isaVersion = PIMEncoding::V1);
+
+protected:
+    void write(const PIMInstruction& instruction) override;
+    size_t writeData(const PIMConstantMatrix& matrix) override;
+
+private:
+    std::ostream& out;
+    unsigned isaVersion;
+};
+
+/**
+ * Writes a PIM binary container (see PIMBinaryFormat.h) with buffered writes
+ * 
+ * The header is written last, once the instruction count is known, after
+ * the data section built from the constant matrices. An instruction with
+ * a field too wide for the encoding fails the write, and a container that
+ * is not finished is removed.
+ */
+class BinaryInstructionSink : public InstructionSink {
+public:
+    /**
+     * @param filename Output file
+     * @param archParams Architecture recorded in the header
+     * @param isaVersion Instruction encoding (PIMEncoding)
+     * @throws std::runtime_error if the file cannot be opened
+     */
+    BinaryInstructionSink(const std::string& filename, const CompilerConfig::PIMArchParams& archParams,
+                          unsigned isaVersion = PIMEncoding::V1);
+    ~BinaryInstructionSink() override;
+    
+    /**
+     * @throws std::runtime_error if the file cannot be written
+     */
+    void finish() override;
+    
+protected:
+    void write(const PIMInstruction& instruction) override;
+    size_t writeData(const PIMConstantMatrix& matrix) override;
+
+private:
+    static const size_t BUFFER_SIZE = 64 * 1024;
+    
+    std::string filename;
+    CompilerConfig::PIMArchParams archParams;
+    unsigned isaVersion;
+    FILE* file;
+    std::vector<uint8_t> buffer;
+    std::vector<PIMConstantMatrix> data;
+    
+    void flushBuffer();
+};
+
+/**
+ * Counts instructions without storing them
+ */
+class CountingInstructionSink : public InstructionSink {
+public:
+    CountingInstructionSink();
+    
+    /**
+     * Get the number of instructions emitted with the given opcode
+     */
+    size_t getOpcodeCount(PIMOpcode opcode) const;
+
+protected:
+    void write(const PIMInstruction& instruction) override;
+
+private:
+    std::vector<size_t> opcodeCounts;
+};
+
+/**
+ * Merges runs of host transfers into block transfers before forwarding them
+ * 
+ * A LOAD (or STORE) continues the pending run when it moves the next PIM
+ * word from or to the same host buffer at the next coordinate along one
+ * axis; runs of two or more become one LOAD_BLOCK (STORE_BLOCK), which
+ * moves exactly the same words (see PIM Block Transfers). Every other
+ * instruction flushes the run first, so the order of memory effects is
+ * kept. Transfers of buffers block transfers cannot address (the epilogue
+ * vectors) are forwarded unmerged. Merging renumbers the instructions that
+ * follow, so the stream must not contain absolute jump targets. Constant
+ * matrices are forwarded as they are emitted.
+ */
+class CoalescingInstructionSink : public InstructionSink {
+public:
+    /**
+     * @param next Sink receiving the coalesced instructions
+     * @param maxBurst Longest run merged into one block transfer
+     */
+    CoalescingInstructionSink(InstructionSink& next, unsigned maxBurst);
+    
+    /**
+     * Forward the pending run; the next sink is not finished
+     */
+    void finish() override;
+    
+    /**
+     * Get the number of LOADs and STOREs merged into block transfers
+     */
+    size_t getMergedCount() const;
+    
+    /**
+     * Get the number of block transfers formed
+     */
+    size_t getBlockCount() const;
+
+protected:
+    void write(const PIMInstruction& instruction) override;
+    size_t writeData(const PIMConstantMatrix& matrix) override;
+
+private:
+    InstructionSink& next;
+    unsigned maxBurst;
+    std::vector<PIMInstruction> run;  // Pending transfers, all continuing the first
+    unsigned axis;
+    size_t merged;
+    size_t blocks;
+    
+    /**
+     * Check whether a transfer continues the pending run
+     */
+    bool continuesRun(const PIMInstruction& instruction) const;
+    
+    void flush();
+};
+
+/**
+ * Collects instructions in memory
+ */
+class VectorInstructionSink : public InstructionSink {
+public:
+    /**
+     * @param instructions Receives the instructions
+     * @param data Receives the constant matrices; nullptr drops them
+     */
+    explicit VectorInstructionSink(std::vector<PIMInstruction>& instructions,
+                                   std::vector<PIMConstantMatrix>* data = nullptr);
+
+protected:
+    void write(const PIMInstruction& instruction) override;
+    size_t writeData(const PIMConstantMatrix& matrix) override;
+
+private:
+    std::vector<PIMInstruction>& instructions;
+    std::vector<PIMConstantMatrix>* data;
+};
+
+#endif // INSTRUCTION_SINK_H
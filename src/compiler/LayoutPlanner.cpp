@@ -0,0 +1,247 @@
+/**
+ * LayoutPlanner.cpp
+ * Implements bank-aware matrix placement
+ */
+
+#include "LayoutPlanner.h"
+#include "../utils/Logger.h"
+#include "../include/PIMInstructionSet.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// Upper bound on the multiply-accumulates simulated per conflict estimate
+const unsigned MAX_SIMULATED_MACS = 4096;
+
+std::string formatRate(double rate) {
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << rate * 100.0 << "%";
+    return ss.str();
+}
+
+std::string describeMatrix(const char* name, const MatrixLayout& layout) {
+    std::string packing = layout.lanes > 1 ? " packed x" + std::to_string(layout.lanes) : "";
+    std::string compressed = layout.isCompressed() ? " compressed to " + std::to_string(layout.size()) + " words" : "";
+    return std::string(name) + (layout.columnMajor ? " column-major" : " row-major") + packing + compressed +
+           " @" + std::to_string(layout.base);
+}
+
+} // namespace
+
+unsigned LayoutPlan::footprint() const {
+    return std::max({a.base + a.size(), b.base + b.size(), c.base + c.size()});
+}
+
+std::string LayoutPlan::describe() const {
+    return describeMatrix("A", a) + ", " + describeMatrix("B", b) + ", " + describeMatrix("C", c);
+}
+
+LayoutPlanner::LayoutPlanner(const CompilerConfig& config) : config(config) {}
+
+LayoutPlanner::~LayoutPlanner() = default;
+
+unsigned LayoutPlanner::lanesPerWord() const {
+    const unsigned wordSize = config.archParams.wordSize;
+    if ((config.precision == 8 || config.precision == 16) && config.precision < wordSize &&
+        wordSize % config.precision == 0) {
+        return wordSize / config.precision;
+    }
+    return 1;
+}
+
+LayoutPlan LayoutPlanner::contiguousLayout(unsigned rows, unsigned cols, unsigned common, unsigned lanes,
+                                           bool transposeA, bool transposeB) {
+    LayoutPlan layout;
+    layout.a = {rows, common, 0, transposeA, lanes, false};
+    layout.b = {common, cols, layout.a.size(), transposeB, lanes, true};
+    layout.c = {rows, cols, layout.a.size() + layout.b.size(), false};
+    return layout;
+}
+
+LayoutPlan LayoutPlanner::plan(const KernelShape& shape) const {
+    LayoutPlan layout = plan(shape.rows, shape.cols, shape.common, shape.transposeA, shape.transposeB);
+    if (shape.sparsity.isSparse()) {
+        compress(layout.b, shape.sparsity);
+        layout.c.base = layout.b.base + layout.b.size();
+    }
+    return layout;
+}
+
+void LayoutPlanner::compress(MatrixLayout& b, const SparsityPattern& pattern, unsigned colOrigin) {
+    if (!pattern.isSparse()) {
+        return;
+    }
+    
+    // Walk the words in storage order, so stored words keep their relative order
+    const unsigned wordRows = b.wordRows();
+    const unsigned wordCols = b.wordCols();
+    b.slots.assign(static_cast<size_t>(wordRows) * wordCols, MatrixLayout::NO_SLOT);
+    b.storedWords = 0;
+    for (unsigned offset = 0; offset < b.slots.size(); offset++) {
+        unsigned row = b.columnMajor ? offset % wordRows : offset / wordCols;
+        unsigned col = b.columnMajor ? offset / wordRows : offset % wordCols;
+        unsigned rowBegin = b.packRows ? row * b.lanes : row;
+        unsigned rowEnd = b.packRows ? rowBegin + b.lanes : row + 1;
+        if (pattern.anyNonzero(rowBegin, rowEnd, colOrigin + col, colOrigin + col + 1)) {
+            b.slots[offset] = b.storedWords++;
+        }
+    }
+}
+
+LayoutPlan LayoutPlanner::plan(unsigned rows, unsigned cols, unsigned common,
+                               bool transposeA, bool transposeB) const {
+    std::vector<LayoutPlan> candidates = evaluateCandidates(rows, cols, common, transposeA, transposeB);
+    
+    // The first candidate is the contiguous layout, which wins ties
+    LayoutPlan best = candidates.front();
+    for (const auto& candidate : candidates) {
+        if (candidate.conflictRate < best.conflictRate) {
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+std::vector<LayoutPlan> LayoutPlanner::evaluateCandidates(unsigned rows, unsigned cols, unsigned common,
+                                                          bool transposeA, bool transposeB) const {
+    LayoutPlan contiguous = contiguousLayout(rows, cols, common, lanesPerWord(), transposeA, transposeB);
+    contiguous.conflictRate = estimateConflictRate(contiguous);
+    
+    std::vector<LayoutPlan> candidates = {contiguous};
+    if (!config.layout.enabled) {
+        return candidates;
+    }
+    
+    const auto& arch = config.archParams;
+    const unsigned numBanks = std::max(1u, arch.numMemoryBanks);
+    const unsigned wordsPerBank = std::max(1u, arch.memoryBankSize / std::max(1u, arch.wordSize / 8));
+    
+    // Pad B by every bank offset, and up to the next bank boundary for linear hashing
+    const unsigned aEnd = contiguous.a.size();
+    std::vector<unsigned> paddings;
+    for (unsigned pad = 0; pad < numBanks; pad++) {
+        paddings.push_back(pad);
+    }
+    paddings.push_back((wordsPerBank - aEnd % wordsPerBank) % wordsPerBank);
+    
+    // Matrices that only fit the tiled path keep the contiguous placement order
+    // Untiled programs address PIM memory through the dest/src fields
+    const unsigned addressLimit = PIMEncoding::operandLimit(config.isaVersion);
+    bool fitsAddressField = contiguous.footprint() <= addressLimit;
+    
+    for (bool columnMajor : {false, true}) {
+        // A B stored transposed by the host stays in its stored order
+        if (transposeB && !columnMajor) {
+            continue;
+        }
+        
+        LayoutPlan bestForOrder;
+        bool found = false;
+        
+        for (unsigned pad : paddings) {
+            if (pad != 0 && !fitsAddressField) {
+                continue;
+            }
+            
+            LayoutPlan candidate = contiguous;
+            candidate.b.base = aEnd + pad;
+            candidate.b.columnMajor = columnMajor;
+            candidate.c.base = candidate.b.base + candidate.b.size();
+            if (fitsAddressField && candidate.footprint() > addressLimit) {
+                continue;
+            }
+            
+            candidate.conflictRate = estimateConflictRate(candidate);
+            if (!found || candidate.conflictRate < bestForOrder.conflictRate) {
+                bestForOrder = candidate;
+                found = true;
+            }
+        }
+        
+        // Only report improvements over the contiguous layout as separate candidates
+        if (found && bestForOrder.describe() != contiguous.describe()) {
+            candidates.push_back(bestForOrder);
+        }
+    }
+    
+    return candidates;
+}
+
+void LayoutPlanner::report(unsigned rows, unsigned cols, unsigned common, bool transposeA, bool transposeB) const {
+    for (const auto& candidate : evaluateCandidates(rows, cols, common, transposeA, transposeB)) {
+        PIM_LOG_INFO("Bank conflict rate of " + candidate.describe() + ": " +
+                    formatRate(candidate.conflictRate));
+    }
+    
+    LayoutPlan chosen = plan(rows, cols, common, transposeA, transposeB);
+    PIM_LOG_INFO("Chosen layout: " + chosen.describe() + " (expected bank conflict rate " +
+                formatRate(chosen.conflictRate) + ")");
+}
+
+double LayoutPlanner::estimateConflictRate(const LayoutPlan& layout) const {
+    const unsigned rows = layout.a.rows;
+    const unsigned common = layout.a.wordCols();
+    const unsigned cols = layout.b.cols;
+    const unsigned groupSize = std::max(1u, config.archParams.numMemoryBanks / 2);
+    
+    unsigned long conflicts = 0;
+    unsigned long reads = 0;
+    unsigned macs = 0;
+    
+    std::vector<unsigned> addresses;
+    std::vector<unsigned> banks;
+    auto flush = [&]() {
+        std::sort(addresses.begin(), addresses.end());
+        addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+        
+        banks.clear();
+        for (unsigned address : addresses) {
+            banks.push_back(bankOf(address));
+        }
+        std::sort(banks.begin(), banks.end());
+        banks.erase(std::unique(banks.begin(), banks.end()), banks.end());
+        
+        conflicts += addresses.size() - banks.size();
+        reads += addresses.size();
+        addresses.clear();
+    };
+    
+    for (unsigned i = 0; i < rows && macs < MAX_SIMULATED_MACS; i++) {
+        for (unsigned j = 0; j < cols && macs < MAX_SIMULATED_MACS; j++) {
+            for (unsigned k = 0; k < common && macs < MAX_SIMULATED_MACS; k++) {
+                if (!layout.b.isStored(k, j)) {
+                    continue;
+                }
+                addresses.push_back(layout.a.addressOf(i, k));
+                addresses.push_back(layout.b.addressOf(k, j));
+                if (++macs % groupSize == 0) {
+                    flush();
+                }
+            }
+        }
+    }
+    if (!addresses.empty()) {
+        flush();
+    }
+    
+    return reads == 0 ? 0.0 : static_cast<double>(conflicts) / reads;
+}
+
+unsigned LayoutPlanner::bankOf(unsigned address) const {
+    const auto& arch = config.archParams;
+    const unsigned numBanks = std::max(1u, arch.numMemoryBanks);
+    
+    switch (config.layout.bankHashing) {
+        case CompilerConfig::LayoutParams::BANK_HASH_LINEAR: {
+            const unsigned wordsPerBank = std::max(1u, arch.memoryBankSize / std::max(1u, arch.wordSize / 8));
+            return (address / wordsPerBank) % numBanks;
+        }
+        case CompilerConfig::LayoutParams::BANK_HASH_XOR:
+            return (address ^ (address / numBanks)) % numBanks;
+        case CompilerConfig::LayoutParams::BANK_HASH_INTERLEAVED:
+        default:
+            return address % numBanks;
+    }
+}
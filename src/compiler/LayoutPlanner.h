@@ -0,0 +1,233 @@
+/**
+ * LayoutPlanner.h
+ * Plans bank-aware placement of matrices in PIM memory
+ */
+
+#ifndef LAYOUT_PLANNER_H
+#define LAYOUT_PLANNER_H
+
+#include <string>
+#include <vector>
+#include "MatrixShapeAnalysis.h"
+#include "../include/CompilerConfig.h"
+
+/**
+ * Placement of one matrix in PIM memory
+ *
+ * With packed precision (lanes > 1) consecutive elements along one
+ * dimension share a word; rows and cols still count elements, while
+ * offsetOf() and addressOf() take the coordinates of a word in the
+ * wordRows() x wordCols() grid.
+ *
+ * A compressed layout stores only the words that may be nonzero, in the
+ * same order; slots maps the dense offset of every word to its offset in
+ * the compressed layout, or NO_SLOT for words known to be zero.
+ */
+struct MatrixLayout {
+    unsigned rows = 0;
+    unsigned cols = 0;
+    unsigned base = 0;         // PIM word address of element [0][0]
+    bool columnMajor = false;  // Store columns contiguously (transposed)
+    unsigned lanes = 1;        // Elements packed into one word
+    bool packRows = false;     // Lanes run down a column (B) instead of along a row (A)
+    std::vector<unsigned> slots{};  // Compressed offset by dense offset; empty for a dense layout
+    unsigned storedWords = 0;       // Words of a compressed layout
+
+    // Slot of a word that is not stored
+    static constexpr unsigned NO_SLOT = ~0u;
+
+    // Number of word rows and columns
+    unsigned wordRows() const {
+        return packRows ? (rows + lanes - 1) / lanes : rows;
+    }
+
+    unsigned wordCols() const {
+        return packRows ? cols : (cols + lanes - 1) / lanes;
+    }
+
+    // Offset of a word from the base address in the dense layout
+    unsigned denseOffsetOf(unsigned row, unsigned col) const {
+        return columnMajor ? col * wordRows() + row : row * wordCols() + col;
+    }
+
+    // Offset of a word from the base address; stored words only in a compressed layout
+    unsigned offsetOf(unsigned row, unsigned col) const {
+        return slots.empty() ? denseOffsetOf(row, col) : slots[denseOffsetOf(row, col)];
+    }
+
+    // Check whether a layout keeps only the words that may be nonzero
+    bool isCompressed() const {
+        return !slots.empty();
+    }
+
+    // Check whether a word is stored (every word of a dense layout is)
+    bool isStored(unsigned row, unsigned col) const {
+        return slots.empty() || slots[denseOffsetOf(row, col)] != NO_SLOT;
+    }
+
+    // PIM word address of a word
+    unsigned addressOf(unsigned row, unsigned col) const {
+        return base + offsetOf(row, col);
+    }
+
+    // Offset of an element in lane slots (word offset * lanes + lane)
+    unsigned elementOffsetOf(unsigned row, unsigned col) const {
+        unsigned lane = packRows ? row % lanes : col % lanes;
+        unsigned word = packRows ? offsetOf(row / lanes, col) : offsetOf(row, col / lanes);
+        return word * lanes + lane;
+    }
+
+    // Number of words occupied
+    unsigned size() const {
+        return slots.empty() ? wordRows() * wordCols() : storedWords;
+    }
+};
+
+/**
+ * Placement of the operands of C = A * B
+ */
+struct LayoutPlan {
+    MatrixLayout a;
+    MatrixLayout b;
+    MatrixLayout c;
+    double conflictRate = 0.0;  // Expected fraction of operand reads delayed by a bank conflict
+
+    /**
+     * Get the number of words from address 0 to the end of the last matrix
+     */
+    unsigned footprint() const;
+
+    /**
+     * Get a short description such as "A row-major @0, B column-major @20, C row-major @36"
+     */
+    std::string describe() const;
+};
+
+class LayoutPlanner {
+public:
+    explicit LayoutPlanner(const CompilerConfig& config);
+    ~LayoutPlanner();
+
+    /**
+     * Plan the layout of a matrix multiplication
+     *
+     * A is kept row-major. B is evaluated row-major and column-major
+     * (transposed, so a k-walk reads consecutive words), each with its base
+     * padded by every bank offset that keeps the plan within the address
+     * field of the configured ISA version. The candidate with the lowest
+     * expected conflict rate is chosen; ties keep the contiguous row-major
+     * layout.
+     *
+     * Without CompilerConfig::LayoutParams::enabled the contiguous row-major
+     * layout (A, B, C back to back) is returned. With packed precision A
+     * and B are planned at word granularity (see lanesPerWord()).
+     *
+     * Operands the host stores transposed are kept column-major instead, so
+     * they are loaded in their stored order.
+     *
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param common Common dimension
+     * @param transposeA The host stores A transposed
+     * @param transposeB The host stores B transposed
+     * @return Chosen layout with its conflict rate
+     */
+    LayoutPlan plan(unsigned rows, unsigned cols, unsigned common,
+                    bool transposeA = false, bool transposeB = false) const;
+
+    /**
+     * Plan the layout of an analyzed kernel
+     *
+     * A B with a known sparsity pattern is compressed (see compress()) and
+     * C follows it.
+     *
+     * @param shape Kernel shape from MatrixShapeAnalysis
+     * @return Chosen layout with its conflict rate
+     */
+    LayoutPlan plan(const KernelShape& shape) const;
+
+    /**
+     * Compress the layout of B to the words a sparsity pattern may have nonzero
+     *
+     * Words keep their dense order. A packed word is stored if any of its
+     * lanes is. In a plan, the caller moves C behind the compressed B.
+     *
+     * @param b Layout of B or of a block of its columns
+     * @param pattern Nonzeros of the whole B; a dense pattern leaves the layout unchanged
+     * @param colOrigin Column of B of the first column of the layout
+     */
+    static void compress(MatrixLayout& b, const SparsityPattern& pattern, unsigned colOrigin = 0);
+
+    /**
+     * Evaluate the candidate layouts of a matrix multiplication
+     *
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param common Common dimension
+     * @param transposeA The host stores A transposed
+     * @param transposeB The host stores B transposed
+     * @return The contiguous layout followed by the best layout of each B
+     *         order that differs from it, each with its conflict rate
+     */
+    std::vector<LayoutPlan> evaluateCandidates(unsigned rows, unsigned cols, unsigned common,
+                                               bool transposeA = false, bool transposeB = false) const;
+
+    /**
+     * Log the expected bank conflict rate of every candidate and the choice
+     *
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param common Common dimension
+     * @param transposeA The host stores A transposed
+     * @param transposeB The host stores B transposed
+     */
+    void report(unsigned rows, unsigned cols, unsigned common,
+                bool transposeA = false, bool transposeB = false) const;
+
+    /**
+     * Estimate the bank conflict rate of a layout
+     *
+     * The multiply-accumulates are issued in i, j, k order, and the operand
+     * reads of numMemoryBanks / 2 consecutive MACs form one issue group.
+     * Each bank serves one distinct address per cycle, so a group touching
+     * n distinct addresses in b distinct banks incurs n - b conflicts. At
+     * most the first 4096 MACs are simulated.
+     *
+     * @param layout Layout to evaluate
+     * @return Conflicts divided by distinct-address reads, in [0, 1)
+     */
+    double estimateConflictRate(const LayoutPlan& layout) const;
+
+    /**
+     * Map a PIM word address to its memory bank under the configured hashing
+     *
+     * @param address PIM word address
+     * @return Bank index in [0, numMemoryBanks)
+     */
+    unsigned bankOf(unsigned address) const;
+
+    /**
+     * Get the number of A/B elements packed into one word
+     *
+     * @return wordSize / precision for 8- and 16-bit precision, otherwise 1
+     */
+    unsigned lanesPerWord() const;
+
+    /**
+     * Get the contiguous row-major layout (A, B, C back to back)
+     *
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param common Common dimension
+     * @param lanes Elements per word of A and B, packed along the common dimension
+     * @param transposeA Store A column-major (the host stores it transposed)
+     * @param transposeB Store B column-major (the host stores it transposed)
+     */
+    static LayoutPlan contiguousLayout(unsigned rows, unsigned cols, unsigned common, unsigned lanes = 1,
+                                       bool transposeA = false, bool transposeB = false);
+
+private:
+    CompilerConfig config;
+};
+
+#endif // LAYOUT_PLANNER_H
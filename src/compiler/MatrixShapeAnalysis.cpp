@@ -0,0 +1,1085 @@
+/**
+ * MatrixShapeAnalysis.cpp
+ * Implements matrix dimension inference from LLVM IR
+ */
+
+#include "MatrixShapeAnalysis.h"
+#include "../utils/Logger.h"
+#include <llvm/ADT/Triple.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <algorithm>
+#include <map>
+
+namespace {
+
+// Dimension used when nothing else determines it
+const unsigned DEFAULT_DIMENSION = 2;
+
+// Step of an address along a loop that is not a compile-time constant
+const int64_t SYMBOLIC_STEP = -1;
+
+// Look through casts between integer widths (e.g. sext of an i32 bound to i64)
+llvm::Value* stripIntCasts(llvm::Value* value) {
+    while (auto* cast = llvm::dyn_cast<llvm::CastInst>(value)) {
+        if (!cast->getSrcTy()->isIntegerTy()) {
+            break;
+        }
+        value = cast->getOperand(0);
+    }
+    return value;
+}
+
+// Unoptimized code keeps arguments in stack slots: resolve a load from a slot
+// whose only store is an argument to that argument
+llvm::Value* resolveSpilledArgument(llvm::Value* value) {
+    auto* load = llvm::dyn_cast<llvm::LoadInst>(value);
+    if (!load) {
+        return value;
+    }
+    
+    auto* slot = llvm::dyn_cast<llvm::AllocaInst>(load->getPointerOperand());
+    if (!slot) {
+        return value;
+    }
+    
+    llvm::Value* stored = nullptr;
+    for (auto* user : slot->users()) {
+        if (auto* store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+            if (store->getPointerOperand() != slot || stored) {
+                return value;
+            }
+            stored = store->getValueOperand();
+        }
+    }
+    
+    return (stored && llvm::isa<llvm::Argument>(stored)) ? stored : value;
+}
+
+// Find the object a matrix access is based on
+llvm::Value* getMatrixBase(llvm::Value* ptr) {
+    llvm::Value* base = llvm::getUnderlyingObject(ptr);
+    return resolveSpilledArgument(base);
+}
+
+// Matrix elements are addressed through a GEP; unoptimized code also loads
+// and stores scalar locals directly through their stack slots
+bool isElementAccess(llvm::Instruction* access) {
+    llvm::Value* ptr = llvm::getLoadStorePointerOperand(access);
+    return ptr && !llvm::isa<llvm::AllocaInst>(ptr->stripPointerCasts());
+}
+
+// Find the loop-invariant operand of the compare that controls the loop exit
+llvm::Value* findLoopBound(llvm::Loop* loop) {
+    llvm::SmallVector<llvm::BasicBlock*, 4> exitingBlocks;
+    loop->getExitingBlocks(exitingBlocks);
+    
+    for (auto* block : exitingBlocks) {
+        auto* branch = llvm::dyn_cast<llvm::BranchInst>(block->getTerminator());
+        if (!branch || !branch->isConditional()) {
+            continue;
+        }
+        
+        auto* compare = llvm::dyn_cast<llvm::ICmpInst>(branch->getCondition());
+        if (!compare) {
+            continue;
+        }
+        
+        for (llvm::Value* operand : compare->operands()) {
+            llvm::Value* bound = resolveSpilledArgument(stripIntCasts(operand));
+            if (llvm::isa<llvm::ConstantInt>(bound) || llvm::isa<llvm::Argument>(bound)) {
+                return bound;
+            }
+        }
+    }
+    
+    return nullptr;
+}
+
+// Get the value passed for an argument if every call site passes the same constant
+unsigned findCallSiteConstant(llvm::Argument* arg) {
+    llvm::Function* function = arg->getParent();
+    unsigned value = 0;
+    
+    for (auto* user : function->users()) {
+        auto* call = llvm::dyn_cast<llvm::CallBase>(user);
+        if (!call || call->getCalledFunction() != function) {
+            return 0;
+        }
+        
+        auto* constant = llvm::dyn_cast<llvm::ConstantInt>(call->getArgOperand(arg->getArgNo()));
+        if (!constant || constant->isNegative()) {
+            return 0;
+        }
+        
+        unsigned current = static_cast<unsigned>(constant->getZExtValue());
+        if (value != 0 && value != current) {
+            return 0;
+        }
+        value = current;
+    }
+    
+    return value;
+}
+
+// Trip count of a loop counting up from 0 by 1, or 0 if unknown
+unsigned findTripCount(llvm::Loop* loop, llvm::ScalarEvolution& scev) {
+    if (unsigned tripCount = scev.getSmallConstantTripCount(loop)) {
+        // A loop that is not rotated tests its condition in the header,
+        // which runs once more than the body
+        llvm::BasicBlock* latch = loop->getLoopLatch();
+        if (latch && !loop->isLoopExiting(latch)) {
+            tripCount--;
+        }
+        return tripCount;
+    }
+    
+    llvm::Value* bound = findLoopBound(loop);
+    if (!bound) {
+        return 0;
+    }
+    
+    if (auto* constant = llvm::dyn_cast<llvm::ConstantInt>(bound)) {
+        return constant->isNegative() ? 0 : static_cast<unsigned>(constant->getZExtValue());
+    }
+    
+    return findCallSiteConstant(llvm::cast<llvm::Argument>(bound));
+}
+
+// Steps of an affine matrix access along the loops of its nest, in
+// elements; loops the address does not depend on have no entry
+struct AccessPattern {
+    bool known = false;
+    std::map<const llvm::Loop*, int64_t> steps;
+    
+    int64_t stepAlong(const llvm::Loop* loop) const {
+        auto it = steps.find(loop);
+        return it != steps.end() ? it->second : 0;
+    }
+    
+    bool dependsOn(const llvm::Loop* loop) const {
+        return stepAlong(loop) != 0;
+    }
+};
+
+// Decompose the address of a load or store into per-loop steps
+AccessPattern getAccessPattern(llvm::Instruction* access, llvm::ScalarEvolution& scev) {
+    AccessPattern pattern;
+    llvm::Value* ptr = llvm::getLoadStorePointerOperand(access);
+    llvm::Type* elementType = llvm::getLoadStoreType(access);
+    if (!ptr || !scev.isSCEVable(ptr->getType())) {
+        return pattern;
+    }
+    
+    const llvm::SCEV* address = scev.getSCEV(ptr);
+    const llvm::SCEV* offset = scev.getMinusSCEV(address, scev.getPointerBase(address));
+    if (llvm::isa<llvm::SCEVCouldNotCompute>(offset)) {
+        return pattern;
+    }
+    
+    const int64_t elementBytes = static_cast<int64_t>(
+        access->getModule()->getDataLayout().getTypeAllocSize(elementType).getFixedSize());
+    while (auto* recurrence = llvm::dyn_cast<llvm::SCEVAddRecExpr>(offset)) {
+        if (!recurrence->isAffine()) {
+            return pattern;
+        }
+        
+        int64_t step = SYMBOLIC_STEP;
+        if (auto* constant = llvm::dyn_cast<llvm::SCEVConstant>(recurrence->getStepRecurrence(scev))) {
+            int64_t bytes = constant->getAPInt().getSExtValue();
+            if (bytes <= 0 || bytes % elementBytes != 0) {
+                return pattern;
+            }
+            step = bytes / elementBytes;
+        }
+        pattern.steps[recurrence->getLoop()] = step;
+        offset = recurrence->getStart();
+    }
+    
+    pattern.known = true;
+    return pattern;
+}
+
+// Leading dimension from a step, or 0 if it is not a constant
+unsigned leadingDimension(int64_t step) {
+    return step > 0 ? static_cast<unsigned>(step) : 0;
+}
+
+// Dimensions of a matrix allocated as a 2D array global or alloca, format {rows, cols}
+std::vector<unsigned> getAllocatedDimensions(llvm::Value* base) {
+    llvm::Type* type = nullptr;
+    if (auto* global = llvm::dyn_cast<llvm::GlobalVariable>(base)) {
+        type = global->getValueType();
+    } else if (auto* alloca = llvm::dyn_cast<llvm::AllocaInst>(base)) {
+        type = alloca->getAllocatedType();
+    }
+    
+    auto* outer = llvm::dyn_cast_or_null<llvm::ArrayType>(type);
+    if (!outer) {
+        return {};
+    }
+    
+    auto* inner = llvm::dyn_cast<llvm::ArrayType>(outer->getElementType());
+    if (!inner) {
+        return {};
+    }
+    
+    return {static_cast<unsigned>(outer->getNumElements()), static_cast<unsigned>(inner->getNumElements())};
+}
+
+// Pick the first known dimension
+unsigned firstKnown(std::initializer_list<unsigned> candidates) {
+    for (unsigned candidate : candidates) {
+        if (candidate != 0) {
+            return candidate;
+        }
+    }
+    return 0;
+}
+
+// Loops indexing the rows and columns of C where an epilogue is applied
+struct EpilogueLoops {
+    llvm::Loop* row = nullptr;
+    llvm::Loop* col = nullptr;
+};
+
+// Match max(x, 0) as smax or as a compare and select against 0
+llvm::Value* matchRelu(llvm::Value* value) {
+    if (auto* intrinsic = llvm::dyn_cast<llvm::IntrinsicInst>(value)) {
+        if (intrinsic->getIntrinsicID() != llvm::Intrinsic::smax) {
+            return nullptr;
+        }
+        for (unsigned operand = 0; operand < 2; operand++) {
+            auto* zero = llvm::dyn_cast<llvm::ConstantInt>(intrinsic->getArgOperand(1 - operand));
+            if (zero && zero->isZero()) {
+                return intrinsic->getArgOperand(operand);
+            }
+        }
+        return nullptr;
+    }
+    
+    auto* select = llvm::dyn_cast<llvm::SelectInst>(value);
+    auto* compare = select ? llvm::dyn_cast<llvm::ICmpInst>(select->getCondition()) : nullptr;
+    auto* bound = compare ? llvm::dyn_cast<llvm::ConstantInt>(compare->getOperand(1)) : nullptr;
+    if (!bound) {
+        return nullptr;
+    }
+    
+    // x > 0 ? x : 0 (also x > -1, x >= 0) and x < 0 ? 0 : x (also x < 1, x <= 0)
+    llvm::Value* x = compare->getOperand(0);
+    const int64_t limit = bound->getSExtValue();
+    const llvm::CmpInst::Predicate predicate = compare->getPredicate();
+    bool keepsTrue = (predicate == llvm::CmpInst::ICMP_SGT && (limit == 0 || limit == -1)) ||
+                     (predicate == llvm::CmpInst::ICMP_SGE && limit == 0);
+    bool keepsFalse = (predicate == llvm::CmpInst::ICMP_SLT && (limit == 0 || limit == 1)) ||
+                      (predicate == llvm::CmpInst::ICMP_SLE && limit == 0);
+    llvm::Value* kept = keepsTrue ? select->getTrueValue() : select->getFalseValue();
+    auto* zero = llvm::dyn_cast<llvm::ConstantInt>(keepsTrue ? select->getFalseValue() : select->getTrueValue());
+    if ((keepsTrue || keepsFalse) && kept == x && zero && zero->isZero()) {
+        return x;
+    }
+    return nullptr;
+}
+
+// Match a load of a vector indexed by exactly one of the row and column loops
+bool matchBiasVector(llvm::Value* value, const EpilogueLoops& loops, llvm::ScalarEvolution& scev,
+                     EpilogueOp& op) {
+    auto* load = llvm::dyn_cast<llvm::LoadInst>(value);
+    if (!load || !isElementAccess(load)) {
+        return false;
+    }
+    
+    AccessPattern pattern = getAccessPattern(load, scev);
+    if (!pattern.known || pattern.steps.size() != 1) {
+        return false;
+    }
+    
+    const llvm::Loop* loop = pattern.steps.begin()->first;
+    if (pattern.steps.begin()->second != 1 || (loop != loops.row && loop != loops.col)) {
+        return false;
+    }
+    
+    llvm::Value* base = getMatrixBase(load->getPointerOperand());
+    op.kind = loop == loops.col ? EpilogueOp::BIAS_COLUMN : EpilogueOp::BIAS_ROW;
+    op.vector = base->hasName() ? base->getName().str() : "bias";
+    return true;
+}
+
+// Peel the elementwise operations off a value stored to C, down to the
+// value they apply to; the operations are returned in application order
+llvm::Value* matchEpilogueChain(llvm::Value* value, const EpilogueLoops& loops, llvm::ScalarEvolution& scev,
+                                std::vector<EpilogueOp>& ops) {
+    std::vector<EpilogueOp> peeled;
+    while (auto* inst = llvm::dyn_cast<llvm::Instruction>(value)) {
+        EpilogueOp op;
+        llvm::Value* next = nullptr;
+        
+        if (llvm::Value* x = matchRelu(inst)) {
+            op.kind = EpilogueOp::RELU;
+            next = x;
+        } else if (inst->getOpcode() == llvm::Instruction::Mul || inst->getOpcode() == llvm::Instruction::Shl) {
+            auto* constant = llvm::dyn_cast<llvm::ConstantInt>(inst->getOperand(1));
+            bool commuted = !constant && inst->getOpcode() == llvm::Instruction::Mul;
+            if (commuted) {
+                constant = llvm::dyn_cast<llvm::ConstantInt>(inst->getOperand(0));
+            }
+            if (constant && (inst->getOpcode() == llvm::Instruction::Mul || constant->getZExtValue() < 31)) {
+                op.kind = EpilogueOp::SCALE;
+                op.factor = inst->getOpcode() == llvm::Instruction::Mul
+                    ? static_cast<int32_t>(constant->getSExtValue())
+                    : static_cast<int32_t>(1u << constant->getZExtValue());
+                next = inst->getOperand(commuted ? 1 : 0);
+            }
+        } else if (inst->getOpcode() == llvm::Instruction::Add) {
+            for (unsigned operand = 0; operand < 2 && !next; operand++) {
+                if (matchBiasVector(inst->getOperand(1 - operand), loops, scev, op)) {
+                    next = inst->getOperand(operand);
+                }
+            }
+        }
+        
+        if (!next) {
+            break;
+        }
+        peeled.push_back(op);
+        value = next;
+    }
+    
+    ops.insert(ops.end(), peeled.rbegin(), peeled.rend());
+    return value;
+}
+
+// Check whether a value is a load of the element a store writes
+bool loadsStoredElement(llvm::Value* value, llvm::StoreInst* store, llvm::ScalarEvolution& scev) {
+    auto* load = llvm::dyn_cast<llvm::LoadInst>(value);
+    return load && scev.isSCEVable(load->getPointerOperand()->getType()) &&
+           scev.getSCEV(load->getPointerOperand()) == scev.getSCEV(store->getPointerOperand());
+}
+
+// Check whether a value is the sum accumulated by the common-dimension loop
+// (an instruction of the loop or an exit phi of it, which is 0 where a
+// guard skipped the loop)
+bool isAccumulatedValue(llvm::Value* value, const llvm::Loop* commonLoop) {
+    auto* inst = llvm::dyn_cast<llvm::Instruction>(value);
+    if (!inst) {
+        return false;
+    }
+    if (commonLoop->contains(inst)) {
+        return true;
+    }
+    
+    auto* phi = llvm::dyn_cast<llvm::PHINode>(inst);
+    if (!phi) {
+        return false;
+    }
+    for (llvm::Value* incoming : phi->incoming_values()) {
+        auto* source = llvm::dyn_cast<llvm::Instruction>(incoming);
+        auto* zero = llvm::dyn_cast<llvm::ConstantInt>(incoming);
+        if (zero && zero->isZero()) {
+            continue;
+        }
+        if (!source || !commonLoop->contains(source)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Collect the element stores to a matrix in the blocks of a loop, in block order
+std::vector<llvm::StoreInst*> findStoresTo(llvm::Value* matrix, const llvm::Loop* loop, const llvm::Loop* excluded) {
+    std::vector<llvm::StoreInst*> stores;
+    for (auto* block : loop->getBlocks()) {
+        if (excluded && excluded->contains(block)) {
+            continue;
+        }
+        for (auto& inst : *block) {
+            auto* store = llvm::dyn_cast<llvm::StoreInst>(&inst);
+            if (store && isElementAccess(store) && getMatrixBase(store->getPointerOperand()) == matrix) {
+                stores.push_back(store);
+            }
+        }
+    }
+    return stores;
+}
+
+// Read the integer elements of a constant global array in memory order
+bool readConstantIntegers(llvm::Value* base, std::vector<int64_t>& values) {
+    auto* global = llvm::dyn_cast_or_null<llvm::GlobalVariable>(base);
+    if (!global || !global->isConstant() || !global->hasDefinitiveInitializer()) {
+        return false;
+    }
+
+    std::vector<llvm::Constant*> pending = {global->getInitializer()};
+    values.clear();
+    while (!pending.empty()) {
+        llvm::Constant* constant = pending.back();
+        pending.pop_back();
+        if (auto* integer = llvm::dyn_cast<llvm::ConstantInt>(constant)) {
+            values.push_back(integer->getSExtValue());
+            continue;
+        }
+        auto* array = llvm::dyn_cast<llvm::ArrayType>(constant->getType());
+        if (!array) {
+            return false;
+        }
+        for (uint64_t index = array->getNumElements(); index > 0; index--) {
+            llvm::Constant* element = constant->getAggregateElement(static_cast<unsigned>(index - 1));
+            if (!element) {
+                return false;
+            }
+            pending.push_back(element);
+        }
+    }
+    return true;
+}
+
+// Check whether an address is computed from a value, through casts, arithmetic and GEPs
+bool addressUses(llvm::Value* address, llvm::Value* value) {
+    std::vector<llvm::Value*> pending = {address};
+    for (size_t visited = 0; !pending.empty() && visited < 64; visited++) {
+        llvm::Value* current = pending.back();
+        pending.pop_back();
+        if (current == value) {
+            return true;
+        }
+        auto* inst = llvm::dyn_cast<llvm::Instruction>(current);
+        if (inst && (llvm::isa<llvm::GetElementPtrInst>(inst) || llvm::isa<llvm::CastInst>(inst) ||
+                     inst->isBinaryOp())) {
+            pending.insert(pending.end(), inst->op_begin(), inst->op_end());
+        }
+    }
+    return false;
+}
+
+// Pointer of a load walking an array with a unit step along a loop
+bool isUnitStrided(llvm::LoadInst* load, const llvm::Loop* loop, llvm::ScalarEvolution& scev) {
+    AccessPattern pattern = getAccessPattern(load, scev);
+    return pattern.known && pattern.steps.size() == 1 && pattern.stepAlong(loop) == 1;
+}
+
+// Innermost loop of a compressed nest and the arrays it walks
+struct CompressedNest {
+    SparsityPattern::Format format = SparsityPattern::SPARSE_NONE;
+    llvm::LoadInst* a = nullptr;        // Element of A
+    llvm::LoadInst* values = nullptr;   // Nonzero value of B
+    std::vector<int64_t> pointers;      // Start of every compressed row (CSR) or column (CSC)
+    std::vector<int64_t> indices;       // Column (CSR) or row (CSC) of every nonzero
+};
+
+// Match an innermost loop p = ptr[x] .. ptr[x + 1] over constant pointer
+// and index arrays, x being the induction variable of the parent loop, and
+// classify the multiply operands and the store of C
+bool matchCompressedNest(llvm::Loop* innermost, llvm::LoadInst* const operands[2], llvm::StoreInst* result,
+                         llvm::ScalarEvolution& scev, CompressedNest& nest) {
+    llvm::Loop* parent = innermost->getParentLoop();
+    llvm::BasicBlock* header = innermost->getHeader();
+    if (!parent || !result || !operands[0] || !operands[1]) {
+        return false;
+    }
+
+    // The range starts at a load of ptr[x]
+    llvm::LoadInst* start = nullptr;
+    for (auto& phi : header->phis()) {
+        auto* recurrence = llvm::dyn_cast<llvm::SCEVAddRecExpr>(scev.getSCEV(&phi));
+        if (!recurrence || recurrence->getLoop() != innermost || !recurrence->getStepRecurrence(scev)->isOne()) {
+            continue;
+        }
+        for (unsigned incoming = 0; incoming < phi.getNumIncomingValues(); incoming++) {
+            if (!innermost->contains(phi.getIncomingBlock(incoming))) {
+                start = llvm::dyn_cast<llvm::LoadInst>(stripIntCasts(phi.getIncomingValue(incoming)));
+            }
+        }
+        if (start) {
+            break;
+        }
+    }
+    if (!start || !isUnitStrided(start, parent, scev)) {
+        return false;
+    }
+
+    // and ends at a load of ptr[x + 1], the invariant operand of the exit compare
+    llvm::SmallVector<llvm::BasicBlock*, 4> exitingBlocks;
+    innermost->getExitingBlocks(exitingBlocks);
+    llvm::LoadInst* end = nullptr;
+    for (auto* block : exitingBlocks) {
+        auto* branch = llvm::dyn_cast<llvm::BranchInst>(block->getTerminator());
+        auto* compare = branch && branch->isConditional() ? llvm::dyn_cast<llvm::ICmpInst>(branch->getCondition())
+                                                          : nullptr;
+        for (unsigned operand = 0; compare && operand < 2 && !end; operand++) {
+            llvm::Value* bound = stripIntCasts(compare->getOperand(operand));
+            if (innermost->isLoopInvariant(bound)) {
+                end = llvm::dyn_cast<llvm::LoadInst>(bound);
+            }
+        }
+    }
+    llvm::Value* pointerArray = getMatrixBase(start->getPointerOperand());
+    if (!end || getMatrixBase(end->getPointerOperand()) != pointerArray ||
+        !readConstantIntegers(pointerArray, nest.pointers) || nest.pointers.size() < 2) {
+        return false;
+    }
+    const llvm::SCEV* distance = scev.getMinusSCEV(scev.getSCEV(end->getPointerOperand()),
+                                                   scev.getSCEV(start->getPointerOperand()));
+    const int64_t elementBytes = static_cast<int64_t>(
+        start->getModule()->getDataLayout().getTypeAllocSize(start->getType()).getFixedSize());
+    auto* step = llvm::dyn_cast<llvm::SCEVConstant>(distance);
+    if (!step || step->getAPInt().getSExtValue() != elementBytes) {
+        return false;
+    }
+
+    // The values are walked with p; the operand that is not is A
+    int valuesOperand = isUnitStrided(operands[0], innermost, scev) ? 0 :
+                        isUnitStrided(operands[1], innermost, scev) ? 1 : -1;
+    if (valuesOperand < 0) {
+        return false;
+    }
+    nest.values = operands[valuesOperand];
+    nest.a = operands[1 - valuesOperand];
+
+    // The index array is read with p and addresses A (CSC) or C (CSR)
+    for (auto* block : innermost->getBlocks()) {
+        for (auto& inst : *block) {
+            auto* load = llvm::dyn_cast<llvm::LoadInst>(&inst);
+            if (!load || load == nest.values || load == nest.a || !isUnitStrided(load, innermost, scev) ||
+                !readConstantIntegers(getMatrixBase(load->getPointerOperand()), nest.indices)) {
+                continue;
+            }
+            bool indexesA = addressUses(nest.a->getPointerOperand(), load);
+            bool indexesC = addressUses(result->getPointerOperand(), load);
+            if (indexesA != indexesC) {
+                nest.format = indexesC ? SparsityPattern::SPARSE_CSR : SparsityPattern::SPARSE_CSC;
+                break;
+            }
+        }
+        if (nest.format != SparsityPattern::SPARSE_NONE) {
+            break;
+        }
+    }
+    if (nest.format == SparsityPattern::SPARSE_NONE) {
+        return false;
+    }
+
+    // Every range lies in the index array
+    for (size_t x = 0; x + 1 < nest.pointers.size(); x++) {
+        if (nest.pointers[x] < 0 || nest.pointers[x] > nest.pointers[x + 1] ||
+            nest.pointers[x + 1] > static_cast<int64_t>(nest.indices.size())) {
+            return false;
+        }
+    }
+    for (int64_t index : nest.indices) {
+        if (index < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+SparsityPattern SparsityPattern::fromEntries(Format format, unsigned rows, unsigned cols,
+                                             std::vector<std::pair<unsigned, unsigned>> nonzeros) {
+    std::sort(nonzeros.begin(), nonzeros.end());
+    nonzeros.erase(std::unique(nonzeros.begin(), nonzeros.end()), nonzeros.end());
+
+    SparsityPattern pattern;
+    pattern.format = format;
+    pattern.rows = rows;
+    pattern.cols = cols;
+    pattern.rowStart.assign(rows + 1, 0);
+    for (const auto& entry : nonzeros) {
+        pattern.rowStart[entry.first + 1]++;
+        pattern.columns.push_back(entry.second);
+    }
+    for (unsigned row = 0; row < rows; row++) {
+        pattern.rowStart[row + 1] += pattern.rowStart[row];
+    }
+    return pattern;
+}
+
+bool SparsityPattern::isNonzero(unsigned row, unsigned col) const {
+    return anyNonzero(row, row + 1, col, col + 1);
+}
+
+bool SparsityPattern::anyNonzero(unsigned rowBegin, unsigned rowEnd, unsigned colBegin, unsigned colEnd) const {
+    if (!isSparse()) {
+        return true;
+    }
+    for (unsigned row = rowBegin; row < std::min(rowEnd, rows); row++) {
+        auto first = columns.begin() + rowStart[row];
+        auto last = columns.begin() + rowStart[row + 1];
+        auto it = std::lower_bound(first, last, colBegin);
+        if (it != last && *it < colEnd) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint64_t SparsityPattern::fingerprint() const {
+    // FNV-1a over the dimensions, row offsets and columns
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&](uint64_t value) {
+        hash = (hash ^ value) * 1099511628211ull;
+    };
+    mix(rows);
+    mix(cols);
+    for (unsigned offset : rowStart) {
+        mix(offset);
+    }
+    for (unsigned col : columns) {
+        mix(col);
+    }
+    return hash;
+}
+
+uint64_t KernelShape::weightFingerprint() const {
+    // FNV-1a over the values of B
+    uint64_t hash = 14695981039346656037ull;
+    for (int32_t weight : weights) {
+        hash = (hash ^ static_cast<uint32_t>(weight)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string SparsityPattern::describe() const {
+    const char* names[] = {"dense", "constant", "csr", "csc"};
+    return std::string(names[format]) + ", " + std::to_string(nonzeros()) + " of " +
+           std::to_string(static_cast<uint64_t>(rows) * cols) + " nonzero";
+}
+
+const KernelShape* ShapeAnalysisResult::lookup(const std::string& functionName) const {
+    auto it = kernels.find(functionName);
+    return it != kernels.end() ? &it->second : nullptr;
+}
+
+std::string EpilogueOp::describe() const {
+    switch (kind) {
+        case BIAS_COLUMN:
+            return vector + "[j]";
+        case BIAS_ROW:
+            return vector + "[i]";
+        case SCALE:
+            return "scale " + std::to_string(factor);
+        case RELU:
+        default:
+            return "relu";
+    }
+}
+
+std::string KernelShape::describeEpilogue() const {
+    std::string description;
+    for (const auto& op : epilogue) {
+        description += (description.empty() ? "" : ", ") + op.describe();
+    }
+    return description;
+}
+
+std::string KernelShape::describeVariant() const {
+    std::vector<std::string> parts;
+    if (isGemv()) {
+        parts.push_back("GEMV");
+    }
+    if (batch > 1) {
+        parts.push_back("batch " + std::to_string(batch));
+    }
+    if (transposeA) {
+        parts.push_back("A transposed");
+    }
+    if (transposeB) {
+        parts.push_back("B transposed");
+    }
+    
+    // Leading dimensions are only reported where rows are padded
+    const unsigned widthA = transposeA ? rows : common;
+    const unsigned widthB = transposeB ? common : cols;
+    if (lda != 0 && lda != widthA) {
+        parts.push_back("lda " + std::to_string(lda));
+    }
+    if (ldb != 0 && ldb != widthB) {
+        parts.push_back("ldb " + std::to_string(ldb));
+    }
+    if (ldc != 0 && ldc != cols) {
+        parts.push_back("ldc " + std::to_string(ldc));
+    }
+    if (sparsity.isSparse()) {
+        parts.push_back("B " + sparsity.describe());
+    }
+    
+    std::string description;
+    for (const auto& part : parts) {
+        description += (description.empty() ? "" : ", ") + part;
+    }
+    return description;
+}
+
+MatrixShapeAnalysis::MatrixShapeAnalysis(const CompilerConfig& config) : config(config) {}
+
+MatrixShapeAnalysis::~MatrixShapeAnalysis() = default;
+
+llvm::Value* MatrixShapeAnalysis::findMatrixBase(llvm::Value* ptr) {
+    return getMatrixBase(ptr);
+}
+
+ShapeAnalysisResult MatrixShapeAnalysis::analyze(llvm::Module& module) {
+    PIM_LOG_INFO("Inferring matrix dimensions");
+    
+    ShapeAnalysisResult result;
+    
+    for (auto& function : module) {
+        ShapeAnalysisResult functionResult = analyze(function);
+        result.kernels.insert(functionResult.kernels.begin(), functionResult.kernels.end());
+    }
+    
+    return result;
+}
+
+ShapeAnalysisResult MatrixShapeAnalysis::analyze(llvm::Function& function) {
+    ShapeAnalysisResult result;
+    
+    KernelShape shape;
+    if (function.isDeclaration() || !analyzeFunction(function, shape)) {
+        return result;
+    }
+    
+    const std::string variant = shape.describeVariant();
+    PIM_LOG_INFO("Inferred shape of " + function.getName().str() + ": " +
+                std::to_string(shape.rows) + "x" + std::to_string(shape.common) + " * " +
+                std::to_string(shape.common) + "x" + std::to_string(shape.cols) +
+                (variant.empty() ? "" : " (" + variant + ")"));
+    if (!shape.epilogue.empty()) {
+        PIM_LOG_INFO("Elementwise epilogue of " + function.getName().str() + ": " +
+                    shape.describeEpilogue());
+    }
+    result.kernels[function.getName().str()] = shape;
+    return result;
+}
+
+bool MatrixShapeAnalysis::analyzeFunction(llvm::Function& function, KernelShape& shape) {
+    llvm::DominatorTree dominatorTree(function);
+    llvm::LoopInfo loopInfo(dominatorTree);
+    llvm::TargetLibraryInfoImpl libraryInfoImpl(llvm::Triple(function.getParent()->getTargetTriple()));
+    llvm::TargetLibraryInfo libraryInfo(libraryInfoImpl);
+    llvm::AssumptionCache assumptions(function);
+    llvm::ScalarEvolution scev(function, libraryInfo, assumptions, dominatorTree, loopInfo);
+    
+    // Find the multiply of two matrix elements in an innermost loop
+    llvm::Loop* innermost = nullptr;
+    llvm::LoadInst* operands[2] = {nullptr, nullptr};
+    for (llvm::Loop* loop : loopInfo.getLoopsInPreorder()) {
+        if (!loop->getSubLoops().empty() || loop->getLoopDepth() < 2 || loop->getLoopDepth() > 4) {
+            continue;
+        }
+        for (auto* block : loop->getBlocks()) {
+            for (auto& inst : *block) {
+                if (inst.getOpcode() != llvm::Instruction::Mul || innermost) {
+                    continue;
+                }
+                auto* lhs = llvm::dyn_cast<llvm::LoadInst>(stripIntCasts(inst.getOperand(0)));
+                auto* rhs = llvm::dyn_cast<llvm::LoadInst>(stripIntCasts(inst.getOperand(1)));
+                if (lhs && rhs && isElementAccess(lhs) && isElementAccess(rhs)) {
+                    innermost = loop;
+                    operands[0] = lhs;
+                    operands[1] = rhs;
+                }
+            }
+        }
+        if (innermost) {
+            break;
+        }
+    }
+    
+    // Nests without a recognizable multiply keep the i/j/k assumption
+    if (!innermost) {
+        for (llvm::Loop* outer : loopInfo.getLoopsInPreorder()) {
+            if (outer->getLoopDepth() != 1) {
+                continue;
+            }
+            for (llvm::Loop* middle : outer->getSubLoops()) {
+                if (!middle->getSubLoops().empty() && !innermost) {
+                    innermost = middle->getSubLoops().front();
+                }
+            }
+            if (innermost) {
+                break;
+            }
+        }
+    }
+    
+    if (!innermost) {
+        return false;
+    }
+    
+    // Outermost first: (i, k) for a GEMV, (i, j, k) for a GEMM and (batch, i, j, k)
+    std::vector<llvm::Loop*> nest;
+    for (llvm::Loop* loop = innermost; loop; loop = loop->getParentLoop()) {
+        nest.insert(nest.begin(), loop);
+    }
+    llvm::Loop* batchLoop = nest.size() == 4 ? nest[0] : nullptr;
+    llvm::Loop* rowLoop = nest[nest.size() == 4 ? 1 : 0];
+    llvm::Loop* colLoop = nest.size() >= 3 ? nest[nest.size() - 2] : nullptr;
+    llvm::Loop* commonLoop = innermost;
+    
+    // C is stored in the innermost loop, or once after it when LICM promoted it
+    llvm::StoreInst* result = nullptr;
+    for (llvm::Loop* loop : {innermost, innermost->getParentLoop()}) {
+        for (auto* block : loop->getBlocks()) {
+            if (loop != innermost && innermost->contains(block)) {
+                continue;
+            }
+            for (auto& inst : *block) {
+                auto* store = llvm::dyn_cast<llvm::StoreInst>(&inst);
+                if (store && isElementAccess(store)) {
+                    result = store;
+                }
+            }
+        }
+        if (result) {
+            break;
+        }
+    }
+    
+    // Address steps along the loops tell A (indexed by i) from B and give
+    // the host storage of each operand
+    AccessPattern patterns[3];
+    for (int m = 0; m < 2; m++) {
+        if (operands[m]) {
+            patterns[m] = getAccessPattern(operands[m], scev);
+        }
+    }
+    if (result) {
+        patterns[2] = getAccessPattern(result, scev);
+    }
+    if (patterns[0].known && patterns[1].known && !patterns[0].dependsOn(rowLoop) && patterns[1].dependsOn(rowLoop)) {
+        std::swap(operands[0], operands[1]);
+        std::swap(patterns[0], patterns[1]);
+    }
+    
+    // A compressed nest multiplies A by the nonzero values of B
+    CompressedNest compressed;
+    const bool isCompressed = !batchLoop && colLoop && matchCompressedNest(innermost, operands, result, scev, compressed);
+    if (isCompressed) {
+        operands[0] = compressed.a;
+        operands[1] = compressed.values;
+        patterns[0] = getAccessPattern(operands[0], scev);
+        if (compressed.format == SparsityPattern::SPARSE_CSR) {
+            shape.lda = leadingDimension(patterns[0].stepAlong(rowLoop));
+        }
+    } else if (patterns[0].known) {
+        int64_t rowStep = patterns[0].stepAlong(rowLoop);
+        int64_t commonStep = patterns[0].stepAlong(commonLoop);
+        shape.transposeA = rowStep == 1 && commonStep != 1;
+        shape.lda = leadingDimension(shape.transposeA ? commonStep : rowStep);
+        shape.strideA = batchLoop ? leadingDimension(patterns[0].stepAlong(batchLoop)) : 0;
+    }
+    if (patterns[1].known && !isCompressed) {
+        int64_t commonStep = patterns[1].stepAlong(commonLoop);
+        int64_t colStep = colLoop ? patterns[1].stepAlong(colLoop) : 0;
+        shape.transposeB = colLoop && commonStep == 1 && colStep != 1;
+        shape.ldb = leadingDimension(shape.transposeB ? colStep : commonStep);
+        shape.strideB = batchLoop ? leadingDimension(patterns[1].stepAlong(batchLoop)) : 0;
+    }
+    if (patterns[2].known) {
+        shape.ldc = leadingDimension(patterns[2].stepAlong(rowLoop));
+        shape.strideC = batchLoop ? leadingDimension(patterns[2].stepAlong(batchLoop)) : 0;
+    }
+    
+    llvm::Value* bases[3] = {
+        operands[0] ? getMatrixBase(operands[0]->getPointerOperand()) : nullptr,
+        operands[1] ? getMatrixBase(operands[1]->getPointerOperand()) : nullptr,
+        result ? getMatrixBase(result->getPointerOperand()) : nullptr
+    };
+    
+    const char* defaultNames[3] = {"A", "B", "C"};
+    std::string names[3];
+    std::vector<unsigned> allocated[3];
+    for (int m = 0; m < 3; m++) {
+        names[m] = (bases[m] && bases[m]->hasName()) ? bases[m]->getName().str() : defaultNames[m];
+        if (bases[m]) {
+            allocated[m] = getAllocatedDimensions(bases[m]);
+        }
+        allocated[m].resize(2, 0);
+    }
+    
+    // Arrays of transposed operands are declared in stored order
+    if (shape.transposeA) {
+        std::swap(allocated[0][0], allocated[0][1]);
+    }
+    if (shape.transposeB) {
+        std::swap(allocated[1][0], allocated[1][1]);
+    }
+    
+    const auto& assumed = config.assumedDimensions;
+    shape.rows = firstKnown({findTripCount(rowLoop, scev), allocated[0][0], allocated[2][0], assumed.rows});
+    shape.cols = colLoop ? firstKnown({findTripCount(colLoop, scev), allocated[1][1], allocated[2][1], assumed.cols})
+                         : 1;
+    shape.common = firstKnown({findTripCount(commonLoop, scev), allocated[0][1], allocated[1][0], assumed.common});
+    shape.vector = !colLoop;
+    shape.batch = batchLoop ? firstKnown({findTripCount(batchLoop, scev), assumed.batch}) : 1;
+    
+    // Compressed nests take the dimension they walk from the pointer array,
+    // and the other from the extent of the indices
+    if (isCompressed) {
+        const bool byRow = compressed.format == SparsityPattern::SPARSE_CSR;
+        unsigned walked = static_cast<unsigned>(compressed.pointers.size() - 1);
+        unsigned indexed = 0;
+        for (int64_t index : compressed.indices) {
+            indexed = std::max(indexed, static_cast<unsigned>(index) + 1);
+        }
+        unsigned& other = byRow ? shape.cols : shape.common;
+        (byRow ? shape.common : shape.cols) = walked;
+        other = std::max(firstKnown({byRow ? allocated[2][1] : allocated[0][1],
+                                     byRow ? assumed.cols : assumed.common, indexed}), indexed);
+        
+        std::vector<std::pair<unsigned, unsigned>> nonzeros;
+        for (unsigned x = 0; x < walked; x++) {
+            for (int64_t p = compressed.pointers[x]; p < compressed.pointers[x + 1]; p++) {
+                unsigned index = static_cast<unsigned>(compressed.indices[p]);
+                nonzeros.push_back(byRow ? std::make_pair(x, index) : std::make_pair(index, x));
+            }
+        }
+        shape.sparsity = SparsityPattern::fromEntries(compressed.format, shape.common, shape.cols, nonzeros);
+    }
+    
+    if (shape.rows == 0 || shape.cols == 0 || shape.common == 0 || shape.batch == 0) {
+        std::string guessed;
+        for (const auto& dimension : {std::make_pair(shape.rows, "rows"), std::make_pair(shape.cols, "cols"),
+                                      std::make_pair(shape.common, "common"), std::make_pair(shape.batch, "batch")}) {
+            if (dimension.first == 0) {
+                guessed += (guessed.empty() ? "" : ", ") + std::string(dimension.second);
+            }
+        }
+        PIM_LOG_WARNING("Could not infer all dimensions of " + function.getName().str() + ": assuming " +
+                        std::to_string(DEFAULT_DIMENSION) + " for " + guessed +
+                        "; pass --dims RxCxK[xB] to set them");
+        shape.rows = firstKnown({shape.rows, DEFAULT_DIMENSION});
+        shape.cols = firstKnown({shape.cols, DEFAULT_DIMENSION});
+        shape.common = firstKnown({shape.common, DEFAULT_DIMENSION});
+        shape.batch = firstKnown({shape.batch, DEFAULT_DIMENSION});
+    }
+    
+    // A constant B, such as the weights of a layer, keeps its values and the
+    // positions of its zeros
+    std::vector<int64_t> constantB;
+    if (!isCompressed && shape.batch == 1 && bases[1] && readConstantIntegers(bases[1], constantB)) {
+        const unsigned width = shape.ldb != 0 ? shape.ldb : (shape.transposeB ? shape.common : shape.cols);
+        std::vector<std::pair<unsigned, unsigned>> nonzeros;
+        std::vector<int32_t> weights;
+        weights.reserve(static_cast<size_t>(shape.common) * shape.cols);
+        bool inBounds = true;
+        for (unsigned k = 0; k < shape.common && inBounds; k++) {
+            for (unsigned j = 0; j < shape.cols; j++) {
+                size_t offset = shape.transposeB ? static_cast<size_t>(j) * width + k
+                                                 : static_cast<size_t>(k) * width + j;
+                if (offset >= constantB.size()) {
+                    inBounds = false;
+                    break;
+                }
+                weights.push_back(static_cast<int32_t>(constantB[offset]));
+                if (constantB[offset] != 0) {
+                    nonzeros.push_back({k, j});
+                }
+            }
+        }
+        if (inBounds) {
+            shape.weights = std::move(weights);
+        }
+        if (inBounds && nonzeros.size() < static_cast<size_t>(shape.common) * shape.cols) {
+            shape.sparsity = SparsityPattern::fromEntries(SparsityPattern::SPARSE_CONSTANT, shape.common,
+                                                          shape.cols, nonzeros);
+        }
+    }
+    
+    shape.matrixA = names[0];
+    shape.matrixB = names[1];
+    shape.matrixC = names[2];
+    shape.matrices[names[0]] = {shape.rows, shape.common};
+    shape.matrices[names[1]] = {shape.common, shape.cols};
+    shape.matrices[names[2]] = {shape.rows, shape.cols};
+    
+    // Elementwise epilogues of an unbatched kernel, first where C is stored
+    // after the common-dimension loop, then in the nests over C that follow
+    if (batchLoop || !bases[2]) {
+        return true;
+    }
+    
+    bool recognized = true;
+    for (auto* store : findStoresTo(bases[2], innermost->getParentLoop(), innermost)) {
+        llvm::Value* root = matchEpilogueChain(store->getValueOperand(), {rowLoop, colLoop}, scev, shape.epilogue);
+        if (!loadsStoredElement(root, store, scev) && !isAccumulatedValue(root, innermost)) {
+            recognized = false;
+            break;
+        }
+    }
+    
+    for (llvm::Loop* outer : loopInfo.getLoopsInPreorder()) {
+        if (!recognized) {
+            break;
+        }
+        if (outer->getLoopDepth() != 1 || outer == nest[0] ||
+            !dominatorTree.dominates(nest[0]->getHeader(), outer->getHeader())) {
+            continue;
+        }
+        
+        std::vector<llvm::StoreInst*> stores = findStoresTo(bases[2], outer, nullptr);
+        if (stores.empty()) {
+            continue;
+        }
+        
+        // A loop over the rows of a vector C, or a two-deep nest over a matrix
+        llvm::Loop* inner = outer;
+        if (colLoop && outer->getSubLoops().size() == 1) {
+            inner = outer->getSubLoops().front();
+        }
+        const size_t depth = colLoop ? 2 : 1;
+        if ((colLoop && inner == outer) || !inner->getSubLoops().empty()) {
+            recognized = false;
+            break;
+        }
+        
+        for (auto* store : stores) {
+            // The column loop walks consecutive elements of C
+            AccessPattern pattern = getAccessPattern(store, scev);
+            EpilogueLoops loops = {outer, nullptr};
+            if (colLoop) {
+                bool innerIsCol = pattern.stepAlong(inner) == 1;
+                loops = {innerIsCol ? outer : inner, innerIsCol ? inner : outer};
+            }
+            unsigned rowTrips = findTripCount(loops.row, scev);
+            unsigned colTrips = loops.col ? findTripCount(loops.col, scev) : 0;
+            if (!pattern.known || pattern.steps.size() != depth || !pattern.dependsOn(loops.row) ||
+                (rowTrips != 0 && rowTrips != shape.rows) || (colTrips != 0 && colTrips != shape.cols)) {
+                recognized = false;
+                break;
+            }
+            
+            llvm::Value* root = matchEpilogueChain(store->getValueOperand(), loops, scev, shape.epilogue);
+            if (!loadsStoredElement(root, store, scev)) {
+                recognized = false;
+                break;
+            }
+        }
+    }
+    
+    if (!recognized) {
+        PIM_LOG_INFO("Stopped fusing the epilogue of " + function.getName().str() +
+                    " at an unrecognized store to " + names[2]);
+    }
+    
+    // Bias vectors are numbered per kind in order of use
+    unsigned vectors[2] = {0, 0};
+    for (auto& op : shape.epilogue) {
+        if (op.isBias()) {
+            op.operand = vectors[op.kind == EpilogueOp::BIAS_ROW ? 1 : 0]++;
+        }
+    }
+    
+    return true;
+}
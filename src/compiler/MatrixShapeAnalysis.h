@@ -0,0 +1,285 @@
+/**
+ * MatrixShapeAnalysis.h
+ * Infers matrix dimensions from LLVM IR
+ */
+
+#ifndef MATRIX_SHAPE_ANALYSIS_H
+#define MATRIX_SHAPE_ANALYSIS_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+#include "../include/CompilerConfig.h"
+
+/**
+ * Elementwise operation applied to every element of C after the product
+ * 
+ * Bias vectors are supplied by the host: operand v of the row vectors is
+ * row v of PIM_HOST_ROW_VECTOR, and likewise for the column vectors.
+ */
+struct EpilogueOp {
+    enum Kind {
+        BIAS_COLUMN,            // C[i][j] += v[j]
+        BIAS_ROW,               // C[i][j] += v[i]
+        RELU,                   // C[i][j] = max(C[i][j], 0)
+        SCALE                   // C[i][j] *= factor
+    };
+    
+    Kind kind = RELU;
+    int32_t factor = 1;         // Multiplier of SCALE
+    unsigned operand = 0;       // Host vector of a bias, numbered per kind
+    std::string vector;         // IR name of the bias vector
+    
+    /**
+     * Check whether the operation adds a host vector
+     */
+    bool isBias() const { return kind == BIAS_COLUMN || kind == BIAS_ROW; }
+    
+    /**
+     * Get a short description such as "bias[j]", "relu" or "scale 2"
+     */
+    std::string describe() const;
+};
+
+/**
+ * Nonzero structure of B, where it is known at compile time
+ *
+ * B is either a constant array whose zero elements need no multiply, or
+ * the operand of a compressed loop nest walking B by rows (CSR) or by
+ * columns (CSC) through constant index arrays; the values of a compressed
+ * B may change at run time. Whatever the source, the nonzeros are kept by
+ * rows of the logical common x cols matrix.
+ */
+struct SparsityPattern {
+    enum Format {
+        SPARSE_NONE,            // Dense, or unknown before the nonzeros are loaded
+        SPARSE_CONSTANT,        // Constant array with zero elements
+        SPARSE_CSR,             // Row pointers and column indices
+        SPARSE_CSC              // Column pointers and row indices
+    };
+
+    Format format = SPARSE_NONE;
+    unsigned rows = 0;
+    unsigned cols = 0;
+    std::vector<unsigned> rowStart;     // rows + 1 offsets of the rows into columns
+    std::vector<unsigned> columns;      // Column of every nonzero, ascending within a row
+
+    /**
+     * Build a pattern from the coordinates of its nonzeros
+     *
+     * @param format Source of the pattern
+     * @param rows Rows of the matrix
+     * @param cols Columns of the matrix
+     * @param nonzeros Coordinates {row, col} in any order; duplicates count once
+     */
+    static SparsityPattern fromEntries(Format format, unsigned rows, unsigned cols,
+                                       std::vector<std::pair<unsigned, unsigned>> nonzeros);
+
+    /**
+     * Check whether the pattern says which elements of B are zero
+     */
+    bool isSparse() const { return format != SPARSE_NONE; }
+
+    /**
+     * Get the number of nonzero elements
+     */
+    unsigned nonzeros() const { return static_cast<unsigned>(columns.size()); }
+
+    /**
+     * Check whether element [row, col] may be nonzero; every element of a
+     * dense pattern may be
+     */
+    bool isNonzero(unsigned row, unsigned col) const;
+
+    /**
+     * Check whether a block [rowBegin, rowEnd) x [colBegin, colEnd) has a
+     * nonzero element; the bounds are clamped to the matrix
+     */
+    bool anyNonzero(unsigned rowBegin, unsigned rowEnd, unsigned colBegin, unsigned colEnd) const;
+
+    /**
+     * Get a hash of the dimensions and nonzero positions
+     */
+    uint64_t fingerprint() const;
+
+    /**
+     * Get a short description such as "csr, 96 of 1024 nonzero"
+     */
+    std::string describe() const;
+};
+
+/**
+ * Shape of one matrix multiplication kernel C = A * B
+ *
+ * A is rows x common, B is common x cols and C is rows x cols. The fields
+ * after the dimensions describe the variant: a batched kernel computes
+ * batch independent products C[b] = A[b] * B[b], a GEMV (vector, cols == 1)
+ * multiplies A by the vector B, and transposed operands are stored by the
+ * host as their transpose. Leading dimensions and batch strides count
+ * elements and are 0 where the IR does not determine them.
+ */
+struct KernelShape {
+    unsigned rows = 0;
+    unsigned cols = 0;
+    unsigned common = 0;
+    unsigned batch = 1;
+    bool vector = false;        // B and C are vectors (a two-deep i/k nest)
+    
+    // Host storage of the operands
+    bool transposeA = false;    // A stored as common x rows
+    bool transposeB = false;    // B stored as cols x common
+    unsigned lda = 0;           // Elements between consecutive stored rows of A
+    unsigned ldb = 0;
+    unsigned ldc = 0;
+    unsigned strideA = 0;       // Elements between the A operands of consecutive products
+    unsigned strideB = 0;
+    unsigned strideC = 0;
+    
+    // IR names of the operand base pointers (empty if unnamed)
+    std::string matrixA;
+    std::string matrixB;
+    std::string matrixC;
+    
+    // Dimensions per operand name, format: {rows, cols}
+    std::map<std::string, std::vector<unsigned>> matrices;
+    
+    // Elementwise operations fused after the product, in application order
+    std::vector<EpilogueOp> epilogue;
+
+    // Zero elements of B known at compile time
+    SparsityPattern sparsity;
+    
+    // Values of a constant B by rows of the logical common x cols matrix
+    // (empty unless B is a constant array)
+    std::vector<int32_t> weights;
+    
+    /**
+     * Check whether B is a vector (matrix-vector product)
+     */
+    bool isGemv() const { return vector; }
+    
+    /**
+     * Check whether the kernel has the defaults of a plain GEMM: one
+     * product of untransposed operands
+     */
+    bool isPlainGemm() const { return batch == 1 && !transposeA && !transposeB; }
+    
+    /**
+     * Get a hash of the values of a constant B
+     */
+    uint64_t weightFingerprint() const;
+    
+    /**
+     * Get a short description of the variant, such as "batch 8, B transposed, ldb 32"
+     * 
+     * @return Empty for a plain, densely stored GEMM
+     */
+    std::string describeVariant() const;
+    
+    /**
+     * Get the fused epilogue as a list such as "bias[j], relu, scale 2"
+     * 
+     * @return Empty without an epilogue
+     */
+    std::string describeEpilogue() const;
+};
+
+/**
+ * Shapes of all matrix multiplication kernels in a module, by function name
+ */
+struct ShapeAnalysisResult {
+    std::map<std::string, KernelShape> kernels;
+    
+    /**
+     * Get the shape of the kernel in the given function
+     * 
+     * @param functionName Function name
+     * @return Kernel shape, or nullptr if the function is not a kernel
+     */
+    const KernelShape* lookup(const std::string& functionName) const;
+};
+
+class MatrixShapeAnalysis {
+public:
+    explicit MatrixShapeAnalysis(const CompilerConfig& config);
+    ~MatrixShapeAnalysis();
+
+    /**
+     * Infer the shapes of all matrix multiplication kernels in a module
+     * 
+     * The multiply-accumulate of the innermost loop selects the nest: two
+     * loops (i, k) form a GEMV, three (i, j, k) a GEMM and four a batched
+     * GEMM whose outermost loop counts the products. The steps of the
+     * operand addresses along the loops (ScalarEvolution) tell A from B,
+     * detect transposed operands and give the leading dimensions and batch
+     * strides; where they are unknown, as in unoptimized IR, the operands
+     * are assumed untransposed with the product's first load as A.
+     * 
+     * Sparse B operands are recognized in two forms. A B held in a
+     * constant global array (an unbatched kernel's weights) keeps the
+     * positions of its zero elements. An innermost loop running from
+     * ptr[x] to ptr[x + 1] over constant pointer and index arrays is a
+     * compressed nest: with C[i][idx[p]] += A[i][k] * val[p] it walks the
+     * rows of B (CSR, x = k), with C[i][j] += A[i][idx[p]] * val[p] its
+     * columns (CSC, x = j). The values are B, and the number of pointers
+     * fixes the common dimension (CSR) or the columns (CSC).
+     *
+     * Elementwise epilogues of unbatched kernels are recognized where C is
+     * stored after the common-dimension loop, and in the loop nests over C
+     * that follow the kernel: bias vectors indexed by the row or column of
+     * C, ReLU (smax or a compare and select against 0) and multiplication
+     * by a constant.
+     * 
+     * Each dimension is taken from the first source that determines it:
+     * 1. Constant loop trip counts (ScalarEvolution, or a constant loop bound)
+     * 2. Constant arguments at every call site of the kernel, for loops
+     *    bounded by a function argument
+     * 3. Array types of the global variables or allocas holding the matrices
+     * 4. CompilerConfig::assumedDimensions
+     * 5. The legacy default of 2
+     * 
+     * @param module LLVM module to analyze (not modified)
+     * @return Shapes of the functions containing a matrix multiplication loop nest
+     */
+    ShapeAnalysisResult analyze(llvm::Module& module);
+    
+    /**
+     * Infer the shape of the kernel in a single function
+     * 
+     * Uses the same sources as analyze(Module&); call sites are looked up in
+     * the function's parent module.
+     * 
+     * @param function Function to analyze (not modified)
+     * @return The function's shape, or no kernels if it has no matrix
+     *         multiplication loop nest
+     */
+    ShapeAnalysisResult analyze(llvm::Function& function);
+    
+    /**
+     * Find the matrix an access pointer is based on
+     * 
+     * Looks through GEPs and casts, and through the stack slots unoptimized
+     * code keeps pointer arguments in.
+     * 
+     * @param ptr Pointer operand of a load or store
+     * @return Global variable, alloca or argument holding the matrix
+     */
+    static llvm::Value* findMatrixBase(llvm::Value* ptr);
+
+private:
+    CompilerConfig config;
+    
+    /**
+     * Analyze a single function
+     * 
+     * @param function Function to analyze
+     * @param shape Shape to fill in
+     * @return True if the function contains a matrix multiplication loop nest
+     */
+    bool analyzeFunction(llvm::Function& function, KernelShape& shape);
+};
+
+#endif // MATRIX_SHAPE_ANALYSIS_H
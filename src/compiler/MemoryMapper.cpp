@@ -15,15 +15,24 @@
 #include <string>
 #include <vector>
 
-MemoryMapper::MemoryMapper() {}
+MemoryMapper::MemoryMapper() : config(CompilerConfig::getDefaultConfig()) {}
+
+MemoryMapper::MemoryMapper(const CompilerConfig& config) : config(config) {}
 
 MemoryMapper::~MemoryMapper() = default;
 
 std::unique_ptr<llvm::Module> MemoryMapper::applyMemoryMapping(std::unique_ptr<llvm::Module>& module) {
-    Logger::getInstance().log("Starting memory mapping transformation");
+    MatrixShapeAnalysis shapeAnalysis(config);
+    ShapeAnalysisResult shapes = shapeAnalysis.analyze(*module);
+    return applyMemoryMapping(module, shapes);
+}
+
+std::unique_ptr<llvm::Module> MemoryMapper::applyMemoryMapping(std::unique_ptr<llvm::Module>& module,
+                                                               const ShapeAnalysisResult& shapes) {
+    PIM_LOG_INFO("Starting memory mapping transformation");
     
-    // Detect matrix dimensions from the code
-    auto matrixInfo = detectMatrixDimensions(module.get());
+    // Plan the bank layout of every matrix from the inferred shapes
+    auto matrixLayouts = planMatrixLayouts(shapes);
     
     // Process each function in the module
     for (auto& function : *module) {
@@ -32,31 +41,63 @@ std::unique_ptr<llvm::Module> MemoryMapper::applyMemoryMapping(std::unique_ptr<l
             continue;
         }
         
-        Logger::getInstance().log("Applying memory mapping to function: " + function.getName().str());
-        mapArrayAccesses(&function, matrixInfo);
+        PIM_LOG_INFO("Applying memory mapping to function: " + function.getName().str());
+        mapArrayAccesses(&function, matrixLayouts);
     }
     
-    Logger::getInstance().log("Memory mapping transformation complete");
+    PIM_LOG_INFO("Memory mapping transformation complete");
     return std::move(module);
 }
 
-std::map<std::string, std::vector<unsigned>> MemoryMapper::detectMatrixDimensions(llvm::Module* module) {
-    Logger::getInstance().log("Detecting matrix dimensions");
+void MemoryMapper::applyMemoryMapping(llvm::Function& function, const ShapeAnalysisResult& shapes) {
+    if (function.isDeclaration()) {
+        return;
+    }
     
-    // In a real implementation, this would analyze the code to determine matrix dimensions
-    // For simplicity, we'll use fixed dimensions in this example
-    std::map<std::string, std::vector<unsigned>> matrixInfo;
+    auto matrixLayouts = planMatrixLayouts(shapes);
+    PIM_LOG_INFO("Applying memory mapping to function: " + function.getName().str());
+    mapArrayAccesses(&function, matrixLayouts);
+}
+
+std::map<std::string, MatrixLayout> MemoryMapper::planMatrixLayouts(const ShapeAnalysisResult& shapes) {
+    PIM_LOG_INFO("Planning matrix layouts");
     
-    // Add default matrix information
-    // Format: {rows, cols}
-    matrixInfo["A"] = {2, 2};
-    matrixInfo["B"] = {2, 2};
-    matrixInfo["C"] = {2, 2};
+    LayoutPlanner planner(config);
+    std::map<std::string, MatrixLayout> matrixLayouts;
     
-    return matrixInfo;
+    for (const auto& [functionName, shape] : shapes.kernels) {
+        PIM_LOG_INFO("Layout candidates for " + functionName + ":");
+        planner.report(shape.rows, shape.cols, shape.common, shape.transposeA, shape.transposeB);
+        LayoutPlan plan = planner.plan(shape);
+        
+        const std::pair<std::string, MatrixLayout> operands[] = {
+            {shape.matrixA, plan.a}, {shape.matrixB, plan.b}, {shape.matrixC, plan.c}
+        };
+        
+        // The values of a compressed nest are stored compressed already
+        const bool compressedNest = shape.sparsity.format == SparsityPattern::SPARSE_CSR ||
+                                    shape.sparsity.format == SparsityPattern::SPARSE_CSC;
+        for (const auto& [matrixName, layout] : operands) {
+            if (compressedNest && matrixName == shape.matrixB) {
+                continue;
+            }
+            auto it = matrixLayouts.find(matrixName);
+            if (it != matrixLayouts.end() &&
+                (it->second.rows != layout.rows || it->second.cols != layout.cols ||
+                 it->second.columnMajor != layout.columnMajor || it->second.lanes != layout.lanes ||
+                 it->second.packRows != layout.packRows)) {
+                PIM_LOG_WARNING("Conflicting layouts for matrix " + matrixName +
+                               " in function " + functionName + ", keeping the first");
+                continue;
+            }
+            matrixLayouts[matrixName] = layout;
+        }
+    }
+    
+    return matrixLayouts;
 }
 
-void MemoryMapper::mapArrayAccesses(llvm::Function* function, std::map<std::string, std::vector<unsigned>>& matrixInfo) {
+void MemoryMapper::mapArrayAccesses(llvm::Function* function, const std::map<std::string, MatrixLayout>& matrixLayouts) {
     std::vector<llvm::Instruction*> instructionsToProcess;
     
     // First, collect all load/store instructions
@@ -69,12 +110,30 @@ void MemoryMapper::mapArrayAccesses(llvm::Function* function, std::map<std::stri
     }
     
     // Then transform them
+    unsigned transformed = 0;
     for (auto* inst : instructionsToProcess) {
-        transformMemoryAccess(inst, matrixInfo);
+        if (transformMemoryAccess(inst, matrixLayouts)) {
+            transformed++;
+        }
+    }
+    
+    if (transformed > 0) {
+        PIM_LOG_INFO("Remapped " + std::to_string(transformed) + " matrix accesses in " +
+                    function->getName().str());
     }
 }
 
-bool MemoryMapper::transformMemoryAccess(llvm::Instruction* inst, std::map<std::string, std::vector<unsigned>>& matrixInfo) {
+llvm::GlobalVariable* MemoryMapper::getSlotTable(llvm::Module& module, const std::string& matrixName,
+                                                 const MatrixLayout& layout) {
+    const std::string name = "pim_" + matrixName + "_slots";
+    if (llvm::GlobalVariable* table = module.getNamedGlobal(name)) {
+        return table;
+    }
+    llvm::Constant* slots = llvm::ConstantDataArray::get(module.getContext(), llvm::ArrayRef<uint32_t>(layout.slots));
+    return new llvm::GlobalVariable(module, slots->getType(), true, llvm::GlobalValue::InternalLinkage, slots, name);
+}
+
+bool MemoryMapper::transformMemoryAccess(llvm::Instruction* inst, const std::map<std::string, MatrixLayout>& matrixLayouts) {
     llvm::IRBuilder<> builder(inst);
     llvm::Value* ptr = nullptr;
     
@@ -93,61 +152,100 @@ bool MemoryMapper::transformMemoryAccess(llvm::Instruction* inst, std::map<std::
         return false;
     }
     
-    // In a real implementation, we would analyze the GEP to determine which matrix it's accessing
-    // and transform the access according to PIM memory layout
-    
     // Determine which matrix is being accessed
     llvm::Value* basePtr = gep->getPointerOperand();
-    std::string matrixName;
-    
-    if (auto* global = llvm::dyn_cast<llvm::GlobalVariable>(basePtr)) {
-        matrixName = global->getName().str();
-    } else {
-        // We can't determine the matrix name, skip this instruction
+    llvm::Value* matrix = MatrixShapeAnalysis::findMatrixBase(basePtr);
+    if (!matrix->hasName()) {
         return false;
     }
+    std::string matrixName = matrix->getName().str();
     
-    // Check if we have information about this matrix
-    if (matrixInfo.find(matrixName) == matrixInfo.end()) {
+    // Check if we have a layout for this matrix
+    auto layoutIt = matrixLayouts.find(matrixName);
+    if (layoutIt == matrixLayouts.end()) {
         return false;
     }
+    const MatrixLayout& layout = layoutIt->second;
     
-    // Get the indices
-    if (gep->getNumIndices() != 2) {
-        // Not a 2D array access, skip
-        return false;
-    }
-    
-    llvm::Value* rowIdx = gep->getOperand(1);
-    llvm::Value* colIdx = gep->getOperand(2);
-    
-    // Check if indices are constants
-    auto* rowIdxConst = llvm::dyn_cast<llvm::ConstantInt>(rowIdx);
-    auto* colIdxConst = llvm::dyn_cast<llvm::ConstantInt>(colIdx);
+    // Recover the row and column indices; the arithmetic is done in 64 bits
+    llvm::Type* indexType = builder.getInt64Ty();
+    llvm::Type* elementType = nullptr;
+    llvm::Value* rowIdx = nullptr;
+    llvm::Value* colIdx = nullptr;
     
-    if (!rowIdxConst || !colIdxConst) {
-        // Indices are not constants, we would need more complex transformation
-        // For simplicity, we'll skip these cases
+    auto* arrayType = llvm::dyn_cast<llvm::ArrayType>(gep->getSourceElementType());
+    if (arrayType && gep->getNumIndices() == 3 && llvm::isa<llvm::ArrayType>(arrayType->getElementType())) {
+        // 2D array access: gep [R x [C x T]], base, 0, row, col
+        auto* firstIdx = llvm::dyn_cast<llvm::ConstantInt>(gep->getOperand(1));
+        if (!firstIdx || !firstIdx->isZero()) {
+            return false;
+        }
+        elementType = llvm::cast<llvm::ArrayType>(arrayType->getElementType())->getElementType();
+        rowIdx = builder.CreateSExtOrTrunc(gep->getOperand(2), indexType);
+        colIdx = builder.CreateSExtOrTrunc(gep->getOperand(3), indexType);
+    } else if (!arrayType && gep->getNumIndices() == 1) {
+        // Flat access: gep T, base, idx; unpacked dense row-major layouts already match
+        if (!layout.columnMajor && layout.lanes == 1 && !layout.isCompressed()) {
+            return false;
+        }
+        elementType = gep->getSourceElementType();
+        llvm::Value* flatIdx = builder.CreateSExtOrTrunc(gep->getOperand(1), indexType);
+        rowIdx = builder.CreateUDiv(flatIdx, llvm::ConstantInt::get(indexType, layout.cols));
+        colIdx = builder.CreateURem(flatIdx, llvm::ConstantInt::get(indexType, layout.cols));
+    } else {
         return false;
     }
     
-    // Get matrix dimensions
-    unsigned rows = matrixInfo[matrixName][0];
-    unsigned cols = matrixInfo[matrixName][1];
-    
-    // Calculate linear index based on PIM memory layout
-    // In a real implementation, this would follow the PIM memory mapping scheme
-    // For simplicity, we'll use row-major order
-    unsigned rowVal = rowIdxConst->getZExtValue();
-    unsigned colVal = colIdxConst->getZExtValue();
-    unsigned linearIdx = rowVal * cols + colVal;
+    // Packed layouts address words; the lane is the remainder along the packed dimension
+    llvm::Value* lane = nullptr;
+    if (layout.lanes > 1) {
+        llvm::Value* lanes = llvm::ConstantInt::get(indexType, layout.lanes);
+        llvm::Value*& packedIdx = layout.packRows ? rowIdx : colIdx;
+        lane = builder.CreateURem(packedIdx, lanes);
+        packedIdx = builder.CreateUDiv(packedIdx, lanes);
+    }
     
-    // Create a new GEP instruction that uses the linear index
-    std::vector<llvm::Value*> indices;
-    indices.push_back(llvm::ConstantInt::get(rowIdx->getType(), 0));  // First index is always 0 for arrays
-    indices.push_back(llvm::ConstantInt::get(rowIdx->getType(), linearIdx));
+    // Calculate the element offset in the planned layout (folded for constant indices)
+    llvm::Value* linearIdx = nullptr;
+    if (layout.columnMajor) {
+        linearIdx = builder.CreateAdd(builder.CreateMul(colIdx, llvm::ConstantInt::get(indexType, layout.wordRows())), rowIdx);
+    } else {
+        linearIdx = builder.CreateAdd(builder.CreateMul(rowIdx, llvm::ConstantInt::get(indexType, layout.wordCols())), colIdx);
+    }
+    // Compressed layouts look the word up in a table of slots, and words
+    // known to be zero read as 0; B is only read
+    llvm::Value* stored = nullptr;
+    if (layout.isCompressed()) {
+        if (!llvm::isa<llvm::LoadInst>(inst)) {
+            return false;
+        }
+        if (auto* constant = llvm::dyn_cast<llvm::ConstantInt>(linearIdx)) {
+            if (constant->getZExtValue() >= layout.slots.size()) {
+                return false;
+            }
+            unsigned slot = layout.slots[constant->getZExtValue()];
+            if (slot == MatrixLayout::NO_SLOT) {
+                inst->replaceAllUsesWith(llvm::Constant::getNullValue(inst->getType()));
+                inst->eraseFromParent();
+                return true;
+            }
+            linearIdx = llvm::ConstantInt::get(indexType, slot);
+        } else {
+            llvm::GlobalVariable* table = getSlotTable(*inst->getModule(), matrixName, layout);
+            llvm::Value* slotPtr = builder.CreateGEP(table->getValueType(), table,
+                                                     {builder.getInt64(0), linearIdx}, "pim_" + matrixName + "_slot_addr");
+            llvm::Value* slot = builder.CreateLoad(builder.getInt32Ty(), slotPtr, "pim_" + matrixName + "_slot");
+            stored = builder.CreateICmpNE(slot, builder.getInt32(MatrixLayout::NO_SLOT));
+            linearIdx = builder.CreateSelect(stored, builder.CreateZExt(slot, indexType), builder.getInt64(0));
+        }
+    }
+    if (lane) {
+        linearIdx = builder.CreateAdd(builder.CreateMul(linearIdx, llvm::ConstantInt::get(indexType, layout.lanes)), lane);
+    }
     
-    llvm::Value* newPtr = builder.CreateGEP(gep->getSourceElementType(), basePtr, indices, "pim_" + matrixName + "_addr");
+    // Address the matrix as a flat array of elements
+    llvm::Value* elementBase = builder.CreatePointerCast(basePtr, elementType->getPointerTo(gep->getAddressSpace()));
+    llvm::Value* newPtr = builder.CreateGEP(elementType, elementBase, linearIdx, "pim_" + matrixName + "_addr");
     
     // Replace the old pointer with the new one
     if (auto* loadInst = llvm::dyn_cast<llvm::LoadInst>(inst)) {
@@ -156,5 +254,12 @@ bool MemoryMapper::transformMemoryAccess(llvm::Instruction* inst, std::map<std::
         storeInst->setOperand(1, newPtr);
     }
     
+    // Words that are not stored load slot 0 and are replaced by 0
+    if (stored) {
+        builder.SetInsertPoint(inst->getNextNode());
+        llvm::Value* value = builder.CreateSelect(stored, inst, llvm::Constant::getNullValue(inst->getType()));
+        inst->replaceUsesWithIf(value, [&](llvm::Use& use) { return use.getUser() != value; });
+    }
+    
     return true;
 }
@@ -13,10 +13,14 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include "MatrixShapeAnalysis.h"
+#include "LayoutPlanner.h"
+#include "../include/CompilerConfig.h"
 
 class MemoryMapper {
 public:
     MemoryMapper();
+    explicit MemoryMapper(const CompilerConfig& config);
     ~MemoryMapper();
 
     /**
@@ -27,31 +31,78 @@ public:
      */
     std::unique_ptr<llvm::Module> applyMemoryMapping(std::unique_ptr<llvm::Module>& module);
 
+    /**
+     * Apply memory mapping using previously inferred kernel shapes
+     * 
+     * @param module LLVM module to transform
+     * @param shapes Kernel shapes from MatrixShapeAnalysis
+     * @return Transformed LLVM module
+     */
+    std::unique_ptr<llvm::Module> applyMemoryMapping(std::unique_ptr<llvm::Module>& module,
+                                                     const ShapeAnalysisResult& shapes);
+
+    /**
+     * Apply memory mapping to a single function
+     * 
+     * Layouts are planned from the given shapes only, so functions mapped
+     * separately do not share matrix placements.
+     * 
+     * @param function Function to transform
+     * @param shapes Kernel shapes from MatrixShapeAnalysis
+     */
+    void applyMemoryMapping(llvm::Function& function, const ShapeAnalysisResult& shapes);
+
 private:
+    CompilerConfig config;
+    
     /**
      * Map array accesses to PIM-specific memory layout
      * 
      * @param function Function to transform
-     * @param matrixInfo Map of matrix names to dimensions
+     * @param matrixLayouts Map of matrix names to layouts
      */
-    void mapArrayAccesses(llvm::Function* function, std::map<std::string, std::vector<unsigned>>& matrixInfo);
+    void mapArrayAccesses(llvm::Function* function, const std::map<std::string, MatrixLayout>& matrixLayouts);
     
     /**
-     * Detect matrix dimensions from the code
+     * Plan the layout of every matrix from the inferred kernel shapes
      * 
-     * @param module LLVM module to analyze
-     * @return Map of matrix names to dimensions
+     * The value arrays of CSR and CSC nests hold B compressed already and
+     * keep their IR layout.
+     * 
+     * @param shapes Kernel shapes from MatrixShapeAnalysis
+     * @return Map of matrix names to layouts
      */
-    std::map<std::string, std::vector<unsigned>> detectMatrixDimensions(llvm::Module* module);
+    std::map<std::string, MatrixLayout> planMatrixLayouts(const ShapeAnalysisResult& shapes);
     
     /**
-     * Transform regular load/store instructions to PIM-specific layout
+     * Rewrite a load/store address to the element offset in the matrix layout
+     * 
+     * Handles 2D array accesses (A[r][c]) and flat pointer accesses
+     * (A[idx]) with constant or runtime indices; the offset is computed
+     * with mul/add (and udiv/urem for flat accesses to transposed matrices)
+     * when the indices are not constant. Packed layouts are addressed in
+     * lane slots, word offset * lanes + lane (see MatrixLayout). Loads from
+     * a compressed layout read their word through its slot table (see
+     * getSlotTable()), or are replaced by 0 for words known to be zero.
      * 
      * @param inst Load or store instruction to transform
-     * @param matrixInfo Map of matrix names to dimensions
+     * @param matrixLayouts Map of matrix names to layouts
      * @return Whether the instruction was transformed
      */
-    bool transformMemoryAccess(llvm::Instruction* inst, std::map<std::string, std::vector<unsigned>>& matrixInfo);
+    bool transformMemoryAccess(llvm::Instruction* inst, const std::map<std::string, MatrixLayout>& matrixLayouts);
+    
+    /**
+     * Get the constant table of a compressed layout's slots, indexed by
+     * dense word offset (MatrixLayout::NO_SLOT for words not stored),
+     * creating it on first use
+     * 
+     * @param module Module holding the table
+     * @param matrixName Name of the matrix
+     * @param layout Compressed layout of the matrix
+     * @return Global named pim_<matrix>_slots
+     */
+    llvm::GlobalVariable* getSlotTable(llvm::Module& module, const std::string& matrixName,
+                                       const MatrixLayout& layout);
 };
 
 #endif // MEMORY_MAPPER_H
@@ -0,0 +1,208 @@
+/**
+ * PEScheduler.cpp
+ * Implements the cost model for distributing C over the processing elements
+ */
+
+#include "PEScheduler.h"
+#include "LayoutPlanner.h"
+#include "../utils/Logger.h"
+#include "../include/PIMInstructionSet.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Cycles a single-word host transfer occupies the shared host link; a
+// stream moves one word per LOAD or STORE, which takes a full link cycle
+const double HOST_CYCLES_PER_WORD = 1.0;
+
+using Strategy = CompilerConfig::SchedulingParams::Strategy;
+
+const char* strategyName(Strategy strategy) {
+    switch (strategy) {
+        case CompilerConfig::SchedulingParams::SCHEDULE_ROW_BLOCK: return "row-block";
+        case CompilerConfig::SchedulingParams::SCHEDULE_COLUMN_BLOCK: return "column-block";
+        case CompilerConfig::SchedulingParams::SCHEDULE_BLOCK_2D: return "2D-block";
+        default: return "auto";
+    }
+}
+
+// Strategy of a grid; a single PE counts as a row block
+Strategy strategyOf(unsigned gridRows, unsigned gridCols) {
+    if (gridCols == 1) {
+        return CompilerConfig::SchedulingParams::SCHEDULE_ROW_BLOCK;
+    }
+    if (gridRows == 1) {
+        return CompilerConfig::SchedulingParams::SCHEDULE_COLUMN_BLOCK;
+    }
+    return CompilerConfig::SchedulingParams::SCHEDULE_BLOCK_2D;
+}
+
+// Whether a grid may be used for the strategy (one PE is allowed for every 1D strategy)
+bool matchesStrategy(unsigned gridRows, unsigned gridCols, Strategy strategy) {
+    switch (strategy) {
+        case CompilerConfig::SchedulingParams::SCHEDULE_ROW_BLOCK: return gridCols == 1;
+        case CompilerConfig::SchedulingParams::SCHEDULE_COLUMN_BLOCK: return gridRows == 1;
+        case CompilerConfig::SchedulingParams::SCHEDULE_BLOCK_2D: return gridRows > 1 && gridCols > 1;
+        default: return true;
+    }
+}
+
+unsigned divideRoundingUp(unsigned value, unsigned divisor) {
+    return (value + divisor - 1) / divisor;
+}
+
+} // namespace
+
+std::string PESchedule::describe() const {
+    return std::string(strategyName(strategy)) + " " + std::to_string(gridRows) + "x" + std::to_string(gridCols) +
+           " on " + std::to_string(blocks.size()) + (blocks.size() == 1 ? " PE" : " PEs");
+}
+
+PEScheduler::PEScheduler(const CompilerConfig& config) : config(config) {}
+
+PEScheduler::~PEScheduler() = default;
+
+PESchedule PEScheduler::partition(unsigned rows, unsigned cols, unsigned gridRows, unsigned gridCols) {
+    PESchedule schedule;
+    schedule.strategy = strategyOf(gridRows, gridCols);
+    schedule.gridRows = gridRows;
+    schedule.gridCols = gridCols;
+    
+    unsigned row = 0;
+    for (unsigned bi = 0; bi < gridRows; bi++) {
+        unsigned blockRows = rows / gridRows + (bi < rows % gridRows ? 1 : 0);
+        unsigned col = 0;
+        for (unsigned bj = 0; bj < gridCols; bj++) {
+            unsigned blockCols = cols / gridCols + (bj < cols % gridCols ? 1 : 0);
+            schedule.blocks.push_back({bi * gridCols + bj, row, col, blockRows, blockCols});
+            col += blockCols;
+        }
+        row += blockRows;
+    }
+    
+    return schedule;
+}
+
+bool PEScheduler::fits(const PESchedule& schedule, unsigned common) const {
+    const auto& arch = config.archParams;
+    const unsigned numPEs = std::max(1u, arch.numProcessingElements);
+    const unsigned wordBytes = std::max(1u, arch.wordSize / 8);
+    
+    // PE streams address local memory through the dest/src fields
+    const unsigned localWords = std::min(arch.numMemoryBanks * (arch.memoryBankSize / wordBytes) / numPEs,
+                                         PIMEncoding::operandLimit(config.isaVersion));
+    const unsigned lanes = LayoutPlanner(config).lanesPerWord();
+    
+    // The first block is the largest in both dimensions
+    const PEBlock& block = schedule.blocks.front();
+    return LayoutPlanner::contiguousLayout(block.rows, block.cols, common, lanes).footprint() <= localWords;
+}
+
+double PEScheduler::estimateCost(const PESchedule& schedule, unsigned common) const {
+    const unsigned lanes = LayoutPlanner(config).lanesPerWord();
+    const unsigned words = divideRoundingUp(common, lanes);
+    const unsigned accumulators = config.archParams.registerFileSize > 2 ? config.archParams.registerFileSize - 2 : 1;
+    
+    double slowest = 0.0;
+    double hostWords = 0.0;
+    for (const auto& block : schedule.blocks) {
+        double loads = static_cast<double>(block.rows) * words + static_cast<double>(words) * block.cols;
+        double outputs = static_cast<double>(block.rows) * block.cols;
+        
+        // Instruction counts of generateMatrixMultiplyInstructions
+        double macs = outputs * words;
+        double compute = config.enableRegisterAllocation
+            ? 3.0 * macs + 2.0 * outputs + static_cast<double>(block.rows) * divideRoundingUp(block.cols, accumulators) * words
+            : 6.0 * macs;
+        
+        // Stream marker, loads, zero fills, compute and stores
+        slowest = std::max(slowest, 1.0 + loads + outputs + compute + outputs);
+        hostWords += loads + outputs;
+    }
+    
+    return std::max(slowest, hostWords * HOST_CYCLES_PER_WORD);
+}
+
+std::vector<PESchedule> PEScheduler::evaluateCandidates(unsigned rows, unsigned cols, unsigned common) const {
+    const unsigned numPEs = std::max(1u, config.archParams.numProcessingElements);
+    const Strategy strategies[] = {CompilerConfig::SchedulingParams::SCHEDULE_ROW_BLOCK,
+                                   CompilerConfig::SchedulingParams::SCHEDULE_COLUMN_BLOCK,
+                                   CompilerConfig::SchedulingParams::SCHEDULE_BLOCK_2D};
+    
+    std::vector<PESchedule> best(3);
+    std::vector<bool> found(3, false);
+    for (unsigned gridRows = 1; gridRows <= std::min(rows, numPEs); gridRows++) {
+        for (unsigned gridCols = 1; gridCols <= std::min(cols, numPEs / gridRows); gridCols++) {
+            PESchedule candidate = partition(rows, cols, gridRows, gridCols);
+            if (!fits(candidate, common)) {
+                continue;
+            }
+            candidate.cost = estimateCost(candidate, common);
+            
+            for (size_t s = 0; s < 3; s++) {
+                if (!matchesStrategy(gridRows, gridCols, strategies[s])) {
+                    continue;
+                }
+                bool better = !found[s] || candidate.cost < best[s].cost ||
+                              (candidate.cost == best[s].cost && candidate.blocks.size() < best[s].blocks.size());
+                if (better) {
+                    best[s] = candidate;
+                    best[s].strategy = strategies[s];
+                    found[s] = true;
+                }
+            }
+        }
+    }
+    
+    std::vector<PESchedule> candidates;
+    for (size_t s = 0; s < 3; s++) {
+        if (found[s]) {
+            candidates.push_back(best[s]);
+        }
+    }
+    return candidates;
+}
+
+PESchedule PEScheduler::schedule(unsigned rows, unsigned cols, unsigned common) const {
+    const Strategy requested = config.scheduling.strategy;
+    
+    bool found = false;
+    PESchedule chosen;
+    for (const auto& candidate : evaluateCandidates(rows, cols, common)) {
+        if (requested != CompilerConfig::SchedulingParams::SCHEDULE_AUTO && candidate.strategy != requested) {
+            continue;
+        }
+        if (!found || candidate.cost < chosen.cost ||
+            (candidate.cost == chosen.cost && candidate.blocks.size() < chosen.blocks.size())) {
+            chosen = candidate;
+            found = true;
+        }
+    }
+    
+    if (!found && requested == CompilerConfig::SchedulingParams::SCHEDULE_BLOCK_2D) {
+        // A 2D grid splits both dimensions of C over at least four PEs
+        const unsigned numPEs = std::max(1u, config.archParams.numProcessingElements);
+        if (rows < 2 || cols < 2) {
+            throw std::runtime_error("A 2D-block schedule needs at least two rows and two columns of C; a " +
+                                     std::to_string(rows) + "x" + std::to_string(cols) +
+                                     " result can only use a row-block or column-block schedule");
+        }
+        if (numPEs < 4) {
+            throw std::runtime_error("A 2D-block schedule needs at least 4 PEs; " + std::to_string(numPEs) +
+                                     (numPEs == 1 ? " is" : " are") + " configured");
+        }
+    }
+    if (!found) {
+        throw std::runtime_error(std::string("No ") + strategyName(requested) + " schedule of a " +
+                                 std::to_string(rows) + "x" + std::to_string(cols) + " result fits the PE memories");
+    }
+    return chosen;
+}
+
+void PEScheduler::report(unsigned rows, unsigned cols, unsigned common) const {
+    for (const auto& candidate : evaluateCandidates(rows, cols, common)) {
+        PIM_LOG_INFO("Schedule cost of " + candidate.describe() + ": " +
+                    std::to_string(static_cast<unsigned long>(candidate.cost)) + " cycles");
+    }
+}
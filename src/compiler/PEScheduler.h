@@ -0,0 +1,123 @@
+/**
+ * PEScheduler.h
+ * Distributes the output matrix of untiled kernels over the processing elements
+ */
+
+#ifndef PE_SCHEDULER_H
+#define PE_SCHEDULER_H
+
+#include <string>
+#include <vector>
+#include "../include/CompilerConfig.h"
+
+/**
+ * Block of C computed by one PE
+ */
+struct PEBlock {
+    unsigned pe = 0;
+    unsigned row = 0;          // First row of C
+    unsigned col = 0;          // First column of C
+    unsigned rows = 0;
+    unsigned cols = 0;
+    unsigned batch = 0;        // Product of a batched kernel
+};
+
+/**
+ * Partition of C into one block per PE
+ */
+struct PESchedule {
+    CompilerConfig::SchedulingParams::Strategy strategy = CompilerConfig::SchedulingParams::SCHEDULE_ROW_BLOCK;
+    unsigned gridRows = 1;     // Blocks along the rows of C
+    unsigned gridCols = 1;     // Blocks along the columns of C
+    std::vector<PEBlock> blocks;
+    double cost = 0.0;         // Estimated cycles until the closing SYNC
+    
+    /**
+     * Get a short description such as "2D-block 4x2 on 8 PEs"
+     */
+    std::string describe() const;
+};
+
+class PEScheduler {
+public:
+    explicit PEScheduler(const CompilerConfig& config);
+    ~PEScheduler();
+    
+    /**
+     * Choose the partition of a matrix multiplication
+     *
+     * CompilerConfig::SchedulingParams::strategy restricts the candidates to
+     * one strategy; SCHEDULE_AUTO considers all of them. Among the
+     * candidates whose blocks fit a PE's local memory the cheapest wins, and
+     * ties go to the schedule using fewer PEs.
+     *
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param common Common dimension
+     * @return Chosen schedule with its cost
+     * @throws std::runtime_error if no candidate of the strategy fits, or
+     *         if a 2D-block schedule is requested for a result with a single
+     *         row or column or for fewer than four PEs
+     */
+    PESchedule schedule(unsigned rows, unsigned cols, unsigned common) const;
+    
+    /**
+     * Evaluate the best schedule of every strategy
+     *
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param common Common dimension
+     * @return The cheapest fitting candidate of each strategy (row-block,
+     *         column-block, 2D-block) that has one
+     */
+    std::vector<PESchedule> evaluateCandidates(unsigned rows, unsigned cols, unsigned common) const;
+    
+    /**
+     * Log the cost of every strategy and the choice
+     *
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param common Common dimension
+     */
+    void report(unsigned rows, unsigned cols, unsigned common) const;
+    
+    /**
+     * Split C into a grid of balanced blocks
+     *
+     * Block sizes along each dimension differ by at most one, so
+     * non-divisible dimensions leave no PE with more than one extra row or
+     * column. PE bi * gridCols + bj owns block (bi, bj).
+     *
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param gridRows Blocks along the rows, at most rows
+     * @param gridCols Blocks along the columns, at most cols
+     * @return Schedule without cost
+     */
+    static PESchedule partition(unsigned rows, unsigned cols, unsigned gridRows, unsigned gridCols);
+    
+    /**
+     * Estimate the cycles of a schedule
+     *
+     * Every PE issues one instruction per cycle, so the slowest stream
+     * bounds the run; the host link is shared, so the A and B words loaded
+     * by all streams bound it as well. Replicated operands (B for row
+     * blocks, A for column blocks) are paid for on the link.
+     *
+     * @param schedule Schedule to evaluate
+     * @param common Common dimension
+     * @return Estimated cycles
+     */
+    double estimateCost(const PESchedule& schedule, unsigned common) const;
+
+private:
+    CompilerConfig config;
+    
+    /**
+     * Check whether the largest block fits a PE's local memory and the
+     * address field of the configured ISA version
+     */
+    bool fits(const PESchedule& schedule, unsigned common) const;
+};
+
+#endif // PE_SCHEDULER_H
@@ -4,159 +4,1524 @@
  */
 
 #include "PIMBackend.h"
+#include "RegisterAllocator.h"
+#include "MatrixShapeAnalysis.h"
+#include "LayoutPlanner.h"
+#include "PEScheduler.h"
+#include "AutoTuner.h"
 #include "../utils/Logger.h"
+#include "../utils/TimeProfiler.h"
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdexcept>
 
-PIMBackend::PIMBackend() {}
+namespace {
+
+bool isPowerOfTwo(int32_t value) {
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+// Get n of a weight of +-2^n with n > 0, or -1 for any other weight
+int weightShift(int32_t weight) {
+    const uint32_t magnitude = weight < 0 ? 0u - static_cast<uint32_t>(weight) : static_cast<uint32_t>(weight);
+    if (magnitude < 2 || (magnitude & (magnitude - 1)) != 0) {
+        return -1;
+    }
+    int shift = 0;
+    while ((magnitude >> shift) != 1) {
+        shift++;
+    }
+    return shift;
+}
+
+// Get the constant an epilogue operation keeps in a register: the sign
+// shift of RELU, or the factor of SCALE (the shift of a power of two)
+int32_t epilogueConstant(const EpilogueOp& op) {
+    if (op.kind != EpilogueOp::SCALE) {
+        return 31;
+    }
+    int32_t value = op.factor;
+    if (isPowerOfTwo(op.factor)) {
+        for (value = 0; (1 << value) != op.factor; value++) {}
+    }
+    return value;
+}
+
+// Count the registers generateEpilogueConstants allocates
+unsigned epilogueConstantCount(const std::vector<EpilogueOp>& epilogue) {
+    std::set<int32_t> values;
+    for (const auto& op : epilogue) {
+        if (op.kind == EpilogueOp::RELU || (op.kind == EpilogueOp::SCALE && op.factor != 1)) {
+            values.insert(epilogueConstant(op));
+        }
+    }
+    if (values.empty()) {
+        return 0;
+    }
+    return static_cast<unsigned>(values.size()) + (values.count(1) ? 0 : 1);
+}
+
+// Pack the logical common x cols values of a constant B into the words the
+// host LOADs of B deliver, lanes elements along k per word
+PIMConstantMatrix packWeights(const std::vector<int32_t>& weights, unsigned common, unsigned cols,
+                              unsigned lanes, unsigned precision) {
+    PIMConstantMatrix matrix;
+    matrix.rows = (common + lanes - 1) / lanes;
+    matrix.cols = cols;
+    matrix.words.assign(static_cast<size_t>(matrix.rows) * cols, 0);
+    const uint32_t mask = precision < 32 ? (1u << precision) - 1 : ~0u;
+    for (unsigned k = 0; k < common; k++) {
+        for (unsigned j = 0; j < cols; j++) {
+            uint32_t element = static_cast<uint32_t>(weights[static_cast<size_t>(k) * cols + j]) & mask;
+            matrix.words[static_cast<size_t>(k / lanes) * cols + j] |= element << ((k % lanes) * precision);
+        }
+    }
+    return matrix;
+}
+
+// Build a constant in a register from a register holding 1: shift in the
+// bits of the magnitude from the top, then negate
+void emitConstant(InstructionSink& sink, PIMRegister dest, int32_t value, PIMRegister one, PIMRegister scratch) {
+    const uint32_t magnitude = value < 0 ? 0u - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+    sink.emit(PIMInstruction(PIM_XOR, dest, dest, dest, 0));
+    bool started = false;
+    for (int bit = 31; bit >= 0; bit--) {
+        if (started) {
+            sink.emit(PIMInstruction(PIM_SHL, dest, dest, one, 0));
+        }
+        if ((magnitude >> bit) & 1) {
+            sink.emit(PIMInstruction(PIM_ADD, dest, dest, one, 0));
+            started = true;
+        }
+    }
+    if (value < 0) {
+        sink.emit(PIMInstruction(PIM_XOR, scratch, scratch, scratch, 0));
+        sink.emit(PIMInstruction(PIM_SUB, dest, scratch, dest, 0));
+    }
+}
+
+} // namespace
+
+PIMBackend::PIMBackend() : config(CompilerConfig::getDefaultConfig()) {}
+
+PIMBackend::PIMBackend(const CompilerConfig& config) : config(config) {}
 
 PIMBackend::~PIMBackend() = default;
 
 std::vector<PIMInstruction> PIMBackend::generatePIMInstructions(std::unique_ptr<llvm::Module>& module) {
-    Logger::getInstance().log("Starting PIM instruction generation");
-    
     std::vector<PIMInstruction> instructions;
+    VectorInstructionSink sink(instructions);
+    generatePIMInstructions(module, sink);
+    return instructions;
+}
+
+size_t PIMBackend::generatePIMInstructions(std::unique_ptr<llvm::Module>& module, InstructionSink& sink) {
+    MatrixShapeAnalysis shapeAnalysis(config);
+    ShapeAnalysisResult shapes = shapeAnalysis.analyze(*module);
+    ResidencyPlan residency = ResidencyPlanner(config).plan(*module, shapes);
+    return generatePIMInstructions(module, shapes, sink, &residency);
+}
+
+size_t PIMBackend::generatePIMInstructions(std::unique_ptr<llvm::Module>& module,
+                                           const ShapeAnalysisResult& shapes,
+                                           InstructionSink& sink,
+                                           const ResidencyPlan* residency) {
+    PIM_LOG_INFO("Starting PIM instruction generation");
+    
+    size_t start = sink.getCount();
     
     // Process each function in the module
     for (auto& function : module->functions()) {
-        // Skip declarations without definitions
-        if (function.isDeclaration()) {
-            continue;
+        generateFunctionInstructions(function, shapes, sink, residency);
+    }
+    
+    size_t generated = sink.getCount() - start;
+    PIM_LOG_INFO("Generated " + std::to_string(generated) + " PIM instructions");
+    return generated;
+}
+
+size_t PIMBackend::generateFunctionInstructions(llvm::Function& function,
+                                                const ShapeAnalysisResult& shapes,
+                                                InstructionSink& sink,
+                                                const ResidencyPlan* residency) {
+    // Skip declarations without definitions
+    if (function.isDeclaration()) {
+        return 0;
+    }
+    
+    const KernelShape* shape = shapes.lookup(function.getName().str());
+    if (!shape) {
+        PIM_LOG_INFO("Skipping function without a matrix multiplication: " +
+                    function.getName().str());
+        return 0;
+    }
+    
+    size_t start = sink.getCount();
+    PIM_LOG_INFO("Processing function: " + function.getName().str());
+    ScopedTimer timer("Kernel lowering", function.getName().str());
+    
+    // Kernels of a linked program bind their host operands with a marker
+    const KernelResidency* kernel = residency ? residency->lookup(function.getName().str()) : nullptr;
+    if (kernel) {
+        sink.emit(PIMInstruction(PIM_CONFIG, PIM_CONFIG_KERNEL, kernel->index, 0, 0));
+    }
+    
+    generateKernelInstructions(*shape, sink, kernel);
+    return sink.getCount() - start;
+}
+
+size_t PIMBackend::generateShardedInstructions(const ShapeAnalysisResult& shapes, const ShardPlan& plan,
+                                               InstructionSink& sink) {
+    PIM_LOG_INFO("Starting PIM instruction generation for " + std::to_string(plan.devices) + " devices");
+    
+    size_t start = sink.getCount();
+    for (unsigned device = 0; device < plan.devices; device++) {
+        sink.emit(PIMInstruction(PIM_CONFIG, PIM_CONFIG_DEVICE, device, 0, 0));
+        for (const auto& kernel : plan.kernels) {
+            const DeviceShard* shard = kernel.shardOf(device);
+            const KernelShape* shape = shapes.lookup(kernel.function);
+            if (!shard || !shape) {
+                continue;
+            }
+            
+            PIM_LOG_INFO("Processing shard of " + kernel.function + " on device " + std::to_string(device));
+            ScopedTimer timer("Kernel lowering", kernel.function);
+            sink.emit(PIMInstruction(PIM_CONFIG, PIM_CONFIG_KERNEL, kernel.index, 0, 0));
+            generateKernelInstructions(ShardPlanner::shardShape(*shape, *shard), sink);
         }
-        
-        Logger::getInstance().log("Processing function: " + function.getName().str());
-        processMatrixMultiplyFunction(&function, instructions);
     }
     
-    Logger::getInstance().log("Generated " + std::to_string(instructions.size()) + " PIM instructions");
-    return instructions;
+    size_t generated = sink.getCount() - start;
+    PIM_LOG_INFO("Generated " + std::to_string(generated) + " PIM instructions");
+    return generated;
 }
 
-void PIMBackend::processMatrixMultiplyFunction(llvm::Function* function, std::vector<PIMInstruction>& instructions) {
-    // Analyze the function to determine matrix dimensions
-    // In a real implementation, we would extract this from the IR
-    // For simplicity, we're using fixed dimensions in this example
+void PIMBackend::generateKernelInstructions(const KernelShape& shape, InstructionSink& sink,
+                                            const KernelResidency* residency) {
+    // Symbolic programs take any size at launch
+    const unsigned limit = config.archParams.matrixDimLimit;
+    if (!config.symbolicDimensions && std::max({shape.rows, shape.cols, shape.common}) > limit) {
+        throw std::runtime_error("A " + std::to_string(shape.rows) + "x" + std::to_string(shape.cols) + "x" +
+                                 std::to_string(shape.common) + " kernel exceeds the matrix dimension limit of " +
+                                 std::to_string(limit) + " of one PIM device; shard it with --devices");
+    }
     
-    unsigned rows = 2;
-    unsigned cols = 2;
-    unsigned common = 2;
+    // Tuned kernels are never resident (see planLinkedLayout)
+    if (config.tuning.enabled && !config.symbolicDimensions) {
+        CompilerConfig tuned = config;
+        tuned.tuning.enabled = false;
+        AutoTuner(tuned).tune(shape).apply(tuned);
+        PIMBackend(tuned).generateKernelInstructions(shape, sink);
+        return;
+    }
     
-    Logger::getInstance().log("Matrix dimensions: " + std::to_string(rows) + "x" + 
-                             std::to_string(common) + " * " + std::to_string(common) + "x" + 
-                             std::to_string(cols));
+    // Symbolic programs address the matrices through registers and contain
+    // jumps, so only fixed-size programs are coalesced
+    if (config.coalesceTransfers && config.isaVersion >= PIMEncoding::V2 && !config.symbolicDimensions) {
+        unsigned maxBurst = PIMBlockOperand::maxCount(PIMEncoding::operandLimit(config.isaVersion));
+        CoalescingInstructionSink coalescer(sink, maxBurst);
+        processMatrixMultiplyFunction(shape, coalescer, residency);
+        coalescer.finish();
+        PIM_LOG_INFO("Coalesced " + std::to_string(coalescer.getMergedCount()) + " host transfers into " +
+                    std::to_string(coalescer.getBlockCount()) + " block transfers");
+    } else {
+        processMatrixMultiplyFunction(shape, sink, residency);
+    }
+}
+
+bool PIMBackend::planLinkedLayout(const KernelShape& shape, LayoutPlan& layout, unsigned& vectorWords) {
+    hostTransposeA = shape.transposeA;
+    hostTransposeB = shape.transposeB;
+    vectorKernel = shape.isGemv();
+    epilogue = shape.epilogue;
+    sparsity = shape.sparsity;
+    if (config.symbolicDimensions || config.tuning.enabled || config.scheduling.enabled ||
+        LayoutPlanner(config).lanesPerWord() != 1 || !shape.isPlainGemm() ||
+        shouldTile(shape.rows, shape.cols, shape.common)) {
+        return false;
+    }
     
-    // Generate instructions for each phase of matrix multiplication
+    // The same folding processMatrixMultiplyFunction applies, so B is compressed alike
+    foldedWeights.clear();
+    weightShifts.clear();
+    KernelShape planned = shape;
+    if (config.foldConstantWeights && !shape.weights.empty() && planWeightFolding(shape) > 0) {
+        planned.sparsity = sparsity;
+    }
+    layout = planUntiledLayout(planned);
+    vectorWords = epilogueVectorWords(epilogue.size(), shape.rows, shape.cols);
+    return true;
+}
+
+LayoutPlan PIMBackend::planUntiledLayout(const KernelShape& planned) const {
+    const unsigned lanes = LayoutPlanner(config).lanesPerWord();
+    LayoutPlan layout = LayoutPlanner(config).plan(planned);
+    const unsigned vectorWords = epilogueVectorWords(epilogue.size(), planned.rows, planned.cols);
+    if (layout.footprint() + vectorWords > PIMEncoding::operandLimit(config.isaVersion)) {
+        layout = LayoutPlanner::contiguousLayout(planned.rows, planned.cols, planned.common, lanes,
+                                                 hostTransposeA, hostTransposeB);
+        LayoutPlanner::compress(layout.b, sparsity);
+        layout.c.base = layout.b.base + layout.b.size();
+    }
+    return layout;
+}
+
+void PIMBackend::processMatrixMultiplyFunction(const KernelShape& shape, InstructionSink& sink,
+                                               const KernelResidency* residency) {
+    LayoutPlanner layoutPlanner(config);
+    const unsigned lanes = layoutPlanner.lanesPerWord();
     
-    // 1. Load matrices into PIM memory
-    generateMatrixLoadInstructions(instructions, rows, cols, common);
+    if (config.isaVersion >= PIMEncoding::V2) {
+        PIM_LOG_INFO("Using ISA version " + std::to_string(config.isaVersion) +
+                    " (64-bit encoding, MAC and block transfers)");
+    }
+    
+    if (config.symbolicDimensions) {
+        if (lanes > 1) {
+            throw std::runtime_error(std::to_string(config.precision) +
+                                     "-bit precision is not supported with symbolic dimensions");
+        }
+        if (!shape.isPlainGemm() || !shape.epilogue.empty()) {
+            throw std::runtime_error("Batched, transposed and fused kernels are not supported with symbolic dimensions");
+        }
+        PIM_LOG_INFO("Using symbolic matrix dimensions from the launch block");
+        generateSymbolicMatrixMultiplyInstructions(sink);
+        return;
+    }
+    
+    unsigned rows = shape.rows;
+    unsigned cols = shape.cols;
+    unsigned common = shape.common;
+    hostTransposeA = shape.transposeA;
+    hostTransposeB = shape.transposeB;
+    vectorKernel = shape.isGemv();
+    epilogue = shape.epilogue;
+    sparsity = shape.sparsity;
+    const bool linked = residency && residency->resident;
+    residentA = linked && residency->residentA;
+    residentB = linked && residency->residentB;
+    
+    PIM_LOG_INFO("Matrix dimensions: " + std::to_string(rows) + "x" + 
+                std::to_string(common) + " * " + std::to_string(common) + "x" + 
+                std::to_string(cols));
+    
+    if (!epilogue.empty()) {
+        PIM_LOG_INFO("Fusing epilogue: " + shape.describeEpilogue());
+    }
+    if (sparsity.isSparse()) {
+        PIM_LOG_INFO("Skipping the zeros of B (" + sparsity.describe() + ")");
+    }
+    
+    // Narrow elements are packed along the common dimension, so every MUL
+    // multiplies lanes pairs and the k loops count words
+    if (lanes > 1) {
+        PIM_LOG_INFO("Packing " + std::to_string(lanes) + " " + std::to_string(config.precision) +
+                    "-bit elements per word");
+        sink.emit(PIMInstruction(PIM_CONFIG, PIM_CONFIG_PRECISION, config.precision, lanes, 0));
+        
+        // MUL of packed words is a dot product of the lanes
+        for (const auto& op : epilogue) {
+            if (op.kind == EpilogueOp::SCALE && op.factor != 1 && !isPowerOfTwo(op.factor)) {
+                throw std::runtime_error("Scaling by " + std::to_string(op.factor) + " is not supported with " +
+                                         std::to_string(config.precision) + "-bit precision");
+            }
+        }
+    }
+    unsigned commonWords = (common + lanes - 1) / lanes;
+    
+    // Host transfers of transposed operands use stored coordinates
+    if (hostTransposeA || hostTransposeB) {
+        unsigned flags = (hostTransposeA ? PIM_HOST_TRANSPOSE_A : 0) | (hostTransposeB ? PIM_HOST_TRANSPOSE_B : 0);
+        sink.emit(PIMInstruction(PIM_CONFIG, PIM_CONFIG_HOST_LAYOUT, flags, 0, 0));
+    }
     
-    // 2. Perform matrix multiplication
-    generateMatrixMultiplyInstructions(instructions, rows, cols, common);
+    // A constant B travels in the data section of the program, unless an
+    // earlier kernel left it in PIM memory
+    const bool constantB = config.foldConstantWeights && !shape.weights.empty();
+    if (constantB && !residentB) {
+        size_t index = sink.emitData(packWeights(shape.weights, common, cols, lanes, config.precision));
+        sink.emit(PIMInstruction(PIM_CONFIG, PIM_CONFIG_CONSTANT_B, static_cast<unsigned>(index + 1), 0, 0));
+    }
+    
+    const bool tiled = shouldTile(rows, cols, commonWords);
+    
+    // Products by +-1 and +-2^n of a constant B become adds and shifts of A,
+    // so only the other words of B are loaded and multiplied
+    foldedWeights.clear();
+    weightShifts.clear();
+    KernelShape planned = shape;
+    if (constantB && !tiled && lanes == 1) {
+        unsigned folded = planWeightFolding(shape);
+        if (folded > 0) {
+            planned.sparsity = sparsity;
+            PIM_LOG_INFO("Folding " + std::to_string(folded) + " of " +
+                        std::to_string(folded + sparsity.nonzeros()) + " products of constant B");
+        }
+    }
     
-    // 3. Store result
-    generateStoreResultInstructions(instructions, rows, cols);
+    // Products that fit a PE's local memory run concurrently, one per PE stream
+    if (shape.batch > 1 && !tiled && config.scheduling.enabled &&
+        LayoutPlanner::contiguousLayout(rows, cols, common, lanes).footprint() <= scratchWordsPerPE()) {
+        const unsigned numPEs = std::max(config.archParams.numProcessingElements, 1u);
+        PIM_LOG_INFO("Distributing " + std::to_string(shape.batch) + " products over " +
+                    std::to_string(std::min(shape.batch, numPEs)) + " PE streams");
+        for (unsigned b0 = 0; b0 < shape.batch; b0 += numPEs) {
+            PESchedule section;
+            for (unsigned b = b0; b < std::min(shape.batch, b0 + numPEs); b++) {
+                PEBlock block;
+                block.pe = b - b0;
+                block.rows = rows;
+                block.cols = cols;
+                block.batch = b;
+                section.blocks.push_back(block);
+            }
+            generateScheduledMatrixMultiplyInstructions(sink, section, common);
+        }
+        return;
+    }
+    
+    // Otherwise the products run one after another
+    TileShape tile;
+    if (tiled) {
+        tile = computeTileShape(rows, cols, commonWords);
+        PIM_LOG_INFO("Using tiled code generation with " + std::to_string(tile.rows) + "x" +
+                    std::to_string(tile.cols) + " tiles, depth " + std::to_string(tile.depth));
+    }
+    
+    // Distribute C over per-PE instruction streams
+    PESchedule schedule;
+    if (!tiled && config.scheduling.enabled) {
+        PEScheduler scheduler(config);
+        scheduler.report(rows, cols, common);
+        schedule = scheduler.schedule(rows, cols, common);
+        PIM_LOG_INFO("Chosen schedule: " + schedule.describe() + " (estimated " +
+                    std::to_string(static_cast<unsigned long>(schedule.cost)) + " cycles)");
+    }
+    
+    // Place A, B and C across the memory banks; the bias vectors follow them.
+    // A resident kernel of a linked program takes the placement planned for it
+    LayoutPlan layout = tiled ? layoutPlanner.plan(planned) : planUntiledLayout(planned);
+    if (linked) {
+        layout = residency->layout;
+        PIM_LOG_INFO("Linked placement: " + layout.describe() + (residentA ? ", A resident" : "") +
+                    (residentB ? ", B resident" : "") + (residency->storeC ? "" : ", C kept in PIM memory"));
+    }
+    
+    for (unsigned b = 0; b < shape.batch; b++) {
+        if (shape.batch > 1) {
+            sink.emit(PIMInstruction(PIM_CONFIG, PIM_CONFIG_BATCH, b, 0, 0));
+        }
+    
+        if (tiled) {
+            generateTiledMatrixMultiplyInstructions(sink, rows, cols, commonWords, tile);
+            continue;
+        }
+    
+        if (config.scheduling.enabled) {
+            for (auto& block : schedule.blocks) {
+                block.batch = b;
+            }
+            generateScheduledMatrixMultiplyInstructions(sink, schedule, common);
+            continue;
+        }
+    
+        // Generate instructions for each phase of matrix multiplication
+    
+        // Matrix size header
+        sink.emit(PIMInstruction(PIM_CONFIG, 0, layout.a.size(), 0, 0));
+        sink.emit(PIMInstruction(PIM_CONFIG, 1, layout.b.size(), 0, 0));
+        sink.emit(PIMInstruction(PIM_CONFIG, 2, layout.c.size(), 0, 0));
+        
+        // 1. Load matrices into PIM memory
+        generateMatrixLoadInstructions(sink, layout);
+        
+        // 2. Perform matrix multiplication
+        generateMatrixMultiplyInstructions(sink, layout);
+        
+        // 3. Store result, unless only later kernels read it from PIM memory
+        if (!linked || residency->storeC) {
+            generateStoreResultInstructions(sink, layout);
+        }
+    }
+    
+    if (constantB && !residentB) {
+        sink.emit(PIMInstruction(PIM_CONFIG, PIM_CONFIG_CONSTANT_B, 0, 0, 0));
+    }
 }
 
-void PIMBackend::generateMatrixLoadInstructions(std::vector<PIMInstruction>& instructions, 
-                                               unsigned rows, unsigned cols, unsigned common) {
-    Logger::getInstance().log("Generating matrix load instructions");
+PIMInstruction PIMBackend::hostLoad(unsigned dest, unsigned buffer, unsigned row, unsigned col,
+                                    unsigned count, unsigned axis) const {
+    const bool transposed = (buffer == PIM_HOST_A && hostTransposeA) || (buffer == PIM_HOST_B && hostTransposeB);
+    if (transposed) {
+        std::swap(row, col);
+        axis = (axis == PIM_BLOCK_ALONG_ROW) ? PIM_BLOCK_DOWN_COLUMN : PIM_BLOCK_ALONG_ROW;
+    }
+    if (count == 0) {
+        return PIMInstruction(PIM_LOAD, dest, buffer, row, col);
+    }
+    return PIMInstruction(PIM_LOAD_BLOCK, dest, PIMBlockOperand::encode(buffer, count, axis), row, col);
+}
+
+void PIMBackend::generateMatrixLoadInstructions(InstructionSink& sink, const LayoutPlan& layout,
+                                                unsigned rowOrigin, unsigned colOrigin) {
+    PIM_LOG_INFO("Generating matrix load instructions");
+    ScopedTimer timer("Load generation");
     
-    // Configure the PIM array size
-    instructions.push_back(PIMInstruction(PIM_CONFIG, 0, rows*common, 0, 0));
-    instructions.push_back(PIMInstruction(PIM_CONFIG, 1, common*cols, 0, 0));
-    instructions.push_back(PIMInstruction(PIM_CONFIG, 2, rows*cols, 0, 0));
+    // Packed A and B are loaded a word (lanes elements along k) at a time
+    const unsigned rows = layout.a.rows;
+    const unsigned cols = layout.b.cols;
+    const unsigned common = layout.a.wordCols();
     
-    // Load matrix A (rows x common)
-    for (unsigned i = 0; i < rows; i++) {
-        for (unsigned k = 0; k < common; k++) {
-            // LOAD instruction: opcode = PIM_LOAD, dest = matrix A offset + i*common + k, src = host memory address
-            instructions.push_back(PIMInstruction(PIM_LOAD, 
-                                                 (i * common + k),             // destination PIM address
-                                                 0,                            // src (host memory offset, would be actual address)
-                                                 i,                            // row
-                                                 k));                          // col
+    // Load matrices A (rows x common) and B (common x cols) in the order of
+    // their layouts, so consecutive LOADs fill consecutive words
+    // A column of A is needed only where its row of B has a stored word
+    std::vector<bool> usedK(common, true);
+    for (unsigned k = 0; k < common && layout.b.isCompressed(); k++) {
+        usedK[k] = false;
+        for (unsigned j = 0; j < cols && !usedK[k]; j++) {
+            usedK[k] = layout.b.isStored(k, j) || foldedWeight(k, colOrigin + j) != 0;
         }
     }
     
-    // Load matrix B (common x cols)
-    for (unsigned k = 0; k < common; k++) {
-        for (unsigned j = 0; j < cols; j++) {
-            // LOAD instruction: opcode = PIM_LOAD, dest = matrix B offset + k*cols + j, src = host memory address
-            instructions.push_back(PIMInstruction(PIM_LOAD, 
-                                                 rows*common + (k * cols + j), // destination PIM address
-                                                 0,                            // src (host memory offset, would be actual address)
-                                                 k,                            // row
-                                                 j));                          // col
+    const bool aColumnMajor = layout.a.columnMajor;
+    for (unsigned outer = 0; outer < (aColumnMajor ? common : rows) && !residentA; outer++) {
+        for (unsigned inner = 0; inner < (aColumnMajor ? rows : common); inner++) {
+            unsigned i = aColumnMajor ? inner : outer;
+            unsigned k = aColumnMajor ? outer : inner;
+            if (!usedK[k]) {
+                continue;
+            }
+            // LOAD instruction: opcode = PIM_LOAD, dest = PIM address of A[i][k], src = host matrix A
+            sink.emit(hostLoad(layout.a.addressOf(i, k), PIM_HOST_A, rowOrigin + i, k));
+        }
+    }
+    
+    const bool columnMajor = layout.b.columnMajor;
+    for (unsigned outer = 0; outer < (columnMajor ? cols : common) && !residentB; outer++) {
+        for (unsigned inner = 0; inner < (columnMajor ? common : cols); inner++) {
+            unsigned k = columnMajor ? inner : outer;
+            unsigned j = columnMajor ? outer : inner;
+            if (!layout.b.isStored(k, j)) {
+                continue;
+            }
+            // LOAD instruction: opcode = PIM_LOAD, dest = PIM address of B[k][j], src = host matrix B
+            sink.emit(hostLoad(layout.b.addressOf(k, j), PIM_HOST_B, k, colOrigin + j));
+        }
+    }
+    
+    // Bias vectors of the epilogue, restricted to the rows or columns of the layout
+    for (size_t index = 0; index < epilogue.size(); index++) {
+        const EpilogueOp& op = epilogue[index];
+        if (!op.isBias()) {
+            continue;
+        }
+        const bool byRow = op.kind == EpilogueOp::BIAS_ROW;
+        const unsigned base = layout.footprint() + epilogueVectorWords(index, rows, cols);
+        for (unsigned e = 0; e < (byRow ? rows : cols); e++) {
+            sink.emit(PIMInstruction(PIM_LOAD, base + e, byRow ? PIM_HOST_ROW_VECTOR : PIM_HOST_COL_VECTOR,
+                                     op.operand, (byRow ? rowOrigin : colOrigin) + e));
         }
     }
     
+    // The matrix-vector product overwrites C without reading it
+    if (vectorKernel && config.enableRegisterAllocation) {
+        return;
+    }
+    
     // Initialize matrix C (rows x cols) to zeros
     for (unsigned i = 0; i < rows; i++) {
         for (unsigned j = 0; j < cols; j++) {
-            // LOAD instruction with zero value: opcode = PIM_LOAD, dest = matrix C offset + i*cols + j, src = 0
-            instructions.push_back(PIMInstruction(PIM_LOAD, 
-                                                 rows*common + common*cols + (i * cols + j), // destination PIM address
-                                                 0,                                          // src (zero)
-                                                 i,                                          // row
-                                                 j));                                        // col
+            // LOAD instruction with zero value: opcode = PIM_LOAD, dest = PIM address of C[i][j], src = 0
+            sink.emit(PIMInstruction(PIM_LOAD, 
+                                       layout.c.addressOf(i, j),     // destination PIM address
+                                       PIM_HOST_ZERO,                // src (zero)
+                                       rowOrigin + i,                // row
+                                       colOrigin + j));              // col
+        }
+    }
+}
+
+void PIMBackend::generateMatrixMultiplyInstructions(InstructionSink& sink, const LayoutPlan& layout,
+                                                    unsigned colOrigin) {
+    PIM_LOG_INFO("Generating matrix multiply instructions");
+    ScopedTimer timer("Multiply generation");
+    
+    if (!config.enableRegisterAllocation) {
+        generateUnallocatedMatrixMultiplyInstructions(sink, layout, colOrigin);
+        return;
+    }
+    
+    if (vectorKernel) {
+        generateMatrixVectorMultiplyInstructions(sink, layout);
+        return;
+    }
+    
+    const unsigned rows = layout.a.rows;
+    const unsigned cols = layout.b.cols;
+    const unsigned common = layout.a.wordCols();
+    const bool fusedMultiplyAdd = config.isaVersion >= PIMEncoding::V2;
+    
+    // Two operand registers; the product overwrites the B operand and every
+    // remaining register holds a C accumulator that stays live across the k loop
+    RegisterAllocator registers(config.archParams.registerFileSize);
+    if (registers.capacity() < 3) {
+        throw std::runtime_error("Matrix multiplication needs at least 3 PIM registers");
+    }
+    
+    PIMRegister aReg = registers.allocate();
+    PIMRegister bReg = registers.allocate();
+    EpilogueRegisters constants = generateEpilogueConstants(sink, registers, aReg);
+    std::vector<PIMRegister> shifts = generateWeightShifts(sink, registers, bReg, aReg);
+    if (registers.numFree() == 0) {
+        throw std::runtime_error("No PIM register is left for an accumulator after the epilogue constants");
+    }
+    std::vector<PIMRegister> accumulators;
+    while (registers.numFree() > 0 && accumulators.size() < cols) {
+        accumulators.push_back(registers.allocate());
+    }
+    
+    PIM_LOG_INFO("Register blocking with " + std::to_string(accumulators.size()) + " accumulators");
+    
+    const unsigned vectorBase = layout.footprint();
+    std::vector<unsigned> stored;
+    std::vector<std::pair<unsigned, int32_t>> folded;
+    for (unsigned i = 0; i < rows; i++) {
+        for (unsigned j0 = 0; j0 < cols; j0 += accumulators.size()) {
+            unsigned blockCols = std::min(static_cast<unsigned>(accumulators.size()), cols - j0);
+            
+            // Load each C[i][j] of the block once
+            for (unsigned jj = 0; jj < blockCols; jj++) {
+                unsigned c_addr = layout.c.addressOf(i, j0 + jj);
+                sink.emit(PIMInstruction(PIM_MOVE, accumulators[jj], c_addr, 0, PIM_MOVE_TO_REG));
+            }
+            
+            for (unsigned k = 0; k < common; k++) {
+                // Stored words and folded weights of B in row k of the block
+                stored.clear();
+                folded.clear();
+                for (unsigned jj = 0; jj < blockCols; jj++) {
+                    if (layout.b.isStored(k, j0 + jj)) {
+                        stored.push_back(jj);
+                    } else if (int32_t weight = foldedWeight(k, colOrigin + j0 + jj)) {
+                        folded.push_back({jj, weight});
+                    }
+                }
+                if (stored.empty() && folded.empty()) {
+                    continue;
+                }
+                
+                // A[i][k] is shared by the whole block
+                unsigned a_addr = layout.a.addressOf(i, k);
+                sink.emit(PIMInstruction(PIM_MOVE, aReg, a_addr, 0, PIM_MOVE_TO_REG));
+                
+                for (const auto& [jj, weight] : folded) {
+                    emitFoldedProduct(sink, accumulators[jj], aReg, bReg, weight, shifts);
+                }
+                for (unsigned jj : stored) {
+                    unsigned b_addr = layout.b.addressOf(k, j0 + jj);
+                    sink.emit(PIMInstruction(PIM_MOVE, bReg, b_addr, 0, PIM_MOVE_TO_REG));   // Move B[k][j] to bReg
+                    if (fusedMultiplyAdd) {
+                        sink.emit(PIMInstruction(PIM_MAC, accumulators[jj], aReg, bReg, 0)); // acc += A[i][k] * B[k][j]
+                    } else {
+                        sink.emit(PIMInstruction(PIM_MUL, bReg, aReg, bReg, 0));             // bReg = A[i][k] * B[k][j]
+                        sink.emit(PIMInstruction(PIM_ADD, accumulators[jj], accumulators[jj], bReg, 0));
+                    }
+                }
+            }
+            
+            // Apply the epilogue while C[i][j] is in its accumulator
+            for (unsigned jj = 0; jj < blockCols && !epilogue.empty(); jj++) {
+                generateEpilogueInstructions(sink, constants, accumulators[jj], bReg, [&](size_t index) {
+                    bool byRow = epilogue[index].kind == EpilogueOp::BIAS_ROW;
+                    return vectorBase + epilogueVectorWords(index, rows, cols) + (byRow ? i : j0 + jj);
+                });
+            }
+            
+            // Store each C[i][j] of the block once
+            for (unsigned jj = 0; jj < blockCols; jj++) {
+                unsigned c_addr = layout.c.addressOf(i, j0 + jj);
+                sink.emit(PIMInstruction(PIM_MOVE, c_addr, accumulators[jj], 0, PIM_MOVE_TO_MEM));
+            }
         }
     }
 }
 
-void PIMBackend::generateMatrixMultiplyInstructions(std::vector<PIMInstruction>& instructions,
-                                                   unsigned rows, unsigned cols, unsigned common) {
-    Logger::getInstance().log("Generating matrix multiply instructions");
+void PIMBackend::generateMatrixVectorMultiplyInstructions(InstructionSink& sink, const LayoutPlan& layout) {
+    const unsigned rows = layout.a.rows;
+    const unsigned common = layout.a.wordCols();
+    const bool fusedMultiplyAdd = config.isaVersion >= PIMEncoding::V2;
+    
+    // One register holds x[k] for a block of rows, one the A operand and
+    // product, and the rest accumulate y
+    RegisterAllocator registers(config.archParams.registerFileSize);
+    if (registers.capacity() < 3) {
+        throw std::runtime_error("Matrix multiplication needs at least 3 PIM registers");
+    }
+    
+    PIMRegister xReg = registers.allocate();
+    PIMRegister aReg = registers.allocate();
+    EpilogueRegisters constants = generateEpilogueConstants(sink, registers, aReg);
+    std::vector<PIMRegister> shifts = generateWeightShifts(sink, registers, xReg, aReg);
+    if (registers.numFree() == 0) {
+        throw std::runtime_error("No PIM register is left for an accumulator after the epilogue constants");
+    }
+    std::vector<PIMRegister> accumulators;
+    while (registers.numFree() > 0 && accumulators.size() < rows) {
+        accumulators.push_back(registers.allocate());
+    }
+    
+    PIM_LOG_INFO("Matrix-vector product with " + std::to_string(accumulators.size()) + " row accumulators");
+    
+    for (unsigned i0 = 0; i0 < rows; i0 += accumulators.size()) {
+        unsigned blockRows = std::min(static_cast<unsigned>(accumulators.size()), rows - i0);
+        
+        // Clear the accumulators: acc = acc ^ acc
+        for (unsigned ii = 0; ii < blockRows; ii++) {
+            sink.emit(PIMInstruction(PIM_XOR, accumulators[ii], accumulators[ii], accumulators[ii], 0));
+        }
+        
+        for (unsigned k = 0; k < common; k++) {
+            // A folded x[k] scales A[i][k] without a multiply
+            if (int32_t weight = foldedWeight(k, 0)) {
+                for (unsigned ii = 0; ii < blockRows; ii++) {
+                    sink.emit(PIMInstruction(PIM_MOVE, aReg, layout.a.addressOf(i0 + ii, k), 0, PIM_MOVE_TO_REG));
+                    emitFoldedProduct(sink, accumulators[ii], aReg, aReg, weight, shifts);
+                }
+                continue;
+            }
+            if (!layout.b.isStored(k, 0)) {
+                continue;
+            }
+            
+            // x[k] is shared by every row of the block
+            sink.emit(PIMInstruction(PIM_MOVE, xReg, layout.b.addressOf(k, 0), 0, PIM_MOVE_TO_REG));
+            
+            for (unsigned ii = 0; ii < blockRows; ii++) {
+                sink.emit(PIMInstruction(PIM_MOVE, aReg, layout.a.addressOf(i0 + ii, k), 0, PIM_MOVE_TO_REG));
+                if (fusedMultiplyAdd) {
+                    sink.emit(PIMInstruction(PIM_MAC, accumulators[ii], aReg, xReg, 0));  // acc += A[i][k] * x[k]
+                } else {
+                    sink.emit(PIMInstruction(PIM_MUL, aReg, aReg, xReg, 0));              // aReg = A[i][k] * x[k]
+                    sink.emit(PIMInstruction(PIM_ADD, accumulators[ii], accumulators[ii], aReg, 0));
+                }
+            }
+        }
+        
+        for (unsigned ii = 0; ii < blockRows && !epilogue.empty(); ii++) {
+            generateEpilogueInstructions(sink, constants, accumulators[ii], aReg, [&](size_t index) {
+                bool byRow = epilogue[index].kind == EpilogueOp::BIAS_ROW;
+                return layout.footprint() + epilogueVectorWords(index, rows, 1) + (byRow ? i0 + ii : 0);
+            });
+        }
+        
+        for (unsigned ii = 0; ii < blockRows; ii++) {
+            sink.emit(PIMInstruction(PIM_MOVE, layout.c.addressOf(i0 + ii, 0), accumulators[ii], 0, PIM_MOVE_TO_MEM));
+        }
+    }
+}
+
+void PIMBackend::generateUnallocatedMatrixMultiplyInstructions(InstructionSink& sink, const LayoutPlan& layout,
+                                                               unsigned colOrigin) {
+    const unsigned rows = layout.a.rows;
+    const unsigned cols = layout.b.cols;
+    const unsigned common = layout.a.wordCols();
+    const bool fusedMultiplyAdd = config.isaVersion >= PIMEncoding::V2;
     
     // The PIM-specific way to do matrix multiplication
     // In a real PIM architecture, we'd use specialized matrix operations
     
-    // Calculate C = A * B
+    // Registers 0 to 3 are fixed; the epilogue constants take the next ones
+    RegisterAllocator registers(config.archParams.registerFileSize);
+    for (unsigned reg = 0; reg < 4 && registers.numFree() > 0; reg++) {
+        registers.allocate();
+    }
+    EpilogueRegisters constants = generateEpilogueConstants(sink, registers, PIM_REG2);
+    
+    // Calculate C = A * B, reloading and spilling C[i][j] on every MAC
     for (unsigned i = 0; i < rows; i++) {
         for (unsigned j = 0; j < cols; j++) {
             for (unsigned k = 0; k < common; k++) {
+                // Weights of +-1 add or subtract A[i][k]
+                if (int32_t weight = foldedWeight(k, colOrigin + j)) {
+                    unsigned c_addr = layout.c.addressOf(i, j);
+                    sink.emit(PIMInstruction(PIM_MOVE, 0, layout.a.addressOf(i, k), 0, PIM_MOVE_TO_REG));
+                    sink.emit(PIMInstruction(PIM_MOVE, 3, c_addr, 0, PIM_MOVE_TO_REG));
+                    emitFoldedProduct(sink, PIM_REG3, PIM_REG0, PIM_REG2, weight, {});
+                    sink.emit(PIMInstruction(PIM_MOVE, c_addr, 3, 0, PIM_MOVE_TO_MEM));
+                    continue;
+                }
+                if (!layout.b.isStored(k, j)) {
+                    continue;
+                }
+                
                 // Address calculations
-                unsigned a_addr = i * common + k;
-                unsigned b_addr = rows*common + k * cols + j;
-                unsigned c_addr = rows*common + common*cols + i * cols + j;
+                unsigned a_addr = layout.a.addressOf(i, k);
+                unsigned b_addr = layout.b.addressOf(k, j);
+                unsigned c_addr = layout.c.addressOf(i, j);
                 
                 // Load values from A and B into registers
-                instructions.push_back(PIMInstruction(PIM_MOVE, 0, a_addr, 0, 0));   // Move A[i][k] to Reg0
-                instructions.push_back(PIMInstruction(PIM_MOVE, 1, b_addr, 0, 0));   // Move B[k][j] to Reg1
-                
-                // Multiply A[i][k] * B[k][j]
-                instructions.push_back(PIMInstruction(PIM_MUL, 2, 0, 1, 0));         // Reg2 = Reg0 * Reg1
+                sink.emit(PIMInstruction(PIM_MOVE, 0, a_addr, 0, PIM_MOVE_TO_REG));   // Move A[i][k] to Reg0
+                sink.emit(PIMInstruction(PIM_MOVE, 1, b_addr, 0, PIM_MOVE_TO_REG));   // Move B[k][j] to Reg1
                 
-                // Add to C[i][j]
-                instructions.push_back(PIMInstruction(PIM_MOVE, 3, c_addr, 0, 0));   // Move C[i][j] to Reg3
-                instructions.push_back(PIMInstruction(PIM_ADD, 3, 3, 2, 0));         // Reg3 = Reg3 + Reg2
+                if (fusedMultiplyAdd) {
+                    sink.emit(PIMInstruction(PIM_MOVE, 3, c_addr, 0, PIM_MOVE_TO_REG));   // Move C[i][j] to Reg3
+                    sink.emit(PIMInstruction(PIM_MAC, 3, 0, 1, 0));     // Reg3 = Reg3 + Reg0 * Reg1
+                } else {
+                    // Multiply A[i][k] * B[k][j]
+                    sink.emit(PIMInstruction(PIM_MUL, 2, 0, 1, 0));         // Reg2 = Reg0 * Reg1
+                    
+                    // Add to C[i][j]
+                    sink.emit(PIMInstruction(PIM_MOVE, 3, c_addr, 0, PIM_MOVE_TO_REG));   // Move C[i][j] to Reg3
+                    sink.emit(PIMInstruction(PIM_ADD, 3, 3, 2, 0));         // Reg3 = Reg3 + Reg2
+                }
                 
                 // Store result back to C[i][j]
-                instructions.push_back(PIMInstruction(PIM_MOVE, c_addr, 3, 0, 0));   // Move Reg3 to C[i][j]
+                sink.emit(PIMInstruction(PIM_MOVE, c_addr, 3, 0, PIM_MOVE_TO_MEM));   // Move Reg3 to C[i][j]
+            }
+            
+            // Apply the epilogue to the finished C[i][j]
+            if (!epilogue.empty()) {
+                unsigned c_addr = layout.c.addressOf(i, j);
+                sink.emit(PIMInstruction(PIM_MOVE, 3, c_addr, 0, PIM_MOVE_TO_REG));
+                generateEpilogueInstructions(sink, constants, PIM_REG3, PIM_REG2, [&](size_t index) {
+                    bool byRow = epilogue[index].kind == EpilogueOp::BIAS_ROW;
+                    return layout.footprint() + epilogueVectorWords(index, rows, cols) + (byRow ? i : j);
+                });
+                sink.emit(PIMInstruction(PIM_MOVE, c_addr, 3, 0, PIM_MOVE_TO_MEM));
             }
         }
     }
 }
 
-void PIMBackend::generateStoreResultInstructions(std::vector<PIMInstruction>& instructions,
-                                                unsigned rows, unsigned cols) {
-    Logger::getInstance().log("Generating store result instructions");
+void PIMBackend::generateStoreResultInstructions(InstructionSink& sink, const LayoutPlan& layout,
+                                                 unsigned rowOrigin, unsigned colOrigin) {
+    PIM_LOG_INFO("Generating store result instructions");
+    ScopedTimer timer("Store generation");
     
-    // Store matrix C (rows x cols) back to host memory
-    unsigned c_offset = rows*cols + cols*cols;
+    const unsigned rows = layout.c.rows;
+    const unsigned cols = layout.c.cols;
     
+    // Store matrix C (rows x cols) back to host memory
     for (unsigned i = 0; i < rows; i++) {
         for (unsigned j = 0; j < cols; j++) {
             // Get address of C[i][j]
-            unsigned c_addr = rows*cols + cols*cols + i * cols + j;
+            unsigned c_addr = layout.c.addressOf(i, j);
+            
+            // STORE instruction: opcode = PIM_STORE, dest = host matrix C, src = C[i][j] PIM address
+            sink.emit(PIMInstruction(PIM_STORE, 
+                                       PIM_HOST_C,       // destination host buffer
+                                       c_addr,           // src PIM address
+                                       rowOrigin + i,    // row
+                                       colOrigin + j));  // col
+        }
+    }
+}
+
+void PIMBackend::generateScheduledMatrixMultiplyInstructions(InstructionSink& sink, const PESchedule& schedule,
+                                                            unsigned common) {
+    PIM_LOG_INFO("Generating PE stream instructions");
+    
+    // Every PE computes its block of C from private copies of the A rows and
+    // B columns it needs, laid out contiguously in its local memory
+    const unsigned lanes = LayoutPlanner(config).lanesPerWord();
+    for (const auto& block : schedule.blocks) {
+        LayoutPlan layout = LayoutPlanner::contiguousLayout(block.rows, block.cols, common, lanes,
+                                                            hostTransposeA, hostTransposeB);
+        LayoutPlanner::compress(layout.b, sparsity, block.col);
+        layout.c.base = layout.b.base + layout.b.size();
+        if (layout.footprint() + epilogueVectorWords(epilogue.size(), block.rows, block.cols) > scratchWordsPerPE()) {
+            throw std::runtime_error("The epilogue vectors of a " + std::to_string(block.rows) + "x" +
+                                     std::to_string(block.cols) + " block do not fit the PE memory");
+        }
+        sink.emit(PIMInstruction(PIM_CONFIG, PIM_CONFIG_PE_STREAM, block.pe, block.batch, 0));
+        generateMatrixLoadInstructions(sink, layout, block.row, block.col);
+        generateMatrixMultiplyInstructions(sink, layout, block.col);
+        generateStoreResultInstructions(sink, layout, block.row, block.col);
+    }
+    
+    // C is complete once every stream has stored its block
+    sink.emit(PIMInstruction(PIM_SYNC, 0, 0, 0, 0));
+}
+
+PIMBackend::TileShape PIMBackend::computeTileShape(unsigned rows, unsigned cols, unsigned common) const {
+    const auto& arch = config.archParams;
+    const auto& tiling = config.tiling;
+    unsigned numPEs = std::max(arch.numProcessingElements, 1u);
+    
+    TileShape tile;
+    
+    // Columns per tile: the largest power of two whose square fits in the PE array,
+    // so tiles stay close to square and edge tiles waste few PEs
+    tile.cols = tiling.tileCols;
+    if (tile.cols == 0) {
+        tile.cols = 1;
+        while ((tile.cols * 2) * (tile.cols * 2) <= numPEs) {
+            tile.cols *= 2;
+        }
+    }
+    tile.cols = std::max(1u, std::min(tile.cols, cols));
+    
+    // Rows per tile: fill the remaining PEs
+    tile.rows = tiling.tileRows;
+    if (tile.rows == 0) {
+        tile.rows = std::max(1u, numPEs / tile.cols);
+    }
+    tile.rows = std::max(1u, std::min(tile.rows, rows));
+    
+    // Depth: each PE holds an A slice, a B slice and one C element in its share
+    // of the memory banks, addressed through the 8-bit operand fields; double
+    // buffering keeps two of each. The bias elements of the epilogue take
+    // one word each, and the partial sums of the ikj and jki orders one
+    // word per tile in flight
+    tile.depth = tiling.tileDepth;
+    if (tile.depth == 0) {
+        unsigned wordsPerPE = scratchWordsPerPE() - std::min(scratchWordsPerPE(), epilogueVectorWords(epilogue.size(), 1, 1));
+        unsigned partialWords = partialSumWords(rows, cols, tile);
+        if (partialWords == 0) {
+            if (tiling.doubleBuffering && wordsPerPE >= 6) {
+                tile.depth = (wordsPerPE - 2) / 4;
+            } else {
+                tile.depth = wordsPerPE > 1 ? (wordsPerPE - 1) / 2 : 1;
+            }
+        } else if (tiling.doubleBuffering && wordsPerPE >= partialWords + 4) {
+            tile.depth = (wordsPerPE - partialWords) / 4;
+        } else {
+            tile.depth = wordsPerPE > partialWords + 1 ? (wordsPerPE - partialWords) / 2 : 1;
+        }
+    }
+    tile.depth = std::max(1u, std::min(tile.depth, common));
+    
+    return tile;
+}
+
+unsigned PIMBackend::partialSumWords(unsigned rows, unsigned cols, const TileShape& tile) const {
+    switch (config.tiling.order) {
+        case CompilerConfig::TilingParams::ORDER_IKJ:
+            return (cols + tile.cols - 1) / tile.cols;
+        case CompilerConfig::TilingParams::ORDER_JKI:
+            return (rows + tile.rows - 1) / tile.rows;
+        default:
+            return 0;
+    }
+}
+
+unsigned PIMBackend::scratchWordsPerPE() const {
+    const auto& arch = config.archParams;
+    unsigned numPEs = std::max(arch.numProcessingElements, 1u);
+    unsigned bytesPerWord = std::max(arch.wordSize / 8, 1u);
+    unsigned totalWords = arch.numMemoryBanks * (arch.memoryBankSize / bytesPerWord);
+    return std::min(totalWords / numPEs, PIMEncoding::operandLimit(config.isaVersion));
+}
+
+unsigned PIMBackend::epilogueVectorWords(size_t count, unsigned rows, unsigned cols) const {
+    unsigned words = 0;
+    for (size_t index = 0; index < std::min(count, epilogue.size()); index++) {
+        if (epilogue[index].isBias()) {
+            words += epilogue[index].kind == EpilogueOp::BIAS_ROW ? rows : cols;
+        }
+    }
+    return words;
+}
+
+PIMBackend::EpilogueRegisters PIMBackend::generateEpilogueConstants(InstructionSink& sink,
+                                                                    RegisterAllocator& registers,
+                                                                    PIMRegister scratch) {
+    EpilogueRegisters constants;
+    constants.operands.assign(epilogue.size(), PIM_REG0);
+    bool needsConstants = std::any_of(epilogue.begin(), epilogue.end(), [](const EpilogueOp& op) {
+        return op.kind == EpilogueOp::RELU || (op.kind == EpilogueOp::SCALE && op.factor != 1);
+    });
+    if (!needsConstants) {
+        return constants;
+    }
+    
+    // one = 0 - ~0
+    constants.one = registers.allocate();
+    sink.emit(PIMInstruction(PIM_XOR, constants.one, constants.one, constants.one, 0));
+    sink.emit(PIMInstruction(PIM_NOT, scratch, constants.one, 0, 0));
+    sink.emit(PIMInstruction(PIM_SUB, constants.one, constants.one, scratch, 0));
+    
+    std::map<int32_t, PIMRegister> shared = {{1, constants.one}};
+    for (size_t index = 0; index < epilogue.size(); index++) {
+        const EpilogueOp& op = epilogue[index];
+        if (op.isBias() || (op.kind == EpilogueOp::SCALE && op.factor == 1)) {
+            continue;
+        }
+        
+        // The sign bit is shifted down to bit 0; powers of two scale by a shift
+        int32_t value = epilogueConstant(op);
+        auto it = shared.find(value);
+        if (it == shared.end()) {
+            PIMRegister reg = registers.allocate();
+            emitConstant(sink, reg, value, constants.one, scratch);
+            it = shared.insert({value, reg}).first;
+        }
+        constants.operands[index] = it->second;
+    }
+    return constants;
+}
+
+void PIMBackend::generateEpilogueInstructions(InstructionSink& sink, const EpilogueRegisters& constants,
+                                              PIMRegister acc, PIMRegister temp,
+                                              const std::function<unsigned(size_t)>& vectorWord) {
+    for (size_t index = 0; index < epilogue.size(); index++) {
+        const EpilogueOp& op = epilogue[index];
+        const PIMRegister constant = constants.operands[index];
+        switch (op.kind) {
+            case EpilogueOp::BIAS_COLUMN:
+            case EpilogueOp::BIAS_ROW:
+                sink.emit(PIMInstruction(PIM_MOVE, temp, vectorWord(index), 0, PIM_MOVE_TO_REG));
+                sink.emit(PIMInstruction(PIM_ADD, acc, acc, temp, 0));               // acc += v
+                break;
+            case EpilogueOp::RELU:
+                sink.emit(PIMInstruction(PIM_SHR, temp, acc, constant, 0));          // temp = sign bit
+                sink.emit(PIMInstruction(PIM_SUB, temp, temp, constants.one, 0));    // temp = x < 0 ? 0 : ~0
+                sink.emit(PIMInstruction(PIM_AND, acc, acc, temp, 0));
+                break;
+            case EpilogueOp::SCALE:
+                if (op.factor == 1) {
+                    break;
+                }
+                sink.emit(PIMInstruction(isPowerOfTwo(op.factor) ? PIM_SHL : PIM_MUL, acc, acc, constant, 0));
+                break;
+        }
+    }
+}
+
+unsigned PIMBackend::planWeightFolding(const KernelShape& shape) {
+    // Shift amounts take at most half of the registers left for accumulators
+    unsigned budget = 0;
+    if (config.enableRegisterAllocation) {
+        const unsigned reserved = 2 + epilogueConstantCount(epilogue);
+        const unsigned size = config.archParams.registerFileSize;
+        budget = size > reserved ? (size - reserved) / 2 : 0;
+    }
+    
+    std::map<int, size_t> frequency;
+    for (int32_t weight : shape.weights) {
+        int shift = weightShift(weight);
+        if (shift > 0) {
+            frequency[shift]++;
+        }
+    }
+    std::vector<std::pair<size_t, int>> ranked;
+    for (const auto& [shift, count] : frequency) {
+        ranked.push_back({count, shift});
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const auto& x, const auto& y) { return x.first > y.first; });
+    for (size_t index = 0; index < ranked.size() && index < budget; index++) {
+        weightShifts.push_back(static_cast<unsigned>(ranked[index].second));
+    }
+    
+    foldedCols = shape.cols;
+    foldedWeights.assign(shape.weights.size(), 0);
+    std::vector<std::pair<unsigned, unsigned>> multiplied;
+    unsigned folded = 0;
+    for (unsigned k = 0; k < shape.common; k++) {
+        for (unsigned j = 0; j < shape.cols; j++) {
+            const size_t index = static_cast<size_t>(k) * shape.cols + j;
+            const int32_t weight = shape.weights[index];
+            if (weight == 0) {
+                continue;
+            }
+            int shift = weightShift(weight);
+            bool foldable = weight == 1 || weight == -1 ||
+                (shift > 0 && std::find(weightShifts.begin(), weightShifts.end(),
+                                        static_cast<unsigned>(shift)) != weightShifts.end());
+            if (foldable) {
+                foldedWeights[index] = weight;
+                folded++;
+            } else {
+                multiplied.push_back({k, j});
+            }
+        }
+    }
+    
+    if (folded == 0) {
+        foldedWeights.clear();
+        return 0;
+    }
+    sparsity = SparsityPattern::fromEntries(SparsityPattern::SPARSE_CONSTANT, shape.common, shape.cols, multiplied);
+    return folded;
+}
+
+int32_t PIMBackend::foldedWeight(unsigned k, unsigned j) const {
+    const size_t index = static_cast<size_t>(k) * foldedCols + j;
+    return (j < foldedCols && index < foldedWeights.size()) ? foldedWeights[index] : 0;
+}
+
+std::vector<PIMRegister> PIMBackend::generateWeightShifts(InstructionSink& sink, RegisterAllocator& registers,
+                                                          PIMRegister one, PIMRegister scratch) {
+    std::vector<PIMRegister> shifts;
+    if (weightShifts.empty()) {
+        return shifts;
+    }
+    
+    // one = 0 - ~0
+    sink.emit(PIMInstruction(PIM_XOR, one, one, one, 0));
+    sink.emit(PIMInstruction(PIM_NOT, scratch, one, 0, 0));
+    sink.emit(PIMInstruction(PIM_SUB, one, one, scratch, 0));
+    for (unsigned shift : weightShifts) {
+        PIMRegister reg = registers.allocate();
+        emitConstant(sink, reg, static_cast<int32_t>(shift), one, scratch);
+        shifts.push_back(reg);
+    }
+    return shifts;
+}
+
+void PIMBackend::emitFoldedProduct(InstructionSink& sink, PIMRegister acc, PIMRegister a, PIMRegister temp,
+                                   int32_t weight, const std::vector<PIMRegister>& shifts) const {
+    const PIMOpcode accumulate = weight < 0 ? PIM_SUB : PIM_ADD;
+    const int shift = weightShift(weight);
+    if (shift < 0) {
+        sink.emit(PIMInstruction(accumulate, acc, acc, a, 0));                      // acc += +-a
+        return;
+    }
+    
+    size_t index = std::find(weightShifts.begin(), weightShifts.end(), static_cast<unsigned>(shift)) -
+                   weightShifts.begin();
+    sink.emit(PIMInstruction(PIM_SHL, temp, a, shifts[index], 0));                  // temp = a << n
+    sink.emit(PIMInstruction(accumulate, acc, acc, temp, 0));                       // acc += +-temp
+}
+
+bool PIMBackend::shouldTile(unsigned rows, unsigned cols, unsigned common) const {
+    const auto& tiling = config.tiling;
+    if (!tiling.enabled) {
+        return false;
+    }
+    
+    if (tiling.tileRows != 0 || tiling.tileCols != 0 || tiling.tileDepth != 0) {
+        return true;
+    }
+    
+    // The untiled layout places A, B, C and the bias vectors back to back in one address range
+    unsigned footprint = rows * common + common * cols + rows * cols + epilogueVectorWords(epilogue.size(), rows, cols);
+    return rows * cols > config.archParams.numProcessingElements ||
+           footprint > PIMEncoding::operandLimit(config.isaVersion);
+}
+
+void PIMBackend::generateTiledMatrixMultiplyInstructions(InstructionSink& sink,
+                                                        unsigned rows, unsigned cols, unsigned common,
+                                                        const TileShape& tile) {
+    PIM_LOG_INFO("Generating tiled matrix multiply instructions");
+    ScopedTimer timer("Tiled generation");
+    
+    // Every PE of the active array executes the same instruction stream on its
+    // own scratch memory. PE (pi, pj) of a tile with origin (i0, j0) owns
+    // C[i0+pi][j0+pj]; a broadcast LOAD with host coordinates [row, col]
+    // delivers A[row+pi][col] or B[row][col+pj] to that PE.
+    //
+    // PE-local scratch layout, per buffer b:
+    //   [2*b*depth, (2*b+1)*depth)        A[i0+pi][k0 .. k0+depth)
+    //   [(2*b+1)*depth, (2*b+2)*depth)    B[k0 .. k0+depth)[j0+pj]
+    // followed by the C words and one word per bias vector of the epilogue.
+    // With packed precision k counts words of the common dimension.
+    //
+    // With double buffering the slices of the next step are loaded into the
+    // other buffer before the current step computes, so host transfers run
+    // while the array multiplies. Host LOADs complete asynchronously, and the
+    // buffer they overwrite was last read by the step before.
+    //
+    // The ijk order finishes one tile before starting the next, with its sum
+    // in a register and one C word per buffer. The ikj (jki) order visits a
+    // row (column) of tiles for every slice, so the A (B) slice is loaded
+    // once for all of them; each tile of the row keeps its partial sum in a
+    // C word of its own between slices.
+    using LoopOrder = CompilerConfig::TilingParams::LoopOrder;
+    const unsigned biasWords = epilogueVectorWords(epilogue.size(), 1, 1);
+    LoopOrder order = config.tiling.order;
+    unsigned partialWords = partialSumWords(rows, cols, tile);
+    if (partialWords > 0 && 2 * tile.depth + partialWords + biasWords > scratchWordsPerPE()) {
+        PIM_LOG_INFO("Tile depth " + std::to_string(tile.depth) + " leaves no room for " +
+                    std::to_string(partialWords) + " partial sums; using the ijk tile order");
+        order = CompilerConfig::TilingParams::ORDER_IJK;
+        partialWords = 0;
+    }
+    
+    unsigned buffers = 1;
+    if (config.tiling.doubleBuffering) {
+        unsigned cWords = partialWords > 0 ? partialWords : 2;
+        if (4 * tile.depth + cWords + biasWords <= scratchWordsPerPE()) {
+            buffers = 2;
+        } else {
+            PIM_LOG_INFO("Tile depth " + std::to_string(tile.depth) +
+                        " leaves no room for double buffers; loading slices in sequence");
+        }
+    }
+    const unsigned cWords = partialWords > 0 ? partialWords : buffers;
+    auto aBase = [&](unsigned buffer) { return 2 * buffer * tile.depth; };
+    auto bBase = [&](unsigned buffer) { return (2 * buffer + 1) * tile.depth; };
+    auto cAddr = [&](unsigned word) { return 2 * buffers * tile.depth + word; };
+    auto biasAddr = [&](size_t index) { return 2 * buffers * tile.depth + cWords + epilogueVectorWords(index, 1, 1); };
+    
+    RegisterAllocator registers(config.archParams.registerFileSize);
+    PIMRegister aReg = registers.allocate();
+    PIMRegister bReg = registers.allocate();
+    PIMRegister accReg = registers.allocate();
+    EpilogueRegisters constants;
+    
+    // One step per (tile, slice) in execution order
+    struct Step {
+        unsigned i0, j0, tileRows, tileCols;
+        unsigned tileIndex;
+        unsigned k0, depth;
+        bool first, last;  // First and last slice of the tile
+        unsigned cWord;    // C word holding the tile's sum
+        bool loadA, loadB; // The slice is not resident from the step before
+        unsigned aBuffer, bBuffer;
+    };
+    const unsigned tileColumns = (cols + tile.cols - 1) / tile.cols;
+    const unsigned lanes = LayoutPlanner(config).lanesPerWord();
+    std::vector<Step> steps;
+    unsigned skipped = 0;
+    auto addStep = [&](unsigned i0, unsigned j0, unsigned k0) {
+        unsigned tileIndex = (i0 / tile.rows) * tileColumns + j0 / tile.cols;
+        unsigned cWord = order == CompilerConfig::TilingParams::ORDER_IKJ ? j0 / tile.cols
+                       : order == CompilerConfig::TilingParams::ORDER_JKI ? i0 / tile.rows
+                       : tileIndex % buffers;
+        unsigned tileCols = std::min(tile.cols, cols - j0);
+        unsigned depth = std::min(tile.depth, common - k0);
+        
+        // A slice over a zero block of B adds nothing to its tile
+        if (!sparsity.anyNonzero(k0 * lanes, (k0 + depth) * lanes, j0, j0 + tileCols)) {
+            depth = 0;
+            skipped++;
+        }
+        steps.push_back({i0, j0, std::min(tile.rows, rows - i0), tileCols,
+                         tileIndex, k0, depth, false, false, cWord, true, true, 0, 0});
+    };
+    for (unsigned outer = 0; outer < (order == CompilerConfig::TilingParams::ORDER_JKI ? cols : rows);
+         outer += (order == CompilerConfig::TilingParams::ORDER_JKI ? tile.cols : tile.rows)) {
+        if (order == CompilerConfig::TilingParams::ORDER_IJK) {
+            for (unsigned j0 = 0; j0 < cols; j0 += tile.cols) {
+                for (unsigned k0 = 0; k0 < common; k0 += tile.depth) {
+                    addStep(outer, j0, k0);
+                }
+            }
+            continue;
+        }
+        for (unsigned k0 = 0; k0 < common; k0 += tile.depth) {
+            if (order == CompilerConfig::TilingParams::ORDER_IKJ) {
+                for (unsigned j0 = 0; j0 < cols; j0 += tile.cols) {
+                    addStep(outer, j0, k0);
+                }
+            } else {
+                for (unsigned i0 = 0; i0 < rows; i0 += tile.rows) {
+                    addStep(i0, outer, k0);
+                }
+            }
+        }
+    }
+    
+    // Skipped slices are dropped; a tile left without slices keeps one with
+    // nothing to load, which clears and stores its accumulator
+    const unsigned tileCount = (rows + tile.rows - 1) / tile.rows * tileColumns;
+    if (skipped > 0) {
+        std::vector<bool> computed(tileCount, false);
+        for (const Step& step : steps) {
+            computed[step.tileIndex] = computed[step.tileIndex] || step.depth > 0;
+        }
+        std::vector<bool> kept(tileCount, false);
+        std::vector<Step> remaining;
+        for (const Step& step : steps) {
+            if (step.depth > 0 || (!computed[step.tileIndex] && !kept[step.tileIndex])) {
+                kept[step.tileIndex] = true;
+                remaining.push_back(step);
+            }
+        }
+        steps.swap(remaining);
+        PIM_LOG_INFO("Skipped " + std::to_string(skipped) + " tile slices over zero blocks of B");
+    }
+    std::vector<bool> started(tileCount, false);
+    for (Step& step : steps) {
+        step.first = !started[step.tileIndex];
+        started[step.tileIndex] = true;
+    }
+    std::vector<bool> finished(tileCount, false);
+    for (size_t s = steps.size(); s > 0; s--) {
+        steps[s - 1].last = !finished[steps[s - 1].tileIndex];
+        finished[steps[s - 1].tileIndex] = true;
+    }
+    
+    // A slice can be reused by a later step when it covers the same rows and
+    // k range and the array kept its shape since it was loaded, so the same
+    // PEs hold it
+    unsigned aLoads = 0, bLoads = 0;
+    const Step* holdingA = nullptr;
+    const Step* holdingB = nullptr;
+    for (size_t s = 0; s < steps.size(); s++) {
+        Step& step = steps[s];
+        const Step* previous = s > 0 ? &steps[s - 1] : nullptr;
+        if (previous && (previous->tileRows != step.tileRows || previous->tileCols != step.tileCols)) {
+            holdingA = nullptr;
+            holdingB = nullptr;
+        }
+        if (step.depth == 0) {
+            step.loadA = false;
+            step.loadB = false;
+            continue;
+        }
+        step.loadA = !(order == CompilerConfig::TilingParams::ORDER_IKJ && holdingA &&
+                       holdingA->i0 == step.i0 && holdingA->k0 == step.k0);
+        step.loadB = !(order == CompilerConfig::TilingParams::ORDER_JKI && holdingB &&
+                       holdingB->j0 == step.j0 && holdingB->k0 == step.k0);
+        step.aBuffer = (step.loadA ? aLoads++ : aLoads - 1) % buffers;
+        step.bBuffer = (step.loadB ? bLoads++ : bLoads - 1) % buffers;
+        holdingA = &step;
+        holdingB = &step;
+    }
+    
+    // Load the A and B slices of a step once, as one burst each with ISA version 2
+    const bool extended = config.isaVersion >= PIMEncoding::V2;
+    auto emitLoads = [&](const Step& step) {
+        if (extended) {
+            if (step.loadA) {
+                sink.emit(hostLoad(aBase(step.aBuffer), PIM_HOST_A, step.i0, step.k0, step.depth, PIM_BLOCK_ALONG_ROW));
+            }
+            if (step.loadB) {
+                sink.emit(hostLoad(bBase(step.bBuffer), PIM_HOST_B, step.k0, step.j0, step.depth, PIM_BLOCK_DOWN_COLUMN));
+            }
+            return;
+        }
+        for (unsigned kk = 0; step.loadA && kk < step.depth; kk++) {
+            sink.emit(hostLoad(aBase(step.aBuffer) + kk, PIM_HOST_A, step.i0, step.k0 + kk));
+        }
+        for (unsigned kk = 0; step.loadB && kk < step.depth; kk++) {
+            sink.emit(hostLoad(bBase(step.bBuffer) + kk, PIM_HOST_B, step.k0 + kk, step.j0));
+        }
+    };
+    
+    // Every PE loads the bias elements of its row and column of C
+    auto emitBiasLoads = [&](const Step& step) {
+        for (size_t index = 0; index < epilogue.size(); index++) {
+            const EpilogueOp& op = epilogue[index];
+            if (op.isBias()) {
+                bool byRow = op.kind == EpilogueOp::BIAS_ROW;
+                sink.emit(PIMInstruction(PIM_LOAD, biasAddr(index), byRow ? PIM_HOST_ROW_VECTOR : PIM_HOST_COL_VECTOR,
+                                         op.operand, byRow ? step.i0 : step.j0));
+            }
+        }
+    };
+    
+    unsigned activeRows = 0;
+    unsigned activeCols = 0;
+    size_t prefetched = 0;
+    bool loaded = false;
+    const Step* accumulating = nullptr;  // Unfinished tile whose sum is in accReg
+    
+    for (size_t s = 0; s < steps.size(); s++) {
+        const Step& step = steps[s];
+        
+        // Park the sum of an unfinished tile before its PEs are reconfigured
+        bool resumes = accumulating && accumulating->tileIndex == step.tileIndex;
+        if (accumulating && !resumes) {
+            sink.emit(PIMInstruction(PIM_MOVE, cAddr(accumulating->cWord), accReg, 0, PIM_MOVE_TO_MEM));
+        }
+        
+        // Reconfigure the PE array only when the tile shape changes (edge tiles)
+        if (step.tileRows != activeRows || step.tileCols != activeCols) {
+            sink.emit(PIMInstruction(PIM_CONFIG, PIM_CONFIG_ARRAY_SIZE, step.tileRows * step.tileCols, 0, 0));
+            sink.emit(PIMInstruction(PIM_CONFIG, PIM_CONFIG_INTERCONNECT, step.tileCols, 0, 0));
+            activeRows = step.tileRows;
+            activeCols = step.tileCols;
             
-            // STORE instruction: opcode = PIM_STORE, dest = host memory address, src = C[i][j] PIM address
-            instructions.push_back(PIMInstruction(PIM_STORE, 
-                                                 0,                // destination (host memory offset, would be actual address)
-                                                 c_addr,           // src PIM address
-                                                 i,                // row
-                                                 j));              // col
+            // The first tile is the largest, so its PEs include those of every later tile
+            if (s == 0) {
+                constants = generateEpilogueConstants(sink, registers, aReg);
+            }
+        }
+        
+        if (step.first) {
+            // Clear the accumulator: acc = acc ^ acc
+            sink.emit(PIMInstruction(PIM_XOR, accReg, accReg, accReg, 0));
+            if (order == CompilerConfig::TilingParams::ORDER_IJK) {
+                emitBiasLoads(step);
+            }
+        } else if (!resumes) {
+            sink.emit(PIMInstruction(PIM_MOVE, accReg, cAddr(step.cWord), 0, PIM_MOVE_TO_REG));
+        }
+            
+        // The bias words are shared by the tiles in flight, so interleaved
+        // orders load them for the last slice only
+        if (step.last && order != CompilerConfig::TilingParams::ORDER_IJK) {
+            emitBiasLoads(step);
+        }
+        
+        if (!loaded) {
+            emitLoads(step);
+        }
+        
+        // Prefetch the next step unless it needs another array configuration
+        loaded = false;
+        if (buffers > 1 && s + 1 < steps.size() &&
+            steps[s + 1].tileRows == activeRows && steps[s + 1].tileCols == activeCols) {
+            emitLoads(steps[s + 1]);
+            loaded = true;
+            prefetched += steps[s + 1].depth > 0 ? 1 : 0;
+        }
+        
+        // Loop body over tile-local addresses, identical for every tile
+        for (unsigned kk = 0; kk < step.depth; kk++) {
+            sink.emit(PIMInstruction(PIM_MOVE, aReg, aBase(step.aBuffer) + kk, 0, PIM_MOVE_TO_REG));
+            sink.emit(PIMInstruction(PIM_MOVE, bReg, bBase(step.bBuffer) + kk, 0, PIM_MOVE_TO_REG));
+            if (extended) {
+                sink.emit(PIMInstruction(PIM_MAC, accReg, aReg, bReg, 0));  // acc = acc + a * b
+            } else {
+                sink.emit(PIMInstruction(PIM_MUL, bReg, aReg, bReg, 0));    // b = a * b
+                sink.emit(PIMInstruction(PIM_ADD, accReg, accReg, bReg, 0));  // acc = acc + b
+            }
+        }
+        
+        accumulating = &step;
+        if (step.last) {
+            // Write the accumulated tile back to host memory; alternating C
+            // words keep the STORE in flight while the next tile accumulates
+            unsigned cWord = cAddr(step.cWord);
+            if (!epilogue.empty()) {
+                generateEpilogueInstructions(sink, constants, accReg, bReg, biasAddr);
+            }
+            sink.emit(PIMInstruction(PIM_MOVE, cWord, accReg, 0, PIM_MOVE_TO_MEM));
+            sink.emit(PIMInstruction(PIM_STORE, PIM_HOST_C, cWord, step.i0, step.j0));
+            accumulating = nullptr;
+        }
+    }
+    
+    if (buffers > 1) {
+        PIM_LOG_INFO("Double buffering prefetched " + std::to_string(prefetched) + " of " +
+                    std::to_string(steps.size()) + " slices behind compute");
+    }
+    if (order != CompilerConfig::TilingParams::ORDER_IJK) {
+        PIM_LOG_INFO("Tile order " + std::string(order == CompilerConfig::TilingParams::ORDER_IKJ ? "ikj" : "jki") +
+                    " loaded " + std::to_string(aLoads) + " A and " + std::to_string(bLoads) + " B slices for " +
+                    std::to_string(steps.size()) + " steps");
+    }
+}
+
+void PIMBackend::generateSymbolicMatrixMultiplyInstructions(InstructionSink& sink) {
+    PIM_LOG_INFO("Generating symbolic matrix multiply instructions");
+    ScopedTimer timer("Symbolic generation");
+    
+    // The program is assembled locally so forward jumps can be patched, then
+    // emitted with targets relative to the current end of the stream
+    const size_t base = sink.getCount();
+    std::vector<PIMInstruction> program;
+    auto emit = [&](PIMOpcode opcode, unsigned dest, unsigned src1, unsigned src2, unsigned imm) {
+        program.push_back(PIMInstruction(opcode, dest, src1, src2, imm));
+        return program.size() - 1;
+    };
+    auto target = [&](size_t index) {
+        size_t address = base + index;
+        if (address >= PIMEncoding::operandLimit(config.isaVersion)) {
+            throw std::runtime_error("Symbolic program at instruction " + std::to_string(base) +
+                                     " exceeds the jump target range of ISA version " +
+                                     std::to_string(config.isaVersion));
         }
+        return static_cast<unsigned>(address);
+    };
+    
+    // The inner loop keeps everything in registers:
+    // one, B stride (cols), A/B pointers, k counter, accumulator and two operands
+    RegisterAllocator registers(config.archParams.registerFileSize);
+    if (registers.capacity() < 8) {
+        throw std::runtime_error("Symbolic matrix multiplication needs at least 8 PIM registers");
+    }
+    
+    PIMRegister one = registers.allocate();
+    PIMRegister stride = registers.allocate();
+    PIMRegister aPtr = registers.allocate();
+    PIMRegister bPtr = registers.allocate();
+    PIMRegister kCount = registers.allocate();
+    PIMRegister acc = registers.allocate();
+    PIMRegister aVal = registers.allocate();
+    PIMRegister bVal = registers.allocate();
+    
+    emit(PIM_CONFIG, PIM_CONFIG_OP_MODE, PIM_OP_MODE_SYMBOLIC, 0, 0);
+    
+    // one = 0 - ~0
+    emit(PIM_XOR, one, one, one, 0);
+    emit(PIM_NOT, aVal, one, 0, 0);
+    emit(PIM_SUB, one, one, aVal, 0);
+    
+    // The loops below test their counters at the bottom, so skip empty matrices
+    std::vector<size_t> exitJumps;
+    emit(PIM_MOVE, aPtr, PIMLaunchLayout::ROWS, 0, PIM_MOVE_TO_REG);
+    exitJumps.push_back(emit(PIM_JUMPZ, 0, aPtr, 0, 0));
+    emit(PIM_MOVE, stride, PIMLaunchLayout::COLS, 0, PIM_MOVE_TO_REG);
+    exitJumps.push_back(emit(PIM_JUMPZ, 0, stride, 0, 0));
+    emit(PIM_MOVE, kCount, PIMLaunchLayout::COMMON, 0, PIM_MOVE_TO_REG);
+    exitJumps.push_back(emit(PIM_JUMPZ, 0, kCount, 0, 0));
+    
+    // Row loop state lives in the launch block
+    emit(PIM_MOVE, PIMLaunchLayout::ROW_COUNT, aPtr, 0, PIM_MOVE_TO_MEM);
+    emit(PIM_MOVE, acc, PIMLaunchLayout::A_BASE, 0, PIM_MOVE_TO_REG);
+    emit(PIM_MOVE, PIMLaunchLayout::A_ROW, acc, 0, PIM_MOVE_TO_MEM);
+    emit(PIM_MOVE, acc, PIMLaunchLayout::C_BASE, 0, PIM_MOVE_TO_REG);
+    emit(PIM_MOVE, PIMLaunchLayout::C_NEXT, acc, 0, PIM_MOVE_TO_MEM);
+    
+    // for each row i of C
+    size_t rowLoop = program.size();
+    emit(PIM_MOVE, PIMLaunchLayout::COL_COUNT, stride, 0, PIM_MOVE_TO_MEM);
+    emit(PIM_MOVE, acc, PIMLaunchLayout::B_BASE, 0, PIM_MOVE_TO_REG);
+    emit(PIM_MOVE, PIMLaunchLayout::B_COL, acc, 0, PIM_MOVE_TO_MEM);
+    
+    // for each column j of C
+    size_t colLoop = program.size();
+    emit(PIM_MOVE, aPtr, PIMLaunchLayout::A_ROW, 0, PIM_MOVE_TO_REG);
+    emit(PIM_MOVE, bPtr, PIMLaunchLayout::B_COL, 0, PIM_MOVE_TO_REG);
+    emit(PIM_MOVE, kCount, PIMLaunchLayout::COMMON, 0, PIM_MOVE_TO_REG);
+    emit(PIM_XOR, acc, acc, acc, 0);
+    
+    // for each k: acc += A[i][k] * B[k][j]
+    size_t kLoop = program.size();
+    emit(PIM_MOVE, aVal, aPtr, 0, PIM_MOVE_TO_REG_INDIRECT);
+    emit(PIM_MOVE, bVal, bPtr, 0, PIM_MOVE_TO_REG_INDIRECT);
+    if (config.isaVersion >= PIMEncoding::V2) {
+        emit(PIM_MAC, acc, aVal, bVal, 0);
+    } else {
+        emit(PIM_MUL, aVal, aVal, bVal, 0);
+        emit(PIM_ADD, acc, acc, aVal, 0);
+    }
+    emit(PIM_ADD, aPtr, aPtr, one, 0);      // next column of A
+    emit(PIM_ADD, bPtr, bPtr, stride, 0);   // next row of B
+    emit(PIM_SUB, kCount, kCount, one, 0);
+    emit(PIM_JUMPNZ, target(kLoop), kCount, 0, 0);
+    
+    // C[i][j] = acc, advance to the next column
+    emit(PIM_MOVE, aVal, PIMLaunchLayout::C_NEXT, 0, PIM_MOVE_TO_REG);
+    emit(PIM_MOVE, aVal, acc, 0, PIM_MOVE_TO_MEM_INDIRECT);
+    emit(PIM_ADD, aVal, aVal, one, 0);
+    emit(PIM_MOVE, PIMLaunchLayout::C_NEXT, aVal, 0, PIM_MOVE_TO_MEM);
+    emit(PIM_MOVE, aVal, PIMLaunchLayout::B_COL, 0, PIM_MOVE_TO_REG);
+    emit(PIM_ADD, aVal, aVal, one, 0);
+    emit(PIM_MOVE, PIMLaunchLayout::B_COL, aVal, 0, PIM_MOVE_TO_MEM);
+    emit(PIM_MOVE, aVal, PIMLaunchLayout::COL_COUNT, 0, PIM_MOVE_TO_REG);
+    emit(PIM_SUB, aVal, aVal, one, 0);
+    emit(PIM_MOVE, PIMLaunchLayout::COL_COUNT, aVal, 0, PIM_MOVE_TO_MEM);
+    emit(PIM_JUMPNZ, target(colLoop), aVal, 0, 0);
+    
+    // Advance to the next row of A
+    emit(PIM_MOVE, aVal, PIMLaunchLayout::A_ROW, 0, PIM_MOVE_TO_REG);
+    emit(PIM_MOVE, bVal, PIMLaunchLayout::COMMON, 0, PIM_MOVE_TO_REG);
+    emit(PIM_ADD, aVal, aVal, bVal, 0);
+    emit(PIM_MOVE, PIMLaunchLayout::A_ROW, aVal, 0, PIM_MOVE_TO_MEM);
+    emit(PIM_MOVE, aVal, PIMLaunchLayout::ROW_COUNT, 0, PIM_MOVE_TO_REG);
+    emit(PIM_SUB, aVal, aVal, one, 0);
+    emit(PIM_MOVE, PIMLaunchLayout::ROW_COUNT, aVal, 0, PIM_MOVE_TO_MEM);
+    emit(PIM_JUMPNZ, target(rowLoop), aVal, 0, 0);
+    
+    // Empty matrices continue after the kernel
+    unsigned exit = target(program.size());
+    for (size_t index : exitJumps) {
+        const PIMInstruction& jump = program[index];
+        program[index] = PIMInstruction(PIM_JUMPZ, exit, jump.getSrc1(), 0, 0);
+    }
+    
+    for (const auto& instruction : program) {
+        sink.emit(instruction);
     }
 }
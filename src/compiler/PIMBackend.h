@@ -6,15 +6,38 @@
 #ifndef PIM_BACKEND_H
 #define PIM_BACKEND_H
 
+#include <functional>
 #include <memory>
 #include <vector>
 #include <llvm/IR/Module.h>
 #include "PIMInstruction.h"
+#include "InstructionSink.h"
+#include "MatrixShapeAnalysis.h"
+#include "LayoutPlanner.h"
+#include "PEScheduler.h"
+#include "RegisterAllocator.h"
+#include "ResidencyPlanner.h"
+#include "ShardPlanner.h"
 #include "../include/PIMInstructionSet.h"
+#include "../include/CompilerConfig.h"
 
 class PIMBackend {
 public:
+    /**
+     * Shape of one tile of the output matrix C
+     * 
+     * rows x cols output elements are computed in parallel, one per
+     * processing element, while the common dimension is consumed in
+     * slices of depth elements.
+     */
+    struct TileShape {
+        unsigned rows;
+        unsigned cols;
+        unsigned depth;
+    };
+
     PIMBackend();
+    explicit PIMBackend(const CompilerConfig& config);
     ~PIMBackend();
 
     /**
@@ -25,46 +48,469 @@ public:
      */
     std::vector<PIMInstruction> generatePIMInstructions(std::unique_ptr<llvm::Module>& module);
 
+    /**
+     * Generate PIM instructions from LLVM IR, streaming them into a sink
+     * 
+     * Instructions are emitted as they are generated and never collected,
+     * so memory use does not depend on the program size. The kernels of a
+     * module with several are linked as ResidencyPlanner plans them.
+     * 
+     * @param module LLVM module to translate
+     * @param sink Sink receiving the instructions; finish() is left to the caller
+     * @return Number of instructions emitted
+     */
+    size_t generatePIMInstructions(std::unique_ptr<llvm::Module>& module, InstructionSink& sink);
+
+    /**
+     * Generate PIM instructions using previously inferred kernel shapes
+     * 
+     * Functions without an entry in shapes are not matrix multiplication
+     * kernels and produce no instructions.
+     * 
+     * @param module LLVM module to translate
+     * @param shapes Kernel shapes from MatrixShapeAnalysis
+     * @param sink Sink receiving the instructions; finish() is left to the caller
+     * @param residency Placement of the kernels of a linked program, or
+     *        nullptr to lower every kernel on its own
+     * @return Number of instructions emitted
+     */
+    size_t generatePIMInstructions(std::unique_ptr<llvm::Module>& module,
+                                   const ShapeAnalysisResult& shapes,
+                                   InstructionSink& sink,
+                                   const ResidencyPlan* residency = nullptr);
+
+    /**
+     * Generate PIM instructions for a single function
+     * 
+     * Jump targets are absolute, so the instructions are only valid at the
+     * sink position they were generated at (see ParallelCompiler for
+     * relocating them). A kernel of a linked program starts with its
+     * CONFIG PIM_CONFIG_KERNEL marker.
+     * 
+     * @param function Function to translate
+     * @param shapes Kernel shapes from MatrixShapeAnalysis
+     * @param sink Sink receiving the instructions; finish() is left to the caller
+     * @param residency Placement of the kernels of a linked program, or nullptr
+     * @return Number of instructions emitted (0 for non-kernels)
+     */
+    size_t generateFunctionInstructions(llvm::Function& function,
+                                        const ShapeAnalysisResult& shapes,
+                                        InstructionSink& sink,
+                                        const ResidencyPlan* residency = nullptr);
+
+    /**
+     * Generate the device programs of a module sharded over several devices
+     * 
+     * Every device program starts with CONFIG PIM_CONFIG_DEVICE, d and
+     * holds the shard of every kernel the device computes, in module order,
+     * each opened by its CONFIG PIM_CONFIG_KERNEL marker and lowered from
+     * ShardPlanner::shardShape. Kernels are not linked across their shards.
+     * 
+     * @param shapes Kernel shapes from MatrixShapeAnalysis
+     * @param plan Sharding of the kernels from ShardPlanner
+     * @param sink Sink receiving the instructions; finish() is left to the caller
+     * @return Number of instructions emitted
+     */
+    size_t generateShardedInstructions(const ShapeAnalysisResult& shapes, const ShardPlan& plan,
+                                       InstructionSink& sink);
+
+    /**
+     * Generate the instructions of one matrix multiplication kernel
+     * 
+     * Host transfers are coalesced into block transfers when the ISA
+     * version allows it. With CompilerConfig::TuningParams enabled the
+     * tile shape, tile order and PE schedule are those AutoTuner found
+     * best for the shape and the architecture.
+     * 
+     * @param shape Kernel shape inferred from the IR
+     * @param sink Sink receiving the instructions; finish() is left to the caller
+     * @param residency Placement of the kernel in a linked program, or nullptr
+     * @throws std::runtime_error if the kernel cannot be lowered with this configuration,
+     *         such as a dimension beyond PIMArchParams::matrixDimLimit
+     */
+    void generateKernelInstructions(const KernelShape& shape, InstructionSink& sink,
+                                    const KernelResidency* residency = nullptr);
+    
+    /**
+     * Plan the placement of a kernel that may keep operands resident
+     * between the kernels of a linked program
+     * 
+     * Kernels of 32-bit elements that run untiled on a single PE from one
+     * product of untransposed operands qualify, unless dimensions are
+     * symbolic or kernels are tuned. The layout is the one
+     * processMatrixMultiplyFunction lowers the kernel with on its own.
+     * 
+     * @param shape Kernel shape inferred from the IR
+     * @param layout Receives the placement of A, B and C from address 0
+     * @param vectorWords Receives the words of the bias vectors, which follow layout.footprint()
+     * @return False if the kernel is lowered in another form
+     */
+    bool planLinkedLayout(const KernelShape& shape, LayoutPlan& layout, unsigned& vectorWords);
+
+    /**
+     * Choose the tile shape for a matrix multiplication
+     * 
+     * Explicit sizes from CompilerConfig::TilingParams take precedence; any
+     * dimension left at 0 is derived from PIMArchParams so that one tile
+     * occupies at most numProcessingElements PEs and its A/B slices fit in
+     * the per-PE share of the memory banks (and in the address field of the ISA version),
+     * twice over with double buffering.
+     * 
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param common Common dimension, in words when A and B are packed
+     * @return Tile shape, clamped to the matrix dimensions
+     */
+    TileShape computeTileShape(unsigned rows, unsigned cols, unsigned common) const;
+
+    /**
+     * Check whether a matrix multiplication should use tiled code generation
+     * 
+     * @param rows Number of rows
+     * @param cols Number of columns
+     * @param common Common dimension, in words when A and B are packed
+     * @return True if tiling is enabled and the problem exceeds the PE array
+     *         or the address space of the ISA version, or tile sizes were given explicitly
+     */
+    bool shouldTile(unsigned rows, unsigned cols, unsigned common) const;
+
 private:
+    CompilerConfig config;
+    
+    // Variant of the kernel being lowered
+    bool hostTransposeA = false;
+    bool hostTransposeB = false;
+    bool vectorKernel = false;
+    std::vector<EpilogueOp> epilogue;   // Applied to C in registers before it is stored
+    SparsityPattern sparsity;           // Zeros of B that need no load or multiply
+    bool residentA = false;             // A was left in PIM memory by an earlier kernel and is not loaded
+    bool residentB = false;
+    
+    // Products by a constant B folded into adds and shifts of A
+    std::vector<int32_t> foldedWeights; // Factor by [k][j] of the logical B, 0 where B is multiplied
+    unsigned foldedCols = 0;
+    std::vector<unsigned> weightShifts; // Shift amounts of the folded powers of two, one register each
+    
+    /**
+     * Registers holding the constants of the fused epilogue
+     */
+    struct EpilogueRegisters {
+        PIMRegister one = PIM_REG0;
+        std::vector<PIMRegister> operands;  // Per operation: sign shift of RELU, factor or shift of SCALE
+    };
+    
     /**
-     * Process matrix multiplication patterns in LLVM IR
+     * Plan the layout of an untiled kernel from address 0
      * 
-     * @param function LLVM function to process
-     * @param instructions Vector to add generated instructions to
+     * Falls back to the contiguous layout when the planned one and the
+     * bias vectors exceed the address field of the ISA version.
+     * 
+     * @param planned Kernel shape with the sparsity pattern of the words of B that are loaded
      */
-    void processMatrixMultiplyFunction(llvm::Function* function, std::vector<PIMInstruction>& instructions);
+    LayoutPlan planUntiledLayout(const KernelShape& planned) const;
     
     /**
-     * Generate instructions for loading matrices into PIM memory
+     * Get the words of PE-local scratch addressable by tiled programs
+     */
+    unsigned scratchWordsPerPE() const;
+    
+    /**
+     * Get the PE-local words holding partial sums of C between slices
+     * 
+     * The ijk tile order finishes each tile before the next and needs
+     * none; ikj keeps one per tile of a row of tiles, jki one per tile of
+     * a column.
      * 
-     * @param instructions Vector to add generated instructions to
      * @param rows Number of rows
      * @param cols Number of columns
-     * @param common Common dimension
+     * @param tile Tile shape; only rows and cols are used
+     */
+    unsigned partialSumWords(unsigned rows, unsigned cols, const TileShape& tile) const;
+    
+    /**
+     * Get the PIM words the bias vectors of the first count epilogue
+     * operations occupy for a rows x cols block of C
+     * 
+     * @param count Number of leading epilogue operations
+     * @param rows Rows of the block
+     * @param cols Columns of the block
+     */
+    unsigned epilogueVectorWords(size_t count, unsigned rows, unsigned cols) const;
+    
+    /**
+     * Allocate and fill the registers holding the epilogue constants
+     * 
+     * The ISA has no immediate operands, so every constant is built from
+     * 1 = 0 - ~0 by shifts and adds. Constants of equal value share a
+     * register; an epilogue of bias vectors only needs none.
+     * 
+     * @param sink Sink receiving the generated instructions
+     * @param registers Allocator the constant registers are taken from
+     * @param scratch Register free for temporaries
+     * @return Registers of the constants
+     */
+    EpilogueRegisters generateEpilogueConstants(InstructionSink& sink, RegisterAllocator& registers,
+                                                PIMRegister scratch);
+    
+    /**
+     * Apply the fused epilogue to one element of C held in a register
+     * 
+     * ReLU masks the element with (x >> 31) - 1, which is all ones unless
+     * x is negative; scaling by a power of two is a shift.
+     * 
+     * @param sink Sink receiving the generated instructions
+     * @param constants Registers from generateEpilogueConstants
+     * @param acc Register holding the element
+     * @param temp Register free for temporaries
+     * @param vectorWord PIM address of the element's entry in the bias
+     *                   vector of an epilogue operation, by operation index
+     */
+    void generateEpilogueInstructions(InstructionSink& sink, const EpilogueRegisters& constants,
+                                      PIMRegister acc, PIMRegister temp,
+                                      const std::function<unsigned(size_t)>& vectorWord);
+
+    /**
+     * Decide which products by a constant B are folded
+     * 
+     * Weights of +-1 add or subtract A; +-2^n add or subtract A shifted by
+     * n, for the shift amounts that get a register: the most frequent ones,
+     * up to half of the registers left after the operands and epilogue
+     * constants. Fills foldedWeights, weightShifts and the sparsity pattern
+     * of the words of B that are still loaded and multiplied.
+     * 
+     * @param shape Kernel shape with the values of B
+     * @return Number of folded products
      */
-    void generateMatrixLoadInstructions(std::vector<PIMInstruction>& instructions, 
-                                        unsigned rows, unsigned cols, unsigned common);
+    unsigned planWeightFolding(const KernelShape& shape);
+    
+    /**
+     * Get the folded factor of the product by element [k, j] of B
+     * 
+     * @return The weight, or 0 if the product is multiplied
+     */
+    int32_t foldedWeight(unsigned k, unsigned j) const;
+    
+    /**
+     * Allocate and fill the registers holding the shift amounts of the
+     * folded weights
+     * 
+     * @param sink Sink receiving the generated instructions
+     * @param registers Allocator the shift registers are taken from
+     * @param one Register free to hold 1 while the amounts are built
+     * @param scratch Register free for temporaries
+     * @return Register of every amount in weightShifts
+     */
+    std::vector<PIMRegister> generateWeightShifts(InstructionSink& sink, RegisterAllocator& registers,
+                                                  PIMRegister one, PIMRegister scratch);
+    
+    /**
+     * Add a folded product to an accumulator: acc += weight * a
+     * 
+     * @param sink Sink receiving the generated instructions
+     * @param acc Accumulator
+     * @param a Register holding the element of A
+     * @param temp Register for the shifted A; may be a
+     * @param weight Factor from foldedWeight
+     * @param shifts Registers from generateWeightShifts
+     */
+    void emitFoldedProduct(InstructionSink& sink, PIMRegister acc, PIMRegister a, PIMRegister temp,
+                           int32_t weight, const std::vector<PIMRegister>& shifts) const;
+
+    /**
+     * Generate the instructions for one matrix multiplication kernel
+     * 
+     * With 8- or 16-bit CompilerConfig::precision the kernel starts with
+     * CONFIG PIM_CONFIG_PRECISION and A and B are packed along the common
+     * dimension, so each MUL/ADD pair performs several multiply-accumulates
+     * into a 32-bit accumulator. With CompilerConfig::SchedulingParams
+     * enabled, untiled kernels are distributed over per-PE streams by
+     * PEScheduler instead of running on a single PE.
+     * 
+     * Transposed operands are announced with CONFIG PIM_CONFIG_HOST_LAYOUT
+     * and loaded in their stored order. The products of a batched kernel
+     * run one after another, each selected by CONFIG PIM_CONFIG_BATCH, or
+     * with scheduling enabled one per PE stream when a product fits a PE's
+     * local memory.
+     * 
+     * The elementwise epilogue of the kernel is applied to every element
+     * of C in registers after its last multiply-accumulate, so C is stored
+     * to the host once; bias vectors are loaded from PIM_HOST_ROW_VECTOR
+     * and PIM_HOST_COL_VECTOR next to the operands.
+     * 
+     * With a known sparsity pattern of B only the words of B that may be
+     * nonzero are loaded, into a compressed layout, and only their
+     * multiply-accumulates are issued; tiled kernels skip every slice whose
+     * block of B is zero. The host still addresses B in its logical
+     * coordinates, so a compressed host store only serves the nonzeros.
+     * 
+     * A constant B (KernelShape::weights) is emitted into the data section
+     * of the program, packed as the host LOADs of B deliver it, and
+     * selected with CONFIG PIM_CONFIG_CONSTANT_B for the kernel. Untiled
+     * kernels of 32-bit elements also fold its products by 0, +-1 and
+     * +-2^n (planWeightFolding), which are neither loaded nor multiplied.
+     * CompilerConfig::foldConstantWeights off keeps B with the host.
+     * 
+     * A kernel a ResidencyPlan keeps resident is placed as planned and
+     * neither loads the operands earlier kernels left in PIM memory nor,
+     * when only later kernels read it, stores C.
+     * 
+     * @param shape Kernel shape inferred from the IR
+     * @param sink Sink receiving the generated instructions
+     * @param residency Placement of the kernel in a linked program, or nullptr
+     * @throws std::runtime_error for packed precision, batched, transposed
+     *         or fused kernels with symbolic dimensions, and for scaling by
+     *         a factor other than a power of two with packed precision
+     */
+    void processMatrixMultiplyFunction(const KernelShape& shape, InstructionSink& sink,
+                                       const KernelResidency* residency = nullptr);
+    
+    /**
+     * Create a host LOAD of element [row, col] of A or B, or a burst of
+     * count words along axis
+     * 
+     * Operands the host stores transposed are addressed in stored
+     * coordinates, with the burst axis flipped.
+     * 
+     * @param dest PIM address of the first word
+     * @param buffer Host buffer (PIMHostBuffer)
+     * @param row Row of the logical matrix
+     * @param col Column of the logical matrix
+     * @param count Words of a LOAD_BLOCK, or 0 for a single LOAD
+     * @param axis Burst direction in the logical matrix (PIMBlockAxis)
+     */
+    PIMInstruction hostLoad(unsigned dest, unsigned buffer, unsigned row, unsigned col,
+                            unsigned count = 0, unsigned axis = PIM_BLOCK_ALONG_ROW) const;
+    
+    /**
+     * Generate instructions for loading matrices into PIM memory
+     * 
+     * The bias vectors of the epilogue follow the matrices, at
+     * layout.footprint(). Words missing from a compressed layout of B are
+     * not loaded, nor are the columns of A that neither they nor folded
+     * weights would multiply, nor resident operands (residentA, residentB).
+     * 
+     * @param sink Sink receiving the generated instructions
+     * @param layout Placement of A, B and C from LayoutPlanner
+     * @param rowOrigin Host row of the first row of A and C in the layout
+     * @param colOrigin Host column of the first column of B and C in the layout
+     */
+    void generateMatrixLoadInstructions(InstructionSink& sink, const LayoutPlan& layout,
+                                        unsigned rowOrigin = 0, unsigned colOrigin = 0);
                                         
     /**
      * Generate matrix multiplication instructions for PIM architecture
      * 
-     * @param instructions Vector to add generated instructions to
-     * @param rows Number of rows
-     * @param cols Number of columns
-     * @param common Common dimension
+     * Registers are assigned by RegisterAllocator: A[i][k] is loaded once per
+     * k and shared by a block of C accumulators that stay live across the
+     * whole k loop, so each C element is loaded and stored only once. Words
+     * missing from a compressed layout of B are skipped, and so is A[i][k]
+     * when the block has none of row k. Folded weights add A[i][k] to the
+     * accumulator directly or through a shift.
+     * 
+     * @param sink Sink receiving the generated instructions
+     * @param layout Placement of A, B and C from LayoutPlanner
+     * @param colOrigin Column of B of the first column of the layout
+     */
+    void generateMatrixMultiplyInstructions(InstructionSink& sink, const LayoutPlan& layout,
+                                            unsigned colOrigin = 0);
+    
+    /**
+     * Generate a register-blocked matrix-vector product
+     * 
+     * A block of y accumulators is cleared and shares every x[k], which is
+     * loaded once per block, so the loop moves one A element per
+     * multiply-accumulate and y is written without being read. Elements of
+     * x missing from a compressed layout skip their k iteration, unless
+     * their weight is folded.
+     * 
+     * @param sink Sink receiving the generated instructions
+     * @param layout Placement of A, x and y from LayoutPlanner
+     */
+    void generateMatrixVectorMultiplyInstructions(InstructionSink& sink, const LayoutPlan& layout);
+                                            
+    /**
+     * Generate matrix multiplication instructions without register allocation
+     * 
+     * Reloads and spills C[i][j] around every multiply-accumulate; kept for
+     * comparison when CompilerConfig::enableRegisterAllocation is off.
+     * Words missing from a compressed layout of B are skipped; weights of
+     * +-1 are folded into an add or subtract.
+     * 
+     * @param sink Sink receiving the generated instructions
+     * @param layout Placement of A, B and C from LayoutPlanner
+     * @param colOrigin Column of B of the first column of the layout
      */
-    void generateMatrixMultiplyInstructions(std::vector<PIMInstruction>& instructions,
-                                            unsigned rows, unsigned cols, unsigned common);
+    void generateUnallocatedMatrixMultiplyInstructions(InstructionSink& sink, const LayoutPlan& layout,
+                                                       unsigned colOrigin = 0);
                                             
     /**
      * Generate store result instructions
      * 
-     * @param instructions Vector to add generated instructions to
+     * @param sink Sink receiving the generated instructions
+     * @param layout Placement of A, B and C from LayoutPlanner
+     * @param rowOrigin Host row of the first row of C in the layout
+     * @param colOrigin Host column of the first column of C in the layout
+     */
+    void generateStoreResultInstructions(InstructionSink& sink, const LayoutPlan& layout,
+                                         unsigned rowOrigin = 0, unsigned colOrigin = 0);
+
+    /**
+     * Generate one instruction stream per PE of a schedule
+     * 
+     * Each stream (CONFIG PIM_CONFIG_PE_STREAM) loads the A rows and B
+     * columns of its block of C into the PE's local memory, runs the
+     * register-blocked multiply of generateMatrixMultiplyInstructions on
+     * them and stores its block; a SYNC closes the streams.
+     * 
+     * @param sink Sink receiving the generated instructions
+     * @param schedule Partition of C from PEScheduler
+     * @param common Common dimension
+     */
+    void generateScheduledMatrixMultiplyInstructions(InstructionSink& sink, const PESchedule& schedule,
+                                                     unsigned common);
+
+    /**
+     * Generate tiled matrix multiplication instructions
+     * 
+     * C is split into tiles of tile.rows x tile.cols elements, each computed
+     * by the PE array in lockstep. For every tile the A/B slices are loaded
+     * once into PE-local scratch and a fixed loop body over tile-local
+     * addresses accumulates the result, so program size grows with the tile
+     * count rather than with rows * cols * common.
+     * 
+     * With TilingParams::doubleBuffering the scratch holds two sets of
+     * slices and the loads of the next slice (of the same or the next tile)
+     * are issued before the current slice computes, overlapping host
+     * transfers with the MACs. Steps that reconfigure the array drain the
+     * pipeline.
+     * 
+     * Slices whose block of B is zero by the sparsity pattern are neither
+     * loaded nor computed; a tile without any other slice only stores its
+     * cleared accumulator (with the epilogue applied).
+     * 
+     * @param sink Sink receiving the generated instructions
      * @param rows Number of rows
      * @param cols Number of columns
+     * @param common Common dimension, in words when A and B are packed
+     * @param tile Tile shape from computeTileShape
+     */
+    void generateTiledMatrixMultiplyInstructions(InstructionSink& sink,
+                                                 unsigned rows, unsigned cols, unsigned common,
+                                                 const TileShape& tile);
+
+    /**
+     * Generate a matrix multiplication whose sizes are known only at launch
+     * 
+     * Emits a single looped program (JUMPZ/JUMPNZ) that reads rows, cols,
+     * common and the matrix base addresses from the launch block described
+     * by PIMLaunchLayout, so one program serves every shape and its size is
+     * independent of the matrix dimensions.
+     * 
+     * @param sink Sink receiving the generated instructions
+     * @throws std::runtime_error if fewer than 8 registers are available or
+     *         the loop targets do not fit the jump field of the ISA version
      */
-    void generateStoreResultInstructions(std::vector<PIMInstruction>& instructions,
-                                         unsigned rows, unsigned cols);
+    void generateSymbolicMatrixMultiplyInstructions(InstructionSink& sink);
 };
 
 #endif // PIM_BACKEND_H
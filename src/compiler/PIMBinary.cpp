@@ -0,0 +1,410 @@
+/**
+ * PIMBinary.cpp
+ * Implementation of the PIM binary container writer and reader
+ */
+
+#include "PIMBinary.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+void putLE32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+    out[2] = static_cast<uint8_t>(value >> 16);
+    out[3] = static_cast<uint8_t>(value >> 24);
+}
+
+uint32_t getLE32(const uint8_t* in) {
+    return static_cast<uint32_t>(in[0]) |
+           (static_cast<uint32_t>(in[1]) << 8) |
+           (static_cast<uint32_t>(in[2]) << 16) |
+           (static_cast<uint32_t>(in[3]) << 24);
+}
+
+void putLE64(uint8_t* out, uint64_t value) {
+    putLE32(out, static_cast<uint32_t>(value));
+    putLE32(out + 4, static_cast<uint32_t>(value >> 32));
+}
+
+uint64_t getLE64(const uint8_t* in) {
+    return static_cast<uint64_t>(getLE32(in)) | (static_cast<uint64_t>(getLE32(in + 4)) << 32);
+}
+
+uint32_t alignUp(uint32_t value) {
+    const uint32_t align = PIMBinaryFormat::SECTION_ALIGNMENT;
+    return (value + align - 1) / align * align;
+}
+
+bool isLittleEndianHost() {
+    const uint32_t probe = 1;
+    uint8_t first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+} // namespace
+
+// Implementation of PIMBinaryWriter
+
+PIMBinaryHeader PIMBinaryWriter::makeHeader(const CompilerConfig::PIMArchParams& archParams,
+                                            uint32_t instructionCount, uint32_t dataSize,
+                                            unsigned isaVersion) {
+    bool extended = isaVersion == PIMEncoding::V2;
+    PIMBinaryHeader header = {};
+    header.magic = PIMBinaryFormat::MAGIC;
+    header.version = extended ? PIMBinaryFormat::VERSION_EXTENDED : PIMBinaryFormat::VERSION;
+    header.headerSize = PIMBinaryFormat::HEADER_SIZE;
+    header.instructionWordSize = PIMEncoding::wordBytes(isaVersion);
+    
+    header.numProcessingElements = archParams.numProcessingElements;
+    header.memoryBankSize = archParams.memoryBankSize;
+    header.numMemoryBanks = archParams.numMemoryBanks;
+    header.registerFileSize = archParams.registerFileSize;
+    header.wordSize = archParams.wordSize;
+    
+    header.instructionCount = instructionCount;
+    header.textOffset = alignUp(PIMBinaryFormat::HEADER_SIZE);
+    header.textSize = instructionCount * header.instructionWordSize;
+    header.dataOffset = alignUp(header.textOffset + header.textSize);
+    header.dataSize = dataSize;
+    
+    return header;
+}
+
+void PIMBinaryWriter::encodeHeader(const PIMBinaryHeader& header, uint8_t* out) {
+    // The header consists solely of 32-bit fields, encoded in declaration order
+    uint32_t fields[PIMBinaryFormat::HEADER_SIZE / sizeof(uint32_t)];
+    std::memcpy(fields, &header, sizeof(fields));
+    
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+        putLE32(out + i * sizeof(uint32_t), fields[i]);
+    }
+}
+
+void PIMBinaryWriter::encodeInstruction(const PIMInstruction& instruction, unsigned isaVersion, uint8_t* out) {
+    if (isaVersion == PIMEncoding::V2) {
+        putLE64(out, instruction.toExtendedBinary());
+    } else {
+        putLE32(out, instruction.toBinary());
+    }
+}
+
+std::vector<uint8_t> PIMBinaryWriter::encodeData(const std::vector<PIMConstantMatrix>& data, size_t* blocks) {
+    if (blocks) {
+        *blocks = 0;
+    }
+    if (data.empty()) {
+        return {};
+    }
+    
+    // Cut every matrix into blocks and number the distinct ones
+    const uint32_t blockRows = PIMBinaryFormat::DATA_BLOCK_ROWS;
+    const uint32_t blockCols = PIMBinaryFormat::DATA_BLOCK_COLS;
+    std::map<std::vector<uint32_t>, uint32_t> poolIndex;
+    std::vector<const std::vector<uint32_t>*> pool;
+    std::vector<uint32_t> table;
+    std::vector<uint32_t> block(blockRows * blockCols);
+    for (const auto& matrix : data) {
+        for (uint32_t row0 = 0; row0 < matrix.rows; row0 += blockRows) {
+            for (uint32_t col0 = 0; col0 < matrix.cols; col0 += blockCols) {
+                for (uint32_t r = 0; r < blockRows; r++) {
+                    for (uint32_t c = 0; c < blockCols; c++) {
+                        block[r * blockCols + c] = matrix.word(row0 + r, col0 + c);
+                    }
+                }
+                auto inserted = poolIndex.insert({block, static_cast<uint32_t>(pool.size())});
+                if (inserted.second) {
+                    pool.push_back(&inserted.first->first);
+                }
+                table.push_back(inserted.first->second);
+            }
+        }
+    }
+    if (blocks) {
+        *blocks = table.size();
+    }
+    
+    size_t words = 2 + 2 * data.size() + table.size() + pool.size() * block.size();
+    std::vector<uint8_t> section(words * sizeof(uint32_t));
+    uint8_t* out = section.data();
+    auto put = [&](uint32_t value) {
+        putLE32(out, value);
+        out += sizeof(uint32_t);
+    };
+    put(static_cast<uint32_t>(data.size()));
+    put(static_cast<uint32_t>(pool.size()));
+    for (const auto& matrix : data) {
+        put(matrix.rows);
+        put(matrix.cols);
+    }
+    for (uint32_t index : table) {
+        put(index);
+    }
+    for (const auto* words : pool) {
+        for (uint32_t word : *words) {
+            put(word);
+        }
+    }
+    return section;
+}
+
+std::vector<uint8_t> PIMBinaryWriter::serialize(const std::vector<PIMInstruction>& instructions,
+                                                const CompilerConfig::PIMArchParams& archParams,
+                                                unsigned isaVersion,
+                                                const std::vector<PIMConstantMatrix>& data) {
+    std::vector<uint8_t> section = encodeData(data);
+    PIMBinaryHeader header = makeHeader(archParams, static_cast<uint32_t>(instructions.size()),
+                                        static_cast<uint32_t>(section.size()), isaVersion);
+    
+    std::vector<uint8_t> buffer(header.dataOffset + header.dataSize, 0);
+    encodeHeader(header, buffer.data());
+    
+    uint8_t* text = buffer.data() + header.textOffset;
+    for (const auto& instruction : instructions) {
+        encodeInstruction(instruction, isaVersion, text);
+        text += header.instructionWordSize;
+    }
+    std::copy(section.begin(), section.end(), buffer.begin() + header.dataOffset);
+    
+    return buffer;
+}
+
+void PIMBinaryWriter::write(const std::string& filename,
+                            const std::vector<PIMInstruction>& instructions,
+                            const CompilerConfig::PIMArchParams& archParams,
+                            unsigned isaVersion,
+                            const std::vector<PIMConstantMatrix>& data) {
+    std::vector<uint8_t> buffer = serialize(instructions, archParams, isaVersion, data);
+    
+    FILE* file = std::fopen(filename.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Could not open output file: " + filename);
+    }
+    
+    size_t written = std::fwrite(buffer.data(), 1, buffer.size(), file);
+    bool closed = std::fclose(file) == 0;
+    
+    if (written != buffer.size() || !closed) {
+        throw std::runtime_error("Failed to write output file: " + filename);
+    }
+}
+
+// Implementation of PIMBinaryReader
+
+PIMBinaryReader::PIMBinaryReader(const std::string& filename)
+    : base(nullptr), size(0), mapped(false), header() {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open PIM binary: " + filename);
+    }
+    
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(PIMBinaryFormat::HEADER_SIZE)) {
+        ::close(fd);
+        throw std::runtime_error("Not a PIM binary: " + filename);
+    }
+    
+    void* mapping = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Could not map PIM binary: " + filename);
+    }
+    
+    base = static_cast<const uint8_t*>(mapping);
+    size = static_cast<size_t>(st.st_size);
+    mapped = true;
+    
+    try {
+        validate();
+    } catch (...) {
+        ::munmap(const_cast<uint8_t*>(base), size);
+        throw;
+    }
+}
+
+PIMBinaryReader::PIMBinaryReader(const uint8_t* data, size_t size)
+    : base(data), size(size), mapped(false), header() {
+    validate();
+}
+
+PIMBinaryReader::~PIMBinaryReader() {
+    if (mapped) {
+        ::munmap(const_cast<uint8_t*>(base), size);
+    }
+}
+
+void PIMBinaryReader::validate() {
+    if (!base || size < PIMBinaryFormat::HEADER_SIZE) {
+        throw std::runtime_error("PIM binary is truncated");
+    }
+    
+    uint32_t fields[PIMBinaryFormat::HEADER_SIZE / sizeof(uint32_t)];
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+        fields[i] = getLE32(base + i * sizeof(uint32_t));
+    }
+    std::memcpy(&header, fields, sizeof(header));
+    
+    if (header.magic != PIMBinaryFormat::MAGIC) {
+        throw std::runtime_error("Bad PIM binary magic");
+    }
+    if (header.version != PIMBinaryFormat::VERSION && header.version != PIMBinaryFormat::VERSION_EXTENDED) {
+        throw std::runtime_error("Unsupported PIM binary version " + std::to_string(header.version));
+    }
+    if (header.headerSize < PIMBinaryFormat::HEADER_SIZE ||
+        header.instructionWordSize != PIMEncoding::wordBytes(header.version)) {
+        throw std::runtime_error("Malformed PIM binary header");
+    }
+    
+    if (header.textOffset % PIMBinaryFormat::SECTION_ALIGNMENT != 0 ||
+        header.dataOffset % PIMBinaryFormat::SECTION_ALIGNMENT != 0) {
+        throw std::runtime_error("PIM binary sections are not aligned to " +
+                                 std::to_string(PIMBinaryFormat::SECTION_ALIGNMENT) + " bytes");
+    }
+    
+    uint64_t textEnd = static_cast<uint64_t>(header.textOffset) + header.textSize;
+    uint64_t dataEnd = static_cast<uint64_t>(header.dataOffset) + header.dataSize;
+    if (header.textSize != static_cast<uint64_t>(header.instructionCount) * header.instructionWordSize ||
+        textEnd > size || dataEnd > size) {
+        throw std::runtime_error("PIM binary sections exceed file size");
+    }
+    if (header.textOffset < header.headerSize || (header.dataSize > 0 && header.dataOffset < textEnd)) {
+        throw std::runtime_error("PIM binary sections overlap");
+    }
+}
+
+const PIMBinaryHeader& PIMBinaryReader::getHeader() const {
+    return header;
+}
+
+size_t PIMBinaryReader::getInstructionCount() const {
+    return header.instructionCount;
+}
+
+unsigned PIMBinaryReader::getISAVersion() const {
+    return header.version;
+}
+
+uint64_t PIMBinaryReader::getInstruction(size_t index) const {
+    if (index >= header.instructionCount) {
+        throw std::out_of_range("PIM instruction index out of range");
+    }
+    const uint8_t* word = base + header.textOffset + index * header.instructionWordSize;
+    return header.version == PIMBinaryFormat::VERSION_EXTENDED ? getLE64(word) : getLE32(word);
+}
+
+PIMInstruction PIMBinaryReader::decodeInstruction(size_t index) const {
+    uint64_t word = getInstruction(index);
+    if (header.version == PIMBinaryFormat::VERSION_EXTENDED) {
+        return PIMInstruction::fromExtendedBinary(word);
+    }
+    return PIMInstruction::fromBinary(static_cast<uint32_t>(word));
+}
+
+const uint32_t* PIMBinaryReader::getInstructionWords() const {
+    if (header.version != PIMBinaryFormat::VERSION) {
+        throw std::runtime_error("In-place 32-bit instruction access requires a version 1 container");
+    }
+    if (!isLittleEndianHost()) {
+        throw std::runtime_error("In-place instruction access requires a little-endian host");
+    }
+    const uint8_t* words = base + header.textOffset;
+    if (reinterpret_cast<uintptr_t>(words) % alignof(uint32_t) != 0) {
+        throw std::runtime_error("In-place instruction access requires a 4-byte aligned container");
+    }
+    return reinterpret_cast<const uint32_t*>(words);
+}
+
+const uint64_t* PIMBinaryReader::getExtendedInstructionWords() const {
+    if (header.version != PIMBinaryFormat::VERSION_EXTENDED) {
+        throw std::runtime_error("In-place 64-bit instruction access requires a version 2 container");
+    }
+    if (!isLittleEndianHost()) {
+        throw std::runtime_error("In-place instruction access requires a little-endian host");
+    }
+    const uint8_t* words = base + header.textOffset;
+    if (reinterpret_cast<uintptr_t>(words) % alignof(uint64_t) != 0) {
+        throw std::runtime_error("In-place instruction access requires an 8-byte aligned container");
+    }
+    return reinterpret_cast<const uint64_t*>(words);
+}
+
+const uint8_t* PIMBinaryReader::getData() const {
+    return base + header.dataOffset;
+}
+
+std::vector<PIMConstantMatrix> PIMBinaryReader::getConstantMatrices() const {
+    std::vector<PIMConstantMatrix> matrices;
+    if (header.dataSize == 0) {
+        return matrices;
+    }
+    
+    const uint8_t* data = getData();
+    const size_t words = header.dataSize / sizeof(uint32_t);
+    size_t next = 0;
+    auto get = [&]() {
+        if (next >= words) {
+            throw std::runtime_error("PIM binary data section is truncated");
+        }
+        return getLE32(data + sizeof(uint32_t) * next++);
+    };
+    
+    const uint32_t blockRows = PIMBinaryFormat::DATA_BLOCK_ROWS;
+    const uint32_t blockCols = PIMBinaryFormat::DATA_BLOCK_COLS;
+    uint32_t matrixCount = get();
+    uint32_t poolSize = get();
+    if (matrixCount > words) {
+        throw std::runtime_error("PIM binary data section is truncated");
+    }
+    matrices.resize(matrixCount);
+    for (auto& matrix : matrices) {
+        matrix.rows = get();
+        matrix.cols = get();
+    }
+    
+    // The pool follows the block tables of all matrices
+    std::vector<std::vector<uint32_t>> tables(matrixCount);
+    for (uint32_t m = 0; m < matrixCount; m++) {
+        const PIMConstantMatrix& matrix = matrices[m];
+        uint64_t count = static_cast<uint64_t>((matrix.rows + blockRows - 1) / blockRows) *
+                         ((matrix.cols + blockCols - 1) / blockCols);
+        if (count > words) {
+            throw std::runtime_error("PIM binary data section is truncated");
+        }
+        for (uint64_t b = 0; b < count; b++) {
+            uint32_t index = get();
+            if (index >= poolSize) {
+                throw std::runtime_error("PIM binary data block " + std::to_string(index) + " out of range");
+            }
+            tables[m].push_back(index);
+        }
+    }
+    const size_t poolStart = next;
+    if (poolStart + static_cast<uint64_t>(poolSize) * blockRows * blockCols > words) {
+        throw std::runtime_error("PIM binary data section is truncated");
+    }
+    
+    for (uint32_t m = 0; m < matrixCount; m++) {
+        PIMConstantMatrix& matrix = matrices[m];
+        const uint32_t blocksPerRow = (matrix.cols + blockCols - 1) / blockCols;
+        matrix.words.resize(static_cast<size_t>(matrix.rows) * matrix.cols);
+        for (uint32_t row = 0; row < matrix.rows; row++) {
+            for (uint32_t col = 0; col < matrix.cols; col++) {
+                uint32_t index = tables[m][(row / blockRows) * blocksPerRow + col / blockCols];
+                size_t word = poolStart + (static_cast<size_t>(index) * blockRows + row % blockRows) * blockCols +
+                              col % blockCols;
+                matrix.words[static_cast<size_t>(row) * matrix.cols + col] = getLE32(data + sizeof(uint32_t) * word);
+            }
+        }
+    }
+    return matrices;
+}
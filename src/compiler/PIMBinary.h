@@ -0,0 +1,186 @@
+/**
+ * PIMBinary.h
+ * Writes and reads compiled PIM programs in the binary container format
+ */
+
+#ifndef PIM_BINARY_H
+#define PIM_BINARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "PIMInstruction.h"
+#include "../include/CompilerConfig.h"
+#include "../include/PIMBinaryFormat.h"
+
+class PIMBinaryWriter {
+public:
+    /**
+     * Serialize a program into an in-memory binary container
+     * 
+     * @param instructions Instructions to encode
+     * @param archParams Architecture the program was compiled for
+     * @param isaVersion Encoding of the instructions (PIMEncoding)
+     * @param data Constant matrices of the program
+     * @return Container bytes
+     * @throws std::runtime_error if an instruction does not fit the encoding
+     */
+    static std::vector<uint8_t> serialize(const std::vector<PIMInstruction>& instructions,
+                                          const CompilerConfig::PIMArchParams& archParams,
+                                          unsigned isaVersion = PIMEncoding::V1,
+                                          const std::vector<PIMConstantMatrix>& data = {});
+    
+    /**
+     * Write a program to a binary container file with a single write
+     * 
+     * @param filename Output file
+     * @param instructions Instructions to encode
+     * @param archParams Architecture the program was compiled for
+     * @param isaVersion Encoding of the instructions (PIMEncoding)
+     * @param data Constant matrices of the program
+     * @throws std::runtime_error if an instruction does not fit the encoding
+     *         or the file cannot be written
+     */
+    static void write(const std::string& filename,
+                      const std::vector<PIMInstruction>& instructions,
+                      const CompilerConfig::PIMArchParams& archParams,
+                      unsigned isaVersion = PIMEncoding::V1,
+                      const std::vector<PIMConstantMatrix>& data = {});
+    
+    /**
+     * Encode constant matrices into a data section, storing identical
+     * blocks once (see PIMBinaryFormat)
+     * 
+     * @param data Constant matrices of the program
+     * @param blocks Receives the number of blocks before deduplication
+     * @return Section bytes, empty without matrices
+     */
+    static std::vector<uint8_t> encodeData(const std::vector<PIMConstantMatrix>& data, size_t* blocks = nullptr);
+    
+    /**
+     * Build the header for a container with the given section sizes
+     */
+    static PIMBinaryHeader makeHeader(const CompilerConfig::PIMArchParams& archParams,
+                                      uint32_t instructionCount, uint32_t dataSize,
+                                      unsigned isaVersion = PIMEncoding::V1);
+    
+    /**
+     * Encode one instruction into its little-endian instruction word
+     * 
+     * @param instruction Instruction to encode
+     * @param isaVersion Encoding (PIMEncoding)
+     * @param out Destination of PIMEncoding::wordBytes(isaVersion) bytes
+     * @throws std::runtime_error if a field is wider than the encoding
+     */
+    static void encodeInstruction(const PIMInstruction& instruction, unsigned isaVersion, uint8_t* out);
+    
+    /**
+     * Encode a header into its little-endian on-disk representation
+     * 
+     * @param header Header to encode
+     * @param out Destination of PIMBinaryFormat::HEADER_SIZE bytes
+     */
+    static void encodeHeader(const PIMBinaryHeader& header, uint8_t* out);
+};
+
+/**
+ * Zero-copy reader for PIM binary containers
+ * 
+ * The file is mapped read-only; instruction words are accessed in place.
+ */
+class PIMBinaryReader {
+public:
+    /**
+     * Map and validate a binary container file
+     * 
+     * @param filename File to open
+     * @throws std::runtime_error if the file cannot be mapped or is malformed
+     */
+    explicit PIMBinaryReader(const std::string& filename);
+    
+    /**
+     * Validate a container that is already in memory (not copied, not owned)
+     * 
+     * @param data Container bytes
+     * @param size Size of the container in bytes
+     * @throws std::runtime_error if the container is malformed
+     */
+    PIMBinaryReader(const uint8_t* data, size_t size);
+    
+    ~PIMBinaryReader();
+    
+    PIMBinaryReader(const PIMBinaryReader&) = delete;
+    PIMBinaryReader& operator=(const PIMBinaryReader&) = delete;
+    
+    /**
+     * Get the decoded header
+     */
+    const PIMBinaryHeader& getHeader() const;
+    
+    /**
+     * Get the number of instruction words
+     */
+    size_t getInstructionCount() const;
+    
+    /**
+     * Get the ISA version of the instructions (PIMEncoding)
+     */
+    unsigned getISAVersion() const;
+    
+    /**
+     * Get the instruction word at the given index (decoded from little-endian;
+     * 32-bit words are zero-extended)
+     */
+    uint64_t getInstruction(size_t index) const;
+    
+    /**
+     * Decode the instruction at the given index in the container's encoding
+     */
+    PIMInstruction decodeInstruction(size_t index) const;
+    
+    /**
+     * Get a pointer to the 32-bit instruction words inside the mapping
+     * 
+     * The words are little-endian; on little-endian hosts they can be used
+     * directly.
+     * 
+     * @throws std::runtime_error for extended containers, big-endian hosts or
+     *         a container buffer that is not aligned for 32-bit access
+     */
+    const uint32_t* getInstructionWords() const;
+    
+    /**
+     * Get a pointer to the 64-bit instruction words of an extended container
+     * inside the mapping
+     * 
+     * The text section starts on a SECTION_ALIGNMENT boundary, so the words
+     * of a mapped file can be read in place like those of getInstructionWords().
+     * 
+     * @throws std::runtime_error for version 1 containers, big-endian hosts or
+     *         a container buffer that is not aligned for 64-bit access
+     */
+    const uint64_t* getExtendedInstructionWords() const;
+    
+    /**
+     * Get the data section
+     */
+    const uint8_t* getData() const;
+
+    /**
+     * Decode the constant matrices of the data section
+     * 
+     * @throws std::runtime_error if the data section is malformed
+     */
+    std::vector<PIMConstantMatrix> getConstantMatrices() const;
+
+private:
+    const uint8_t* base;
+    size_t size;
+    bool mapped;
+    PIMBinaryHeader header;
+    
+    void validate();
+};
+
+#endif // PIM_BINARY_H
@@ -0,0 +1,135 @@
+/**
+ * PIMCompiler.cpp
+ * Implements the in-process compiler API
+ */
+
+#include "PIMCompiler.h"
+#include "InstructionSink.h"
+#include "PIMBinary.h"
+#include "../utils/Logger.h"
+#include "../utils/TimeProfiler.h"
+#include <sstream>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Support/raw_ostream.h>
+
+// Implementation of CompiledProgram
+
+std::string CompiledProgram::toText(unsigned isaVersion) const {
+    std::ostringstream text;
+    TextInstructionSink sink(text, isaVersion);
+    for (const auto& matrix : data) {
+        sink.emitData(matrix);
+    }
+    for (const auto& instruction : instructions) {
+        sink.emit(instruction);
+    }
+    sink.finish();
+    return text.str();
+}
+
+std::vector<uint8_t> CompiledProgram::toBinary(const CompilerConfig::PIMArchParams& archParams,
+                                               unsigned isaVersion) const {
+    return PIMBinaryWriter::serialize(instructions, archParams, isaVersion, data);
+}
+
+size_t CompiledProgram::byteSize() const {
+    size_t bytes = sizeof(CompiledProgram) + key.size() + schedule.size() + instructions.size() * sizeof(PIMInstruction);
+    for (const auto& matrix : data) {
+        bytes += sizeof(PIMConstantMatrix) + matrix.words.size() * sizeof(matrix.words[0]);
+    }
+    return bytes;
+}
+
+// Implementation of PIMCompiler
+
+PIMCompiler::PIMCompiler(const CompilerConfig& config)
+    : config(config), driver(config), keys(config) {}
+
+PIMCompiler::~PIMCompiler() = default;
+
+std::shared_ptr<const CompiledProgram> PIMCompiler::compileSource(const std::string& source) {
+    return compile("source.cpp", source);
+}
+
+std::shared_ptr<const CompiledProgram> PIMCompiler::compileIR(const std::string& ir, const std::string& name) {
+    const unsigned char* begin = reinterpret_cast<const unsigned char*>(ir.data());
+    bool bitcode = llvm::isBitcode(begin, begin + ir.size());
+    return compile(name + (bitcode ? ".bc" : ".ll"), ir);
+}
+
+std::shared_ptr<const CompiledProgram> PIMCompiler::compileModule(const llvm::Module& module) {
+    std::string bitcode;
+    {
+        llvm::raw_string_ostream out(bitcode);
+        llvm::WriteBitcodeToFile(module, out);
+    }
+    return compile(module.getModuleIdentifier() + ".bc", bitcode);
+}
+
+std::shared_ptr<const CompiledProgram> PIMCompiler::compile(const std::string& inputFile, const std::string& content) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string key = keys.computeKey(inputFile, content);
+    
+    auto cached = programs.find(key);
+    if (cached != programs.end()) {
+        stats.hits++;
+        recency.splice(recency.begin(), recency, cached->second.position);
+        PIM_LOG_DEBUG("In-memory cache hit for " + inputFile + " (" + key + ")");
+        return cached->second.program;
+    }
+    stats.misses++;
+    
+    ScopedTimer timer("Compile in memory", inputFile);
+    std::unique_ptr<llvm::Module> module = CompilerDriver::isIRFile(inputFile)
+        ? driver.buildIRModule(content, inputFile)
+        : driver.buildModule(inputFile, content);
+    
+    auto program = std::make_shared<CompiledProgram>();
+    program->key = key;
+    VectorInstructionSink sink(program->instructions, &program->data);
+    driver.generate(module, sink);
+    sink.finish();
+    if (!driver.getShardPlan().kernels.empty()) {
+        std::ostringstream schedule;
+        driver.getShardPlan().write(schedule);
+        program->schedule = schedule.str();
+    }
+    
+    insert(program);
+    return program;
+}
+
+void PIMCompiler::insert(const std::shared_ptr<const CompiledProgram>& program) {
+    size_t bytes = program->byteSize();
+    if (bytes > config.cache.maxBytes) {
+        return;
+    }
+    
+    recency.push_front(program->key);
+    programs[program->key] = {program, recency.begin()};
+    stats.entries++;
+    stats.bytes += bytes;
+    
+    while (stats.bytes > config.cache.maxBytes) {
+        auto oldest = programs.find(recency.back());
+        stats.bytes -= oldest->second.program->byteSize();
+        stats.entries--;
+        stats.evictions++;
+        programs.erase(oldest);
+        recency.pop_back();
+    }
+}
+
+PIMCompilerStats PIMCompiler::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void PIMCompiler::clearCache() {
+    std::lock_guard<std::mutex> lock(mutex);
+    programs.clear();
+    recency.clear();
+    stats.entries = 0;
+    stats.bytes = 0;
+}
@@ -0,0 +1,174 @@
+/**
+ * PIMCompiler.h
+ * In-process compiler API returning programs in memory
+ */
+
+#ifndef PIM_COMPILER_H
+#define PIM_COMPILER_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <llvm/IR/Module.h>
+#include "CompilerDriver.h"
+#include "CompilationCache.h"
+#include "PIMInstruction.h"
+#include "../include/CompilerConfig.h"
+
+/**
+ * Read-only view of the instructions of a compiled program
+ *
+ * The span does not own the instructions; it stays valid as long as the
+ * CompiledProgram it was taken from.
+ */
+struct InstructionSpan {
+    const PIMInstruction* data = nullptr;
+    size_t size = 0;
+    
+    const PIMInstruction* begin() const { return data; }
+    const PIMInstruction* end() const { return data + size; }
+    const PIMInstruction& operator[](size_t index) const { return data[index]; }
+    bool empty() const { return size == 0; }
+};
+
+/**
+ * A program compiled in memory
+ */
+struct CompiledProgram {
+    std::vector<PIMInstruction> instructions;
+    std::vector<PIMConstantMatrix> data;     // Constant matrices of the program
+    std::string key;                         // Compilation cache key of the input
+    std::string schedule;                    // Host schedule of a sharded program (ShardPlan::write)
+    
+    /**
+     * Get the instructions without copying them
+     */
+    InstructionSpan span() const { return {instructions.data(), instructions.size()}; }
+    
+    /**
+     * Format the program as the text output of pim_compiler
+     *
+     * @param isaVersion Instruction encoding (PIMEncoding)
+     */
+    std::string toText(unsigned isaVersion = PIMEncoding::V2) const;
+    
+    /**
+     * Serialize the program into a binary container (PIMBinaryFormat)
+     *
+     * @param archParams Architecture the program was compiled for
+     * @param isaVersion Instruction encoding (PIMEncoding)
+     */
+    std::vector<uint8_t> toBinary(const CompilerConfig::PIMArchParams& archParams,
+                                  unsigned isaVersion = PIMEncoding::V2) const;
+    
+    /**
+     * Get the memory held by the program, as charged to the in-memory cache
+     */
+    size_t byteSize() const;
+};
+
+/**
+ * Counters of the in-memory program cache
+ */
+struct PIMCompilerStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t entries = 0;       // Programs currently cached
+    size_t bytes = 0;         // Memory held by the cached programs
+};
+
+/**
+ * Compiles kernels inside the calling process
+ *
+ * Every compilation runs through one CompilerDriver, so the parser, the
+ * LLVM context and the pipeline stages are created once. Programs are
+ * cached in memory under the key CompilationCache computes for the input,
+ * and least recently used programs are dropped once the cache exceeds
+ * CacheParams::maxBytes (0 disables the cache); the on-disk cache is not
+ * used. Compilations are serialized, so one compiler may be shared by
+ * several threads.
+ */
+class PIMCompiler {
+public:
+    explicit PIMCompiler(const CompilerConfig& config);
+    ~PIMCompiler();
+    
+    PIMCompiler(const PIMCompiler&) = delete;
+    PIMCompiler& operator=(const PIMCompiler&) = delete;
+    
+    /**
+     * Compile C++ source
+     *
+     * @param source Source text
+     * @return Compiled program, shared with the cache
+     * @throws std::runtime_error if any stage fails
+     */
+    std::shared_ptr<const CompiledProgram> compileSource(const std::string& source);
+    
+    /**
+     * Compile LLVM IR held in memory
+     *
+     * @param ir Textual IR or bitcode
+     * @param name Name of the module in diagnostics
+     * @return Compiled program, shared with the cache
+     * @throws std::runtime_error if the IR is invalid or any stage fails
+     */
+    std::shared_ptr<const CompiledProgram> compileIR(const std::string& ir, const std::string& name = "module");
+    
+    /**
+     * Compile an LLVM module of any context
+     *
+     * The module is copied through bitcode into the compiler's context and
+     * is not modified.
+     *
+     * @param module Unmapped module containing the kernels
+     * @return Compiled program, shared with the cache
+     * @throws std::runtime_error if any stage fails
+     */
+    std::shared_ptr<const CompiledProgram> compileModule(const llvm::Module& module);
+    
+    /**
+     * Get the counters of the in-memory cache
+     */
+    PIMCompilerStats getStats() const;
+    
+    /**
+     * Drop every cached program; programs still referenced stay valid
+     */
+    void clearCache();
+
+private:
+    CompilerConfig config;
+    CompilerDriver driver;
+    CompilationCache keys;
+    
+    // Cached programs by key, and their keys from most to least recently used
+    struct CacheEntry {
+        std::shared_ptr<const CompiledProgram> program;
+        std::list<std::string>::iterator position;
+    };
+    std::unordered_map<std::string, CacheEntry> programs;
+    std::list<std::string> recency;
+    PIMCompilerStats stats;
+    mutable std::mutex mutex;
+    
+    /**
+     * Look up or compile one input
+     *
+     * @param inputFile Name whose extension selects C++, IR or bitcode
+     * @param content Contents of the input
+     */
+    std::shared_ptr<const CompiledProgram> compile(const std::string& inputFile, const std::string& content);
+    
+    /**
+     * Add a program to the cache and evict programs beyond the size bound
+     */
+    void insert(const std::shared_ptr<const CompiledProgram>& program);
+};
+
+#endif // PIM_COMPILER_H
@@ -6,12 +6,33 @@
 #include "PIMInstruction.h"
 #include <sstream>
 #include <iomanip>
+#include <type_traits>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+// Mnemonics indexed by PIMOpcode
+const char* const OPCODE_NAMES[] = {
+    "NOP", "LOAD", "STORE", "MOVE", "ADD", "SUB", "MUL", "DIV", "AND",
+    "OR", "XOR", "NOT", "SHL", "SHR", "JUMP", "JUMPZ", "JUMPNZ", "CONFIG", "SYNC",
+    "MAC", "LOAD_BLOCK", "STORE_BLOCK"
+};
+
+// Mnemonic and raw fields, for errors about instructions that cannot be encoded
+std::string describeOperands(const PIMInstruction& instruction) {
+    return std::string(PIMInstruction::getOpcodeName(instruction.getOpcode())) + " " +
+           std::to_string(instruction.getDest()) + ", " + std::to_string(instruction.getSrc1()) + ", " +
+           std::to_string(instruction.getSrc2()) + ", " + std::to_string(instruction.getImm());
+}
+
+} // namespace
 
 PIMInstruction::PIMInstruction(PIMOpcode opcode, unsigned dest, unsigned src1, unsigned src2, unsigned imm)
     : opcode(opcode), dest(dest), src1(src1), src2(src2), imm(imm) {}
 
-PIMInstruction::PIMInstruction(const PIMInstruction& other)
-    : opcode(other.opcode), dest(other.dest), src1(other.src1), src2(other.src2), imm(other.imm) {}
+// Instructions are copied in bulk by the sinks and containers
+static_assert(std::is_trivially_copyable<PIMInstruction>::value, "PIMInstruction must stay trivially copyable");
 
 PIMOpcode PIMInstruction::getOpcode() const {
     return opcode;
@@ -41,6 +62,10 @@ uint32_t PIMInstruction::toBinary() const {
     // - src1: 8 bits
     // - src2: 8 bits
     // - imm: 2 bits (as described in the paper, though this seems very small)
+    if (!fitsEncoding(PIMEncoding::V1)) {
+        throw std::runtime_error(describeOperands(*this) + " does not fit the 32-bit encoding of ISA version 1; "
+                                 "use --isa v2");
+    }
     
     uint32_t result = 0;
     result |= (static_cast<uint32_t>(opcode) & 0x3F) << 26;  // 6-bit opcode in the highest bits
@@ -52,49 +77,61 @@ uint32_t PIMInstruction::toBinary() const {
     return result;
 }
 
-std::string PIMInstruction::toString() const {
+uint64_t PIMInstruction::toExtendedBinary() const {
+    if (!fitsEncoding(PIMEncoding::V2)) {
+        throw std::runtime_error(describeOperands(*this) + " does not fit the 64-bit encoding of ISA version 2");
+    }
+    return PIMExtendedFormat::encode(opcode, dest, src1, src2, imm);
+}
+
+bool PIMInstruction::fitsEncoding(unsigned isaVersion) const {
+    if (isaVersion == PIMEncoding::V2) {
+        return opcode <= PIMExtendedFormat::OPCODE_MASK && dest <= PIMExtendedFormat::DEST_MASK &&
+               src1 <= PIMExtendedFormat::SRC1_MASK && src2 <= PIMExtendedFormat::SRC2_MASK &&
+               imm <= PIMExtendedFormat::IMM_MASK;
+    }
+    return opcode <= PIMInstructionFormat::OPCODE_MASK && dest <= PIMInstructionFormat::DEST_MASK &&
+           src1 <= PIMInstructionFormat::SRC1_MASK && src2 <= PIMInstructionFormat::SRC2_MASK &&
+           imm <= PIMInstructionFormat::IMM_MASK;
+}
+
+std::string PIMInstruction::toString(unsigned isaVersion) const {
     std::stringstream ss;
     
     // Add the opcode name
-    switch (opcode) {
-        case PIM_NOP:     ss << "NOP"; break;
-        case PIM_LOAD:    ss << "LOAD"; break;
-        case PIM_STORE:   ss << "STORE"; break;
-        case PIM_MOVE:    ss << "MOVE"; break;
-        case PIM_ADD:     ss << "ADD"; break;
-        case PIM_SUB:     ss << "SUB"; break;
-        case PIM_MUL:     ss << "MUL"; break;
-        case PIM_DIV:     ss << "DIV"; break;
-        case PIM_AND:     ss << "AND"; break;
-        case PIM_OR:      ss << "OR"; break;
-        case PIM_XOR:     ss << "XOR"; break;
-        case PIM_NOT:     ss << "NOT"; break;
-        case PIM_SHL:     ss << "SHL"; break;
-        case PIM_SHR:     ss << "SHR"; break;
-        case PIM_JUMP:    ss << "JUMP"; break;
-        case PIM_JUMPZ:   ss << "JUMPZ"; break;
-        case PIM_JUMPNZ:  ss << "JUMPNZ"; break;
-        case PIM_CONFIG:  ss << "CONFIG"; break;
-        default:          ss << "UNKNOWN"; break;
-    }
+    ss << getOpcodeName(opcode);
     
     // Format depends on instruction type
-    if (opcode == PIM_NOP) {
-        // NOP has no operands
+    if (opcode == PIM_NOP || opcode == PIM_SYNC) {
+        // NOP and SYNC have no operands
     } else if (opcode == PIM_CONFIG) {
-        // CONFIG has a parameter ID and value
+        // CONFIG has a parameter ID and value, and a lane count for PRECISION
         ss << " " << dest << ", " << src1;
+        if (src2 != 0) {
+            ss << ", " << src2;
+        }
     } else if (opcode == PIM_LOAD || opcode == PIM_STORE) {
         // Load/Store have memory addresses and optional row/column
         ss << " " << dest << ", " << src1;
         if (src2 != 0 || imm != 0) {
             ss << " [" << src2 << ", " << imm << "]";
         }
-    } else if (opcode == PIM_NOT || opcode == PIM_JUMP) {
+    } else if (opcode == PIM_LOAD_BLOCK || opcode == PIM_STORE_BLOCK) {
+        // Block transfers unpack the host buffer and show the word count and axis
+        unsigned packed = (opcode == PIM_LOAD_BLOCK) ? src1 : dest;
+        unsigned address = (opcode == PIM_LOAD_BLOCK) ? dest : src1;
+        unsigned buffer = PIMBlockOperand::buffer(packed);
+        ss << " " << (opcode == PIM_LOAD_BLOCK ? address : buffer) << ", "
+           << (opcode == PIM_LOAD_BLOCK ? buffer : address) << ", " << PIMBlockOperand::count(packed) << ", "
+           << PIMBlockOperand::axis(packed);
+        if (src2 != 0 || imm != 0) {
+            ss << " [" << src2 << ", " << imm << "]";
+        }
+    } else if (opcode == PIM_JUMP) {
         // Single operand instructions
         ss << " " << dest;
-    } else if (opcode == PIM_JUMPZ || opcode == PIM_JUMPNZ) {
-        // Conditional jumps
+    } else if (opcode == PIM_NOT || opcode == PIM_JUMPZ || opcode == PIM_JUMPNZ) {
+        // Two operand instructions (NOT dest, src; conditional jumps)
         ss << " " << dest << ", " << src1;
     } else {
         // Regular 3-operand instructions
@@ -104,8 +141,150 @@ std::string PIMInstruction::toString() const {
         }
     }
     
-    // Add the binary representation
-    ss << " ; 0x" << std::hex << std::setw(8) << std::setfill('0') << toBinary();
+    // Add the binary representation, which operands too wide for the encoding do not have
+    if (!fitsEncoding(isaVersion)) {
+        ss << " ; no " << PIMEncoding::wordBytes(isaVersion) * 8 << "-bit encoding";
+    } else if (isaVersion == PIMEncoding::V2) {
+        ss << " ; 0x" << std::hex << std::setw(16) << std::setfill('0') << toExtendedBinary();
+    } else {
+        ss << " ; 0x" << std::hex << std::setw(8) << std::setfill('0') << toBinary();
+    }
+    
+    return ss.str();
+}
+
+const char* PIMInstruction::getOpcodeName(PIMOpcode opcode) {
+    return (opcode >= PIM_NOP && opcode <= PIM_STORE_BLOCK) ? OPCODE_NAMES[opcode] : "UNKNOWN";
+}
+
+PIMInstruction PIMInstruction::fromBinary(uint32_t word) {
+    return PIMInstruction(PIMInstructionFormat::decodeOpcode(word),
+                          PIMInstructionFormat::decodeDest(word),
+                          PIMInstructionFormat::decodeSrc1(word),
+                          PIMInstructionFormat::decodeSrc2(word),
+                          PIMInstructionFormat::decodeImm(word));
+}
+
+PIMInstruction PIMInstruction::fromExtendedBinary(uint64_t word) {
+    return PIMInstruction(PIMExtendedFormat::decodeOpcode(word),
+                          PIMExtendedFormat::decodeDest(word),
+                          PIMExtendedFormat::decodeSrc1(word),
+                          PIMExtendedFormat::decodeSrc2(word),
+                          PIMExtendedFormat::decodeImm(word));
+}
+
+PIMInstruction PIMInstruction::parse(const std::string& text) {
+    // Drop the binary comment and split "OPCODE a, b [c, d]" into tokens
+    std::string body = text.substr(0, text.find(';'));
+    for (char& c : body) {
+        if (c == ',' || c == '[' || c == ']') {
+            c = ' ';
+        }
+    }
+    
+    std::stringstream ss(body);
+    std::string name;
+    if (!(ss >> name)) {
+        throw std::runtime_error("Empty PIM instruction");
+    }
+    
+    int opcode = -1;
+    for (int i = 0; i <= PIM_STORE_BLOCK; i++) {
+        if (name == OPCODE_NAMES[i]) {
+            opcode = i;
+            break;
+        }
+    }
+    if (opcode < 0) {
+        throw std::runtime_error("Unknown PIM opcode: " + name);
+    }
+    
+    std::vector<unsigned> operands;
+    std::string token;
+    while (ss >> token) {
+        try {
+            size_t consumed = 0;
+            unsigned long value = std::stoul(token, &consumed);
+            if (consumed != token.size()) {
+                throw std::invalid_argument(token);
+            }
+            operands.push_back(static_cast<unsigned>(value));
+        } catch (const std::logic_error&) {
+            throw std::runtime_error("Malformed operand '" + token + "' in PIM instruction: " + text);
+        }
+    }
+    
+    // Block transfers pack the word count and axis into the host buffer operand
+    if (opcode == PIM_LOAD_BLOCK || opcode == PIM_STORE_BLOCK) {
+        if (operands.size() > 6) {
+            throw std::runtime_error("Too many operands in PIM instruction: " + text);
+        }
+        operands.resize(6, 0);
+        if (opcode == PIM_LOAD_BLOCK) {
+            return PIMInstruction(PIM_LOAD_BLOCK, operands[0],
+                                  PIMBlockOperand::encode(operands[1], operands[2], operands[3]),
+                                  operands[4], operands[5]);
+        }
+        return PIMInstruction(PIM_STORE_BLOCK, PIMBlockOperand::encode(operands[0], operands[2], operands[3]),
+                              operands[1], operands[4], operands[5]);
+    }
+    
+    if (operands.size() > 4) {
+        throw std::runtime_error("Too many operands in PIM instruction: " + text);
+    }
+    operands.resize(4, 0);
     
+    return PIMInstruction(static_cast<PIMOpcode>(opcode), operands[0], operands[1], operands[2], operands[3]);
+}
+
+std::string PIMConstantMatrix::toString(size_t index) const {
+    std::stringstream ss;
+    for (unsigned row = 0; row < rows; row++) {
+        ss << "DATA " << index << ", " << row << ":";
+        for (unsigned col = 0; col < cols; col++) {
+            ss << " " << static_cast<int32_t>(word(row, col));
+        }
+        ss << '\n';
+    }
     return ss.str();
 }
+
+bool PIMConstantMatrix::isDataLine(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t");
+    return start != std::string::npos && text.compare(start, 5, "DATA ") == 0;
+}
+
+void PIMConstantMatrix::parseLine(const std::string& text, std::vector<PIMConstantMatrix>& matrices) {
+    std::string body = text.substr(0, text.find(';'));
+    size_t colon = body.find(':');
+    std::stringstream head(colon == std::string::npos ? std::string() : body.substr(0, colon));
+    std::string name;
+    size_t index = 0;
+    unsigned row = 0;
+    char comma = 0;
+    if (!(head >> name >> index >> comma >> row) || name != "DATA" || comma != ',') {
+        throw std::runtime_error("Malformed constant data line: " + text);
+    }
+    
+    // Rows extend the last matrix or start the next one
+    if (index == matrices.size() && row == 0) {
+        matrices.emplace_back();
+    }
+    if (index + 1 != matrices.size() || row != matrices[index].rows) {
+        throw std::runtime_error("Constant data row out of order: " + text);
+    }
+    
+    PIMConstantMatrix& matrix = matrices[index];
+    std::stringstream values(body.substr(colon + 1));
+    std::vector<uint32_t> words;
+    long long value = 0;
+    while (values >> value) {
+        words.push_back(static_cast<uint32_t>(static_cast<int32_t>(value)));
+    }
+    if (!values.eof() || (row > 0 && words.size() != matrix.cols)) {
+        throw std::runtime_error("Malformed constant data line: " + text);
+    }
+    matrix.cols = static_cast<unsigned>(words.size());
+    matrix.words.insert(matrix.words.end(), words.begin(), words.end());
+    matrix.rows++;
+}
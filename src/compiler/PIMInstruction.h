@@ -7,6 +7,7 @@
 #define PIM_INSTRUCTION_H
 
 #include <string>
+#include <vector>
 #include "../include/PIMInstructionSet.h"
 
 class PIMInstruction {
@@ -14,9 +15,6 @@ public:
     // Constructor
     PIMInstruction(PIMOpcode opcode, unsigned dest, unsigned src1, unsigned src2, unsigned imm);
     
-    // Copy constructor
-    PIMInstruction(const PIMInstruction& other);
-    
     // Accessors
     PIMOpcode getOpcode() const;
     unsigned getDest() const;
@@ -25,10 +23,34 @@ public:
     unsigned getImm() const;
     
     // Convert instruction to binary format
+    // Throws std::runtime_error if a field is wider than the encoding
     uint32_t toBinary() const;
     
-    // Convert instruction to string representation
-    std::string toString() const;
+    // Convert instruction to the 64-bit extended format of ISA version 2
+    // Throws std::runtime_error if a field is wider than the encoding
+    uint64_t toExtendedBinary() const;
+    
+    // Check whether every field fits the encoding of the given ISA version
+    bool fitsEncoding(unsigned isaVersion) const;
+    
+    // Convert instruction to string representation, annotated with its
+    // encoding in the given ISA version if it has one
+    std::string toString(unsigned isaVersion = PIMEncoding::V1) const;
+    
+    // Get the mnemonic of an opcode, or "UNKNOWN"
+    static const char* getOpcodeName(PIMOpcode opcode);
+    
+    // Decode an instruction from binary format
+    static PIMInstruction fromBinary(uint32_t word);
+    
+    // Decode an instruction from the extended format
+    static PIMInstruction fromExtendedBinary(uint64_t word);
+    
+    // Parse the string representation produced by toString(); the trailing
+    // "; 0x..." comment is optional and ignored, and block transfers take
+    // their word count as a separate operand
+    // Throws std::runtime_error on malformed input
+    static PIMInstruction parse(const std::string& text);
 
 private:
     PIMOpcode opcode; // Operation code
@@ -38,4 +60,32 @@ private:
     unsigned imm;     // Immediate value
 };
 
+/**
+ * Constant matrix in the data section of a program (see PIM_CONFIG_CONSTANT_B)
+ * 
+ * The text form lists the rows in order, one per line: "DATA m, row: w0 w1 ..."
+ * with the words of row row of matrix m as signed decimals.
+ */
+struct PIMConstantMatrix {
+    unsigned rows = 0;
+    unsigned cols = 0;
+    std::vector<uint32_t> words;  // Row-major
+    
+    // Get word [row, col], or 0 outside the matrix
+    uint32_t word(unsigned row, unsigned col) const {
+        return (row < rows && col < cols) ? words[static_cast<size_t>(row) * cols + col] : 0;
+    }
+    
+    // Convert the matrix to its text lines, as matrix index of the program
+    std::string toString(size_t index) const;
+    
+    // Check whether a line of a text program is a row of a constant matrix
+    static bool isDataLine(const std::string& text);
+    
+    // Parse a row line into the matrices of a program, which must already
+    // hold the rows before it
+    // Throws std::runtime_error on malformed input
+    static void parseLine(const std::string& text, std::vector<PIMConstantMatrix>& matrices);
+};
+
 #endif // PIM_INSTRUCTION_H
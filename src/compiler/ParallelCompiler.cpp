@@ -0,0 +1,196 @@
+/**
+ * ParallelCompiler.cpp
+ * Implements parallel per-function compilation
+ */
+
+#include "ParallelCompiler.h"
+#include "MatrixShapeAnalysis.h"
+#include "MemoryMapper.h"
+#include "PIMBackend.h"
+#include "ResidencyPlanner.h"
+#include "../utils/Logger.h"
+#include "../utils/TimeProfiler.h"
+#include "../include/PIMInstructionSet.h"
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+ParallelCompiler::ParallelCompiler(const CompilerConfig& config) : config(config) {}
+
+ParallelCompiler::~ParallelCompiler() = default;
+
+unsigned ParallelCompiler::getThreadCount(size_t functionCount) const {
+    unsigned threads = config.compileJobs;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, functionCount)));
+}
+
+size_t ParallelCompiler::compile(std::unique_ptr<llvm::Module>& module, InstructionSink& sink) {
+    PIM_LOG_INFO("Starting parallel PIM instruction generation");
+    
+    // One section per function definition, in module order
+    std::vector<Section> sections;
+    for (auto& function : *module) {
+        if (!function.isDeclaration()) {
+            sections.push_back({function.getName().str(), {}, {}});
+        }
+    }
+    
+    // Residency spans the kernels, so it is planned for the whole module up front
+    ResidencyPlan residency;
+    if (config.linkKernels && sections.size() > 1) {
+        ScopedTimer timer("Residency planning");
+        ShapeAnalysisResult shapes = MatrixShapeAnalysis(config).analyze(*module);
+        residency = ResidencyPlanner(config).plan(*module, shapes);
+    }
+    
+    // Workers cannot share the LLVMContext, so each parses its own copy of the module
+    std::string bitcode;
+    {
+        ScopedTimer timer("Module serialization");
+        llvm::raw_string_ostream bitcodeStream(bitcode);
+        llvm::WriteBitcodeToFile(*module, bitcodeStream);
+        bitcodeStream.flush();
+    }
+    
+    unsigned threadCount = getThreadCount(sections.size());
+    PIM_LOG_INFO("Compiling " + std::to_string(sections.size()) + " functions on " +
+                std::to_string(threadCount) + " threads");
+    
+    std::vector<std::string> errors(sections.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threadCount; i++) {
+        workers.emplace_back([&]() { runWorker(bitcode, residency, sections, errors, next); });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    
+    // Report the first failure in module order so errors do not depend on scheduling
+    for (size_t i = 0; i < sections.size(); i++) {
+        if (!errors[i].empty()) {
+            throw std::runtime_error(errors[i]);
+        }
+    }
+    
+    ScopedTimer timer("Section linking");
+    size_t start = sink.getCount();
+    for (const auto& section : sections) {
+        linkSection(section, sink);
+    }
+    
+    size_t generated = sink.getCount() - start;
+    PIM_LOG_INFO("Generated " + std::to_string(generated) + " PIM instructions");
+    return generated;
+}
+
+void ParallelCompiler::runWorker(const std::string& bitcode, const ResidencyPlan& residency,
+                                 std::vector<Section>& sections, std::vector<std::string>& errors,
+                                 std::atomic<size_t>& next) const {
+    ScopedTimer workerTimer("Parallel worker");
+    llvm::LLVMContext context;
+    std::unique_ptr<llvm::Module> module;
+    
+    std::string parseError;
+    {
+        ScopedTimer timer("Module copy");
+        auto buffer = llvm::MemoryBuffer::getMemBuffer(bitcode, "pim_module", false);
+        auto parsed = llvm::parseBitcodeFile(buffer->getMemBufferRef(), context);
+        if (parsed) {
+            module = std::move(*parsed);
+        } else {
+            parseError = "Failed to copy module for parallel compilation: " + llvm::toString(parsed.takeError());
+        }
+    }
+    
+    MatrixShapeAnalysis shapeAnalysis(config);
+    MemoryMapper memoryMapper(config);
+    PIMBackend backend(config);
+    
+    for (size_t index = next++; index < sections.size(); index = next++) {
+        Section& section = sections[index];
+        if (!module) {
+            errors[index] = parseError;
+            continue;
+        }
+        
+        try {
+            llvm::Function* function = module->getFunction(section.functionName);
+            if (!function) {
+                throw std::runtime_error("Function " + section.functionName + " missing from module copy");
+            }
+            
+            // Each section starts at 0; linkSection moves it to its final position
+            ShapeAnalysisResult shapes;
+            {
+                ScopedTimer timer("Shape analysis", section.functionName);
+                shapes = shapeAnalysis.analyze(*function);
+            }
+            {
+                ScopedTimer timer("Memory mapping", section.functionName);
+                memoryMapper.applyMemoryMapping(*function, shapes);
+            }
+            ScopedTimer timer("Code generation", section.functionName);
+            VectorInstructionSink sectionSink(section.instructions, &section.data);
+            backend.generateFunctionInstructions(*function, shapes, sectionSink, &residency);
+        } catch (const std::exception& e) {
+            errors[index] = section.functionName + ": " + e.what();
+        }
+    }
+}
+
+void ParallelCompiler::linkSection(const Section& section, InstructionSink& sink) const {
+    const size_t base = sink.getCount();
+    
+    // The kernel marker precedes the constant matrices, as in a serial build
+    size_t first = 0;
+    if (!section.instructions.empty() && section.instructions[0].getOpcode() == PIM_CONFIG &&
+        section.instructions[0].getDest() == PIM_CONFIG_KERNEL) {
+        sink.emit(section.instructions[0]);
+        first = 1;
+    }
+    
+    size_t dataBase = 0;
+    for (size_t m = 0; m < section.data.size(); m++) {
+        size_t index = sink.emitData(section.data[m]);
+        if (m == 0) {
+            dataBase = index;
+        }
+    }
+    
+    for (size_t i = first; i < section.instructions.size(); i++) {
+        const PIMInstruction& instruction = section.instructions[i];
+        PIMOpcode opcode = instruction.getOpcode();
+        if (opcode == PIM_CONFIG && instruction.getDest() == PIM_CONFIG_CONSTANT_B &&
+            instruction.getSrc1() != 0) {
+            // Matrix m + 1 of the section is matrix dataBase + m + 1 of the program
+            sink.emit(PIMInstruction(opcode, instruction.getDest(),
+                                     static_cast<unsigned>(dataBase + instruction.getSrc1()),
+                                     instruction.getSrc2(), instruction.getImm()));
+            continue;
+        }
+        if (opcode != PIM_JUMP && opcode != PIM_JUMPZ && opcode != PIM_JUMPNZ) {
+            sink.emit(instruction);
+            continue;
+        }
+        
+        // Jump targets are absolute instruction indices
+        size_t target = base + instruction.getDest();
+        if (target >= PIMEncoding::operandLimit(config.isaVersion)) {
+            throw std::runtime_error("Function " + section.functionName + " at instruction " +
+                                     std::to_string(base) + " exceeds the jump target range of ISA version " +
+                                     std::to_string(config.isaVersion));
+        }
+        sink.emit(PIMInstruction(opcode, static_cast<unsigned>(target), instruction.getSrc1(),
+                                 instruction.getSrc2(), instruction.getImm()));
+    }
+}
@@ -0,0 +1,96 @@
+/**
+ * ParallelCompiler.h
+ * Lowers the functions of a module to PIM instructions on a thread pool
+ */
+
+#ifndef PARALLEL_COMPILER_H
+#define PARALLEL_COMPILER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <llvm/IR/Module.h>
+#include "PIMInstruction.h"
+#include "InstructionSink.h"
+#include "ResidencyPlanner.h"
+#include "../include/CompilerConfig.h"
+
+class ParallelCompiler {
+public:
+    /**
+     * @param config Compiler configuration; compileJobs sets the thread count
+     *        (0 uses every hardware thread)
+     */
+    explicit ParallelCompiler(const CompilerConfig& config);
+    ~ParallelCompiler();
+    
+    /**
+     * Run shape analysis, memory mapping and PIM code generation for every
+     * function of a module in parallel
+     *
+     * The residency of operands shared by the kernels (ResidencyPlanner) is
+     * planned on the calling thread before the workers start.
+     *
+     * The module is serialized to bitcode once and every worker parses its
+     * own copy into a private llvm::LLVMContext, so no LLVM state is shared
+     * between threads. Workers take functions in module order and lower each
+     * into its own section; the sections are then linked into the sink in
+     * module order with their jump targets relocated, so the output is
+     * identical to the serial pipeline whatever the thread count.
+     *
+     * @param module LLVM module to compile (not modified)
+     * @param sink Sink receiving the linked instructions; finish() is left to the caller
+     * @return Number of instructions emitted
+     * @throws std::runtime_error if the module cannot be copied, a function
+     *         fails to compile (the first failure in module order is
+     *         reported) or a relocated jump target exceeds the jump field of the
+     *         ISA version
+     */
+    size_t compile(std::unique_ptr<llvm::Module>& module, InstructionSink& sink);
+    
+    /**
+     * Get the number of worker threads compile() uses for a module
+     *
+     * @param functionCount Number of function definitions to compile
+     * @return Thread count, at least 1 and at most functionCount
+     */
+    unsigned getThreadCount(size_t functionCount) const;
+
+private:
+    CompilerConfig config;
+    
+    /**
+     * Instructions generated for one function, with targets and constant
+     * matrices relative to 0
+     */
+    struct Section {
+        std::string functionName;
+        std::vector<PIMInstruction> instructions;
+        std::vector<PIMConstantMatrix> data;
+    };
+    
+    /**
+     * Compile part of the module in a worker thread
+     *
+     * @param bitcode Serialized module
+     * @param residency Placement of the kernels, planned for the whole module
+     * @param sections Sections to fill, one per function definition
+     * @param errors Error message per section, empty on success
+     * @param next Index of the next unclaimed section, shared by the workers
+     */
+    void runWorker(const std::string& bitcode, const ResidencyPlan& residency,
+                   std::vector<Section>& sections, std::vector<std::string>& errors,
+                   std::atomic<size_t>& next) const;
+    
+    /**
+     * Append a section to the sink, relocating its jump targets and the
+     * constant matrices it selects
+     *
+     * @param section Section to link
+     * @param sink Sink receiving the instructions
+     */
+    void linkSection(const Section& section, InstructionSink& sink) const;
+};
+
+#endif // PARALLEL_COMPILER_H
@@ -35,7 +35,7 @@ public:
         clang::RecursiveASTVisitor<ParserASTConsumer> visitor;
         visitor.TraverseDecl(parser->translationUnit);
         
-        Logger::getInstance().log("Translation unit parsed successfully");
+        PIM_LOG_INFO("Translation unit parsed successfully");
     }
 };
 
@@ -68,7 +68,11 @@ public:
 #endif
 
 #ifdef HAVE_CLANG
-Parser::Parser() : translationUnit(nullptr) {}
+Parser::Parser() : translationUnit(nullptr) {
+    // The command line is the same for every input, so batch compilations reuse it
+    std::vector<std::string> args = {"-std=c++14", "-fsyntax-only"};
+    compilations = std::make_unique<clang::tooling::FixedCompilationDatabase>(".", args);
+}
 #else
 Parser::Parser() {}
 #endif
@@ -77,11 +81,9 @@ Parser::~Parser() = default;
 
 #ifdef HAVE_CLANG
 std::unique_ptr<clang::ASTContext> Parser::parse(const std::string& source) {
-    // Create compilation database and tool
-    std::vector<std::string> args = {"-std=c++14", "-fsyntax-only"};
-    std::unique_ptr<clang::tooling::CompilationDatabase> compilations =
-        clang::tooling::FixedCompilationDatabase::loadFromCommandLine(
-            args.size(), args.data());
+    // Clear the result of a previous parse
+    astContext.reset();
+    translationUnit = nullptr;
     
     // Create source file
     llvm::SmallString<1024> sourceBuffer;
@@ -107,11 +109,11 @@ std::unique_ptr<clang::ASTContext> Parser::parse(const std::string& source) {
 #else
 void* Parser::parse(const std::string& source) {
     // Simple implementation for environments without Clang
-    Logger::getInstance().log("Using simplified parser (Clang not available)");
-    Logger::getInstance().log("Source code will be processed using hardcoded patterns");
+    PIM_LOG_INFO("Using simplified parser (Clang not available)");
+    PIM_LOG_INFO("Source code will be processed using hardcoded patterns");
     
     // Log the source code for debugging
-    Logger::getInstance().log("Source code to parse:\n" + source);
+    PIM_LOG_DEBUG("Source code to parse:\n" + source);
     
     // Return nullptr - in a real implementation we might parse the source more intelligently
     return nullptr;
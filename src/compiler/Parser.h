@@ -59,6 +59,9 @@ private:
 #ifdef HAVE_CLANG
     std::unique_ptr<clang::ASTContext> astContext;
     clang::TranslationUnitDecl* translationUnit;
+    
+    // Created once and shared by every parse() of this parser
+    std::unique_ptr<clang::tooling::CompilationDatabase> compilations;
 #endif
     
     friend class ParserASTConsumer;
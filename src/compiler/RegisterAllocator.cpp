@@ -0,0 +1,48 @@
+/**
+ * RegisterAllocator.cpp
+ * Implementation of the PIM register allocator
+ */
+
+#include "RegisterAllocator.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace {
+// Number of general purpose registers (REG0 - REG7); PC and STATUS are not allocatable
+const unsigned NUM_GENERAL_REGISTERS = PIM_REG7 + 1;
+}
+
+RegisterAllocator::RegisterAllocator(unsigned registerFileSize)
+    : inUse(std::min(registerFileSize, NUM_GENERAL_REGISTERS), false) {}
+
+RegisterAllocator::~RegisterAllocator() = default;
+
+PIMRegister RegisterAllocator::allocate() {
+    for (unsigned reg = 0; reg < inUse.size(); ++reg) {
+        if (!inUse[reg]) {
+            inUse[reg] = true;
+            return static_cast<PIMRegister>(reg);
+        }
+    }
+    
+    throw std::runtime_error("PIM register file exhausted (" + std::to_string(inUse.size()) + " registers)");
+}
+
+void RegisterAllocator::release(PIMRegister reg) {
+    if (static_cast<unsigned>(reg) < inUse.size()) {
+        inUse[reg] = false;
+    }
+}
+
+void RegisterAllocator::releaseAll() {
+    std::fill(inUse.begin(), inUse.end(), false);
+}
+
+unsigned RegisterAllocator::numFree() const {
+    return static_cast<unsigned>(std::count(inUse.begin(), inUse.end(), false));
+}
+
+unsigned RegisterAllocator::capacity() const {
+    return static_cast<unsigned>(inUse.size());
+}
@@ -0,0 +1,57 @@
+/**
+ * RegisterAllocator.h
+ * Allocates registers from the PIM register file during code generation
+ */
+
+#ifndef REGISTER_ALLOCATOR_H
+#define REGISTER_ALLOCATOR_H
+
+#include <vector>
+#include "../include/PIMInstructionSet.h"
+
+class RegisterAllocator {
+public:
+    /**
+     * Create an allocator over REG0 .. REG(registerFileSize - 1)
+     * 
+     * @param registerFileSize Number of registers per PE (capped at the
+     *                         general purpose registers defined by the ISA)
+     */
+    explicit RegisterAllocator(unsigned registerFileSize);
+    ~RegisterAllocator();
+
+    /**
+     * Allocate the lowest-numbered free register
+     * 
+     * @return Allocated register
+     * @throws std::runtime_error if the register file is exhausted
+     */
+    PIMRegister allocate();
+    
+    /**
+     * Return a register to the free pool
+     * 
+     * @param reg Register previously returned by allocate()
+     */
+    void release(PIMRegister reg);
+    
+    /**
+     * Return all registers to the free pool
+     */
+    void releaseAll();
+    
+    /**
+     * Get the number of registers currently free
+     */
+    unsigned numFree() const;
+    
+    /**
+     * Get the number of registers managed by this allocator
+     */
+    unsigned capacity() const;
+
+private:
+    std::vector<bool> inUse;
+};
+
+#endif // REGISTER_ALLOCATOR_H
@@ -0,0 +1,317 @@
+/**
+ * ResidencyPlanner.cpp
+ * Implements residency planning across the kernels of a module
+ */
+
+#include "ResidencyPlanner.h"
+#include "PIMBackend.h"
+#include "../utils/Logger.h"
+#include "../include/PIMInstructionSet.h"
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/ValueSymbolTable.h>
+#include <algorithm>
+#include <set>
+
+namespace {
+
+// One kernel of the module, in module order
+struct Kernel {
+    std::string function;
+    const KernelShape* shape = nullptr;
+    bool linkable = false;      // planLinkedLayout accepted it
+    LayoutPlan layout;          // Own placement from address 0
+    unsigned words = 0;         // Words of the layout and the bias vectors behind it
+    std::string a;              // Globals of the operands, empty for other operands
+    std::string b;
+    std::string c;
+};
+
+// Matrix an earlier kernel left in PIM memory
+struct Resident {
+    std::string name;
+    MatrixLayout layout;
+    size_t producer;            // Kernel that computed or loaded it
+    bool result;                // The C of producer, rather than an operand it loaded
+    
+    unsigned begin() const { return layout.base; }
+    unsigned end() const { return layout.base + layout.size(); }
+};
+
+// Global a kernel operand is based on, empty if the name is local to the function
+std::string globalOperand(const llvm::Module& module, const llvm::Function& function, const std::string& name) {
+    if (name.empty() || !module.getGlobalVariable(name, true)) {
+        return "";
+    }
+    const llvm::ValueSymbolTable* locals = function.getValueSymbolTable();
+    return (locals && locals->lookup(name)) ? "" : name;
+}
+
+// Collect the functions whose instructions use a value, through constant
+// expressions; false if anything else uses it
+bool collectUsers(const llvm::Value* value, std::set<const llvm::Function*>& functions) {
+    for (const llvm::User* user : value->users()) {
+        if (const auto* instruction = llvm::dyn_cast<llvm::Instruction>(user)) {
+            functions.insert(instruction->getFunction());
+        } else if (!llvm::isa<llvm::ConstantExpr>(user) || !collectUsers(user, functions)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Check whether a layout holds every word of a rows x cols matrix of 32-bit elements
+bool isDense(const MatrixLayout& layout, unsigned rows, unsigned cols) {
+    return layout.rows == rows && layout.cols == cols && layout.lanes == 1 && !layout.isCompressed();
+}
+
+// Check whether two layouts place the words of a matrix alike, whatever their base
+bool sameLayout(const MatrixLayout& x, const MatrixLayout& y) {
+    return x.rows == y.rows && x.cols == y.cols && x.columnMajor == y.columnMajor && x.lanes == y.lanes &&
+           x.packRows == y.packRows && x.slots == y.slots && x.storedWords == y.storedWords;
+}
+
+unsigned alignUp(unsigned value, unsigned alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+const KernelResidency* ResidencyPlan::lookup(const std::string& functionName) const {
+    auto it = kernels.find(functionName);
+    return it == kernels.end() ? nullptr : &it->second;
+}
+
+ResidencyPlanner::ResidencyPlanner(const CompilerConfig& config) : config(config) {}
+
+ResidencyPlanner::~ResidencyPlanner() = default;
+
+ResidencyPlan ResidencyPlanner::plan(const llvm::Module& module, const ShapeAnalysisResult& shapes) const {
+    ResidencyPlan result;
+    if (!config.linkKernels || config.symbolicDimensions) {
+        return result;
+    }
+    
+    PIMBackend backend(config);
+    std::vector<Kernel> kernels;
+    std::map<const llvm::Function*, size_t> kernelOf;
+    for (const auto& function : module) {
+        const KernelShape* shape = function.isDeclaration() ? nullptr : shapes.lookup(function.getName().str());
+        if (!shape) {
+            continue;
+        }
+        Kernel kernel;
+        kernel.function = function.getName().str();
+        kernel.shape = shape;
+        kernel.a = globalOperand(module, function, shape->matrixA);
+        kernel.b = globalOperand(module, function, shape->matrixB);
+        kernel.c = globalOperand(module, function, shape->matrixC);
+        unsigned vectorWords = 0;
+        kernel.linkable = backend.planLinkedLayout(*shape, kernel.layout, vectorWords) &&
+                          (kernel.c.empty() || (kernel.c != kernel.a && kernel.c != kernel.b));
+        kernel.words = kernel.layout.footprint() + vectorWords;
+        kernelOf[&function] = kernels.size();
+        kernels.push_back(std::move(kernel));
+    }
+    if (kernels.size() < 2) {
+        return result;
+    }
+    
+    const auto& arch = config.archParams;
+    const unsigned memoryWords = arch.numMemoryBanks * (arch.memoryBankSize / std::max(1u, arch.wordSize / 8));
+    const unsigned capacity = std::min(memoryWords, PIMEncoding::operandLimit(config.isaVersion));
+    const unsigned alignment = std::max(1u, arch.numMemoryBanks);
+    
+    // First kernel from index on that reads a global as A or B, before any kernel writes it
+    auto nextUse = [&](const std::string& name, size_t from) {
+        for (size_t j = from; j < kernels.size(); j++) {
+            if (kernels[j].a == name || kernels[j].b == name) {
+                return j;
+            }
+            if (kernels[j].c == name) {
+                break;
+            }
+        }
+        return kernels.size();
+    };
+    
+    std::vector<Resident> live;
+    std::vector<bool> spilled(kernels.size(), false);
+    std::vector<std::set<size_t>> residentReaders(kernels.size());
+    auto find = [&](const std::string& name) {
+        return std::find_if(live.begin(), live.end(), [&](const Resident& r) { return r.name == name; });
+    };
+    auto evict = [&](std::vector<Resident>::iterator victim, const std::string& reason) {
+        if (victim->result) {
+            spilled[victim->producer] = true;
+        }
+        PIM_LOG_INFO("Spilling " + victim->name + " to the host: " + reason);
+        live.erase(victim);
+    };
+    
+    for (size_t i = 0; i < kernels.size(); i++) {
+        const Kernel& kernel = kernels[i];
+        const KernelShape& shape = *kernel.shape;
+        KernelResidency& entry = result.kernels[kernel.function];
+        entry.index = static_cast<unsigned>(i);
+        if (!kernel.linkable) {
+            while (!live.empty()) {
+                evict(live.begin(), kernel.function + " is not lowered untiled on a single PE");
+            }
+            continue;
+        }
+        
+        // Operands earlier kernels left in PIM memory in a layout this kernel can read
+        auto residentA = find(kernel.a);
+        bool readA = !kernel.a.empty() && residentA != live.end() &&
+                     isDense(residentA->layout, shape.rows, shape.common);
+        auto residentB = find(kernel.b);
+        bool readB = !kernel.b.empty() && residentB != live.end() && residentB->layout.size() > 0 &&
+                     (sameLayout(residentB->layout, kernel.layout.b) ||
+                      (isDense(residentB->layout, shape.common, shape.cols) && !kernel.layout.b.isCompressed()));
+        auto isInput = [&](const Resident& r) {
+            return (readA && r.name == kernel.a) || (readB && r.name == kernel.b);
+        };
+        
+        // Place the kernel above its resident operands and clear of the
+        // others, spilling the operand needed last until it fits
+        bool fits = false;
+        unsigned base = 0;
+        for (;;) {
+            unsigned minBase = 0;
+            for (const auto& r : live) {
+                if (isInput(r)) {
+                    minBase = std::max(minBase, r.end());
+                }
+            }
+            base = alignUp(minBase, alignment);
+            while (base + kernel.words <= capacity) {
+                auto clash = std::find_if(live.begin(), live.end(), [&](const Resident& r) {
+                    return r.begin() < base + kernel.words && base < r.end();
+                });
+                if (clash == live.end()) {
+                    fits = true;
+                    break;
+                }
+                base = alignUp(clash->end(), alignment);
+            }
+            if (fits || live.empty()) {
+                break;
+            }
+            
+            auto victim = live.end();
+            size_t victimUse = 0;
+            for (auto it = live.begin(); it != live.end(); ++it) {
+                size_t use = isInput(*it) ? i : nextUse(it->name, i);
+                if (victim == live.end() || use > victimUse) {
+                    victim = it;
+                    victimUse = use;
+                }
+            }
+            evict(victim, "no room for " + kernel.function);
+            readA = readA && find(kernel.a) != live.end();
+            readB = readB && find(kernel.b) != live.end();
+        }
+        if (!fits) {
+            PIM_LOG_INFO(kernel.function + " needs " + std::to_string(kernel.words) +
+                        " words and is lowered on its own");
+            continue;
+        }
+        
+        entry.resident = true;
+        entry.layout = kernel.layout;
+        entry.layout.a.base += base;
+        entry.layout.b.base += base;
+        entry.layout.c.base += base;
+        if (readA) {
+            const Resident& r = *find(kernel.a);
+            entry.layout.a = r.layout;
+            entry.residentA = true;
+            if (r.result) {
+                residentReaders[r.producer].insert(i);
+            }
+            result.residentOperands++;
+            result.wordsNotLoaded += r.layout.size();
+            PIM_LOG_INFO(kernel.function + " reads A (" + kernel.a + ") from PIM memory at " +
+                        std::to_string(r.begin()) + ", left by " + kernels[r.producer].function);
+        }
+        if (readB) {
+            const Resident& r = *find(kernel.b);
+            entry.layout.b = r.layout;
+            entry.residentB = true;
+            if (r.result) {
+                residentReaders[r.producer].insert(i);
+            }
+            result.residentOperands++;
+            result.wordsNotLoaded += r.layout.size();
+            PIM_LOG_INFO(kernel.function + " reads B (" + kernel.b + ") from PIM memory at " +
+                        std::to_string(r.begin()) + ", left by " + kernels[r.producer].function);
+        }
+        PIM_LOG_INFO("Placing " + kernel.function + " at " + std::to_string(base) + ": " +
+                    entry.layout.describe());
+        
+        // C replaces the value of its global, and matrices no later kernel
+        // reads are released; what later kernels read stays
+        live.erase(std::remove_if(live.begin(), live.end(), [&](const Resident& r) {
+            return r.name == kernel.c || nextUse(r.name, i + 1) == kernels.size();
+        }), live.end());
+        const std::pair<const std::string*, const MatrixLayout*> loaded[] = {
+            {readA ? nullptr : &kernel.a, &entry.layout.a}, {readB ? nullptr : &kernel.b, &entry.layout.b}
+        };
+        for (const auto& [name, layout] : loaded) {
+            if (name && !name->empty() && layout->size() > 0 && find(*name) == live.end() &&
+                nextUse(*name, i + 1) < kernels.size()) {
+                live.push_back({*name, *layout, i, false});
+            }
+        }
+        if (!kernel.c.empty() && nextUse(kernel.c, i + 1) < kernels.size()) {
+            live.push_back({kernel.c, entry.layout.c, i, true});
+        }
+    }
+    
+    // A C whose every reader found it resident and that the host cannot
+    // read is not stored
+    std::map<std::string, unsigned> writers;
+    for (const auto& kernel : kernels) {
+        if (!kernel.c.empty()) {
+            writers[kernel.c]++;
+        }
+    }
+    for (size_t p = 0; p < kernels.size(); p++) {
+        const Kernel& kernel = kernels[p];
+        KernelResidency& entry = result.kernels[kernel.function];
+        if (!entry.resident || kernel.c.empty() || spilled[p] || residentReaders[p].empty() ||
+            writers[kernel.c] != 1) {
+            continue;
+        }
+        
+        const llvm::GlobalVariable* global = module.getGlobalVariable(kernel.c, true);
+        std::set<const llvm::Function*> users;
+        if (!global->hasLocalLinkage() || !collectUsers(global, users)) {
+            continue;
+        }
+        bool privateResult = std::all_of(users.begin(), users.end(), [&](const llvm::Function* function) {
+            auto it = kernelOf.find(function);
+            if (it == kernelOf.end()) {
+                return false;
+            }
+            const auto& epilogue = kernels[it->second].shape->epilogue;
+            bool biasVector = std::any_of(epilogue.begin(), epilogue.end(), [&](const EpilogueOp& op) {
+                return op.isBias() && op.vector == kernel.c;
+            });
+            return it->second == p || (residentReaders[p].count(it->second) && !biasVector);
+        });
+        if (!privateResult) {
+            continue;
+        }
+        entry.storeC = false;
+        result.wordsNotStored += entry.layout.c.size();
+        PIM_LOG_INFO("Keeping C (" + kernel.c + ") of " + kernel.function + " in PIM memory without storing it");
+    }
+    
+    PIM_LOG_INFO("Linked " + std::to_string(kernels.size()) + " kernels: " +
+                std::to_string(result.residentOperands) + " operands resident, " +
+                std::to_string(result.wordsNotLoaded) + " host words not loaded, " +
+                std::to_string(result.wordsNotStored) + " not stored");
+    return result;
+}
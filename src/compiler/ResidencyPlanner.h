@@ -0,0 +1,84 @@
+/**
+ * ResidencyPlanner.h
+ * Plans which operands stay in PIM memory between the kernels of a module
+ */
+
+#ifndef RESIDENCY_PLANNER_H
+#define RESIDENCY_PLANNER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <llvm/IR/Module.h>
+#include "LayoutPlanner.h"
+#include "MatrixShapeAnalysis.h"
+#include "../include/CompilerConfig.h"
+
+/**
+ * Placement of one kernel of a linked program
+ */
+struct KernelResidency {
+    unsigned index = 0;          // Kernel number of the PIM_CONFIG_KERNEL marker
+    bool resident = false;       // Lowered with layout instead of its own placement
+    LayoutPlan layout;           // Placement in PIM memory, including the resident operands
+    bool residentA = false;      // A was left in PIM memory by an earlier kernel and is not loaded
+    bool residentB = false;
+    bool storeC = true;          // C is stored to the host
+};
+
+/**
+ * Placement of the kernels of a module, by function name
+ *
+ * An empty plan leaves every kernel to be lowered on its own.
+ */
+struct ResidencyPlan {
+    std::map<std::string, KernelResidency> kernels;
+    unsigned residentOperands = 0;  // Operands read from PIM memory instead of the host
+    uint64_t wordsNotLoaded = 0;    // Host words the resident operands save
+    uint64_t wordsNotStored = 0;    // Words of C kept in PIM memory instead of being stored
+    
+    /**
+     * Get the placement of the kernel in the given function
+     *
+     * @param functionName Function name
+     * @return Placement, or nullptr if the program is not linked or the function is not a kernel
+     */
+    const KernelResidency* lookup(const std::string& functionName) const;
+};
+
+class ResidencyPlanner {
+public:
+    explicit ResidencyPlanner(const CompilerConfig& config);
+    ~ResidencyPlanner();
+    
+    /**
+     * Plan the residency of the operands of a module's kernels
+     *
+     * Kernels run in module order, each numbered by its PIM_CONFIG_KERNEL
+     * marker. A global matrix a kernel reads as A or B stays in PIM memory
+     * when it is the C of an earlier kernel, or the B an earlier kernel
+     * loaded, with the dimensions and layout the reader needs and no
+     * kernel writing it in between. Every resident kernel is placed, bank
+     * aligned and first fit, above the operands it reads and clear of those
+     * later kernels still read, within the PIM memory
+     * (numMemoryBanks * memoryBankSize) and the address field of the ISA
+     * version. Operands that leave no room are spilled, those read last
+     * first, and reloaded from the host by their later readers.
+     *
+     * A C is not stored when its global has internal linkage and no uses
+     * outside kernels, and every other kernel using it reads it resident.
+     * Kernels planLinkedLayout rejects, such as tiled kernels, address the
+     * memory of the whole array and spill every resident operand.
+     *
+     * @param module Unmapped module containing the kernels
+     * @param shapes Kernel shapes from MatrixShapeAnalysis
+     * @return Placement of every kernel; empty with CompilerConfig::linkKernels
+     *         off, symbolic dimensions or fewer than two kernels
+     */
+    ResidencyPlan plan(const llvm::Module& module, const ShapeAnalysisResult& shapes) const;
+
+private:
+    CompilerConfig config;
+};
+
+#endif // RESIDENCY_PLANNER_H
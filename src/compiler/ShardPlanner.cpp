@@ -0,0 +1,566 @@
+/**
+ * ShardPlanner.cpp
+ * Implements the partitioning of kernels over PIM devices and their host schedule
+ */
+
+#include "ShardPlanner.h"
+#include "LayoutPlanner.h"
+#include "../utils/Logger.h"
+#include "../include/PIMInstructionSet.h"
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Cycles a word occupies the host link all devices share, as in PEScheduler
+const double HOST_CYCLES_PER_WORD = 1.0;
+
+// Cycles a word occupies the link into the device receiving it; the links
+// between devices are point to point and several carry words at once
+const double DEVICE_CYCLES_PER_WORD = 0.25;
+
+using Strategy = CompilerConfig::ShardingParams::Strategy;
+
+const Strategy STRATEGIES[] = {CompilerConfig::ShardingParams::SHARD_ROWS,
+                               CompilerConfig::ShardingParams::SHARD_COLUMNS,
+                               CompilerConfig::ShardingParams::SHARD_COMMON,
+                               CompilerConfig::ShardingParams::SHARD_2D,
+                               CompilerConfig::ShardingParams::SHARD_SUMMA};
+
+const char* strategyName(Strategy strategy) {
+    switch (strategy) {
+        case CompilerConfig::ShardingParams::SHARD_ROWS: return "rows";
+        case CompilerConfig::ShardingParams::SHARD_COLUMNS: return "columns";
+        case CompilerConfig::ShardingParams::SHARD_COMMON: return "common";
+        case CompilerConfig::ShardingParams::SHARD_2D: return "2d";
+        case CompilerConfig::ShardingParams::SHARD_SUMMA: return "summa";
+        default: return "auto";
+    }
+}
+
+// Whether a grid may be used for the strategy (one device is allowed for every 1D strategy)
+bool matchesStrategy(unsigned gridRows, unsigned gridCols, unsigned gridCommon, Strategy strategy) {
+    switch (strategy) {
+        case CompilerConfig::ShardingParams::SHARD_ROWS: return gridCols == 1 && gridCommon == 1;
+        case CompilerConfig::ShardingParams::SHARD_COLUMNS: return gridRows == 1 && gridCommon == 1;
+        case CompilerConfig::ShardingParams::SHARD_COMMON: return gridRows == 1 && gridCols == 1;
+        case CompilerConfig::ShardingParams::SHARD_2D: return gridRows > 1 && gridCols > 1 && gridCommon == 1;
+        case CompilerConfig::ShardingParams::SHARD_SUMMA: return gridRows * gridCols > 1 && gridCommon == 1;
+        default: return false;
+    }
+}
+
+unsigned divideRoundingUp(unsigned value, unsigned divisor) {
+    return (value + divisor - 1) / divisor;
+}
+
+// Split count items into parts balanced to within one, as {first, size} pairs
+std::vector<std::pair<unsigned, unsigned>> split(unsigned count, unsigned parts) {
+    std::vector<std::pair<unsigned, unsigned>> ranges;
+    unsigned first = 0;
+    for (unsigned p = 0; p < parts; p++) {
+        unsigned size = count / parts + (p < count % parts ? 1 : 0);
+        ranges.push_back({first, size});
+        first += size;
+    }
+    return ranges;
+}
+
+// Split the common dimension into parts of whole words, as element {first, size} pairs
+std::vector<std::pair<unsigned, unsigned>> splitCommon(unsigned common, unsigned lanes, unsigned parts) {
+    std::vector<std::pair<unsigned, unsigned>> ranges;
+    for (const auto& [word, words] : split(divideRoundingUp(common, lanes), parts)) {
+        unsigned first = word * lanes;
+        ranges.push_back({first, std::min(common, (word + words) * lanes) - first});
+    }
+    return ranges;
+}
+
+} // namespace
+
+std::string KernelSharding::describe() const {
+    return std::string(strategyName(strategy)) + " " + std::to_string(gridRows) + "x" + std::to_string(gridCols) +
+           "x" + std::to_string(gridCommon) + " on " + std::to_string(shards.size()) +
+           (shards.size() == 1 ? " device" : " devices");
+}
+
+const DeviceShard* KernelSharding::shardOf(unsigned device) const {
+    for (const auto& shard : shards) {
+        if (shard.device == device) {
+            return &shard;
+        }
+    }
+    return nullptr;
+}
+
+const KernelSharding* ShardPlan::lookup(const std::string& functionName) const {
+    for (const auto& kernel : kernels) {
+        if (kernel.function == functionName) {
+            return &kernel;
+        }
+    }
+    return nullptr;
+}
+
+void ShardPlan::write(std::ostream& out) const {
+    static const char* const KINDS[] = {"SCATTER", "BROADCAST", "GATHER", "REDUCE"};
+    
+    out << "# Host schedule of a program sharded over " << devices << " devices\n"
+        << "DEVICES " << devices << "\n";
+    for (const auto& kernel : kernels) {
+        out << "KERNEL " << kernel.index << " " << kernel.function << " " << kernel.rows << "x" << kernel.cols
+            << "x" << kernel.common << " " << strategyName(kernel.strategy) << " " << kernel.gridRows << "x"
+            << kernel.gridCols << "x" << kernel.gridCommon << "\n";
+        for (const auto& shard : kernel.shards) {
+            out << "SHARD " << kernel.index << " " << shard.device << " " << shard.row << " " << shard.col << " "
+                << shard.k << " " << shard.rows << " " << shard.cols << " " << shard.common << "\n";
+        }
+        for (const auto& step : kernel.transfers) {
+            out << KINDS[step.kind] << " " << kernel.index;
+            switch (step.kind) {
+                case ShardTransfer::SCATTER: out << " " << step.matrix << " " << step.to; break;
+                case ShardTransfer::BROADCAST: out << " " << step.matrix << " " << step.from << " " << step.to; break;
+                default: out << " " << step.from; break;
+            }
+            out << " " << step.row << " " << step.col << " " << step.rows << " " << step.cols << "\n";
+        }
+        out << "TRAFFIC " << kernel.index << " " << kernel.hostWordsLoaded << " " << kernel.interDeviceWords << " "
+            << kernel.hostWordsStored << " " << kernel.reducedWords << "\n";
+    }
+}
+
+ShardPlan ShardPlan::read(std::istream& in) {
+    ShardPlan plan;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::stringstream ss(line.substr(0, line.find('#')));
+        std::string step;
+        if (!(ss >> step)) {
+            continue;
+        }
+        auto malformed = [&]() { return std::runtime_error("Malformed host schedule line: " + line); };
+        
+        if (step == "DEVICES") {
+            if (!(ss >> plan.devices) || plan.devices == 0) {
+                throw malformed();
+            }
+            continue;
+        }
+        
+        unsigned index = 0;
+        if (!(ss >> index)) {
+            throw malformed();
+        }
+        if (step == "KERNEL") {
+            KernelSharding kernel;
+            kernel.index = index;
+            std::string strategy;
+            char x1 = 0, x2 = 0, x3 = 0, x4 = 0;
+            if (!(ss >> kernel.function >> kernel.rows >> x1 >> kernel.cols >> x2 >> kernel.common >> strategy >>
+                  kernel.gridRows >> x3 >> kernel.gridCols >> x4 >> kernel.gridCommon) ||
+                x1 != 'x' || x2 != 'x' || x3 != 'x' || x4 != 'x' || index != plan.kernels.size()) {
+                throw malformed();
+            }
+            const Strategy* named = std::find_if(std::begin(STRATEGIES), std::end(STRATEGIES),
+                                                 [&](Strategy s) { return strategy == strategyName(s); });
+            if (named == std::end(STRATEGIES)) {
+                throw malformed();
+            }
+            kernel.strategy = *named;
+            plan.kernels.push_back(std::move(kernel));
+            continue;
+        }
+        if (plan.kernels.empty() || index != plan.kernels.back().index) {
+            throw std::runtime_error("Host schedule line outside its kernel: " + line);
+        }
+        KernelSharding& kernel = plan.kernels.back();
+        
+        bool parsed = true;
+        if (step == "SHARD") {
+            DeviceShard shard;
+            parsed = static_cast<bool>(ss >> shard.device >> shard.row >> shard.col >> shard.k >>
+                                       shard.rows >> shard.cols >> shard.common) && shard.device < plan.devices;
+            kernel.shards.push_back(shard);
+        } else if (step == "TRAFFIC") {
+            parsed = static_cast<bool>(ss >> kernel.hostWordsLoaded >> kernel.interDeviceWords >>
+                                       kernel.hostWordsStored >> kernel.reducedWords);
+        } else {
+            ShardTransfer transfer;
+            if (step == "SCATTER") {
+                transfer.kind = ShardTransfer::SCATTER;
+                parsed = static_cast<bool>(ss >> transfer.matrix >> transfer.to);
+            } else if (step == "BROADCAST") {
+                transfer.kind = ShardTransfer::BROADCAST;
+                parsed = static_cast<bool>(ss >> transfer.matrix >> transfer.from >> transfer.to);
+            } else if (step == "GATHER" || step == "REDUCE") {
+                transfer.kind = step == "GATHER" ? ShardTransfer::GATHER : ShardTransfer::REDUCE;
+                transfer.matrix = 'C';
+                parsed = static_cast<bool>(ss >> transfer.from);
+            } else {
+                throw std::runtime_error("Unknown host schedule step: " + line);
+            }
+            parsed = parsed && (ss >> transfer.row >> transfer.col >> transfer.rows >> transfer.cols) &&
+                     (transfer.matrix == 'A' || transfer.matrix == 'B' || transfer.matrix == 'C') &&
+                     transfer.from < plan.devices && transfer.to < plan.devices;
+            kernel.transfers.push_back(transfer);
+        }
+        std::string rest;
+        if (!parsed || ss >> rest) {
+            throw malformed();
+        }
+    }
+    return plan;
+}
+
+ShardPlanner::ShardPlanner(const CompilerConfig& config) : config(config) {}
+
+ShardPlanner::~ShardPlanner() = default;
+
+KernelShape ShardPlanner::shardShape(const KernelShape& shape, const DeviceShard& shard) {
+    KernelShape sharded = shape;
+    sharded.rows = shard.rows;
+    sharded.cols = shard.cols;
+    sharded.common = shard.common;
+    
+    if (!shape.weights.empty()) {
+        sharded.weights.clear();
+        for (unsigned k = shard.k; k < shard.k + shard.common; k++) {
+            auto row = shape.weights.begin() + static_cast<size_t>(k) * shape.cols + shard.col;
+            sharded.weights.insert(sharded.weights.end(), row, row + shard.cols);
+        }
+    }
+    
+    if (shape.sparsity.isSparse()) {
+        const SparsityPattern& pattern = shape.sparsity;
+        std::vector<std::pair<unsigned, unsigned>> nonzeros;
+        for (unsigned k = shard.k; k < shard.k + shard.common && k < pattern.rows; k++) {
+            for (unsigned p = pattern.rowStart[k]; p < pattern.rowStart[k + 1]; p++) {
+                if (pattern.columns[p] >= shard.col && pattern.columns[p] < shard.col + shard.cols) {
+                    nonzeros.push_back({k - shard.k, pattern.columns[p] - shard.col});
+                }
+            }
+        }
+        sharded.sparsity = SparsityPattern::fromEntries(pattern.format, shard.common, shard.cols, nonzeros);
+    }
+    return sharded;
+}
+
+KernelSharding ShardPlanner::partition(const KernelShape& shape, Strategy strategy, unsigned gridRows,
+                                       unsigned gridCols, unsigned gridCommon) const {
+    const unsigned lanes = LayoutPlanner(config).lanesPerWord();
+    const bool summa = strategy == CompilerConfig::ShardingParams::SHARD_SUMMA;
+    
+    KernelSharding sharding;
+    sharding.rows = shape.rows;
+    sharding.cols = shape.cols;
+    sharding.common = shape.common;
+    sharding.strategy = strategy;
+    sharding.gridRows = gridRows;
+    sharding.gridCols = gridCols;
+    sharding.gridCommon = gridCommon;
+    
+    const auto rowBlocks = split(shape.rows, gridRows);
+    const auto colBlocks = split(shape.cols, gridCols);
+    const auto slices = splitCommon(shape.common, lanes, gridCommon);
+    for (unsigned bi = 0; bi < gridRows; bi++) {
+        for (unsigned bj = 0; bj < gridCols; bj++) {
+            for (unsigned bk = 0; bk < gridCommon; bk++) {
+                sharding.shards.push_back({(bi * gridCols + bj) * gridCommon + bk,
+                                           rowBlocks[bi].first, colBlocks[bj].first, slices[bk].first,
+                                           rowBlocks[bi].second, colBlocks[bj].second, slices[bk].second});
+            }
+        }
+    }
+    
+    // Words of an A or B block: its common elements are packed lanes per word
+    auto words = [&](const ShardTransfer& step) {
+        return step.matrix == 'A' ? static_cast<uint64_t>(step.rows) * divideRoundingUp(step.cols, lanes)
+             : step.matrix == 'B' ? static_cast<uint64_t>(divideRoundingUp(step.rows, lanes)) * step.cols
+                                  : static_cast<uint64_t>(step.rows) * step.cols;
+    };
+    
+    // A constant B travels in the device programs
+    const bool hostB = !(config.foldConstantWeights && !shape.weights.empty());
+    if (!summa) {
+        for (const auto& shard : sharding.shards) {
+            sharding.transfers.push_back({ShardTransfer::SCATTER, 'A', 0, shard.device,
+                                          shard.row, shard.k, shard.rows, shard.common});
+            if (hostB) {
+                sharding.transfers.push_back({ShardTransfer::SCATTER, 'B', 0, shard.device,
+                                              shard.k, shard.col, shard.common, shard.cols});
+            }
+        }
+    } else {
+        // Panels are distributed cyclically: device (bi, t % gridCols) owns
+        // panel t of A's row band bi, device (t % gridRows, bj) panel t of
+        // B's column band bj; owners broadcast them along their row or column
+        unsigned panels = std::min(std::lcm(gridRows, gridCols), divideRoundingUp(shape.common, lanes));
+        sharding.panels = panels;
+        const auto panelRanges = splitCommon(shape.common, lanes, panels);
+        for (unsigned t = 0; t < panels; t++) {
+            const auto& [k, depth] = panelRanges[t];
+            for (unsigned bi = 0; bi < gridRows; bi++) {
+                unsigned owner = bi * gridCols + t % gridCols;
+                const auto& [row, rows] = rowBlocks[bi];
+                sharding.transfers.push_back({ShardTransfer::SCATTER, 'A', 0, owner, row, k, rows, depth});
+                for (unsigned bj = 0; bj < gridCols; bj++) {
+                    if (bi * gridCols + bj != owner) {
+                        sharding.transfers.push_back({ShardTransfer::BROADCAST, 'A', owner, bi * gridCols + bj,
+                                                      row, k, rows, depth});
+                    }
+                }
+            }
+            for (unsigned bj = 0; hostB && bj < gridCols; bj++) {
+                unsigned owner = (t % gridRows) * gridCols + bj;
+                const auto& [col, cols] = colBlocks[bj];
+                sharding.transfers.push_back({ShardTransfer::SCATTER, 'B', 0, owner, k, col, depth, cols});
+                for (unsigned bi = 0; bi < gridRows; bi++) {
+                    if (bi * gridCols + bj != owner) {
+                        sharding.transfers.push_back({ShardTransfer::BROADCAST, 'B', owner, bi * gridCols + bj,
+                                                      k, col, depth, cols});
+                    }
+                }
+            }
+        }
+    }
+    
+    // Slices of the common dimension compute partial sums the host adds up
+    for (const auto& shard : sharding.shards) {
+        sharding.transfers.push_back({gridCommon > 1 ? ShardTransfer::REDUCE : ShardTransfer::GATHER, 'C',
+                                      shard.device, 0, shard.row, shard.col, shard.rows, shard.cols});
+    }
+    
+    for (const auto& step : sharding.transfers) {
+        uint64_t count = words(step);
+        if (step.kind == ShardTransfer::SCATTER) {
+            sharding.hostWordsLoaded += count;
+        } else if (step.kind == ShardTransfer::BROADCAST) {
+            sharding.interDeviceWords += count;
+        } else {
+            sharding.hostWordsStored += count;
+        }
+    }
+    if (gridCommon > 1) {
+        sharding.reducedWords = sharding.hostWordsStored - static_cast<uint64_t>(shape.rows) * shape.cols;
+    }
+    
+    sharding.cost = estimateCost(sharding);
+    return sharding;
+}
+
+double ShardPlanner::estimateCost(const KernelSharding& sharding) const {
+    const unsigned lanes = LayoutPlanner(config).lanesPerWord();
+    const unsigned numPEs = std::max(1u, config.archParams.numProcessingElements);
+    const double cyclesPerMac = config.isaVersion >= PIMEncoding::V2 ? 1.0 : 2.0;
+    
+    double slowest = 0.0;
+    for (const auto& shard : sharding.shards) {
+        double outputs = static_cast<double>(divideRoundingUp(shard.rows * shard.cols, numPEs));
+        slowest = std::max(slowest, cyclesPerMac * outputs * divideRoundingUp(shard.common, lanes));
+    }
+    
+    std::vector<double> received(sharding.shards.size(), 0.0);
+    for (const auto& step : sharding.transfers) {
+        if (step.kind == ShardTransfer::BROADCAST) {
+            received[step.to] += step.matrix == 'A'
+                ? static_cast<double>(step.rows) * divideRoundingUp(step.cols, lanes)
+                : static_cast<double>(divideRoundingUp(step.rows, lanes)) * step.cols;
+        }
+    }
+    double broadcast = received.empty() ? 0.0 : *std::max_element(received.begin(), received.end());
+    
+    double host = static_cast<double>(sharding.hostWordsLoaded + sharding.hostWordsStored) * HOST_CYCLES_PER_WORD;
+    return std::max({slowest, host, broadcast * DEVICE_CYCLES_PER_WORD}) +
+           static_cast<double>(sharding.reducedWords) * HOST_CYCLES_PER_WORD;
+}
+
+std::vector<KernelSharding> ShardPlanner::evaluateCandidates(const KernelShape& shape) const {
+    const unsigned devices = std::max(1u, config.sharding.devices);
+    const unsigned limit = config.archParams.matrixDimLimit;
+    const unsigned commonWords = divideRoundingUp(shape.common, LayoutPlanner(config).lanesPerWord());
+    
+    // Partial sums cannot pass through a fused epilogue
+    const unsigned maxSlices = shape.epilogue.empty() ? std::min(devices, commonWords) : 1;
+    
+    // A requested strategy shares the kernel; only SHARD_AUTO may keep it on one device
+    const bool forced = config.sharding.strategy != CompilerConfig::ShardingParams::SHARD_AUTO;
+    
+    std::vector<KernelSharding> best;
+    for (Strategy strategy : STRATEGIES) {
+        bool found = false;
+        KernelSharding chosen;
+        for (unsigned gridRows = 1; gridRows <= std::min(shape.rows, devices); gridRows++) {
+            for (unsigned gridCols = 1; gridCols <= std::min(shape.cols, devices / gridRows); gridCols++) {
+                for (unsigned gridCommon = 1; gridCommon <= std::min(maxSlices, devices / (gridRows * gridCols));
+                     gridCommon++) {
+                    if (!matchesStrategy(gridRows, gridCols, gridCommon, strategy) ||
+                        (forced && gridRows * gridCols * gridCommon == 1)) {
+                        continue;
+                    }
+                    
+                    // The first shard is the largest along every dimension
+                    KernelSharding candidate = partition(shape, strategy, gridRows, gridCols, gridCommon);
+                    const DeviceShard& largest = candidate.shards.front();
+                    if (largest.rows > limit || largest.cols > limit || largest.common > limit) {
+                        continue;
+                    }
+                    if (!found || candidate.cost < chosen.cost ||
+                        (candidate.cost == chosen.cost && candidate.shards.size() < chosen.shards.size())) {
+                        chosen = std::move(candidate);
+                        found = true;
+                    }
+                }
+            }
+        }
+        if (found) {
+            best.push_back(std::move(chosen));
+        }
+    }
+    return best;
+}
+
+KernelSharding ShardPlanner::shard(const KernelShape& shape) const {
+    const Strategy requested = config.sharding.strategy;
+    
+    bool found = false;
+    KernelSharding chosen;
+    for (auto& candidate : evaluateCandidates(shape)) {
+        if (requested != CompilerConfig::ShardingParams::SHARD_AUTO && candidate.strategy != requested) {
+            continue;
+        }
+        if (!found || candidate.cost < chosen.cost ||
+            (candidate.cost == chosen.cost && candidate.shards.size() < chosen.shards.size())) {
+            chosen = std::move(candidate);
+            found = true;
+        }
+    }
+    
+    if (!found) {
+        throw std::runtime_error(explainInfeasible(shape));
+    }
+    return chosen;
+}
+
+std::string ShardPlanner::explainInfeasible(const KernelShape& shape) const {
+    const Strategy requested = config.sharding.strategy;
+    const unsigned devices = std::max(1u, config.sharding.devices);
+    const unsigned commonWords = divideRoundingUp(shape.common, LayoutPlanner(config).lanesPerWord());
+    const std::string kernel = std::to_string(shape.rows) + "x" + std::to_string(shape.cols) + "x" +
+                               std::to_string(shape.common) + " kernel";
+    const std::string name = strategyName(requested);
+    
+    // A requested strategy needs two devices and two blocks along the dimensions it splits
+    if (requested != CompilerConfig::ShardingParams::SHARD_AUTO) {
+        const unsigned needed = requested == CompilerConfig::ShardingParams::SHARD_2D ? 4 : 2;
+        if (devices < needed) {
+            return "A " + name + " sharding needs at least " + std::to_string(needed) + " devices; " +
+                   std::to_string(devices) + (devices == 1 ? " is" : " are") + " configured";
+        }
+        switch (requested) {
+            case CompilerConfig::ShardingParams::SHARD_ROWS:
+                if (shape.rows < 2) {
+                    return "A " + kernel + " has one row of C, which cannot be sharded by rows";
+                }
+                break;
+            case CompilerConfig::ShardingParams::SHARD_COLUMNS:
+                if (shape.cols < 2) {
+                    return "A " + kernel + " has one column of C, which cannot be sharded by columns";
+                }
+                break;
+            case CompilerConfig::ShardingParams::SHARD_COMMON:
+                if (!shape.epilogue.empty()) {
+                    return "A " + kernel + " with a fused epilogue cannot be sharded along the common dimension";
+                }
+                if (commonWords < 2) {
+                    return "The common dimension of a " + kernel + " is one word, which cannot be sharded";
+                }
+                break;
+            case CompilerConfig::ShardingParams::SHARD_2D:
+                if (shape.rows < 2 || shape.cols < 2) {
+                    return "A 2d sharding needs at least two rows and two columns of C; a " + kernel +
+                           " has a " + std::to_string(shape.rows) + "x" + std::to_string(shape.cols) + " result";
+                }
+                break;
+            case CompilerConfig::ShardingParams::SHARD_SUMMA:
+                if (shape.rows * shape.cols < 2) {
+                    return "A " + kernel + " has a single element of C, which SUMMA cannot shard";
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    
+    // Otherwise every partition leaves a shard too large for one device; report the smallest
+    const unsigned maxSlices = shape.epilogue.empty() ? std::min(devices, commonWords) : 1;
+    bool found = false;
+    DeviceShard smallest;
+    for (Strategy strategy : STRATEGIES) {
+        if (requested != CompilerConfig::ShardingParams::SHARD_AUTO && strategy != requested) {
+            continue;
+        }
+        for (unsigned gridRows = 1; gridRows <= std::min(shape.rows, devices); gridRows++) {
+            for (unsigned gridCols = 1; gridCols <= std::min(shape.cols, devices / gridRows); gridCols++) {
+                for (unsigned gridCommon = 1; gridCommon <= std::min(maxSlices, devices / (gridRows * gridCols));
+                     gridCommon++) {
+                    if (!matchesStrategy(gridRows, gridCols, gridCommon, strategy) ||
+                        (requested != CompilerConfig::ShardingParams::SHARD_AUTO &&
+                         gridRows * gridCols * gridCommon == 1)) {
+                        continue;
+                    }
+                    DeviceShard largest = partition(shape, strategy, gridRows, gridCols, gridCommon).shards.front();
+                    unsigned extent = std::max({largest.rows, largest.cols, largest.common});
+                    if (!found || extent < std::max({smallest.rows, smallest.cols, smallest.common})) {
+                        smallest = largest;
+                        found = true;
+                    }
+                }
+            }
+        }
+    }
+    return "Every " + (requested == CompilerConfig::ShardingParams::SHARD_AUTO ? std::string() : name + " ") +
+           "sharding of a " + kernel + " over " + std::to_string(devices) + (devices == 1 ? " device" : " devices") +
+           " leaves shards of " + std::to_string(smallest.rows) + "x" + std::to_string(smallest.cols) + "x" +
+           std::to_string(smallest.common) + " or larger, beyond the per-device matrix dimension limit of " +
+           std::to_string(config.archParams.matrixDimLimit);
+}
+
+ShardPlan ShardPlanner::plan(const llvm::Module& module, const ShapeAnalysisResult& shapes) const {
+    ShardPlan plan;
+    plan.devices = std::max(1u, config.sharding.devices);
+    if (plan.devices == 1) {
+        return plan;
+    }
+    if (config.symbolicDimensions) {
+        throw std::runtime_error("Programs with symbolic dimensions cannot be sharded over devices");
+    }
+    
+    for (const auto& function : module.functions()) {
+        const KernelShape* shape = function.isDeclaration() ? nullptr : shapes.lookup(function.getName().str());
+        if (!shape) {
+            continue;
+        }
+        
+        for (const auto& candidate : evaluateCandidates(*shape)) {
+            PIM_LOG_INFO("Shard cost of " + candidate.describe() + ": " +
+                        std::to_string(static_cast<unsigned long>(candidate.cost)) + " cycles, " +
+                        std::to_string(candidate.hostWordsLoaded) + " host words loaded, " +
+                        std::to_string(candidate.interDeviceWords) + " between devices, " +
+                        std::to_string(candidate.hostWordsStored) + " stored");
+        }
+        
+        KernelSharding sharding = shard(*shape);
+        sharding.index = static_cast<unsigned>(plan.kernels.size());
+        sharding.function = function.getName().str();
+        PIM_LOG_INFO("Sharding " + sharding.function + " as " + sharding.describe() + ": " +
+                    std::to_string(sharding.hostWordsLoaded) + " host words loaded, " +
+                    std::to_string(sharding.interDeviceWords) + " inter-device words, " +
+                    std::to_string(sharding.hostWordsStored) + " words stored" +
+                    (sharding.reducedWords > 0 ? ", " + std::to_string(sharding.reducedWords) + " reduced" : ""));
+        plan.kernels.push_back(std::move(sharding));
+    }
+    return plan;
+}
@@ -0,0 +1,217 @@
+/**
+ * ShardPlanner.h
+ * Partitions kernels over several PIM devices and plans the host schedule
+ */
+
+#ifndef SHARD_PLANNER_H
+#define SHARD_PLANNER_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <llvm/IR/Module.h>
+#include "MatrixShapeAnalysis.h"
+#include "../include/CompilerConfig.h"
+
+/**
+ * Block of a kernel computed by one device
+ *
+ * The device computes rows x cols of C from A[row.., k..] and B[k.., col..]
+ * over common elements of the common dimension; a shard covering part of
+ * the common dimension computes a partial sum of its block of C.
+ */
+struct DeviceShard {
+    unsigned device = 0;
+    unsigned row = 0;          // First row of A and C
+    unsigned col = 0;          // First column of B and C
+    unsigned k = 0;            // First element of the common dimension
+    unsigned rows = 0;
+    unsigned cols = 0;
+    unsigned common = 0;
+};
+
+/**
+ * One step of the host schedule of a sharded kernel
+ *
+ * Blocks are given in logical element coordinates of their operand: rows
+ * and columns of A (rows x common), B (common x cols) or C (rows x cols).
+ */
+struct ShardTransfer {
+    enum Kind {
+        SCATTER,               // Host -> device: load a block of A or B into device to
+        BROADCAST,             // Device -> device: copy a block device from received to device to
+        GATHER,                // Device -> host: copy the block of C device from computed
+        REDUCE                 // Device -> host: add the partial block of C device from computed
+    };
+    
+    Kind kind = SCATTER;
+    char matrix = 'A';         // 'A', 'B' or 'C'
+    unsigned from = 0;         // Source device (BROADCAST, GATHER, REDUCE)
+    unsigned to = 0;           // Destination device (SCATTER, BROADCAST)
+    unsigned row = 0;
+    unsigned col = 0;
+    unsigned rows = 0;
+    unsigned cols = 0;
+};
+
+/**
+ * Partition of one kernel over the devices and its host schedule
+ */
+struct KernelSharding {
+    unsigned index = 0;        // Kernel number of the PIM_CONFIG_KERNEL markers
+    std::string function;
+    unsigned rows = 0;
+    unsigned cols = 0;
+    unsigned common = 0;
+    CompilerConfig::ShardingParams::Strategy strategy = CompilerConfig::ShardingParams::SHARD_ROWS;
+    unsigned gridRows = 1;     // Blocks along the rows of C
+    unsigned gridCols = 1;     // Blocks along the columns of C
+    unsigned gridCommon = 1;   // Slices of the common dimension
+    unsigned panels = 0;       // Panels of the common dimension broadcast by SUMMA
+    std::vector<DeviceShard> shards;
+    std::vector<ShardTransfer> transfers;   // Staging steps, then the steps collecting C
+    
+    // Expected traffic in words, and the cycles of the traffic model
+    uint64_t hostWordsLoaded = 0;           // A and B words scattered from the host
+    uint64_t interDeviceWords = 0;          // Words broadcast between devices
+    uint64_t hostWordsStored = 0;           // Words of C gathered or reduced by the host
+    uint64_t reducedWords = 0;              // Partial sums the host adds
+    double cost = 0.0;
+    
+    /**
+     * Get a short description such as "summa 2x2 on 4 devices"
+     */
+    std::string describe() const;
+    
+    /**
+     * Get the shard a device computes
+     *
+     * @return Shard, or nullptr if the device has no part of the kernel
+     */
+    const DeviceShard* shardOf(unsigned device) const;
+};
+
+/**
+ * Sharding of the kernels of a module, in module order
+ */
+struct ShardPlan {
+    unsigned devices = 1;
+    std::vector<KernelSharding> kernels;
+    
+    /**
+     * Get the sharding of the kernel in the given function
+     *
+     * @param functionName Function name
+     * @return Sharding, or nullptr if the function is not a kernel
+     */
+    const KernelSharding* lookup(const std::string& functionName) const;
+    
+    /**
+     * Write the host schedule as text
+     *
+     * One step per line: "DEVICES n", then for every kernel "KERNEL n
+     * function RxCxK strategy PxQxS", one "SHARD n device row col k rows cols
+     * common" line per device, its transfers ("SCATTER n A|B to row col rows
+     * cols", "BROADCAST n A|B from to row col rows cols", "GATHER n from row
+     * col rows cols" and "REDUCE n from row col rows cols") and "TRAFFIC n
+     * loaded inter-device stored reduced" in words. '#' starts a comment.
+     */
+    void write(std::ostream& out) const;
+    
+    /**
+     * Read a host schedule written by write()
+     *
+     * @param in Stream holding the schedule
+     * @return Sharding of every kernel of the schedule
+     * @throws std::runtime_error on a malformed or out-of-order line
+     */
+    static ShardPlan read(std::istream& in);
+};
+
+class ShardPlanner {
+public:
+    explicit ShardPlanner(const CompilerConfig& config);
+    ~ShardPlanner();
+    
+    /**
+     * Shard every kernel of a module
+     *
+     * @param module Module containing the kernels
+     * @param shapes Kernel shapes from MatrixShapeAnalysis
+     * @return Sharding of every kernel, numbered in module order
+     * @throws std::runtime_error if a kernel has no partition of the
+     *         configured strategy that fits the devices
+     */
+    ShardPlan plan(const llvm::Module& module, const ShapeAnalysisResult& shapes) const;
+    
+    /**
+     * Choose the partition of one kernel
+     *
+     * CompilerConfig::ShardingParams::strategy restricts the candidates to
+     * one strategy over at least two devices; SHARD_AUTO considers all of
+     * them, including leaving the kernel on one device. Among the candidates
+     * whose shards stay within PIMArchParams::matrixDimLimit the cheapest
+     * wins, and ties go to the partition using fewer devices.
+     *
+     * @param shape Kernel shape
+     * @return Chosen partition with its schedule and traffic
+     * @throws std::runtime_error if no candidate of the strategy fits,
+     *         naming the reason from explainInfeasible()
+     */
+    KernelSharding shard(const KernelShape& shape) const;
+    
+    /**
+     * Evaluate the best partition of every strategy
+     *
+     * @param shape Kernel shape
+     * @return The cheapest fitting candidate of each strategy that has one
+     */
+    std::vector<KernelSharding> evaluateCandidates(const KernelShape& shape) const;
+    
+    /**
+     * Get the shape of the kernel a shard computes
+     *
+     * The dimensions shrink to the shard, and the weights and sparsity of a
+     * constant or compressed B to its block.
+     *
+     * @param shape Shape of the whole kernel
+     * @param shard Shard of the kernel
+     * @return Shape lowered into the device program
+     */
+    static KernelShape shardShape(const KernelShape& shape, const DeviceShard& shard);
+
+private:
+    CompilerConfig config;
+    
+    /**
+     * Partition a kernel on a grid and plan its schedule and traffic
+     *
+     * Blocks differ by at most one row or column; slices of the common
+     * dimension are whole words of packed precision. Device
+     * (bi * gridCols + bj) * gridCommon + bk owns block (bi, bj, bk).
+     */
+    KernelSharding partition(const KernelShape& shape, CompilerConfig::ShardingParams::Strategy strategy,
+                             unsigned gridRows, unsigned gridCols, unsigned gridCommon) const;
+    
+    /**
+     * Estimate the cycles of a partition
+     *
+     * The slowest device bounds the compute, one MAC (a MUL/ADD pair with ISA
+     * version 1) per PE and cycle. All devices share the host link, which
+     * carries the scattered and collected words; broadcasts use the links
+     * between devices, bounded by the device receiving the most. Transfers
+     * overlap compute; the host reduction follows it.
+     */
+    double estimateCost(const KernelSharding& sharding) const;
+    
+    /**
+     * Explain why no candidate of the configured strategy exists: too few
+     * devices, rows, columns or common words for the strategy to split, or
+     * shards that all stay beyond PIMArchParams::matrixDimLimit
+     */
+    std::string explainInfeasible(const KernelShape& shape) const;
+};
+
+#endif // SHARD_PLANNER_H
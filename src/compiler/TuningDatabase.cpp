@@ -0,0 +1,286 @@
+/**
+ * TuningDatabase.cpp
+ * Implements the persistent store of tuning results
+ */
+
+#include "TuningDatabase.h"
+#include "../utils/Logger.h"
+#include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <system_error>
+#include <thread>
+
+#ifndef PIM_COMPILER_VERSION
+#define PIM_COMPILER_VERSION "unknown"
+#endif
+
+namespace {
+
+// Layout version of the database file
+const int64_t FORMAT_VERSION = 1;
+
+// Distinguishes temporary files of concurrent writers
+std::atomic<unsigned> temporaryCounter(0);
+
+const char* orderName(CompilerConfig::TilingParams::LoopOrder order) {
+    switch (order) {
+        case CompilerConfig::TilingParams::ORDER_IKJ: return "ikj";
+        case CompilerConfig::TilingParams::ORDER_JKI: return "jki";
+        default: return "ijk";
+    }
+}
+
+bool parseOrder(llvm::StringRef name, CompilerConfig::TilingParams::LoopOrder& order) {
+    for (auto candidate : {CompilerConfig::TilingParams::ORDER_IJK, CompilerConfig::TilingParams::ORDER_IKJ,
+                           CompilerConfig::TilingParams::ORDER_JKI}) {
+        if (name == orderName(candidate)) {
+            order = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Schedule of an untiled kernel, "single" for one PE
+const char* scheduleName(const KernelTuning& tuning) {
+    if (!tuning.scheduled) {
+        return "single";
+    }
+    switch (tuning.strategy) {
+        case CompilerConfig::SchedulingParams::SCHEDULE_ROW_BLOCK: return "row";
+        case CompilerConfig::SchedulingParams::SCHEDULE_COLUMN_BLOCK: return "column";
+        case CompilerConfig::SchedulingParams::SCHEDULE_BLOCK_2D: return "2d";
+        default: return "auto";
+    }
+}
+
+bool parseSchedule(llvm::StringRef name, KernelTuning& tuning) {
+    tuning.scheduled = name != "single";
+    if (name == "single" || name == "auto") {
+        tuning.strategy = CompilerConfig::SchedulingParams::SCHEDULE_AUTO;
+    } else if (name == "row") {
+        tuning.strategy = CompilerConfig::SchedulingParams::SCHEDULE_ROW_BLOCK;
+    } else if (name == "column") {
+        tuning.strategy = CompilerConfig::SchedulingParams::SCHEDULE_COLUMN_BLOCK;
+    } else if (name == "2d") {
+        tuning.strategy = CompilerConfig::SchedulingParams::SCHEDULE_BLOCK_2D;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+llvm::json::Value toJson(const KernelTuning& tuning) {
+    llvm::json::Object entry{
+        {"tiled", tuning.tiled},
+        {"estimated_cycles", static_cast<int64_t>(tuning.estimatedCycles)},
+        {"candidates", static_cast<int64_t>(tuning.candidates)}
+    };
+    if (tuning.tiled) {
+        entry["tile"] = llvm::json::Array{tuning.tileRows, tuning.tileCols, tuning.tileDepth};
+        entry["order"] = orderName(tuning.order);
+    } else {
+        entry["schedule"] = scheduleName(tuning);
+    }
+    return llvm::json::Value(std::move(entry));
+}
+
+bool fromJson(const llvm::json::Object& entry, KernelTuning& tuning) {
+    llvm::Optional<bool> tiled = entry.getBoolean("tiled");
+    if (!tiled) {
+        return false;
+    }
+    tuning.tiled = *tiled;
+    tuning.estimatedCycles = static_cast<uint64_t>(entry.getInteger("estimated_cycles").getValueOr(0));
+    tuning.candidates = static_cast<unsigned>(entry.getInteger("candidates").getValueOr(0));
+    if (!tuning.tiled) {
+        llvm::Optional<llvm::StringRef> schedule = entry.getString("schedule");
+        return schedule && parseSchedule(*schedule, tuning);
+    }
+    
+    const llvm::json::Array* tile = entry.getArray("tile");
+    llvm::Optional<llvm::StringRef> order = entry.getString("order");
+    if (!tile || tile->size() != 3 || !order || !parseOrder(*order, tuning.order)) {
+        return false;
+    }
+    unsigned* sizes[] = {&tuning.tileRows, &tuning.tileCols, &tuning.tileDepth};
+    for (size_t i = 0; i < 3; i++) {
+        llvm::Optional<int64_t> size = (*tile)[i].getAsInteger();
+        if (!size || *size < 0) {
+            return false;
+        }
+        *sizes[i] = static_cast<unsigned>(*size);
+    }
+    return tuning.tileRows > 0 && tuning.tileCols > 0;
+}
+
+} // namespace
+
+void KernelTuning::apply(CompilerConfig& config) const {
+    config.tiling.enabled = tiled;
+    config.tiling.tileRows = tiled ? tileRows : 0;
+    config.tiling.tileCols = tiled ? tileCols : 0;
+    config.tiling.tileDepth = tiled ? tileDepth : 0;
+    config.tiling.order = tiled ? order : CompilerConfig::TilingParams::ORDER_IJK;
+    config.scheduling.enabled = !tiled && scheduled;
+    config.scheduling.strategy = strategy;
+}
+
+std::string KernelTuning::describe() const {
+    if (tiled) {
+        std::string depth = tileDepth == 0 ? "auto" : std::to_string(tileDepth);
+        return "tiled " + std::to_string(tileRows) + "x" + std::to_string(tileCols) + "x" + depth +
+               " " + orderName(order);
+    }
+    return scheduled ? std::string("untiled, ") + scheduleName(*this) + " schedule" : "untiled, single PE";
+}
+
+TuningDatabase& TuningDatabase::shared(const std::string& path) {
+    static std::mutex registryMutex;
+    static std::map<std::string, std::unique_ptr<TuningDatabase>> registry;
+    
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::unique_ptr<TuningDatabase>& database = registry[path];
+    if (!database) {
+        database.reset(new TuningDatabase(path));
+    }
+    return *database;
+}
+
+TuningDatabase::TuningDatabase(const std::string& path) : path(path) {
+    if (!path.empty() && !load()) {
+        PIM_LOG_WARNING("Ignoring unreadable tuning database: " + path);
+    }
+}
+
+std::string TuningDatabase::makeKey(const KernelShape& shape, const CompilerConfig& config) {
+    const auto& arch = config.archParams;
+    std::stringstream ss;
+    ss << shape.rows << "x" << shape.cols << "x" << shape.common << "x" << shape.batch
+       << (shape.vector ? " gemv" : "");
+    std::string variant = shape.describeVariant();
+    if (!variant.empty()) {
+        ss << " [" << variant << "]";
+    }
+    std::string epilogue = shape.describeEpilogue();
+    if (!epilogue.empty()) {
+        ss << " [" << epilogue << "]";
+    }
+    if (shape.sparsity.isSparse()) {
+        ss << " pattern=" << std::hex << shape.sparsity.fingerprint() << std::dec;
+    }
+    if (!shape.weights.empty() && config.foldConstantWeights) {
+        ss << " weights=" << std::hex << shape.weightFingerprint() << std::dec;
+    }
+    ss << " precision=" << config.precision
+       << " isa=" << config.isaVersion << "," << config.coalesceTransfers
+       << " regalloc=" << config.enableRegisterAllocation
+       << " layout=" << config.layout.enabled << "," << config.layout.bankHashing
+       << " buffering=" << config.tiling.doubleBuffering
+       << " arch=" << arch.numProcessingElements << "," << arch.memoryBankSize << "," << arch.numMemoryBanks
+       << "," << arch.registerFileSize << "," << arch.wordSize << "," << arch.matrixDimLimit;
+    return ss.str();
+}
+
+bool TuningDatabase::lookup(const std::string& key, KernelTuning& tuning) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        return false;
+    }
+    tuning = it->second;
+    return true;
+}
+
+void TuningDatabase::record(const std::string& key, const KernelTuning& tuning) {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[key] = tuning;
+    if (!path.empty()) {
+        // Keep what other processes stored since the file was read
+        load();
+        save();
+    }
+}
+
+size_t TuningDatabase::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+bool TuningDatabase::load() {
+    std::ifstream input(path);
+    if (!input) {
+        return true;
+    }
+    std::stringstream contents;
+    contents << input.rdbuf();
+    
+    llvm::Expected<llvm::json::Value> parsed = llvm::json::parse(contents.str());
+    if (!parsed) {
+        PIM_LOG_WARNING("Tuning database " + path + ": " + llvm::toString(parsed.takeError()));
+        return false;
+    }
+    const llvm::json::Object* root = parsed->getAsObject();
+    if (!root || root->getInteger("version") != FORMAT_VERSION) {
+        return false;
+    }
+    llvm::Optional<llvm::StringRef> compiler = root->getString("compiler");
+    if (!compiler || *compiler != PIM_COMPILER_VERSION) {
+        PIM_LOG_INFO("Discarding tuning results of another compiler version in " + path);
+        return true;
+    }
+    
+    const llvm::json::Object* stored = root->getObject("entries");
+    if (!stored) {
+        return false;
+    }
+    for (const auto& item : *stored) {
+        KernelTuning tuning;
+        const llvm::json::Object* entry = item.second.getAsObject();
+        if (entry && fromJson(*entry, tuning)) {
+            entries.emplace(item.first.str(), tuning);
+        }
+    }
+    return true;
+}
+
+void TuningDatabase::save() const {
+    llvm::json::Object stored;
+    for (const auto& entry : entries) {
+        stored[entry.first] = toJson(entry.second);
+    }
+    llvm::json::Object root{
+        {"version", FORMAT_VERSION},
+        {"compiler", PIM_COMPILER_VERSION},
+        {"entries", std::move(stored)}
+    };
+    
+    // Write under a unique name and rename, so readers never see a partial file
+    std::stringstream temporary;
+    temporary << path << ".tmp." << std::hash<std::thread::id>()(std::this_thread::get_id())
+              << "." << temporaryCounter++;
+    {
+        std::ofstream output(temporary.str());
+        if (!output) {
+            PIM_LOG_WARNING("Cannot write tuning database: " + temporary.str());
+            return;
+        }
+        std::string text;
+        llvm::raw_string_ostream stream(text);
+        stream << llvm::formatv("{0:2}", llvm::json::Value(std::move(root))) << "\n";
+        output << stream.str();
+    }
+    
+    std::error_code error;
+    std::filesystem::rename(temporary.str(), path, error);
+    if (error) {
+        PIM_LOG_WARNING("Cannot write tuning database " + path + ": " + error.message());
+        std::filesystem::remove(temporary.str(), error);
+    }
+}
@@ -0,0 +1,119 @@
+/**
+ * TuningDatabase.h
+ * Persistent store of the code generation parameters found by AutoTuner
+ */
+
+#ifndef TUNING_DATABASE_H
+#define TUNING_DATABASE_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include "MatrixShapeAnalysis.h"
+#include "../include/CompilerConfig.h"
+
+/**
+ * Code generation parameters of one kernel shape
+ * 
+ * A tiled kernel uses the given tile shape and order; an untiled kernel
+ * runs on a single PE or, when scheduled, on per-PE streams partitioned by
+ * the strategy.
+ */
+struct KernelTuning {
+    bool tiled = false;
+    unsigned tileRows = 0;
+    unsigned tileCols = 0;
+    unsigned tileDepth = 0;                 // 0 derives the depth from the PE-local memory
+    CompilerConfig::TilingParams::LoopOrder order = CompilerConfig::TilingParams::ORDER_IJK;
+    bool scheduled = false;
+    CompilerConfig::SchedulingParams::Strategy strategy = CompilerConfig::SchedulingParams::SCHEDULE_AUTO;
+    uint64_t estimatedCycles = 0;           // Static estimate of the kernel's program
+    unsigned candidates = 0;                // Configurations evaluated by the search
+    
+    /**
+     * Set the tiling and scheduling parameters of a configuration
+     */
+    void apply(CompilerConfig& config) const;
+    
+    /**
+     * Get a short description such as "tiled 8x8x16 ikj" or "untiled, 2D-block schedule"
+     */
+    std::string describe() const;
+};
+
+/**
+ * Tuning results by kernel shape and architecture, in a JSON file
+ * 
+ * One instance per file is shared by every compilation of the process,
+ * so parallel workers and batch entries see each other's results. The
+ * file is read once and rewritten atomically (temporary file and rename)
+ * after each new result, merged with entries other processes added in
+ * the meantime. Entries of another compiler version are dropped, since
+ * the code they were measured on may have changed. Without a file the
+ * results are kept for the process only.
+ */
+class TuningDatabase {
+public:
+    /**
+     * Get the database stored in a file
+     * 
+     * @param path JSON file, created on the first result; empty for a
+     *        database held in memory
+     */
+    static TuningDatabase& shared(const std::string& path);
+    
+    /**
+     * Build the key of a kernel shape under a configuration
+     * 
+     * The key covers the dimensions and variant of the kernel, its
+     * epilogue and sparsity pattern, the PIMArchParams and every other CompilerConfig field that
+     * changes the generated code, but not the parameters being tuned.
+     */
+    static std::string makeKey(const KernelShape& shape, const CompilerConfig& config);
+    
+    /**
+     * Find the tuning of a key
+     * 
+     * @param key Key from makeKey()
+     * @param tuning Receives the stored tuning
+     * @return True if the key has an entry
+     */
+    bool lookup(const std::string& key, KernelTuning& tuning) const;
+    
+    /**
+     * Add or replace the tuning of a key and write the file
+     * 
+     * Failures to write the file are logged and otherwise ignored.
+     * 
+     * @param key Key from makeKey()
+     * @param tuning Tuning found by the search
+     */
+    void record(const std::string& key, const KernelTuning& tuning);
+    
+    /**
+     * Get the number of entries
+     */
+    size_t size() const;
+
+private:
+    std::string path;
+    mutable std::mutex mutex;
+    std::map<std::string, KernelTuning> entries;
+    
+    explicit TuningDatabase(const std::string& path);
+    
+    /**
+     * Read the entries of the file, replacing none that are already held
+     * 
+     * @return False if the file exists but cannot be parsed
+     */
+    bool load();
+    
+    /**
+     * Write all entries to the file
+     */
+    void save() const;
+};
+
+#endif // TUNING_DATABASE_H
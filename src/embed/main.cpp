@@ -0,0 +1,177 @@
+/**
+ * Main entry point for the embedding example
+ * Compiles LLVM IR in process through PIMCompiler and emulates kernels on the host
+ */
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "compiler/CompilerDriver.h"
+#include "compiler/HostExecutor.h"
+#include "compiler/PIMCompiler.h"
+#include "utils/Logger.h"
+#include "../include/CompilerConfig.h"
+
+void printUsage(const std::string& programName) {
+    std::cout << "Usage: " << programName << " [options] input.ll\n"
+              << "Compiles LLVM IR in process with the PIMCompiler library API\n"
+              << "Options:\n"
+              << "  -o <file>        Write the program as text, or as a binary container\n"
+              << "                   with --format binary\n"
+              << "  --format <f>     Output format: text (default) or binary\n"
+              << "  --isa <v>        Instruction encoding: v2 (default) or v1\n"
+              << "  --repeat <n>     Compile the input n times; repeats hit the in-memory cache\n"
+              << "  --module         Pass the parsed llvm::Module instead of the IR text\n"
+              << "  --run <f>        Emulate function f on the host through the JIT\n"
+              << "  --print <g>      After --run, print the i32 global g as a JSON array\n"
+              << "  -v, --verbose    Enable verbose output\n"
+              << "  -h, --help       Display this help message\n";
+}
+
+// Count the i32 elements of a global of nested array type, 0 for other types
+size_t elementCount(llvm::Type* type) {
+    size_t count = 1;
+    while (auto* array = llvm::dyn_cast<llvm::ArrayType>(type)) {
+        count *= array->getNumElements();
+        type = array->getElementType();
+    }
+    return type->isIntegerTy(32) ? count : 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string inputFile;
+    std::string outputFile;
+    std::string runFunction;
+    std::vector<std::string> printGlobals;
+    unsigned repeat = 1;
+    bool useModule = false;
+    CompilerConfig config = CompilerConfig::getDefaultConfig();
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "-v" || arg == "--verbose") {
+            config.verboseOutput = true;
+        } else if (arg == "-o" && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else if (arg == "--format" && i + 1 < argc) {
+            config.outputFormat = argv[++i];
+            if (config.outputFormat != "text" && config.outputFormat != "binary") {
+                std::cerr << "Invalid output format: " << config.outputFormat << " (expected text or binary)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--isa" && i + 1 < argc) {
+            std::string isa = argv[++i];
+            if (isa == "v1") {
+                config.isaVersion = PIMEncoding::V1;
+            } else if (isa == "v2") {
+                config.isaVersion = PIMEncoding::V2;
+            } else {
+                std::cerr << "Invalid ISA version: " << isa << " (expected v1 or v2)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--module") {
+            useModule = true;
+        } else if (arg == "--run" && i + 1 < argc) {
+            runFunction = argv[++i];
+        } else if (arg == "--print" && i + 1 < argc) {
+            printGlobals.push_back(argv[++i]);
+        } else if (arg[0] == '-') {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            inputFile = arg;
+        }
+    }
+    
+    if (inputFile.empty()) {
+        std::cerr << "No input file specified" << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    Logger::getInstance().setVerbose(config.verboseOutput);
+    
+    try {
+        std::string ir = CompilerDriver::readFile(inputFile);
+        
+        // The caller's own context, as a serving stack embedding the compiler would have
+        llvm::LLVMContext context;
+        llvm::SMDiagnostic error;
+        std::unique_ptr<llvm::Module> module =
+            llvm::parseIR(llvm::MemoryBufferRef(ir, inputFile), error, context);
+        if (!module) {
+            std::string message;
+            llvm::raw_string_ostream messageStream(message);
+            error.print(argv[0], messageStream);
+            throw std::runtime_error("Failed to load LLVM IR: " + messageStream.str());
+        }
+        
+        PIMCompiler compiler(config);
+        std::shared_ptr<const CompiledProgram> program;
+        for (unsigned i = 0; i < repeat; ++i) {
+            size_t hits = compiler.getStats().hits;
+            program = useModule ? compiler.compileModule(*module) : compiler.compileIR(ir, inputFile);
+            InstructionSpan instructions = program->span();
+            std::cout << "Compile " << (i + 1) << ": " << instructions.size << " instructions, "
+                      << program->data.size() << " constant matrices ("
+                      << (compiler.getStats().hits > hits ? "cached" : "compiled") << ")" << std::endl;
+        }
+        
+        PIMCompilerStats stats = compiler.getStats();
+        std::cout << "In-memory cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+                  << stats.entries << " programs, " << stats.bytes << " bytes" << std::endl;
+        
+        if (!outputFile.empty()) {
+            std::ofstream out(outputFile, std::ios::binary);
+            if (config.outputFormat == "binary") {
+                std::vector<uint8_t> bytes = program->toBinary(config.archParams, config.isaVersion);
+                out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+            } else {
+                out << program->toText(config.isaVersion);
+            }
+            if (!out) {
+                throw std::runtime_error("Could not write output file: " + outputFile);
+            }
+        }
+        
+        if (!runFunction.empty()) {
+            HostExecutor executor(*module);
+            executor.run(runFunction);
+            
+            for (const auto& name : printGlobals) {
+                llvm::GlobalVariable* global = module->getGlobalVariable(name, true);
+                size_t count = global ? elementCount(global->getValueType()) : 0;
+                if (count == 0) {
+                    throw std::runtime_error("No i32 array global named " + name);
+                }
+                
+                const int32_t* values = static_cast<const int32_t*>(executor.lookup(name));
+                std::cout << "{\"" << name << "\": [";
+                for (size_t i = 0; i < count; ++i) {
+                    std::cout << (i ? ", " : "") << values[i];
+                }
+                std::cout << "]}" << std::endl;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
@@ -7,36 +7,141 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <sstream>
+#include <cstdlib>
 
-#include "compiler/Parser.h"
-#include "compiler/IRGenerator.h"
-#include "compiler/PIMBackend.h"
-#include "compiler/MemoryMapper.h"
+#include "compiler/CompilerDriver.h"
+#include "compiler/BatchCompiler.h"
+#include "compiler/InstructionSink.h"
 #include "optimizer/RefactoringAssistant.h"
+#include "optimizer/CodeQualityAnalyzer.h"
 #include "utils/Logger.h"
+#include "utils/TimeProfiler.h"
 #include "../include/CompilerConfig.h"
+#include "../include/PIMInstructionSet.h"
 
 void printUsage(const std::string& programName) {
     std::cout << "Usage: " << programName << " [options] input_file\n"
+              << "       " << programName << " [options] --batch manifest | input_file...\n"
+              << "Input files ending in .ll or .bc are read as LLVM IR\n"
               << "Options:\n"
               << "  -o <file>        Write output to <file>\n"
+              << "  --format <fmt>   Output format: text (default) or binary\n"
+              << "  -O<n>            LLVM IR pipeline before shape analysis: 0 (none), 1 (SSA cleanup),\n"
+              << "                   2 (default, adds loop canonicalization) or 3 (adds GVN and DSE)\n"
+              << "  --isa <v>        Instruction encoding: v2 (default, 64-bit words with wide operands,\n"
+              << "                   MAC and block transfers) or v1 (32-bit, first 256 words only)\n"
+              << "  --no-coalesce    Keep one LOAD/STORE per word instead of block transfers (ISA v2)\n"
               << "  -v, --verbose    Enable verbose output\n"
+              << "  --log-level <l>  Lowest level logged: debug, info (default), warning or error\n"
+              << "  --log-file <f>   Append log messages to <f> (written in the background)\n"
+              << "  --time-report    Print wall time and peak heap usage per compilation stage to stderr\n"
+              << "  --time-trace <f> Write the stage intervals to <f> as a Chrome trace (JSON)\n"
+              << "  --stats <f>      Write instruction mix, host traffic, register pressure and estimated\n"
+              << "                   cycles of the generated program to <f> as JSON\n"
               << "  -h, --help       Display this help message\n"
-              << "  --dump-ir        Dump LLVM IR to stderr\n"
+              << "  --dump-ir        Dump the LLVM IR of the input, before the IR pipeline, to stderr\n"
               << "  --refactor       Enable AI-powered code refactoring suggestions\n"
               << "  --refactor-only  Only suggest refactoring without compiling\n"
-              << "  --refactor-detailed    Generate more detailed refactoring suggestions\n";
+              << "  --refactor-detailed    Generate more detailed refactoring suggestions\n"
+              << "  --tile <RxCxK>   Use tiled code generation with the given tile shape\n"
+              << "  --tile-order <o> Order of tiles and slices: ijk (default), or ikj/jki keeping\n"
+              << "                   partial sums in PE memory so A/B slices load once per row/column\n"
+              << "  --autotune       Search tile shapes, tile orders and PE schedules per kernel shape\n"
+              << "                   against the cycle estimate of --stats\n"
+              << "  --tuning-db <f>  Store and reuse tuning results in <f>\n"
+              << "                   (default: $PIM_TUNING_DB, unset keeps them for one run)\n"
+              << "  --dims <RxCxK[xB]> Matrix dimensions to assume when they cannot be inferred,\n"
+              << "                   with the product count of a batched kernel\n"
+              << "  --symbolic       Emit one looped program whose sizes are read at launch\n"
+              << "  --precision <p>  Element type of A and B: int32 (default), or int16/int8 packed\n"
+              << "                   2/4 lanes per word with 32-bit accumulation\n"
+              << "  --no-tiling      Disable tiled code generation\n"
+              << "  --no-double-buffer     Load tile slices in sequence instead of overlapping them with compute\n"
+              << "  --no-regalloc    Disable register-resident accumulators\n"
+              << "  --no-weight-folding    Load a constant B from the host and multiply by every weight\n"
+              << "                   instead of carrying it in the program and folding 0, +-1 and\n"
+              << "                   power-of-two weights into adds and shifts\n"
+              << "  --no-kernel-linking    Lower every kernel of a module on its own instead of keeping\n"
+              << "                   the intermediates and weights they share in PIM memory\n"
+              << "  --bank-hash <h>  Hardware bank mapping: linear, interleaved (default) or xor\n"
+              << "  --no-layout      Disable bank-aware layout planning\n"
+              << "  --pe-schedule <s> Distribute untiled kernels over per-PE streams: auto (cost model),\n"
+              << "                   row, column or 2d blocks of C\n"
+              << "  --devices <n>    Shard every kernel over n PIM devices or channels; writes the\n"
+              << "                   host schedule to <output>.schedule\n"
+              << "  --shard <s>      Partition of sharded kernels: auto (traffic model, default), rows,\n"
+              << "                   columns, common (host reduction), 2d or summa (panel broadcasts)\n"
+              << "  -j, --jobs <n>   Compile functions (batches: files) on n threads (0 = all cores, default 1)\n"
+              << "  --batch <file>   Compile every input listed in a manifest (\"input [output]\" per line)\n"
+              << "  --output-dir <d> Directory for batch outputs without an explicit output file\n"
+              << "  --cache-dir <d>  Reuse outputs of identical compilations stored in <d>\n"
+              << "                   (default: $PIM_COMPILER_CACHE_DIR, unset disables the cache)\n"
+              << "  --cache-size <n> Evict least recently used cache entries above n MiB (default 256)\n"
+              << "  --no-cache       Do not read or write the compilation cache\n";
+}
+
+// Prints the time report and writes the trace when main returns
+struct ProfileOutput {
+    bool report = false;
+    std::string traceFile;
+    
+    ~ProfileOutput() {
+        TimeProfiler& profiler = TimeProfiler::getInstance();
+        if (!profiler.isEnabled()) {
+            return;
+        }
+        if (report) {
+            profiler.printReport(std::cerr);
+        }
+        if (!traceFile.empty()) {
+            try {
+                profiler.writeTrace(traceFile);
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+            }
+        }
+    }
+};
+
+// Parse a dimension triple of the form "RxCxK", followed by "xB" if batch is given
+bool parseDimensions(const std::string& text, unsigned& first, unsigned& second, unsigned& third,
+                     unsigned* batch = nullptr) {
+    std::stringstream ss(text);
+    char sep1 = 0, sep2 = 0;
+    if (!(ss >> first >> sep1 >> second >> sep2 >> third) || sep1 != 'x' || sep2 != 'x') {
+        return false;
+    }
+    if (batch && !ss.eof()) {
+        char sep3 = 0;
+        if (!(ss >> sep3 >> *batch) || sep3 != 'x' || *batch == 0) {
+            return false;
+        }
+    }
+    return ss.eof() && first > 0 && second > 0 && third > 0;
 }
 
 int main(int argc, char* argv[]) {
     // Parse command line arguments
-    std::string inputFile;
+    std::vector<std::string> inputFiles;
+    std::string manifestFile;
+    std::string outputDir;
     std::string outputFile = "a.out";
+    bool outputFileGiven = false;
+    bool cacheDirGiven = false;
+    bool noCache = false;
     bool verbose = false;
+    LogLevel logLevel = LogLevel::INFO;
+    std::string logFile;
+    ProfileOutput profileOutput;
     bool dumpIR = false;
     bool enableRefactoring = false;
     bool refactorOnly = false;
     bool detailedRefactoring = false;
+    std::string statsFile;
+    bool tuningDbGiven = false;
+    std::string fixedCodegenOption;   // Last option fixing a parameter the tuner searches
+    CompilerConfig config = CompilerConfig::getDefaultConfig();
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -45,6 +150,27 @@ int main(int argc, char* argv[]) {
             return 0;
         } else if (arg == "-v" || arg == "--verbose") {
             verbose = true;
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            std::string level = argv[++i];
+            if (!Logger::parseLevel(level, logLevel)) {
+                std::cerr << "Unknown log level: " << level << " (expected debug, info, warning or error)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--log-file" && i + 1 < argc) {
+            logFile = argv[++i];
+        } else if (arg == "--time-report") {
+            profileOutput.report = true;
+        } else if (arg == "--time-trace" && i + 1 < argc) {
+            profileOutput.traceFile = argv[++i];
+        } else if (arg == "--stats" && i + 1 < argc) {
+            statsFile = argv[++i];
+        } else if (arg.size() > 2 && arg.compare(0, 2, "-O") == 0) {
+            std::string level = arg.substr(2);
+            if (level != "0" && level != "1" && level != "2" && level != "3") {
+                std::cerr << "Unknown optimization level: " << arg << " (expected -O0 to -O3)" << std::endl;
+                return 1;
+            }
+            config.optimizationLevel = static_cast<CompilerConfig::OptimizationLevel>(std::stoi(level));
         } else if (arg == "--dump-ir") {
             dumpIR = true;
         } else if (arg == "--refactor") {
@@ -55,10 +181,167 @@ int main(int argc, char* argv[]) {
         } else if (arg == "--refactor-detailed") {
             enableRefactoring = true;
             detailedRefactoring = true;
+        } else if (arg == "--tile" && i + 1 < argc) {
+            std::string shape = argv[++i];
+            if (!parseDimensions(shape, config.tiling.tileRows, config.tiling.tileCols, config.tiling.tileDepth)) {
+                std::cerr << "Invalid tile shape: " << shape << " (expected RxCxK)" << std::endl;
+                return 1;
+            }
+            config.tiling.enabled = true;
+            fixedCodegenOption = arg;
+        } else if (arg == "--tile-order" && i + 1 < argc) {
+            std::string order = argv[++i];
+            if (order == "ijk") {
+                config.tiling.order = CompilerConfig::TilingParams::ORDER_IJK;
+            } else if (order == "ikj") {
+                config.tiling.order = CompilerConfig::TilingParams::ORDER_IKJ;
+            } else if (order == "jki") {
+                config.tiling.order = CompilerConfig::TilingParams::ORDER_JKI;
+            } else {
+                std::cerr << "Unknown tile order: " << order << " (expected ijk, ikj or jki)" << std::endl;
+                return 1;
+            }
+            fixedCodegenOption = arg;
+        } else if (arg == "--autotune") {
+            config.tuning.enabled = true;
+        } else if (arg == "--tuning-db" && i + 1 < argc) {
+            config.tuning.database = argv[++i];
+            tuningDbGiven = true;
+        } else if (arg == "--dims" && i + 1 < argc) {
+            std::string dims = argv[++i];
+            auto& assumed = config.assumedDimensions;
+            if (!parseDimensions(dims, assumed.rows, assumed.cols, assumed.common, &assumed.batch)) {
+                std::cerr << "Invalid matrix dimensions: " << dims << " (expected RxCxK or RxCxKxB)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--symbolic") {
+            config.symbolicDimensions = true;
+            fixedCodegenOption = arg;
+        } else if (arg == "--precision" && i + 1 < argc) {
+            std::string precision = argv[++i];
+            if (precision == "int8" || precision == "8") {
+                config.precision = 8;
+            } else if (precision == "int16" || precision == "16") {
+                config.precision = 16;
+            } else if (precision == "int32" || precision == "32") {
+                config.precision = 32;
+            } else {
+                std::cerr << "Unknown precision: " << precision << " (expected int8, int16 or int32)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--no-tiling") {
+            config.tiling.enabled = false;
+            fixedCodegenOption = arg;
+        } else if (arg == "--no-double-buffer") {
+            config.tiling.doubleBuffering = false;
+        } else if (arg == "--no-regalloc") {
+            config.enableRegisterAllocation = false;
+        } else if (arg == "--no-weight-folding") {
+            config.foldConstantWeights = false;
+        } else if (arg == "--no-kernel-linking") {
+            config.linkKernels = false;
+        } else if (arg == "--bank-hash" && i + 1 < argc) {
+            std::string hashing = argv[++i];
+            if (hashing == "linear") {
+                config.layout.bankHashing = CompilerConfig::LayoutParams::BANK_HASH_LINEAR;
+            } else if (hashing == "interleaved") {
+                config.layout.bankHashing = CompilerConfig::LayoutParams::BANK_HASH_INTERLEAVED;
+            } else if (hashing == "xor") {
+                config.layout.bankHashing = CompilerConfig::LayoutParams::BANK_HASH_XOR;
+            } else {
+                std::cerr << "Unknown bank hashing: " << hashing << std::endl;
+                return 1;
+            }
+        } else if (arg == "--pe-schedule" && i + 1 < argc) {
+            std::string strategy = argv[++i];
+            config.scheduling.enabled = true;
+            fixedCodegenOption = arg;
+            if (strategy == "auto") {
+                config.scheduling.strategy = CompilerConfig::SchedulingParams::SCHEDULE_AUTO;
+            } else if (strategy == "row") {
+                config.scheduling.strategy = CompilerConfig::SchedulingParams::SCHEDULE_ROW_BLOCK;
+            } else if (strategy == "column") {
+                config.scheduling.strategy = CompilerConfig::SchedulingParams::SCHEDULE_COLUMN_BLOCK;
+            } else if (strategy == "2d") {
+                config.scheduling.strategy = CompilerConfig::SchedulingParams::SCHEDULE_BLOCK_2D;
+            } else {
+                std::cerr << "Unknown PE schedule: " << strategy << std::endl;
+                return 1;
+            }
+        } else if (arg == "--devices" && i + 1 < argc) {
+            std::string devices = argv[++i];
+            if (devices.empty() || devices.find_first_not_of("0123456789") != std::string::npos ||
+                std::stoul(devices) == 0) {
+                std::cerr << "Invalid device count: " << devices << std::endl;
+                return 1;
+            }
+            config.sharding.devices = static_cast<unsigned>(std::stoul(devices));
+        } else if (arg == "--shard" && i + 1 < argc) {
+            std::string strategy = argv[++i];
+            if (strategy == "auto") {
+                config.sharding.strategy = CompilerConfig::ShardingParams::SHARD_AUTO;
+            } else if (strategy == "rows") {
+                config.sharding.strategy = CompilerConfig::ShardingParams::SHARD_ROWS;
+            } else if (strategy == "columns") {
+                config.sharding.strategy = CompilerConfig::ShardingParams::SHARD_COLUMNS;
+            } else if (strategy == "common") {
+                config.sharding.strategy = CompilerConfig::ShardingParams::SHARD_COMMON;
+            } else if (strategy == "2d") {
+                config.sharding.strategy = CompilerConfig::ShardingParams::SHARD_2D;
+            } else if (strategy == "summa") {
+                config.sharding.strategy = CompilerConfig::ShardingParams::SHARD_SUMMA;
+            } else {
+                std::cerr << "Unknown sharding: " << strategy << std::endl;
+                return 1;
+            }
+        } else if (arg == "--no-layout") {
+            config.layout.enabled = false;
+        } else if ((arg == "-j" || arg == "--jobs") && i + 1 < argc) {
+            std::string jobs = argv[++i];
+            if (jobs.empty() || jobs.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "Invalid job count: " << jobs << std::endl;
+                return 1;
+            }
+            config.compileJobs = static_cast<unsigned>(std::stoul(jobs));
+        } else if (arg == "--format" && i + 1 < argc) {
+            config.outputFormat = argv[++i];
+            if (config.outputFormat != "text" && config.outputFormat != "binary") {
+                std::cerr << "Unknown output format: " << config.outputFormat << std::endl;
+                return 1;
+            }
+        } else if (arg == "--isa" && i + 1 < argc) {
+            std::string isa = argv[++i];
+            if (isa == "v1" || isa == "1") {
+                config.isaVersion = PIMEncoding::V1;
+            } else if (isa == "v2" || isa == "2") {
+                config.isaVersion = PIMEncoding::V2;
+            } else {
+                std::cerr << "Unknown ISA version: " << isa << " (expected v1 or v2)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--no-coalesce") {
+            config.coalesceTransfers = false;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            manifestFile = argv[++i];
+        } else if (arg == "--output-dir" && i + 1 < argc) {
+            outputDir = argv[++i];
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            config.cache.directory = argv[++i];
+            cacheDirGiven = true;
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            std::string size = argv[++i];
+            if (size.empty() || size.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "Invalid cache size: " << size << std::endl;
+                return 1;
+            }
+            config.cache.maxBytes = std::stoull(size) << 20;
+        } else if (arg == "--no-cache") {
+            noCache = true;
         } else if (arg == "-o" && i + 1 < argc) {
             outputFile = argv[++i];
+            outputFileGiven = true;
         } else if (arg[0] != '-') {
-            inputFile = arg;
+            inputFiles.push_back(arg);
         } else {
             std::cerr << "Unknown option: " << arg << std::endl;
             printUsage(argv[0]);
@@ -66,33 +349,101 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    if (inputFile.empty()) {
+    if (inputFiles.empty() && manifestFile.empty()) {
         std::cerr << "Error: No input file specified\n";
         printUsage(argv[0]);
         return 1;
     }
 
-    // Set up logging
-    Logger::getInstance().setVerbose(verbose);
-    Logger::getInstance().log("PIM Compiler started");
-    Logger::getInstance().log("Input file: " + inputFile);
-    Logger::getInstance().log("Output file: " + outputFile);
+    if (config.tuning.enabled && !fixedCodegenOption.empty()) {
+        std::cerr << "Error: --autotune chooses tiling and PE schedules itself; it cannot be combined with "
+                  << fixedCodegenOption << std::endl;
+        return 1;
+    }
 
-    try {
-        // Read input file
-        std::ifstream inFile(inputFile);
-        if (!inFile) {
-            std::cerr << "Error: Could not open input file: " << inputFile << std::endl;
+    config.verboseOutput = verbose;
+    
+    // Set up logging
+    Logger& logger = Logger::getInstance();
+    logger.setVerbose(verbose);
+    logger.setLevel(logLevel);
+    if (!logFile.empty()) {
+        logger.setOutputFile(logFile);
+    }
+    if (profileOutput.report || !profileOutput.traceFile.empty()) {
+        TimeProfiler::getInstance().enable();
+    }
+    
+    // The environment enables the cache for every invocation of a build
+    if (noCache) {
+        config.cache.directory.clear();
+    } else if (!cacheDirGiven) {
+        const char* cacheDir = std::getenv("PIM_COMPILER_CACHE_DIR");
+        config.cache.directory = cacheDir ? cacheDir : "";
+    }
+    if (!tuningDbGiven) {
+        const char* tuningDb = std::getenv("PIM_TUNING_DB");
+        config.tuning.database = tuningDb ? tuningDb : "";
+    }
+    
+    // Several inputs or a manifest compile as one batch
+    if (!manifestFile.empty() || inputFiles.size() > 1) {
+        if (outputFileGiven || enableRefactoring || dumpIR || !statsFile.empty()) {
+            std::cerr << "Error: -o, --dump-ir, --refactor and --stats apply to a single input; "
+                      << "use a manifest or --output-dir for batch outputs\n";
             return 1;
         }
+        
+        PIM_LOG_INFO("PIM Compiler started in batch mode");
+        
+        try {
+            BatchCompiler batch(config);
+            std::vector<BatchEntry> entries;
+            if (!manifestFile.empty()) {
+                entries = batch.readManifest(manifestFile, outputDir);
+            }
+            for (const auto& input : inputFiles) {
+                entries.push_back({input, batch.defaultOutput(input, outputDir)});
+            }
+            
+            std::vector<BatchEntryResult> results = batch.compile(entries);
+            size_t compiled = 0, cached = 0;
+            for (size_t i = 0; i < entries.size(); i++) {
+                if (results[i].success) {
+                    std::cout << "Compiled " << entries[i].inputFile << " to " << entries[i].outputFile
+                              << (results[i].cached ? " (cached)" : "") << std::endl;
+                    compiled++;
+                    cached += results[i].cached ? 1 : 0;
+                } else {
+                    std::cerr << "Error: " << entries[i].inputFile << ": " << results[i].error << std::endl;
+                }
+            }
+            std::cout << "Compiled " << compiled << " of " << entries.size() << " files";
+            if (cached > 0) {
+                std::cout << " (" << cached << " from cache)";
+            }
+            std::cout << std::endl;
+            return compiled == entries.size() ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    
+    const std::string inputFile = inputFiles.front();
+
+    PIM_LOG_INFO("PIM Compiler started");
+    PIM_LOG_INFO("Input file: " + inputFile);
+    PIM_LOG_INFO("Output file: " + outputFile);
 
-        std::string source((std::istreambuf_iterator<char>(inFile)),
-                           std::istreambuf_iterator<char>());
-        inFile.close();
+    try {
+        // Read input file
+        std::string source = CompilerDriver::readFile(inputFile);
         
         // Process refactoring if enabled
         if (enableRefactoring) {
-            Logger::getInstance().log("Running AI-powered code refactoring analysis...");
+            PIM_LOG_INFO("Running AI-powered code refactoring analysis...");
+            ScopedTimer timer("Refactoring analysis");
             std::cout << "\n=== PIM Architecture Code Refactoring Assistant ===\n";
             
             RefactoringAssistant assistant;
@@ -158,78 +509,94 @@ int main(int argc, char* argv[]) {
         }
 
         // Create compiler pipeline components
-        Parser parser;
-        IRGenerator irGenerator;
-        MemoryMapper memoryMapper;
-        PIMBackend backend;
-
-        // Execute compilation pipeline
-        Logger::getInstance().log("Parsing input file...");
-        std::unique_ptr<llvm::Module> module;
-        
-#ifdef HAVE_CLANG
-        auto ast = parser.parse(source);
-        Logger::getInstance().log("Generating LLVM IR...");
-        module = irGenerator.generateIR(ast);
-#else
-        try {
-            void* dummyAst = parser.parse(source);
-            Logger::getInstance().log("Generating LLVM IR...");
-            module = irGenerator.generateIR(dummyAst);
-        } catch (const std::runtime_error& e) {
-            Logger::getInstance().log("Using fallback path: Clang not available");
-            // Pass nullptr as a void* directly to the IR generator
-            module = irGenerator.generateIR(nullptr);
-        }
-#endif
+        CompilerDriver driver(config);
         
-        if (dumpIR) {
-            irGenerator.dumpIR(module);
+        // Plain compilations run as a whole so they can be served from the cache
+        if (!enableRefactoring && !dumpIR && statsFile.empty()) {
+            CompileResult result = driver.compileFile(inputFile, outputFile);
+            PIM_LOG_INFO("Compilation completed successfully");
+            std::cout << "Compiled " << inputFile << " to " << outputFile
+                      << (result.cached ? " (cached)" : "") << std::endl;
+            return 0;
         }
+
+        // Execute compilation pipeline
+        std::unique_ptr<llvm::Module> module = driver.buildModule(inputFile, source, dumpIR);
         
-        Logger::getInstance().log("Applying memory mapping for PIM architecture...");
-        auto mappedModule = memoryMapper.applyMemoryMapping(module);
-        
-        Logger::getInstance().log("Generating PIM instructions...");
-        auto instructions = backend.generatePIMInstructions(mappedModule);
+        // Open the output before generation so instructions stream straight to the file
+        std::ofstream outFile;
+        std::unique_ptr<InstructionSink> sink = driver.openOutput(outputFile, outFile);
         
-        // Add instruction-level optimization suggestions if refactoring is enabled
-        if (enableRefactoring) {
-            Logger::getInstance().log("Analyzing generated PIM instructions...");
-            std::cout << "\n=== PIM Instruction Optimization Analysis ===\n";
+        // Analyze the generated program if refactoring or statistics are enabled
+        if (enableRefactoring || !statsFile.empty()) {
+            // The instruction analysis needs the whole program in memory
+            std::vector<PIMInstruction> instructions;
+            std::vector<PIMConstantMatrix> data;
+            VectorInstructionSink instructionBuffer(instructions, &data);
+            driver.generate(module, instructionBuffer);
             
-            RefactoringAssistant assistant;
-            auto instructionSuggestions = assistant.suggestInstructionOptimizations(instructions, source);
+            if (!statsFile.empty()) {
+                ScopedTimer timer("Code statistics");
+                CodeQualityReport report = CodeQualityAnalyzer(config).analyze(instructions);
+                PIM_LOG_INFO("Estimated " + std::to_string(report.estimatedCycles) + " cycles, " +
+                             report.bound + " bound");
             
-            if (instructionSuggestions.empty()) {
-                std::cout << "No instruction-level optimization suggestions found.\n";
-                std::cout << "The generated PIM code appears to be already well-optimized.\n";
-            } else {
-                std::cout << "Found " << instructionSuggestions.size() << " potential instruction-level optimizations:\n\n";
+                std::ofstream stats(statsFile);
+                CodeQualityAnalyzer::writeJson(report, stats);
+                stats.close();
+                if (!stats) {
+                    std::cerr << "Error: Could not write statistics file: " << statsFile << std::endl;
+                    return 1;
+                }
+            }
+            
+            // Add instruction-level optimization suggestions if refactoring is enabled
+            if (enableRefactoring) {
+                PIM_LOG_INFO("Analyzing generated PIM instructions...");
+                ScopedTimer timer("Instruction analysis");
+                std::cout << "\n=== PIM Instruction Optimization Analysis ===\n";
                 
-                int i = 1;
-                for (const auto& [name, suggestion] : instructionSuggestions) {
-                    std::cout << "Suggestion " << i << ": " << name << "\n";
-                    std::cout << "-------------------------------------\n";
-                    std::cout << suggestion << "\n\n";
-                    i++;
+                RefactoringAssistant assistant;
+                auto instructionSuggestions = assistant.suggestInstructionOptimizations(instructions, source);
+                
+                if (instructionSuggestions.empty()) {
+                    std::cout << "No instruction-level optimization suggestions found.\n";
+                    std::cout << "The generated PIM code appears to be already well-optimized.\n";
+                } else {
+                    std::cout << "Found " << instructionSuggestions.size() << " potential instruction-level optimizations:\n\n";
+                    
+                    int i = 1;
+                    for (const auto& [name, suggestion] : instructionSuggestions) {
+                        std::cout << "Suggestion " << i << ": " << name << "\n";
+                        std::cout << "-------------------------------------\n";
+                        std::cout << suggestion << "\n\n";
+                        i++;
+                    }
                 }
             }
+            
+            for (const auto& matrix : data) {
+                sink->emitData(matrix);
+            }
+            for (const auto& instruction : instructions) {
+                sink->emit(instruction);
+            }
+        } else {
+            driver.generate(module, *sink);
         }
         
         // Write output to file
-        std::ofstream outFile(outputFile);
-        if (!outFile) {
-            std::cerr << "Error: Could not open output file: " << outputFile << std::endl;
-            return 1;
-        }
-        
-        for (const auto& instruction : instructions) {
-            outFile << instruction.toString() << "\n";
+        sink->finish();
+        if (outFile.is_open()) {
+            outFile.close();
+            if (!outFile) {
+                std::cerr << "Error: Could not write output file: " << outputFile << std::endl;
+                return 1;
+            }
         }
-        outFile.close();
+        driver.writeSchedule(outputFile);
         
-        Logger::getInstance().log("Compilation completed successfully");
+        PIM_LOG_INFO("Compilation completed successfully");
         std::cout << "Compiled " << inputFile << " to " << outputFile << std::endl;
         
         return 0;
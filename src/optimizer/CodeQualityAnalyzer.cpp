@@ -0,0 +1,364 @@
+/**
+ * CodeQualityAnalyzer.cpp
+ * Implementation of the static program measurements
+ */
+
+#include "optimizer/CodeQualityAnalyzer.h"
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <llvm/Support/FormatVariadic.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_os_ostream.h>
+
+namespace {
+
+using RegisterSet = std::bitset<CodeQualityAnalyzer::MAX_TRACKED_REGISTERS>;
+
+uint64_t divideRoundingUp(uint64_t value, uint64_t divisor) {
+    return (value + divisor - 1) / divisor;
+}
+
+bool isArithmetic(PIMOpcode opcode) {
+    switch (opcode) {
+        case PIM_ADD:
+        case PIM_SUB:
+        case PIM_MUL:
+        case PIM_MAC:
+        case PIM_DIV:
+        case PIM_AND:
+        case PIM_OR:
+        case PIM_XOR:
+        case PIM_NOT:
+        case PIM_SHL:
+        case PIM_SHR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool isStreamMarker(const PIMInstruction& instruction) {
+    return instruction.getOpcode() == PIM_CONFIG && instruction.getDest() == PIM_CONFIG_PE_STREAM;
+}
+
+// Tracked registers an instruction reads and writes
+struct RegisterOperands {
+    unsigned uses[3];
+    unsigned useCount = 0;
+    bool writes = false;
+    unsigned def = 0;
+    
+    void use(unsigned reg) {
+        if (reg < CodeQualityAnalyzer::MAX_TRACKED_REGISTERS) {
+            uses[useCount++] = reg;
+        }
+    }
+
+    void define(unsigned reg) {
+        if (reg < CodeQualityAnalyzer::MAX_TRACKED_REGISTERS) {
+            writes = true;
+            def = reg;
+        }
+    }
+};
+
+RegisterOperands registerOperands(const PIMInstruction& instruction) {
+    RegisterOperands operands;
+    const PIMOpcode opcode = instruction.getOpcode();
+    if (isArithmetic(opcode)) {
+        operands.define(instruction.getDest());
+        operands.use(instruction.getSrc1());
+        if (opcode != PIM_NOT) {
+            operands.use(instruction.getSrc2());
+        }
+        if (opcode == PIM_MAC) {
+            operands.use(instruction.getDest());
+        }
+    } else if (opcode == PIM_MOVE) {
+        const unsigned mode = instruction.getImm();
+        if (mode == PIM_MOVE_TO_REG || mode == PIM_MOVE_TO_REG_INDIRECT) {
+            operands.define(instruction.getDest());
+            if (mode == PIM_MOVE_TO_REG_INDIRECT) {
+                operands.use(instruction.getSrc1());
+            }
+        } else {
+            operands.use(instruction.getSrc1());
+            if (mode == PIM_MOVE_TO_MEM_INDIRECT) {
+                operands.use(instruction.getDest());
+            }
+        }
+    } else if (opcode == PIM_JUMPZ || opcode == PIM_JUMPNZ) {
+        operands.use(instruction.getSrc1());
+    }
+    return operands;
+}
+
+} // namespace
+
+CodeQualityAnalyzer::CodeQualityAnalyzer(const CompilerConfig& config, const StaticCostModel& model)
+    : config(config), model(model) {}
+
+CodeQualityAnalyzer::~CodeQualityAnalyzer() {}
+
+void CodeQualityAnalyzer::issue(const PIMInstruction& instruction, Timeline& timeline) const {
+    const RegisterOperands operands = registerOperands(instruction);
+    
+    uint64_t start = timeline.cycle;
+    for (unsigned i = 0; i < operands.useCount; i++) {
+        start = std::max(start, timeline.registerReady[operands.uses[i]]);
+    }
+    
+    // Branches, configuration and barriers stall issue; everything else is pipelined
+    uint64_t latency = 1;
+    uint64_t issueCycles = 1;
+    switch (instruction.getOpcode()) {
+        case PIM_MUL:
+        case PIM_MAC:
+            latency = model.mulCycles;
+            break;
+        case PIM_DIV:
+            latency = model.divCycles;
+            break;
+        case PIM_MOVE:
+            latency = model.bankCycles;
+            break;
+        case PIM_JUMP:
+        case PIM_JUMPZ:
+        case PIM_JUMPNZ:
+            issueCycles = model.branchCycles;
+            break;
+        case PIM_CONFIG:
+            issueCycles = model.configCycles;
+            break;
+        case PIM_SYNC:
+            issueCycles = model.syncCycles;
+            break;
+        default:
+            latency = isArithmetic(instruction.getOpcode()) ? model.aluCycles : 1;
+            break;
+    }
+    
+    timeline.cycle = start + issueCycles;
+    timeline.finish = std::max(timeline.finish, timeline.cycle);
+    if (operands.writes) {
+        timeline.registerReady[operands.def] = start + latency;
+        timeline.finish = std::max(timeline.finish, start + latency);
+    }
+}
+
+CodeQualityReport CodeQualityAnalyzer::analyze(const std::vector<PIMInstruction>& program) const {
+    const auto& arch = config.archParams;
+    const uint64_t wordBytes = std::max(1u, arch.wordSize / 8);
+    const unsigned linkBandwidth = std::max(1u, model.hostBytesPerCycle);
+    
+    CodeQualityReport report;
+    report.instructions = program.size();
+    report.registerFileSize = arch.registerFileSize;
+    
+    // PE array configuration of the broadcast stream
+    unsigned arraySize = 1;
+    unsigned activePEs = 1;
+    
+    // The broadcast stream, and the PE streams of the open section, which
+    // all start when the section does
+    Timeline broadcast;
+    Timeline stream;
+    uint64_t sectionEnd = 0;
+    bool inStream = false;
+    
+    // Counted by opcode and named once at the end
+    std::array<uint64_t, 256> opcodeCounts{};
+    
+    for (const auto& instruction : program) {
+        const PIMOpcode opcode = instruction.getOpcode();
+        opcodeCounts[static_cast<uint8_t>(opcode)]++;
+        
+        if (isStreamMarker(instruction)) {
+            if (inStream) {
+                sectionEnd = std::max(sectionEnd, stream.finish);
+            } else {
+                sectionEnd = broadcast.cycle;
+            }
+            stream = Timeline();
+            stream.cycle = broadcast.cycle;
+            inStream = true;
+            report.peStreams++;
+            issue(instruction, stream);
+            continue;
+        }
+        if (opcode == PIM_SYNC) {
+            // The barrier waits for the slowest stream and every outstanding operation
+            if (inStream) {
+                sectionEnd = std::max(sectionEnd, stream.finish);
+                inStream = false;
+            }
+            broadcast.cycle = std::max({broadcast.cycle, broadcast.finish, sectionEnd});
+        }
+        
+        const uint64_t numActive = inStream ? 1 : activePEs;
+        switch (opcode) {
+            case PIM_CONFIG:
+                if (instruction.getDest() == PIM_CONFIG_ARRAY_SIZE) {
+                    arraySize = instruction.getSrc1();
+                } else if (instruction.getDest() == PIM_CONFIG_INTERCONNECT) {
+                    activePEs = std::max(1u, std::min(arraySize, arch.numProcessingElements));
+                    report.activePEs = std::max(report.activePEs, activePEs);
+                } else if (instruction.getDest() == PIM_CONFIG_PRECISION && instruction.getSrc2() != 0) {
+                    report.lanes = instruction.getSrc2();
+                }
+                break;
+            
+            case PIM_LOAD:
+            case PIM_LOAD_BLOCK: {
+                const bool block = opcode == PIM_LOAD_BLOCK;
+                const unsigned buffer = block ? PIMBlockOperand::buffer(instruction.getSrc1()) : instruction.getSrc1();
+                const uint64_t count = block ? PIMBlockOperand::count(instruction.getSrc1()) : 1;
+                const uint64_t bytes = count * numActive * wordBytes;
+                if (buffer == PIM_HOST_ZERO) {
+                    report.zeroFillBytes += bytes;
+                } else {
+                    report.hostLoads++;
+                    report.hostLoadBytes += bytes;
+                    report.hostLinkCycles += divideRoundingUp(bytes, linkBandwidth);
+                }
+                break;
+            }
+            
+            case PIM_STORE:
+            case PIM_STORE_BLOCK: {
+                const bool block = opcode == PIM_STORE_BLOCK;
+                const uint64_t count = block ? PIMBlockOperand::count(instruction.getDest()) : 1;
+                const uint64_t bytes = count * numActive * wordBytes;
+                report.hostStores++;
+                report.hostStoreBytes += bytes;
+                report.hostLinkCycles += divideRoundingUp(bytes, linkBandwidth);
+                break;
+            }
+            
+            case PIM_MUL:
+            case PIM_MAC:
+                report.macs += static_cast<uint64_t>(report.lanes) * numActive;
+                break;
+            
+            case PIM_JUMP:
+            case PIM_JUMPZ:
+            case PIM_JUMPNZ:
+                report.hasJumps = true;
+                break;
+            
+            default:
+                break;
+        }
+        
+        issue(instruction, inStream ? stream : broadcast);
+    }
+    if (inStream) {
+        sectionEnd = std::max(sectionEnd, stream.finish);
+    }
+    report.issueCycles = std::max({broadcast.cycle, broadcast.finish, sectionEnd});
+    for (unsigned opcode = 0; opcode < opcodeCounts.size(); opcode++) {
+        if (opcodeCounts[opcode] > 0) {
+            report.opcodeCounts[PIMInstruction::getOpcodeName(static_cast<PIMOpcode>(opcode))] += opcodeCounts[opcode];
+        }
+    }
+    
+    const uint64_t hostBytes = report.hostLoadBytes + report.hostStoreBytes;
+    report.estimatedCycles = std::max(report.issueCycles, report.hostLinkCycles) +
+                             (hostBytes > 0 ? model.hostLatencyCycles : 0);
+    
+    // Roofline: the device issues at most one MUL or MAC per PE and cycle
+    report.arithmeticIntensity = hostBytes > 0 ? static_cast<double>(report.macs) / hostBytes : 0.0;
+    report.peakMacsPerCycle = static_cast<double>(std::max(1u, arch.numProcessingElements)) * report.lanes;
+    report.hostBytesPerCycle = linkBandwidth;
+    report.ridgeIntensity = report.peakMacsPerCycle / report.hostBytesPerCycle;
+    if (hostBytes > 0 && report.arithmeticIntensity < report.ridgeIntensity) {
+        report.attainableMacsPerCycle = report.arithmeticIntensity * report.hostBytesPerCycle;
+        report.bound = "host_bandwidth";
+    } else {
+        report.attainableMacsPerCycle = report.peakMacsPerCycle;
+        report.bound = "compute";
+    }
+    report.rooflineCycles = report.macs > 0
+        ? static_cast<uint64_t>(std::ceil(report.macs / report.attainableMacsPerCycle)) : 0;
+    
+    analyzeRegisters(program, report);
+    return report;
+}
+
+void CodeQualityAnalyzer::analyzeRegisters(const std::vector<PIMInstruction>& program,
+                                           CodeQualityReport& report) const {
+    RegisterSet referenced;
+    RegisterSet live;
+    size_t maxLive = 0;
+    
+    // Backward over the program; PE streams and SYNC sections do not share registers
+    for (auto it = program.rbegin(); it != program.rend(); ++it) {
+        if (isStreamMarker(*it) || it->getOpcode() == PIM_SYNC) {
+            live.reset();
+            continue;
+        }
+        
+        const RegisterOperands operands = registerOperands(*it);
+        RegisterSet uses;
+        RegisterSet defs;
+        for (unsigned i = 0; i < operands.useCount; i++) {
+            uses.set(operands.uses[i]);
+        }
+        if (operands.writes) {
+            defs.set(operands.def);
+        }
+        referenced |= uses | defs;
+        
+        // A written register occupies its slot even when the value is never read
+        maxLive = std::max(maxLive, (live | defs).count());
+        live = (live & ~defs) | uses;
+        maxLive = std::max(maxLive, live.count());
+    }
+    
+    report.registersUsed = static_cast<unsigned>(referenced.count());
+    report.maxLiveRegisters = static_cast<unsigned>(maxLive);
+}
+
+void CodeQualityAnalyzer::writeJson(const CodeQualityReport& report, std::ostream& out) {
+    llvm::json::Object opcodes;
+    for (const auto& [name, count] : report.opcodeCounts) {
+        opcodes[name] = static_cast<int64_t>(count);
+    }
+    
+    llvm::json::Object root{
+        {"instructions", static_cast<int64_t>(report.instructions)},
+        {"opcodes", std::move(opcodes)},
+        {"host_traffic", llvm::json::Object{
+            {"loads", static_cast<int64_t>(report.hostLoads)},
+            {"stores", static_cast<int64_t>(report.hostStores)},
+            {"load_bytes", static_cast<int64_t>(report.hostLoadBytes)},
+            {"store_bytes", static_cast<int64_t>(report.hostStoreBytes)},
+            {"zero_fill_bytes", static_cast<int64_t>(report.zeroFillBytes)}}},
+        {"compute", llvm::json::Object{
+            {"macs", static_cast<int64_t>(report.macs)},
+            {"arithmetic_intensity", report.arithmeticIntensity},
+            {"lanes", static_cast<int64_t>(report.lanes)},
+            {"active_pes", static_cast<int64_t>(report.activePEs)},
+            {"pe_streams", static_cast<int64_t>(report.peStreams)},
+            {"has_jumps", report.hasJumps}}},
+        {"registers", llvm::json::Object{
+            {"file_size", static_cast<int64_t>(report.registerFileSize)},
+            {"used", static_cast<int64_t>(report.registersUsed)},
+            {"max_live", static_cast<int64_t>(report.maxLiveRegisters)}}},
+        {"cycles", llvm::json::Object{
+            {"issue", static_cast<int64_t>(report.issueCycles)},
+            {"host_link", static_cast<int64_t>(report.hostLinkCycles)},
+            {"estimated", static_cast<int64_t>(report.estimatedCycles)}}},
+        {"roofline", llvm::json::Object{
+            {"peak_macs_per_cycle", report.peakMacsPerCycle},
+            {"host_bytes_per_cycle", report.hostBytesPerCycle},
+            {"ridge_intensity", report.ridgeIntensity},
+            {"attainable_macs_per_cycle", report.attainableMacsPerCycle},
+            {"min_cycles", static_cast<int64_t>(report.rooflineCycles)},
+            {"bound", report.bound}}}
+    };
+    
+    llvm::raw_os_ostream stream(out);
+    stream << llvm::formatv("{0:2}", llvm::json::Value(std::move(root))) << "\n";
+}
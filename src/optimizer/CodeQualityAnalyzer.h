@@ -0,0 +1,143 @@
+/**
+ * CodeQualityAnalyzer.h
+ * Static measurements of generated PIM programs
+ */
+
+#ifndef CODE_QUALITY_ANALYZER_H
+#define CODE_QUALITY_ANALYZER_H
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "compiler/PIMInstruction.h"
+#include "../include/CompilerConfig.h"
+
+/**
+ * Latencies of the static cycle estimate
+ * 
+ * The defaults are those of the simulator's PerformanceModel, so estimates
+ * and simulated runs of one program can be compared.
+ */
+struct StaticCostModel {
+    unsigned aluCycles = 1;            // ADD, SUB, logic and shifts
+    unsigned mulCycles = 3;            // MUL and MAC
+    unsigned divCycles = 16;           // DIV
+    unsigned bankCycles = 2;           // MOVE between a register and PIM memory
+    unsigned branchCycles = 2;         // Issue stall of a jump
+    unsigned configCycles = 1;         // Issue stall of a CONFIG
+    unsigned syncCycles = 4;           // Issue stall of a SYNC
+    unsigned hostLatencyCycles = 20;   // Host link round trip
+    unsigned hostBytesPerCycle = 16;   // Host link bandwidth
+};
+
+/**
+ * Measurements of one program
+ * 
+ * Counts are static: every instruction is counted once, so loops of
+ * symbolic programs (hasJumps) run their bodies more often than reported.
+ * Transfers and MACs are summed over the PEs that execute them.
+ */
+struct CodeQualityReport {
+    uint64_t instructions = 0;
+    std::map<std::string, uint64_t> opcodeCounts;   // By mnemonic, opcodes that occur
+    
+    // Host traffic
+    uint64_t hostLoads = 0;             // LOAD and LOAD_BLOCK instructions reading the host
+    uint64_t hostStores = 0;            // STORE and STORE_BLOCK instructions
+    uint64_t hostLoadBytes = 0;
+    uint64_t hostStoreBytes = 0;
+    uint64_t zeroFillBytes = 0;         // Written by LOADs of PIM_HOST_ZERO, which stay off the link
+    
+    // Compute
+    uint64_t macs = 0;                  // Multiply-accumulates of MUL and MAC, per packed lane
+    double arithmeticIntensity = 0.0;   // MACs per host byte loaded or stored
+    unsigned lanes = 1;                 // Elements per word of the last PRECISION configuration
+    unsigned activePEs = 1;             // Widest broadcast array configured
+    uint64_t peStreams = 0;
+    bool hasJumps = false;
+    
+    // Registers
+    unsigned registerFileSize = 0;
+    unsigned registersUsed = 0;         // Distinct registers referenced
+    unsigned maxLiveRegisters = 0;      // Most registers holding a value needed later
+    
+    // Static cycle estimate
+    uint64_t issueCycles = 0;           // In-order issue with register dependences, streams overlapped
+    uint64_t hostLinkCycles = 0;        // Link occupancy of all transfers; it is shared by every PE
+    uint64_t estimatedCycles = 0;       // The longer of the two plus one link round trip
+    
+    // Roofline of the device
+    double peakMacsPerCycle = 0.0;      // Every PE issuing a MUL or MAC each cycle
+    double hostBytesPerCycle = 0.0;
+    double ridgeIntensity = 0.0;        // Intensity at which the link stops being the limit
+    double attainableMacsPerCycle = 0.0;
+    uint64_t rooflineCycles = 0;        // MACs at the attainable rate
+    std::string bound;                  // "compute" or "host_bandwidth"
+};
+
+/**
+ * Measures instruction mix, host traffic, register pressure and estimated
+ * run time of generated programs for the configured architecture
+ */
+class CodeQualityAnalyzer {
+public:
+    // Registers the analysis tracks; the simulator rejects higher register numbers
+    static const unsigned MAX_TRACKED_REGISTERS = 64;
+    
+    explicit CodeQualityAnalyzer(const CompilerConfig& config, const StaticCostModel& model = StaticCostModel());
+    ~CodeQualityAnalyzer();
+    
+    /**
+     * Analyze a program
+     * 
+     * The PE array, precision and PE streams are followed through the
+     * CONFIG instructions as the simulator executes them. Instructions
+     * issue in order, one per cycle, once the registers they read are
+     * ready; jumps, CONFIG and SYNC stall issue for their latency, and the
+     * PE streams between two SYNCs run concurrently. Memory words, banks
+     * and host transfers are left to the host link term. The estimate
+     * assumes transfers overlap compute entirely, so it approaches a
+     * simulated run from below; programs that load everything before they
+     * compute (PE streams) take up to the sum of both terms.
+     * Register liveness is computed over the straight-line order of the
+     * instructions, with each PE stream starting with empty registers.
+     * 
+     * @param program Final instructions, as written to the output
+     * @return Measurements of the program
+     */
+    CodeQualityReport analyze(const std::vector<PIMInstruction>& program) const;
+    
+    /**
+     * Write a report as a JSON object
+     * 
+     * @param report Report from analyze()
+     * @param out Destination stream
+     */
+    static void writeJson(const CodeQualityReport& report, std::ostream& out);
+
+private:
+    // Issue state of one instruction stream
+    struct Timeline {
+        uint64_t cycle = 0;                // Next issue slot
+        uint64_t finish = 0;               // Completion of the last operation
+        std::array<uint64_t, MAX_TRACKED_REGISTERS> registerReady{};
+    };
+    
+    CompilerConfig config;
+    StaticCostModel model;
+    
+    /**
+     * Issue one instruction on a stream and account its latency
+     */
+    void issue(const PIMInstruction& instruction, Timeline& timeline) const;
+    
+    /**
+     * Compute the register liveness measurements of a program
+     */
+    void analyzeRegisters(const std::vector<PIMInstruction>& program, CodeQualityReport& report) const;
+};
+
+#endif // CODE_QUALITY_ANALYZER_H
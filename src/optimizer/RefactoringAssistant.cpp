@@ -1,39 +1,175 @@
 #include "optimizer/RefactoringAssistant.h"
 #include "utils/Logger.h"
-#include <regex>
 #include <iostream>
 #include <algorithm>
+#include <cctype>
+#include <initializer_list>
 #include <sstream>
 
-// Implementation of LoopReorderingRule
+namespace {
 
-bool LoopReorderingRule::applies(const std::string& code) {
-    // Look for matrix multiplication with i-j-k loop order
-    std::regex pattern(
-        "for\\s*\\(.*?\\bi\\b.*?\\)\\s*\\{"
-        "\\s*for\\s*\\(.*?\\bj\\b.*?\\)\\s*\\{"
-        "\\s*for\\s*\\(.*?\\bk\\b.*?\\)\\s*\\{"
-    );
-    return std::regex_search(code, pattern);
-}
-
-std::string LoopReorderingRule::apply(const std::string& code) {
-    // Replace i-j-k loop order with i-k-j loop order
-    std::regex pattern(
-        "(for\\s*\\(.*?\\bi\\b.*?\\)\\s*\\{)"
-        "(\\s*for\\s*\\(.*?\\bj\\b.*?\\)\\s*\\{)"
-        "(\\s*for\\s*\\(.*?\\bk\\b.*?\\)\\s*\\{)"
-    );
-    
-    std::string result = std::regex_replace(code, pattern, 
-        "$1"
-        "\n    for (int k = 0; k < common; k++) {"
-        "\n        for (int j = 0; j < cols; j++) {"
-    );
+// Whether an expression reads a variable
+bool mentions(const std::string& expression, const std::string& name) {
+    return SourceModel::describeSubscript(expression).uses(name);
+}
+
+// Whether consecutive values of a variable address adjacent elements of an access
+bool isContiguousAlong(const ArrayAccess& access, const std::string& name) {
+    if (access.subscripts.empty() || !access.subscripts.back().uses(name) ||
+        access.subscripts.back().scales(name)) {
+        return false;
+    }
+    return std::none_of(access.subscripts.begin(), access.subscripts.end() - 1,
+                        [&](const SubscriptInfo& s) { return s.uses(name); });
+}
+
+// Whether consecutive values of a variable address different rows of an access
+bool isStridedAlong(const ArrayAccess& access, const std::string& name) {
+    for (size_t i = 0; i < access.subscripts.size(); ++i) {
+        if (access.subscripts[i].uses(name) && (i + 1 < access.subscripts.size() || access.subscripts[i].scales(name))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether a loop's bounds read any of the given variables
+bool boundsMention(const LoopInfo& loop, std::initializer_list<std::string> names) {
+    for (const auto& name : names) {
+        if (mentions(loop.lowerBound, name) || mentions(loop.upperBound, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parenthesize an expression unless it is a single identifier or literal
+std::string group(const std::string& expression) {
+    bool simple = std::all_of(expression.begin(), expression.end(), [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.';
+    });
+    return simple ? expression : "(" + expression + ")";
+}
+
+bool isIntegerLiteral(const std::string& expression) {
+    return !expression.empty() && std::all_of(expression.begin(), expression.end(), [](char c) {
+        return std::isdigit(static_cast<unsigned char>(c));
+    });
+}
+
+// Indentation step of the source, taken from an outer and an inner statement
+std::string indentStep(const SourceModel& model, const LoopInfo& outer, const LoopInfo& inner) {
+    std::string outerIndent = model.indentation(outer.range.begin);
+    std::string innerIndent = model.indentation(inner.range.begin);
+    if (innerIndent.size() > outerIndent.size() && innerIndent.compare(0, outerIndent.size(), outerIndent) == 0) {
+        return innerIndent.substr(outerIndent.size());
+    }
+    return "    ";
+}
+
+// Add a prefix to every non-empty line but the first
+std::string indentLines(const std::string& text, const std::string& prefix) {
+    std::string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        result += text[i];
+        if (text[i] == '\n' && i + 1 < text.size() && text[i + 1] != '\n') {
+            result += prefix;
+        }
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+// Implementation of RefactoringRule
+
+bool RefactoringRule::applies(const SourceModel& model, const FunctionInfo& function) const {
+    return std::any_of(function.nests.begin(), function.nests.end(),
+                       [&](const KernelNest& nest) { return appliesTo(model, function, nest); });
+}
+
+std::string RefactoringRule::apply(const SourceModel& model, const FunctionInfo& function) const {
+    std::vector<Edit> edits;
+    for (const auto& nest : function.nests) {
+        if (appliesTo(model, function, nest)) {
+            rewrite(model, function, nest, edits);
+        }
+    }
+    std::stable_sort(edits.begin(), edits.end(), [](const Edit& a, const Edit& b) {
+        return a.range.begin < b.range.begin || (a.range.begin == b.range.begin && a.range.end < b.range.end);
+    });
     
+    std::string result;
+    size_t position = function.range.begin;
+    const Edit* previous = nullptr;
+    for (const auto& edit : edits) {
+        // Nests sharing loops ask for the same edit more than once
+        if (previous && previous->range.begin == edit.range.begin && previous->range.end == edit.range.end &&
+            previous->replacement == edit.replacement) {
+            continue;
+        }
+        if (edit.range.begin < position) {
+            PIM_LOG_DEBUG("Skipping overlapping edit in " + function.name);
+            continue;
+        }
+        result += model.text({position, edit.range.begin});
+        result += edit.replacement;
+        position = edit.range.end;
+        previous = &edit;
+    }
+    result += model.text({position, function.range.end});
+    return result;
+}
+
+bool RefactoringRule::applies(const std::string& code) const {
+    SourceModel model = SourceModel::build(code);
+    const auto& functions = model.getFunctions();
+    return std::any_of(functions.begin(), functions.end(),
+                       [&](const FunctionInfo& function) { return applies(model, function); });
+}
+
+std::string RefactoringRule::apply(const std::string& code) const {
+    SourceModel model = SourceModel::build(code);
+    std::string result;
+    size_t position = 0;
+    for (const auto& function : model.getFunctions()) {
+        if (applies(model, function)) {
+            result += model.text({position, function.range.begin});
+            result += apply(model, function);
+            position = function.range.end;
+        }
+    }
+    result += model.text({position, code.size()});
     return result;
 }
 
+// Implementation of LoopReorderingRule
+
+bool LoopReorderingRule::appliesTo(const SourceModel& model, const FunctionInfo&,
+                                   const KernelNest& nest) const {
+    const LoopInfo& middle = model.getLoops()[nest.middle];
+    const LoopInfo& inner = model.getLoops()[nest.inner];
+    const AccumulationInfo& accumulation = model.getAccumulations()[nest.accumulation];
+    
+    // Loops can be interchanged when nothing lies between them and neither bound depends on the other loop
+    if (!middle.bodyIsSingleLoop || boundsMention(inner, {middle.variable}) ||
+        boundsMention(middle, {inner.variable})) {
+        return false;
+    }
+    return std::any_of(accumulation.factors.begin(), accumulation.factors.end(), [&](const ArrayAccess& factor) {
+        return isContiguousAlong(factor, middle.variable) && !isContiguousAlong(factor, inner.variable);
+    });
+}
+
+void LoopReorderingRule::rewrite(const SourceModel& model, const FunctionInfo&, const KernelNest& nest,
+                                 std::vector<Edit>& edits) const {
+    const LoopInfo& middle = model.getLoops()[nest.middle];
+    const LoopInfo& inner = model.getLoops()[nest.inner];
+    edits.push_back({middle.header, model.text(inner.header)});
+    edits.push_back({inner.header, model.text(middle.header)});
+}
+
 std::string LoopReorderingRule::getDescription() const {
     return "Reorder loops for better cache locality in matrix multiplication";
 }
@@ -44,40 +180,81 @@ std::string LoopReorderingRule::getPerformanceImpact() const {
 
 // Implementation of MatrixLayoutRule
 
-bool MatrixLayoutRule::applies(const std::string& code) {
-    // Look for matrix access patterns that could be optimized
-    std::regex pattern("A\\s*\\[\\s*i\\s*\\]\\s*\\[\\s*k\\s*\\]|A\\s*\\[\\s*i\\s*\\*\\s*\\w+\\s*\\+\\s*k\\s*\\]");
-    return std::regex_search(code, pattern);
+int MatrixLayoutRule::findStridedFactor(const SourceModel& model, const FunctionInfo& function,
+                                        const KernelNest& nest) const {
+    const LoopInfo& outer = model.getLoops()[nest.outer];
+    const LoopInfo& middle = model.getLoops()[nest.middle];
+    const LoopInfo& inner = model.getLoops()[nest.inner];
+    const AccumulationInfo& accumulation = model.getAccumulations()[nest.accumulation];
+    
+    // The copy runs over the middle and inner loops before the nest, from zero
+    if (middle.lowerBound != "0" || inner.lowerBound != "0" ||
+        boundsMention(middle, {outer.variable, inner.variable}) ||
+        boundsMention(inner, {outer.variable, middle.variable})) {
+        return -1;
+    }
+    
+    for (size_t i = 0; i < accumulation.factors.size(); ++i) {
+        const ArrayAccess& factor = accumulation.factors[i];
+        bool readsOuter = std::any_of(factor.subscripts.begin(), factor.subscripts.end(),
+                                      [&](const SubscriptInfo& s) { return s.uses(outer.variable); });
+        bool readsMiddle = std::any_of(factor.subscripts.begin(), factor.subscripts.end(),
+                                       [&](const SubscriptInfo& s) { return s.uses(middle.variable); });
+        auto parameter = std::find_if(function.parameters.begin(), function.parameters.end(),
+                                      [&](const ParameterInfo& p) { return p.name == factor.array; });
+        // The buffer is declared with the element type of the parameter it copies
+        if (factor.array != accumulation.target.array && !readsOuter && readsMiddle &&
+            isStridedAlong(factor, inner.variable) && parameter != function.parameters.end() &&
+            !parameter->elementType.empty()) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
 }
 
-std::string MatrixLayoutRule::apply(const std::string& code) {
-    // Suggest using a transposed layout for matrix B
-    std::string result = code;
+bool MatrixLayoutRule::appliesTo(const SourceModel& model, const FunctionInfo& function,
+                                 const KernelNest& nest) const {
+    return findStridedFactor(model, function, nest) >= 0;
+}
     
-    // Add transpose code before the multiplication
-    std::regex mainPattern("void\\s+matrix\\w+\\s*\\([^)]*\\)\\s*\\{");
-    if (std::regex_search(code, mainPattern)) {
-        std::regex initPattern("(\\s*// Initialize result matrix.*?\n)(\\s*for\\s*\\(.*?\\))");
-        if (std::regex_search(code, initPattern)) {
-            result = std::regex_replace(result, initPattern,
-                "$1"
-                "\n    // Transpose matrix B for better memory access patterns"
-                "\n    int B_transposed[common][cols];"
-                "\n    for (int k = 0; k < common; k++) {"
-                "\n        for (int j = 0; j < cols; j++) {"
-                "\n            B_transposed[k][j] = B[k][j];"
-                "\n        }"
-                "\n    }"
-                "\n$2"
-            );
-        }
+void MatrixLayoutRule::rewrite(const SourceModel& model, const FunctionInfo& function, const KernelNest& nest,
+                               std::vector<Edit>& edits) const {
+    const LoopInfo& outer = model.getLoops()[nest.outer];
+    const LoopInfo& middle = model.getLoops()[nest.middle];
+    const LoopInfo& inner = model.getLoops()[nest.inner];
+    const ArrayAccess& factor = model.getAccumulations()[nest.accumulation].factors[
+        findStridedFactor(model, function, nest)];
+    auto parameter = std::find_if(function.parameters.begin(), function.parameters.end(),
+                                  [&](const ParameterInfo& p) { return p.name == factor.array; });
         
-        // Replace access to B in the multiplication loop
-        std::regex accessPattern("B\\s*\\[\\s*k\\s*\\]\\s*\\[\\s*j\\s*\\]|B\\s*\\[\\s*k\\s*\\*\\s*\\w+\\s*\\+\\s*j\\s*\\]");
-        result = std::regex_replace(result, accessPattern, "B_transposed[k][j]");
+    // Later nests of the function get their own buffer
+    size_t ordinal = &nest - function.nests.data();
+    std::string buffer = factor.array + "_transposed" + (ordinal > 0 ? "_" + std::to_string(ordinal) : "");
+    std::string indent = model.indentation(outer.range.begin);
+    std::string step = indentStep(model, outer, middle);
+    
+    // Constant extents fit an array on the stack; others need the heap
+    std::string access;
+    std::stringstream copy;
+    copy << "// Transpose " << factor.array << " so that the loop over " << inner.variable
+         << " reads it contiguously\n" << indent;
+    if (isIntegerLiteral(middle.upperBound) && isIntegerLiteral(inner.upperBound)) {
+        copy << parameter->elementType << " " << buffer << "[" << middle.upperBound << "][" << inner.upperBound << "];\n";
+        access = buffer + "[" + middle.variable + "][" + inner.variable + "]";
+    } else {
+        copy << "std::vector<" << parameter->elementType << "> " << buffer << "(" << group(middle.upperBound)
+             << " * " << group(inner.upperBound) << ");\n";
+        access = buffer + "[" + middle.variable + " * " + group(inner.upperBound) + " + " + inner.variable + "]";
     }
+    copy << indent << model.text(middle.header) << " {\n"
+         << indent << step << model.text(inner.header) << " {\n"
+         << indent << step << step << access << " = " << model.text(factor.range) << ";\n"
+         << indent << step << "}\n"
+         << indent << "}\n"
+         << "\n" << indent;
     
-    return result;
+    edits.push_back({{outer.range.begin, outer.range.begin}, copy.str()});
+    edits.push_back({factor.range, access});
 }
 
 std::string MatrixLayoutRule::getDescription() const {
@@ -90,53 +267,66 @@ std::string MatrixLayoutRule::getPerformanceImpact() const {
 
 // Implementation of BlockingOptimizationRule
 
-bool BlockingOptimizationRule::applies(const std::string& code) {
-    // Look for large matrix multiplication patterns without blocking
-    std::regex pattern("for\\s*\\(.*?\\bi\\b.*?\\)\\s*\\{[^}]*for\\s*\\(.*?\\bj\\b.*?\\)\\s*\\{[^}]*for\\s*\\(.*?\\bk\\b.*?\\)");
-    return std::regex_search(code, pattern);
+bool BlockingOptimizationRule::appliesTo(const SourceModel& model, const FunctionInfo&,
+                                         const KernelNest& nest) const {
+    const LoopInfo& outer = model.getLoops()[nest.outer];
+    const LoopInfo& middle = model.getLoops()[nest.middle];
+    const LoopInfo& inner = model.getLoops()[nest.inner];
+    
+    // Tiles are rectangular only when no bound depends on another loop of the nest
+    return nest.perfect && !boundsMention(outer, {middle.variable, inner.variable}) &&
+           !boundsMention(middle, {outer.variable, inner.variable}) &&
+           !boundsMention(inner, {outer.variable, middle.variable});
 }
 
-std::string BlockingOptimizationRule::apply(const std::string& code) {
-    // Apply blocking optimization
-    std::string result = code;
+void BlockingOptimizationRule::rewrite(const SourceModel& model, const FunctionInfo& function, const KernelNest& nest,
+                                       std::vector<Edit>& edits) const {
+    const LoopInfo& outer = model.getLoops()[nest.outer];
+    const LoopInfo& middle = model.getLoops()[nest.middle];
+    const LoopInfo& inner = model.getLoops()[nest.inner];
+    const LoopInfo* nestLoops[] = {&outer, &middle, &inner};
     
-    // Define block size constant
-    std::regex funcPattern("void\\s+matrix\\w+\\s*\\([^)]*\\)\\s*\\{");
-    if (std::regex_search(result, funcPattern)) {
-        result = std::regex_replace(result, funcPattern, 
-            "void matrixMultiplyBlocked(int* A, int* B, int* C, int rows, int cols, int common) {\n"
-            "    const int BLOCK_SIZE = 8; // Optimal block size for PIM architecture\n"
-        );
-    }
+    std::string indent = model.indentation(outer.range.begin);
+    std::string step = indentStep(model, outer, middle);
     
-    // Replace the loops with blocked version
-    std::regex loopPattern(
-        "for\\s*\\(\\s*int\\s+i\\s*=\\s*0\\s*;\\s*i\\s*<\\s*\\w+\\s*;\\s*i\\+\\+\\s*\\)\\s*\\{"
-        "[^}]*for\\s*\\(\\s*int\\s+j\\s*=\\s*0\\s*;\\s*j\\s*<\\s*\\w+\\s*;\\s*j\\+\\+\\s*\\)\\s*\\{"
-        "[^}]*for\\s*\\(\\s*int\\s+k\\s*=\\s*0\\s*;\\s*k\\s*<\\s*\\w+\\s*;\\s*k\\+\\+\\s*\\)\\s*\\{"
-    );
+    // Define block size constant once per function
+    std::string bodyIndent = model.indentation(function.range.begin) + step;
+    edits.push_back({{function.body.begin + 1, function.body.begin + 1},
+                     "\n" + bodyIndent + "const int BLOCK_SIZE = 8; // Optimal block size for PIM architecture\n"});
     
-    if (std::regex_search(result, loopPattern)) {
-        result = std::regex_replace(result, loopPattern,
-            "// Use blocked matrix multiplication algorithm\n"
-            "    for (int i = 0; i < rows; i += BLOCK_SIZE) {\n"
-            "        for (int j = 0; j < cols; j += BLOCK_SIZE) {\n"
-            "            for (int k = 0; k < common; k += BLOCK_SIZE) {\n"
-            "                // Process block\n"
-            "                for (int ii = i; ii < std::min(i + BLOCK_SIZE, rows); ii++) {\n"
-            "                    for (int jj = j; jj < std::min(j + BLOCK_SIZE, cols); jj++) {\n"
-            "                        for (int kk = k; kk < std::min(k + BLOCK_SIZE, common); kk++) {"
-        );
-        
-        // Update array access pattern
-        std::regex accessPattern("C\\[\\s*i\\s*\\]\\[\\s*j\\s*\\]\\s*\\+=\\s*A\\[\\s*i\\s*\\]\\[\\s*k\\s*\\]\\s*\\*\\s*B\\[\\s*k\\s*\\]\\[\\s*j\\s*\\]");
-        result = std::regex_replace(result, accessPattern, "C[ii][jj] += A[ii][kk] * B[kk][jj]");
-        
-        // Close the additional brackets
-        result = std::regex_replace(result, std::regex("(\\s*}\\s*}\\s*})"), "$1\n                }\n            }\n        }");
+    std::stringstream blocked;
+    std::string level = indent;
+    for (const LoopInfo* loop : nestLoops) {
+        std::string block = loop->variable + "_block";
+        blocked << (loop == &outer ? "" : level) << "for (" << (loop->type.empty() ? "int" : loop->type) << " "
+                << block << " = " << loop->lowerBound << "; " << block << " < " << loop->upperBound << "; "
+                << block << " += BLOCK_SIZE) {\n";
+        level += step;
+    }
+    for (const LoopInfo* loop : nestLoops) {
+        std::string block = loop->variable + "_block";
+        blocked << level << "for (" << (loop->type.empty() ? "" : loop->type + " ") << loop->variable << " = "
+                << block << "; " << loop->variable << " < " << block << " + BLOCK_SIZE && " << loop->variable
+                << " < " << loop->upperBound << "; " << loop->variable << "++)";
+        if (loop != &inner) {
+            blocked << " {\n";
+            level += step;
+        }
     }
     
-    return result;
+    // The original body, shifted by the three tile loops
+    std::string body = indentLines(model.text(inner.body), step + step + step);
+    if (model.getSource()[inner.body.begin] == '{') {
+        blocked << " " << body << "\n";
+    } else {
+        blocked << " {\n" << level << step << body << "\n" << level << "}\n";
+    }
+    for (size_t i = 0; i < 5; ++i) {
+        level.erase(level.size() - step.size());
+        blocked << level << "}" << (i < 4 ? "\n" : "");
+    }
+    
+    edits.push_back({outer.range, blocked.str()});
 }
 
 std::string BlockingOptimizationRule::getDescription() const {
@@ -173,21 +363,25 @@ std::map<std::string, std::pair<std::string, std::string>> RefactoringAssistant:
     
     std::map<std::string, std::pair<std::string, std::string>> suggestions;
     
-    // Find patterns in the code
-    auto patterns = findPatterns(sourceCode);
+    // One scan of the source serves every rule
+    SourceModel model = SourceModel::build(sourceCode);
     
-    // Apply rules to each pattern
-    for (const auto& [patternName, pattern] : patterns) {
+    for (const auto& function : model.getFunctions()) {
+        if (function.nests.empty()) {
+            continue;
+        }
+        std::string original = model.text(function.range);
+        
         for (const auto& rule : rules) {
-            if (rule->applies(pattern)) {
-                std::string refactored = rule->apply(pattern);
+            if (rule->applies(model, function)) {
+                std::string refactored = rule->apply(model, function);
                 
                 // Only suggest if there's an actual change
-                if (refactored != pattern) {
-                    std::string description = rule->getDescription() + 
+                if (refactored != original) {
+                    std::string description = rule->getDescription() + " in " + function.name +
                                              " (" + rule->getPerformanceImpact() + ")";
                     
-                    suggestions[description] = std::make_pair(pattern, refactored);
+                    suggestions[description] = std::make_pair(original, refactored);
                 }
             }
         }
@@ -246,62 +440,6 @@ std::map<std::string, std::string> RefactoringAssistant::suggestInstructionOptim
     return suggestions;
 }
 
-std::map<std::string, std::string> RefactoringAssistant::findPatterns(const std::string& code) {
-    std::map<std::string, std::string> patterns;
-    
-    // Find matrix multiplication function patterns
-    std::regex matrixMultPattern(
-        "void\\s+matrix\\w+\\([^)]*\\)\\s*\\{"
-        "[^}]*?"  // Non-greedy match of anything
-        "for\\s*\\([^{]*\\)\\s*\\{"
-        "[^}]*?"  // Non-greedy match of anything
-        "for\\s*\\([^{]*\\)\\s*\\{"
-        "[^}]*?"  // Non-greedy match of anything
-        "for\\s*\\([^{]*\\)\\s*\\{"
-        "[^}]*?"  // Non-greedy match of anything
-        "C\\[.*?\\].*?\\+=.*?A\\[.*?\\].*?\\*.*?B\\[.*?\\]"
-        "[^}]*?"  // Non-greedy match of anything
-        "\\}\\s*\\}\\s*\\}"
-    );
-    
-    std::sregex_iterator it(code.begin(), code.end(), matrixMultPattern);
-    std::sregex_iterator end;
-    
-    while (it != end) {
-        std::smatch match = *it;
-        patterns["matrix_multiplication"] = match.str();
-        ++it;
-    }
-    
-    // Find large fixed-size matrix patterns
-    std::regex fixedMatrixPattern(
-        "void\\s+matrix\\w+\\([^)]*\\[\\d+\\][^)]*\\)\\s*\\{"
-    );
-    
-    it = std::sregex_iterator(code.begin(), code.end(), fixedMatrixPattern);
-    
-    while (it != end) {
-        std::smatch match = *it;
-        // Find the entire function body
-        std::string funcStart = match.str();
-        size_t startPos = code.find(funcStart);
-        if (startPos != std::string::npos) {
-            int braceCount = 0;
-            size_t pos = startPos + funcStart.length() - 1; // Start at the opening brace
-            do {
-                if (code[pos] == '{') braceCount++;
-                else if (code[pos] == '}') braceCount--;
-                pos++;
-            } while (braceCount > 0 && pos < code.length());
-            
-            patterns["fixed_size_matrix"] = code.substr(startPos, pos - startPos);
-        }
-        ++it;
-    }
-    
-    return patterns;
-}
-
 std::map<std::string, std::vector<PIMInstruction>> RefactoringAssistant::findInstructionPatterns(
     const std::vector<PIMInstruction>& instructions) {
     
@@ -335,7 +473,7 @@ std::map<std::string, std::vector<PIMInstruction>> RefactoringAssistant::findIns
     
     // Check for inefficient accumulation patterns
     std::vector<PIMInstruction> inefficientAccum;
-    for (size_t i = 0; i < instructions.size() - 3; ++i) {
+    for (size_t i = 0; i + 3 < instructions.size(); ++i) {
         const auto& instr1 = instructions[i];
         const auto& instr2 = instructions[i+1];
         const auto& instr3 = instructions[i+2];
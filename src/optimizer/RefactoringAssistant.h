@@ -7,28 +7,49 @@
 #include <memory>
 #include "utils/Logger.h"
 #include "compiler/PIMInstruction.h"
+#include "optimizer/SourceModel.h"
 
 /**
  * @class RefactoringRule
  * @brief Base class for refactoring rules
+ * 
+ * Rules work on the kernel nests of a SourceModel, so one scan of the
+ * source serves every rule. A rule rewrites each nest it applies to with
+ * text edits; the rest of the function is left as written.
  */
 class RefactoringRule {
 public:
     virtual ~RefactoringRule() = default;
     
+    /**
+     * @brief Check if the rule applies to a function of a scanned source
+     * @param model The source model
+     * @param function A function of the model
+     * @return True if the rule applies to a kernel nest of the function
+     */
+    bool applies(const SourceModel& model, const FunctionInfo& function) const;
+    
+    /**
+     * @brief Apply the rule to every kernel nest of a function it applies to
+     * @param model The source model
+     * @param function A function of the model
+     * @return The refactored text of the function
+     */
+    std::string apply(const SourceModel& model, const FunctionInfo& function) const;
+    
     /**
      * @brief Check if the rule applies to the given code
-     * @param code The source code to check
+     * @param code The source code to check; it is scanned on every call
      * @return True if the rule applies, false otherwise
      */
-    virtual bool applies(const std::string& code) = 0;
+    bool applies(const std::string& code) const;
     
     /**
      * @brief Apply the refactoring rule to the given code
-     * @param code The source code to refactor
+     * @param code The source code to refactor; it is scanned on every call
      * @return The refactored code
      */
-    virtual std::string apply(const std::string& code) = 0;
+    std::string apply(const std::string& code) const;
     
     /**
      * @brief Get a description of the rule
@@ -41,42 +62,91 @@ public:
      * @return A string describing the expected performance improvement
      */
     virtual std::string getPerformanceImpact() const = 0;
+
+protected:
+    // Replacement of a range of the source; an empty range inserts
+    struct Edit {
+        TextRange range;
+        std::string replacement;
+    };
+    
+    /**
+     * @brief Check if the rule applies to one kernel nest
+     */
+    virtual bool appliesTo(const SourceModel& model, const FunctionInfo& function,
+                           const KernelNest& nest) const = 0;
+    
+    /**
+     * @brief Add the edits that refactor one kernel nest
+     */
+    virtual void rewrite(const SourceModel& model, const FunctionInfo& function, const KernelNest& nest,
+                         std::vector<Edit>& edits) const = 0;
 };
 
 /**
  * @class LoopReorderingRule
  * @brief Rule for reordering loops to optimize for PIM architecture
+ * 
+ * Interchanges the two inner loops of a nest whose innermost loop is the
+ * reduction when a factor is contiguous along the middle loop (i-j-k to
+ * i-k-j), so the innermost loop walks rows of both that factor and the result.
  */
 class LoopReorderingRule : public RefactoringRule {
 public:
-    bool applies(const std::string& code) override;
-    std::string apply(const std::string& code) override;
     std::string getDescription() const override;
     std::string getPerformanceImpact() const override;
+
+protected:
+    bool appliesTo(const SourceModel& model, const FunctionInfo& function,
+                   const KernelNest& nest) const override;
+    void rewrite(const SourceModel& model, const FunctionInfo& function, const KernelNest& nest,
+                 std::vector<Edit>& edits) const override;
 };
 
 /**
  * @class MatrixLayoutRule
  * @brief Rule for optimizing matrix layout for PIM architecture
+ * 
+ * Copies a factor that the reduction loop reads across rows (B[k][j]) into
+ * a transposed buffer before the nest, and reads the buffer contiguously
+ * inside it.
  */
 class MatrixLayoutRule : public RefactoringRule {
 public:
-    bool applies(const std::string& code) override;
-    std::string apply(const std::string& code) override;
     std::string getDescription() const override;
     std::string getPerformanceImpact() const override;
+
+protected:
+    bool appliesTo(const SourceModel& model, const FunctionInfo& function,
+                   const KernelNest& nest) const override;
+    void rewrite(const SourceModel& model, const FunctionInfo& function, const KernelNest& nest,
+                 std::vector<Edit>& edits) const override;
+
+private:
+    /**
+     * @brief Find the factor of a nest that is read across rows
+     * @return Index into the accumulation's factors, or -1
+     */
+    int findStridedFactor(const SourceModel& model, const FunctionInfo& function, const KernelNest& nest) const;
 };
 
 /**
  * @class BlockingOptimizationRule
- * @brief Rule for applying blocking optimizations to matrix operations
+ * @brief Rule for applying blocking/tiling optimizations to matrix operations
+ * 
+ * Tiles each loop of a perfect nest by BLOCK_SIZE; the loops over the
+ * elements of a tile keep the original variables, so the body is unchanged.
  */
 class BlockingOptimizationRule : public RefactoringRule {
 public:
-    bool applies(const std::string& code) override;
-    std::string apply(const std::string& code) override;
     std::string getDescription() const override;
     std::string getPerformanceImpact() const override;
+
+protected:
+    bool appliesTo(const SourceModel& model, const FunctionInfo& function,
+                   const KernelNest& nest) const override;
+    void rewrite(const SourceModel& model, const FunctionInfo& function, const KernelNest& nest,
+                 std::vector<Edit>& edits) const override;
 };
 
 /**
@@ -90,9 +160,14 @@ public:
     
     /**
      * @brief Analyze code and suggest refactorings
+     * 
+     * The source is scanned once; every rule is then tried on each function
+     * that contains a matrix multiplication loop nest.
+     * 
      * @param sourceCode The source code to analyze
-     * @return A map of refactoring suggestions, with keys being rule names and
-     *         values being pairs of original code and refactored code
+     * @return A map of refactoring suggestions, with keys being rule and
+     *         function descriptions and values being pairs of original
+     *         function code and refactored function code
      */
     std::map<std::string, std::pair<std::string, std::string>> suggestRefactorings(
         const std::string& sourceCode);
@@ -122,13 +197,6 @@ private:
      */
     void initializeRules();
     
-    /**
-     * @brief Find patterns in code that could be optimized
-     * @param code The source code to analyze
-     * @return A map of pattern names to code snippets
-     */
-    std::map<std::string, std::string> findPatterns(const std::string& code);
-    
     /**
      * @brief Analyze instruction patterns for optimization opportunities
      * @param instructions The PIM instructions to analyze
@@ -0,0 +1,584 @@
+/**
+ * SourceModel.cpp
+ * Single-pass scanner building the source model
+ */
+
+#include "optimizer/SourceModel.h"
+#include <algorithm>
+#include <cctype>
+#include <map>
+
+namespace {
+
+const size_t NONE = static_cast<size_t>(-1);
+
+enum class TokenKind { Identifier, Number, Punctuation };
+
+struct Token {
+    TokenKind kind;
+    size_t begin;
+    size_t end;
+};
+
+// Two-character operators the scanner distinguishes from their first character
+const char* const DIGRAPHS[] = {
+    "++", "--", "+=", "-=", "*=", "/=", "<=", ">=", "==", "!=", "&&", "||", "::", "->", "<<", ">>"
+};
+
+bool isIdentifierStart(char c) {
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+}
+
+bool isIdentifierChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+/**
+ * Split source into tokens, skipping whitespace, comments, string and
+ * character literals and preprocessor lines
+ */
+std::vector<Token> tokenize(const std::string& source) {
+    std::vector<Token> tokens;
+    const size_t size = source.size();
+    bool lineStart = true;
+    size_t pos = 0;
+    
+    while (pos < size) {
+        char c = source[pos];
+        
+        if (c == '\n') {
+            lineStart = true;
+            ++pos;
+            continue;
+        }
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            ++pos;
+            continue;
+        }
+        
+        // Preprocessor directive, with its continuation lines
+        if (c == '#' && lineStart) {
+            while (pos < size && source[pos] != '\n') {
+                if (source[pos] == '\\' && pos + 1 < size && source[pos + 1] == '\n') {
+                    ++pos;
+                }
+                ++pos;
+            }
+            continue;
+        }
+        lineStart = false;
+        
+        // Comments
+        if (c == '/' && pos + 1 < size && source[pos + 1] == '/') {
+            while (pos < size && source[pos] != '\n') {
+                ++pos;
+            }
+            continue;
+        }
+        if (c == '/' && pos + 1 < size && source[pos + 1] == '*') {
+            size_t close = source.find("*/", pos + 2);
+            pos = close == std::string::npos ? size : close + 2;
+            continue;
+        }
+        
+        // Raw string literal R"delimiter( ... )delimiter"
+        if (c == 'R' && pos + 1 < size && source[pos + 1] == '"') {
+            size_t open = source.find('(', pos + 2);
+            if (open != std::string::npos) {
+                std::string terminator = ")" + source.substr(pos + 2, open - pos - 2) + "\"";
+                size_t close = source.find(terminator, open + 1);
+                pos = close == std::string::npos ? size : close + terminator.size();
+                continue;
+            }
+        }
+        
+        // String and character literals
+        if (c == '"' || c == '\'') {
+            ++pos;
+            while (pos < size && source[pos] != c && source[pos] != '\n') {
+                pos += source[pos] == '\\' ? 2 : 1;
+            }
+            ++pos;
+            continue;
+        }
+        
+        size_t begin = pos;
+        if (isIdentifierStart(c)) {
+            while (pos < size && isIdentifierChar(source[pos])) {
+                ++pos;
+            }
+            tokens.push_back({TokenKind::Identifier, begin, pos});
+        } else if (std::isdigit(static_cast<unsigned char>(c)) ||
+                   (c == '.' && pos + 1 < size && std::isdigit(static_cast<unsigned char>(source[pos + 1])))) {
+            while (pos < size && (isIdentifierChar(source[pos]) || source[pos] == '.' || source[pos] == '\'' ||
+                                  ((source[pos] == '+' || source[pos] == '-') &&
+                                   (source[pos - 1] == 'e' || source[pos - 1] == 'E')))) {
+                ++pos;
+            }
+            tokens.push_back({TokenKind::Number, begin, pos});
+        } else {
+            size_t length = 1;
+            if (pos + 1 < size) {
+                for (const char* digraph : DIGRAPHS) {
+                    if (digraph[0] == c && digraph[1] == source[pos + 1]) {
+                        length = 2;
+                        break;
+                    }
+                }
+            }
+            pos += length;
+            tokens.push_back({TokenKind::Punctuation, begin, pos});
+        }
+    }
+    
+    return tokens;
+}
+
+/**
+ * Scanner state over the tokens of one source
+ */
+class Scanner {
+public:
+    explicit Scanner(const std::string& source)
+        : source(source), tokens(tokenize(source)), match(tokens.size(), NONE) {
+        matchBrackets();
+    }
+    
+    void run(std::vector<FunctionInfo>& functions, std::vector<LoopInfo>& loops,
+             std::vector<AccumulationInfo>& accumulations) {
+        size_t functionClose = NONE;
+        std::map<size_t, size_t> loopsByBegin;
+        std::vector<TextRange> loopContents;
+        
+        for (size_t t = 0; t < tokens.size(); ++t) {
+            bool inFunction = functionClose != NONE && t < functionClose;
+            
+            if (!inFunction && is(t, "{")) {
+                FunctionInfo function;
+                if (matchFunction(t, function)) {
+                    functions.push_back(std::move(function));
+                    functionClose = match[t];
+                }
+                continue;
+            }
+            if (!inFunction) {
+                continue;
+            }
+            
+            if (is(t, "for") && is(t + 1, "(") && match[t + 1] != NONE) {
+                LoopInfo loop;
+                TextRange content;
+                matchLoop(t, loop, content);
+                loopsByBegin[loop.range.begin] = loops.size();
+                loops.push_back(std::move(loop));
+                loopContents.push_back(content);
+                continue;
+            }
+            
+            if (tokens[t].kind == TokenKind::Identifier && is(t + 1, "[")) {
+                ArrayAccess target;
+                size_t last = matchAccess(t, target);
+                if (is(last + 1, "+=")) {
+                    AccumulationInfo accumulation;
+                    accumulation.target = std::move(target);
+                    matchAccumulation(last + 2, accumulation);
+                    accumulations.push_back(std::move(accumulation));
+                }
+            }
+        }
+        
+        // A body is a single loop when its contents are exactly that loop's range
+        for (size_t i = 0; i < loops.size(); ++i) {
+            auto child = loopsByBegin.find(loopContents[i].begin);
+            loops[i].bodyIsSingleLoop = child != loopsByBegin.end() && child->second != i &&
+                                        loops[child->second].range.end == loopContents[i].end;
+        }
+    }
+
+private:
+    const std::string& source;
+    std::vector<Token> tokens;
+    std::vector<size_t> match;      // Index of the matching bracket token
+    
+    bool is(size_t t, const char* text) const {
+        if (t >= tokens.size()) {
+            return false;
+        }
+        size_t length = tokens[t].end - tokens[t].begin;
+        return source.compare(tokens[t].begin, length, text) == 0;
+    }
+    
+    std::string textOf(size_t t) const {
+        return source.substr(tokens[t].begin, tokens[t].end - tokens[t].begin);
+    }
+    
+    // Source text between two tokens, both excluded
+    std::string between(size_t first, size_t last) const {
+        if (last <= first + 1) {
+            return "";
+        }
+        return trim(source.substr(tokens[first].end, tokens[last].begin - tokens[first].end));
+    }
+    
+    void matchBrackets() {
+        std::vector<size_t> open;
+        for (size_t t = 0; t < tokens.size(); ++t) {
+            if (tokens[t].kind != TokenKind::Punctuation || tokens[t].end - tokens[t].begin != 1) {
+                continue;
+            }
+            char c = source[tokens[t].begin];
+            if (c == '(' || c == '[' || c == '{') {
+                open.push_back(t);
+            } else if (c == ')' || c == ']' || c == '}') {
+                char expected = c == ')' ? '(' : c == ']' ? '[' : '{';
+                // Unbalanced closers are ignored rather than unwinding the stack
+                if (!open.empty() && source[tokens[open.back()].begin] == expected) {
+                    match[open.back()] = t;
+                    match[t] = open.back();
+                    open.pop_back();
+                }
+            }
+        }
+    }
+    
+    /**
+     * Recognize the opening brace of a function definition
+     */
+    bool matchFunction(size_t brace, FunctionInfo& function) const {
+        static const char* const QUALIFIERS[] = {"const", "noexcept", "override", "final", "volatile", "&", "&&"};
+        static const char* const KEYWORDS[] = {
+            "for", "if", "while", "switch", "catch", "return", "sizeof", "decltype", "alignas", "do", "else"
+        };
+        
+        if (match[brace] == NONE || brace == 0) {
+            return false;
+        }
+        size_t p = brace - 1;
+        while (p > 0 && std::any_of(std::begin(QUALIFIERS), std::end(QUALIFIERS),
+                                    [&](const char* q) { return is(p, q); })) {
+            --p;
+        }
+        if (!is(p, ")") || match[p] == NONE || match[p] == 0) {
+            return false;
+        }
+        size_t open = match[p];
+        size_t name = open - 1;
+        if (tokens[name].kind != TokenKind::Identifier ||
+            std::any_of(std::begin(KEYWORDS), std::end(KEYWORDS), [&](const char* k) { return is(name, k); })) {
+            return false;
+        }
+        // Member initializers a(1) of a constructor
+        if (name > 0 && (is(name - 1, ":") || is(name - 1, ","))) {
+            return false;
+        }
+        
+        size_t first = name;
+        while (first > 0 && !is(first - 1, ";") && !is(first - 1, "}") && !is(first - 1, "{") &&
+               !is(first - 1, ":")) {
+            --first;
+        }
+        
+        function.name = textOf(name);
+        function.range = {tokens[first].begin, tokens[match[brace]].end};
+        function.body = {tokens[brace].begin, tokens[match[brace]].end};
+        for (size_t t = open + 1; t + 2 < p; ++t) {
+            if (is(t, "[") && tokens[t + 1].kind == TokenKind::Number && is(t + 2, "]")) {
+                function.fixedSizeArrays = true;
+                break;
+            }
+        }
+        matchParameters(open, p, function);
+        return true;
+    }
+    
+    void matchParameters(size_t open, size_t close, FunctionInfo& function) const {
+        static const char* const IGNORED[] = {"const", "volatile", "restrict", "__restrict", "*", "&", "&&"};
+        
+        size_t begin = open + 1;
+        for (size_t t = begin; t <= close; ++t) {
+            if ((is(t, "(") || is(t, "[")) && match[t] != NONE && match[t] < close) {
+                t = match[t];
+                continue;
+            }
+            if (t != close && !is(t, ",")) {
+                continue;
+            }
+            
+            // Parameter tokens [begin, t): the name is the last identifier before an extent or default
+            size_t end = begin;
+            while (end < t && !is(end, "[") && !is(end, "=")) {
+                ++end;
+            }
+            if (end > begin && tokens[end - 1].kind == TokenKind::Identifier) {
+                ParameterInfo parameter;
+                parameter.name = textOf(end - 1);
+                bool scalar = true;
+                for (size_t u = begin; u + 1 < end; ++u) {
+                    if (is(u, "<") || is(u, "(")) {
+                        scalar = false;
+                    }
+                    if (std::none_of(std::begin(IGNORED), std::end(IGNORED), [&](const char* q) { return is(u, q); })) {
+                        if (!parameter.elementType.empty() && !is(u, "::") && !is(u - 1, "::")) {
+                            parameter.elementType += " ";
+                        }
+                        parameter.elementType += textOf(u);
+                    }
+                }
+                if (!scalar) {
+                    parameter.elementType.clear();
+                }
+                function.parameters.push_back(std::move(parameter));
+            }
+            begin = t + 1;
+        }
+    }
+    
+    /**
+     * Find the end of the statement starting at a token
+     * 
+     * @return Index of the statement's last token
+     */
+    size_t statementEnd(size_t t) const {
+        if (is(t, "{")) {
+            return match[t] != NONE ? match[t] : tokens.size() - 1;
+        }
+        // Unbraced bodies of nested statements end with the nested statement
+        if ((is(t, "for") || is(t, "while") || is(t, "if")) && is(t + 1, "(") && match[t + 1] != NONE) {
+            size_t end = statementEnd(match[t + 1] + 1);
+            if (is(t, "if") && is(end + 1, "else")) {
+                end = statementEnd(end + 2);
+            }
+            return end;
+        }
+        while (t < tokens.size() && !is(t, ";")) {
+            if ((is(t, "(") || is(t, "[") || is(t, "{")) && match[t] != NONE) {
+                t = match[t];
+            }
+            ++t;
+        }
+        return std::min(t, tokens.size() - 1);
+    }
+    
+    void matchLoop(size_t t, LoopInfo& loop, TextRange& content) const {
+        size_t open = t + 1;
+        size_t close = match[open];
+        size_t bodyEnd = statementEnd(close + 1);
+        
+        loop.header = {tokens[t].begin, tokens[close].end};
+        loop.range = {tokens[t].begin, tokens[bodyEnd].end};
+        loop.body = close + 1 < tokens.size() ? TextRange{tokens[close + 1].begin, tokens[bodyEnd].end}
+                                              : TextRange{tokens[close].end, tokens[close].end};
+        if (is(close + 1, "{") && bodyEnd > close + 2) {
+            content = {tokens[close + 2].begin, tokens[bodyEnd - 1].end};
+        } else {
+            content = loop.body;
+        }
+        
+        // Header clauses init; condition; increment
+        size_t firstSemicolon = NONE, secondSemicolon = NONE;
+        for (size_t u = open + 1; u < close; ++u) {
+            if ((is(u, "(") || is(u, "[")) && match[u] != NONE) {
+                u = match[u];
+            } else if (is(u, ";")) {
+                (firstSemicolon == NONE ? firstSemicolon : secondSemicolon) = u;
+            }
+        }
+        if (secondSemicolon == NONE) {
+            return;
+        }
+        
+        size_t assign = NONE;
+        for (size_t u = open + 1; u < firstSemicolon; ++u) {
+            if (is(u, "=")) {
+                assign = u;
+                break;
+            }
+        }
+        if (assign == NONE || assign == open + 1 || tokens[assign - 1].kind != TokenKind::Identifier) {
+            return;
+        }
+        std::string variable = textOf(assign - 1);
+        
+        bool condition = is(firstSemicolon + 1, variable.c_str()) && is(firstSemicolon + 2, "<") &&
+                         firstSemicolon + 3 < secondSemicolon;
+        size_t incrementTokens = close - secondSemicolon - 1;
+        size_t inc = secondSemicolon + 1;
+        bool increment = (incrementTokens == 2 && ((is(inc, variable.c_str()) && is(inc + 1, "++")) ||
+                                                   (is(inc, "++") && is(inc + 1, variable.c_str())))) ||
+                         (incrementTokens == 3 && is(inc, variable.c_str()) && is(inc + 1, "+=") &&
+                          is(inc + 2, "1"));
+        if (!condition || !increment) {
+            return;
+        }
+        
+        loop.canonical = true;
+        loop.variable = variable;
+        loop.type = between(open, assign - 1);
+        loop.lowerBound = between(assign, firstSemicolon);
+        loop.upperBound = between(firstSemicolon + 2, secondSemicolon);
+    }
+    
+    /**
+     * Read an array access starting at its name
+     * 
+     * @return Index of the last ']'
+     */
+    size_t matchAccess(size_t t, ArrayAccess& access) const {
+        access.array = textOf(t);
+        size_t last = t;
+        size_t s = t + 1;
+        while (is(s, "[") && match[s] != NONE) {
+            access.subscripts.push_back(SourceModel::describeSubscript(between(s, match[s])));
+            last = match[s];
+            s = last + 1;
+        }
+        access.range = {tokens[t].begin, tokens[last].end};
+        return last;
+    }
+    
+    void matchAccumulation(size_t t, AccumulationInfo& accumulation) const {
+        size_t end = statementEnd(t);
+        for (size_t u = t; u < end; ++u) {
+            if (tokens[u].kind == TokenKind::Identifier && is(u + 1, "[")) {
+                ArrayAccess factor;
+                u = matchAccess(u, factor);
+                accumulation.factors.push_back(std::move(factor));
+            } else if ((is(u, "(") || is(u, "[")) && match[u] != NONE && is(match[u] + 1, "[")) {
+                u = match[u];
+            }
+        }
+        accumulation.range = {accumulation.target.range.begin, tokens[end].end};
+    }
+};
+
+} // anonymous namespace
+
+bool SubscriptInfo::uses(const std::string& name) const {
+    return std::find(identifiers.begin(), identifiers.end(), name) != identifiers.end();
+}
+
+bool SubscriptInfo::scales(const std::string& name) const {
+    return std::find(scaled.begin(), scaled.end(), name) != scaled.end();
+}
+
+SubscriptInfo SourceModel::describeSubscript(const std::string& text) {
+    SubscriptInfo subscript;
+    subscript.text = trim(text);
+    
+    std::vector<Token> tokens = tokenize(subscript.text);
+    auto isStar = [&](size_t t) {
+        return t < tokens.size() && subscript.text.compare(tokens[t].begin, tokens[t].end - tokens[t].begin, "*") == 0;
+    };
+    for (size_t t = 0; t < tokens.size(); ++t) {
+        if (tokens[t].kind != TokenKind::Identifier) {
+            continue;
+        }
+        std::string name = subscript.text.substr(tokens[t].begin, tokens[t].end - tokens[t].begin);
+        subscript.identifiers.push_back(name);
+        if (isStar(t + 1) || (t > 0 && isStar(t - 1))) {
+            subscript.scaled.push_back(name);
+        }
+    }
+    return subscript;
+}
+
+SourceModel SourceModel::build(const std::string& source) {
+    SourceModel model;
+    model.source = source;
+    Scanner(model.source).run(model.functions, model.loops, model.accumulations);
+    model.link();
+    return model;
+}
+
+std::string SourceModel::text(const TextRange& range) const {
+    return source.substr(range.begin, range.end - range.begin);
+}
+
+std::string SourceModel::indentation(size_t offset) const {
+    size_t lineStart = source.rfind('\n', offset == 0 ? 0 : offset - 1);
+    lineStart = lineStart == std::string::npos ? 0 : lineStart + 1;
+    size_t end = lineStart;
+    while (end < source.size() && (source[end] == ' ' || source[end] == '\t')) {
+        ++end;
+    }
+    return source.substr(lineStart, end - lineStart);
+}
+
+void SourceModel::link() {
+    // Loops are in order of their 'for'; enclosing loops are still open on the stack
+    std::vector<size_t> open;
+    for (size_t i = 0; i < loops.size(); ++i) {
+        while (!open.empty() && loops[open.back()].range.end <= loops[i].range.begin) {
+            open.pop_back();
+        }
+        loops[i].parent = open.empty() ? -1 : static_cast<int>(open.back());
+        open.push_back(i);
+    }
+    
+    for (auto& accumulation : accumulations) {
+        auto after = std::upper_bound(loops.begin(), loops.end(), accumulation.range.begin,
+                                      [](size_t offset, const LoopInfo& loop) { return offset < loop.range.begin; });
+        int loop = static_cast<int>(after - loops.begin()) - 1;
+        while (loop >= 0 && !loops[loop].range.contains(accumulation.range)) {
+            loop = loops[loop].parent;
+        }
+        accumulation.loop = loop;
+    }
+    
+    size_t next = 0;
+    for (auto& function : functions) {
+        while (next < accumulations.size() && accumulations[next].range.begin < function.body.begin) {
+            ++next;
+        }
+        for (; next < accumulations.size() && function.body.contains(accumulations[next].range); ++next) {
+            const AccumulationInfo& accumulation = accumulations[next];
+            if (accumulation.loop < 0 || loops[accumulation.loop].parent < 0 ||
+                loops[loops[accumulation.loop].parent].parent < 0) {
+                continue;
+            }
+            
+            KernelNest nest;
+            nest.inner = accumulation.loop;
+            nest.middle = loops[nest.inner].parent;
+            nest.outer = loops[nest.middle].parent;
+            nest.accumulation = next;
+            const LoopInfo& outer = loops[nest.outer];
+            const LoopInfo& middle = loops[nest.middle];
+            const LoopInfo& inner = loops[nest.inner];
+            if (!outer.canonical || !middle.canonical || !inner.canonical || !function.body.contains(outer.range) ||
+                outer.variable == middle.variable || middle.variable == inner.variable ||
+                outer.variable == inner.variable) {
+                continue;
+            }
+            if (!function.nests.empty() && function.nests.back().inner == nest.inner) {
+                continue;
+            }
+            
+            auto targetUses = [&](const std::string& name) {
+                return std::any_of(accumulation.target.subscripts.begin(), accumulation.target.subscripts.end(),
+                                   [&](const SubscriptInfo& s) { return s.uses(name); });
+            };
+            bool reduction = std::any_of(accumulation.factors.begin(), accumulation.factors.end(),
+                                         [&](const ArrayAccess& factor) {
+                return std::any_of(factor.subscripts.begin(), factor.subscripts.end(),
+                                   [&](const SubscriptInfo& s) { return s.uses(inner.variable); });
+            });
+            if (!targetUses(outer.variable) || !targetUses(middle.variable) || targetUses(inner.variable) ||
+                !reduction) {
+                continue;
+            }
+            
+            nest.perfect = outer.bodyIsSingleLoop && middle.bodyIsSingleLoop;
+            function.nests.push_back(nest);
+        }
+    }
+}
@@ -0,0 +1,156 @@
+/**
+ * SourceModel.h
+ * Functions, loops and array accesses of C++ source, found in one pass
+ */
+
+#ifndef SOURCE_MODEL_H
+#define SOURCE_MODEL_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Half-open range of byte offsets into the source
+ */
+struct TextRange {
+    size_t begin = 0;
+    size_t end = 0;
+    
+    bool contains(const TextRange& other) const { return begin <= other.begin && other.end <= end; }
+};
+
+/**
+ * One subscript of an array access
+ */
+struct SubscriptInfo {
+    std::string text;                      // Expression as written, trimmed
+    std::vector<std::string> identifiers;  // Identifiers the expression reads
+    std::vector<std::string> scaled;       // Identifiers that are a factor of a product (k in k * cols + j)
+    
+    bool uses(const std::string& name) const;
+    bool scales(const std::string& name) const;
+};
+
+/**
+ * Subscripted variable, such as A[i][k] or B[k * cols + j]
+ */
+struct ArrayAccess {
+    std::string array;
+    std::vector<SubscriptInfo> subscripts;
+    TextRange range;                       // From the array name to the last ']'
+};
+
+/**
+ * for statement
+ * 
+ * A canonical loop has the form for (type v = lower; v < upper; v++),
+ * with ++v or v += 1 as the increment and the type optional.
+ */
+struct LoopInfo {
+    bool canonical = false;
+    std::string type;
+    std::string variable;
+    std::string lowerBound;
+    std::string upperBound;
+    TextRange range;                       // From 'for' to the end of the body
+    TextRange header;                      // From 'for' to the closing parenthesis
+    TextRange body;                        // Braces included
+    bool bodyIsSingleLoop = false;         // The body holds nothing but one nested for statement
+    int parent = -1;                       // Innermost enclosing loop
+};
+
+/**
+ * Accumulation statement target += factor * factor
+ */
+struct AccumulationInfo {
+    ArrayAccess target;
+    std::vector<ArrayAccess> factors;      // Array accesses of the right-hand side
+    TextRange range;                       // Through the ';'
+    int loop = -1;                         // Innermost enclosing loop
+};
+
+/**
+ * Matrix multiplication loop nest: three canonical loops around an
+ * accumulation whose target is indexed by the two outer variables and
+ * whose factors read the inner (reduction) variable
+ */
+struct KernelNest {
+    size_t outer = 0;
+    size_t middle = 0;
+    size_t inner = 0;
+    size_t accumulation = 0;
+    bool perfect = false;                  // No statements between the loops
+};
+
+/**
+ * Function parameter
+ */
+struct ParameterInfo {
+    std::string name;
+    std::string elementType;               // Built-in type with pointers, extents and qualifiers removed, else empty
+};
+
+/**
+ * Function definition
+ */
+struct FunctionInfo {
+    std::string name;
+    TextRange range;                       // From the declaration's first token to the closing brace
+    TextRange body;
+    std::vector<ParameterInfo> parameters;
+    bool fixedSizeArrays = false;          // A parameter is an array of constant extent, such as A[32][32]
+    std::vector<KernelNest> nests;
+};
+
+/**
+ * Structure of one source file
+ * 
+ * The scanner tokenizes the source once, skipping comments, literals and
+ * preprocessor lines, and matches brackets with a stack, so building the
+ * model takes time linear in the source size whatever its contents. It
+ * needs no Clang and accepts sources that do not compile on their own.
+ */
+class SourceModel {
+public:
+    /**
+     * Build the model by scanning the source
+     * 
+     * @param source C++ source code
+     */
+    static SourceModel build(const std::string& source);
+
+    const std::string& getSource() const { return source; }
+    const std::vector<FunctionInfo>& getFunctions() const { return functions; }
+    const std::vector<LoopInfo>& getLoops() const { return loops; }
+    const std::vector<AccumulationInfo>& getAccumulations() const { return accumulations; }
+    
+    /**
+     * Get the source text of a range
+     */
+    std::string text(const TextRange& range) const;
+    
+    /**
+     * Get the whitespace that indents the line containing an offset
+     */
+    std::string indentation(size_t offset) const;
+    
+    /**
+     * Describe a subscript expression: its identifiers and scaled identifiers
+     */
+    static SubscriptInfo describeSubscript(const std::string& text);
+
+private:
+    std::string source;
+    std::vector<FunctionInfo> functions;
+    std::vector<LoopInfo> loops;
+    std::vector<AccumulationInfo> accumulations;
+    
+    /**
+     * Link loops and accumulations to their enclosing loop and function,
+     * and find the kernel nests of every function
+     */
+    void link();
+};
+
+#endif // SOURCE_MODEL_H
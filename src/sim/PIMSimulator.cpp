@@ -0,0 +1,800 @@
+/**
+ * PIMSimulator.cpp
+ * Implements the cycle-approximate PIM execution model
+ */
+
+#include "PIMSimulator.h"
+#include "compiler/LayoutPlanner.h"
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// Number of general purpose registers (REG0 - REG7)
+const unsigned NUM_GENERAL_REGISTERS = PIM_REG7 + 1;
+
+// Words of the launch block written by the runtime (ROWS .. C_BASE)
+const unsigned LAUNCH_ARGUMENTS = PIMLaunchLayout::C_BASE + 1;
+
+uint64_t divideRoundingUp(uint64_t value, uint64_t divisor) {
+    return (value + divisor - 1) / divisor;
+}
+
+// Timing state of one instruction stream
+struct Timeline {
+    uint64_t cycle = 0;                   // Next issue cycle
+    uint64_t finish = 0;                  // Completion of the last operation
+    std::vector<uint64_t> registerReady;  // Per register: cycle its value is available
+    
+    explicit Timeline(unsigned numRegisters) : registerReady(numRegisters, 0) {}
+};
+
+// Instructions [begin, end) run by one PE; begin is its PIM_CONFIG_PE_STREAM marker
+struct Stream {
+    unsigned pe;
+    unsigned batch;  // Product addressed by the host transfers
+    size_t begin;
+    size_t end;
+};
+
+// Half-open cycle range [begin, end)
+struct Interval {
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Append an interval, extending the last one when they touch
+void addInterval(std::vector<Interval>& intervals, uint64_t begin, uint64_t end) {
+    if (end <= begin) {
+        return;
+    }
+    if (!intervals.empty() && begin >= intervals.back().begin && begin <= intervals.back().end) {
+        intervals.back().end = std::max(intervals.back().end, end);
+    } else {
+        intervals.push_back({begin, end});
+    }
+}
+
+// Sort and merge intervals into disjoint ranges
+void normalizeIntervals(std::vector<Interval>& intervals) {
+    std::sort(intervals.begin(), intervals.end(), [](const Interval& a, const Interval& b) {
+        return a.begin < b.begin;
+    });
+    std::vector<Interval> merged;
+    for (const auto& interval : intervals) {
+        addInterval(merged, interval.begin, interval.end);
+    }
+    intervals.swap(merged);
+}
+
+uint64_t coveredCycles(const std::vector<Interval>& intervals) {
+    uint64_t cycles = 0;
+    for (const auto& interval : intervals) {
+        cycles += interval.end - interval.begin;
+    }
+    return cycles;
+}
+
+// Cycles covered by both sets of disjoint, sorted intervals
+uint64_t overlappingCycles(const std::vector<Interval>& a, const std::vector<Interval>& b) {
+    uint64_t cycles = 0;
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        uint64_t begin = std::max(a[i].begin, b[j].begin);
+        uint64_t end = std::min(a[i].end, b[j].end);
+        if (begin < end) {
+            cycles += end - begin;
+        }
+        if (a[i].end < b[j].end) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    return cycles;
+}
+
+// Sign-extend lane l of a packed word
+int32_t laneValue(uint32_t word, unsigned lane, unsigned bits) {
+    uint32_t value = (word >> (lane * bits)) & ((1u << bits) - 1);
+    uint32_t sign = 1u << (bits - 1);
+    return static_cast<int32_t>((value ^ sign) - sign);
+}
+
+} // namespace
+
+PIMSimulator::PIMSimulator(const CompilerConfig& config, const PerformanceModel& model)
+    : config(config), model(model) {}
+
+PIMSimulator::~PIMSimulator() = default;
+
+std::vector<int32_t> PIMSimulator::referenceGemm(const HostMatrices& host) {
+    std::vector<int32_t> c(host.batch * host.rows * host.cols, 0);
+    for (unsigned b = 0; b < host.batch; b++) {
+        const int32_t* hostA = host.a.data() + b * host.rows * host.common;
+        const int32_t* hostB = host.b.data() + b * host.common * host.cols;
+        int32_t* hostC = c.data() + b * host.rows * host.cols;
+        for (unsigned i = 0; i < host.rows; i++) {
+            for (unsigned k = 0; k < host.common; k++) {
+                uint32_t a = static_cast<uint32_t>(hostA[i * host.common + k]);
+                for (unsigned j = 0; j < host.cols; j++) {
+                    uint32_t sum = static_cast<uint32_t>(hostC[i * host.cols + j]) + a * static_cast<uint32_t>(hostB[k * host.cols + j]);
+                    hostC[i * host.cols + j] = static_cast<int32_t>(sum);
+                }
+            }
+        }
+        
+        for (unsigned i = 0; i < host.rows && !host.epilogue.empty(); i++) {
+            for (unsigned j = 0; j < host.cols; j++) {
+                uint32_t value = static_cast<uint32_t>(hostC[i * host.cols + j]);
+                for (const auto& op : host.epilogue) {
+                    switch (op.kind) {
+                        case EpilogueOp::BIAS_COLUMN:
+                            value += static_cast<uint32_t>(host.colVectors[op.operand * host.cols + j]);
+                            break;
+                        case EpilogueOp::BIAS_ROW:
+                            value += static_cast<uint32_t>(host.rowVectors[op.operand * host.rows + i]);
+                            break;
+                        case EpilogueOp::RELU:
+                            value = static_cast<int32_t>(value) < 0 ? 0 : value;
+                            break;
+                        case EpilogueOp::SCALE:
+                            value *= static_cast<uint32_t>(op.factor);
+                            break;
+                    }
+                }
+                hostC[i * host.cols + j] = static_cast<int32_t>(value);
+            }
+        }
+    }
+    return c;
+}
+
+std::map<std::string, std::vector<int32_t>> PIMSimulator::referenceKernels(const HostMatrices& host) {
+    std::map<std::string, std::vector<int32_t>> buffers = host.buffers;
+    for (const auto& kernel : host.kernels) {
+        HostMatrices product;
+        product.rows = kernel.rows;
+        product.cols = kernel.cols;
+        product.common = kernel.common;
+        product.a = buffers[kernel.a];
+        product.b = buffers[kernel.b];
+        product.a.resize(static_cast<size_t>(kernel.rows) * kernel.common, 0);
+        product.b.resize(static_cast<size_t>(kernel.common) * kernel.cols, 0);
+        buffers[kernel.c] = referenceGemm(product);
+    }
+    return buffers;
+}
+
+SimulationResult PIMSimulator::run(const std::vector<PIMInstruction>& program, const HostMatrices& host) const {
+    const auto& arch = config.archParams;
+    const unsigned numPEs = std::max(1u, arch.numProcessingElements);
+    const unsigned numBanks = std::max(1u, arch.numMemoryBanks);
+    const unsigned wordBytes = std::max(1u, arch.wordSize / 8);
+    const unsigned totalWords = numBanks * (arch.memoryBankSize / wordBytes);
+    const unsigned localWords = totalWords / numPEs;
+    const unsigned numRegisters = std::min(arch.registerFileSize, NUM_GENERAL_REGISTERS);
+    const LayoutPlanner banks(config);
+    
+    SimulationResult result;
+    result.peBusyCycles.assign(numPEs, 0);
+    result.bankAccesses.assign(numBanks, 0);
+    result.bankBusyCycles.assign(numBanks, 0);
+    
+    // Architectural state
+    std::vector<int32_t> memory(totalWords, 0);
+    std::vector<std::vector<uint32_t>> registers(numPEs, std::vector<uint32_t>(numRegisters, 0));
+    const unsigned batch = std::max(1u, host.batch);
+    std::vector<int32_t> hostC = host.c;
+    hostC.resize(batch * host.rows * host.cols, 0);
+    bool stored = false;
+    
+    // Timing state: the broadcast stream runs every active PE in lockstep, so
+    // its ready times are shared; PE streams get a timeline of their own
+    std::vector<uint64_t> memoryReady(totalWords, 0);
+    std::vector<std::deque<Interval>> bankReservations(numBanks);
+    uint64_t horizon = 0;  // No access is requested before this cycle any more
+    uint64_t hostLinkFree = 0;
+    Timeline broadcast(numRegisters);
+    
+    // Cycles with a host transfer in flight and cycles an arithmetic unit
+    // was busy, for the transfer overlap
+    std::vector<Interval> transferIntervals;
+    std::vector<Interval> computeIntervals;
+    
+    // PE array configuration
+    unsigned arraySize = 1;
+    unsigned activePEs = 1;
+    unsigned gridWidth = 1;
+    bool arrayConfigured = false;
+    unsigned cBase = 0;
+    
+    // Host operand configuration of the broadcast stream
+    unsigned hostLayout = 0;
+    unsigned currentBatch = 0;
+    unsigned constantB = 0;                 // Constant matrix + 1 read by LOADs of B, 0 for host.b
+    
+    // Host operands the transfers address; the kernel markers of a linked
+    // program rebind them to the buffers of each kernel
+    std::map<std::string, std::vector<int32_t>> buffers = host.buffers;
+    unsigned viewRows = host.rows;
+    unsigned viewCols = host.cols;
+    unsigned viewCommon = host.common;
+    const int32_t* viewA = host.a.data();
+    const int32_t* viewB = host.b.data();
+    int32_t* viewC = hostC.data();
+    const std::string* viewName = nullptr;  // Buffer of C while a linked kernel runs
+    
+    auto checkRegister = [&](unsigned reg) {
+        if (reg >= numRegisters) {
+            throw std::runtime_error("Register " + std::to_string(reg) + " outside the " +
+                                     std::to_string(numRegisters) + "-entry register file");
+        }
+        return reg;
+    };
+    
+    // Translate a PE address to a global word address; PE streams always use local memory
+    auto globalAddress = [&](unsigned pe, uint64_t address, bool local) {
+        uint64_t limit = local ? localWords : totalWords;
+        if (address >= limit) {
+            throw std::runtime_error("PIM address " + std::to_string(address) + " out of range");
+        }
+        return static_cast<unsigned>(local ? address * numPEs + pe : address);
+    };
+    
+    // Occupy the bank of a word in its first free slot no earlier than the
+    // given time; returns the completion time. Banks keep a calendar of
+    // reservations, so a LOAD claiming a bank when it arrives in the future
+    // does not delay accesses that fit in before it
+    auto accessBank = [&](unsigned address, uint64_t earliest) {
+        unsigned bank = banks.bankOf(address);
+        auto& reservations = bankReservations[bank];
+        while (!reservations.empty() && reservations.front().end <= horizon) {
+            reservations.pop_front();
+        }
+        
+        uint64_t start = earliest;
+        auto it = reservations.begin();
+        while (it != reservations.end() && it->end <= start) {
+            ++it;
+        }
+        while (it != reservations.end() && it->begin < start + model.bankCycles) {
+            start = std::max(start, it->end);
+            ++it;
+        }
+        reservations.insert(it, {start, start + model.bankCycles});
+        
+        result.bankConflictCycles += start - earliest;
+        result.bankAccesses[bank]++;
+        result.bankBusyCycles[bank] += model.bankCycles;
+        return start + model.bankCycles;
+    };
+    
+    // Element of a host operand read by the instruction at pc. The host pads the
+    // last packed word of a row of A or a column of B with zero lanes; any
+    // other element outside the operand is a code generation error
+    auto hostElement = [&](size_t pc, unsigned buffer, unsigned product, unsigned row, unsigned col) -> int32_t {
+        const unsigned paddedCommon = static_cast<unsigned>(divideRoundingUp(viewCommon, result.lanes) * result.lanes);
+        auto outside = [&](const char* name, unsigned rows, unsigned cols) {
+            return std::runtime_error("Instruction " + std::to_string(pc) + " (" +
+                                      program[pc].toString(PIMEncoding::V2) + ") reads " + name + "[" +
+                                      std::to_string(row) + "][" + std::to_string(col) + "] outside the " +
+                                      std::to_string(rows) + "x" + std::to_string(cols) + " operand");
+        };
+        switch (buffer) {
+            case PIM_HOST_A:
+                if (row >= viewRows || col >= paddedCommon) {
+                    throw outside("A", viewRows, viewCommon);
+                }
+                return col < viewCommon ? viewA[(product * viewRows + row) * viewCommon + col] : 0;
+            case PIM_HOST_B:
+                if (row >= paddedCommon || col >= viewCols) {
+                    throw outside("B", viewCommon, viewCols);
+                }
+                return row < viewCommon ? viewB[(product * viewCommon + row) * viewCols + col] : 0;
+            case PIM_HOST_C:
+                if (row >= viewRows || col >= viewCols) {
+                    throw outside("C", viewRows, viewCols);
+                }
+                return viewC[(product * viewRows + row) * viewCols + col];
+            case PIM_HOST_ROW_VECTOR:
+                if (col >= host.rows || (row + 1) * static_cast<size_t>(host.rows) > host.rowVectors.size()) {
+                    const unsigned vectors = static_cast<unsigned>(host.rowVectors.size() / std::max(1u, host.rows));
+                    throw outside("row vectors", vectors, host.rows);
+                }
+                return host.rowVectors[row * host.rows + col];
+            case PIM_HOST_COL_VECTOR:
+                if (col >= host.cols || (row + 1) * static_cast<size_t>(host.cols) > host.colVectors.size()) {
+                    const unsigned vectors = static_cast<unsigned>(host.colVectors.size() / std::max(1u, host.cols));
+                    throw outside("column vectors", vectors, host.cols);
+                }
+                return host.colVectors[row * host.cols + col];
+            default:
+                return 0;
+        }
+    };
+    
+    // Host operands stored transposed are addressed in stored coordinates
+    auto isTransposed = [&](unsigned buffer) {
+        return (buffer == PIM_HOST_A && (hostLayout & PIM_HOST_TRANSPOSE_A)) ||
+               (buffer == PIM_HOST_B && (hostLayout & PIM_HOST_TRANSPOSE_B));
+    };
+    
+    // Execute one instruction on the broadcast array or, for a PE stream, on
+    // a single PE; returns the index of the next instruction
+    uint64_t executed = 0;
+    auto execute = [&](size_t pc, const Stream* stream, Timeline& timeline) -> size_t {
+        if (++executed > model.maxInstructions) {
+            throw std::runtime_error("Simulation exceeded " + std::to_string(model.maxInstructions) + " instructions");
+        }
+        
+        const PIMInstruction& inst = program[pc];
+        const unsigned dest = inst.getDest();
+        const unsigned src1 = inst.getSrc1();
+        const unsigned src2 = inst.getSrc2();
+        const unsigned imm = inst.getImm();
+        const unsigned firstPE = stream ? stream->pe : 0;
+        const unsigned numActive = stream ? 1 : activePEs;
+        const unsigned product = stream ? stream->batch : currentBatch;
+        const bool local = stream || arrayConfigured;
+        size_t nextPC = pc + 1;
+        uint64_t start = timeline.cycle;
+        horizon = start;
+        uint64_t occupancy = 1;
+        
+        // Grid coordinates of a PE; a stream addresses the host matrices directly
+        auto gridRow = [&](unsigned pe) { return stream ? 0 : pe / gridWidth; };
+        auto gridCol = [&](unsigned pe) { return stream ? 0 : pe % gridWidth; };
+        
+        switch (inst.getOpcode()) {
+            case PIM_NOP:
+                break;
+            
+            case PIM_CONFIG:
+                occupancy = model.configCycles;
+                if (dest == PIM_CONFIG_PE_STREAM) {
+                    // Stream markers are consumed by the stream scheduler
+                    if (!stream || stream->begin != pc) {
+                        throw std::runtime_error("Unexpected PE stream marker at instruction " + std::to_string(pc));
+                    }
+                } else if (stream) {
+                    throw std::runtime_error("CONFIG inside the PE stream at instruction " + std::to_string(pc));
+                } else if (dest == PIM_CONFIG_PRECISION && src2 != 0) {
+                    // Without a lane count this is the untiled size header
+                    if ((src1 != 8 && src1 != 16 && src1 != 32) || src1 * src2 > arch.wordSize) {
+                        throw std::runtime_error("Invalid precision configuration: " + std::to_string(src2) +
+                                                 " lanes of " + std::to_string(src1) + " bits");
+                    }
+                    result.precision = src1;
+                    result.lanes = src2;
+                } else if (dest == PIM_CONFIG_HOST_LAYOUT) {
+                    hostLayout = src1;
+                } else if (dest == PIM_CONFIG_BATCH) {
+                    if (src1 >= batch) {
+                        throw std::runtime_error("Product " + std::to_string(src1) + " outside the batch of " +
+                                                 std::to_string(batch));
+                    }
+                    currentBatch = src1;
+                } else if (dest == PIM_CONFIG_CONSTANT_B) {
+                    if (src1 > host.constants.size()) {
+                        throw std::runtime_error("Constant matrix " + std::to_string(src1) + " outside the " +
+                                                 std::to_string(host.constants.size()) + " of the data section");
+                    }
+                    constantB = src1;
+                } else if (dest == PIM_CONFIG_DEVICE) {
+                    throw std::runtime_error("Device program marker at instruction " + std::to_string(pc) +
+                                             ": a sharded program runs with its host schedule");
+                } else if (dest == PIM_CONFIG_KERNEL) {
+                    if (src1 >= host.kernels.size()) {
+                        throw std::runtime_error("Kernel " + std::to_string(src1) + " outside the " +
+                                                 std::to_string(host.kernels.size()) + " of the linked program");
+                    }
+                    const LinkedKernel& kernel = host.kernels[src1];
+                    const std::pair<const std::string*, size_t> operands[] = {
+                        {&kernel.a, static_cast<size_t>(kernel.rows) * kernel.common},
+                        {&kernel.b, static_cast<size_t>(kernel.common) * kernel.cols},
+                        {&kernel.c, static_cast<size_t>(kernel.rows) * kernel.cols}
+                    };
+                    for (const auto& [name, size] : operands) {
+                        auto& buffer = buffers[*name];
+                        buffer.resize(std::max(buffer.size(), size), 0);
+                    }
+                    viewRows = kernel.rows;
+                    viewCols = kernel.cols;
+                    viewCommon = kernel.common;
+                    viewA = buffers[kernel.a].data();
+                    viewB = buffers[kernel.b].data();
+                    viewC = buffers[kernel.c].data();
+                    viewName = &kernel.c;
+                    
+                    // Each kernel configures its own operands and array
+                    hostLayout = 0;
+                    currentBatch = 0;
+                    constantB = 0;
+                    arraySize = 1;
+                    activePEs = 1;
+                    gridWidth = 1;
+                    arrayConfigured = false;
+                    result.kernels++;
+                } else if (dest == PIM_CONFIG_ARRAY_SIZE) {
+                    arraySize = src1;
+                } else if (dest == PIM_CONFIG_INTERCONNECT) {
+                    if (arraySize == 0 || arraySize > numPEs || src1 == 0) {
+                        throw std::runtime_error("Invalid PE array configuration: " + std::to_string(arraySize) +
+                                                 " PEs of width " + std::to_string(src1));
+                    }
+                    arrayConfigured = true;
+                    activePEs = arraySize;
+                    gridWidth = src1;
+                } else if (dest == PIM_CONFIG_OP_MODE && src1 == PIM_OP_MODE_SYMBOLIC && !result.symbolic) {
+                    if (batch > 1) {
+                        throw std::runtime_error("Batched matrices are not supported in symbolic mode");
+                    }
+                    if (!host.epilogue.empty()) {
+                        throw std::runtime_error("Fused epilogues are not supported in symbolic mode");
+                    }
+                    
+                    // The runtime stages the launch block, A and B before the program runs on
+                    unsigned aBase = PIMLaunchLayout::DATA_OFFSET;
+                    unsigned bBase = aBase + host.rows * host.common;
+                    cBase = bBase + host.common * host.cols;
+                    if (cBase + host.rows * host.cols > totalWords) {
+                        throw std::runtime_error("Matrices do not fit the PIM memory in symbolic mode");
+                    }
+                    
+                    const unsigned launch[LAUNCH_ARGUMENTS] = {host.rows, host.cols, host.common, aBase, bBase, cBase};
+                    std::copy(launch, launch + LAUNCH_ARGUMENTS, memory.begin());
+                    std::copy(host.a.begin(), host.a.end(), memory.begin() + aBase);
+                    std::copy(host.b.begin(), host.b.end(), memory.begin() + bBase);
+                    result.stagingBytes += static_cast<uint64_t>(LAUNCH_ARGUMENTS + host.a.size() + host.b.size()) * wordBytes;
+                    result.symbolic = true;
+                }
+                break;
+            
+            case PIM_SYNC:
+                // Wait for every outstanding operation of the array
+                start = std::max(start, timeline.finish);
+                occupancy = model.syncCycles;
+                break;
+            
+            case PIM_LOAD:
+            case PIM_LOAD_BLOCK: {
+                // A block moves count consecutive words per PE in one link transfer
+                const bool block = inst.getOpcode() == PIM_LOAD_BLOCK;
+                const unsigned buffer = block ? PIMBlockOperand::buffer(src1) : src1;
+                const unsigned count = block ? PIMBlockOperand::count(src1) : 1;
+                const bool downColumn = block && PIMBlockOperand::axis(src1) == PIM_BLOCK_DOWN_COLUMN;
+                const bool transposed = isTransposed(buffer);
+                if (count == 0) {
+                    throw std::runtime_error("Empty block transfer at instruction " + std::to_string(pc));
+                }
+                
+                // Zero fills are generated in the PIM array and do not use the host link
+                const uint64_t wordsBytes = static_cast<uint64_t>(numActive) * wordBytes;
+                uint64_t linkStart = start;
+                if (buffer != PIM_HOST_ZERO) {
+                    uint64_t bytes = count * wordsBytes;
+                    linkStart = std::max(start, hostLinkFree);
+                    hostLinkFree = linkStart + divideRoundingUp(bytes, model.hostBytesPerCycle);
+                    result.hostBytesLoaded += bytes;
+                    addInterval(transferIntervals, linkStart, hostLinkFree + model.hostLatencyCycles);
+                }
+                
+                for (unsigned w = 0; w < count; w++) {
+                    // Words of a burst arrive in order as the link delivers them
+                    uint64_t arrival = start;
+                    if (buffer != PIM_HOST_ZERO) {
+                        arrival = linkStart + divideRoundingUp((w + 1) * wordsBytes, model.hostBytesPerCycle) +
+                                  model.hostLatencyCycles;
+                    }
+                    unsigned row = src2 + (downColumn ? w : 0);
+                    unsigned col = imm + (downColumn ? 0 : w);
+                    if (transposed) {
+                        std::swap(row, col);
+                    }
+                    
+                    for (unsigned pe = firstPE; pe < firstPE + numActive; pe++) {
+                        unsigned pi = gridRow(pe);
+                        unsigned pj = gridCol(pe);
+                        int32_t value = 0;
+                        if (buffer == PIM_HOST_B && constantB != 0) {
+                            // Constant words are already packed
+                            value = static_cast<int32_t>(host.constants[constantB - 1].word(row, col + pj));
+                        } else if (buffer == PIM_HOST_A || buffer == PIM_HOST_B) {
+                            // Packed words hold consecutive elements along the common dimension
+                            uint32_t word = 0;
+                            uint32_t mask = result.precision < 32 ? (1u << result.precision) - 1 : ~0u;
+                            for (unsigned lane = 0; lane < result.lanes; lane++) {
+                                int32_t element = (buffer == PIM_HOST_A)
+                                    ? hostElement(pc, buffer, product, row + pi, col * result.lanes + lane)
+                                    : hostElement(pc, buffer, product, row * result.lanes + lane, col + pj);
+                                word |= (static_cast<uint32_t>(element) & mask) << (lane * result.precision);
+                            }
+                            value = static_cast<int32_t>(word);
+                        } else if (buffer == PIM_HOST_C) {
+                            value = hostElement(pc, buffer, product, row + pi, col + pj);
+                        } else if (buffer == PIM_HOST_ROW_VECTOR) {
+                            value = hostElement(pc, buffer, product, row, col + pi);
+                        } else if (buffer == PIM_HOST_COL_VECTOR) {
+                            value = hostElement(pc, buffer, product, row, col + pj);
+                        }
+                        
+                        unsigned address = globalAddress(pe, static_cast<uint64_t>(dest) + w, local);
+                        memory[address] = value;
+                        memoryReady[address] = accessBank(address, std::max(arrival, memoryReady[address]));
+                        timeline.finish = std::max(timeline.finish, memoryReady[address]);
+                    }
+                }
+                break;
+            }
+            
+            case PIM_STORE:
+            case PIM_STORE_BLOCK: {
+                const bool block = inst.getOpcode() == PIM_STORE_BLOCK;
+                const unsigned buffer = block ? PIMBlockOperand::buffer(dest) : dest;
+                const unsigned count = block ? PIMBlockOperand::count(dest) : 1;
+                const bool downColumn = block && PIMBlockOperand::axis(dest) == PIM_BLOCK_DOWN_COLUMN;
+                if (buffer != PIM_HOST_C) {
+                    throw std::runtime_error("STORE to host buffer " + std::to_string(buffer) + " is not writable");
+                }
+                if (count == 0) {
+                    throw std::runtime_error("Empty block transfer at instruction " + std::to_string(pc));
+                }
+                
+                uint64_t readDone = start;
+                for (unsigned w = 0; w < count; w++) {
+                    for (unsigned pe = firstPE; pe < firstPE + numActive; pe++) {
+                        unsigned row = src2 + (downColumn ? w : 0) + gridRow(pe);
+                        unsigned col = imm + (downColumn ? 0 : w) + gridCol(pe);
+                        unsigned address = globalAddress(pe, static_cast<uint64_t>(src1) + w, local);
+                        readDone = std::max(readDone, accessBank(address, std::max(start, memoryReady[address])));
+                        if (row < viewRows && col < viewCols) {
+                            viewC[(product * viewRows + row) * viewCols + col] = memory[address];
+                        }
+                    }
+                }
+                
+                uint64_t bytes = static_cast<uint64_t>(count) * numActive * wordBytes;
+                uint64_t linkStart = std::max(readDone, hostLinkFree);
+                hostLinkFree = linkStart + divideRoundingUp(bytes, model.hostBytesPerCycle);
+                timeline.finish = std::max(timeline.finish, hostLinkFree + model.hostLatencyCycles);
+                addInterval(transferIntervals, linkStart, hostLinkFree + model.hostLatencyCycles);
+                result.hostBytesStored += bytes;
+                stored = true;
+                if (viewName) {
+                    result.storedBuffers.insert(*viewName);
+                }
+                break;
+            }
+            
+            case PIM_MOVE: {
+                occupancy = model.bankCycles;
+                uint64_t done = start;
+                
+                if (imm == PIM_MOVE_TO_REG || imm == PIM_MOVE_TO_REG_INDIRECT) {
+                    checkRegister(dest);
+                    uint64_t earliest = start;
+                    if (imm == PIM_MOVE_TO_REG_INDIRECT) {
+                        earliest = std::max(earliest, timeline.registerReady[checkRegister(src1)]);
+                    }
+                    for (unsigned pe = firstPE; pe < firstPE + numActive; pe++) {
+                        uint64_t address = (imm == PIM_MOVE_TO_REG) ? src1 : registers[pe][src1];
+                        unsigned global = globalAddress(pe, address, local);
+                        done = std::max(done, accessBank(global, std::max(earliest, memoryReady[global])));
+                        registers[pe][dest] = static_cast<uint32_t>(memory[global]);
+                    }
+                    timeline.registerReady[dest] = done;
+                } else {
+                    uint64_t earliest = std::max(start, timeline.registerReady[checkRegister(src1)]);
+                    if (imm == PIM_MOVE_TO_MEM_INDIRECT) {
+                        earliest = std::max(earliest, timeline.registerReady[checkRegister(dest)]);
+                    }
+                    for (unsigned pe = firstPE; pe < firstPE + numActive; pe++) {
+                        uint64_t address = (imm == PIM_MOVE_TO_MEM) ? dest : registers[pe][dest];
+                        unsigned global = globalAddress(pe, address, local);
+                        memory[global] = static_cast<int32_t>(registers[pe][src1]);
+                        memoryReady[global] = accessBank(global, earliest);
+                        done = std::max(done, memoryReady[global]);
+                    }
+                }
+                timeline.finish = std::max(timeline.finish, done);
+                break;
+            }
+            
+            case PIM_ADD:
+            case PIM_SUB:
+            case PIM_MUL:
+            case PIM_MAC:
+            case PIM_DIV:
+            case PIM_AND:
+            case PIM_OR:
+            case PIM_XOR:
+            case PIM_NOT:
+            case PIM_SHL:
+            case PIM_SHR: {
+                PIMOpcode opcode = inst.getOpcode();
+                bool unary = opcode == PIM_NOT;
+                checkRegister(dest);
+                if (opcode == PIM_MAC) {
+                    start = std::max(start, timeline.registerReady[dest]);
+                }
+                start = std::max(start, timeline.registerReady[checkRegister(src1)]);
+                if (!unary) {
+                    start = std::max(start, timeline.registerReady[checkRegister(src2)]);
+                }
+                
+                bool multiply = opcode == PIM_MUL || opcode == PIM_MAC;
+                occupancy = multiply ? model.mulCycles : (opcode == PIM_DIV ? model.divCycles : model.aluCycles);
+                for (unsigned pe = firstPE; pe < firstPE + numActive; pe++) {
+                    uint32_t a = registers[pe][src1];
+                    uint32_t b = unary ? 0 : registers[pe][src2];
+                    uint32_t value = 0;
+                    switch (opcode) {
+                        case PIM_ADD: value = a + b; break;
+                        case PIM_SUB: value = a - b; break;
+                        case PIM_MUL:
+                        case PIM_MAC:
+                            if (result.lanes > 1) {
+                                // Widening dot product of the packed lanes
+                                for (unsigned lane = 0; lane < result.lanes; lane++) {
+                                    value += static_cast<uint32_t>(laneValue(a, lane, result.precision) *
+                                                                   laneValue(b, lane, result.precision));
+                                }
+                            } else {
+                                value = a * b;
+                            }
+                            if (opcode == PIM_MAC) {
+                                value += registers[pe][dest];
+                            }
+                            break;
+                        case PIM_DIV:
+                            if (b == 0) {
+                                throw std::runtime_error("Division by zero at instruction " + std::to_string(pc));
+                            }
+                            value = static_cast<uint32_t>(static_cast<int32_t>(a) / static_cast<int32_t>(b));
+                            break;
+                        case PIM_AND: value = a & b; break;
+                        case PIM_OR:  value = a | b; break;
+                        case PIM_XOR: value = a ^ b; break;
+                        case PIM_NOT: value = ~a; break;
+                        case PIM_SHL: value = a << (b & 31); break;
+                        case PIM_SHR: value = a >> (b & 31); break;
+                        default: break;
+                    }
+                    registers[pe][dest] = value;
+                }
+                timeline.registerReady[dest] = start + occupancy;
+                timeline.finish = std::max(timeline.finish, timeline.registerReady[dest]);
+                addInterval(computeIntervals, start, start + occupancy);
+                break;
+            }
+            
+            case PIM_JUMP:
+            case PIM_JUMPZ:
+            case PIM_JUMPNZ: {
+                if (stream) {
+                    throw std::runtime_error("Jump inside the PE stream at instruction " + std::to_string(pc));
+                }
+                
+                // Control flow is uniform across the array; PE 0 decides
+                bool taken = true;
+                if (inst.getOpcode() != PIM_JUMP) {
+                    start = std::max(start, timeline.registerReady[checkRegister(src1)]);
+                    bool zero = registers[0][src1] == 0;
+                    taken = (inst.getOpcode() == PIM_JUMPZ) ? zero : !zero;
+                }
+                if (taken) {
+                    if (dest > program.size()) {
+                        throw std::runtime_error("Jump target " + std::to_string(dest) + " outside the program");
+                    }
+                    nextPC = dest;
+                }
+                occupancy = model.branchCycles;
+                break;
+            }
+            
+            default:
+                throw std::runtime_error("Unknown opcode at instruction " + std::to_string(pc));
+        }
+        
+        // Branches, configuration and barriers stall issue; everything else is pipelined
+        PIMOpcode opcode = inst.getOpcode();
+        bool stalls = opcode == PIM_CONFIG || opcode == PIM_SYNC || opcode == PIM_JUMP ||
+                      opcode == PIM_JUMPZ || opcode == PIM_JUMPNZ;
+        uint64_t issueCycles = stalls ? occupancy : 1;
+        for (unsigned pe = firstPE; pe < firstPE + numActive; pe++) {
+            result.peBusyCycles[pe] += issueCycles;
+        }
+        timeline.cycle = start + issueCycles;
+        timeline.finish = std::max(timeline.finish, timeline.cycle);
+        return nextPC;
+    };
+    
+    // Run the PE streams starting at pc concurrently; returns the index of their SYNC
+    auto runStreams = [&](size_t pc) {
+        std::vector<Stream> streams;
+        std::vector<bool> seen(numPEs, false);
+        size_t index = pc;
+        while (index < program.size() && program[index].getOpcode() != PIM_SYNC) {
+            const PIMInstruction& inst = program[index];
+            if (inst.getOpcode() == PIM_CONFIG && inst.getDest() == PIM_CONFIG_PE_STREAM) {
+                unsigned pe = inst.getSrc1();
+                if (pe >= numPEs || seen[pe]) {
+                    throw std::runtime_error("Invalid PE stream for PE " + std::to_string(pe) +
+                                             " at instruction " + std::to_string(index));
+                }
+                if (inst.getSrc2() >= batch) {
+                    throw std::runtime_error("PE stream for product " + std::to_string(inst.getSrc2()) +
+                                             " outside the batch of " + std::to_string(batch));
+                }
+                seen[pe] = true;
+                streams.push_back({pe, inst.getSrc2(), index, index});
+            }
+            streams.back().end = ++index;
+        }
+        if (index == program.size()) {
+            throw std::runtime_error("PE streams at instruction " + std::to_string(pc) + " are not closed by SYNC");
+        }
+        
+        // Always advance the stream that is furthest behind, so shared banks and
+        // the host link are claimed in approximately chronological order
+        std::vector<Timeline> timelines(streams.size(), broadcast);
+        std::vector<size_t> next(streams.size());
+        for (size_t s = 0; s < streams.size(); s++) {
+            next[s] = streams[s].begin;
+        }
+        for (;;) {
+            size_t current = streams.size();
+            for (size_t s = 0; s < streams.size(); s++) {
+                if (next[s] < streams[s].end &&
+                    (current == streams.size() || timelines[s].cycle < timelines[current].cycle)) {
+                    current = s;
+                }
+            }
+            if (current == streams.size()) {
+                break;
+            }
+            next[current] = execute(next[current], &streams[current], timelines[current]);
+        }
+        
+        for (const auto& timeline : timelines) {
+            broadcast.cycle = std::max(broadcast.cycle, timeline.cycle);
+            broadcast.finish = std::max(broadcast.finish, timeline.finish);
+        }
+        result.peStreams += streams.size();
+        return index;
+    };
+    
+    size_t pc = 0;
+    while (pc < program.size()) {
+        const PIMInstruction& inst = program[pc];
+        if (inst.getOpcode() == PIM_CONFIG && inst.getDest() == PIM_CONFIG_PE_STREAM) {
+            pc = runStreams(pc);
+        }
+        pc = execute(pc, nullptr, broadcast);
+    }
+    
+    result.cycles = broadcast.finish;
+    result.instructions = executed;
+    
+    normalizeIntervals(transferIntervals);
+    normalizeIntervals(computeIntervals);
+    result.transferCycles = coveredCycles(transferIntervals);
+    result.computeCycles = coveredCycles(computeIntervals);
+    result.overlappedTransferCycles = overlappingCycles(transferIntervals, computeIntervals);
+    
+    // Symbolic programs leave C in PIM memory for the runtime to read back
+    if (result.symbolic && !stored) {
+        result.c.assign(memory.begin() + cBase, memory.begin() + cBase + host.rows * host.cols);
+        result.readbackBytes = static_cast<uint64_t>(result.c.size()) * wordBytes;
+    } else {
+        result.c = hostC;
+    }
+        if (!host.kernels.empty()) {
+        result.buffers = std::move(buffers);
+    }
+    
+    return result;
+}
@@ -0,0 +1,201 @@
+/**
+ * PIMSimulator.h
+ * Cycle-approximate execution model for PIM instruction streams
+ */
+
+#ifndef PIM_SIMULATOR_H
+#define PIM_SIMULATOR_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "compiler/PIMInstruction.h"
+#include "compiler/MatrixShapeAnalysis.h"
+#include "../include/CompilerConfig.h"
+
+/**
+ * Timing parameters of the simulated PIM device
+ *
+ * PE count, bank count, bank size, register file and word size come from
+ * CompilerConfig::PIMArchParams; these add the latencies the ISA leaves open.
+ */
+struct PerformanceModel {
+    unsigned aluCycles = 1;            // ADD, SUB, logic and shifts
+    unsigned mulCycles = 3;            // MUL
+    unsigned divCycles = 16;           // DIV
+    unsigned bankCycles = 2;           // Occupancy of a bank per access
+    unsigned branchCycles = 2;         // Taken or not, including the pipeline refill
+    unsigned configCycles = 1;         // CONFIG
+    unsigned syncCycles = 4;           // SYNC barrier once every operation has completed
+    unsigned hostLatencyCycles = 20;   // Host link round trip per LOAD/STORE
+    unsigned hostBytesPerCycle = 16;   // Host link bandwidth
+    uint64_t maxInstructions = 100000000;  // Abort runaway programs
+};
+
+/**
+ * One kernel of a linked program computing C = A * B on named host buffers
+ * (row-major, A is rows x common, B is common x cols)
+ */
+struct LinkedKernel {
+    unsigned rows = 0;
+    unsigned cols = 0;
+    unsigned common = 0;
+    std::string a;
+    std::string b;
+    std::string c;
+};
+
+/**
+ * Host-side operands of C = A * B (row-major, A is rows x common, B is common x cols)
+ *
+ * Batched kernels hold batch products back to back in each array. A and B
+ * are kept in logical order; a program that declares them transposed
+ * (PIM_CONFIG_HOST_LAYOUT) addresses them in stored coordinates.
+ *
+ * A kernel compiled with a fused epilogue applies it to every product;
+ * its bias vectors are supplied row by row in rowVectors (rows elements
+ * each, PIM_HOST_ROW_VECTOR) and colVectors (cols elements each,
+ * PIM_HOST_COL_VECTOR).
+ *
+ * The constant matrices of the program's data section, which CONFIG
+ * PIM_CONFIG_CONSTANT_B selects in place of b, are kept in constants.
+ *
+ * A linked program binds the host transfers after CONFIG
+ * PIM_CONFIG_KERNEL, n to the buffers kernels[n] names; buffers missing
+ * from buffers start zero-filled.
+ */
+struct HostMatrices {
+    unsigned rows = 0;
+    unsigned cols = 0;
+    unsigned common = 0;
+    unsigned batch = 1;
+    std::vector<int32_t> a;
+    std::vector<int32_t> b;
+    std::vector<int32_t> c;
+    std::vector<EpilogueOp> epilogue;
+    std::vector<int32_t> rowVectors;
+    std::vector<int32_t> colVectors;
+    std::vector<PIMConstantMatrix> constants;
+    std::vector<LinkedKernel> kernels;
+    std::map<std::string, std::vector<int32_t>> buffers;
+};
+
+/**
+ * Measurements of one simulated run
+ */
+struct SimulationResult {
+    uint64_t cycles = 0;                    // Time until the last operation completed
+    uint64_t instructions = 0;              // Dynamic instruction count
+    uint64_t hostBytesLoaded = 0;           // Host -> PIM bytes moved by LOAD
+    uint64_t hostBytesStored = 0;           // PIM -> host bytes moved by STORE
+    uint64_t stagingBytes = 0;              // Launch block, A and B staged by the runtime (symbolic mode)
+    uint64_t readbackBytes = 0;             // C read back by the runtime (symbolic mode)
+    uint64_t bankConflictCycles = 0;        // Cycles accesses waited for a busy bank
+    uint64_t transferCycles = 0;            // Cycles with a host LOAD/STORE in flight (link and latency)
+    uint64_t computeCycles = 0;             // Cycles an arithmetic instruction was executing
+    uint64_t overlappedTransferCycles = 0;  // Transfer cycles that were also compute cycles
+    bool symbolic = false;                  // Program ran in PIM_OP_MODE_SYMBOLIC
+    unsigned precision = 32;                // Element bits selected by CONFIG PIM_CONFIG_PRECISION
+    unsigned lanes = 1;                     // Elements packed per word of A and B
+    uint64_t peStreams = 0;                 // Per-PE instruction streams executed
+    std::vector<uint64_t> peBusyCycles;     // Per PE: cycles issue was occupied by its instructions
+    std::vector<uint64_t> bankAccesses;     // Per bank: number of accesses
+    std::vector<uint64_t> bankBusyCycles;   // Per bank: cycles the bank was occupied
+    std::vector<int32_t> c;                 // Result matrices, row-major batch x rows x cols
+    uint64_t kernels = 0;                   // Kernel markers of a linked program executed
+    std::map<std::string, std::vector<int32_t>> buffers;  // Host buffers of a linked program after the run
+    std::set<std::string> storedBuffers;    // Buffers of a linked program written by STORE
+};
+
+class PIMSimulator {
+public:
+    explicit PIMSimulator(const CompilerConfig& config, const PerformanceModel& model = PerformanceModel());
+    ~PIMSimulator();
+
+    /**
+     * Execute a program and measure it
+     *
+     * Instructions issue in order, one per cycle, and are broadcast to the
+     * active PEs. Until CONFIG PIM_CONFIG_INTERCONNECT sets the grid width a
+     * single PE is active and other CONFIG values (such as the matrix size
+     * header of untiled programs) are informational; afterwards
+     * PIM_CONFIG_ARRAY_SIZE PEs form a grid of that width. A broadcast
+     * LOAD [row, col] delivers A[row+pi][col], B[row][col+pj],
+     * C[row+pi][col+pj], element col+pi of row vector row or element
+     * col+pj of column vector row to PE (pi, pj) and STORE writes
+     * C[row+pi][col+pj].
+     *
+     * A register scoreboard lets independent instructions overlap long
+     * latencies. Host LOADs complete asynchronously and a later access to the
+     * destination word waits for them. Every memory access occupies the bank
+     * LayoutPlanner::bankOf maps its address to (PE memories are word
+     * interleaved: PE p's local word w is global word w * numPEs + p while the
+     * array is configured), and accesses to a busy bank wait.
+     *
+     * CONFIG PIM_CONFIG_PRECISION with a lane count packs host LOADs of A
+     * and B and turns MUL and MAC into a widening dot product of the lanes
+     * (see PIMInstructionSet.h).
+     *
+     * CONFIG PIM_CONFIG_HOST_LAYOUT swaps the host coordinates of the
+     * transposed operands, and CONFIG PIM_CONFIG_BATCH (or the batch of a
+     * PE stream marker) selects the product host transfers address. CONFIG
+     * PIM_CONFIG_CONSTANT_B makes LOADs of B read the pre-packed words of a
+     * constant matrix of host.constants.
+     *
+     * LOAD_BLOCK and STORE_BLOCK (ISA version 2) move a burst of words per PE
+     * in one host link transfer; the words of a burst arrive in order, so
+     * compute may start on the first before the last has landed.
+     *
+     * The transfer overlap counts the cycles in which a host transfer was
+     * in flight while an ADD, MUL or other arithmetic instruction executed;
+     * relative to the shorter of the two phases it is 100% when that phase
+     * is hidden entirely behind the other.
+     * 
+     * PE streams (PIM_CONFIG_PE_STREAM sections closed by SYNC) run
+     * concurrently, each on its own PE with its own issue timeline and
+     * scoreboard, addressing PE-local memory and the host matrices directly;
+     * they share the banks and the host link, and SYNC waits for all of them.
+     *
+     * When the program selects PIM_OP_MODE_SYMBOLIC, the launch block
+     * (PIMLaunchLayout) and A and B are staged before execution continues and the
+     * result is read from PIM memory; otherwise it is the host C buffer written
+     * by STORE.
+     * 
+     * CONFIG PIM_CONFIG_KERNEL starts a kernel of a linked program: host
+     * transfers address the buffers of host.kernels[n] until the next marker,
+     * and PIM memory carries over from the previous kernel.
+     *
+     * @param program Instructions to execute
+     * @param host Host matrices; A and B are read, C is the initial result buffer
+     * @return Measurements and the result matrix
+     * @throws std::runtime_error on invalid instructions, out-of-range
+     *         addresses or when PerformanceModel::maxInstructions is exceeded
+     */
+    SimulationResult run(const std::vector<PIMInstruction>& program, const HostMatrices& host) const;
+
+    /**
+     * Compute C = A * B of every product on the host as the reference result
+     *
+     * The epilogue of the host matrices is applied to every element.
+     *
+     * @param host Host matrices
+     * @return Row-major batch x rows x cols result with 32-bit wrap-around
+     */
+    static std::vector<int32_t> referenceGemm(const HostMatrices& host);
+
+    /**
+     * Run the kernels of a linked program on the host as the reference result
+     * 
+     * @param host Host matrices with the kernels and their input buffers
+     * @return Every buffer after the last kernel, with 32-bit wrap-around
+     */
+    static std::map<std::string, std::vector<int32_t>> referenceKernels(const HostMatrices& host);
+
+private:
+    CompilerConfig config;
+    PerformanceModel model;
+};
+
+#endif // PIM_SIMULATOR_H
@@ -0,0 +1,801 @@
+/**
+ * Main entry point for the PIM simulator
+ * Runs a compiled PIM program against the performance model and checks its result
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include "sim/PIMSimulator.h"
+#include "compiler/PIMBinary.h"
+#include "compiler/PIMInstruction.h"
+#include "compiler/ShardPlanner.h"
+#include "../include/CompilerConfig.h"
+
+void printUsage(const std::string& programName) {
+    std::cout << "Usage: " << programName << " [options] program_file\n"
+              << "Runs a text (.pim/.txt) or binary (.pimb) PIM program and checks C = A * B\n"
+              << "Options:\n"
+              << "  --dims <RxCxK[xB]> Matrix dimensions rows x cols x common (default 2x2x2),\n"
+              << "                   and the number of products of a batched program\n"
+              << "  --seed <n>       Seed for the generated input matrices (default 1)\n"
+              << "  --matrix-b <file> Take B from a file of whitespace-separated integers,\n"
+              << "                   common x cols in row-major order per product, instead\n"
+              << "                   of generating it (the values of a compressed kernel);\n"
+              << "                   a program carrying its constant B must match the file\n"
+              << "  --epilogue <ops> Fused epilogue of the program, comma separated from\n"
+              << "                   col-bias, row-bias, relu and scale=N\n"
+              << "  --kernel <RxCxK:A,B,C> A kernel of a linked program computing C = A * B\n"
+              << "                   on the named host buffers, repeated in kernel order; buffers\n"
+              << "                   no earlier kernel computes are generated unless the program\n"
+              << "                   carries them as a constant B. The buffers the program\n"
+              << "                   stores are checked\n"
+              << "  --schedule <file> Host schedule of a program sharded over several devices\n"
+              << "                   (written by pim_compiler --devices); A and B of every\n"
+              << "                   kernel are generated, staged as the schedule says and\n"
+              << "                   the C the host collects is checked\n"
+              << "  --pes <n>        Number of processing elements (text programs)\n"
+              << "  --banks <n>      Number of memory banks (text programs)\n"
+              << "  --bank-hash <h>  Bank mapping: linear, interleaved (default) or xor\n"
+              << "  --json           Print the report as JSON\n"
+              << "  -v, --verbose    Report utilization of every PE and bank\n"
+              << "  -h, --help       Display this help message\n";
+}
+
+// Parse a dimension triple of the form "RxCxK", followed by "xB" if batch is given
+bool parseDimensions(const std::string& text, unsigned& first, unsigned& second, unsigned& third,
+                     unsigned* batch = nullptr) {
+    std::stringstream ss(text);
+    char sep1 = 0, sep2 = 0;
+    if (!(ss >> first >> sep1 >> second >> sep2 >> third) || sep1 != 'x' || sep2 != 'x') {
+        return false;
+    }
+    if (batch && !ss.eof()) {
+        char sep3 = 0;
+        if (!(ss >> sep3 >> *batch) || sep3 != 'x' || *batch == 0) {
+            return false;
+        }
+    }
+    return ss.eof() && first > 0 && second > 0 && third > 0;
+}
+
+// Parse a linked kernel of the form "RxCxK:A,B,C"
+bool parseKernel(const std::string& text, LinkedKernel& kernel) {
+    size_t colon = text.find(':');
+    if (colon == std::string::npos ||
+        !parseDimensions(text.substr(0, colon), kernel.rows, kernel.cols, kernel.common)) {
+        return false;
+    }
+    std::stringstream ss(text.substr(colon + 1));
+    std::string* names[] = {&kernel.a, &kernel.b, &kernel.c};
+    for (std::string* name : names) {
+        if (!std::getline(ss, *name, ',') || name->empty()) {
+            return false;
+        }
+    }
+    return ss.peek() == std::char_traits<char>::eof();
+}
+
+// Parse an epilogue list of the form "col-bias,relu,scale=2"
+bool parseEpilogue(const std::string& text, std::vector<EpilogueOp>& epilogue) {
+    std::stringstream ss(text);
+    std::string item;
+    unsigned vectors[2] = {0, 0};
+    while (std::getline(ss, item, ',')) {
+        EpilogueOp op;
+        if (item == "col-bias" || item == "row-bias") {
+            op.kind = item == "row-bias" ? EpilogueOp::BIAS_ROW : EpilogueOp::BIAS_COLUMN;
+            op.operand = vectors[op.kind == EpilogueOp::BIAS_ROW ? 1 : 0]++;
+            op.vector = "bias";
+        } else if (item == "relu") {
+            op.kind = EpilogueOp::RELU;
+        } else if (item.compare(0, 6, "scale=") == 0 && item.size() > 6) {
+            op.kind = EpilogueOp::SCALE;
+            try {
+                op.factor = static_cast<int32_t>(std::stol(item.substr(6)));
+            } catch (const std::exception&) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+        epilogue.push_back(op);
+    }
+    return !epilogue.empty();
+}
+
+// Load a program from a binary container (taking its architecture) or a text
+// listing, with the constant matrices of its data section
+std::vector<PIMInstruction> loadProgram(const std::string& filename, CompilerConfig& config,
+                                        std::vector<PIMConstantMatrix>& data) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Could not open program file: " + filename);
+    }
+    
+    char magic[4] = {0, 0, 0, 0};
+    file.read(magic, sizeof(magic));
+    std::vector<PIMInstruction> program;
+    
+    if (file && std::string(magic, sizeof(magic)) == "PIMB") {
+        file.close();
+        PIMBinaryReader reader(filename);
+        const PIMBinaryHeader& header = reader.getHeader();
+        config.archParams.numProcessingElements = header.numProcessingElements;
+        config.archParams.memoryBankSize = header.memoryBankSize;
+        config.archParams.numMemoryBanks = header.numMemoryBanks;
+        config.archParams.registerFileSize = header.registerFileSize;
+        config.archParams.wordSize = header.wordSize;
+        
+        for (size_t i = 0; i < reader.getInstructionCount(); i++) {
+            program.push_back(reader.decodeInstruction(i));
+        }
+        data = reader.getConstantMatrices();
+        return program;
+    }
+    
+    file.clear();
+    file.seekg(0);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        if (PIMConstantMatrix::isDataLine(line)) {
+            PIMConstantMatrix::parseLine(line, data);
+            continue;
+        }
+        program.push_back(PIMInstruction::parse(line));
+    }
+    return program;
+}
+
+// Unpack constant matrix 0 of the data section into the logical common x
+// cols B of the reference, with the packing the program configures
+std::vector<int32_t> unpackConstantB(const std::vector<PIMInstruction>& program,
+                                     const PIMConstantMatrix& matrix, unsigned common, unsigned cols) {
+    unsigned precision = 32, lanes = 1;
+    for (const auto& inst : program) {
+        if (inst.getOpcode() == PIM_CONFIG && inst.getDest() == PIM_CONFIG_PRECISION && inst.getSrc2() != 0) {
+            precision = inst.getSrc1();
+            lanes = inst.getSrc2();
+        }
+    }
+    std::vector<int32_t> values(static_cast<size_t>(common) * cols);
+    for (unsigned k = 0; k < common; k++) {
+        for (unsigned j = 0; j < cols; j++) {
+            uint32_t word = matrix.word(k / lanes, j) >> ((k % lanes) * precision);
+            int32_t value = static_cast<int32_t>(word);
+            if (precision < 32) {
+                // Sign-extend the lane
+                value = static_cast<int32_t>(word << (32 - precision)) >> (32 - precision);
+            }
+            values[static_cast<size_t>(k) * cols + j] = value;
+        }
+    }
+    return values;
+}
+
+// Index of the constant matrix the section of kernel n selects for B, or 0 for none
+unsigned constantOfKernel(const std::vector<PIMInstruction>& program, unsigned kernel) {
+    bool inKernel = false;
+    for (const auto& inst : program) {
+        if (inst.getOpcode() != PIM_CONFIG) {
+            continue;
+        }
+        if (inst.getDest() == PIM_CONFIG_KERNEL) {
+            inKernel = inst.getSrc1() == kernel;
+        } else if (inKernel && inst.getDest() == PIM_CONFIG_CONSTANT_B && inst.getSrc1() != 0) {
+            return inst.getSrc1();
+        }
+    }
+    return 0;
+}
+
+// Fill a matrix with small deterministic values in [-8, 8)
+std::vector<int32_t> generateMatrix(unsigned size, uint32_t& state) {
+    std::vector<int32_t> values(size);
+    for (auto& value : values) {
+        state = state * 1664525u + 1013904223u;
+        value = static_cast<int32_t>((state >> 16) % 16) - 8;
+    }
+    return values;
+}
+
+// Read the integers of a matrix file, which must hold exactly size values
+std::vector<int32_t> readMatrix(const std::string& filename, size_t size) {
+    std::ifstream file(filename);
+    if (!file) {
+        throw std::runtime_error("Could not open matrix file: " + filename);
+    }
+    std::vector<int32_t> values;
+    int64_t value = 0;
+    while (file >> value) {
+        values.push_back(static_cast<int32_t>(value));
+    }
+    if (!file.eof() || values.size() != size) {
+        throw std::runtime_error("Matrix file " + filename + " must hold " + std::to_string(size) + " integers");
+    }
+    return values;
+}
+
+double percent(uint64_t part, uint64_t total) {
+    return total == 0 ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(total);
+}
+
+// Run a linked program on generated buffers and report the buffers it stores
+int simulateLinked(const std::string& programFile, const std::vector<PIMInstruction>& program,
+                   const std::vector<PIMConstantMatrix>& data, const CompilerConfig& config,
+                   const std::vector<LinkedKernel>& kernels, uint32_t seed, bool json) {
+    HostMatrices host;
+    host.kernels = kernels;
+    host.constants = data;
+    std::set<std::string> computed;
+    for (unsigned n = 0; n < kernels.size(); n++) {
+        const LinkedKernel& kernel = kernels[n];
+        const std::pair<const std::string*, unsigned> inputs[] = {
+            {&kernel.a, kernel.rows * kernel.common}, {&kernel.b, kernel.common * kernel.cols}
+        };
+        for (const auto& [name, size] : inputs) {
+            if (!computed.count(*name) && !host.buffers.count(*name)) {
+                host.buffers[*name] = generateMatrix(size, seed);
+            }
+        }
+        if (unsigned constant = constantOfKernel(program, n)) {
+            if (constant > data.size()) {
+                throw std::runtime_error("Kernel " + std::to_string(n) + " selects a missing constant matrix");
+            }
+            host.buffers[kernel.b] = unpackConstantB(program, data[constant - 1], kernel.common, kernel.cols);
+        }
+        computed.insert(kernel.c);
+    }
+    
+    PIMSimulator simulator(config);
+    SimulationResult result = simulator.run(program, host);
+    std::map<std::string, std::vector<int32_t>> expected = PIMSimulator::referenceKernels(host);
+    
+    size_t mismatches = 0;
+    for (const auto& name : result.storedBuffers) {
+        const std::vector<int32_t>& values = result.buffers[name];
+        const std::vector<int32_t>& reference = expected[name];
+        for (size_t i = 0; i < reference.size(); i++) {
+            if (i >= values.size() || values[i] != reference[i]) {
+                mismatches++;
+            }
+        }
+    }
+    
+    std::string stored;
+    for (const auto& name : result.storedBuffers) {
+        stored += (stored.empty() ? "" : ", ") + (json ? "\"" + name + "\"" : name);
+    }
+    if (json) {
+        std::cout << "{\n"
+                  << "  \"program\": \"" << programFile << "\",\n"
+                  << "  \"kernels\": " << kernels.size() << ",\n"
+                  << "  \"kernels_executed\": " << result.kernels << ",\n"
+                  << "  \"instructions\": " << program.size() << ",\n"
+                  << "  \"executed\": " << result.instructions << ",\n"
+                  << "  \"cycles\": " << result.cycles << ",\n"
+                  << "  \"host_bytes_loaded\": " << result.hostBytesLoaded << ",\n"
+                  << "  \"host_bytes_stored\": " << result.hostBytesStored << ",\n"
+                  << "  \"stored_buffers\": [" << stored << "],\n"
+                  << "  \"mismatches\": " << mismatches << ",\n"
+                  << "  \"correct\": " << (mismatches == 0 ? "true" : "false") << "\n"
+                  << "}\n";
+    } else {
+        std::cout << "Program: " << programFile << " (" << program.size() << " instructions, "
+                  << result.instructions << " executed)\n"
+                  << "Linked kernels: " << result.kernels << " of " << kernels.size() << "\n"
+                  << "Cycles: " << result.cycles << "\n"
+                  << "Host traffic: " << result.hostBytesLoaded << " bytes loaded, "
+                  << result.hostBytesStored << " bytes stored\n"
+                  << "Stored buffers: " << (stored.empty() ? "none" : stored) << "\n"
+                  << "Result check: " << (mismatches == 0 ? "PASS" : "FAIL") << std::endl;
+    }
+    return mismatches == 0 ? 0 : 2;
+}
+
+// Blocks of A and B a device holds, with the elements the schedule staged
+struct DeviceOperands {
+    std::vector<int32_t> a, b;
+    std::vector<bool> stagedA, stagedB;
+};
+
+// Run a sharded program: stage A and B on every device as the host schedule
+// says, run the device programs and collect C on the host
+int simulateSharded(const std::string& programFile, const std::vector<PIMInstruction>& program,
+                    const std::vector<PIMConstantMatrix>& data, const CompilerConfig& config,
+                    const std::string& scheduleFile, uint32_t seed, bool json) {
+    std::ifstream file(scheduleFile);
+    if (!file) {
+        throw std::runtime_error("Could not open host schedule: " + scheduleFile);
+    }
+    ShardPlan plan = ShardPlan::read(file);
+    
+    // Split the program into the sections of every device and kernel
+    std::map<std::pair<unsigned, unsigned>, std::vector<PIMInstruction>> sections;
+    std::vector<PIMInstruction>* section = nullptr;
+    unsigned device = 0;
+    bool inDevice = false;
+    for (const auto& inst : program) {
+        if (inst.getOpcode() == PIM_CONFIG && inst.getDest() == PIM_CONFIG_DEVICE) {
+            if (inst.getSrc1() >= plan.devices) {
+                throw std::runtime_error("Device " + std::to_string(inst.getSrc1()) + " outside the " +
+                                         std::to_string(plan.devices) + " of the host schedule");
+            }
+            device = inst.getSrc1();
+            inDevice = true;
+            section = nullptr;
+        } else if (inst.getOpcode() == PIM_CONFIG && inst.getDest() == PIM_CONFIG_KERNEL && inDevice) {
+            section = &sections[{device, inst.getSrc1()}];
+        } else if (section) {
+            section->push_back(inst);
+        } else if (inst.getOpcode() != PIM_NOP) {
+            throw std::runtime_error("Instruction outside a device kernel: " + inst.toString());
+        }
+    }
+    
+    PIMSimulator simulator(config);
+    std::vector<uint64_t> deviceCycles(plan.devices, 0);
+    uint64_t executed = 0, hostBytesLoaded = 0, hostBytesStored = 0;
+    uint64_t hostWords = 0, interDeviceWords = 0;
+    size_t mismatches = 0;
+    for (const auto& kernel : plan.kernels) {
+        std::vector<int32_t> a = generateMatrix(kernel.rows * kernel.common, seed);
+        std::vector<int32_t> b = generateMatrix(kernel.common * kernel.cols, seed);
+        
+        // A device program carrying its constant B holds its block of B
+        std::vector<const DeviceShard*> carried;
+        for (const auto& shard : kernel.shards) {
+            auto found = sections.find({shard.device, kernel.index});
+            if (found == sections.end()) {
+                throw std::runtime_error("No program for shard " + std::to_string(shard.device) + " of kernel " +
+                                         std::to_string(kernel.index));
+            }
+            unsigned constant = 0;
+            for (const auto& inst : found->second) {
+                if (inst.getOpcode() == PIM_CONFIG && inst.getDest() == PIM_CONFIG_CONSTANT_B && inst.getSrc1() != 0) {
+                    constant = inst.getSrc1();
+                    break;
+                }
+            }
+            if (constant == 0) {
+                continue;
+            }
+            if (constant > data.size()) {
+                throw std::runtime_error("Kernel " + std::to_string(kernel.index) + " selects a missing constant matrix");
+            }
+            std::vector<int32_t> block = unpackConstantB(found->second, data[constant - 1], shard.common, shard.cols);
+            for (unsigned k = 0; k < shard.common; k++) {
+                std::copy_n(&block[static_cast<size_t>(k) * shard.cols], shard.cols,
+                            &b[static_cast<size_t>(shard.k + k) * kernel.cols + shard.col]);
+            }
+            carried.push_back(&shard);
+        }
+        
+        // Stage the blocks of A and B; a broadcast forwards what its source holds
+        std::vector<DeviceOperands> devices(plan.devices);
+        for (auto& operands : devices) {
+            operands.a.assign(a.size(), 0);
+            operands.b.assign(b.size(), 0);
+            operands.stagedA.assign(a.size(), false);
+            operands.stagedB.assign(b.size(), false);
+        }
+        for (const DeviceShard* shard : carried) {
+            DeviceOperands& operands = devices[shard->device];
+            for (unsigned k = shard->k; k < shard->k + shard->common; k++) {
+                for (unsigned j = shard->col; j < shard->col + shard->cols; j++) {
+                    size_t i = static_cast<size_t>(k) * kernel.cols + j;
+                    operands.b[i] = b[i];
+                    operands.stagedB[i] = true;
+                }
+            }
+        }
+        for (const auto& step : kernel.transfers) {
+            if (step.kind != ShardTransfer::SCATTER && step.kind != ShardTransfer::BROADCAST) {
+                continue;
+            }
+            bool isA = step.matrix == 'A';
+            unsigned width = isA ? kernel.common : kernel.cols;
+            for (unsigned r = step.row; r < step.row + step.rows; r++) {
+                for (unsigned col = step.col; col < step.col + step.cols; col++) {
+                    size_t i = static_cast<size_t>(r) * width + col;
+                    int32_t value = isA ? a[i] : b[i];
+                    if (step.kind == ShardTransfer::BROADCAST) {
+                        const DeviceOperands& source = devices[step.from];
+                        if (!(isA ? source.stagedA[i] : source.stagedB[i])) {
+                            throw std::runtime_error("Device " + std::to_string(step.from) + " broadcasts " +
+                                                     step.matrix + "[" + std::to_string(r) + "][" +
+                                                     std::to_string(col) + "] before receiving it");
+                        }
+                        value = isA ? source.a[i] : source.b[i];
+                    }
+                    DeviceOperands& target = devices[step.to];
+                    (isA ? target.a : target.b)[i] = value;
+                    (isA ? target.stagedA : target.stagedB)[i] = true;
+                }
+            }
+        }
+        
+        // Every device computes its shard from the blocks it holds
+        std::map<unsigned, std::vector<int32_t>> results;
+        for (const auto& shard : kernel.shards) {
+            const DeviceOperands& operands = devices[shard.device];
+            HostMatrices host;
+            host.rows = shard.rows;
+            host.cols = shard.cols;
+            host.common = shard.common;
+            host.constants = data;
+            for (unsigned r = 0; r < shard.rows; r++) {
+                for (unsigned k = 0; k < shard.common; k++) {
+                    size_t i = static_cast<size_t>(shard.row + r) * kernel.common + shard.k + k;
+                    if (!operands.stagedA[i]) {
+                        throw std::runtime_error("Device " + std::to_string(shard.device) + " reads A[" +
+                                                 std::to_string(shard.row + r) + "][" + std::to_string(shard.k + k) +
+                                                 "] the schedule does not stage");
+                    }
+                    host.a.push_back(operands.a[i]);
+                }
+            }
+            for (unsigned k = 0; k < shard.common; k++) {
+                for (unsigned j = 0; j < shard.cols; j++) {
+                    size_t i = static_cast<size_t>(shard.k + k) * kernel.cols + shard.col + j;
+                    if (!operands.stagedB[i]) {
+                        throw std::runtime_error("Device " + std::to_string(shard.device) + " reads B[" +
+                                                 std::to_string(shard.k + k) + "][" + std::to_string(shard.col + j) +
+                                                 "] the schedule does not stage");
+                    }
+                    host.b.push_back(operands.b[i]);
+                }
+            }
+            host.c.assign(static_cast<size_t>(shard.rows) * shard.cols, 0);
+            
+            SimulationResult result = simulator.run(sections[{shard.device, kernel.index}], host);
+            deviceCycles[shard.device] += result.cycles;
+            executed += result.instructions;
+            hostBytesLoaded += result.hostBytesLoaded;
+            hostBytesStored += result.hostBytesStored;
+            results[shard.device] = result.c;
+        }
+        
+        // Collect C: a gathered block is copied, the partial sums are added up
+        std::vector<int32_t> c(static_cast<size_t>(kernel.rows) * kernel.cols, 0);
+        for (const auto& step : kernel.transfers) {
+            if (step.kind != ShardTransfer::GATHER && step.kind != ShardTransfer::REDUCE) {
+                continue;
+            }
+            const DeviceShard* shard = kernel.shardOf(step.from);
+            if (!shard || shard->row != step.row || shard->col != step.col || shard->rows != step.rows ||
+                shard->cols != step.cols) {
+                throw std::runtime_error("Device " + std::to_string(step.from) + " does not compute the block of C "
+                                         "the host collects from it");
+            }
+            const std::vector<int32_t>& block = results[step.from];
+            for (unsigned r = 0; r < step.rows; r++) {
+                for (unsigned j = 0; j < step.cols; j++) {
+                    int32_t& value = c[static_cast<size_t>(step.row + r) * kernel.cols + step.col + j];
+                    int32_t partial = block[static_cast<size_t>(r) * step.cols + j];
+                    value = step.kind == ShardTransfer::REDUCE ? value + partial : partial;
+                }
+            }
+        }
+        
+        HostMatrices whole;
+        whole.rows = kernel.rows;
+        whole.cols = kernel.cols;
+        whole.common = kernel.common;
+        whole.a = a;
+        whole.b = b;
+        std::vector<int32_t> expected = PIMSimulator::referenceGemm(whole);
+        for (size_t i = 0; i < expected.size(); i++) {
+            if (c[i] != expected[i]) {
+                mismatches++;
+            }
+        }
+        hostWords += kernel.hostWordsLoaded + kernel.hostWordsStored;
+        interDeviceWords += kernel.interDeviceWords;
+    }
+    
+    // The devices run side by side
+    uint64_t cycles = *std::max_element(deviceCycles.begin(), deviceCycles.end());
+    if (json) {
+        std::cout << "{\n"
+                  << "  \"program\": \"" << programFile << "\",\n"
+                  << "  \"devices\": " << plan.devices << ",\n"
+                  << "  \"kernels\": " << plan.kernels.size() << ",\n"
+                  << "  \"instructions\": " << program.size() << ",\n"
+                  << "  \"executed\": " << executed << ",\n"
+                  << "  \"cycles\": " << cycles << ",\n"
+                  << "  \"device_cycles\": [";
+        for (unsigned d = 0; d < plan.devices; d++) {
+            std::cout << (d ? ", " : "") << deviceCycles[d];
+        }
+        std::cout << "],\n"
+                  << "  \"host_bytes_loaded\": " << hostBytesLoaded << ",\n"
+                  << "  \"host_bytes_stored\": " << hostBytesStored << ",\n"
+                  << "  \"scheduled_host_words\": " << hostWords << ",\n"
+                  << "  \"inter_device_words\": " << interDeviceWords << ",\n"
+                  << "  \"mismatches\": " << mismatches << ",\n"
+                  << "  \"correct\": " << (mismatches == 0 ? "true" : "false") << "\n"
+                  << "}\n";
+    } else {
+        std::cout << "Program: " << programFile << " (" << program.size() << " instructions, "
+                  << executed << " executed)\n"
+                  << "Devices: " << plan.devices << ", kernels: " << plan.kernels.size() << "\n";
+        for (const auto& kernel : plan.kernels) {
+            std::cout << "  Kernel " << kernel.index << " (" << kernel.function << "): " << kernel.describe() << "\n";
+        }
+        std::cout << "Cycles: " << cycles << " (slowest device)\n"
+                  << "Host traffic: " << hostBytesLoaded << " bytes loaded, " << hostBytesStored
+                  << " bytes stored by the devices\n"
+                  << "Scheduled traffic: " << hostWords << " host words, " << interDeviceWords
+                  << " words between devices\n"
+                  << "Result check: " << (mismatches == 0 ? "PASS" : "FAIL") << std::endl;
+    }
+    return mismatches == 0 ? 0 : 2;
+}
+
+int main(int argc, char* argv[]) {
+    std::string programFile;
+    unsigned rows = 2, cols = 2, common = 2, batch = 1;
+    uint32_t seed = 1;
+    bool json = false;
+    bool verbose = false;
+    std::vector<EpilogueOp> epilogue;
+    std::string matrixBFile;
+    std::vector<LinkedKernel> kernels;
+    std::string scheduleFile;
+    CompilerConfig config = CompilerConfig::getDefaultConfig();
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (arg == "-v" || arg == "--verbose") {
+            verbose = true;
+        } else if (arg == "--json") {
+            json = true;
+        } else if (arg == "--dims" && i + 1 < argc) {
+            std::string dims = argv[++i];
+            if (!parseDimensions(dims, rows, cols, common, &batch)) {
+                std::cerr << "Invalid matrix dimensions: " << dims << " (expected RxCxK or RxCxKxB)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--epilogue" && i + 1 < argc) {
+            std::string ops = argv[++i];
+            if (!parseEpilogue(ops, epilogue)) {
+                std::cerr << "Invalid epilogue: " << ops << " (expected col-bias, row-bias, relu or scale=N)" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--kernel" && i + 1 < argc) {
+            std::string text = argv[++i];
+            LinkedKernel kernel;
+            if (!parseKernel(text, kernel)) {
+                std::cerr << "Invalid kernel: " << text << " (expected RxCxK:A,B,C)" << std::endl;
+                return 1;
+            }
+            kernels.push_back(kernel);
+        } else if (arg == "--schedule" && i + 1 < argc) {
+            scheduleFile = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--matrix-b" && i + 1 < argc) {
+            matrixBFile = argv[++i];
+        } else if (arg == "--pes" && i + 1 < argc) {
+            config.archParams.numProcessingElements = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--banks" && i + 1 < argc) {
+            config.archParams.numMemoryBanks = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--bank-hash" && i + 1 < argc) {
+            std::string hashing = argv[++i];
+            if (hashing == "linear") {
+                config.layout.bankHashing = CompilerConfig::LayoutParams::BANK_HASH_LINEAR;
+            } else if (hashing == "interleaved") {
+                config.layout.bankHashing = CompilerConfig::LayoutParams::BANK_HASH_INTERLEAVED;
+            } else if (hashing == "xor") {
+                config.layout.bankHashing = CompilerConfig::LayoutParams::BANK_HASH_XOR;
+            } else {
+                std::cerr << "Unknown bank hashing: " << hashing << std::endl;
+                return 1;
+            }
+        } else if (arg[0] != '-') {
+            programFile = arg;
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+    if (programFile.empty()) {
+        std::cerr << "Error: No program file specified\n";
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    try {
+        std::vector<PIMConstantMatrix> data;
+        std::vector<PIMInstruction> program = loadProgram(programFile, config, data);
+        if (!scheduleFile.empty()) {
+            return simulateSharded(programFile, program, data, config, scheduleFile, seed, json);
+        }
+        if (!kernels.empty()) {
+            return simulateLinked(programFile, program, data, config, kernels, seed, json);
+        }
+        
+        HostMatrices host;
+        host.rows = rows;
+        host.cols = cols;
+        host.common = common;
+        host.batch = batch;
+        host.a = generateMatrix(batch * rows * common, seed);
+        host.b = generateMatrix(batch * common * cols, seed);
+        if (!matrixBFile.empty()) {
+            host.b = readMatrix(matrixBFile, host.b.size());
+        }
+        
+        // A program carrying its constant B is checked against that B
+        host.constants = data;
+        if (!data.empty()) {
+            if (batch > 1) {
+                throw std::runtime_error("Programs carrying a constant B are not batched");
+            }
+            std::vector<int32_t> constant = unpackConstantB(program, data[0], common, cols);
+            if (!matrixBFile.empty() && constant != host.b) {
+                throw std::runtime_error("Matrix file " + matrixBFile + " differs from the constant B of the program");
+            }
+            host.b = constant;
+        }
+        host.c.assign(batch * rows * cols, 0);
+        host.epilogue = epilogue;
+        for (const auto& op : epilogue) {
+            if (op.kind == EpilogueOp::BIAS_ROW) {
+                std::vector<int32_t> vector = generateMatrix(rows, seed);
+                host.rowVectors.insert(host.rowVectors.end(), vector.begin(), vector.end());
+            } else if (op.kind == EpilogueOp::BIAS_COLUMN) {
+                std::vector<int32_t> vector = generateMatrix(cols, seed);
+                host.colVectors.insert(host.colVectors.end(), vector.begin(), vector.end());
+            }
+        }
+        
+        PIMSimulator simulator(config);
+        SimulationResult result = simulator.run(program, host);
+        std::vector<int32_t> expected = PIMSimulator::referenceGemm(host);
+        
+        size_t mismatches = 0;
+        for (size_t i = 0; i < expected.size(); i++) {
+            if (result.c[i] != expected[i]) {
+                mismatches++;
+            }
+        }
+        
+        // Utilization over the PEs and banks that were used at all
+        std::vector<unsigned> activePEs;
+        for (unsigned pe = 0; pe < result.peBusyCycles.size(); pe++) {
+            if (result.peBusyCycles[pe] > 0) {
+                activePEs.push_back(pe);
+            }
+        }
+        std::vector<unsigned> usedBanks;
+        for (unsigned bank = 0; bank < result.bankAccesses.size(); bank++) {
+            if (result.bankAccesses[bank] > 0) {
+                usedBanks.push_back(bank);
+            }
+        }
+        
+        uint64_t peBusy = 0, peMax = 0, bankBusy = 0, bankMax = 0;
+        for (unsigned pe : activePEs) {
+            peBusy += result.peBusyCycles[pe];
+            peMax = std::max(peMax, result.peBusyCycles[pe]);
+        }
+        for (unsigned bank : usedBanks) {
+            bankBusy += result.bankBusyCycles[bank];
+            bankMax = std::max(bankMax, result.bankBusyCycles[bank]);
+        }
+        double peMean = activePEs.empty() ? 0.0 : percent(peBusy, result.cycles * activePEs.size());
+        double bankMean = usedBanks.empty() ? 0.0 : percent(bankBusy, result.cycles * usedBanks.size());
+        
+        // Share of the shorter of transfer and compute that ran alongside the other
+        double overlapRatio = percent(result.overlappedTransferCycles,
+                                      std::min(result.transferCycles, result.computeCycles));
+        
+        std::cout << std::fixed << std::setprecision(1);
+        if (json) {
+            std::cout << "{\n"
+                      << "  \"program\": \"" << programFile << "\",\n"
+                      << "  \"dims\": [" << rows << ", " << cols << ", " << common << "],\n"
+                      << "  \"batch\": " << batch << ",\n"
+                      << "  \"instructions\": " << program.size() << ",\n"
+                      << "  \"executed\": " << result.instructions << ",\n"
+                      << "  \"cycles\": " << result.cycles << ",\n"
+                      << "  \"symbolic\": " << (result.symbolic ? "true" : "false") << ",\n"
+                      << "  \"precision\": " << result.precision << ",\n"
+                      << "  \"lanes\": " << result.lanes << ",\n"
+                      << "  \"pe_streams\": " << result.peStreams << ",\n"
+                      << "  \"host_bytes_loaded\": " << result.hostBytesLoaded << ",\n"
+                      << "  \"host_bytes_stored\": " << result.hostBytesStored << ",\n"
+                      << "  \"staging_bytes\": " << result.stagingBytes << ",\n"
+                      << "  \"readback_bytes\": " << result.readbackBytes << ",\n"
+                      << "  \"bank_conflict_cycles\": " << result.bankConflictCycles << ",\n"
+                      << "  \"transfer_cycles\": " << result.transferCycles << ",\n"
+                      << "  \"compute_cycles\": " << result.computeCycles << ",\n"
+                      << "  \"overlapped_cycles\": " << result.overlappedTransferCycles << ",\n"
+                      << "  \"overlap_ratio\": " << overlapRatio << ",\n"
+                      << "  \"pe_utilization\": {";
+            for (size_t i = 0; i < activePEs.size(); i++) {
+                std::cout << (i ? ", " : "") << "\"" << activePEs[i] << "\": "
+                          << percent(result.peBusyCycles[activePEs[i]], result.cycles);
+            }
+            std::cout << "},\n  \"bank_utilization\": {";
+            for (size_t i = 0; i < usedBanks.size(); i++) {
+                std::cout << (i ? ", " : "") << "\"" << usedBanks[i] << "\": "
+                          << percent(result.bankBusyCycles[usedBanks[i]], result.cycles);
+            }
+            std::cout << "},\n"
+                      << "  \"mismatches\": " << mismatches << ",\n"
+                      << "  \"correct\": " << (mismatches == 0 ? "true" : "false") << "\n"
+                      << "}\n";
+        } else {
+            std::cout << "Program: " << programFile << " (" << program.size() << " instructions, "
+                      << result.instructions << " executed" << (result.symbolic ? ", symbolic" : "") << ")\n"
+                      << "Matrix dimensions: " << rows << "x" << common << " * " << common << "x" << cols
+                      << (batch > 1 ? ", batch " + std::to_string(batch) : "") << "\n";
+            if (!epilogue.empty()) {
+                KernelShape shape;
+                shape.epilogue = epilogue;
+                std::cout << "Epilogue: " << shape.describeEpilogue() << "\n";
+            }
+            if (result.lanes > 1) {
+                std::cout << "Precision: " << result.precision << "-bit, " << result.lanes << " lanes per word\n";
+            }
+            if (result.peStreams > 0) {
+                std::cout << "PE streams: " << result.peStreams << "\n";
+            }
+            std::cout << "Cycles: " << result.cycles << "\n"
+                      << "Host traffic: " << result.hostBytesLoaded << " bytes loaded, "
+                      << result.hostBytesStored << " bytes stored";
+            if (result.symbolic) {
+                std::cout << " (" << result.stagingBytes << " bytes staged, "
+                          << result.readbackBytes << " bytes read back)";
+            }
+            std::cout << "\n"
+                      << "Transfer overlap: " << result.overlappedTransferCycles << " cycles of "
+                      << result.transferCycles << " transfer and " << result.computeCycles << " compute, ratio "
+                      << overlapRatio << "%\n"
+                      << "Bank conflict stalls: " << result.bankConflictCycles << " cycles\n"
+                      << "PE utilization: " << activePEs.size() << " of " << result.peBusyCycles.size()
+                      << " PEs active, mean " << peMean << "%, max " << percent(peMax, result.cycles) << "%\n"
+                      << "Bank utilization: " << usedBanks.size() << " of " << result.bankAccesses.size()
+                      << " banks used, mean " << bankMean << "%, max " << percent(bankMax, result.cycles) << "%\n";
+            
+            if (verbose) {
+                for (unsigned pe : activePEs) {
+                    std::cout << "  PE " << pe << ": " << percent(result.peBusyCycles[pe], result.cycles) << "%\n";
+                }
+                for (unsigned bank : usedBanks) {
+                    std::cout << "  Bank " << bank << ": " << result.bankAccesses[bank] << " accesses, "
+                              << percent(result.bankBusyCycles[bank], result.cycles) << "%\n";
+                }
+            }
+            
+            std::cout << "Result check: " << (mismatches == 0 ? "PASS" : "FAIL");
+            if (mismatches != 0) {
+                std::cout << " (" << mismatches << " of " << expected.size() << " elements differ)";
+            }
+            std::cout << std::endl;
+        }
+        
+        return mismatches == 0 ? 0 : 2;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
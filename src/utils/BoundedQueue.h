@@ -0,0 +1,113 @@
+/**
+ * BoundedQueue.h
+ * Fixed-capacity lock-free queue for handing work between threads
+ */
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * Bounded multi-producer, multi-consumer queue without locks
+ * 
+ * Each slot carries a sequence number telling producers and consumers
+ * whose turn it is, so a push or pop claims its slot with one
+ * compare-and-swap on the shared position and never waits for another
+ * thread. push() and pop() fail instead of blocking when the queue is
+ * full or empty.
+ * 
+ * @tparam T Element type, moved in and out of the slots
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    /**
+     * @param capacity Number of slots, rounded up to a power of two
+     */
+    explicit BoundedQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask = size - 1;
+        slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+    
+    /**
+     * Append an element
+     * 
+     * @param value Element, moved from only on success
+     * @return False if the queue is full
+     */
+    bool push(T& value) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[position & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto distance = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (distance == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (distance < 0) {
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+    
+    /**
+     * Remove the oldest element
+     * 
+     * @param value Receives the element on success
+     * @return False if the queue is empty
+     */
+    bool pop(T& value) {
+        size_t position = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[position & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto distance = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (distance == 0) {
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(slot.value);
+                    slot.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (distance < 0) {
+                return false;
+            } else {
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        T value;
+    };
+    
+    // Producers and consumers update different cache lines
+    static constexpr size_t CACHE_LINE = 64;
+    
+    std::unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+    alignas(CACHE_LINE) std::atomic<size_t> tail{0};
+    alignas(CACHE_LINE) std::atomic<size_t> head{0};
+};
+
+#endif // BOUNDED_QUEUE_H
@@ -0,0 +1,82 @@
+/**
+ * HeapCounter.cpp
+ * Replacement global allocation functions feeding TimeProfiler::countHeap()
+ *
+ * Linked into the pim_compiler and pim_bench executables only; the library
+ * must leave the allocator of the applications embedding it alone.
+ */
+
+#include "TimeProfiler.h"
+#include <cstdlib>
+#include <new>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#ifdef __GLIBC__
+
+namespace {
+
+void* countedAllocate(size_t size) {
+    void* pointer = std::malloc(size > 0 ? size : 1);
+    if (pointer) {
+        TimeProfiler::countHeap(static_cast<int64_t>(malloc_usable_size(pointer)));
+    }
+    return pointer;
+}
+
+void countedFree(void* pointer) {
+    if (pointer) {
+        TimeProfiler::countHeap(-static_cast<int64_t>(malloc_usable_size(pointer)));
+    }
+    std::free(pointer);
+}
+
+} // namespace
+
+// The aligned forms keep their default implementation and are not counted
+void* operator new(size_t size) {
+    void* pointer = countedAllocate(size);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+    countedFree(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+    countedFree(pointer);
+}
+
+#endif // __GLIBC__
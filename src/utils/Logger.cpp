@@ -4,89 +4,302 @@
  */
 
 #include "Logger.h"
+#include "BoundedQueue.h"
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <ctime>
 #include <iomanip>
 #include <sstream>
+#include <thread>
+
+namespace {
+
+const char* levelPrefix(LogLevel level) {
+    switch (level) {
+        case LogLevel::DEBUG: return "DEBUG: ";
+        case LogLevel::WARNING: return "WARNING: ";
+        case LogLevel::ERROR: return "ERROR: ";
+        default: return "";
+    }
+}
+
+// Format the current time, reusing the text while the second is unchanged
+const std::string& currentTimestamp() {
+    thread_local std::time_t cachedTime = -1;
+    thread_local std::string cachedText;
+    
+    std::time_t timeT = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    if (timeT != cachedTime) {
+        // localtime is not reentrant
+        std::tm localTime;
+        localtime_r(&timeT, &localTime);
+        std::stringstream timestamp;
+        timestamp << std::put_time(&localTime, "%Y-%m-%d %H:%M:%S");
+        cachedText = timestamp.str();
+        cachedTime = timeT;
+    }
+    return cachedText;
+}
+
+} // namespace
+
+/**
+ * Log file written by a background thread
+ * 
+ * Producers append lines to a lock-free queue and only touch the wake-up
+ * mutex when the writer is asleep. The writer drains the queue, flushes
+ * the file once per batch and sleeps when it finds the queue empty.
+ */
+class AsyncFileSink {
+public:
+    AsyncFileSink() : queue(QUEUE_CAPACITY) {}
+    
+    ~AsyncFileSink() {
+        close();
+    }
+    
+    // Start writing to a file (caller serializes open and close)
+    bool open(const std::string& filename) {
+        close();
+        stream.open(filename, std::ios::out | std::ios::app);
+        if (!stream) {
+            return false;
+        }
+        stopping = false;
+        writer = std::thread(&AsyncFileSink::run, this);
+        return true;
+    }
+    
+    // Write the pending lines and stop the writer
+    void close() {
+        if (writer.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                stopping = true;
+            }
+            wake.notify_one();
+            writer.join();
+            stream.close();
+        }
+    }
+    
+    // Enqueue a line, waiting for the writer while the queue is full
+    void write(std::string line) {
+        while (!queue.push(line)) {
+            notifyWriter();
+            std::this_thread::yield();
+        }
+        enqueued.fetch_add(1);
+        if (sleeping.load()) {
+            notifyWriter();
+        }
+    }
+    
+    // Wait until every line enqueued before the call is in the file
+    void flush() {
+        size_t target = enqueued.load(std::memory_order_acquire);
+        while (writer.joinable() && written.load(std::memory_order_acquire) < target) {
+            notifyWriter();
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    static constexpr size_t QUEUE_CAPACITY = 4096;
+    
+    void notifyWriter() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+        }
+        wake.notify_one();
+    }
+    
+    bool drained() const {
+        return written.load(std::memory_order_acquire) == enqueued.load(std::memory_order_acquire);
+    }
+    
+    void run() {
+        std::string line;
+        for (;;) {
+            size_t batch = 0;
+            while (queue.pop(line)) {
+                stream << line << '\n';
+                batch++;
+            }
+            if (batch > 0) {
+                stream.flush();
+                written.fetch_add(batch, std::memory_order_release);
+                continue;
+            }
+            
+            // Recheck after announcing the sleep: a producer that missed the
+            // flag has already counted its line, so the wait is skipped
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            sleeping.store(true);
+            if (stopping && drained()) {
+                sleeping.store(false, std::memory_order_relaxed);
+                return;
+            }
+            if (drained()) {
+                wake.wait_for(lock, std::chrono::milliseconds(50));
+            }
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+    
+    std::ofstream stream;
+    BoundedQueue<std::string> queue;
+    std::atomic<size_t> enqueued{0};
+    std::atomic<size_t> written{0};
+    std::atomic<bool> sleeping{false};
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread writer;
+};
 
 Logger& Logger::getInstance() {
     static Logger instance;
     return instance;
 }
 
-Logger::Logger() : verbose(false) {}
+Logger::Logger()
+    : verbose(false), level(LogLevel::INFO), fileSink(new AsyncFileSink()),
+      enabledLevel(static_cast<int>(LogLevel::WARNING)), consoleLevel(static_cast<int>(LogLevel::WARNING)),
+      fileOpen(false), historyCapacity(1024), historyNext(0) {}
 
-Logger::~Logger() {
-    if (fileStream.is_open()) {
-        fileStream.close();
-    }
-}
+Logger::~Logger() = default;
 
 void Logger::setVerbose(bool verbose) {
+    std::lock_guard<std::mutex> lock(configMutex);
     this->verbose = verbose;
+    updateEnabledLevel();
+}
+
+void Logger::setLevel(LogLevel level) {
+    std::lock_guard<std::mutex> lock(configMutex);
+    this->level = level;
+    updateEnabledLevel();
 }
 
 void Logger::setOutputFile(const std::string& filename) {
-    if (fileStream.is_open()) {
-        fileStream.close();
-    }
+    std::lock_guard<std::mutex> lock(configMutex);
     
+    // Closing the previous file writes its pending lines
+    fileOpen.store(false);
     outputFile = filename;
-    fileStream.open(filename, std::ios::out | std::ios::app);
-    
-    if (!fileStream) {
+    if (fileSink->open(filename)) {
+        fileOpen.store(true);
+    } else {
         std::cerr << "Warning: Could not open log file: " << filename << std::endl;
     }
+    updateEnabledLevel();
+}
+
+void Logger::setHistoryCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(historyMutex);
+    std::vector<std::string> recent = getHistoryUnlocked();
+    if (recent.size() > capacity) {
+        recent.erase(recent.begin(), recent.end() - static_cast<std::ptrdiff_t>(capacity));
+    }
+    history = std::move(recent);
+    historyCapacity = capacity;
+    historyNext = capacity > 0 ? history.size() % capacity : 0;
+}
+
+void Logger::updateEnabledLevel() {
+    // Warnings and errors reach the console unless the level hides them;
+    // lower levels need verbose mode or a file
+    const int warning = static_cast<int>(LogLevel::WARNING);
+    const int console = verbose ? static_cast<int>(level) : std::max(static_cast<int>(level), warning);
+    consoleLevel.store(console, std::memory_order_relaxed);
+    enabledLevel.store(fileOpen.load() ? std::min(static_cast<int>(level), console) : console,
+                       std::memory_order_relaxed);
+}
+
+void Logger::log(LogLevel level, const std::string& message) {
+    if (isEnabled(level)) {
+        write(level, message);
+    }
 }
 
 void Logger::log(const std::string& message) {
-    // Get current timestamp
-    auto now = std::chrono::system_clock::now();
-    auto timeT = std::chrono::system_clock::to_time_t(now);
-    std::stringstream timestamp;
-    timestamp << std::put_time(std::localtime(&timeT), "%Y-%m-%d %H:%M:%S");
-    
+    log(LogLevel::INFO, message);
+}
+
+void Logger::error(const std::string& message) {
+    log(LogLevel::ERROR, message);
+}
+
+void Logger::write(LogLevel level, const std::string& message) {
     // Format log message
-    std::string formattedMessage = "[" + timestamp.str() + "] " + message;
+    const std::string& timestamp = currentTimestamp();
+    const char* prefix = levelPrefix(level);
+    std::string formattedMessage;
+    formattedMessage.reserve(timestamp.size() + message.size() + 16);
+    formattedMessage.append("[").append(timestamp).append("] ").append(prefix).append(message);
     
-    // Add to history
-    history.push_back(formattedMessage);
+    // Warnings and errors go to stderr, so they never mix with a program written to stdout
+    if (static_cast<int>(level) >= consoleLevel.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(consoleMutex);
+        (level >= LogLevel::WARNING ? std::cerr : std::cout) << formattedMessage << std::endl;
+    }
     
-    // Output if verbose
-    if (verbose) {
-        std::cout << formattedMessage << std::endl;
+    // Hand the line to the file writer without blocking on it
+    if (fileOpen.load(std::memory_order_acquire)) {
+        fileSink->write(formattedMessage);
     }
     
-    // Write to file if open
-    if (fileStream.is_open()) {
-        fileStream << formattedMessage << std::endl;
-        fileStream.flush();
+    // Add to history
+    std::lock_guard<std::mutex> lock(historyMutex);
+    if (historyCapacity == 0) {
+        return;
     }
+    if (history.size() < historyCapacity) {
+        history.push_back(std::move(formattedMessage));
+    } else {
+        history[historyNext] = std::move(formattedMessage);
+    }
+    historyNext = (historyNext + 1) % historyCapacity;
 }
 
-void Logger::error(const std::string& message) {
-    // Get current timestamp
-    auto now = std::chrono::system_clock::now();
-    auto timeT = std::chrono::system_clock::to_time_t(now);
-    std::stringstream timestamp;
-    timestamp << std::put_time(std::localtime(&timeT), "%Y-%m-%d %H:%M:%S");
-    
-    // Format error message
-    std::string formattedMessage = "[" + timestamp.str() + "] ERROR: " + message;
-    
-    // Add to history
-    history.push_back(formattedMessage);
-    
-    // Always output errors
-    std::cerr << formattedMessage << std::endl;
-    
-    // Write to file if open
-    if (fileStream.is_open()) {
-        fileStream << formattedMessage << std::endl;
-        fileStream.flush();
+void Logger::flush() {
+    {
+        std::lock_guard<std::mutex> lock(configMutex);
+        fileSink->flush();
+    }
+    std::lock_guard<std::mutex> lock(consoleMutex);
+    std::cout.flush();
+}
+
+std::vector<std::string> Logger::getHistory() const {
+    std::lock_guard<std::mutex> lock(historyMutex);
+    return getHistoryUnlocked();
+}
+
+std::vector<std::string> Logger::getHistoryUnlocked() const {
+    if (history.size() < historyCapacity) {
+        return history;
     }
+    
+    // Once full, historyNext is the oldest entry
+    std::vector<std::string> ordered(history.begin() + static_cast<std::ptrdiff_t>(historyNext), history.end());
+    ordered.insert(ordered.end(), history.begin(), history.begin() + static_cast<std::ptrdiff_t>(historyNext));
+    return ordered;
 }
 
-const std::vector<std::string>& Logger::getHistory() const {
-    return history;
+bool Logger::parseLevel(const std::string& name, LogLevel& level) {
+    if (name == "debug") {
+        level = LogLevel::DEBUG;
+    } else if (name == "info") {
+        level = LogLevel::INFO;
+    } else if (name == "warning") {
+        level = LogLevel::WARNING;
+    } else if (name == "error") {
+        level = LogLevel::ERROR;
+    } else {
+        return false;
+    }
+    return true;
 }
@@ -10,7 +10,57 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <mutex>
+#include <atomic>
+#include <memory>
 
+/**
+ * Severity of a log message, in increasing order
+ */
+enum class LogLevel {
+    DEBUG = 0,
+    INFO = 1,
+    WARNING = 2,
+    ERROR = 3
+};
+
+// Messages below this level are compiled out of the PIM_LOG macros
+#ifndef PIM_LOG_MIN_LEVEL
+#define PIM_LOG_MIN_LEVEL 0
+#endif
+
+/**
+ * Log a message if its level is enabled
+ * 
+ * The message expression is only evaluated, and no string is built, when
+ * the level is compiled in and some sink accepts it.
+ */
+#define PIM_LOG(level, ...)                                                       \
+    do {                                                                          \
+        if (static_cast<int>(level) >= PIM_LOG_MIN_LEVEL &&                       \
+            Logger::getInstance().isEnabled(level)) {                             \
+            Logger::getInstance().log(level, __VA_ARGS__);                        \
+        }                                                                         \
+    } while (0)
+
+#define PIM_LOG_DEBUG(...) PIM_LOG(LogLevel::DEBUG, __VA_ARGS__)
+#define PIM_LOG_INFO(...) PIM_LOG(LogLevel::INFO, __VA_ARGS__)
+#define PIM_LOG_WARNING(...) PIM_LOG(LogLevel::WARNING, __VA_ARGS__)
+#define PIM_LOG_ERROR(...) PIM_LOG(LogLevel::ERROR, __VA_ARGS__)
+
+class AsyncFileSink;
+
+/**
+ * Process-wide logger
+ * 
+ * All members may be called concurrently; each message is written as one
+ * line. Messages go to the console (warnings and errors always, other
+ * levels when verbose) and to the log file, which a background thread
+ * writes so that compiler threads only enqueue the line. Messages below
+ * the level, or that no sink would show, are dropped before they are
+ * formatted. The history keeps the most recent messages that reached a
+ * sink.
+ */
 class Logger {
 public:
     // Singleton access
@@ -22,30 +72,86 @@ public:
     Logger& operator=(const Logger&) = delete;
     Logger& operator=(Logger&&) = delete;
     
-    // Set verbose mode
+    // Set verbose mode (console output of messages below WARNING)
     void setVerbose(bool verbose);
     
-    // Set output file
+    // Set the lowest level written to any sink (default INFO)
+    void setLevel(LogLevel level);
+    
+    // Set output file, written asynchronously
     void setOutputFile(const std::string& filename);
     
-    // Log a message
+    // Set the number of messages kept in the history (default 1024)
+    void setHistoryCapacity(size_t capacity);
+    
+    /**
+     * Check whether a message of the given level would reach a sink
+     * 
+     * @param level Message level
+     * @return False if the message would be dropped
+     */
+    bool isEnabled(LogLevel level) const {
+        return static_cast<int>(level) >= enabledLevel.load(std::memory_order_relaxed);
+    }
+    
+    // Log a message with the given level
+    void log(LogLevel level, const std::string& message);
+    
+    // Log an informational message
     void log(const std::string& message);
     
     // Log an error
     void error(const std::string& message);
     
-    // Retrieve log history
-    const std::vector<std::string>& getHistory() const;
+    // Wait until the log file contains every message logged so far
+    void flush();
+    
+    // Retrieve a snapshot of the log history, oldest first
+    std::vector<std::string> getHistory() const;
+    
+    /**
+     * Parse a level name
+     * 
+     * @param name "debug", "info", "warning" or "error"
+     * @param level Receives the level
+     * @return False if the name is unknown
+     */
+    static bool parseLevel(const std::string& name, LogLevel& level);
 
 private:
     // Private constructor for singleton
     Logger();
     ~Logger();
     
+    // Format a message and write it to the history, the console and the log file
+    void write(LogLevel level, const std::string& message);
+    
+    // Recompute the lowest levels the sinks accept (caller holds configMutex)
+    void updateEnabledLevel();
+    
+    // Copy the history in order (caller holds historyMutex)
+    std::vector<std::string> getHistoryUnlocked() const;
+    
+    // Sink configuration
+    mutable std::mutex configMutex;
     bool verbose;
-    std::vector<std::string> history;
+    LogLevel level;
     std::string outputFile;
-    std::ofstream fileStream;
+    std::unique_ptr<AsyncFileSink> fileSink;
+    
+    // Read without locks on every message
+    std::atomic<int> enabledLevel;          // Lowest level any sink accepts
+    std::atomic<int> consoleLevel;          // Lowest level written to the console
+    std::atomic<bool> fileOpen;
+    
+    // Console lines of concurrent messages are not interleaved
+    std::mutex consoleMutex;
+    
+    // Ring buffer of the most recent messages
+    mutable std::mutex historyMutex;
+    std::vector<std::string> history;
+    size_t historyCapacity;
+    size_t historyNext;
 };
 
 #endif // LOGGER_H
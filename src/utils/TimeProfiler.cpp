@@ -0,0 +1,266 @@
+/**
+ * TimeProfiler.cpp
+ * Implementation of the stage timers and heap counters
+ */
+
+#include "TimeProfiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Heap usage is only counted while the profiler is enabled
+std::atomic<bool> countAllocations{false};
+
+// Heap bytes allocated minus freed by every thread, and the maximum this
+// thread saw since its innermost timer started
+std::atomic<int64_t> liveBytes{0};
+thread_local int64_t peakBytes = 0;
+
+// Stage path and nesting depth of the timers open on this thread
+thread_local std::string currentPath;
+thread_local unsigned currentDepth = 0;
+
+unsigned currentThreadIndex() {
+    static std::atomic<unsigned> nextIndex{0};
+    thread_local unsigned index = nextIndex++;
+    return index;
+}
+
+std::string formatBytes(int64_t bytes) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(1);
+    if (bytes < 1024) {
+        text << bytes << " B";
+    } else if (bytes < 1024 * 1024) {
+        text << bytes / 1024.0 << " KiB";
+    } else {
+        text << bytes / (1024.0 * 1024.0) << " MiB";
+    }
+    return text.str();
+}
+
+// Last component of a stage path
+std::string stageName(const std::string& path) {
+    size_t separator = path.rfind('/');
+    return separator == std::string::npos ? path : path.substr(separator + 1);
+}
+
+std::string escapeJson(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        switch (c) {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char code[8];
+                    std::snprintf(code, sizeof(code), "\\u%04x", c);
+                    escaped += code;
+                } else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+} // namespace
+
+TimeProfiler& TimeProfiler::getInstance() {
+    static TimeProfiler instance;
+    return instance;
+}
+
+void TimeProfiler::enable() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (enabled.load()) {
+        return;
+    }
+    startTime = Clock::now();
+    countAllocations.store(true);
+    enabled.store(true);
+}
+
+void TimeProfiler::countHeap(int64_t bytes) {
+    if (!countAllocations.load(std::memory_order_relaxed)) {
+        return;
+    }
+    int64_t live = liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    if (bytes > 0) {
+        peakBytes = std::max(peakBytes, live);
+    }
+}
+
+void TimeProfiler::addSection(const std::string& text) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sections.push_back(text);
+}
+
+void TimeProfiler::record(Event event) {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back(std::move(event));
+}
+
+int64_t TimeProfiler::microseconds(Clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - startTime).count();
+}
+
+void TimeProfiler::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    events.clear();
+    sections.clear();
+}
+
+std::vector<TimeProfiler::StageTotal> TimeProfiler::getStageTotals() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    // Intervals finish innermost first; in start order every stage follows its parent
+    std::vector<const Event*> ordered;
+    for (const auto& event : events) {
+        ordered.push_back(&event);
+    }
+    std::stable_sort(ordered.begin(), ordered.end(),
+                     [](const Event* a, const Event* b) { return a->start < b->start; });
+    
+    std::vector<StageTotal> stages;
+    std::vector<std::vector<size_t>> children;
+    std::vector<size_t> roots;
+    std::map<std::string, size_t> stageOfPath;
+    for (const Event* event : ordered) {
+        auto found = stageOfPath.find(event->path);
+        if (found == stageOfPath.end()) {
+            size_t index = stages.size();
+            stages.push_back({event->path, event->depth, 0, 0, 0});
+            children.emplace_back();
+            found = stageOfPath.emplace(event->path, index).first;
+            
+            size_t separator = event->path.rfind('/');
+            auto parent = separator == std::string::npos ? stageOfPath.end()
+                                                         : stageOfPath.find(event->path.substr(0, separator));
+            if (parent != stageOfPath.end()) {
+                children[parent->second].push_back(index);
+            } else {
+                roots.push_back(index);
+            }
+        }
+        StageTotal& stage = stages[found->second];
+        stage.calls++;
+        stage.microseconds += event->duration;
+        stage.peakBytes = std::max(stage.peakBytes, event->peakBytes);
+    }
+    
+    // Stages in tree order, children under their parent
+    std::vector<StageTotal> tree;
+    std::vector<size_t> pending(roots.rbegin(), roots.rend());
+    while (!pending.empty()) {
+        size_t index = pending.back();
+        pending.pop_back();
+        tree.push_back(stages[index]);
+        pending.insert(pending.end(), children[index].rbegin(), children[index].rend());
+    }
+    return tree;
+}
+
+void TimeProfiler::printReport(std::ostream& out) const {
+    std::vector<StageTotal> stages = getStageTotals();
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    const int64_t total = std::max<int64_t>(microseconds(Clock::now()), 1);
+    out << "===" << std::string(73, '-') << "===\n"
+        << "                          PIM compiler time report\n"
+        << "===" << std::string(73, '-') << "===\n"
+        << "  Total profiled wall time: " << std::fixed << std::setprecision(3) << total / 1000.0 << " ms\n\n"
+        << "   Wall (ms)       %    Calls    Peak heap  Stage\n";
+    
+    for (const auto& stage : stages) {
+        out << std::setw(12) << std::setprecision(3) << stage.microseconds / 1000.0 << "  "
+            << std::setw(6) << std::setprecision(1) << 100.0 * stage.microseconds / total << "  "
+            << std::setw(7) << stage.calls << "  "
+            << std::setw(11) << formatBytes(stage.peakBytes) << "  "
+            << std::string(2 * stage.depth, ' ') << stageName(stage.path) << "\n";
+    }
+    
+    for (const auto& section : sections) {
+        out << "\n" << section;
+    }
+    out.flush();
+}
+
+void TimeProfiler::writeTrace(const std::string& filename) const {
+    std::ofstream trace(filename);
+    if (!trace) {
+        throw std::runtime_error("Could not open trace file: " + filename);
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    trace << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+          << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"pim_compiler\"}}";
+    for (const auto& event : events) {
+        trace << ",\n{\"name\":\"" << escapeJson(stageName(event.path)) << "\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1"
+              << ",\"tid\":" << event.thread << ",\"ts\":" << event.start << ",\"dur\":" << event.duration
+              << ",\"args\":{\"path\":\"" << escapeJson(event.path) << "\"";
+        if (!event.detail.empty()) {
+            trace << ",\"detail\":\"" << escapeJson(event.detail) << "\"";
+        }
+        trace << ",\"peak_heap_bytes\":" << event.peakBytes << "}}";
+    }
+    trace << "\n]}\n";
+    
+    trace.close();
+    if (!trace) {
+        throw std::runtime_error("Could not write trace file: " + filename);
+    }
+}
+
+ScopedTimer::ScopedTimer(const char* name) : active(TimeProfiler::getInstance().isEnabled()) {
+    if (!active) {
+        return;
+    }
+    
+    pathLength = currentPath.size();
+    if (!currentPath.empty()) {
+        currentPath += '/';
+    }
+    currentPath += name;
+    currentDepth++;
+    
+    // The stage's peak is measured from the heap usage it starts with
+    startBytes = liveBytes.load(std::memory_order_relaxed);
+    outerPeak = peakBytes;
+    peakBytes = startBytes;
+    start = TimeProfiler::Clock::now();
+}
+
+ScopedTimer::ScopedTimer(const char* name, const std::string& detail) : ScopedTimer(name) {
+    if (active) {
+        this->detail = detail;
+    }
+}
+
+ScopedTimer::~ScopedTimer() {
+    if (!active) {
+        return;
+    }
+    
+    TimeProfiler& profiler = TimeProfiler::getInstance();
+    TimeProfiler::Event event;
+    event.start = profiler.microseconds(start);
+    event.duration = profiler.microseconds(TimeProfiler::Clock::now()) - event.start;
+    event.path = currentPath;
+    event.detail = std::move(detail);
+    event.thread = currentThreadIndex();
+    event.depth = --currentDepth;
+    event.peakBytes = peakBytes - startBytes;
+    
+    currentPath.resize(pathLength);
+    peakBytes = std::max(outerPeak, peakBytes);
+    profiler.record(std::move(event));
+}
@@ -0,0 +1,165 @@
+/**
+ * TimeProfiler.h
+ * Wall time and heap instrumentation of the compilation stages
+ */
+
+#ifndef TIME_PROFILER_H
+#define TIME_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * Process-wide collector of ScopedTimer intervals
+ * 
+ * Disabled until enable() is called; disabled timers cost one atomic load.
+ * While enabled, every interval records its thread, its nesting under the
+ * enclosing timers of that thread and the peak heap usage it reached above
+ * its starting point. Heap usage is counted process-wide by countHeap(),
+ * which the replacement operator new and delete of HeapCounter.cpp call;
+ * only the pim_compiler and pim_bench executables link them (glibc only),
+ * so the library never replaces the allocator of its host and reports 0
+ * there. LLVM's allocations are included. All members may be called
+ * concurrently.
+ */
+class TimeProfiler {
+public:
+    // Singleton access
+    static TimeProfiler& getInstance();
+    
+    TimeProfiler(const TimeProfiler&) = delete;
+    TimeProfiler& operator=(const TimeProfiler&) = delete;
+    
+    /**
+     * Start collecting intervals and counting heap allocations
+     */
+    void enable();
+    
+    /**
+     * Check whether intervals are being collected
+     */
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+    
+    /**
+     * Count heap memory allocated (bytes > 0) or freed (bytes < 0) by any
+     * thread; ignored until enable() is called
+     * 
+     * @param bytes Usable size of the block
+     */
+    static void countHeap(int64_t bytes);
+    
+    /**
+     * Intervals of one stage path, summed over its calls
+     */
+    struct StageTotal {
+        std::string path;           // Stage names from the outermost timer, separated by '/'
+        unsigned depth = 0;
+        size_t calls = 0;
+        int64_t microseconds = 0;
+        int64_t peakBytes = 0;      // Largest peak of a single call
+    };
+    
+    /**
+     * Discard the intervals and report sections collected so far
+     */
+    void clear();
+    
+    /**
+     * Aggregate the intervals by stage path
+     * 
+     * @return Stages in order of first appearance, each followed by the
+     *         stages nested in it
+     */
+    std::vector<StageTotal> getStageTotals() const;
+    
+    /**
+     * Add a report section produced elsewhere, such as LLVM's pass timing
+     * 
+     * @param text Section text, printed after the stage table
+     */
+    void addSection(const std::string& text);
+    
+    /**
+     * Print the stage table of getStageTotals(): call counts, wall time,
+     * share of the profiled time and peak heap usage per stage
+     * 
+     * @param out Destination stream
+     */
+    void printReport(std::ostream& out) const;
+    
+    /**
+     * Write every interval as a complete event of the Chrome trace event
+     * format (chrome://tracing, Perfetto)
+     * 
+     * @param filename Destination JSON file
+     * @throws std::runtime_error if the file cannot be written
+     */
+    void writeTrace(const std::string& filename) const;
+
+private:
+    friend class ScopedTimer;
+    
+    using Clock = std::chrono::steady_clock;
+    
+    // One finished interval
+    struct Event {
+        std::string path;           // Stage names from the outermost timer, separated by '/'
+        std::string detail;         // File or function the stage worked on
+        unsigned thread = 0;
+        unsigned depth = 0;
+        int64_t start = 0;          // Microseconds since enable()
+        int64_t duration = 0;
+        int64_t peakBytes = 0;
+    };
+    
+    TimeProfiler() = default;
+    
+    void record(Event event);
+    int64_t microseconds(Clock::time_point time) const;
+    
+    std::atomic<bool> enabled{false};
+    Clock::time_point startTime;
+    mutable std::mutex mutex;
+    std::vector<Event> events;
+    std::vector<std::string> sections;
+};
+
+/**
+ * Times the enclosing scope as one stage of the TimeProfiler
+ * 
+ * Does nothing while the profiler is disabled. Timers of a thread must be
+ * destroyed in reverse order of construction.
+ */
+class ScopedTimer {
+public:
+    /**
+     * @param name Stage name
+     */
+    explicit ScopedTimer(const char* name);
+    
+    /**
+     * @param name Stage name
+     * @param detail File or function the stage works on, shown in the trace
+     */
+    ScopedTimer(const char* name, const std::string& detail);
+    
+    ~ScopedTimer();
+    
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    bool active;
+    std::string detail;
+    TimeProfiler::Clock::time_point start;
+    int64_t startBytes = 0;
+    int64_t outerPeak = 0;
+    size_t pathLength = 0;
+};
+
+#endif // TIME_PROFILER_H
@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+"""
+Kernels and compiler/simulator scaffolding shared by the test scripts
+"""
+
+import os
+import json
+import subprocess
+import tempfile
+import unittest
+
+BUILD_DIR = os.path.join("..", "build")
+
+# The matrix multiplication of the C++ front end, sized by --dims
+CPP_KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    for (int i = 0; i < rows; i++)
+        for (int j = 0; j < cols; j++)
+            for (int k = 0; k < common; k++)
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+}
+"""
+
+# rows x common * common x cols product over the arrays named a, b and c. An
+# accumulating nest adds every product into C[i][j]; otherwise the k loop sums
+# into a register stored once. i.latch leaves to the label then, and the
+# function is only closed when that is the exit block
+GEMM_FUNCTION = """
+define void @{name}() {{
+entry:
+  br label %i.loop
+i.loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %i.latch ]
+  br label %j.loop
+j.loop:
+  %j = phi i64 [ 0, %i.loop ], [ %j.next, %j.latch ]
+  br label %k.loop
+k.loop:
+  %k = phi i64 [ 0, %j.loop ], [ %k.next, %k.loop ]
+{k_body}
+  %k.next = add i64 %k, 1
+  %k.done = icmp eq i64 %k.next, {common}
+  br i1 %k.done, label %j.latch, label %k.loop
+j.latch:
+{j_latch}  %j.next = add i64 %j, 1
+  %j.done = icmp eq i64 %j.next, {cols}
+  br i1 %j.done, label %i.latch, label %j.loop
+i.latch:
+  %i.next = add i64 %i, 1
+  %i.done = icmp eq i64 %i.next, {rows}
+  br i1 %i.done, label %{then}, label %i.loop
+"""
+
+SUM_BODY = """  %sum = phi i32 [ 0, %j.loop ], [ %sum.next, %k.loop ]
+  %a.ptr = getelementptr {a_type}, {a_type}* @{a}, i64 0, {a_index}
+  %b.ptr = getelementptr {b_type}, {b_type}* @{b}, i64 0, {b_index}
+  %a = load i32, i32* %a.ptr
+  %b = load i32, i32* %b.ptr
+  %p = mul i32 %a, %b
+  %sum.next = add i32 %sum, %p"""
+
+SUM_STORE = """  %c.ptr = getelementptr {c_type}, {c_type}* @{c}, i64 0, i64 %i, i64 %j
+  store i32 %sum.next, i32* %c.ptr"""
+
+ACCUMULATE_BODY = """  %a.ptr = getelementptr {a_type}, {a_type}* @{a}, i64 0, {a_index}
+  %b.ptr = getelementptr {b_type}, {b_type}* @{b}, i64 0, {b_index}
+  %c.ptr = getelementptr {c_type}, {c_type}* @{c}, i64 0, i64 %i, i64 %j
+  %a = load i32, i32* %a.ptr
+  %b = load i32, i32* %b.ptr
+  %c = load i32, i32* %c.ptr
+  %p = mul i32 %a, %b
+  %s = add i32 %c, %p
+  store i32 %s, i32* %c.ptr"""
+
+# rows x common matrix times a vector of common elements into y
+GEMV_FUNCTION = """
+define void @{name}() {{
+entry:
+  br label %i.loop
+i.loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %i.latch ]
+  br label %k.loop
+k.loop:
+  %k = phi i64 [ 0, %i.loop ], [ %k.next, %k.loop ]
+  %a.ptr = getelementptr [{rows} x [{common} x i32]], [{rows} x [{common} x i32]]* @A, i64 0, i64 %i, i64 %k
+  %x.ptr = getelementptr [{common} x i32], [{common} x i32]* @x, i64 0, i64 %k
+  %y.ptr = getelementptr [{rows} x i32], [{rows} x i32]* @y, i64 0, i64 %i
+  %a = load i32, i32* %a.ptr
+  %xv = load i32, i32* %x.ptr
+  %y = load i32, i32* %y.ptr
+  %p = mul i32 %a, %xv
+  %s = add i32 %y, %p
+  store i32 %s, i32* %y.ptr
+  %k.next = add i64 %k, 1
+  %k.done = icmp eq i64 %k.next, {common}
+  br i1 %k.done, label %i.latch, label %k.loop
+i.latch:
+  %i.next = add i64 %i, 1
+  %i.done = icmp eq i64 %i.next, {rows}
+  br i1 %i.done, label %{then}, label %i.loop
+"""
+
+def matrix_type(rows, cols):
+    return f"[{rows} x [{cols} x i32]]"
+
+def ir_array(values):
+    return "[" + ", ".join("i32 " + str(v) for v in values) + "]"
+
+def ir_matrix(matrix):
+    width = len(matrix[0])
+    return "[" + ", ".join(f"[{width} x i32] " + ir_array(row) for row in matrix) + "]"
+
+def global_matrix(name, rows, cols, linkage="global", values=None):
+    """Definition of a rows x cols array, zero unless values holds its rows"""
+    initializer = ir_matrix(values) if values is not None else "zeroinitializer"
+    return f"@{name} = {linkage} {matrix_type(rows, cols)} {initializer}\n"
+
+def gemm_function(rows, cols, common, name="gemm", a="A", b="B", c="C", transpose_a=False, transpose_b=False,
+                  a_cols=None, accumulate=False, then="exit"):
+    """
+    Triple nest of C = A * B on existing globals. A and B are indexed in
+    their stored order when transposed; a_cols pads the rows of A
+    """
+    if transpose_a:
+        a_type, a_index = matrix_type(common, a_cols or rows), "i64 %k, i64 %i"
+    else:
+        a_type, a_index = matrix_type(rows, a_cols or common), "i64 %i, i64 %k"
+    if transpose_b:
+        b_type, b_index = matrix_type(cols, common), "i64 %j, i64 %k"
+    else:
+        b_type, b_index = matrix_type(common, cols), "i64 %k, i64 %j"
+    operands = dict(a=a, b=b, c=c, a_type=a_type, a_index=a_index, b_type=b_type, b_index=b_index,
+                    c_type=matrix_type(rows, cols))
+    body = (ACCUMULATE_BODY if accumulate else SUM_BODY).format(**operands)
+    latch = "" if accumulate else SUM_STORE.format(**operands) + "\n"
+    source = GEMM_FUNCTION.format(name=name, rows=rows, cols=cols, common=common, k_body=body, j_latch=latch,
+                                  then=then)
+    return source + ("exit:\n  ret void\n}\n" if then == "exit" else "")
+
+def gemm_ir(rows, cols, common, name="gemm", a="A", b="B", c="C", a_values=None, b_values=None,
+            constant_b=False, transpose_a=False, transpose_b=False, a_cols=None, accumulate=False):
+    """
+    Module defining A, B and C and the kernel C = A * B. a_values and
+    b_values hold the rows of A and B as stored; a constant B is a weight
+    matrix known at compile time
+    """
+    a_shape = (common, rows) if transpose_a else (rows, a_cols or common)
+    b_shape = (cols, common) if transpose_b else (common, cols)
+    return (global_matrix(a, *a_shape, values=a_values) +
+            global_matrix(b, *b_shape, linkage="constant" if constant_b else "global", values=b_values) +
+            global_matrix(c, rows, cols) +
+            gemm_function(rows, cols, common, name, a, b, c, transpose_a, transpose_b, a_cols, accumulate))
+
+def gemv_function(rows, common, name="gemv", then="exit"):
+    """Double nest of y = A * x on the globals A, x and y"""
+    source = GEMV_FUNCTION.format(name=name, rows=rows, common=common, then=then)
+    return source + ("exit:\n  ret void\n}\n" if then == "exit" else "")
+
+def gemv_ir(rows, common, name="gemv", x_values=None):
+    """Module defining A, x and y and the kernel y = A * x, with x constant if its values are given"""
+    x = (f"@x = constant [{common} x i32] " + ir_array(x_values) if x_values is not None
+         else f"@x = global [{common} x i32] zeroinitializer")
+    return (global_matrix("A", rows, common) + x + "\n" + f"@y = global [{rows} x i32] zeroinitializer\n" +
+            gemv_function(rows, common, name))
+
+class PIMTestCase(unittest.TestCase):
+    """Test case running the built tools on files in a temporary directory"""
+    
+    # Executables of the build directory the test needs
+    TOOLS = ("pim_compiler", "pim_sim")
+    
+    def setUp(self):
+        # Paths to the executables
+        self.compiler_path = os.path.join(BUILD_DIR, "pim_compiler")
+        self.simulator_path = os.path.join(BUILD_DIR, "pim_sim")
+        self.embed_path = os.path.join(BUILD_DIR, "pim_embed")
+        
+        # Check if the executables exist
+        missing = [tool for tool in self.TOOLS if not os.path.exists(os.path.join(BUILD_DIR, tool))]
+        if missing:
+            self.skipTest(" and ".join(missing) + " not found. Build the project first.")
+        
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def path(self, name):
+        return os.path.join(self.temp_dir.name, name)
+    
+    def write(self, name, text):
+        """Write a file of the temporary directory, returning its path"""
+        path = self.path(name)
+        with open(path, "w") as f:
+            f.write(text)
+        return path
+    
+    def read(self, path):
+        with open(path, "r") as f:
+            return f.read()
+    
+    def read_bytes(self, path):
+        with open(path, "rb") as f:
+            return f.read()
+    
+    def run_compiler(self, *args, env=None):
+        return subprocess.run([self.compiler_path, *args], capture_output=True, text=True, env=env)
+    
+    def try_compile(self, name, source, *options, suffix=".ll"):
+        """
+        Compile source as <name><suffix> with verbose output and without the
+        cache, returning the process result and the program path
+        """
+        source_file = self.write(name + suffix, source)
+        program = self.path(name + ".pim")
+        return self.run_compiler("-v", "--no-cache", *options, "-o", program, source_file), program
+    
+    def compile(self, name, source, *options, suffix=".ll"):
+        """Compile source, checking that it succeeds, and return the program path and the log"""
+        result, program = self.try_compile(name, source, *options, suffix=suffix)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        return program, result.stdout + result.stderr
+    
+    def run_simulator(self, program, *options):
+        return subprocess.run([self.simulator_path, *options, program], capture_output=True, text=True)
+    
+    def simulate(self, program, *options, matrix_b=None):
+        """
+        Simulate a program, checking its result, and return the JSON report;
+        matrix_b holds the rows of a B to simulate with instead of generated values
+        """
+        if matrix_b is not None:
+            matrix_file = program + ".b"
+            with open(matrix_file, "w") as f:
+                f.write("\n".join(" ".join(str(v) for v in row) for row in matrix_b) + "\n")
+            options += ("--matrix-b", matrix_file)
+        result = self.run_simulator(program, "--json", *options)
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        report = json.loads(result.stdout)
+        self.assertTrue(report["correct"])
+        return report
+    
+    def compile_and_simulate(self, name, source, dims, *options):
+        """Compile source and simulate it at dims, returning the program path, the log and the report"""
+        program, log = self.compile(name, source, *options)
+        return program, log, self.simulate(program, "--dims", dims)
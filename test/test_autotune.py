@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""
+Test script for tile orders and the autotuning of code generation parameters
+"""
+
+import os
+import sys
+import json
+import subprocess
+import tempfile
+import unittest
+
+KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            C[i * cols + j] = 0;
+            for (int k = 0; k < common; k++) {
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+            }
+        }
+    }
+}
+"""
+
+class AutotuneTest(unittest.TestCase):
+
+    def setUp(self):
+        # Paths to the compiler and simulator executables
+        self.compiler_path = os.path.join("..", "build", "pim_compiler")
+        self.simulator_path = os.path.join("..", "build", "pim_sim")
+        
+        # Check if both executables exist
+        if not os.path.exists(self.compiler_path) or not os.path.exists(self.simulator_path):
+            self.skipTest("Compiler or simulator executable not found. Build the project first.")
+        
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.source_file = os.path.join(self.temp_dir.name, "kernel.cpp")
+        with open(self.source_file, "w") as f:
+            f.write(KERNEL)
+        self.database = os.path.join(self.temp_dir.name, "tuning.json")
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def run_compiler(self, dims, *options, env=None):
+        output_file = os.path.join(self.temp_dir.name, "kernel.pim")
+        stats_file = os.path.join(self.temp_dir.name, "stats.json")
+        result = subprocess.run(
+            [self.compiler_path, "-v", "--dims", dims, "--stats", stats_file, *options,
+             "-o", output_file, self.source_file],
+            capture_output=True,
+            text=True,
+            env=env
+        )
+        return output_file, stats_file, result
+    
+    def compile(self, dims, *options, env=None):
+        """Compile the kernel, returning the program path, its text, the log and the statistics"""
+        output_file, stats_file, result = self.run_compiler(dims, *options, env=env)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(output_file, "r") as f:
+            code = f.read()
+        with open(stats_file, "r") as f:
+            return output_file, code, result.stdout, json.load(f)
+    
+    def simulate(self, program, dims):
+        """Simulate a program, checking its result, and return the JSON report"""
+        result = subprocess.run(
+            [self.simulator_path, "--json", "--dims", dims, program],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        report = json.loads(result.stdout)
+        self.assertTrue(report["correct"])
+        return report
+    
+    def load_database(self):
+        with open(self.database, "r") as f:
+            return json.load(f)["entries"]
+    
+    def test_tile_orders(self):
+        """Test that every tile order computes C and that ikj/jki load their stationary slices once"""
+        for dims, tile, options in [("24x20x37", "4x4x8", []), ("33x17x50", "3x5x7", []),
+                                    ("24x20x37", "8x2x5", ["--isa", "v2"]),
+                                    ("16x16x16", "4x4x4", ["--no-double-buffer"])]:
+            loaded = {}
+            for order in ["ijk", "ikj", "jki"]:
+                with self.subTest(dims=dims, tile=tile, options=options, order=order):
+                    program, _, log, _ = self.compile(dims, "--tile", tile, "--tile-order", order, *options)
+                    loaded[order] = self.simulate(program, dims)["host_bytes_loaded"]
+                    if order != "ijk":
+                        self.assertIn("Tile order " + order + " loaded", log)
+            self.assertLess(loaded["ikj"], loaded["ijk"])
+            self.assertLess(loaded["jki"], loaded["ijk"])
+    
+    def test_default_order_fallback(self):
+        """Test that a tile depth leaving no room for the partial sums falls back to ijk"""
+        _, code, log, _ = self.compile("16x64x300", "--tile", "1x1x60", "--tile-order", "ikj")
+        self.assertIn("using the ijk tile order", log)
+        _, reference, _, _ = self.compile("16x64x300", "--tile", "1x1x60")
+        self.assertEqual(code, reference)
+    
+    def test_autotune_improves_estimate(self):
+        """Test that the tuned program is estimated no slower than the default and stays correct"""
+        for dims in ["16x16x16", "64x64x64", "100x37x129"]:
+            with self.subTest(dims=dims):
+                _, _, _, default = self.compile(dims)
+                program, _, log, tuned = self.compile(dims, "--autotune", "--tuning-db", self.database)
+                self.assertIn("Tuned " + dims + "x1", log)
+                self.assertLessEqual(tuned["cycles"]["estimated"], default["cycles"]["estimated"])
+                self.assertLessEqual(tuned["cycles"]["estimated"], self.simulate(program, dims)["cycles"])
+        
+        # Larger kernels gain from slice reuse across the tile grid
+        self.assertLess(tuned["cycles"]["estimated"], 0.8 * default["cycles"]["estimated"])
+    
+    def test_database_reuse(self):
+        """Test that tuning results are stored by shape and architecture and reused without searching"""
+        _, first, log, stats = self.compile("48x40x60", "--autotune", "--tuning-db", self.database)
+        self.assertIn("Tuned 48x40x60x1", log)
+        entries = self.load_database()
+        self.assertEqual(len(entries), 1)
+        entry = list(entries.values())[0]
+        self.assertEqual(entry["estimated_cycles"], stats["cycles"]["estimated"])
+        self.assertGreater(entry["candidates"], 1)
+        
+        # The same shape is looked up, with the same program as result
+        _, second, log, _ = self.compile("48x40x60", "--autotune", "--tuning-db", self.database)
+        self.assertIn("Using stored tuning for 48x40x60x1", log)
+        self.assertNotIn("Tuned ", log)
+        self.assertEqual(first, second)
+        
+        # Another ISA version is tuned separately, and the environment names the database
+        env = dict(os.environ, PIM_TUNING_DB=self.database)
+        _, _, log, _ = self.compile("48x40x60", "--autotune", "--isa", "v1", env=env)
+        self.assertIn("Tuned 48x40x60x1", log)
+        self.assertEqual(len(self.load_database()), 2)
+        _, _, log, _ = self.compile("48x40x60", "--autotune", "--isa", "v1", env=env)
+        self.assertIn("Using stored tuning", log)
+    
+    def test_unreadable_database(self):
+        """Test that a corrupt database is replaced instead of failing the compile"""
+        with open(self.database, "w") as f:
+            f.write("{ not json")
+        program, _, log, _ = self.compile("16x16x16", "--autotune", "--tuning-db", self.database)
+        self.assertIn("Tuned 16x16x16x1", log)
+        self.simulate(program, "16x16x16")
+        self.assertEqual(len(self.load_database()), 1)
+    
+    def test_invalid_usage(self):
+        """Test that options fixing the tuned parameters are rejected with --autotune"""
+        for options in [("--tile", "4x4x4"), ("--tile-order", "ikj"), ("--pe-schedule", "2d"),
+                        ("--no-tiling",), ("--symbolic",)]:
+            with self.subTest(options=options):
+                _, _, result = self.run_compiler("16x16x16", "--autotune", *options)
+                self.assertEqual(result.returncode, 1)
+                self.assertIn("--autotune", result.stderr)
+        _, _, result = self.run_compiler("16x16x16", "--tile-order", "kij")
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("Unknown tile order", result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+"""
+Test script for batch compilation of many inputs in one compiler process
+"""
+
+import os
+import re
+import unittest
+
+from pim_test_util import CPP_KERNEL, PIMTestCase, gemm_ir
+
+SHAPES = [(2, 3, 4), (4, 4, 4), (3, 5, 2), (6, 2, 3), (5, 3, 4), (1, 7, 3)]
+
+class BatchCompilationTest(PIMTestCase):
+    
+    TOOLS = ("pim_compiler",)
+    
+    def setUp(self):
+        super().setUp()
+        
+        # One IR input per shape plus a C++ input
+        self.inputs = [self.write(f"kernel{n}.ll", gemm_ir(m, p, k, name="matmul", accumulate=True))
+                       for n, (m, k, p) in enumerate(SHAPES)]
+        self.inputs.append(self.write("kernel.cpp", CPP_KERNEL))
+    
+    def compile_single(self, input_file, *options):
+        """Compile one input on its own, returning the output bytes"""
+        output_file = self.path("single.out")
+        result = self.run_compiler(*options, "-o", output_file, input_file)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        return self.read_bytes(output_file)
+    
+    def write_manifest(self, lines):
+        return self.write("batch.txt", "\n".join(lines) + "\n")
+    
+    def test_manifest_matches_single_compilations(self):
+        """Test that a concurrent batch writes what separate invocations write"""
+        outputs = [self.path(f"out{n}.txt") for n in range(len(self.inputs))]
+        lines = ["# kernels of the nightly build", ""]
+        lines += [f"{source} {output}" for source, output in zip(self.inputs, outputs)]
+        manifest = self.write_manifest(lines)
+        
+        result = self.run_compiler("--no-tiling", "-j", "4", "--batch", manifest)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertIn(f"Compiled {len(self.inputs)} of {len(self.inputs)} files", result.stdout)
+        
+        # Results are reported in manifest order
+        reported = re.findall(r"^Compiled (\S+) to (\S+)$", result.stdout, re.MULTILINE)
+        self.assertEqual(reported, list(zip(self.inputs, outputs)))
+        
+        for source, output in zip(self.inputs, outputs):
+            with self.subTest(source=os.path.basename(source)):
+                self.assertEqual(self.read_bytes(output), self.compile_single(source, "--no-tiling"))
+    
+    def test_input_list_with_output_dir(self):
+        """Test positional inputs with default binary output names"""
+        output_dir = self.path("out")
+        os.mkdir(output_dir)
+        
+        # Binary programs of these kernels need the wide operands of ISA version 2
+        result = self.run_compiler("--format", "binary", "--isa", "v2", "--output-dir", output_dir, *self.inputs)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        
+        for source in self.inputs:
+            stem = os.path.splitext(os.path.basename(source))[0]
+            output = os.path.join(output_dir, stem + ".pimb")
+            with self.subTest(source=stem):
+                self.assertTrue(os.path.exists(output))
+                self.assertEqual(self.read_bytes(output),
+                                 self.compile_single(source, "--format", "binary", "--isa", "v2"))
+    
+    def test_failure_does_not_stop_batch(self):
+        """Test that a broken input is reported while the others compile"""
+        missing = self.path("missing.cpp")
+        manifest = self.write_manifest([self.inputs[0], missing, self.inputs[1]])
+        
+        result = self.run_compiler("-j", "2", "--batch", manifest)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn(f"Error: {missing}: Could not open input file", result.stderr)
+        self.assertIn("Compiled 2 of 3 files", result.stdout)
+        self.assertTrue(os.path.exists(self.path("kernel0.pim")))
+        self.assertTrue(os.path.exists(self.path("kernel1.pim")))
+    
+    def test_duplicate_outputs(self):
+        """Test that two entries writing the same file are rejected"""
+        output = self.path("same.pim")
+        manifest = self.write_manifest([f"{self.inputs[0]} {output}", f"{self.inputs[1]} {output}"])
+        
+        result = self.run_compiler("--batch", manifest)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("more than once", result.stderr)
+    
+    def test_invalid_manifest(self):
+        """Test malformed manifests and single-input options in batch mode"""
+        manifest = self.write_manifest([f"{self.inputs[0]} a.pim b.pim"])
+        result = self.run_compiler("--batch", manifest)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("batch.txt:1", result.stderr)
+        
+        result = self.run_compiler("-o", "out.pim", *self.inputs[:2])
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("apply to a single input", result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""
+Test script for the compiler throughput benchmark
+"""
+
+import json
+import os
+import sys
+import subprocess
+import tempfile
+import unittest
+
+# One small configuration keeps the runs short
+FILTER = "--benchmark_filter=^compile/matrix_mult.cpp/8x8x8/int32/O2"
+
+class BenchmarkTest(unittest.TestCase):
+
+    def setUp(self):
+        # Path to the benchmark executable
+        self.bench_path = os.path.join("..", "build", "pim_bench")
+        
+        # Check if the benchmark exists; it is only built with Google Benchmark
+        if not os.path.exists(self.bench_path):
+            self.skipTest("Benchmark executable not found. Build the project with Google Benchmark first.")
+        
+        # Create a temporary directory for the JSON reports
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.report = os.path.join(self.temp_dir.name, "report.json")
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def run_bench(self, *args):
+        return subprocess.run(
+            [self.bench_path, "--shapes", "8x8x8", FILTER, "--benchmark_min_time=0.01", *args],
+            capture_output=True,
+            text=True
+        )
+    
+    def write_report(self):
+        result = self.run_bench("--benchmark_out=" + self.report, "--benchmark_out_format=json")
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(self.report) as f:
+            return json.load(f)
+    
+    def test_counters(self):
+        """Test that every run reports the instructions, the stage times and the heap usage"""
+        benchmarks = self.write_report()["benchmarks"]
+        self.assertEqual(len(benchmarks), 1)
+        run = benchmarks[0]
+        self.assertEqual(run["name"], "compile/matrix_mult.cpp/8x8x8/int32/O2/real_time")
+        self.assertEqual(run["time_unit"], "ms")
+        self.assertGreater(run["instructions"], 0)
+        self.assertGreater(run["peak_heap_bytes"], 0)
+        self.assertGreater(run["max_rss_bytes"], 0)
+        for stage in ["parsing_ms", "ir_generation_ms", "shape_analysis_ms", "memory_mapping_ms",
+                      "code_generation_ms", "output_writing_ms"]:
+            self.assertIn(stage, run)
+            self.assertGreaterEqual(run[stage], 0)
+        self.assertLessEqual(run["code_generation_ms"], run["real_time"])
+    
+    def test_baseline_without_regression(self):
+        """Test that a run compared with its own report passes"""
+        self.write_report()
+        result = self.run_bench("--baseline", self.report, "--threshold", "1000")
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        self.assertIn("1 benchmarks compared, 0 regressed", result.stdout)
+    
+    def test_baseline_regression(self):
+        """Test that slower compilations and more instructions are reported as regressions"""
+        report = self.write_report()
+        run = report["benchmarks"][0]
+        run["real_time"] = run["real_time"] / 100
+        run["instructions"] = run["instructions"] - 1
+        with open(self.report, "w") as f:
+            json.dump(report, f)
+        
+        result = self.run_bench("--baseline", self.report)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("REGRESSION compile/matrix_mult.cpp/8x8x8/int32/O2/real_time: time +", result.stdout)
+        self.assertIn("instructions %d -> %d" % (run["instructions"], run["instructions"] + 1), result.stdout)
+        self.assertIn("1 benchmarks compared, 1 regressed", result.stdout)
+    
+    def test_invalid_arguments(self):
+        """Test that invalid shapes and unreadable baselines are rejected before running"""
+        result = subprocess.run([self.bench_path, "--shapes", "8x8"], capture_output=True, text=True)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("Invalid shape: 8x8", result.stderr)
+        
+        result = self.run_bench("--baseline", os.path.join(self.temp_dir.name, "missing.json"))
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("Could not read baseline", result.stderr)
+        self.assertNotIn("compile/", result.stdout)
+
+if __name__ == "__main__":
+    unittest.main()
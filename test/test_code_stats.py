@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""
+Test script for the static code quality report of generated programs
+"""
+
+import os
+import sys
+import json
+import subprocess
+import tempfile
+import unittest
+
+KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            C[i * cols + j] = 0;
+            for (int k = 0; k < common; k++) {
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+            }
+        }
+    }
+}
+"""
+
+class CodeStatsTest(unittest.TestCase):
+
+    def setUp(self):
+        # Paths to the compiler and simulator executables
+        self.compiler_path = os.path.join("..", "build", "pim_compiler")
+        self.simulator_path = os.path.join("..", "build", "pim_sim")
+        
+        # Check if both executables exist
+        if not os.path.exists(self.compiler_path) or not os.path.exists(self.simulator_path):
+            self.skipTest("Compiler or simulator executable not found. Build the project first.")
+        
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.source_file = os.path.join(self.temp_dir.name, "kernel.cpp")
+        with open(self.source_file, "w") as f:
+            f.write(KERNEL)
+        self.stats_file = os.path.join(self.temp_dir.name, "stats.json")
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def compile(self, dims, *options):
+        """Compile the kernel with statistics, returning the program path, its text and the report"""
+        output_file = os.path.join(self.temp_dir.name, "kernel.pim")
+        result = subprocess.run(
+            [self.compiler_path, "--dims", dims, "--stats", self.stats_file, *options,
+             "-o", output_file, self.source_file],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(output_file, "r") as f:
+            code = f.read()
+        with open(self.stats_file, "r") as f:
+            return output_file, code, json.load(f)
+    
+    def simulate(self, program, dims):
+        """Simulate a program, checking its result, and return the JSON report"""
+        result = subprocess.run(
+            [self.simulator_path, "--json", "--dims", dims, program],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        report = json.loads(result.stdout)
+        self.assertTrue(report["correct"])
+        return report
+    
+    def test_instruction_mix(self):
+        """Test that the opcode histogram counts every instruction of the output"""
+        _, code, stats = self.compile("8x8x8", "--no-tiling")
+        lines = [line.split()[0] for line in code.splitlines() if line.strip()]
+        self.assertEqual(stats["instructions"], len(lines))
+        self.assertEqual(sum(stats["opcodes"].values()), len(lines))
+        for opcode, count in stats["opcodes"].items():
+            self.assertEqual(lines.count(opcode), count, opcode)
+        self.assertEqual(stats["compute"]["macs"], 8 * 8 * 8)
+        self.assertFalse(stats["compute"]["has_jumps"])
+    
+    def test_matches_simulation(self):
+        """Test that traffic matches the simulator and cycles are estimated from below"""
+        for dims, options, close in [("8x8x8", ["--no-tiling"], True),
+                                     ("16x16x16", ["--tile", "8x8x8"], True),
+                                     ("16x16x16", ["--isa", "v2", "--precision", "int8"], True),
+                                     ("16x16x16", ["--no-tiling", "--pe-schedule", "2d"], False)]:
+            with self.subTest(dims=dims, options=options):
+                program, _, stats = self.compile(dims, *options)
+                report = self.simulate(program, dims)
+                cycles = stats["cycles"]
+                self.assertEqual(stats["host_traffic"]["load_bytes"], report["host_bytes_loaded"])
+                self.assertEqual(stats["host_traffic"]["store_bytes"], report["host_bytes_stored"])
+                self.assertEqual(stats["compute"]["pe_streams"], report["pe_streams"])
+                self.assertLessEqual(cycles["estimated"], report["cycles"])
+                if close:
+                    self.assertGreater(cycles["estimated"], 0.95 * report["cycles"])
+                else:
+                    # Streams load their blocks before computing on them
+                    self.assertLessEqual(report["cycles"], cycles["issue"] + cycles["host_link"] + 100)
+    
+    def test_roofline(self):
+        """Test the arithmetic intensity and the bound against the device roofline"""
+        _, _, stats = self.compile("16x16x16", "--tile", "8x8x8")
+        traffic = stats["host_traffic"]
+        roofline = stats["roofline"]
+        intensity = stats["compute"]["macs"] / (traffic["load_bytes"] + traffic["store_bytes"])
+        self.assertAlmostEqual(stats["compute"]["arithmetic_intensity"], intensity)
+        self.assertEqual(roofline["peak_macs_per_cycle"], 128)
+        self.assertAlmostEqual(roofline["ridge_intensity"],
+                               roofline["peak_macs_per_cycle"] / roofline["host_bytes_per_cycle"])
+        self.assertEqual(roofline["bound"], "host_bandwidth")
+        self.assertAlmostEqual(roofline["attainable_macs_per_cycle"], intensity * roofline["host_bytes_per_cycle"])
+        self.assertLessEqual(roofline["min_cycles"], stats["cycles"]["estimated"])
+        
+        # Packed int8 lanes quarter the words of A and B
+        _, _, packed = self.compile("16x16x16", "--tile", "8x8x8", "--precision", "int8")
+        self.assertEqual(packed["compute"]["lanes"], 4)
+        self.assertEqual(packed["compute"]["macs"], stats["compute"]["macs"])
+        self.assertLess(packed["host_traffic"]["load_bytes"], traffic["load_bytes"])
+        self.assertGreater(packed["compute"]["arithmetic_intensity"], intensity)
+    
+    def test_register_pressure(self):
+        """Test that register-resident accumulators raise the live registers within the file"""
+        _, _, allocated = self.compile("8x8x8", "--no-tiling")
+        _, _, spilled = self.compile("8x8x8", "--no-tiling", "--no-regalloc")
+        for stats in (allocated, spilled):
+            registers = stats["registers"]
+            self.assertEqual(registers["file_size"], 8)
+            self.assertGreater(registers["max_live"], 0)
+            self.assertLessEqual(registers["max_live"], registers["used"])
+            self.assertLessEqual(registers["used"], registers["file_size"])
+        self.assertGreater(allocated["registers"]["max_live"], spilled["registers"]["max_live"])
+    
+    def test_symbolic_programs_report_jumps(self):
+        """Test that looped programs are flagged as statically counted"""
+        _, _, stats = self.compile("8x8x8", "--symbolic")
+        self.assertTrue(stats["compute"]["has_jumps"])
+        self.assertGreater(stats["opcodes"]["JUMPNZ"] + stats["opcodes"].get("JUMP", 0), 0)
+    
+    def test_invalid_usage(self):
+        """Test that batches and unwritable statistics files are rejected"""
+        result = subprocess.run(
+            [self.compiler_path, "--stats", self.stats_file, self.source_file, self.source_file],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("--stats", result.stderr)
+        
+        result = subprocess.run(
+            [self.compiler_path, "--dims", "4x4x4", "--stats", os.path.join(self.temp_dir.name, "missing", "s.json"),
+             "-o", os.path.join(self.temp_dir.name, "kernel.pim"), self.source_file],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("Could not write statistics file", result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
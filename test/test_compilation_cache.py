@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""
+Test script for the content-addressed compilation cache
+"""
+
+import os
+import unittest
+
+from pim_test_util import PIMTestCase, gemm_ir
+
+class CompilationCacheTest(PIMTestCase):
+
+    TOOLS = ("pim_compiler",)
+    
+    def setUp(self):
+        super().setUp()
+        self.cache_dir = self.path("cache")
+        self.input_file = self.write_kernel("kernel.ll", 4, 4, 4)
+        self.output_file = self.path("kernel.pim")
+    
+    def write_kernel(self, name, m, k, p, suffix=""):
+        return self.write(name, gemm_ir(m, p, k, name="matmul", accumulate=True) + suffix)
+    
+    def compile_cached(self, *options, input_file=None):
+        """Compile through the cache, returning (cached, output bytes)"""
+        result = self.run_compiler("--cache-dir", self.cache_dir, *options,
+                                   "-o", self.output_file, input_file or self.input_file)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        return "(cached)" in result.stdout, self.read_bytes(self.output_file)
+    
+    def cache_entries(self):
+        if not os.path.isdir(self.cache_dir):
+            return []
+        return [name for name in os.listdir(self.cache_dir) if name.endswith(".pimcache")]
+    
+    def test_hit_reproduces_output(self):
+        """Test that a repeated compilation is served from the cache unchanged"""
+        cached, first = self.compile_cached()
+        self.assertFalse(cached)
+        self.assertEqual(len(self.cache_entries()), 1)
+        
+        os.remove(self.output_file)
+        cached, second = self.compile_cached()
+        self.assertTrue(cached)
+        self.assertEqual(first, second)
+    
+    def test_config_changes_miss(self):
+        """Test that options affecting the generated code select other entries"""
+        self.compile_cached()
+        for options in [("--no-tiling",), ("--format", "binary"), ("--no-layout",)]:
+            with self.subTest(options=options):
+                cached, _ = self.compile_cached(*options)
+                self.assertFalse(cached)
+                cached, _ = self.compile_cached(*options)
+                self.assertTrue(cached)
+        self.assertEqual(len(self.cache_entries()), 4)
+    
+    def test_whitespace_edit_hits(self):
+        """Test that formatting-only edits share an entry and real edits do not"""
+        _, first = self.compile_cached()
+        
+        edited = self.write_kernel("edited.ll", 4, 4, 4, suffix="   \n\n\n")
+        cached, second = self.compile_cached(input_file=edited)
+        self.assertTrue(cached)
+        self.assertEqual(first, second)
+        
+        changed = self.write_kernel("changed.ll", 4, 4, 6)
+        cached, third = self.compile_cached(input_file=changed)
+        self.assertFalse(cached)
+        self.assertNotEqual(first, third)
+    
+    def test_no_cache_and_environment(self):
+        """Test that the environment enables the cache and --no-cache disables it"""
+        env = dict(os.environ, PIM_COMPILER_CACHE_DIR=self.cache_dir)
+        
+        result = self.run_compiler("--no-cache", "-o", self.output_file, self.input_file, env=env)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(self.cache_entries(), [])
+        
+        for expected in [False, True]:
+            result = self.run_compiler("-o", self.output_file, self.input_file, env=env)
+            self.assertEqual(result.returncode, 0, result.stderr)
+            self.assertEqual("(cached)" in result.stdout, expected)
+    
+    def test_eviction_bounds_size(self):
+        """Test that a zero size bound keeps only the newest entry"""
+        for n in range(1, 4):
+            kernel = self.write_kernel(f"kernel{n}.ll", n, 4, 4)
+            result = self.run_compiler("--cache-dir", self.cache_dir, "--cache-size", "0",
+                                       "-o", self.output_file, kernel)
+            self.assertEqual(result.returncode, 0, result.stderr)
+            self.assertLessEqual(len(self.cache_entries()), 1)
+        
+        result = self.run_compiler("--cache-size", "large", self.input_file)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("Invalid cache size", result.stderr)
+    
+    def test_batch_hits(self):
+        """Test that batch entries fill and reuse the cache"""
+        inputs = [self.write_kernel(f"batch{n}.ll", n + 1, 3, 2) for n in range(3)]
+        options = ["--cache-dir", self.cache_dir, "-j", "2", *inputs]
+        
+        result = self.run_compiler(*options)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertNotIn("(cached)", result.stdout)
+        
+        result = self.run_compiler(*options)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(result.stdout.count(" (cached)\n"), 3)
+        self.assertIn("Compiled 3 of 3 files (3 from cache)", result.stdout)
+
+if __name__ == "__main__":
+    unittest.main()
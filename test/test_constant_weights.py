@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""
+Test script for constant weight matrices carried in the program and folded into adds and shifts
+"""
+
+import re
+import random
+import struct
+import unittest
+
+from pim_test_util import PIMTestCase, gemm_ir, gemv_ir
+
+# Weights of a quantized layer: mostly 0, +-1 and powers of two
+WEIGHTS = [0, 0, 1, -1, 1, 2, -2, 4, -8, 16, 3, -5]
+
+def weight_matrix(rows, cols, seed=1, values=WEIGHTS):
+    rnd = random.Random(seed)
+    return [[rnd.choice(values) for _ in range(cols)] for _ in range(rows)]
+
+def gemm_kernel(rows, cols, common, matrix, name="gemm", transposed=False):
+    """Kernel multiplying by the common x cols matrix, stored transposed if requested"""
+    stored = [list(column) for column in zip(*matrix)] if transposed else matrix
+    return gemm_ir(rows, cols, common, name=name, b=name + ".B", b_values=stored, constant_b=True,
+                   transpose_b=transposed)
+
+class ConstantWeightsTest(PIMTestCase):
+    
+    def simulate(self, program, dims, matrix):
+        return super().simulate(program, "--dims", dims, matrix_b=matrix)
+    
+    def count_opcode(self, code, opcode):
+        return len(re.findall(rf"^{opcode} ", code, re.MULTILINE))
+    
+    def test_folded_products(self):
+        """Test that products by 0, +-1 and powers of two are folded on every path"""
+        matrix = weight_matrix(12, 10)
+        kernel = gemm_kernel(6, 10, 12, matrix)
+        for options in [("--no-tiling",), ("--no-tiling", "--isa", "v1"), ("--no-tiling", "--no-regalloc"),
+                        ("--no-tiling", "--pe-schedule", "2d")]:
+            with self.subTest(options=options):
+                program, log = self.compile("folded", kernel, *options)
+                self.assertRegex(log, r"Folding \d+ of \d+ products of constant B")
+                folded = self.simulate(program, "6x10x12", matrix)
+                code = self.read(program)
+                self.assertIn("DATA 0, 11:", code)
+                
+                program, log = self.compile("multiplied", kernel, "--no-weight-folding", *options)
+                self.assertNotIn("Folding", log)
+                multiplied = self.simulate(program, "6x10x12", matrix)
+                multiplied_code = self.read(program)
+                self.assertNotIn("DATA", multiplied_code)
+                self.assertLess(folded["host_bytes_loaded"], multiplied["host_bytes_loaded"])
+                opcode = "MUL" if "v1" in options else "MAC"
+                self.assertLess(self.count_opcode(code, opcode), self.count_opcode(multiplied_code, opcode))
+                self.assertLess(folded["cycles"], multiplied["cycles"])
+        
+        # Powers of two become shifts
+        program, _ = self.compile("folded", kernel, "--no-tiling")
+        self.assertGreater(self.count_opcode(self.read(program), "SHL"), 0)
+    
+    def test_data_section_paths(self):
+        """Test that tiled, packed and transposed kernels read the constant B from the program"""
+        matrix = weight_matrix(16, 12, seed=2, values=list(range(-20, 21)))
+        for options, transposed in [(("--tile", "4x4x4"), False), (("--tile", "4x4x2", "--tile-order", "ikj"), False),
+                                    (("--precision", "int8", "--no-tiling"), False),
+                                    (("--precision", "int16", "--tile", "4x4x4"), False),
+                                    (("--no-tiling",), True), (("--tile", "4x4x4"), True)]:
+            with self.subTest(options=options, transposed=transposed):
+                program, log = self.compile("data", gemm_kernel(8, 12, 16, matrix, transposed=transposed), *options)
+                code = self.read(program)
+                self.assertIn("DATA 0, 0:", code)
+                self.assertRegex(code, r"(?m)^CONFIG 7, 1 ")
+                self.assertRegex(code, r"(?m)^CONFIG 7, 0 ")
+                self.simulate(program, "8x12x16", matrix)
+    
+    def test_constant_vector(self):
+        """Test that a matrix-vector product folds its constant vector"""
+        values = [1, -1, 2, 0, -4, 7, 8, 1]
+        source = gemv_ir(6, len(values), x_values=values)
+        for options in [("--no-tiling",), ("--no-tiling", "--no-regalloc")]:
+            with self.subTest(options=options):
+                program, log = self.compile("gemv", source, *options)
+                self.assertIn("Folding", log)
+                self.simulate(program, "6x1x8", [[v] for v in values])
+    
+    def test_binary_container(self):
+        """Test that the data section round-trips through the binary container and shares repeated blocks"""
+        block = weight_matrix(8, 8, seed=3)
+        repeated = [row * 4 for row in block] * 4
+        distinct = weight_matrix(32, 32, seed=4, values=list(range(-50, 51)))
+        sizes = {}
+        for name, matrix in [("repeated", repeated), ("distinct", distinct)]:
+            program, log = self.compile(name, gemm_kernel(4, 32, 32, matrix), "--format", "binary", "--no-tiling",
+                                         "--isa", "v2")
+            self.simulate(program, "4x32x32", matrix)
+            with open(program, "rb") as f:
+                header = f.read(64)
+            self.assertEqual(header[:4], b"PIMB")
+            sizes[name] = struct.unpack_from("<I", header, 52)[0]
+            self.assertGreater(sizes[name], 0)
+        
+        # 16 blocks of the repeated matrix are stored once
+        self.assertLess(sizes["repeated"] * 4, sizes["distinct"])
+    
+    def test_parallel_sections(self):
+        """Test that functions compiled in parallel keep their own constant matrices"""
+        first = gemm_kernel(4, 6, 5, weight_matrix(5, 6, seed=5), name="first")
+        second = gemm_kernel(4, 6, 5, weight_matrix(5, 6, seed=6), name="second").replace(
+            "@A = global [4 x [5 x i32]] zeroinitializer\n", "").replace(
+            "@C = global [4 x [6 x i32]] zeroinitializer\n", "")
+        source = first + second
+        serial, _ = self.compile("serial", source, "--no-tiling")
+        parallel, _ = self.compile("parallel", source, "--no-tiling", "-j", "2")
+        code = self.read(serial)
+        self.assertEqual(code, self.read(parallel))
+        self.assertIn("DATA 1, 0:", code)
+        self.assertRegex(code, r"(?m)^CONFIG 7, 2 ")
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""
+Test script for double-buffered pipelining of tiled programs
+"""
+
+import os
+import re
+import sys
+import json
+import subprocess
+import tempfile
+import unittest
+
+KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            C[i * cols + j] = 0;
+            for (int k = 0; k < common; k++) {
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+            }
+        }
+    }
+}
+"""
+
+class DoubleBufferingTest(unittest.TestCase):
+    
+    def setUp(self):
+        # Paths to the compiler and simulator executables
+        self.compiler_path = os.path.join("..", "build", "pim_compiler")
+        self.simulator_path = os.path.join("..", "build", "pim_sim")
+        
+        # Check if both executables exist
+        if not os.path.exists(self.compiler_path) or not os.path.exists(self.simulator_path):
+            self.skipTest("Compiler or simulator executable not found. Build the project first.")
+        
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.source_file = os.path.join(self.temp_dir.name, "kernel.cpp")
+        with open(self.source_file, "w") as f:
+            f.write(KERNEL)
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def compile(self, name, *options):
+        """Compile the kernel, returning the program path, its text and the log"""
+        output_file = os.path.join(self.temp_dir.name, name)
+        result = subprocess.run(
+            [self.compiler_path, "-v", *options, "-o", output_file, self.source_file],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(output_file, "r") as f:
+            return output_file, f.read(), result.stdout
+    
+    def simulate(self, program, dims):
+        """Simulate a program, checking its result, and return the JSON report"""
+        result = subprocess.run(
+            [self.simulator_path, "--json", "--dims", dims, program],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        report = json.loads(result.stdout)
+        self.assertTrue(report["correct"])
+        return report
+    
+    def operands(self, code, opcode, index):
+        return [int(fields[index]) for fields in
+                re.findall(rf"^{opcode} (\d+), (\d+)", code, re.MULTILINE)]
+    
+    def test_overlaps_transfers_with_compute(self):
+        """Test that prefetching the next slice shortens the run"""
+        options = ["--tile", "4x4x16", "--isa", "v1", "--dims", "32x32x32"]
+        program, code, log = self.compile("pipelined.pim", *options)
+        serial, serial_code, _ = self.compile("serial.pim", "--no-double-buffer", *options)
+        
+        # 8x8 tiles of 2 slices, every one but the first loaded ahead
+        self.assertIn("Double buffering prefetched 127 of 128 slices behind compute", log)
+        self.assertEqual(self.operands(code, "LOAD", 0).count(0), 128 // 2)
+        self.assertEqual(max(self.operands(code, "LOAD", 0)), 63)
+        self.assertEqual(sorted(set(self.operands(code, "STORE", 1))), [64, 65])
+        self.assertEqual(max(self.operands(serial_code, "LOAD", 0)), 31)
+        
+        report = self.simulate(program, "32x32x32")
+        serial_report = self.simulate(serial, "32x32x32")
+        self.assertEqual(report["host_bytes_loaded"], serial_report["host_bytes_loaded"])
+        self.assertLess(report["cycles"], serial_report["cycles"])
+        self.assertGreater(report["overlap_ratio"], serial_report["overlap_ratio"])
+        self.assertLessEqual(report["overlapped_cycles"],
+                             min(report["transfer_cycles"], report["compute_cycles"]))
+    
+    def test_edge_tiles_drain_pipeline(self):
+        """Test that reconfiguring the array for edge tiles stays correct"""
+        for dims in ["6x6x20", "5x9x7", "20x18x37"]:
+            with self.subTest(dims=dims):
+                program, _, log = self.compile("edge.pim", "--tile", "4x4x8", "--dims", dims)
+                prefetched, steps = map(int, re.search(r"prefetched (\d+) of (\d+) slices", log).groups())
+                self.assertLess(prefetched, steps)
+                self.simulate(program, dims)
+    
+    def test_default_depth_fits_two_buffers(self):
+        """Test that derived tile depths leave room for both buffers"""
+        program, code, log = self.compile("default.pim", "--isa", "v1", "--dims", "20x18x37")
+        depth = int(re.search(r"depth (\d+)", log).group(1))
+        _, _, serial_log = self.compile("serial.pim", "--no-double-buffer", "--isa", "v1", "--dims", "20x18x37")
+        self.assertLess(depth, int(re.search(r"depth (\d+)", serial_log).group(1)))
+        self.assertLess(max(self.operands(code, "LOAD", 0)), 4 * depth)
+        self.simulate(program, "20x18x37")
+        
+        # Packed slices are double buffered as well
+        program, _, log = self.compile("int8.pim", "--precision", "int8", "--dims", "20x18x37")
+        self.assertIn("Double buffering prefetched", log)
+        self.simulate(program, "20x18x37")
+    
+    def test_deep_explicit_tile_falls_back(self):
+        """Test that slices too deep for two buffers are loaded in sequence"""
+        options = ["--tile", "2x2x40", "--dims", "4x4x80"]
+        _, code, log = self.compile("deep.pim", *options)
+        _, serial, _ = self.compile("serial.pim", "--no-double-buffer", *options)
+        self.assertIn("leaves no room for double buffers", log)
+        self.assertEqual(code, serial)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""
+Test script for fusing elementwise epilogues (bias, ReLU, scaling) into GEMM kernels
+"""
+
+import re
+import unittest
+
+from pim_test_util import PIMTestCase, gemm_function, gemv_function, global_matrix
+
+# Declaration of the intrinsic behind the ReLU of the epilogues
+SMAX = "\ndeclare i32 @llvm.smax.i32(i32, i32)\n"
+
+# C = A * B over a 4x3 * 3x5 triple nest, followed by the nests of an epilogue
+def gemm_prologue(name):
+    return (global_matrix("A", 4, 3) + global_matrix("B", 3, 5) + global_matrix("C", 4, 5) +
+            "@bias = global [5 x i32] zeroinitializer\n@rbias = global [4 x i32] zeroinitializer\n" + SMAX +
+            gemm_function(4, 5, 3, name, accumulate=True, then="e0.i.loop"))
+
+# One nest over C applying body to %v, loaded from C[i][j], and storing %r
+EPILOGUE_NEST = """
+e{n}.i.loop:
+  %e{n}.i = phi i64 [ 0, %{prev} ], [ %e{n}.i.next, %e{n}.i.latch ]
+  br label %e{n}.j.loop
+e{n}.j.loop:
+  %e{n}.j = phi i64 [ 0, %e{n}.i.loop ], [ %e{n}.j.next, %e{n}.j.loop ]
+  %e{n}.ptr = getelementptr [4 x [5 x i32]], [4 x [5 x i32]]* @C, i64 0, i64 %e{n}.i, i64 %e{n}.j
+  %e{n}.col.ptr = getelementptr [5 x i32], [5 x i32]* @bias, i64 0, i64 %e{n}.j
+  %e{n}.row.ptr = getelementptr [4 x i32], [4 x i32]* @rbias, i64 0, i64 %e{n}.i
+  %e{n}.v = load i32, i32* %e{n}.ptr
+  {body}
+  store i32 %e{n}.r, i32* %e{n}.ptr
+  %e{n}.j.next = add i64 %e{n}.j, 1
+  %e{n}.j.done = icmp eq i64 %e{n}.j.next, 5
+  br i1 %e{n}.j.done, label %e{n}.i.latch, label %e{n}.j.loop
+e{n}.i.latch:
+  %e{n}.i.next = add i64 %e{n}.i, 1
+  %e{n}.i.done = icmp eq i64 %e{n}.i.next, 4
+  br i1 %e{n}.i.done, label %{next}, label %e{n}.i.loop
+"""
+
+def fused_kernel(name, *bodies):
+    """Build a GEMM followed by one epilogue nest per body"""
+    source = gemm_prologue(name)
+    for n, body in enumerate(bodies):
+        prev = "i.latch" if n == 0 else "e{}.i.latch".format(n - 1)
+        following = "e{}.i.loop".format(n + 1) if n + 1 < len(bodies) else "exit"
+        source += EPILOGUE_NEST.format(n=n, prev=prev, next=following, body=body.format(n=n))
+    return source + "exit:\n  ret void\n}\n"
+
+BIAS_RELU = """%e{n}.bias = load i32, i32* %e{n}.col.ptr
+  %e{n}.sum = add i32 %e{n}.v, %e{n}.bias
+  %e{n}.r = call i32 @llvm.smax.i32(i32 %e{n}.sum, i32 0)"""
+SCALE_3 = "%e{n}.r = mul i32 %e{n}.v, 3"
+ROW_BIAS = """%e{n}.bias = load i32, i32* %e{n}.row.ptr
+  %e{n}.r = add i32 %e{n}.bias, %e{n}.v"""
+SHIFT_SCALE = "%e{n}.r = shl i32 %e{n}.v, 2"
+SUBTRACT = "%e{n}.r = sub i32 %e{n}.v, 1"
+
+# The accumulator stays in a register and the bias and ReLU are applied
+# before the only store of C[i][j]
+ACCUMULATOR_KERNEL = """
+@A = global [4 x [3 x i32]] zeroinitializer
+@B = global [3 x [5 x i32]] zeroinitializer
+@C = global [4 x [5 x i32]] zeroinitializer
+@rbias = global [4 x i32] zeroinitializer
+
+define void @dense_relu() {
+entry:
+  br label %i.loop
+i.loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %i.latch ]
+  br label %j.loop
+j.loop:
+  %j = phi i64 [ 0, %i.loop ], [ %j.next, %j.latch ]
+  br label %k.loop
+k.loop:
+  %k = phi i64 [ 0, %j.loop ], [ %k.next, %k.loop ]
+  %sum = phi i32 [ 0, %j.loop ], [ %sum.next, %k.loop ]
+  %a.ptr = getelementptr [4 x [3 x i32]], [4 x [3 x i32]]* @A, i64 0, i64 %i, i64 %k
+  %b.ptr = getelementptr [3 x [5 x i32]], [3 x [5 x i32]]* @B, i64 0, i64 %k, i64 %j
+  %a = load i32, i32* %a.ptr
+  %b = load i32, i32* %b.ptr
+  %p = mul i32 %a, %b
+  %sum.next = add i32 %sum, %p
+  %k.next = add i64 %k, 1
+  %k.done = icmp eq i64 %k.next, 3
+  br i1 %k.done, label %j.latch, label %k.loop
+j.latch:
+  %r.ptr = getelementptr [4 x i32], [4 x i32]* @rbias, i64 0, i64 %i
+  %rv = load i32, i32* %r.ptr
+  %t = add i32 %sum.next, %rv
+  %pos = icmp sgt i32 %t, 0
+  %relu = select i1 %pos, i32 %t, i32 0
+  %c.ptr = getelementptr [4 x [5 x i32]], [4 x [5 x i32]]* @C, i64 0, i64 %i, i64 %j
+  store i32 %relu, i32* %c.ptr
+  %j.next = add i64 %j, 1
+  %j.done = icmp eq i64 %j.next, 5
+  br i1 %j.done, label %i.latch, label %j.loop
+i.latch:
+  %i.next = add i64 %i, 1
+  %i.done = icmp eq i64 %i.next, 4
+  br i1 %i.done, label %exit, label %i.loop
+exit:
+  ret void
+}
+"""
+
+# 6x5 matrix-vector product followed by y = max(y + b, 0)
+GEMV_KERNEL = (global_matrix("A", 6, 5) + "@x = global [5 x i32] zeroinitializer\n" +
+               "@y = global [6 x i32] zeroinitializer\n@b = global [6 x i32] zeroinitializer\n" + SMAX +
+               gemv_function(6, 5, "gemv_relu", then="e.loop") + """e.loop:
+  %e = phi i64 [ 0, %i.latch ], [ %e.next, %e.loop ]
+  %ey.ptr = getelementptr [6 x i32], [6 x i32]* @y, i64 0, i64 %e
+  %eb.ptr = getelementptr [6 x i32], [6 x i32]* @b, i64 0, i64 %e
+  %ey = load i32, i32* %ey.ptr
+  %eb = load i32, i32* %eb.ptr
+  %es = add i32 %ey, %eb
+  %er = call i32 @llvm.smax.i32(i32 %es, i32 0)
+  store i32 %er, i32* %ey.ptr
+  %e.next = add i64 %e, 1
+  %e.done = icmp eq i64 %e.next, 6
+  br i1 %e.done, label %exit, label %e.loop
+exit:
+  ret void
+}
+""")
+
+class EpilogueFusionTest(PIMTestCase):
+    
+    def compile(self, name, source, *options):
+        """Compile an IR kernel, returning the program path, the log and the program text"""
+        program, log = super().compile(name, source, *options)
+        return program, log, self.read(program)
+    
+    def simulate(self, program, dims, epilogue=None):
+        """Simulate a program against the reference with the given epilogue and return the JSON report"""
+        return super().simulate(program, "--dims", dims, *(["--epilogue", epilogue] if epilogue else []))
+    
+    def count_opcode(self, code, opcode):
+        return len(re.findall(rf"^{opcode} ", code, re.MULTILINE))
+    
+    def test_epilogue_nests_fused(self):
+        """Test that bias, ReLU and scaling nests after the product are applied before C is stored"""
+        source = fused_kernel("fused", BIAS_RELU, SCALE_3)
+        program, log, code = self.compile("fused", source, "--no-tiling", "--no-coalesce")
+        
+        self.assertIn("Elementwise epilogue of fused: bias[j], relu, scale 3", log)
+        self.assertIn("Fusing epilogue: bias[j], relu, scale 3", log)
+        
+        # C makes one trip to the host, and the bias vector is loaded once
+        self.assertEqual(self.count_opcode(code, "STORE"), 4 * 5)
+        self.assertEqual(len(re.findall(r"^LOAD \d+, 5\b", code, re.MULTILINE)), 5)
+        self.simulate(program, "4x5x3", "col-bias,relu,scale=3")
+        
+        # Without the epilogue the host has no bias vector for the program to load
+        result = self.run_simulator(program, "--dims", "4x5x3")
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("outside the 0x5 operand", result.stderr)
+    
+    def test_lowering_paths(self):
+        """Test the fused epilogue on every code generation path"""
+        source = fused_kernel("fused", BIAS_RELU, ROW_BIAS, SHIFT_SCALE)
+        epilogue = "col-bias,relu,row-bias,scale=4"
+        for options in [("--no-tiling",), ("--no-tiling", "--no-regalloc"), ("--no-tiling", "--isa", "v1"),
+                        ("--no-tiling", "--pe-schedule", "2d"), ("--tile", "2x2x2"),
+                        ("--tile", "2x2x2", "--isa", "v1"), ("--no-tiling", "--precision", "int8")]:
+            program, log, _ = self.compile("fused", source, *options)
+            self.assertIn("bias[j], relu, rbias[i], scale 4", log)
+            self.simulate(program, "4x5x3", epilogue)
+    
+    def test_accumulator_epilogue(self):
+        """Test that operations between the k loop and the store of C are fused"""
+        program, log, code = self.compile("dense_relu", ACCUMULATOR_KERNEL, "--no-tiling", "--no-coalesce")
+        
+        self.assertIn("Elementwise epilogue of dense_relu: rbias[i], relu", log)
+        self.assertEqual(self.count_opcode(code, "STORE"), 4 * 5)
+        self.simulate(program, "4x5x3", "row-bias,relu")
+    
+    def test_matrix_vector_epilogue(self):
+        """Test that a matrix-vector product applies its epilogue to the row accumulators"""
+        program, log, _ = self.compile("gemv_relu", GEMV_KERNEL, "--no-tiling")
+        
+        self.assertIn("Elementwise epilogue of gemv_relu: b[i], relu", log)
+        self.simulate(program, "6x1x5", "row-bias,relu")
+    
+    def test_unrecognized_epilogue(self):
+        """Test that fusion stops at an operation it does not recognize"""
+        source = fused_kernel("partial", BIAS_RELU, SUBTRACT)
+        program, log, _ = self.compile("partial", source, "--no-tiling")
+        
+        self.assertIn("Stopped fusing the epilogue of partial at an unrecognized store to C", log)
+        self.simulate(program, "4x5x3", "col-bias,relu")
+    
+    def test_rejected_configurations(self):
+        """Test that symbolic programs and packed scaling by other factors are rejected"""
+        source = fused_kernel("fused", SCALE_3)
+        for options in [("--symbolic",), ("--precision", "int8", "--no-tiling")]:
+            result, _ = self.try_compile("fused", source, *options)
+            self.assertNotEqual(result.returncode, 0)
+            self.assertIn("not supported", result.stdout + result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+"""
+Test script for the 64-bit extended ISA (version 2)
+"""
+
+import os
+import re
+import sys
+import json
+import struct
+import subprocess
+import tempfile
+import unittest
+
+KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            C[i * cols + j] = 0;
+            for (int k = 0; k < common; k++) {
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+            }
+        }
+    }
+}
+"""
+
+class ExtendedISATest(unittest.TestCase):
+    
+    def setUp(self):
+        # Paths to the compiler and simulator executables
+        self.compiler_path = os.path.join("..", "build", "pim_compiler")
+        self.simulator_path = os.path.join("..", "build", "pim_sim")
+        
+        # Check if both executables exist
+        if not os.path.exists(self.compiler_path) or not os.path.exists(self.simulator_path):
+            self.skipTest("Compiler or simulator executable not found. Build the project first.")
+        
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.source_file = os.path.join(self.temp_dir.name, "kernel.cpp")
+        with open(self.source_file, "w") as f:
+            f.write(KERNEL)
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def run_compiler(self, name, *options):
+        output_file = os.path.join(self.temp_dir.name, name)
+        result = subprocess.run(
+            [self.compiler_path, *options, "-o", output_file, self.source_file],
+            capture_output=True,
+            text=True
+        )
+        return output_file, result
+    
+    def compile(self, name, *options):
+        """Compile the kernel, returning the program path and its text"""
+        output_file, result = self.run_compiler(name, *options)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(output_file, "r", errors="replace") as f:
+            return output_file, f.read()
+    
+    def simulate(self, program, dims):
+        """Simulate a program, checking its result, and return the JSON report"""
+        result = subprocess.run(
+            [self.simulator_path, "--json", "--dims", dims, program],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        report = json.loads(result.stdout)
+        self.assertTrue(report["correct"])
+        return report
+    
+    def count_opcode(self, code, opcode):
+        return len(re.findall(rf"^{opcode} ", code, re.MULTILINE))
+    
+    def test_fused_multiply_add(self):
+        """Test that every generator replaces MUL and ADD pairs with MAC"""
+        variants = [
+            ("tiled", ["--tile", "4x4x8"], "8x8x16"),
+            ("untiled", ["--no-tiling"], "5x3x7"),
+            ("unallocated", ["--no-tiling", "--no-regalloc"], "5x3x7"),
+            ("scheduled", ["--no-tiling", "--pe-schedule", "2d"], "8x8x8"),
+            ("symbolic", ["--symbolic"], "5x3x7"),
+            ("int8", ["--no-tiling", "--precision", "int8"], "3x5x12"),
+        ]
+        for name, options, dims in variants:
+            with self.subTest(variant=name):
+                v1, v1_code = self.compile(f"{name}_v1.pim", *options, "--dims", dims, "--isa", "v1")
+                v2, v2_code = self.compile(f"{name}_v2.pim", *options, "--dims", dims, "--isa", "v2")
+                self.assertEqual(self.count_opcode(v2_code, "MUL"), 0)
+                self.assertGreater(self.count_opcode(v2_code, "MAC"), 0)
+                self.assertLess(len(v2_code.splitlines()), len(v1_code.splitlines()))
+                self.assertLessEqual(self.simulate(v2, dims)["cycles"], self.simulate(v1, dims)["cycles"])
+                
+                # Every word is annotated with its 64-bit encoding
+                words = re.findall(r"; 0x([0-9a-f]+)$", v2_code, re.MULTILINE)
+                self.assertTrue(words)
+                self.assertTrue(all(len(word) == 16 for word in words))
+    
+    def test_block_transfers(self):
+        """Test that tile slices are loaded with one burst per operand"""
+        v1, v1_code = self.compile("tiled_v1.pim", "--tile", "4x4x16", "--dims", "16x16x32", "--isa", "v1")
+        v2, v2_code = self.compile("tiled_v2.pim", "--tile", "4x4x16", "--dims", "16x16x32", "--isa", "v2")
+        self.assertEqual(self.count_opcode(v2_code, "LOAD"), 0)
+        self.assertEqual(self.count_opcode(v2_code, "LOAD_BLOCK") * 16, self.count_opcode(v1_code, "LOAD"))
+        for burst in re.findall(r"^LOAD_BLOCK \d+, (\d+), (\d+)", v2_code, re.MULTILINE):
+            self.assertIn(int(burst[0]), (1, 2))
+            self.assertEqual(int(burst[1]), 16)
+        
+        report = self.simulate(v2, "16x16x32")
+        self.assertEqual(report["host_bytes_loaded"], self.simulate(v1, "16x16x32")["host_bytes_loaded"])
+    
+    def test_binary_round_trip(self):
+        """Test that the 64-bit binary container simulates like the text"""
+        text, _ = self.compile("kernel.pim", "--tile", "4x4x8", "--dims", "8x8x16", "--isa", "v2")
+        binary, result = self.run_compiler("kernel.pimb", "--tile", "4x4x8", "--dims", "8x8x16",
+                                           "--isa", "v2", "--format", "binary")
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(binary, "rb") as f:
+            self.assertEqual(int.from_bytes(f.read(8)[4:8], "little"), 2)
+        self.assertEqual(self.simulate(binary, "8x8x16")["cycles"], self.simulate(text, "8x8x16")["cycles"])
+    
+    def test_malformed_container(self):
+        """Test that misaligned or overlapping sections are rejected when the container is read"""
+        binary, result = self.run_compiler("kernel.pimb", "--dims", "4x4x4", "--format", "binary")
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(binary, "rb") as f:
+            data = bytearray(f.read())
+        text_offset = struct.unpack_from("<I", data, 40)[0]
+        
+        cases = [
+            ((text_offset + 8, 0), "sections are not aligned to 16 bytes"),
+            ((text_offset, 16), "sections overlap"),
+        ]
+        for (data_offset, data_size), message in cases:
+            with self.subTest(message=message):
+                struct.pack_into("<II", data, 48, data_offset, data_size)
+                corrupt = os.path.join(self.temp_dir.name, "corrupt.pimb")
+                with open(corrupt, "wb") as f:
+                    f.write(data)
+                result = subprocess.run([self.simulator_path, "--dims", "4x4x4", corrupt],
+                                        capture_output=True, text=True)
+                self.assertEqual(result.returncode, 1)
+                self.assertIn(message, result.stderr)
+    
+    def test_wide_operands(self):
+        """Test that addresses beyond the 8-bit fields need ISA version 2"""
+        _, result = self.run_compiler("wide_v1.pimb", "--no-tiling", "--dims", "16x24x16", "--format", "binary",
+                                      "--isa", "v1")
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("does not fit the 32-bit encoding of ISA version 1; use --isa v2", result.stderr)
+        
+        program, result = self.run_compiler("wide_v2.pimb", "--no-tiling", "--dims", "16x24x16",
+                                            "--format", "binary", "--isa", "v2")
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertNotIn("truncated", result.stderr)
+        self.simulate(program, "16x24x16")
+    
+    def test_binary_host_coordinates(self):
+        """Test that host coordinates beyond the 2-bit immediate fail version 1 binaries"""
+        v1, result = self.run_compiler("gemm_v1.pimb", "--dims", "5x7x9", "--format", "binary", "--isa", "v1")
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("does not fit the 32-bit encoding of ISA version 1", result.stderr)
+        self.assertFalse(os.path.exists(v1))
+        
+        # The text listing keeps the instruction without a version 1 word
+        _, code = self.compile("gemm_v1.pim", "--dims", "5x7x9", "--isa", "v1")
+        self.assertIn("; no 32-bit encoding", code)
+        
+        v2, result = self.run_compiler("gemm_v2.pimb", "--dims", "5x7x9", "--format", "binary", "--isa", "v2")
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.assertEqual(self.simulate(v2, "5x7x9")["mismatches"], 0)
+    
+    def test_default_encoding(self):
+        """Test that version 2 is the default, so default programs always have an encoding"""
+        _, default_code = self.compile("default.pim", "--dims", "8x8x8")
+        _, v2_code = self.compile("v2.pim", "--dims", "8x8x8", "--isa", "v2")
+        self.assertEqual(default_code, v2_code)
+        self.assertNotIn("no 64-bit encoding", default_code)
+        
+        binary, result = self.run_compiler("default.pimb", "--dims", "8x8x8", "--format", "binary")
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(binary, "rb") as f:
+            self.assertEqual(int.from_bytes(f.read(8)[4:8], "little"), 2)
+        self.simulate(binary, "8x8x8")
+    
+    def test_invalid_isa(self):
+        """Test that unknown ISA versions are rejected"""
+        _, result = self.run_compiler("bad.pim", "--isa", "v3")
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("Unknown ISA version", result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
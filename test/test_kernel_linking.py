@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""
+Test script for linked programs keeping the operands kernels share in PIM memory
+"""
+
+import json
+import unittest
+
+from pim_test_util import PIMTestCase, gemm_function, global_matrix
+
+def chain_module(linkage="internal global"):
+    """Y = (X * W1) * W2 through the intermediate T"""
+    return (global_matrix("X", 4, 8) + global_matrix("W1", 8, 6) + global_matrix("T", 4, 6, linkage) +
+            global_matrix("W2", 6, 5) + global_matrix("Y", 4, 5) +
+            gemm_function(4, 6, 8, "layer1", "X", "W1", "T") + gemm_function(4, 5, 6, "layer2", "T", "W2", "Y"))
+
+CHAIN_KERNELS = ["4x6x8:X,W1,T", "4x5x6:T,W2,Y"]
+
+class KernelLinkingTest(PIMTestCase):
+    
+    def simulate(self, program, kernels, expect_correct=True, dims=None):
+        options = [option for spec in kernels for option in ("--kernel", spec)] + (["--dims", dims] if dims else [])
+        if expect_correct:
+            return super().simulate(program, *options)
+        return json.loads(self.run_simulator(program, "--json", *options).stdout)
+    
+    def test_chained_intermediate_stays_resident(self):
+        """Test that an internal intermediate is neither stored nor reloaded"""
+        linked, log = self.compile("linked", chain_module(), "--isa", "v2")
+        self.assertIn("layer2 reads A (T) from PIM memory", log)
+        self.assertIn("Keeping C (T) of layer1 in PIM memory", log)
+        program = self.read(linked)
+        self.assertIn("CONFIG 8, 0", program)
+        self.assertIn("CONFIG 8, 1", program)
+        
+        report = self.simulate(linked, CHAIN_KERNELS)
+        self.assertEqual(report["kernels_executed"], 2)
+        self.assertEqual(report["stored_buffers"], ["Y"])
+        
+        # Every kernel on its own moves T out and back in; operands as large
+        # as the first kernel's cover the reads of both
+        unlinked, _ = self.compile("unlinked", chain_module(), "--isa", "v2", "--no-kernel-linking")
+        self.assertNotIn("CONFIG 8,", self.read(unlinked))
+        baseline = self.simulate(unlinked, [], expect_correct=False, dims="4x6x8")
+        self.assertEqual(baseline["host_bytes_loaded"] - report["host_bytes_loaded"], 4 * 6 * 4)
+        self.assertEqual(baseline["host_bytes_stored"] - report["host_bytes_stored"], 4 * 6 * 4)
+    
+    def test_public_intermediate_is_stored(self):
+        """Test that an intermediate the host can read is stored but still not reloaded"""
+        linked, log = self.compile("public", chain_module("global"), "--isa", "v2")
+        self.assertIn("layer2 reads A (T) from PIM memory", log)
+        self.assertNotIn("Keeping C", log)
+        report = self.simulate(linked, CHAIN_KERNELS)
+        self.assertEqual(report["stored_buffers"], ["T", "Y"])
+    
+    def test_shared_weights(self):
+        """Test that a B two kernels share is loaded once"""
+        source = (global_matrix("X1", 4, 8) + global_matrix("X2", 4, 8) + global_matrix("W", 8, 6) +
+                  global_matrix("Y1", 4, 6) + global_matrix("Y2", 4, 6) +
+                  gemm_function(4, 6, 8, "first", "X1", "W", "Y1") + gemm_function(4, 6, 8, "second", "X2", "W", "Y2"))
+        kernels = ["4x6x8:X1,W,Y1", "4x6x8:X2,W,Y2"]
+        linked, log = self.compile("linked", source, "--isa", "v2")
+        self.assertIn("second reads B (W) from PIM memory", log)
+        report = self.simulate(linked, kernels)
+        self.assertEqual(report["stored_buffers"], ["Y1", "Y2"])
+        
+        unlinked, _ = self.compile("unlinked", source, "--isa", "v2", "--no-kernel-linking")
+        baseline = self.simulate(unlinked, [], expect_correct=False, dims="4x6x8")
+        self.assertEqual(baseline["host_bytes_loaded"] - report["host_bytes_loaded"], 8 * 6 * 4)
+    
+    def test_spill_when_memory_is_short(self):
+        """Test that an intermediate that leaves no room for its reader goes through the host"""
+        # The 8-bit address field of ISA version 1 holds one kernel at a time
+        linked, log = self.compile("spilled", chain_module(), "--isa", "v1")
+        self.assertIn("Spilling T to the host: no room for layer2", log)
+        report = self.simulate(linked, CHAIN_KERNELS)
+        self.assertEqual(report["stored_buffers"], ["T", "Y"])
+    
+    def test_parallel_matches_serial(self):
+        """Test that parallel compilation links kernels identically"""
+        serial, _ = self.compile("serial", chain_module(), "--isa", "v2")
+        parallel, _ = self.compile("parallel", chain_module(), "--isa", "v2", "-j", "2")
+        self.assertEqual(self.read(serial), self.read(parallel))
+
+if __name__ == "__main__":
+    unittest.main()
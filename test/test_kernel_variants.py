@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+Test script for batched, transposed and matrix-vector kernel variants
+"""
+
+import re
+import unittest
+
+from pim_test_util import PIMTestCase, gemm_ir, gemv_ir
+
+# Four-deep nest computing two independent 4x3 * 3x5 products
+BATCHED_KERNEL = """
+@A = global [2 x [4 x [3 x i32]]] zeroinitializer
+@B = global [2 x [3 x [5 x i32]]] zeroinitializer
+@C = global [2 x [4 x [5 x i32]]] zeroinitializer
+
+define void @bmm() {
+entry:
+  br label %b.loop
+b.loop:
+  %b = phi i64 [ 0, %entry ], [ %b.next, %b.latch ]
+  br label %i.loop
+i.loop:
+  %i = phi i64 [ 0, %b.loop ], [ %i.next, %i.latch ]
+  br label %j.loop
+j.loop:
+  %j = phi i64 [ 0, %i.loop ], [ %j.next, %j.latch ]
+  br label %k.loop
+k.loop:
+  %k = phi i64 [ 0, %j.loop ], [ %k.next, %k.loop ]
+  %a.ptr = getelementptr [2 x [4 x [3 x i32]]], [2 x [4 x [3 x i32]]]* @A, i64 0, i64 %b, i64 %i, i64 %k
+  %b.ptr = getelementptr [2 x [3 x [5 x i32]]], [2 x [3 x [5 x i32]]]* @B, i64 0, i64 %b, i64 %k, i64 %j
+  %c.ptr = getelementptr [2 x [4 x [5 x i32]]], [2 x [4 x [5 x i32]]]* @C, i64 0, i64 %b, i64 %i, i64 %j
+  %a = load i32, i32* %a.ptr
+  %bv = load i32, i32* %b.ptr
+  %c = load i32, i32* %c.ptr
+  %p = mul i32 %a, %bv
+  %s = add i32 %c, %p
+  store i32 %s, i32* %c.ptr
+  %k.next = add i64 %k, 1
+  %k.done = icmp eq i64 %k.next, 3
+  br i1 %k.done, label %j.latch, label %k.loop
+j.latch:
+  %j.next = add i64 %j, 1
+  %j.done = icmp eq i64 %j.next, 5
+  br i1 %j.done, label %i.latch, label %j.loop
+i.latch:
+  %i.next = add i64 %i, 1
+  %i.done = icmp eq i64 %i.next, 4
+  br i1 %i.done, label %b.latch, label %i.loop
+b.latch:
+  %b.next = add i64 %b, 1
+  %b.done = icmp eq i64 %b.next, 2
+  br i1 %b.done, label %exit, label %b.loop
+exit:
+  ret void
+}
+"""
+
+DENSE_KERNEL = gemm_ir(4, 5, 3, name="dense", accumulate=True)
+TRANSPOSED_A_KERNEL = gemm_ir(4, 5, 3, name="atb", transpose_a=True, accumulate=True)
+TRANSPOSED_B_KERNEL = gemm_ir(4, 5, 3, name="abt", transpose_b=True, accumulate=True)
+
+# Rows of A padded to 8 elements, of which the product uses 3
+PADDED_KERNEL = gemm_ir(4, 5, 3, name="padded", a_cols=8, accumulate=True)
+
+# 6x5 matrix times a 5-vector, and the same product written as a GEMM with one column
+GEMV_KERNEL = gemv_ir(6, 5)
+ONE_COLUMN_KERNEL = gemm_ir(6, 1, 5, accumulate=True)
+
+class KernelVariantsTest(PIMTestCase):
+    
+    def compile(self, name, source, *options):
+        """Compile an IR kernel, returning the program path, the log and the program text"""
+        program, log = super().compile(name, source, *options)
+        return program, log, self.read(program)
+    
+    def simulate(self, program, dims):
+        return super().simulate(program, "--dims", dims)
+    
+    def count_opcode(self, code, opcode):
+        return len(re.findall(rf"^{opcode} ", code, re.MULTILINE))
+    
+    def test_batched_kernel(self):
+        """Test that a four-deep nest runs every product of the batch"""
+        program, log, code = self.compile("batched", BATCHED_KERNEL, "--no-tiling", "--no-coalesce")
+        
+        self.assertIn("Inferred shape of bmm: 4x3 * 3x5 (batch 2)", log)
+        self.assertIn("CONFIG 6, 0 ;", code)
+        self.assertIn("CONFIG 6, 1 ;", code)
+        self.assertEqual(self.count_opcode(code, "STORE"), 2 * 4 * 5)
+        
+        report = self.simulate(program, "4x5x3x2")
+        self.assertEqual(report["batch"], 2)
+        
+        # Tiled programs select the products the same way
+        program, _, _ = self.compile("batched_tiled", BATCHED_KERNEL, "--tile", "2x2x2")
+        self.simulate(program, "4x5x3x2")
+    
+    def test_batched_streams(self):
+        """Test that scheduled batches run one product per PE stream"""
+        program, log, code = self.compile("batched_streams", BATCHED_KERNEL, "--no-tiling", "--pe-schedule", "auto")
+        
+        self.assertIn("Distributing 2 products over 2 PE streams", log)
+        self.assertEqual(len(re.findall(r"^CONFIG 4, ", code, re.MULTILINE)), 2)
+        self.assertNotIn("CONFIG 6,", code)
+        
+        report = self.simulate(program, "4x5x3x2")
+        self.assertEqual(report["pe_streams"], 2)
+    
+    def test_transposed_b(self):
+        """Test that B stored transposed is loaded in its stored order"""
+        program, log, code = self.compile("abt", TRANSPOSED_B_KERNEL, "--no-tiling", "--isa", "v2")
+        
+        self.assertIn("Inferred shape of abt: 4x3 * 3x5 (B transposed)", log)
+        self.assertIn("CONFIG 5, 2 ;", code)
+        
+        # Every stored row of B (a column of the product) is one burst
+        bursts = re.findall(r"^LOAD_BLOCK \d+, 2, 3, 0", code, re.MULTILINE)
+        self.assertEqual(len(bursts), 5)
+        self.simulate(program, "4x5x3")
+        
+        for options in [("--no-tiling",), ("--tile", "2x2x2"), ("--isa", "v1", "--tile", "2x2x2")]:
+            program, _, _ = self.compile("abt", TRANSPOSED_B_KERNEL, *options)
+            self.simulate(program, "4x5x3")
+    
+    def test_transposed_a(self):
+        """Test that A stored transposed is addressed in stored coordinates"""
+        program, log, code = self.compile("atb", TRANSPOSED_A_KERNEL, "--no-tiling")
+        
+        self.assertIn("Inferred shape of atb: 4x3 * 3x5 (A transposed)", log)
+        self.assertIn("CONFIG 5, 1 ;", code)
+        self.simulate(program, "4x5x3")
+        
+        for options in [("--tile", "2x2x2"), ("--no-tiling", "--pe-schedule", "row"), ("--precision", "int8")]:
+            program, _, _ = self.compile("atb", TRANSPOSED_A_KERNEL, *options)
+            self.simulate(program, "4x5x3")
+    
+    def test_leading_dimension(self):
+        """Test that padded rows are recognized and leave the program unchanged"""
+        _, log, padded = self.compile("padded", PADDED_KERNEL, "--no-tiling")
+        _, _, dense = self.compile("dense", DENSE_KERNEL, "--no-tiling")
+        
+        self.assertIn("Inferred shape of padded: 4x3 * 3x5 (lda 8)", log)
+        self.assertEqual(padded, dense)
+    
+    def test_matrix_vector_product(self):
+        """Test that a two-deep nest is lowered as a matrix-vector product"""
+        program, log, code = self.compile("gemv", GEMV_KERNEL, "--no-tiling")
+        
+        self.assertIn("Inferred shape of gemv: 6x5 * 5x1 (GEMV)", log)
+        self.assertEqual(self.count_opcode(code, "MAC"), 6 * 5)
+        self.simulate(program, "6x1x5")
+        
+        # x is moved once per block of rows instead of once per multiply
+        _, _, gemm = self.compile("gemm", ONE_COLUMN_KERNEL, "--no-tiling")
+        self.assertLess(len(code.splitlines()), len(gemm.splitlines()))
+        self.assertLess(self.count_opcode(code, "MOVE"), self.count_opcode(gemm, "MOVE"))
+        
+        program, _, _ = self.compile("gemv", GEMV_KERNEL, "--no-tiling", "--isa", "v1")
+        self.simulate(program, "6x1x5")
+    
+    def test_symbolic_variants_rejected(self):
+        """Test that symbolic programs only accept the plain GEMM"""
+        result, _ = self.try_compile("abt", TRANSPOSED_B_KERNEL, "--symbolic")
+        
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("not supported with symbolic dimensions", result.stdout + result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
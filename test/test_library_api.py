@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+"""
+Test script for the in-process compiler API and host emulation (pim_embed)
+"""
+
+import json
+import subprocess
+import unittest
+
+from pim_test_util import PIMTestCase, gemm_ir
+
+# C = A * B with initialized A and B, so that the host emulation has inputs
+def gemm_kernel(a, b, constant_b=True):
+    return gemm_ir(len(a), len(b[0]), len(b), a_values=a, b_values=b, constant_b=constant_b)
+
+def product(a, b):
+    return [sum(a[i][k] * b[k][j] for k in range(len(b))) for i in range(len(a)) for j in range(len(b[0]))]
+
+class LibraryApiTest(PIMTestCase):
+    
+    TOOLS = ("pim_embed", "pim_compiler")
+
+    def setUp(self):
+        super().setUp()
+        self.a = [[(3 * i + k) % 7 - 2 for k in range(6)] for i in range(4)]
+        self.b = [[(i * j + 1) % 5 - 1 for j in range(5)] for i in range(6)]
+    
+    def write_kernel(self, name, source):
+        return self.write(name + ".ll", source)
+    
+    def run_embed(self, *args):
+        return subprocess.run([self.embed_path, *args], capture_output=True, text=True)
+    
+    def embed(self, *args):
+        result = self.run_embed(*args)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        return result.stdout
+    
+    def test_matches_command_line(self):
+        """Test that in-memory programs equal the output of pim_compiler"""
+        kernel = self.write_kernel("gemm", gemm_kernel(self.a, self.b))
+        for options in [(), ("--isa", "v2"), ("--format", "binary", "--isa", "v2"), ("--module",)]:
+            with self.subTest(options=options):
+                embedded = self.path("embedded.out")
+                compiled = self.path("compiled.out")
+                self.embed(*options, "-o", embedded, kernel)
+                cli_options = [option for option in options if option != "--module"]
+                result = self.run_compiler("--no-cache", *cli_options, "-o", compiled, kernel)
+                self.assertEqual(result.returncode, 0, result.stderr)
+                self.assertEqual(self.read_bytes(embedded), self.read_bytes(compiled))
+    
+    def test_in_memory_cache(self):
+        """Test that repeated compilations of one input are served from memory"""
+        kernel = self.write_kernel("gemm", gemm_kernel(self.a, self.b))
+        for options in [(), ("--module",)]:
+            with self.subTest(options=options):
+                output = self.embed(*options, "--repeat", "3", kernel)
+                self.assertRegex(output, r"Compile 1: \d+ instructions, 1 constant matrices \(compiled\)")
+                self.assertRegex(output, r"Compile 3: \d+ instructions, 1 constant matrices \(cached\)")
+                self.assertIn("In-memory cache: 2 hits, 1 misses, 1 programs", output)
+    
+    def test_host_emulation(self):
+        """Test that kernels run on the host JIT compute C = A * B"""
+        for constant_b in [True, False]:
+            with self.subTest(constant_b=constant_b):
+                kernel = self.write_kernel("gemm", gemm_kernel(self.a, self.b, constant_b))
+                output = self.embed("--run", "gemm", "--print", "C", "--print", "A", kernel)
+                results = {}
+                for line in output.splitlines():
+                    if line.startswith("{"):
+                        results.update(json.loads(line))
+                self.assertEqual(results["C"], product(self.a, self.b))
+                self.assertEqual(results["A"], [v for row in self.a for v in row])
+    
+    def test_invalid_input(self):
+        """Test that invalid IR and unknown symbols are reported"""
+        invalid = self.write_kernel("invalid", "define void @f( {\n")
+        result = self.run_embed(invalid)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("Failed to load LLVM IR", result.stderr)
+        
+        kernel = self.write_kernel("gemm", gemm_kernel(self.a, self.b))
+        result = self.run_embed("--run", "missing", kernel)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("missing", result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""
+Test script for log levels and the background log file writer
+"""
+
+import os
+import re
+import unittest
+
+from pim_test_util import CPP_KERNEL, PIMTestCase, gemm_ir
+
+# Every log line starts with its timestamp
+LOG_LINE = re.compile(r"^\[\d{4}-\d\d-\d\d \d\d:\d\d:\d\d\] ")
+
+class LoggingTest(PIMTestCase):
+    
+    TOOLS = ("pim_compiler",)
+
+    def setUp(self):
+        super().setUp()
+        self.source = self.write("kernel.cpp", CPP_KERNEL)
+        self.log_file = self.path("compiler.log")
+    
+    def run_compiler(self, *args):
+        result = super().run_compiler(*args)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        return result
+    
+    def read_log(self):
+        return self.read(self.log_file)
+    
+    def test_quiet_by_default(self):
+        """Test that only warnings and errors are logged to the console without -v"""
+        output = self.path("out.txt")
+        result = self.run_compiler("--dims", "4x4x4", "-o", output, self.source)
+        self.assertNotRegex(result.stdout, LOG_LINE.pattern)
+        self.assertEqual(result.stderr, "")
+        
+        # Assumed dimensions are reported on stderr, unless the level hides warnings
+        result = self.run_compiler("-o", output, self.source)
+        self.assertNotRegex(result.stdout, LOG_LINE.pattern)
+        self.assertIn("WARNING: Could not infer all dimensions of matrixMultiply: assuming 2 for rows, cols, common; "
+                      "pass --dims", result.stderr)
+        result = self.run_compiler("--log-level", "error", "-o", output, self.source)
+        self.assertEqual(result.stderr, "")
+    
+    def test_log_file_without_verbose(self):
+        """Test that the log file receives every message while the console stays quiet"""
+        output = self.path("out.txt")
+        result = self.run_compiler("--log-file", self.log_file, "-o", output, self.source)
+        self.assertNotRegex(result.stdout, LOG_LINE.pattern)
+        
+        log = self.read_log()
+        self.assertIn("PIM Compiler started", log)
+        self.assertRegex(log, r"Generated \d+ PIM instructions")
+        self.assertIn("Compilation completed successfully", log)
+        
+        # Messages are appended to an existing file
+        self.run_compiler("--log-file", self.log_file, "-o", output, self.source)
+        self.assertEqual(self.read_log().count("PIM Compiler started"), 2)
+    
+    def test_levels(self):
+        """Test that the level hides lower messages and that debug messages are opt-in"""
+        output = self.path("out.txt")
+        
+        result = self.run_compiler("-v", "-o", output, self.source)
+        self.assertIn("PIM Compiler started", result.stdout)
+        self.assertNotIn("Source code to parse", result.stdout)
+        
+        result = self.run_compiler("-v", "--log-level", "debug", "-o", output, self.source)
+        self.assertIn("DEBUG: Source code to parse", result.stdout)
+        self.assertIn("matrixMultiply", result.stdout)
+        
+        result = self.run_compiler("-v", "--log-level", "warning", "-o", output, self.source)
+        self.assertNotRegex(result.stdout, LOG_LINE.pattern)
+        
+        # The level applies to the log file as well
+        self.run_compiler("--log-level", "error", "--log-file", self.log_file, "-o", output, self.source)
+        self.assertEqual(self.read_log(), "")
+    
+    def test_unknown_level(self):
+        """Test that an unknown level is rejected"""
+        result = super().run_compiler("--log-level", "loud", self.source)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("Unknown log level: loud", result.stderr)
+    
+    def test_concurrent_batch_lines(self):
+        """Test that threads of a parallel batch write whole, uninterleaved lines to the log file"""
+        inputs = [self.write(f"kernel{n}.ll", gemm_ir(2 + n % 3, 4, 3 + n % 2, name="matmul", accumulate=True))
+                  for n in range(8)]
+        
+        result = self.run_compiler("--no-tiling", "-j", "4", "--log-file", self.log_file,
+                                   "--output-dir", self.temp_dir.name, *inputs)
+        self.assertIn(f"Compiled {len(inputs)} of {len(inputs)} files", result.stdout)
+        
+        lines = self.read_log().splitlines()
+        self.assertTrue(lines)
+        for line in lines:
+            self.assertRegex(line, LOG_LINE.pattern)
+        
+        # Every input is reported exactly once
+        for path in inputs:
+            with self.subTest(input=os.path.basename(path)):
+                compiling = [line for line in lines if re.search(r"\] Compiling " + re.escape(path) + " to ", line)]
+                self.assertEqual(len(compiling), 1)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,263 @@
+#!/usr/bin/env python3
+"""
+Test script for the LLVM IR optimization pipeline of the PIM compiler
+"""
+
+import os
+import re
+import sys
+import json
+import subprocess
+import tempfile
+import unittest
+
+# Unoptimized loop nest over pointer arguments: counters and bounds live in
+# stack slots, so the trip counts are only visible after mem2reg
+STACK_KERNEL = """
+define void @matmul(i32* %A, i32* %B, i32* %C) {
+entry:
+  %rows = alloca i64
+  %cols = alloca i64
+  %common = alloca i64
+  %i = alloca i64
+  %j = alloca i64
+  %k = alloca i64
+  store i64 4, i64* %rows
+  store i64 5, i64* %cols
+  store i64 3, i64* %common
+  store i64 0, i64* %i
+  br label %i.cond
+i.cond:
+  %i0 = load i64, i64* %i
+  %m = load i64, i64* %rows
+  %i.ok = icmp slt i64 %i0, %m
+  br i1 %i.ok, label %i.body, label %exit
+i.body:
+  store i64 0, i64* %j
+  br label %j.cond
+j.cond:
+  %j0 = load i64, i64* %j
+  %n = load i64, i64* %cols
+  %j.ok = icmp slt i64 %j0, %n
+  br i1 %j.ok, label %j.body, label %i.latch
+j.body:
+  store i64 0, i64* %k
+  br label %k.cond
+k.cond:
+  %k0 = load i64, i64* %k
+  %p = load i64, i64* %common
+  %k.ok = icmp slt i64 %k0, %p
+  br i1 %k.ok, label %k.body, label %j.latch
+k.body:
+  %ia = load i64, i64* %i
+  %ka = load i64, i64* %k
+  %ja = load i64, i64* %j
+  %a.row = mul i64 %ia, 3
+  %a.idx = add i64 %a.row, %ka
+  %a.ptr = getelementptr i32, i32* %A, i64 %a.idx
+  %b.row = mul i64 %ka, 5
+  %b.idx = add i64 %b.row, %ja
+  %b.ptr = getelementptr i32, i32* %B, i64 %b.idx
+  %c.row = mul i64 %ia, 5
+  %c.idx = add i64 %c.row, %ja
+  %c.ptr = getelementptr i32, i32* %C, i64 %c.idx
+  %a = load i32, i32* %a.ptr
+  %b = load i32, i32* %b.ptr
+  %c = load i32, i32* %c.ptr
+  %prod = mul i32 %a, %b
+  %sum = add i32 %c, %prod
+  store i32 %sum, i32* %c.ptr
+  %k1 = add i64 %ka, 1
+  store i64 %k1, i64* %k
+  br label %k.cond
+j.latch:
+  %j1 = add i64 %j0, 1
+  store i64 %j1, i64* %j
+  br label %j.cond
+i.latch:
+  %i1 = add i64 %i0, 1
+  store i64 %i1, i64* %i
+  br label %i.cond
+exit:
+  ret void
+}
+"""
+
+# The same nest over global 2D arrays
+GLOBAL_STACK_KERNEL = """
+@A = global [4 x [3 x i32]] zeroinitializer
+@B = global [3 x [5 x i32]] zeroinitializer
+@C = global [4 x [5 x i32]] zeroinitializer
+
+define void @matmul() {
+entry:
+  %rows = alloca i64
+  %cols = alloca i64
+  %common = alloca i64
+  %i = alloca i64
+  %j = alloca i64
+  %k = alloca i64
+  store i64 4, i64* %rows
+  store i64 5, i64* %cols
+  store i64 3, i64* %common
+  store i64 0, i64* %i
+  br label %i.cond
+i.cond:
+  %i0 = load i64, i64* %i
+  %m = load i64, i64* %rows
+  %i.ok = icmp slt i64 %i0, %m
+  br i1 %i.ok, label %i.body, label %exit
+i.body:
+  store i64 0, i64* %j
+  br label %j.cond
+j.cond:
+  %j0 = load i64, i64* %j
+  %n = load i64, i64* %cols
+  %j.ok = icmp slt i64 %j0, %n
+  br i1 %j.ok, label %j.body, label %i.latch
+j.body:
+  store i64 0, i64* %k
+  br label %k.cond
+k.cond:
+  %k0 = load i64, i64* %k
+  %p = load i64, i64* %common
+  %k.ok = icmp slt i64 %k0, %p
+  br i1 %k.ok, label %k.body, label %j.latch
+k.body:
+  %ia = load i64, i64* %i
+  %ka = load i64, i64* %k
+  %ja = load i64, i64* %j
+  %a.ptr = getelementptr [4 x [3 x i32]], [4 x [3 x i32]]* @A, i64 0, i64 %ia, i64 %ka
+  %b.ptr = getelementptr [3 x [5 x i32]], [3 x [5 x i32]]* @B, i64 0, i64 %ka, i64 %ja
+  %c.ptr = getelementptr [4 x [5 x i32]], [4 x [5 x i32]]* @C, i64 0, i64 %ia, i64 %ja
+  %a = load i32, i32* %a.ptr
+  %b = load i32, i32* %b.ptr
+  %c = load i32, i32* %c.ptr
+  %prod = mul i32 %a, %b
+  %sum = add i32 %c, %prod
+  store i32 %sum, i32* %c.ptr
+  %k1 = add i64 %ka, 1
+  store i64 %k1, i64* %k
+  br label %k.cond
+j.latch:
+  %j1 = add i64 %j0, 1
+  store i64 %j1, i64* %j
+  br label %j.cond
+i.latch:
+  %i1 = add i64 %i0, 1
+  store i64 %i1, i64* %i
+  br label %i.cond
+exit:
+  ret void
+}
+"""
+
+KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            C[i * cols + j] = 0;
+            for (int k = 0; k < common; k++) {
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+            }
+        }
+    }
+}
+"""
+
+class OptimizationPipelineTest(unittest.TestCase):
+
+    def setUp(self):
+        # Paths to the compiler and simulator executables
+        self.compiler_path = os.path.join("..", "build", "pim_compiler")
+        self.simulator_path = os.path.join("..", "build", "pim_sim")
+        
+        # Check if both executables exist
+        if not os.path.exists(self.compiler_path) or not os.path.exists(self.simulator_path):
+            self.skipTest("Compiler or simulator executable not found. Build the project first.")
+        
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def run_compiler(self, name, source, *options):
+        test_file = os.path.join(self.temp_dir.name, name)
+        with open(test_file, "w") as f:
+            f.write(source)
+        
+        output_file = os.path.join(self.temp_dir.name, name + ".pim")
+        result = subprocess.run(
+            [self.compiler_path, "-v", *options, "-o", output_file, test_file],
+            capture_output=True,
+            text=True
+        )
+        return output_file, result
+    
+    def compile(self, name, source, *options):
+        """Compile source with verbose output, returning the program, the process result and the PIM code"""
+        output_file, result = self.run_compiler(name, source, *options)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(output_file, "r") as f:
+            return output_file, result, f.read()
+    
+    def simulate(self, program, dims):
+        """Simulate a program and return the JSON report"""
+        result = subprocess.run(
+            [self.simulator_path, "--json", "--dims", dims, program],
+            capture_output=True,
+            text=True
+        )
+        return json.loads(result.stdout)
+    
+    def test_stack_slots_promoted(self):
+        """Test that dimensions held in stack slots are inferred once promoted"""
+        program, result, _ = self.compile("stack_o0.ll", STACK_KERNEL, "-O0", "--no-tiling")
+        self.assertIn("Could not infer all dimensions of matmul", result.stderr)
+        self.assertFalse(self.simulate(program, "4x5x3")["correct"])
+        
+        program, result, code = self.compile("stack_o2.ll", STACK_KERNEL, "-O2", "--no-tiling")
+        self.assertIn("Inferred shape of matmul: 4x3 * 3x5", result.stdout)
+        self.assertEqual(len(re.findall(r"^MAC ", code, re.MULTILINE)), 4*5*3)
+        self.assertTrue(self.simulate(program, "4x5x3")["correct"])
+    
+    def test_unrotated_loops(self):
+        """Test that loops testing their condition in the header are not counted once too often"""
+        for level in ["-O0", "-O1", "-O2", "-O3"]:
+            with self.subTest(level=level):
+                program, result, _ = self.compile("global.ll", GLOBAL_STACK_KERNEL, level, "--no-tiling")
+                self.assertIn("Inferred shape of matmul: 4x3 * 3x5", result.stdout)
+                self.assertTrue(self.simulate(program, "4x5x3")["correct"])
+    
+    def test_levels_agree(self):
+        """Test that every level generates the same code for the reference kernel"""
+        for options in [["--no-tiling"], ["--tile", "4x4x8"]]:
+            with self.subTest(options=options):
+                _, _, reference = self.compile("kernel.cpp", KERNEL, "-O0", *options, "--dims", "8x8x16")
+                for level in ["-O1", "-O2", "-O3"]:
+                    program, result, code = self.compile("kernel.cpp", KERNEL, level, *options, "--dims", "8x8x16")
+                    self.assertEqual(code, reference, level)
+                    self.assertRegex(result.stdout, r"IR instructions: \d+ before, \d+ after optimization")
+                    self.assertTrue(self.simulate(program, "8x8x16")["correct"])
+    
+    def test_pipeline_logged(self):
+        """Test that the pass pipeline of each level is reported"""
+        _, result, _ = self.compile("kernel.cpp", KERNEL, "-O0", "--dims", "4x4x4")
+        self.assertIn("Running O0 IR pipeline: none", result.stdout)
+        self.assertNotIn("IR instructions:", result.stdout)
+        
+        _, result, _ = self.compile("kernel.cpp", KERNEL, "-O3", "--dims", "4x4x4")
+        self.assertIn("Running O3 IR pipeline: sroa,mem2reg", result.stdout)
+        self.assertIn("licm", result.stdout)
+        self.assertIn("gvn,dse", result.stdout)
+    
+    def test_invalid_level(self):
+        """Test that unknown optimization levels are rejected"""
+        _, result = self.run_compiler("kernel.cpp", KERNEL, "-O4")
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("Unknown optimization level", result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
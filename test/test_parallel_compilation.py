@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+Test script for parallel per-function compilation in the PIM compiler
+"""
+
+import re
+import unittest
+
+from pim_test_util import PIMTestCase, gemm_ir
+
+# A function without a loop nest between the kernels
+HELPER = """
+define i32 @helper(i32 %x) {
+entry:
+  %y = add i32 %x, 1
+  ret i32 %y
+}
+"""
+
+SHAPES = [(2, 3, 4), (4, 4, 4), (3, 5, 2), (6, 2, 3), (2, 2, 2), (5, 3, 4), (8, 8, 8), (1, 7, 3)]
+
+class ParallelCompilationTest(PIMTestCase):
+    
+    TOOLS = ("pim_compiler",)
+    
+    def write_module(self, name, shapes):
+        """Write a module with one kernel per (rows, common, cols) shape and a helper"""
+        kernels = [gemm_ir(m, p, k, name=f"matmul{n}", a=f"A{n}", b=f"B{n}", c=f"C{n}", accumulate=True)
+                   for n, (m, k, p) in enumerate(shapes)]
+        kernels.insert(len(kernels) // 2, HELPER)
+        return self.write(name, "".join(kernels))
+        
+    def compile_module(self, test_file, output_name, *options):
+        """Compile a module, returning the process result and the output bytes"""
+        output_file = self.path(output_name)
+        result = self.run_compiler(*options, "-o", output_file, test_file)
+        self.assertEqual(result.returncode, 0, f"Compilation with {options} failed: {result.stderr}")
+        return result, self.read_bytes(output_file)
+    
+    def test_output_matches_serial(self):
+        """Test that every thread count produces the serial output"""
+        test_file = self.write_module("kernels.ll", SHAPES)
+        _, serial = self.compile_module(test_file, "serial.pim", "--no-tiling")
+        
+        # Every kernel contributes its multiply-accumulates, in module order
+        code = serial.decode()
+        self.assertEqual(len(re.findall(r"^MAC ", code, re.MULTILINE)), sum(m * k * p for m, k, p in SHAPES))
+        
+        for jobs in ["2", "4", "0"]:
+            with self.subTest(jobs=jobs):
+                _, parallel = self.compile_module(test_file, f"parallel{jobs}.pim", "--no-tiling", "-j", jobs)
+                self.assertEqual(parallel, serial)
+    
+    def test_binary_and_tiled_output_matches_serial(self):
+        """Test that tiled code in a binary container is linked identically"""
+        test_file = self.write_module("kernels.ll", SHAPES)
+        # The host coordinates of these kernels need the wide operands of ISA version 2
+        options = ["--tile", "2x2x2", "--format", "binary", "--isa", "v2"]
+        _, serial = self.compile_module(test_file, "serial.pimb", *options)
+        _, parallel = self.compile_module(test_file, "parallel.pimb", *options, "--jobs", "3")
+        self.assertEqual(parallel, serial)
+    
+    def test_symbolic_jumps_are_relocated(self):
+        """Test that jump targets of later sections are moved to their final position"""
+        test_file = self.write_module("kernels.ll", SHAPES[:3])
+        _, serial = self.compile_module(test_file, "serial.pim", "--symbolic")
+        _, parallel = self.compile_module(test_file, "parallel.pim", "--symbolic", "-j", "3")
+        self.assertEqual(parallel, serial)
+        
+        # The three copies of the program differ only in their jump targets
+        lines = parallel.decode().splitlines()
+        self.assertEqual(len(lines) % 3, 0)
+        size = len(lines) // 3
+        first = [int(m.group(1)) for m in re.finditer(r"^JUMPN?Z (\d+),", "\n".join(lines[:size]), re.MULTILINE)]
+        third = [int(m.group(1)) for m in re.finditer(r"^JUMPN?Z (\d+),", "\n".join(lines[2 * size:]), re.MULTILINE)]
+        self.assertTrue(first)
+        self.assertEqual(third, [target + 2 * size for target in first])
+    
+    def test_parallel_log(self):
+        """Test that workers analyze every function and the thread count is reported"""
+        test_file = self.write_module("kernels.ll", SHAPES)
+        result, _ = self.compile_module(test_file, "parallel.pim", "-v", "--no-tiling", "-j", "4")
+        
+        self.assertIn(f"Compiling {len(SHAPES) + 1} functions on 4 threads", result.stdout)
+        self.assertIn("Skipping function without a matrix multiplication: helper", result.stdout)
+        for n, (m, k, p) in enumerate(SHAPES):
+            self.assertIn(f"Inferred shape of matmul{n}: {m}x{k} * {k}x{p}", result.stdout)
+        
+        # Log lines from different threads are never interleaved
+        for line in result.stdout.splitlines():
+            if not line.startswith("Compiled "):
+                self.assertRegex(line, r"^\[\d{4}-\d\d-\d\d \d\d:\d\d:\d\d\] [^\[]*$")
+    
+    def test_invalid_job_count(self):
+        """Test that a malformed job count is rejected"""
+        test_file = self.write_module("kernels.ll", SHAPES[:1])
+        result = self.run_compiler("-j", "many", "-o", self.path("out.pim"), test_file)
+        
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("Invalid job count", result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
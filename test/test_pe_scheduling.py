@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""
+Test script for distributing untiled kernels over the processing elements
+"""
+
+import os
+import re
+import sys
+import json
+import subprocess
+import tempfile
+import unittest
+
+KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            C[i * cols + j] = 0;
+            for (int k = 0; k < common; k++) {
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+            }
+        }
+    }
+}
+"""
+
+class PESchedulingTest(unittest.TestCase):
+    
+    def setUp(self):
+        # Paths to the compiler and simulator executables
+        self.compiler_path = os.path.join("..", "build", "pim_compiler")
+        self.simulator_path = os.path.join("..", "build", "pim_sim")
+        
+        # Check if both executables exist
+        if not os.path.exists(self.compiler_path) or not os.path.exists(self.simulator_path):
+            self.skipTest("Compiler or simulator executable not found. Build the project first.")
+        
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.source_file = os.path.join(self.temp_dir.name, "kernel.cpp")
+        with open(self.source_file, "w") as f:
+            f.write(KERNEL)
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def run_compiler(self, name, *options):
+        output_file = os.path.join(self.temp_dir.name, name)
+        result = subprocess.run(
+            [self.compiler_path, *options, "-o", output_file, self.source_file],
+            capture_output=True,
+            text=True
+        )
+        return output_file, result
+    
+    def compile(self, name, *options):
+        """Compile the kernel untiled, returning the program path, its text and the log"""
+        output_file, result = self.run_compiler(name, "--no-tiling", *options)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(output_file, "r") as f:
+            return output_file, f.read(), result.stdout
+    
+    def simulate(self, program, dims):
+        """Simulate a program, checking its result, and return the JSON report"""
+        result = subprocess.run(
+            [self.simulator_path, "--json", "--dims", dims, program],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        report = json.loads(result.stdout)
+        self.assertTrue(report["correct"])
+        return report
+    
+    def stream_pes(self, code):
+        return [int(pe) for pe in re.findall(r"^CONFIG 4, (\d+) ;", code, re.MULTILINE)]
+    
+    def test_strategies_are_correct_and_faster(self):
+        """Test that every strategy computes C in fewer cycles than one PE"""
+        for dims in ["8x8x8", "5x7x9", "11x10x6"]:
+            serial, _, _ = self.compile("serial.pim", "--dims", dims)
+            serial_cycles = self.simulate(serial, dims)["cycles"]
+            for strategy in ["auto", "row", "column", "2d"]:
+                with self.subTest(dims=dims, strategy=strategy):
+                    program, code, log = self.compile(f"{strategy}.pim", "--pe-schedule", strategy,
+                                                      "--dims", dims, "-v")
+                    self.assertIn("Chosen schedule:", log)
+                    
+                    pes = self.stream_pes(code)
+                    self.assertGreater(len(pes), 1)
+                    self.assertEqual(len(pes), len(set(pes)))
+                    self.assertEqual(len(re.findall(r"^SYNC", code, re.MULTILINE)), 1)
+                    
+                    report = self.simulate(program, dims)
+                    self.assertEqual(report["pe_streams"], len(pes))
+                    self.assertEqual(len(report["pe_utilization"]), len(pes))
+                    self.assertLess(report["cycles"], serial_cycles)
+    
+    def test_strategy_shapes(self):
+        """Test that row and column blocks split only their dimension"""
+        _, row, log = self.compile("row.pim", "--pe-schedule", "row", "--dims", "16x2x4", "-v")
+        self.assertRegex(log, r"Chosen schedule: row-block \d+x1 on \d+ PEs")
+        _, column, log = self.compile("column.pim", "--pe-schedule", "column", "--dims", "2x16x4", "-v")
+        self.assertRegex(log, r"Chosen schedule: column-block 1x\d+ on \d+ PEs")
+        
+        # Auto picks the split along the long dimension of C
+        _, _, log = self.compile("auto.pim", "--pe-schedule", "auto", "--dims", "16x2x4", "-v")
+        self.assertIn("Chosen schedule: row-block", log)
+    
+    def test_balanced_blocks(self):
+        """Test that uneven dimensions give blocks differing by at most one row"""
+        program, code, _ = self.compile("row.pim", "--pe-schedule", "row", "--no-coalesce", "--dims", "7x3x2")
+        sections = re.split(r"^CONFIG 4, \d+ ;.*$", code.split("SYNC")[0], flags=re.MULTILINE)[1:]
+        stores = [len(re.findall(r"^STORE ", section, re.MULTILINE)) for section in sections]
+        self.assertEqual(sum(stores), 7 * 3)
+        self.assertLessEqual(max(stores) - min(stores), 3)
+        self.simulate(program, "7x3x2")
+    
+    def test_default_unchanged(self):
+        """Test that programs without --pe-schedule have no streams"""
+        _, code, _ = self.compile("default.pim", "--dims", "3x4x5")
+        self.assertEqual(self.stream_pes(code), [])
+        self.assertNotIn("SYNC", code)
+    
+    def test_with_packed_precision(self):
+        """Test scheduled streams of packed operands"""
+        program, code, _ = self.compile("int8.pim", "--pe-schedule", "auto", "--precision", "int8",
+                                        "--dims", "6x6x10")
+        self.assertGreater(len(self.stream_pes(code)), 1)
+        self.assertEqual(self.simulate(program, "6x6x10")["lanes"], 4)
+    
+    def test_invalid_options(self):
+        """Test unknown strategies and results too small to split"""
+        _, result = self.run_compiler("bad.pim", "--pe-schedule", "diagonal")
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("Unknown PE schedule", result.stderr)
+        
+        for dims in ["1x1x1", "1x8x4", "8x1x4"]:
+            with self.subTest(dims=dims):
+                _, result = self.run_compiler("thin.pim", "--no-tiling", "--pe-schedule", "2d", "--dims", dims)
+                self.assertNotEqual(result.returncode, 0)
+                self.assertIn("needs at least two rows and two columns of C", result.stderr)
+                self.assertNotIn("fits the PE memories", result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -9,6 +9,7 @@ import subprocess
 import tempfile
 import unittest
 import re
+import struct
 
 class PIMBackendTest(unittest.TestCase):
     
@@ -49,7 +50,7 @@ class PIMBackendTest(unittest.TestCase):
         # Run the compiler to generate PIM instructions
         output_file = os.path.join(self.temp_dir.name, "output.txt")
         result = subprocess.run(
-            [self.compiler_path, "-v", "-o", output_file, test_file],
+            [self.compiler_path, "-v", "--isa", "v1", "-o", output_file, test_file],
             capture_output=True,
             text=True
         )
@@ -98,7 +99,7 @@ class PIMBackendTest(unittest.TestCase):
         # Run the compiler to generate PIM instructions
         output_file = os.path.join(self.temp_dir.name, "output.txt")
         result = subprocess.run(
-            [self.compiler_path, "-v", "-o", output_file, test_file],
+            [self.compiler_path, "-v", "--isa", "v1", "-o", output_file, test_file],
             capture_output=True,
             text=True
         )
@@ -167,5 +168,219 @@ class PIMBackendTest(unittest.TestCase):
             # Check that the output file exists
             self.assertTrue(os.path.exists(output_file), f"Output file for size {size} was not created")
 
+    def test_tiled_code_generation(self):
+        """Test tiled code generation against the fully unrolled stream"""
+        
+        # Create a test C++ file
+        test_file = os.path.join(self.temp_dir.name, "test_tiled.cpp")
+        with open(test_file, "w") as f:
+            f.write("""
+            void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+                for (int i = 0; i < rows; i++) {
+                    for (int j = 0; j < cols; j++) {
+                        C[i * cols + j] = 0;
+                        for (int k = 0; k < common; k++) {
+                            C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+                        }
+                    }
+                }
+            }
+            """)
+        
+        # Compile once with tiling disabled and once with a single 2x2 tile
+        untiled_file = os.path.join(self.temp_dir.name, "untiled.txt")
+        tiled_file = os.path.join(self.temp_dir.name, "tiled.txt")
+        for args, output_file in [(["--no-tiling"], untiled_file), (["--tile", "2x2x2"], tiled_file)]:
+            result = subprocess.run(
+                [self.compiler_path] + args + ["-o", output_file, test_file],
+                capture_output=True,
+                text=True
+            )
+            self.assertEqual(result.returncode, 0, 
+                             f"Tiled code generation test failed with return code {result.returncode}. Error: {result.stderr}")
+        
+        with open(untiled_file, "r") as f:
+            untiled = f.read().strip().split("\n")
+        with open(tiled_file, "r") as f:
+            tiled = f.read().strip().split("\n")
+        
+        # The tile configures the PE array and clears its accumulator
+        self.assertTrue(any(line.startswith("CONFIG 3, 2") for line in tiled), "PE array width not configured")
+        self.assertTrue(any(re.match(r"XOR (\d+), \1, \1 ;", line) for line in tiled), "Accumulator not cleared")
+        
+        # One STORE per tile instead of one per element
+        self.assertEqual(len([line for line in tiled if line.startswith("STORE")]), 1)
+        self.assertLess(len(tiled), len(untiled), "Tiled program should be smaller than the unrolled one")
+    
+    def test_register_allocation(self):
+        """Test that accumulators stay register-resident across the k loop"""
+        
+        test_file = os.path.join(self.temp_dir.name, "test_regalloc.cpp")
+        with open(test_file, "w") as f:
+            f.write("""
+            void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+                for (int i = 0; i < rows; i++)
+                    for (int j = 0; j < cols; j++)
+                        for (int k = 0; k < common; k++)
+                            C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+            }
+            """)
+        
+        allocated_file = os.path.join(self.temp_dir.name, "allocated.txt")
+        unallocated_file = os.path.join(self.temp_dir.name, "unallocated.txt")
+        for args, output_file in [([], allocated_file), (["--no-regalloc"], unallocated_file)]:
+            result = subprocess.run(
+                [self.compiler_path, "--no-tiling"] + args + ["-o", output_file, test_file],
+                capture_output=True,
+                text=True
+            )
+            self.assertEqual(result.returncode, 0, 
+                             f"Register allocation test failed with return code {result.returncode}. Error: {result.stderr}")
+        
+        with open(allocated_file, "r") as f:
+            allocated = f.read().strip().split("\n")
+        with open(unallocated_file, "r") as f:
+            unallocated = f.read().strip().split("\n")
+        
+        # Every C element is spilled exactly once (MOVE to memory has mode 1)
+        spills = [line for line in allocated if line.startswith("MOVE") and line.split(" ; ")[0].endswith(", 1")]
+        self.assertEqual(len(spills), 4, "Each C element should be stored once")
+        
+        # MUL count is unchanged, the per-MAC reload/spill disappears
+        count = lambda lines, op: len([line for line in lines if line.startswith(op)])
+        self.assertEqual(count(allocated, "MUL"), count(unallocated, "MUL"))
+        self.assertLess(count(allocated, "MOVE"), count(unallocated, "MOVE"))
+    
+    def test_binary_output_format(self):
+        """Test the packed binary container against the text output"""
+        
+        test_file = os.path.join(self.temp_dir.name, "test_binary.cpp")
+        with open(test_file, "w") as f:
+            f.write("void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {}\n")
+        
+        text_file = os.path.join(self.temp_dir.name, "output.txt")
+        binary_file = os.path.join(self.temp_dir.name, "output.bin")
+        for args, output_file in [([], text_file), (["--format", "binary"], binary_file)]:
+            result = subprocess.run(
+                [self.compiler_path, "--isa", "v1"] + args + ["-o", output_file, test_file],
+                capture_output=True,
+                text=True
+            )
+            self.assertEqual(result.returncode, 0, 
+                             f"Binary output test failed with return code {result.returncode}. Error: {result.stderr}")
+        
+        with open(text_file, "r") as f:
+            expected = [int(line.split(" ; ")[1], 16) for line in f.read().strip().split("\n")]
+        with open(binary_file, "rb") as f:
+            data = f.read()
+        
+        # Header: magic, version, header size, word size, 5 arch params, count, text/data sections
+        fields = struct.unpack_from("<16I", data, 0)
+        self.assertEqual(data[:4], b"PIMB")
+        self.assertEqual(fields[1], 1, "Unexpected container version")
+        self.assertEqual(fields[3], 4, "Unexpected instruction word size")
+        self.assertEqual(fields[4], 128, "Processing element count not recorded")
+        
+        count, text_offset, text_size = fields[9], fields[10], fields[11]
+        self.assertEqual(count, len(expected))
+        self.assertEqual(text_size, 4 * count)
+        
+        words = list(struct.unpack_from(f"<{count}I", data, text_offset))
+        self.assertEqual(words, expected, "Binary words do not match the text encoding")
+    
+    def test_symbolic_dimensions(self):
+        """Test that one looped program computes every matrix shape"""
+        
+        test_file = os.path.join(self.temp_dir.name, "test_symbolic.cpp")
+        with open(test_file, "w") as f:
+            f.write("void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {}\n")
+        
+        programs = []
+        for dims in ["2x2x2", "16x16x16"]:
+            output_file = os.path.join(self.temp_dir.name, f"symbolic_{dims}.txt")
+            result = subprocess.run(
+                [self.compiler_path, "--symbolic", "--isa", "v1", "--dims", dims, "-o", output_file, test_file],
+                capture_output=True,
+                text=True
+            )
+            self.assertEqual(result.returncode, 0, 
+                             f"Symbolic code generation failed with return code {result.returncode}. Error: {result.stderr}")
+            with open(output_file, "r") as f:
+                programs.append([int(line.split(" ; ")[1], 16) for line in f.read().strip().split("\n")])
+        
+        # The program does not depend on the compile-time shape
+        self.assertEqual(programs[0], programs[1])
+        program = programs[0]
+        opcodes = [word >> 26 for word in program]
+        self.assertIn(16, opcodes, "Expected JUMPNZ back-edges")
+        self.assertNotIn(1, opcodes, "Matrices are staged by the runtime, not loaded")
+        
+        # Interpret the program against the launch block layout in PIMInstructionSet.h
+        def run(rows, cols, common, a, b):
+            a_base, b_base = 16, 16 + rows * common
+            c_base = b_base + common * cols
+            mem = {0: rows, 1: cols, 2: common, 3: a_base, 4: b_base, 5: c_base}
+            mem.update({a_base + n: v for n, v in enumerate(a)})
+            mem.update({b_base + n: v for n, v in enumerate(b)})
+            regs = [0] * 8
+            mask = 0xFFFFFFFF
+            pc = 0
+            steps = 0
+            while pc < len(program):
+                steps += 1
+                self.assertLess(steps, 100000, "Symbolic program does not terminate")
+                word = program[pc]
+                op, dest, src1, src2, imm = (word >> 26, (word >> 18) & 0xFF, (word >> 10) & 0xFF,
+                                             (word >> 2) & 0xFF, word & 0x3)
+                pc += 1
+                if op == 3 and imm == 0:
+                    regs[dest] = mem.get(src1, 0)
+                elif op == 3 and imm == 1:
+                    mem[dest] = regs[src1]
+                elif op == 3 and imm == 2:
+                    regs[dest] = mem.get(regs[src1], 0)
+                elif op == 3 and imm == 3:
+                    mem[regs[dest]] = regs[src1]
+                elif op == 4:
+                    regs[dest] = (regs[src1] + regs[src2]) & mask
+                elif op == 5:
+                    regs[dest] = (regs[src1] - regs[src2]) & mask
+                elif op == 6:
+                    regs[dest] = (regs[src1] * regs[src2]) & mask
+                elif op == 10:
+                    regs[dest] = regs[src1] ^ regs[src2]
+                elif op == 11:
+                    regs[dest] = ~regs[src1] & mask
+                elif op == 15 and regs[src1] == 0:
+                    pc = dest
+                elif op == 16 and regs[src1] != 0:
+                    pc = dest
+            return [mem.get(c_base + n, 0) for n in range(rows * cols)]
+        
+        for rows, cols, common in [(1, 1, 1), (2, 3, 4), (5, 2, 3)]:
+            a = [i + 1 for i in range(rows * common)]
+            b = [2 * i + 1 for i in range(common * cols)]
+            expected = [sum(a[i * common + k] * b[k * cols + j] for k in range(common))
+                        for i in range(rows) for j in range(cols)]
+            self.assertEqual(run(rows, cols, common, a, b), expected, f"Wrong result for {rows}x{cols}x{common}")
+        
+        # Empty matrices skip the loops and terminate
+        self.assertEqual(run(0, 3, 2, [], []), [])
+    
+    def test_invalid_tile_shape(self):
+        """Test rejection of malformed tile shapes"""
+        
+        test_file = os.path.join(self.temp_dir.name, "test_invalid_tile.cpp")
+        with open(test_file, "w") as f:
+            f.write("void matrixMultiply(int* A, int* B, int* C) {}\n")
+        
+        result = subprocess.run(
+            [self.compiler_path, "--tile", "2x0", test_file],
+            capture_output=True,
+            text=True
+        )
+        self.assertNotEqual(result.returncode, 0, "Malformed tile shape should be rejected")
+        self.assertIn("Invalid tile shape", result.stderr)
+
 if __name__ == "__main__":
     unittest.main()
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""
+Test script for packed int8/int16 precision
+"""
+
+import os
+import re
+import sys
+import json
+import subprocess
+import tempfile
+import unittest
+
+KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            C[i * cols + j] = 0;
+            for (int k = 0; k < common; k++) {
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+            }
+        }
+    }
+}
+"""
+
+class PrecisionTest(unittest.TestCase):
+    
+    def setUp(self):
+        # Paths to the compiler and simulator executables
+        self.compiler_path = os.path.join("..", "build", "pim_compiler")
+        self.simulator_path = os.path.join("..", "build", "pim_sim")
+        
+        # Check if both executables exist
+        if not os.path.exists(self.compiler_path) or not os.path.exists(self.simulator_path):
+            self.skipTest("Compiler or simulator executable not found. Build the project first.")
+        
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.source_file = os.path.join(self.temp_dir.name, "kernel.cpp")
+        with open(self.source_file, "w") as f:
+            f.write(KERNEL)
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def compile(self, name, *options):
+        """Compile the kernel, returning the program path and its text"""
+        output_file = os.path.join(self.temp_dir.name, name)
+        result = subprocess.run(
+            [self.compiler_path, *options, "-o", output_file, self.source_file],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(output_file, "r") as f:
+            return output_file, f.read()
+    
+    def simulate(self, program, dims):
+        """Simulate a program, checking its result, and return the JSON report"""
+        result = subprocess.run(
+            [self.simulator_path, "--json", "--dims", dims, program],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        report = json.loads(result.stdout)
+        self.assertTrue(report["correct"])
+        return report
+    
+    def count_opcode(self, code, opcode):
+        return len(re.findall(rf"^{opcode} ", code, re.MULTILINE))
+    
+    def test_packed_untiled(self):
+        """Test that each MAC of an untiled program covers several k"""
+        for precision, lanes in [("int8", 4), ("int16", 2)]:
+            with self.subTest(precision=precision):
+                program, code = self.compile(f"{precision}.pim", "--precision", precision,
+                                             "--no-tiling", "--no-coalesce", "--dims", "3x5x10")
+                words = -(-10 // lanes)
+                self.assertTrue(code.startswith(f"CONFIG 2, {32 // lanes}, {lanes} ;"))
+                self.assertEqual(self.count_opcode(code, "MAC"), 3 * 5 * words)
+                self.assertEqual(self.count_opcode(code, "LOAD"), 3 * words + words * 5 + 3 * 5)
+                
+                report = self.simulate(program, "3x5x10")
+                self.assertEqual(report["precision"], 32 // lanes)
+                self.assertEqual(report["lanes"], lanes)
+    
+    def test_packed_tiled(self):
+        """Test tiled programs with packed slices"""
+        _, wide = self.compile("int32.pim", "--dims", "20x18x37")
+        program, code = self.compile("int8.pim", "--precision", "int8", "--dims", "20x18x37")
+        self.assertLess(self.count_opcode(code, "MAC") * 3, self.count_opcode(wide, "MAC"))
+        
+        report = self.simulate(program, "20x18x37")
+        wide_report = self.simulate(os.path.join(self.temp_dir.name, "int32.pim"), "20x18x37")
+        self.assertLess(report["host_bytes_loaded"] * 3, wide_report["host_bytes_loaded"])
+        self.assertLess(report["cycles"], wide_report["cycles"])
+    
+    def test_default_precision_unchanged(self):
+        """Test that 32-bit programs carry no precision configuration"""
+        _, default = self.compile("default.pim", "--no-tiling", "--dims", "3x4x5")
+        _, explicit = self.compile("int32.pim", "--precision", "int32", "--no-tiling", "--dims", "3x4x5")
+        self.assertEqual(default, explicit)
+        self.assertNotRegex(default, r"CONFIG 2, \d+, \d+")
+    
+    def test_invalid_options(self):
+        """Test unsupported precisions and symbolic dimensions"""
+        result = subprocess.run([self.compiler_path, "--precision", "int4", self.source_file],
+                                capture_output=True, text=True)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("Unknown precision", result.stderr)
+        
+        output_file = os.path.join(self.temp_dir.name, "symbolic.pim")
+        result = subprocess.run([self.compiler_path, "--precision", "int8", "--symbolic",
+                                 "-o", output_file, self.source_file],
+                                capture_output=True, text=True)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("not supported with symbolic dimensions", result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+Test script for the source refactoring assistant
+"""
+
+import os
+import re
+import sys
+import shutil
+import subprocess
+import tempfile
+import time
+import unittest
+
+KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    // Initialize result matrix to zero
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            C[i * cols + j] = 0;
+        }
+    }
+
+    /* Loop order i-j-k, { unbalanced } in a comment */
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            for (int k = 0; k < common; k++) {
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+            }
+        }
+    }
+}
+
+void matrixMultiplyFixed(float A[12][20], float B[20][9], float C[12][9]) {
+    const char* note = "for (int x = 0; x < 4; x++) {";
+    for (int i = 0; i < 12; i++) {
+        for (int j = 0; j < 9; j++) {
+            C[i][j] = 0;
+        }
+    }
+    for (int i = 0; i < 12; i++) {
+        for (int j = 0; j < 9; j++) {
+            for (int k = 0; k < 20; k++) {
+                C[i][j] += A[i][k] * B[k][j];
+            }
+        }
+    }
+}
+"""
+
+# Runs both kernels of KERNEL on odd sizes and prints the results
+HARNESS = """
+#include <cstdio>
+#include <vector>
+
+%s
+
+int main() {
+    const int rows = 13, cols = 11, common = 17;
+    std::vector<int> A(rows * common), B(common * cols), C(rows * cols);
+    for (int i = 0; i < rows * common; i++) A[i] = i %% 7 - 3;
+    for (int i = 0; i < common * cols; i++) B[i] = i %% 5 - 2;
+    matrixMultiply(A.data(), B.data(), C.data(), rows, cols, common);
+    for (int value : C) std::printf("%%d ", value);
+
+    float FA[12][20], FB[20][9], FC[12][9];
+    for (int i = 0; i < 12; i++) for (int k = 0; k < 20; k++) FA[i][k] = (i + 2 * k) %% 5;
+    for (int k = 0; k < 20; k++) for (int j = 0; j < 9; j++) FB[k][j] = (3 * k + j) %% 4;
+    matrixMultiplyFixed(FA, FB, FC);
+    for (int i = 0; i < 12; i++) for (int j = 0; j < 9; j++) std::printf("%%g ", FC[i][j]);
+    return 0;
+}
+"""
+
+class RefactoringTest(unittest.TestCase):
+
+    def setUp(self):
+        # Path to the compiler executable
+        self.compiler_path = os.path.join("..", "build", "pim_compiler")
+
+        # Check if the compiler executable exists
+        if not os.path.exists(self.compiler_path):
+            self.skipTest("Compiler executable not found. Build the project first.")
+
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+
+    def refactor(self, source, name="kernel.cpp"):
+        """Run the refactoring assistant alone, returning its suggestions as (description, original, refactored)"""
+        source_file = os.path.join(self.temp_dir.name, name)
+        with open(source_file, "w") as f:
+            f.write(source)
+        result = subprocess.run(
+            [self.compiler_path, "--refactor-only", source_file],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stderr)
+
+        suggestions = []
+        output = result.stdout.split("\nRefactored code written to:")[0]
+        for section in re.split(r"\nSuggestion \d+: ", output)[1:]:
+            description, rest = section.split("\n", 1)
+            original, refactored = rest.split("Original code:\n", 1)[1].split("\n\nSuggested refactoring:\n")
+            suggestions.append((description, original, refactored.rstrip("\n")))
+        return suggestions
+
+    def run_harness(self, kernel, name):
+        """Compile and run the harness around a kernel with the host compiler, returning its output"""
+        source_file = os.path.join(self.temp_dir.name, name + ".cpp")
+        binary = os.path.join(self.temp_dir.name, name)
+        with open(source_file, "w") as f:
+            f.write(HARNESS % kernel)
+        result = subprocess.run([self.host_compiler, "-std=c++17", "-o", binary, source_file],
+                                capture_output=True, text=True)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        return subprocess.run([binary], capture_output=True, text=True, check=True).stdout
+
+    def test_suggestions(self):
+        """Test that every rule is suggested for each kernel nest, once per function"""
+        descriptions = [description for description, _, _ in self.refactor(KERNEL)]
+        self.assertEqual(len(descriptions), 6)
+        for function in ["matrixMultiply ", "matrixMultiplyFixed "]:
+            for rule in ["Reorder loops", "transposed matrices", "blocking/tiling"]:
+                self.assertEqual(len([d for d in descriptions if rule in d and " in " + function in d]), 1,
+                                 rule + " for " + function)
+
+    def test_refactored_code_is_equivalent(self):
+        """Test that each suggested refactoring compiles and computes the same results"""
+        self.host_compiler = shutil.which("c++") or shutil.which("g++")
+        if not self.host_compiler:
+            self.skipTest("No host C++ compiler found")
+
+        expected = self.run_harness(KERNEL, "original")
+        for index, (description, original, refactored) in enumerate(self.refactor(KERNEL)):
+            self.assertIn(original, KERNEL)
+            actual = self.run_harness(KERNEL.replace(original, refactored), "refactored%d" % index)
+            self.assertEqual(actual, expected, description)
+
+    def test_optimized_order_is_kept(self):
+        """Test that no interchange is suggested for a nest that is already i-k-j"""
+        source = KERNEL.replace(
+            "for (int j = 0; j < cols; j++) {\n            for (int k = 0; k < common; k++) {",
+            "for (int k = 0; k < common; k++) {\n            for (int j = 0; j < cols; j++) {")
+        descriptions = [description for description, _, _ in self.refactor(source)]
+        self.assertFalse(any("Reorder loops" in d and "in matrixMultiply " in d for d in descriptions))
+        self.assertTrue(any("Reorder loops" in d and "in matrixMultiplyFixed " in d for d in descriptions))
+
+    def test_commented_code_is_ignored(self):
+        """Test that loop nests in comments and strings are not refactored"""
+        source = "// " + KERNEL.replace("\n", "\n// ") + '\nconst char* text = "for (i = 0; i < n; i++) {";\n'
+        self.assertEqual(self.refactor(source), [])
+
+    def test_large_source(self):
+        """Test that the analysis of a large source takes time linear in its size"""
+        filler = "int table[] = {" + ", ".join(str(i % 97) for i in range(50000)) + "};\n"
+        kernels = [KERNEL.replace("matrixMultiply", "kernel%d_" % i) for i in range(200)]
+
+        start = time.time()
+        suggestions = self.refactor(filler + "".join(kernels) + filler, "large.cpp")
+        elapsed = time.time() - start
+
+        self.assertEqual(len(suggestions), 6 * 200)
+        self.assertLess(elapsed, 20.0)
+
+if __name__ == "__main__":
+    unittest.main()
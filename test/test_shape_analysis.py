@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""
+Test script for the matrix shape analysis of the PIM compiler
+"""
+
+import re
+import unittest
+
+from pim_test_util import PIMTestCase, gemm_ir
+
+# Triple loop nest over global 2D arrays with constant trip counts
+GLOBAL_ARRAY_KERNEL = gemm_ir(4, 5, 3, name="matmul", accumulate=True)
+
+# Loops bounded by arguments, called with constant sizes
+CALL_SITE_KERNEL = """
+define void @gemm(i32* %A, i32* %B, i32* %C, i32 %m, i32 %n, i32 %p) {
+entry:
+  br label %i.cond
+i.cond:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %i.inc ]
+  %i.ok = icmp slt i32 %i, %m
+  br i1 %i.ok, label %j.cond, label %exit
+j.cond:
+  %j = phi i32 [ 0, %i.cond ], [ %j.next, %j.inc ]
+  %j.ok = icmp slt i32 %j, %p
+  br i1 %j.ok, label %k.cond, label %i.inc
+k.cond:
+  %k = phi i32 [ 0, %j.cond ], [ %k.next, %k.body ]
+  %k.ok = icmp slt i32 %k, %n
+  br i1 %k.ok, label %k.body, label %j.inc
+k.body:
+  %ik = mul i32 %i, %n
+  %a.idx = add i32 %ik, %k
+  %kj = mul i32 %k, %p
+  %b.idx = add i32 %kj, %j
+  %ij = mul i32 %i, %p
+  %c.idx = add i32 %ij, %j
+  %a.ptr = getelementptr i32, i32* %A, i32 %a.idx
+  %b.ptr = getelementptr i32, i32* %B, i32 %b.idx
+  %c.ptr = getelementptr i32, i32* %C, i32 %c.idx
+  %a = load i32, i32* %a.ptr
+  %b = load i32, i32* %b.ptr
+  %c = load i32, i32* %c.ptr
+  %prod = mul i32 %a, %b
+  %sum = add i32 %c, %prod
+  store i32 %sum, i32* %c.ptr
+  %k.next = add i32 %k, 1
+  br label %k.cond
+j.inc:
+  %j.next = add i32 %j, 1
+  br label %j.cond
+i.inc:
+  %i.next = add i32 %i, 1
+  br label %i.cond
+exit:
+  ret void
+}
+
+define void @driver(i32* %A, i32* %B, i32* %C) {
+entry:
+  call void @gemm(i32* %A, i32* %B, i32* %C, i32 6, i32 4, i32 2)
+  ret void
+}
+"""
+
+class ShapeAnalysisTest(PIMTestCase):
+    
+    TOOLS = ("pim_compiler",)
+        
+    def compile(self, name, source, *options, suffix=".ll"):
+        """
+        Compile source with verbose output, returning the log and the PIM code.
+        ISA version 1 keeps one MUL and one LOAD or STORE per element to count
+        """
+        program, log = super().compile(name, source, "--isa", "v1", *options, suffix=suffix)
+        return log, self.read(program)
+    
+    def count_opcode(self, code, opcode):
+        return len(re.findall(rf"^{opcode} ", code, re.MULTILINE))
+    
+    def test_constant_trip_counts(self):
+        """Test that dimensions are inferred from constant loop bounds"""
+        log, code = self.compile("global_arrays", GLOBAL_ARRAY_KERNEL, "--no-tiling")
+        
+        self.assertIn("Inferred shape of matmul: 4x3 * 3x5", log)
+        
+        # A (4x3) and B (3x5) are loaded, C (4x5) is zeroed and stored
+        self.assertEqual(self.count_opcode(code, "LOAD"), 4*3 + 3*5 + 4*5)
+        self.assertEqual(self.count_opcode(code, "STORE"), 4*5)
+        self.assertEqual(self.count_opcode(code, "MUL"), 4*5*3)
+        self.assertIn("CONFIG 0, 12 ;", code)
+        self.assertIn("CONFIG 1, 15 ;", code)
+        self.assertIn("CONFIG 2, 20 ;", code)
+    
+    def test_call_site_constants(self):
+        """Test that argument-bounded loops take their sizes from the call sites"""
+        log, code = self.compile("call_site", CALL_SITE_KERNEL, "--no-tiling")
+        
+        self.assertIn("Inferred shape of gemm: 6x4 * 4x2", log)
+        
+        # The caller has no loop nest and produces no instructions
+        self.assertIn("Skipping function without a matrix multiplication: driver", log)
+        self.assertEqual(self.count_opcode(code, "MUL"), 6*2*4)
+        self.assertEqual(self.count_opcode(code, "STORE"), 6*2)
+    
+    def test_assumed_dimensions(self):
+        """Test that --dims supplies dimensions the IR does not determine"""
+        source = "void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {}\n"
+        log, code = self.compile("unknown", source, "--no-tiling", "--dims", "3x4x5", suffix=".cpp")
+        
+        self.assertIn("Inferred shape of matrixMultiply: 3x5 * 5x4", log)
+        self.assertEqual(self.count_opcode(code, "LOAD"), 3*5 + 5*4 + 3*4)
+        self.assertEqual(self.count_opcode(code, "STORE"), 3*4)
+    
+    def test_invalid_ir(self):
+        """Test that malformed LLVM IR is rejected"""
+        result, _ = self.try_compile("broken", "define void @broken( {\n")
+        
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("Failed to load LLVM IR", result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""
+Test script for kernels sharded over several PIM devices with a host schedule
+"""
+
+import os
+import re
+import random
+import unittest
+
+from pim_test_util import PIMTestCase, gemm_ir
+
+def gemm(rows, cols, common, weights=None):
+    return gemm_ir(rows, cols, common, b_values=weights, constant_b=weights is not None)
+
+class ShardingTest(PIMTestCase):
+    
+    def simulate(self, program):
+        return super().simulate(program, "--schedule", program + ".schedule")
+    
+    def traffic(self, program):
+        """Host words loaded, inter-device words, words stored and words reduced of kernel 0"""
+        match = re.search(r"(?m)^TRAFFIC 0 (\d+) (\d+) (\d+) (\d+)$", self.read(program + ".schedule"))
+        self.assertIsNotNone(match)
+        return [int(value) for value in match.groups()]
+    
+    def test_kernel_beyond_one_device(self):
+        """Test that a kernel over the dimension limit of one device compiles when sharded"""
+        source = gemm(2, 2, 2048)
+        result, _ = self.try_compile("unsharded", source)
+        self.assertNotEqual(result.returncode, 0)
+        self.assertIn("exceeds the matrix dimension limit of 1024", result.stderr)
+        
+        program, log = self.compile("sharded", source, "--devices", "2")
+        self.assertIn("Sharding gemm as common 1x1x2 on 2 devices", log)
+        self.assertRegex(self.read(program), r"(?m)^CONFIG 9, 1\b")
+        report = self.simulate(program)
+        self.assertEqual(report["devices"], 2)
+        self.assertEqual(len(report["device_cycles"]), 2)
+    
+    def test_every_strategy(self):
+        """Test that every partition computes the same product"""
+        for strategy in ["rows", "columns", "common", "2d", "summa"]:
+            with self.subTest(strategy=strategy):
+                program, log = self.compile(strategy, gemm(8, 8, 8), "--isa", "v2", "--devices", "4",
+                                            "--shard", strategy)
+                described = re.search(r"Sharding gemm as (\S+) (\S+) on (\d+) devices", log)
+                self.assertIsNotNone(described)
+                self.assertEqual(described.group(1), strategy)
+                if strategy == "2d":
+                    self.assertEqual(described.group(2), "2x2x1")
+                report = self.simulate(program)
+                self.assertEqual(sum(cycles > 0 for cycles in report["device_cycles"]), int(described.group(3)))
+        
+        # Left to choose, the planner keeps a kernel this small on one device
+        _, log = self.compile("auto", gemm(8, 8, 8), "--isa", "v2", "--devices", "4")
+        self.assertIn("Sharding gemm as rows 1x1x1 on 1 device", log)
+    
+    def test_summa_broadcasts_panels(self):
+        """Test that SUMMA loads every block from the host once and forwards it between devices"""
+        grid, _ = self.compile("grid", gemm(8, 8, 8), "--isa", "v2", "--devices", "4", "--shard", "2d")
+        summa, _ = self.compile("summa", gemm(8, 8, 8), "--isa", "v2", "--devices", "4", "--shard", "summa")
+        self.assertIn("BROADCAST 0 ", self.read(summa + ".schedule"))
+        grid_loaded, grid_inter, _, _ = self.traffic(grid)
+        summa_loaded, summa_inter, _, _ = self.traffic(summa)
+        self.assertEqual(grid_inter, 0)
+        self.assertGreater(summa_inter, 0)
+        self.assertLess(summa_loaded, grid_loaded)
+        self.assertEqual(self.simulate(summa)["inter_device_words"], summa_inter)
+    
+    def test_common_split_reduces(self):
+        """Test that slices of the common dimension are added up by the host"""
+        program, _ = self.compile("common", gemm(4, 4, 64), "--devices", "2", "--shard", "common")
+        schedule = self.read(program + ".schedule")
+        self.assertEqual(len(re.findall(r"(?m)^REDUCE 0 ", schedule)), 2)
+        self.assertNotIn("GATHER", schedule)
+        _, _, stored, reduced = self.traffic(program)
+        self.assertEqual(stored, 2 * 4 * 4)
+        self.assertEqual(reduced, 4 * 4)
+        self.simulate(program)
+    
+    def test_constant_weights_are_sliced(self):
+        """Test that every device carries its block of a constant B"""
+        rnd = random.Random(3)
+        weights = [[rnd.randint(-8, 7) for _ in range(8)] for _ in range(8)]
+        program, _ = self.compile("weights", gemm(8, 8, 8, weights), "--isa", "v2", "--devices", "2",
+                                  "--shard", "columns")
+        self.assertNotIn("SCATTER 0 B", self.read(program + ".schedule"))
+        self.assertRegex(self.read(program), r"(?m)^CONFIG 7, 2\b")
+        self.simulate(program)
+    
+    def test_infeasible_strategy(self):
+        """Test that a requested strategy that cannot apply is rejected with its reason"""
+        cases = [
+            (gemm(1, 8, 8), ["--devices", "2", "--shard", "rows"], "has one row of C"),
+            (gemm(8, 1, 8), ["--devices", "2", "--shard", "columns"], "has one column of C"),
+            (gemm(1, 8, 8), ["--devices", "4", "--shard", "2d"], "needs at least two rows and two columns of C"),
+            (gemm(8, 8, 8), ["--devices", "3", "--shard", "2d"], "needs at least 4 devices; 3 are configured"),
+            (gemm(4, 4, 4096), ["--devices", "2", "--shard", "rows"],
+             "leaves shards of 2x4x4096 or larger, beyond the per-device matrix dimension limit of 1024"),
+        ]
+        for source, options, reason in cases:
+            with self.subTest(options=options, reason=reason):
+                result, _ = self.try_compile("infeasible", source, *options)
+                self.assertNotEqual(result.returncode, 0)
+                self.assertIn(reason, result.stderr)
+    
+    def test_single_device_unchanged(self):
+        """Test that one device compiles exactly as without sharding"""
+        default, _ = self.compile("default", gemm(8, 8, 8))
+        single, log = self.compile("single", gemm(8, 8, 8), "--devices", "1")
+        self.assertEqual(self.read(default), self.read(single))
+        self.assertNotRegex(self.read(single), r"(?m)^CONFIG 9,")
+        self.assertFalse(os.path.exists(single + ".schedule"))
+        self.assertNotIn("Sharding", log)
+
+if __name__ == "__main__":
+    unittest.main()
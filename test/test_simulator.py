@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""
+Test script for the PIM simulator
+"""
+
+import os
+import re
+import sys
+import json
+import subprocess
+import tempfile
+import unittest
+
+KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            C[i * cols + j] = 0;
+            for (int k = 0; k < common; k++) {
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+            }
+        }
+    }
+}
+"""
+
+class PIMSimulatorTest(unittest.TestCase):
+    
+    def setUp(self):
+        # Paths to the compiler and simulator executables
+        self.compiler_path = os.path.join("..", "build", "pim_compiler")
+        self.simulator_path = os.path.join("..", "build", "pim_sim")
+        
+        # Check if both executables exist
+        if not os.path.exists(self.compiler_path) or not os.path.exists(self.simulator_path):
+            self.skipTest("Compiler or simulator executable not found. Build the project first.")
+        
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.source_file = os.path.join(self.temp_dir.name, "kernel.cpp")
+        with open(self.source_file, "w") as f:
+            f.write(KERNEL)
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def compile(self, name, *options):
+        """Compile the kernel, returning the path of the PIM program"""
+        output_file = os.path.join(self.temp_dir.name, name)
+        result = subprocess.run(
+            [self.compiler_path, *options, "-o", output_file, self.source_file],
+            capture_output=True,
+            text=True
+        )
+        
+        self.assertEqual(result.returncode, 0,
+                         f"Compilation of {name} failed with return code {result.returncode}. Error: {result.stderr}")
+        return output_file
+    
+    def simulate(self, program, *options):
+        """Run the simulator on a program, returning the process result"""
+        return subprocess.run(
+            [self.simulator_path, *options, program],
+            capture_output=True,
+            text=True
+        )
+    
+    def assertSimulationPasses(self, program, *options):
+        result = self.simulate(program, *options)
+        self.assertEqual(result.returncode, 0,
+                         f"Simulation of {program} {options} failed with return code {result.returncode}. "
+                         f"Output: {result.stdout} Error: {result.stderr}")
+        self.assertIn("Result check: PASS", result.stdout)
+        return result
+    
+    def test_default_program(self):
+        """Test that the default program computes the product and is reported"""
+        program = self.compile("default.pim")
+        result = self.assertSimulationPasses(program)
+        
+        cycles = int(re.search(r"^Cycles: (\d+)$", result.stdout, re.MULTILINE).group(1))
+        self.assertGreater(cycles, 0)
+        
+        # A and B (2x2 each) are loaded and C is stored, 4 bytes per element
+        self.assertIn("Host traffic: 32 bytes loaded, 16 bytes stored", result.stdout)
+        self.assertIn("Bank conflict stalls:", result.stdout)
+        self.assertIn("PE utilization: 1 of 128 PEs active", result.stdout)
+    
+    def test_untiled_dimensions(self):
+        """Test untiled programs of non-square shapes"""
+        program = self.compile("untiled.pim", "--no-tiling", "--dims", "3x4x5")
+        self.assertSimulationPasses(program, "--dims", "3x4x5")
+        
+        # Simulating with other dimensions than compiled for reads outside the operands
+        result = self.simulate(program, "--dims", "4x4x4")
+        self.assertEqual(result.returncode, 1)
+        self.assertRegex(result.stderr,
+                         r"Instruction \d+ \(LOAD(_BLOCK)? .*\) reads A\[\d+\]\[4\] outside the 4x4 operand")
+        
+        # Larger operands are read in range, and the result differs
+        result = self.simulate(program, "--dims", "4x5x6")
+        self.assertEqual(result.returncode, 2)
+        self.assertIn("Result check: FAIL", result.stdout)
+    
+    def test_tiled_program(self):
+        """Test that tiled programs run across the PE array"""
+        program = self.compile("tiled.pim", "--tile", "2x2x2", "--dims", "4x4x4")
+        result = self.assertSimulationPasses(program, "--dims", "4x4x4")
+        self.assertIn("PE utilization: 4 of 128 PEs active", result.stdout)
+    
+    def test_symbolic_program(self):
+        """Test that one symbolic program is correct for every launch shape"""
+        program = self.compile("symbolic.pim", "--symbolic")
+        
+        for dims in ["1x1x1", "2x2x2", "3x4x5", "7x2x3"]:
+            with self.subTest(dims=dims):
+                result = self.assertSimulationPasses(program, "--dims", dims)
+                self.assertIn("symbolic", result.stdout)
+                self.assertIn("bytes staged", result.stdout)
+    
+    def test_binary_program(self):
+        """Test that binary containers are decoded and simulated"""
+        program = self.compile("default.pimb", "--format", "binary")
+        self.assertSimulationPasses(program)
+    
+    def test_json_report(self):
+        """Test the machine-readable report"""
+        program = self.compile("default.pim")
+        result = self.simulate(program, "--json")
+        self.assertEqual(result.returncode, 0)
+        
+        report = json.loads(result.stdout)
+        self.assertTrue(report["correct"])
+        self.assertEqual(report["dims"], [2, 2, 2])
+        self.assertEqual(report["host_bytes_loaded"], 32)
+        self.assertEqual(report["host_bytes_stored"], 16)
+        self.assertGreater(report["cycles"], 0)
+        self.assertIn("0", report["pe_utilization"])
+    
+    def test_invalid_program(self):
+        """Test that malformed programs are rejected"""
+        program = os.path.join(self.temp_dir.name, "broken.pim")
+        with open(program, "w") as f:
+            f.write("FROB 1, 2\n")
+        
+        result = self.simulate(program)
+        self.assertEqual(result.returncode, 1)
+        self.assertIn("Error:", result.stderr)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+"""
+Test script for kernels skipping the zero elements of a sparse B
+"""
+
+import re
+import random
+import unittest
+
+from pim_test_util import PIMTestCase, gemm_ir, ir_array
+
+# Compressed arrays of B: pointers @ptr, indices @idx and the nonzeros @val
+COMPRESSED_GLOBALS = """
+@A = global [{rows} x [{common} x i32]] zeroinitializer
+@C = global [{rows} x [{cols} x i32]] zeroinitializer
+@ptr = constant [{pointers} x i32] {ptr}
+@idx = constant [{nonzeros} x i32] {idx}
+@val = global [{nonzeros} x i32] {val}
+"""
+
+# C[i][idx[p]] += A[i][k] * val[p] for p in [ptr[k], ptr[k + 1])
+CSR_KERNEL = COMPRESSED_GLOBALS + """
+define void @spmm() {{
+entry:
+  br label %i.loop
+i.loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %i.latch ]
+  br label %k.loop
+k.loop:
+  %k = phi i64 [ 0, %i.loop ], [ %k.next, %k.latch ]
+  %a.ptr = getelementptr [{rows} x [{common} x i32]], [{rows} x [{common} x i32]]* @A, i64 0, i64 %i, i64 %k
+  %a = load i32, i32* %a.ptr
+  %start.ptr = getelementptr [{pointers} x i32], [{pointers} x i32]* @ptr, i64 0, i64 %k
+  %start = load i32, i32* %start.ptr
+  %k.next = add i64 %k, 1
+  %end.ptr = getelementptr [{pointers} x i32], [{pointers} x i32]* @ptr, i64 0, i64 %k.next
+  %end = load i32, i32* %end.ptr
+  %start64 = sext i32 %start to i64
+  %end64 = sext i32 %end to i64
+  %empty = icmp sge i64 %start64, %end64
+  br i1 %empty, label %k.latch, label %p.loop
+p.loop:
+  %p = phi i64 [ %start64, %k.loop ], [ %p.next, %p.loop ]
+  %col.ptr = getelementptr [{nonzeros} x i32], [{nonzeros} x i32]* @idx, i64 0, i64 %p
+  %col = load i32, i32* %col.ptr
+  %col64 = sext i32 %col to i64
+  %v.ptr = getelementptr [{nonzeros} x i32], [{nonzeros} x i32]* @val, i64 0, i64 %p
+  %v = load i32, i32* %v.ptr
+  %c.ptr = getelementptr [{rows} x [{cols} x i32]], [{rows} x [{cols} x i32]]* @C, i64 0, i64 %i, i64 %col64
+  %c = load i32, i32* %c.ptr
+  %prod = mul i32 %a, %v
+  %s = add i32 %c, %prod
+  store i32 %s, i32* %c.ptr
+  %p.next = add i64 %p, 1
+  %p.done = icmp eq i64 %p.next, %end64
+  br i1 %p.done, label %k.latch, label %p.loop
+k.latch:
+  %k.done = icmp eq i64 %k.next, {common}
+  br i1 %k.done, label %i.latch, label %k.loop
+i.latch:
+  %i.next = add i64 %i, 1
+  %i.done = icmp eq i64 %i.next, {rows}
+  br i1 %i.done, label %exit, label %i.loop
+exit:
+  ret void
+}}
+"""
+
+# C[i][j] = sum of A[i][idx[p]] * val[p] for p in [ptr[j], ptr[j + 1])
+CSC_KERNEL = COMPRESSED_GLOBALS + """
+define void @spmm() {{
+entry:
+  br label %i.loop
+i.loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %i.latch ]
+  br label %j.loop
+j.loop:
+  %j = phi i64 [ 0, %i.loop ], [ %j.next, %j.latch ]
+  %start.ptr = getelementptr [{pointers} x i32], [{pointers} x i32]* @ptr, i64 0, i64 %j
+  %start = load i32, i32* %start.ptr
+  %j.next = add i64 %j, 1
+  %end.ptr = getelementptr [{pointers} x i32], [{pointers} x i32]* @ptr, i64 0, i64 %j.next
+  %end = load i32, i32* %end.ptr
+  %start64 = sext i32 %start to i64
+  %end64 = sext i32 %end to i64
+  %empty = icmp sge i64 %start64, %end64
+  br i1 %empty, label %j.latch, label %p.loop
+p.loop:
+  %p = phi i64 [ %start64, %j.loop ], [ %p.next, %p.loop ]
+  %sum = phi i32 [ 0, %j.loop ], [ %sum.next, %p.loop ]
+  %row.ptr = getelementptr [{nonzeros} x i32], [{nonzeros} x i32]* @idx, i64 0, i64 %p
+  %row = load i32, i32* %row.ptr
+  %row64 = sext i32 %row to i64
+  %a.ptr = getelementptr [{rows} x [{common} x i32]], [{rows} x [{common} x i32]]* @A, i64 0, i64 %i, i64 %row64
+  %a = load i32, i32* %a.ptr
+  %v.ptr = getelementptr [{nonzeros} x i32], [{nonzeros} x i32]* @val, i64 0, i64 %p
+  %v = load i32, i32* %v.ptr
+  %prod = mul i32 %a, %v
+  %sum.next = add i32 %sum, %prod
+  %p.next = add i64 %p, 1
+  %p.done = icmp eq i64 %p.next, %end64
+  br i1 %p.done, label %j.latch, label %p.loop
+j.latch:
+  %result = phi i32 [ 0, %j.loop ], [ %sum.next, %p.loop ]
+  %c.ptr = getelementptr [{rows} x [{cols} x i32]], [{rows} x [{cols} x i32]]* @C, i64 0, i64 %i, i64 %j
+  store i32 %result, i32* %c.ptr
+  %j.done = icmp eq i64 %j.next, {cols}
+  br i1 %j.done, label %i.latch, label %j.loop
+i.latch:
+  %i.next = add i64 %i, 1
+  %i.done = icmp eq i64 %i.next, {rows}
+  br i1 %i.done, label %exit, label %i.loop
+exit:
+  ret void
+}}
+"""
+
+def random_matrix(rows, cols, density, block=(1, 1), seed=1):
+    """Random rows x cols matrix whose block x block submatrices are nonzero with the given density"""
+    rnd = random.Random(seed)
+    nonzero = {}
+    matrix = [[0] * cols for _ in range(rows)]
+    for r in range(rows):
+        for c in range(cols):
+            key = (r // block[0], c // block[1])
+            if key not in nonzero:
+                nonzero[key] = rnd.random() < density
+            if nonzero[key]:
+                matrix[r][c] = rnd.randrange(1, 8) * rnd.choice([-1, 1])
+    return matrix
+
+def gemm_kernel(rows, cols, common, matrix, kind="constant"):
+    """C = A * B with B held in a "constant" (sparse weights) or "global" array"""
+    return gemm_ir(rows, cols, common, b_values=matrix, constant_b=kind == "constant")
+
+def compressed_kernel(template, rows, cols, common, matrix):
+    """Compress B by rows for CSR_KERNEL and by columns for CSC_KERNEL"""
+    by_rows = template is CSR_KERNEL
+    outer, inner = (common, cols) if by_rows else (cols, common)
+    ptr, idx, val = [0], [], []
+    for x in range(outer):
+        for y in range(inner):
+            value = matrix[x][y] if by_rows else matrix[y][x]
+            if value != 0:
+                idx.append(y)
+                val.append(value)
+        ptr.append(len(idx))
+    return template.format(rows=rows, cols=cols, common=common, pointers=len(ptr), nonzeros=len(idx),
+                           ptr=ir_array(ptr), idx=ir_array(idx), val=ir_array(val))
+
+class SparseTest(PIMTestCase):
+    
+    def compile(self, name, source, *options):
+        """Compile an IR kernel, returning the program path, the log and the program text"""
+        program, log = super().compile(name, source, *options)
+        return program, log, self.read(program)
+    
+    def simulate(self, program, dims, matrix):
+        return super().simulate(program, "--dims", dims, matrix_b=matrix)
+    
+    def count_opcode(self, code, opcode):
+        return len(re.findall(rf"^{opcode} ", code, re.MULTILINE))
+    
+    def test_constant_sparse_b(self):
+        """Test that the zeros of a constant B are neither loaded nor multiplied"""
+        matrix = random_matrix(24, 20, 0.2)
+        sparse = gemm_kernel(12, 20, 24, matrix)
+        dense = gemm_kernel(12, 20, 24, matrix, kind="global")
+        for options in [("--no-tiling",), ("--no-tiling", "--isa", "v2"), ("--tile", "4x4x4"),
+                        ("--tile", "4x4x2", "--tile-order", "ikj")]:
+            with self.subTest(options=options):
+                program, log, code = self.compile("sparse", sparse, *options)
+                self.assertIn("Inferred shape of gemm: 12x24 * 24x20 (B constant, ", log)
+                self.assertIn("Skipping the zeros of B", log)
+                sparse_report = self.simulate(program, "12x20x24", matrix)
+                
+                program, _, dense_code = self.compile("dense", dense, *options)
+                dense_report = self.simulate(program, "12x20x24", matrix)
+                self.assertLess(sparse_report["host_bytes_loaded"], dense_report["host_bytes_loaded"])
+                self.assertLessEqual(len(code.splitlines()), len(dense_code.splitlines()))
+        
+        # Untiled programs load only the stored words of B
+        _, _, code = self.compile("sparse", sparse, "--no-tiling")
+        _, _, dense_code = self.compile("dense", dense, "--no-tiling")
+        self.assertLess(self.count_opcode(code, "MAC"), self.count_opcode(dense_code, "MAC"))
+    
+    def test_zero_blocks(self):
+        """Test that tiles skip the slices over zero blocks of B and still store C"""
+        matrix = random_matrix(64, 32, 0.25, block=(8, 8), seed=2)
+        sparse = gemm_kernel(32, 32, 64, matrix)
+        dense = gemm_kernel(32, 32, 64, matrix, kind="global")
+        for options in [(), ("--tile", "8x8x8"), ("--tile", "8x8x8", "--tile-order", "ikj")]:
+            with self.subTest(options=options):
+                program, log, code = self.compile("blocks", sparse, *options)
+                self.assertRegex(log, r"Skipped \d+ tile slices over zero blocks of B")
+                self.simulate(program, "32x32x64", matrix)
+                _, _, dense_code = self.compile("dense", dense, *options)
+                self.assertLess(len(code.splitlines()), len(dense_code.splitlines()))
+                self.assertEqual(self.count_opcode(code, "STORE"), self.count_opcode(dense_code, "STORE"))
+        
+        # A column of tiles over zeros only still stores its part of C
+        matrix = [[0] * 8 + row[8:] for row in matrix]
+        program, _, _ = self.compile("zero_column", gemm_kernel(32, 32, 64, matrix), "--tile", "8x8x8")
+        self.simulate(program, "32x32x64", matrix)
+    
+    def test_compressed_nests(self):
+        """Test that CSR and CSC loop nests are recognized as products with a sparse B"""
+        matrix = random_matrix(24, 20, 0.2, seed=3)
+        for template, format in [(CSR_KERNEL, "csr"), (CSC_KERNEL, "csc")]:
+            nonzeros = sum(1 for row in matrix for v in row if v != 0)
+            for options in [("--no-tiling",), ()]:
+                with self.subTest(format=format, options=options):
+                    program, log, _ = self.compile(format, compressed_kernel(template, 12, 20, 24, matrix), *options)
+                    self.assertIn(f"Inferred shape of spmm: 12x24 * 24x20 (B {format}, {nonzeros} of 480 nonzero)",
+                                  log)
+                    self.simulate(program, "12x20x24", matrix)
+    
+    def test_dense_constant(self):
+        """Test that a constant B without zeros compiles like a variable one when it is not folded"""
+        matrix = [[(r + c) % 5 + 1 for c in range(6)] for r in range(7)]
+        _, log, code = self.compile("constant", gemm_kernel(5, 6, 7, matrix), "--no-weight-folding")
+        self.assertNotIn("Skipping the zeros of B", log)
+        _, _, reference = self.compile("variable", gemm_kernel(5, 6, 7, matrix, kind="global"), "--no-weight-folding")
+        self.assertEqual(code, reference)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""
+Test script for the per-stage time report and the Chrome trace export
+"""
+
+import json
+import os
+import re
+import sys
+import subprocess
+import tempfile
+import unittest
+
+CPP_KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    for (int i = 0; i < rows; i++)
+        for (int j = 0; j < cols; j++)
+            for (int k = 0; k < common; k++)
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+}
+"""
+
+# Row of the stage table: wall time, share, calls, peak heap and the indented stage name
+REPORT_ROW = re.compile(r"^\s+([\d.]+)\s+([\d.]+)\s+(\d+)\s+([\d.]+ (?:B|KiB|MiB))  ( *)(\S.*)$", re.MULTILINE)
+
+class TimeReportTest(unittest.TestCase):
+
+    def setUp(self):
+        # Path to the compiler executable
+        self.compiler_path = os.path.join("..", "build", "pim_compiler")
+        
+        # Check if the compiler exists
+        if not os.path.exists(self.compiler_path):
+            self.skipTest("Compiler executable not found. Build the project first.")
+        
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.source = os.path.join(self.temp_dir.name, "kernel.cpp")
+        with open(self.source, "w") as f:
+            f.write(CPP_KERNEL)
+        self.output = os.path.join(self.temp_dir.name, "kernel.pim")
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def run_compiler(self, *args):
+        result = subprocess.run(
+            [self.compiler_path, "--dims", "8x8x8", *args, "-o", self.output, self.source],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stderr)
+        return result
+    
+    def report_rows(self, report):
+        """Map each stage to its (depth, calls) in the stage table"""
+        rows = {}
+        for match in REPORT_ROW.finditer(report):
+            rows.setdefault(match.group(6), (len(match.group(5)) // 2, int(match.group(3))))
+        return rows
+    
+    def test_report_lists_stages(self):
+        """Test that the report covers the pipeline stages and the backend phases"""
+        result = self.run_compiler("--no-tiling", "--time-report")
+        self.assertIn("PIM compiler time report", result.stderr)
+        self.assertNotIn("time report", result.stdout)
+        
+        rows = self.report_rows(result.stderr)
+        self.assertEqual(rows["Compile file"], (0, 1))
+        for stage in ["Parsing", "IR generation", "IR optimization", "Shape analysis",
+                      "Memory mapping", "Code generation", "Output writing"]:
+            with self.subTest(stage=stage):
+                self.assertEqual(rows[stage][0], 1)
+        for phase in ["Load generation", "Multiply generation", "Store generation"]:
+            with self.subTest(phase=phase):
+                self.assertEqual(rows[phase][0], 3)
+        
+        # IR passes are nested in the optimization stage and LLVM's table follows
+        self.assertEqual(rows["InstCombinePass"], (2, 2))
+        self.assertIn("Pass execution timing report", result.stderr)
+    
+    def test_no_report_by_default(self):
+        """Test that nothing is reported without the options"""
+        result = self.run_compiler()
+        self.assertNotIn("time report", result.stderr)
+    
+    def test_tiled_and_parallel_stages(self):
+        """Test that tiled generation and parallel workers appear as stages"""
+        rows = self.report_rows(self.run_compiler("--tile", "2x2x2", "--time-report").stderr)
+        self.assertIn("Tiled generation", rows)
+        
+        rows = self.report_rows(self.run_compiler("--no-tiling", "-j", "2", "--time-report").stderr)
+        self.assertEqual(rows["Parallel worker"][0], 0)
+        self.assertIn("Module copy", rows)
+        self.assertIn("Section linking", rows)
+    
+    def test_trace_events(self):
+        """Test that the trace is valid JSON whose events nest within their parents"""
+        trace_file = os.path.join(self.temp_dir.name, "trace.json")
+        result = self.run_compiler("--no-tiling", "--time-trace", trace_file)
+        self.assertNotIn("time report", result.stderr)
+        
+        with open(trace_file) as f:
+            trace = json.load(f)
+        events = [event for event in trace["traceEvents"] if event["ph"] == "X"]
+        self.assertTrue(events)
+        by_path = {}
+        for event in events:
+            self.assertGreaterEqual(event["dur"], 0)
+            self.assertGreaterEqual(event["args"]["peak_heap_bytes"], 0)
+            by_path.setdefault(event["args"]["path"], event)
+        
+        compile_event = by_path["Compile file"]
+        self.assertEqual(compile_event["args"]["detail"], self.source)
+        for path, event in by_path.items():
+            if "/" not in path:
+                continue
+            parent = by_path[path.rsplit("/", 1)[0]]
+            with self.subTest(path=path):
+                self.assertEqual(event["tid"], parent["tid"])
+                self.assertGreaterEqual(event["ts"], parent["ts"])
+                self.assertLessEqual(event["ts"] + event["dur"], parent["ts"] + parent["dur"])
+        self.assertIn("Compile file/Code generation/Kernel lowering/Multiply generation", by_path)
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""
+Test script for coalescing host transfers into block transfers
+"""
+
+import os
+import re
+import sys
+import json
+import subprocess
+import tempfile
+import unittest
+
+KERNEL = """
+void matrixMultiply(int* A, int* B, int* C, int rows, int cols, int common) {
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            C[i * cols + j] = 0;
+            for (int k = 0; k < common; k++) {
+                C[i * cols + j] += A[i * common + k] * B[k * cols + j];
+            }
+        }
+    }
+}
+"""
+
+class TransferCoalescingTest(unittest.TestCase):
+    
+    def setUp(self):
+        # Paths to the compiler and simulator executables
+        self.compiler_path = os.path.join("..", "build", "pim_compiler")
+        self.simulator_path = os.path.join("..", "build", "pim_sim")
+        
+        # Check if both executables exist
+        if not os.path.exists(self.compiler_path) or not os.path.exists(self.simulator_path):
+            self.skipTest("Compiler or simulator executable not found. Build the project first.")
+        
+        # Create a temporary directory for test files
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.source_file = os.path.join(self.temp_dir.name, "kernel.cpp")
+        with open(self.source_file, "w") as f:
+            f.write(KERNEL)
+    
+    def tearDown(self):
+        # Clean up the temporary directory
+        self.temp_dir.cleanup()
+    
+    def run_compiler(self, name, *options):
+        output_file = os.path.join(self.temp_dir.name, name)
+        result = subprocess.run(
+            [self.compiler_path, *options, "-o", output_file, self.source_file],
+            capture_output=True,
+            text=True
+        )
+        return output_file, result
+    
+    def compile(self, name, *options):
+        """Compile the kernel, returning the program path and its text"""
+        output_file, result = self.run_compiler(name, *options)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        with open(output_file, "r", errors="replace") as f:
+            return output_file, f.read()
+    
+    def simulate(self, program, dims):
+        """Simulate a program, checking its result, and return the JSON report"""
+        result = subprocess.run(
+            [self.simulator_path, "--json", "--dims", dims, program],
+            capture_output=True,
+            text=True
+        )
+        self.assertEqual(result.returncode, 0, result.stdout + result.stderr)
+        report = json.loads(result.stdout)
+        self.assertTrue(report["correct"])
+        return report
+    
+    def transfers(self, code):
+        """Count host transfers and the words they move"""
+        instructions = words = 0
+        for line in code.splitlines():
+            block = re.match(r"^(LOAD|STORE)_BLOCK \d+, \d+, (\d+), ([01])", line)
+            if block:
+                instructions += 1
+                words += int(block.group(2))
+            elif re.match(r"^(LOAD|STORE) ", line):
+                instructions += 1
+                words += 1
+        return instructions, words
+    
+    def compile_log(self, *options):
+        """Compile verbosely, returning the log"""
+        _, result = self.run_compiler("verbose.pim", "-v", *options)
+        self.assertEqual(result.returncode, 0, result.stderr)
+        return result.stdout + result.stderr
+    
+    def test_untiled_runs(self):
+        """Test that rows of untiled operands become one burst each"""
+        for dims in ["16x24x16", "5x7x9", "3x32x16"]:
+            with self.subTest(dims=dims):
+                scalar, scalar_code = self.compile("scalar.pim", "--no-tiling", "--dims", dims,
+                                                   "--isa", "v2", "--no-coalesce")
+                burst, burst_code = self.compile("burst.pim", "--no-tiling", "--dims", dims, "--isa", "v2")
+                scalar_count, scalar_words = self.transfers(scalar_code)
+                burst_count, burst_words = self.transfers(burst_code)
+                self.assertEqual(scalar_count, scalar_words)
+                self.assertEqual(burst_words, scalar_words)
+                
+                # Every run is at least a row of the shortest matrix dimension
+                rows, cols, common = map(int, dims.split("x"))
+                self.assertLessEqual(burst_count * min(rows, cols, common), scalar_count)
+                
+                scalar_report = self.simulate(scalar, dims)
+                burst_report = self.simulate(burst, dims)
+                self.assertEqual(burst_report["host_bytes_loaded"], scalar_report["host_bytes_loaded"])
+                self.assertEqual(burst_report["host_bytes_stored"], scalar_report["host_bytes_stored"])
+                self.assertLess(burst_report["cycles"], scalar_report["cycles"])
+    
+    def test_column_bursts(self):
+        """Test that a column-major B is loaded with bursts down its columns"""
+        program, code = self.compile("kernel.pim", "--no-tiling", "--dims", "16x16x16", "--isa", "v2")
+        self.assertIn("B column-major", self.compile_log("--no-tiling", "--dims", "16x16x16", "--isa", "v2"))
+        columns = re.findall(r"^LOAD_BLOCK \d+, 2, 16, 1", code, re.MULTILINE)
+        self.assertEqual(len(columns), 16)
+        self.simulate(program, "16x16x16")
+    
+    def test_scheduled_streams(self):
+        """Test that the transfers of every PE stream are coalesced"""
+        scalar, scalar_code = self.compile("scalar.pim", "--no-tiling", "--pe-schedule", "2d", "--dims", "8x8x8",
+                                           "--isa", "v2", "--no-coalesce")
+        burst, burst_code = self.compile("burst.pim", "--no-tiling", "--pe-schedule", "2d", "--dims", "8x8x8",
+                                         "--isa", "v2")
+        self.assertLess(self.transfers(burst_code)[0] * 2, self.transfers(scalar_code)[0])
+        self.assertEqual(len(re.findall(r"^CONFIG 4, ", burst_code, re.MULTILINE)),
+                         len(re.findall(r"^CONFIG 4, ", scalar_code, re.MULTILINE)))
+        self.assertLess(self.simulate(burst, "8x8x8")["cycles"], self.simulate(scalar, "8x8x8")["cycles"])
+    
+    def test_binary_output(self):
+        """Test that coalesced binaries simulate correctly"""
+        program, result = self.run_compiler("kernel.pimb", "--no-tiling", "--dims", "5x7x9", "--isa", "v2",
+                                            "--format", "binary")
+        self.assertEqual(result.returncode, 0, result.stderr)
+        self.simulate(program, "5x7x9")
+    
+    def test_version_1_unchanged(self):
+        """Test that version 1 programs keep one transfer per word"""
+        _, code = self.compile("v1.pim", "--no-tiling", "--dims", "5x7x9", "--isa", "v1")
+        _, scalar_code = self.compile("scalar.pim", "--no-tiling", "--dims", "5x7x9", "--isa", "v1", "--no-coalesce")
+        self.assertEqual(code, scalar_code)
+        self.assertNotIn("_BLOCK", code)
+
+if __name__ == "__main__":
+    unittest.main()